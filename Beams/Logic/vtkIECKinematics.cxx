@@ -0,0 +1,262 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// Beams includes
+#include "vtkIECKinematics.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkIECKinematics);
+
+namespace
+{
+  typedef vtkIECKinematics::CoordinateSystemIdentifier Frame;
+
+  //----------------------------------------------------------------------------
+  void SetIdentity(double matrix[16])
+  {
+    std::fill(matrix, matrix+16, 0.0);
+    matrix[0] = matrix[5] = matrix[10] = matrix[15] = 1.0;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Rotation around the Y axis, same as vtkTransform::RotateY on an identity transform
+  void SetRotationY(double angleDegrees, double matrix[16])
+  {
+    SetIdentity(matrix);
+    double angle = vtkMath::RadiansFromDegrees(angleDegrees);
+    double c = cos(angle);
+    double s = sin(angle);
+    matrix[0] = c;  matrix[2] = s;
+    matrix[8] = -s; matrix[10] = c;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Rotation around the Z axis, same as vtkTransform::RotateZ on an identity transform
+  void SetRotationZ(double angleDegrees, double matrix[16])
+  {
+    SetIdentity(matrix);
+    double angle = vtkMath::RadiansFromDegrees(angleDegrees);
+    double c = cos(angle);
+    double s = sin(angle);
+    matrix[0] = c; matrix[1] = -s;
+    matrix[4] = s; matrix[5] = c;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Frames from the given frame up to (not including) the ancestor frame
+  void GetChainToAncestor(Frame frame, Frame ancestor, std::vector<Frame>& chain)
+  {
+    chain.clear();
+    while (frame != ancestor)
+    {
+      chain.push_back(frame);
+      frame = vtkSlicerIECTransformLogic::GetParentFrame(frame);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Lowest common ancestor of two frames in the IEC hierarchy
+  Frame GetCommonAncestor(Frame frame1, Frame frame2)
+  {
+    std::vector<Frame> ancestors1;
+    GetChainToAncestor(frame1, vtkSlicerIECTransformLogic::RAS, ancestors1);
+    Frame frame = frame2;
+    while (frame != vtkSlicerIECTransformLogic::RAS)
+    {
+      if (std::find(ancestors1.begin(), ancestors1.end(), frame) != ancestors1.end())
+      {
+        return frame;
+      }
+      frame = vtkSlicerIECTransformLogic::GetParentFrame(frame);
+    }
+    return vtkSlicerIECTransformLogic::RAS;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Transform from one frame to another along the hierarchy, with the path determined once for all poses
+  class KinematicChain
+  {
+  public:
+    KinematicChain(Frame fromFrame, Frame toFrame)
+    {
+      Frame ancestor = GetCommonAncestor(fromFrame, toFrame);
+      GetChainToAncestor(fromFrame, ancestor, this->FromChain);
+      GetChainToAncestor(toFrame, ancestor, this->ToChain);
+    }
+
+    void Evaluate(const vtkIECKinematics::Pose& pose, double matrix[16]) const
+    {
+      double fromToAncestor[16];
+      double toToAncestor[16];
+      this->Concatenate(this->FromChain, pose, fromToAncestor);
+      if (this->ToChain.empty())
+      {
+        std::copy(fromToAncestor, fromToAncestor+16, matrix);
+        return;
+      }
+      this->Concatenate(this->ToChain, pose, toToAncestor);
+      double ancestorToTo[16];
+      vtkMatrix4x4::Invert(toToAncestor, ancestorToTo);
+      vtkMatrix4x4::Multiply4x4(ancestorToTo, fromToAncestor, matrix);
+    }
+
+  protected:
+    void Concatenate(const std::vector<Frame>& chain, const vtkIECKinematics::Pose& pose, double matrix[16]) const
+    {
+      SetIdentity(matrix);
+      double toParent[16];
+      double result[16];
+      for (std::vector<Frame>::const_iterator frameIt=chain.begin(); frameIt!=chain.end(); ++frameIt)
+      {
+        vtkIECKinematics::GetTransformToParent(*frameIt, pose, toParent);
+        vtkMatrix4x4::Multiply4x4(toParent, matrix, result);
+        std::copy(result, result+16, matrix);
+      }
+    }
+
+  protected:
+    std::vector<Frame> FromChain;
+    std::vector<Frame> ToChain;
+  };
+
+  //----------------------------------------------------------------------------
+  class EvaluatePosesFunctor
+  {
+  public:
+    EvaluatePosesFunctor(const KinematicChain& chain, const std::vector<vtkIECKinematics::Pose>& poses, double* matrices)
+      : Chain(chain)
+      , Poses(poses)
+      , Matrices(matrices)
+    {
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      for (vtkIdType poseIndex=begin; poseIndex<end; ++poseIndex)
+      {
+        this->Chain.Evaluate(this->Poses[poseIndex], this->Matrices + 16*poseIndex);
+      }
+    }
+
+    const KinematicChain& Chain;
+    const std::vector<vtkIECKinematics::Pose>& Poses;
+    double* Matrices;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkIECKinematics::Pose::Pose()
+  : GantryAngle(0.0)
+  , CollimatorAngle(0.0)
+  , PatientSupportRotationAngle(0.0)
+{
+  for (int i=0; i<3; ++i)
+  {
+    this->IsocenterPosition[i] = 0.0;
+    this->TableTopDisplacement[i] = 0.0;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkIECKinematics::vtkIECKinematics()
+{
+}
+
+//----------------------------------------------------------------------------
+vtkIECKinematics::~vtkIECKinematics()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkIECKinematics::GetTransformToParent(CoordinateSystemIdentifier frame, const Pose& pose, double matrix[16])
+{
+  switch (frame)
+  {
+    case vtkSlicerIECTransformLogic::FixedReference:
+      // Translation to isocenter, then RotateX(-90) (the "S" direction in RAS is the "A" direction in FixedReference)
+      // and RotateZ(180) (the "S" direction is toward the gantry, head first position)
+      SetIdentity(matrix);
+      matrix[0] = -1.0;
+      matrix[5] = 0.0; matrix[6] = 1.0;
+      matrix[9] = 1.0; matrix[10] = 0.0;
+      matrix[3] = pose.IsocenterPosition[0];
+      matrix[7] = pose.IsocenterPosition[1];
+      matrix[11] = pose.IsocenterPosition[2];
+      break;
+    case vtkSlicerIECTransformLogic::Gantry:
+      SetRotationY(-pose.GantryAngle, matrix);
+      break;
+    case vtkSlicerIECTransformLogic::Collimator:
+      SetRotationZ(pose.CollimatorAngle, matrix);
+      break;
+    case vtkSlicerIECTransformLogic::PatientSupportRotation:
+      SetRotationZ(pose.PatientSupportRotationAngle, matrix);
+      break;
+    case vtkSlicerIECTransformLogic::TableTop:
+      SetIdentity(matrix);
+      matrix[3] = pose.TableTopDisplacement[0];
+      matrix[7] = pose.TableTopDisplacement[1];
+      matrix[11] = pose.TableTopDisplacement[2];
+      break;
+    default:
+      SetIdentity(matrix);
+      break;
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkIECKinematics::GetTransformBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame, const Pose& pose, double matrix[16])
+{
+  KinematicChain chain(fromFrame, toFrame);
+  chain.Evaluate(pose, matrix);
+}
+
+//----------------------------------------------------------------------------
+void vtkIECKinematics::GetTransformsBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame,
+  const std::vector<Pose>& poses, vtkDoubleArray* matrices)
+{
+  if (!matrices)
+  {
+    vtkGenericWarningMacro("vtkIECKinematics::GetTransformsBetween: Invalid output array");
+    return;
+  }
+
+  matrices->SetNumberOfComponents(16);
+  matrices->SetNumberOfTuples(poses.size());
+  if (poses.empty())
+  {
+    return;
+  }
+
+  KinematicChain chain(fromFrame, toFrame);
+  EvaluatePosesFunctor functor(chain, poses, matrices->GetPointer(0));
+  vtkSMPTools::For(0, static_cast<vtkIdType>(poses.size()), functor);
+}
@@ -0,0 +1,94 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkIECKinematics_h
+#define __vtkIECKinematics_h
+
+#include "vtkSlicerBeamsModuleLogicExport.h"
+
+// Beams includes
+#include "vtkSlicerIECTransformLogic.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <vector>
+
+class vtkDoubleArray;
+
+/// \ingroup SlicerRt_QtModules_Beams
+/// \brief Stateless computation of the IEC 61217 transforms from the machine parameters.
+///
+/// Computes the same transforms as the nodes of the IEC transform hierarchy (see \sa vtkSlicerIECTransformLogic)
+/// directly as 4x4 matrices, without using the MRML scene. The functions are thread safe, so that the
+/// transforms for many poses (beams, control points) can be computed at once, and only the results
+/// need to be set to the transform nodes.
+///
+/// Matrices are stored in row-major order (same as \sa vtkMatrix4x4::DeepCopy(double*)).
+/// The transforms that depend on the treatment machine models (imaging panel movement and patient support
+/// scaling) and the table top eccentric rotation are not part of the pose, and they are identity.
+class VTK_SLICER_BEAMS_LOGIC_EXPORT vtkIECKinematics : public vtkObject
+{
+public:
+  typedef vtkSlicerIECTransformLogic::CoordinateSystemIdentifier CoordinateSystemIdentifier;
+
+  /// Machine parameters determining the IEC transforms
+  struct VTK_SLICER_BEAMS_LOGIC_EXPORT Pose
+  {
+    Pose();
+
+    /// Gantry angle (degrees)
+    double GantryAngle;
+    /// Collimator angle (degrees)
+    double CollimatorAngle;
+    /// Patient support (couch) rotation angle (degrees)
+    double PatientSupportRotationAngle;
+    /// Isocenter position in RAS
+    double IsocenterPosition[3];
+    /// Lateral, longitudinal and vertical table top displacement
+    double TableTopDisplacement[3];
+  };
+
+public:
+  static vtkIECKinematics *New();
+  vtkTypeMacro(vtkIECKinematics, vtkObject);
+
+  /// Get transform from a coordinate frame to its parent frame (same as the transform of the corresponding IEC transform node)
+  static void GetTransformToParent(CoordinateSystemIdentifier frame, const Pose& pose, double matrix[16]);
+
+  /// Get transform from one coordinate frame to another
+  static void GetTransformBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame, const Pose& pose, double matrix[16]);
+
+  /// Get transforms from one coordinate frame to another for multiple poses. The poses are processed in parallel
+  /// \param matrices Output array with 16 components, one tuple (row-major matrix) per pose
+  static void GetTransformsBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame,
+    const std::vector<Pose>& poses, vtkDoubleArray* matrices);
+
+protected:
+  vtkIECKinematics();
+  virtual ~vtkIECKinematics();
+
+private:
+  vtkIECKinematics(const vtkIECKinematics&); // Not implemented
+  void operator=(const vtkIECKinematics&);   // Not implemented
+};
+
+#endif
@@ -115,6 +115,14 @@ void vtkSlicerBeamsModuleLogic::OnMRMLSceneEndImport()
     return;
   }
 
+  // Update beam transforms plan by plan, so that the transforms of all beams in a plan are computed together
+  std::vector<vtkMRMLNode*> planNodes;
+  scene->GetNodesByClass("vtkMRMLRTPlanNode", planNodes);
+  for (std::vector<vtkMRMLNode*>::iterator planIt=planNodes.begin(); planIt!=planNodes.end(); ++planIt)
+  {
+    this->UpdateTransformsForPlan(vtkMRMLRTPlanNode::SafeDownCast(*planIt));
+  }
+
   // Observe beam events of all beam nodes
   std::vector<vtkMRMLNode*> beamNodes;
   scene->GetNodesByClass("vtkMRMLRTBeamNode", beamNodes);
@@ -128,9 +136,8 @@ void vtkSlicerBeamsModuleLogic::OnMRMLSceneEndImport()
     events->InsertNextValue(vtkMRMLRTBeamNode::BeamTransformModified);
     vtkObserveMRMLNodeEventsMacro(node, events);
 
-    // Make sure geometry and transforms are up-to-date
+    // Make sure geometry is up-to-date (transforms have been updated above)
     node->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamGeometryModified);
-    node->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamTransformModified);
   }
 }
 
@@ -155,6 +162,26 @@ void vtkSlicerBeamsModuleLogic::UpdateTransformForBeam(vtkMRMLRTBeamNode* beamNo
   iecLogic->UpdateBeamTransform(beamNode);
 }
 
+//---------------------------------------------------------------------------
+void vtkSlicerBeamsModuleLogic::UpdateTransformsForPlan(vtkMRMLRTPlanNode* planNode)
+{
+  if (!planNode)
+  {
+    vtkErrorMacro("UpdateTransformsForPlan: Invalid plan node");
+    return;
+  }
+  vtkMRMLScene* scene = this->GetMRMLScene();
+  if (!scene)
+  {
+    vtkErrorMacro("UpdateTransformsForPlan: Invalid MRML scene");
+    return;
+  }
+
+  vtkSmartPointer<vtkSlicerIECTransformLogic> iecLogic = vtkSmartPointer<vtkSlicerIECTransformLogic>::New();
+  iecLogic->SetMRMLScene(scene);
+  iecLogic->UpdateBeamTransformsForPlan(planNode);
+}
+
 //----------------------------------------------------------------------------
 void vtkSlicerBeamsModuleLogic::ProcessMRMLNodesEvents(vtkObject* caller, unsigned long event, void* callData)
 {
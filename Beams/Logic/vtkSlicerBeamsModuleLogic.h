@@ -34,6 +34,8 @@
 #include "vtkSlicerBeamsModuleLogicExport.h"
 #include "vtkMRMLRTBeamNode.h"
 
+class vtkMRMLRTPlanNode;
+
 /// \ingroup SlicerRt_QtModules_Beams
 class VTK_SLICER_BEAMS_LOGIC_EXPORT vtkSlicerBeamsModuleLogic :
   public vtkSlicerModuleLogic
@@ -45,6 +47,8 @@ public:
 
   /// Update parent transform of a given beam using its parameters and the IEC logic
   void UpdateTransformForBeam(vtkMRMLRTBeamNode* beamNode);
+  /// Update parent transforms of all beams in a plan at once using the IEC logic
+  void UpdateTransformsForPlan(vtkMRMLRTPlanNode* planNode);
 
 protected:
   vtkSlicerBeamsModuleLogic();
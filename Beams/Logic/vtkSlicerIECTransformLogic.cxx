@@ -21,6 +21,7 @@
 
 // Beams includes
 #include "vtkSlicerIECTransformLogic.h"
+#include "vtkIECKinematics.h"
 #include "vtkMRMLRTBeamNode.h"
 #include "vtkMRMLRTPlanNode.h"
 
@@ -29,14 +30,56 @@
 #include <vtkMRMLLinearTransformNode.h>
 
 // VTK includes
+#include <vtkDoubleArray.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkGeneralTransform.h>
+#include <vtkMatrix4x4.h>
 #include <vtkTransform.h>
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerIECTransformLogic);
 
+namespace
+{
+  typedef vtkSlicerIECTransformLogic::CoordinateSystemIdentifier Frame;
+
+  //----------------------------------------------------------------------------
+  /// IEC transforms as (frame, parent frame) pairs, organized into a hierarchy based on IEC Standard 61217
+  const std::pair<Frame, Frame> IEC_TRANSFORMS[] =
+  {
+    std::make_pair(vtkSlicerIECTransformLogic::FixedReference, vtkSlicerIECTransformLogic::RAS),
+    std::make_pair(vtkSlicerIECTransformLogic::Gantry, vtkSlicerIECTransformLogic::FixedReference),
+    std::make_pair(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::Gantry),
+    std::make_pair(vtkSlicerIECTransformLogic::LeftImagingPanel, vtkSlicerIECTransformLogic::Gantry),
+    std::make_pair(vtkSlicerIECTransformLogic::RightImagingPanel, vtkSlicerIECTransformLogic::Gantry),
+    // Rotation component of patient support transform
+    std::make_pair(vtkSlicerIECTransformLogic::PatientSupportRotation, vtkSlicerIECTransformLogic::FixedReference),
+    // Scaling component of patient support transform
+    std::make_pair(vtkSlicerIECTransformLogic::PatientSupport, vtkSlicerIECTransformLogic::PatientSupportRotation),
+    // NOTE: Currently not supported by REV
+    std::make_pair(vtkSlicerIECTransformLogic::TableTopEccentricRotation, vtkSlicerIECTransformLogic::PatientSupportRotation),
+    std::make_pair(vtkSlicerIECTransformLogic::TableTop, vtkSlicerIECTransformLogic::TableTopEccentricRotation)
+  };
+  const int NUMBER_OF_IEC_TRANSFORMS = sizeof(IEC_TRANSFORMS) / sizeof(IEC_TRANSFORMS[0]);
+
+  //----------------------------------------------------------------------------
+  /// Collect the machine parameters of a beam
+  /// \return False if the isocenter position could not be determined (the isocenter is then the origin)
+  bool GetPoseFromBeam(vtkMRMLRTBeamNode* beamNode, vtkIECKinematics::Pose& pose)
+  {
+    pose.GantryAngle = beamNode->GetGantryAngle();
+    pose.CollimatorAngle = beamNode->GetCollimatorAngle();
+    pose.PatientSupportRotationAngle = beamNode->GetCouchAngle();
+    if (!beamNode->GetPlanIsocenterPosition(pose.IsocenterPosition))
+    {
+      pose.IsocenterPosition[0] = pose.IsocenterPosition[1] = pose.IsocenterPosition[2] = 0.0;
+      return false;
+    }
+    return true;
+  }
+}
+
 //-----------------------------------------------------------------------------
 vtkSlicerIECTransformLogic::vtkSlicerIECTransformLogic()
 {
@@ -53,16 +96,7 @@ vtkSlicerIECTransformLogic::vtkSlicerIECTransformLogic()
   this->CoordinateSystemsMap[TableTopEccentricRotation] = "TableTopEccentricRotation";
   this->CoordinateSystemsMap[TableTop] = "TableTop";
 
-  this->IecTransforms.clear();
-  this->IecTransforms.push_back(std::make_pair(FixedReference, RAS));
-  this->IecTransforms.push_back(std::make_pair(Gantry, FixedReference));
-  this->IecTransforms.push_back(std::make_pair(Collimator, Gantry));
-  this->IecTransforms.push_back(std::make_pair(LeftImagingPanel, Gantry));
-  this->IecTransforms.push_back(std::make_pair(RightImagingPanel, Gantry));
-  this->IecTransforms.push_back(std::make_pair(PatientSupportRotation, FixedReference)); // Rotation component of patient support transform
-  this->IecTransforms.push_back(std::make_pair(PatientSupport, PatientSupportRotation)); // Scaling component of patient support transform
-  this->IecTransforms.push_back(std::make_pair(TableTopEccentricRotation, PatientSupportRotation)); // NOTE: Currently not supported by REV
-  this->IecTransforms.push_back(std::make_pair(TableTop, TableTopEccentricRotation));
+  this->IecTransforms.assign(IEC_TRANSFORMS, IEC_TRANSFORMS + NUMBER_OF_IEC_TRANSFORMS);
 }
 
 //-----------------------------------------------------------------------------
@@ -126,25 +160,29 @@ void vtkSlicerIECTransformLogic::BuildIECTransformHierarchy()
     }
   }
 
-  // Organize transforms into hierarchy based on IEC Standard 61217
-  this->GetTransformNodeBetween(Gantry, FixedReference)->SetAndObserveTransformNodeID(
-    this->GetTransformNodeBetween(FixedReference, RAS)->GetID() );
-  this->GetTransformNodeBetween(Collimator, Gantry)->SetAndObserveTransformNodeID(
-    this->GetTransformNodeBetween(Gantry, FixedReference)->GetID() );
-
-  this->GetTransformNodeBetween(LeftImagingPanel, Gantry)->SetAndObserveTransformNodeID(
-    this->GetTransformNodeBetween(Gantry, FixedReference)->GetID() );
-  this->GetTransformNodeBetween(RightImagingPanel, Gantry)->SetAndObserveTransformNodeID(
-    this->GetTransformNodeBetween(Gantry, FixedReference)->GetID() );
-
-  this->GetTransformNodeBetween(PatientSupportRotation, FixedReference)->SetAndObserveTransformNodeID(
-    this->GetTransformNodeBetween(FixedReference, RAS)->GetID() );
-  this->GetTransformNodeBetween(PatientSupport, PatientSupportRotation)->SetAndObserveTransformNodeID(
-    this->GetTransformNodeBetween(PatientSupportRotation, FixedReference)->GetID() );
-  this->GetTransformNodeBetween(TableTopEccentricRotation, PatientSupportRotation)->SetAndObserveTransformNodeID(
-    this->GetTransformNodeBetween(PatientSupportRotation, FixedReference)->GetID() );
-  this->GetTransformNodeBetween(TableTop, TableTopEccentricRotation)->SetAndObserveTransformNodeID(
-    this->GetTransformNodeBetween(TableTopEccentricRotation, PatientSupportRotation)->GetID() );
+  // Organize transforms into hierarchy: the transform node of each frame is under the transform node of its parent frame
+  for (transformIt=this->IecTransforms.begin(); transformIt!=this->IecTransforms.end(); ++transformIt)
+  {
+    if (transformIt->second == RAS)
+    {
+      continue;
+    }
+    this->GetTransformNodeBetween(transformIt->first, transformIt->second)->SetAndObserveTransformNodeID(
+      this->GetTransformNodeToParent(transformIt->second)->GetID() );
+  }
+}
+
+//-----------------------------------------------------------------------------
+vtkSlicerIECTransformLogic::CoordinateSystemIdentifier vtkSlicerIECTransformLogic::GetParentFrame(CoordinateSystemIdentifier frame)
+{
+  for (int transformIndex=0; transformIndex<NUMBER_OF_IEC_TRANSFORMS; ++transformIndex)
+  {
+    if (IEC_TRANSFORMS[transformIndex].first == frame)
+    {
+      return IEC_TRANSFORMS[transformIndex].second;
+    }
+  }
+  return RAS;
 }
 
 //-----------------------------------------------------------------------------
@@ -161,40 +199,71 @@ void vtkSlicerIECTransformLogic::UpdateBeamTransform(vtkMRMLRTBeamNode* beamNode
     return;
   }
 
-  // Make sure transform node exists
-  beamNode->CreateDefaultTransformNode();
+  std::vector<vtkMRMLRTBeamNode*> beamNodes(1, beamNode);
+  this->UpdateBeamTransforms(beamNodes);
+}
 
-  // Update transform for beam
-  vtkMRMLLinearTransformNode* beamTransformNode = vtkMRMLLinearTransformNode::SafeDownCast(
-    beamNode->GetParentTransformNode() );
-  if (!beamTransformNode)
+//-----------------------------------------------------------------------------
+void vtkSlicerIECTransformLogic::UpdateBeamTransformsForPlan(vtkMRMLRTPlanNode* planNode)
+{
+  if (!planNode)
   {
-    vtkErrorMacro("UpdateBeamTransform: Failed to access transform node of beam " << beamNode->GetName());
+    vtkErrorMacro("UpdateBeamTransformsForPlan: Invalid plan node");
     return;
   }
 
-  // Update transforms in IEC logic from beam node parameters
-  this->UpdateIECTransformsFromBeam(beamNode);
+  std::vector<vtkMRMLRTBeamNode*> beamNodes;
+  planNode->GetBeams(beamNodes);
+  this->UpdateBeamTransforms(beamNodes);
+}
+
+//-----------------------------------------------------------------------------
+void vtkSlicerIECTransformLogic::UpdateBeamTransforms(const std::vector<vtkMRMLRTBeamNode*>& beamNodes)
+{
+  if (beamNodes.empty())
+  {
+    return;
+  }
 
-  vtkSmartPointer<vtkGeneralTransform> beamGeneralTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-  if (this->GetTransformBetween(Collimator, RAS, beamGeneralTransform))
+  // Collect beam parameters
+  std::vector<vtkIECKinematics::Pose> poses(beamNodes.size());
+  for (size_t beamIndex=0; beamIndex<beamNodes.size(); ++beamIndex)
   {
-    // Convert general transform to linear
-    // This call also makes hard copy of the transform so that it doesn't change when other beam transforms change
-    vtkSmartPointer<vtkTransform> beamLinearTransform = vtkSmartPointer<vtkTransform>::New();
-    if (!vtkMRMLTransformNode::IsGeneralTransformLinear(beamGeneralTransform, beamLinearTransform))
+    beamNodes[beamIndex]->CreateDefaultTransformNode();
+    if (!GetPoseFromBeam(beamNodes[beamIndex], poses[beamIndex]))
     {
-      vtkErrorMacro("UpdateBeamTransform: Unable to set transform with non-linear components to beam " << beamNode->GetName());
-      return;
+      vtkErrorMacro("UpdateBeamTransforms: Failed to get isocenter position for beam " << beamNodes[beamIndex]->GetName());
     }
+  }
+
+  // Compute all beam transforms directly from the beam parameters instead of concatenating the IEC transform nodes
+  vtkSmartPointer<vtkDoubleArray> collimatorToRasMatrices = vtkSmartPointer<vtkDoubleArray>::New();
+  vtkIECKinematics::GetTransformsBetween(Collimator, RAS, poses, collimatorToRasMatrices);
+
+  // Set results to the transform nodes
+  for (size_t beamIndex=0; beamIndex<beamNodes.size(); ++beamIndex)
+  {
+    this->SetBeamTransformMatrix(beamNodes[beamIndex], collimatorToRasMatrices->GetPointer(16*beamIndex));
+  }
+  this->UpdateIECTransformsFromBeam(beamNodes.back());
+}
 
-    // Set transform to beam node
-    beamTransformNode->SetAndObserveTransformToParent(beamLinearTransform);
+//-----------------------------------------------------------------------------
+bool vtkSlicerIECTransformLogic::SetBeamTransformMatrix(vtkMRMLRTBeamNode* beamNode, const double collimatorToRasMatrix[16])
+{
+  vtkMRMLLinearTransformNode* beamTransformNode = vtkMRMLLinearTransformNode::SafeDownCast(
+    beamNode->GetParentTransformNode() );
+  if (!beamTransformNode)
+  {
+    vtkErrorMacro("SetBeamTransformMatrix: Failed to access transform node of beam " << beamNode->GetName());
+    return false;
+  }
 
-    // Update the name of the transform node too
-    // (the user may have renamed the beam, but it's very expensive to update the transform name on every beam modified event)
-    std::string transformName = std::string(beamNode->GetName()) + vtkMRMLRTBeamNode::BEAM_TRANSFORM_NODE_NAME_POSTFIX;
-  }  
+  // Set copy of the matrix so that the transform doesn't change when other beam transforms change
+  vtkSmartPointer<vtkMatrix4x4> beamMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  beamMatrix->DeepCopy(collimatorToRasMatrix);
+  beamTransformNode->SetMatrixTransformToParent(beamMatrix);
+  return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -215,48 +284,22 @@ void vtkSlicerIECTransformLogic::UpdateIECTransformsFromBeam(vtkMRMLRTBeamNode*
   // Make sure the transform hierarchy is set up
   this->BuildIECTransformHierarchy();
 
-  //TODO: Code duplication (RevLogic::Update...)
-  vtkMRMLLinearTransformNode* gantryToFixedReferenceTransformNode =
-    this->GetTransformNodeBetween(Gantry, FixedReference);
-  vtkTransform* gantryToFixedReferenceTransform = vtkTransform::SafeDownCast(gantryToFixedReferenceTransformNode->GetTransformToParent());
-  gantryToFixedReferenceTransform->Identity();
-  gantryToFixedReferenceTransform->RotateY(beamNode->GetGantryAngle() * (-1.0));
-  gantryToFixedReferenceTransform->Modified();
-
-  vtkMRMLLinearTransformNode* collimatorToGantryTransformNode =
-    this->GetTransformNodeBetween(Collimator, Gantry);
-  vtkTransform* collimatorToGantryTransform = vtkTransform::SafeDownCast(collimatorToGantryTransformNode->GetTransformToParent());
-  collimatorToGantryTransform->Identity();
-  collimatorToGantryTransform->RotateZ(beamNode->GetCollimatorAngle());
-  collimatorToGantryTransform->Modified();
-
-  vtkMRMLLinearTransformNode* patientSupportRotationToFixedReferenceTransformNode =
-    this->GetTransformNodeBetween(PatientSupportRotation, FixedReference);
-  vtkTransform* patientSupportToFixedReferenceTransform = vtkTransform::SafeDownCast(patientSupportRotationToFixedReferenceTransformNode->GetTransformToParent());
-  patientSupportToFixedReferenceTransform->Identity();
-  patientSupportToFixedReferenceTransform->RotateZ(beamNode->GetCouchAngle());
-  patientSupportToFixedReferenceTransform->Modified();
-
-  // Update IEC FixedReference to RAS transform based on the isocenter defined in the beam's parent plan
-  vtkMRMLLinearTransformNode* fixedReferenceToRasTransformNode =
-    this->GetTransformNodeBetween(FixedReference, RAS);
-  vtkTransform* fixedReferenceToRasTransform = vtkTransform::SafeDownCast(fixedReferenceToRasTransformNode->GetTransformToParent());
-  fixedReferenceToRasTransform->Identity();
-  // Apply isocenter translation
-  double isocenterPosition[3] = { 0.0, 0.0, 0.0 };
-  if (beamNode->GetPlanIsocenterPosition(isocenterPosition))
+  vtkIECKinematics::Pose pose;
+  if (!GetPoseFromBeam(beamNode, pose))
   {
-    fixedReferenceToRasTransform->Translate(isocenterPosition[0], isocenterPosition[1], isocenterPosition[2]);
+    vtkErrorMacro("UpdateIECTransformsFromBeam: Failed to get isocenter position for beam " << beamNode->GetName());
   }
-  else
+
+  // Set transforms determined by the beam parameters
+  CoordinateSystemIdentifier beamFrames[4] = { FixedReference, Gantry, Collimator, PatientSupportRotation };
+  vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  double matrixElements[16] = {0.0};
+  for (int frameIndex=0; frameIndex<4; ++frameIndex)
   {
-    vtkErrorMacro("UpdateIECTransformsFromBeam: Failed to get isocenter position for beam " << beamNode->GetName());
+    vtkIECKinematics::GetTransformToParent(beamFrames[frameIndex], pose, matrixElements);
+    matrix->DeepCopy(matrixElements);
+    this->GetTransformNodeToParent(beamFrames[frameIndex])->SetMatrixTransformToParent(matrix);
   }
-  // The "S" direction in RAS is the "A" direction in FixedReference 
-  fixedReferenceToRasTransform->RotateX(-90.0);
-  // The "S" direction to be toward the gantry (head first position) by default
-  fixedReferenceToRasTransform->RotateZ(180.0);
-  fixedReferenceToRasTransform->Modified();
 }
 
 //-----------------------------------------------------------------------------
@@ -280,6 +323,20 @@ vtkMRMLLinearTransformNode* vtkSlicerIECTransformLogic::GetTransformNodeBetween(
     this->GetMRMLScene()->GetFirstNodeByName( this->GetTransformNodeNameBetween(fromFrame, toFrame).c_str() ) );
 }
 
+//-----------------------------------------------------------------------------
+vtkMRMLLinearTransformNode* vtkSlicerIECTransformLogic::GetTransformNodeToParent(CoordinateSystemIdentifier frame)
+{
+  std::vector< std::pair<CoordinateSystemIdentifier, CoordinateSystemIdentifier> >::iterator transformIt;
+  for (transformIt=this->IecTransforms.begin(); transformIt!=this->IecTransforms.end(); ++transformIt)
+  {
+    if (transformIt->first == frame)
+    {
+      return this->GetTransformNodeBetween(transformIt->first, transformIt->second);
+    }
+  }
+  return NULL;
+}
+
 //-----------------------------------------------------------------------------
 bool vtkSlicerIECTransformLogic::GetTransformBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame, vtkGeneralTransform* outputTransform)
 {
@@ -294,15 +351,16 @@ bool vtkSlicerIECTransformLogic::GetTransformBetween(CoordinateSystemIdentifier
     return false;
   }
 
-  //TODO: !!! IMPLEMENT DYNAMICALLY !!!
-
-  if (fromFrame == Collimator && toFrame == RAS)
+  // Coordinates in a frame are transformed to RAS by the transform node of the frame and its parents,
+  // so the transform between the nodes is the transform between the frames (no node for RAS)
+  vtkMRMLLinearTransformNode* fromFrameNode = this->GetTransformNodeToParent(fromFrame);
+  vtkMRMLLinearTransformNode* toFrameNode = this->GetTransformNodeToParent(toFrame);
+  if ( (fromFrame != RAS && !fromFrameNode) || (toFrame != RAS && !toFrameNode) )
   {
-    vtkMRMLTransformNode::GetTransformBetweenNodes(
-      this->GetTransformNodeBetween(Collimator, Gantry), NULL, outputTransform );
-    return true;
+    vtkErrorMacro("GetTransformBetween: Failed to get transform " << this->GetTransformNodeNameBetween(fromFrame, toFrame));
+    return false;
   }
 
-  vtkErrorMacro("GetTransformBetween: Failed to get transform " << this->GetTransformNodeNameBetween(fromFrame, toFrame));
-  return false;
+  vtkMRMLTransformNode::GetTransformBetweenNodes(fromFrameNode, toFrameNode, outputTransform);
+  return true;
 }
@@ -33,6 +33,7 @@
 
 class vtkGeneralTransform;
 class vtkMRMLRTBeamNode;
+class vtkMRMLRTPlanNode;
 class vtkMRMLLinearTransformNode;
 
 /// \ingroup SlicerRt_QtModules_Beams
@@ -46,6 +47,8 @@ class vtkMRMLLinearTransformNode;
 /// Image describing these coordinate frames:
 /// http://perk.cs.queensu.ca/sites/perkd7.cs.queensu.ca/files/Project/IEC_Transformations.PNG
 ///
+/// The transforms are computed by \sa vtkIECKinematics, and only the results are set to the transform nodes.
+///
 class VTK_SLICER_BEAMS_LOGIC_EXPORT vtkSlicerIECTransformLogic : public vtkMRMLAbstractLogic
 {
 public:
@@ -72,18 +75,25 @@ public:
   /// Create or get transforms taking part in the IEC logic, and build the transform hierarchy
   void BuildIECTransformHierarchy();
 
+  /// Get the parent of a coordinate frame in the IEC transform hierarchy (see \sa IecTransforms)
+  /// \return Parent frame, RAS for RAS (which is the root)
+  static CoordinateSystemIdentifier GetParentFrame(CoordinateSystemIdentifier frame);
+
   /// Get transform node between two coordinate systems is exists
   /// \return Transform node if there is a direct transform between the specified coordinate frames, NULL otherwise
   ///   Note: If IEC does not specify a transform between the given coordinate frames, then there will be no node with the returned name.
   vtkMRMLLinearTransformNode* GetTransformNodeBetween(
     CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame );
 
-  /// Get transform from one coordinate frame to another
+  /// Get transform from one coordinate frame to another from the transform nodes in the IEC hierarchy
   /// \return Success flag (false on any error)
   bool GetTransformBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame, vtkGeneralTransform* outputTransform);
 
-  /// Update parent transform node of a given beam from the IEC transform hierarchy and the beam parameters
+  /// Update parent transform node of a given beam from the beam parameters
   void UpdateBeamTransform(vtkMRMLRTBeamNode* beamNode);
+  /// Update parent transform nodes of all beams in a plan. The beam transforms are computed together, and
+  /// the transform nodes are only modified afterwards. The IEC transforms are set according to the last beam
+  void UpdateBeamTransformsForPlan(vtkMRMLRTPlanNode* planNode);
   /// Update IEC transforms according to beam node
   void UpdateIECTransformsFromBeam(vtkMRMLRTBeamNode* beamNode);
 
@@ -93,11 +103,23 @@ protected:
   ///   Note: If IEC does not specify a transform between the given coordinate frames, then there will be no node with the returned name.
   std::string GetTransformNodeNameBetween(CoordinateSystemIdentifier fromFrame, CoordinateSystemIdentifier toFrame);
 
+  /// Get transform node that transforms the given coordinate frame to its parent
+  /// \return NULL for RAS (which is the root of the hierarchy)
+  vtkMRMLLinearTransformNode* GetTransformNodeToParent(CoordinateSystemIdentifier frame);
+
+  /// Compute the transforms of the given beams together, and set them to the parent transform nodes of the beams.
+  /// The IEC transforms are set according to the last beam
+  void UpdateBeamTransforms(const std::vector<vtkMRMLRTBeamNode*>& beamNodes);
+
+  /// Set the transform node of a beam to the given beam to RAS (row-major) matrix
+  /// \return Success flag
+  bool SetBeamTransformMatrix(vtkMRMLRTBeamNode* beamNode, const double collimatorToRasMatrix[16]);
+
 protected:
   /// Map from \sa CoordinateSystemIdentifier to coordinate system name. Used for getting transforms
   std::map<CoordinateSystemIdentifier, std::string> CoordinateSystemsMap;
 
-  /// List of IEC transforms
+  /// List of IEC transforms as (frame, parent frame) pairs
   std::vector< std::pair<CoordinateSystemIdentifier, CoordinateSystemIdentifier> > IecTransforms;
 
 protected:
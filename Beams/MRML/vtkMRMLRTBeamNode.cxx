@@ -440,6 +440,18 @@ void vtkMRMLRTBeamNode::SetCouchAngle(double angle)
   this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamTransformModified);
 }
 
+//----------------------------------------------------------------------------
+void vtkMRMLRTBeamNode::SetBeamWeight(double weight)
+{
+  if (this->BeamWeight == weight)
+  {
+    return;
+  }
+  this->BeamWeight = weight;
+  this->Modified();
+  this->InvokeCustomModifiedEvent(vtkMRMLRTBeamNode::BeamWeightModified);
+}
+
 //----------------------------------------------------------------------------
 void vtkMRMLRTBeamNode::SetSAD(double sad)
 {
@@ -50,7 +50,9 @@ public:
     BeamTransformModified,
     /// Invoke if the beam is to be cloned.
     /// External Beam Planning logic processes the event if exists
-    CloningRequested
+    CloningRequested,
+    /// Fired if beam weight changes. The dose engine logic updates the total dose of the plan if it exists
+    BeamWeightModified
   };
 
 public:
@@ -176,8 +178,8 @@ public:
 
   /// Get beam weight
   vtkGetMacro(BeamWeight, double);
-  /// Set beam weight
-  vtkSetMacro(BeamWeight, double);
+  /// Set beam weight. Triggers \sa BeamWeightModified event if the weight changes
+  void SetBeamWeight(double weight);
 
 protected:
   /// Create beam model from beam parameters, supporting MLC leaves
@@ -22,6 +22,7 @@
 #include "vtkMRMLRTBeamNode.h"
 #include "vtkMRMLRTPlanNode.h"
 #include "vtkSlicerIECTransformLogic.h"
+#include "vtkIECKinematics.h"
 #include "vtkSlicerBeamsModuleLogic.h"
 
 // MRML includes
@@ -29,6 +30,8 @@
 #include <vtkMRMLLinearTransformNode.h>
 
 // VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkGeneralTransform.h>
 #include <vtkNew.h>
 #include <vtkTransform.h>
 #include <vtkMatrix4x4.h>
@@ -262,6 +265,109 @@ int vtkSlicerIECTransformLogicTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)
   //std::cout << "ZZZ after collimator angle 90:" << std::endl;
   //PrintLinearTransformNodeMatrices(mrmlScene, false, true);
 
+  //
+  // Test stateless IEC kinematics against the transform hierarchy
+
+  // Couch angle, 30 degrees
+  beamNode->SetCouchAngle(30.0);
+  iecLogic->UpdateBeamTransform(beamNode);
+
+  vtkIECKinematics::Pose pose;
+  pose.GantryAngle = beamNode->GetGantryAngle();
+  pose.CollimatorAngle = beamNode->GetCollimatorAngle();
+  pose.PatientSupportRotationAngle = beamNode->GetCouchAngle();
+  beamNode->GetPlanIsocenterPosition(pose.IsocenterPosition);
+
+  double collimatorToRasMatrixElements[16] = {0.0};
+  vtkIECKinematics::GetTransformBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::RAS, pose, collimatorToRasMatrixElements);
+  if (!IsTransformMatrixEqualTo(mrmlScene, beamTransformNode, collimatorToRasMatrixElements))
+    {
+    std::cerr << __LINE__ << ": Beam transform does not match collimator to RAS transform computed by IEC kinematics" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Transform between frames in different branches of the hierarchy
+  vtkSmartPointer<vtkGeneralTransform> collimatorToPatientSupportRotationGeneralTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+  if (!iecLogic->GetTransformBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::PatientSupportRotation,
+    collimatorToPatientSupportRotationGeneralTransform))
+    {
+    std::cerr << __LINE__ << ": Failed to get collimator to patient support rotation transform from IEC logic" << std::endl;
+    return EXIT_FAILURE;
+    }
+  vtkSmartPointer<vtkTransform> collimatorToPatientSupportRotationTransform = vtkSmartPointer<vtkTransform>::New();
+  vtkMRMLTransformNode::IsGeneralTransformLinear(collimatorToPatientSupportRotationGeneralTransform, collimatorToPatientSupportRotationTransform);
+  double collimatorToPatientSupportRotationMatrixElements[16] = {0.0};
+  vtkIECKinematics::GetTransformBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::PatientSupportRotation,
+    pose, collimatorToPatientSupportRotationMatrixElements);
+  vtkSmartPointer<vtkMatrix4x4> collimatorToPatientSupportRotationMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  collimatorToPatientSupportRotationMatrix->DeepCopy(collimatorToPatientSupportRotationMatrixElements);
+  if (!IsEqual(collimatorToPatientSupportRotationTransform->GetMatrix(), collimatorToPatientSupportRotationMatrix))
+    {
+    std::cerr << __LINE__ << ": Collimator to patient support rotation transform computed by IEC kinematics does not match IEC logic" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Batch computation gives the same result as computing the poses one by one
+  std::vector<vtkIECKinematics::Pose> poses(1000);
+  for (size_t poseIndex=0; poseIndex<poses.size(); ++poseIndex)
+    {
+    poses[poseIndex].GantryAngle = 0.36 * poseIndex;
+    poses[poseIndex].CollimatorAngle = 45.0 - 0.09 * poseIndex;
+    poses[poseIndex].PatientSupportRotationAngle = 0.05 * poseIndex;
+    poses[poseIndex].IsocenterPosition[0] = 1000.0;
+    poses[poseIndex].IsocenterPosition[1] = 200.0 + poseIndex;
+    }
+  vtkSmartPointer<vtkDoubleArray> batchMatrices = vtkSmartPointer<vtkDoubleArray>::New();
+  vtkIECKinematics::GetTransformsBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::PatientSupportRotation, poses, batchMatrices);
+  if (batchMatrices->GetNumberOfTuples() != static_cast<vtkIdType>(poses.size()) || batchMatrices->GetNumberOfComponents() != 16)
+    {
+    std::cerr << __LINE__ << ": Invalid number of matrices computed by IEC kinematics batch: " << batchMatrices->GetNumberOfTuples() << std::endl;
+    return EXIT_FAILURE;
+    }
+  for (size_t poseIndex=0; poseIndex<poses.size(); ++poseIndex)
+    {
+    double matrixElements[16] = {0.0};
+    vtkIECKinematics::GetTransformBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::PatientSupportRotation,
+      poses[poseIndex], matrixElements);
+    for (int i=0; i<16; ++i)
+      {
+      if (!AreEqualWithTolerance(matrixElements[i], batchMatrices->GetComponent(poseIndex, i)))
+        {
+        std::cerr << __LINE__ << ": IEC kinematics batch result does not match single pose result for pose " << poseIndex << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    }
+
+  // Update all beams of the plan at once
+  vtkSmartPointer<vtkMRMLRTBeamNode> secondBeamNode = vtkSmartPointer<vtkMRMLRTBeamNode>::New();
+  mrmlScene->AddNode(secondBeamNode);
+  planNode->AddBeam(secondBeamNode);
+  secondBeamNode->SetGantryAngle(90.0);
+  iecLogic->UpdateBeamTransformsForPlan(planNode);
+  vtkMRMLLinearTransformNode* secondBeamTransformNode = vtkMRMLLinearTransformNode::SafeDownCast(secondBeamNode->GetParentTransformNode());
+  if ( !IsTransformMatrixEqualTo(mrmlScene, beamTransformNode, collimatorToRasMatrixElements)
+    || !IsTransformMatrixEqualTo(mrmlScene, secondBeamTransformNode, expectedBeamTransform_Gantry90_MatrixElements) )
+    {
+    std::cerr << __LINE__ << ": Beam transforms do not match baseline after updating all beams of the plan" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Transform node hierarchy follows the parent frames
+  for (int frameIndex=vtkSlicerIECTransformLogic::FixedReference; frameIndex<vtkSlicerIECTransformLogic::LastIECCoordinateFrame; ++frameIndex)
+    {
+    vtkSlicerIECTransformLogic::CoordinateSystemIdentifier frame = (vtkSlicerIECTransformLogic::CoordinateSystemIdentifier)frameIndex;
+    vtkSlicerIECTransformLogic::CoordinateSystemIdentifier parentFrame = vtkSlicerIECTransformLogic::GetParentFrame(frame);
+    vtkMRMLLinearTransformNode* frameTransformNode = iecLogic->GetTransformNodeBetween(frame, parentFrame);
+    vtkMRMLLinearTransformNode* parentFrameTransformNode = (parentFrame == vtkSlicerIECTransformLogic::RAS ? NULL
+      : iecLogic->GetTransformNodeBetween(parentFrame, vtkSlicerIECTransformLogic::GetParentFrame(parentFrame)) );
+    if (!frameTransformNode || frameTransformNode->GetParentTransformNode() != parentFrameTransformNode)
+      {
+      std::cerr << __LINE__ << ": Transform node hierarchy does not match the parent of frame " << frameIndex << std::endl;
+      return EXIT_FAILURE;
+      }
+    }
+
   std::cout << "IEC logic test passed" << std::endl;
   return EXIT_SUCCESS;
 }
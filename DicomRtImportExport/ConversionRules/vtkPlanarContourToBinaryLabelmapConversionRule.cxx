@@ -0,0 +1,560 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToRibbonModelConversionRule.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtCommon.h"
+
+// SegmentationCore includes
+#include <vtkOrientedImageData.h>
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkCubeSource.h>
+#include <vtkDoubleArray.h>
+#include <vtkFieldData.h>
+#include <vtkIntArray.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPolyData.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+#include <vtkSmartPointer.h>
+#include <vtkTriangleFilter.h>
+
+// STD includes
+#include <algorithm>
+#include <map>
+#include <vector>
+
+//----------------------------------------------------------------------------
+const int vtkPlanarContourToBinaryLabelmapConversionRule::FractionalMinimum = -108;
+const int vtkPlanarContourToBinaryLabelmapConversionRule::FractionalMaximum = 108;
+
+//----------------------------------------------------------------------------
+// Utility functions
+namespace
+{
+  /// Maximum deviation of a contour from its slice position (in voxels) for the contour to be considered
+  /// parallel to the slices of the labelmap
+  const double CONTOUR_SLICE_ALIGNMENT_TOLERANCE = 0.05;
+
+  //-----------------------------------------------------------------------------
+  /// Contour edge in the IJ plane of the labelmap
+  struct ContourEdge
+  {
+    double X0;
+    double Y0;
+    double X1;
+    double Y1;
+  };
+
+  //-----------------------------------------------------------------------------
+  /// All contour edges of one contour plane, filled together using the even-odd rule
+  struct ContourPlane
+  {
+    /// Continuous slice index of the plane
+    double K;
+    std::vector<ContourEdge> Edges;
+    double MinimumY;
+    double MaximumY;
+  };
+
+  //-----------------------------------------------------------------------------
+  /// Collect the contours (lines and polygons) of a poly data as point index lists
+  void GetContourPointIds(vtkPolyData* polyData, std::vector< std::vector<vtkIdType> >& contours)
+  {
+    vtkCellArray* cellArrays[2] = { polyData->GetLines(), polyData->GetPolys() };
+    for (int cellArrayIndex=0; cellArrayIndex<2; ++cellArrayIndex)
+    {
+      vtkCellArray* cells = cellArrays[cellArrayIndex];
+      if (!cells)
+      {
+        continue;
+      }
+      vtkIdType numberOfCellPoints = 0;
+      vtkIdType* cellPointIds = NULL;
+      cells->InitTraversal();
+      while (cells->GetNextCell(numberOfCellPoints, cellPointIds))
+      {
+        if (numberOfCellPoints < 3)
+        {
+          continue;
+        }
+        contours.push_back(std::vector<vtkIdType>(cellPointIds, cellPointIds + numberOfCellPoints));
+      }
+    }
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Compute contour normal using Newell's method. Returns false if the contour is degenerate
+  bool ComputeContourNormal(vtkPoints* points, const std::vector<vtkIdType>& contour, double normal[3])
+  {
+    normal[0] = normal[1] = normal[2] = 0.0;
+    size_t numberOfPoints = contour.size();
+    double currentPoint[3] = {0.0,0.0,0.0};
+    double nextPoint[3] = {0.0,0.0,0.0};
+    for (size_t pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+    {
+      points->GetPoint(contour[pointIndex], currentPoint);
+      points->GetPoint(contour[(pointIndex+1) % numberOfPoints], nextPoint);
+      normal[0] += (currentPoint[1] - nextPoint[1]) * (currentPoint[2] + nextPoint[2]);
+      normal[1] += (currentPoint[2] - nextPoint[2]) * (currentPoint[0] + nextPoint[0]);
+      normal[2] += (currentPoint[0] - nextPoint[0]) * (currentPoint[1] + nextPoint[1]);
+    }
+    return vtkMath::Normalize(normal) > 0.0;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Most frequent value with EPSILON tolerance (same approach as the plane spacing computation of the ribbon conversion)
+  double MajorityValue(const std::vector<double>& values)
+  {
+    std::map<double, int> valueFrequencies;
+    for (std::vector<double>::const_iterator it = values.begin(); it != values.end(); ++it)
+    {
+      valueFrequencies[vtkMath::Round((*it) / EPSILON) * EPSILON]++;
+    }
+    double majorityValue = 0.0;
+    int majorityCount = -1;
+    for (std::map<double, int>::iterator it = valueFrequencies.begin(); it != valueFrequencies.end(); ++it)
+    {
+      if (it->second > majorityCount)
+      {
+        majorityValue = it->first;
+        majorityCount = it->second;
+      }
+    }
+    return majorityValue;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Fills a range of labelmap slices from the contour planes that cover them
+  class ScanlineFillFunctor
+  {
+  public:
+    ScanlineFillFunctor(const std::vector<ContourPlane>& planes, const std::vector< std::vector<int> >& planesForSlices,
+      const int extent[6], int supersamplingFactor, bool fractionalOutput, int fractionalMinimum, int fractionalMaximum, void* scalars)
+      : Planes(planes)
+      , PlanesForSlices(planesForSlices)
+      , SupersamplingFactor(supersamplingFactor)
+      , FractionalOutput(fractionalOutput)
+      , FractionalMinimum(fractionalMinimum)
+      , FractionalMaximum(fractionalMaximum)
+      , Scalars(scalars)
+    {
+      for (int i=0; i<6; ++i)
+      {
+        this->Extent[i] = extent[i];
+      }
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      const int dimensionX = this->Extent[1] - this->Extent[0] + 1;
+      const int dimensionY = this->Extent[3] - this->Extent[2] + 1;
+      const vtkIdType sliceSize = (vtkIdType)dimensionX * dimensionY;
+      const int n = this->SupersamplingFactor;
+      const int numberOfSamplesPerVoxel = n * n;
+
+      // Covered sample count per voxel, for the whole slice and for the current plane
+      std::vector<unsigned short>& sliceCounts = this->SliceCounts.Local();
+      std::vector<unsigned short>& planeCounts = this->PlaneCounts.Local();
+      std::vector<double>& crossings = this->Crossings.Local();
+      sliceCounts.resize(sliceSize);
+      planeCounts.resize(sliceSize);
+
+      for (vtkIdType sliceIndex=beginSlice; sliceIndex<endSlice; ++sliceIndex)
+      {
+        std::fill(sliceCounts.begin(), sliceCounts.end(), 0);
+        const std::vector<int>& planeIndices = this->PlanesForSlices[sliceIndex];
+        for (size_t planeNumber=0; planeNumber<planeIndices.size(); ++planeNumber)
+        {
+          // Overlapping planes are combined by taking the maximum coverage
+          bool firstPlane = (planeNumber == 0);
+          std::vector<unsigned short>& counts = (firstPlane ? sliceCounts : planeCounts);
+          if (!firstPlane)
+          {
+            std::fill(planeCounts.begin(), planeCounts.end(), 0);
+          }
+
+          const ContourPlane& plane = this->Planes[planeIndices[planeNumber]];
+          int firstRow = std::max(this->Extent[2], vtkMath::Floor(plane.MinimumY));
+          int lastRow = std::min(this->Extent[3], vtkMath::Ceil(plane.MaximumY));
+          for (int row=firstRow; row<=lastRow; ++row)
+          {
+            unsigned short* rowCounts = &(counts[(vtkIdType)(row - this->Extent[2]) * dimensionX]);
+            for (int subRow=0; subRow<n; ++subRow)
+            {
+              // Even-odd rule: collect all edge crossings of the scanline, and fill between pairs of them
+              double y = row - 0.5 + (subRow + 0.5) / n;
+              crossings.clear();
+              for (std::vector<ContourEdge>::const_iterator edgeIt=plane.Edges.begin(); edgeIt!=plane.Edges.end(); ++edgeIt)
+              {
+                if ((edgeIt->Y0 <= y) != (edgeIt->Y1 <= y))
+                {
+                  crossings.push_back(edgeIt->X0 + (y - edgeIt->Y0) * (edgeIt->X1 - edgeIt->X0) / (edgeIt->Y1 - edgeIt->Y0));
+                }
+              }
+              std::sort(crossings.begin(), crossings.end());
+
+              // Sample columns are at x = (column + 0.5) / n - 0.5, fill the ones in [start, end)
+              const int firstColumn = this->Extent[0] * n;
+              const int endColumn = (this->Extent[1] + 1) * n;
+              for (size_t crossingIndex=0; crossingIndex+1<crossings.size(); crossingIndex+=2)
+              {
+                int startSampleColumn = std::max(firstColumn, (int)ceil(n * (crossings[crossingIndex] + 0.5) - 0.5));
+                int endSampleColumn = std::min(endColumn, (int)ceil(n * (crossings[crossingIndex+1] + 0.5) - 0.5));
+                for (int sampleColumn=startSampleColumn; sampleColumn<endSampleColumn; ++sampleColumn)
+                {
+                  rowCounts[(sampleColumn - firstColumn) / n]++;
+                }
+              }
+            }
+          }
+
+          if (!firstPlane)
+          {
+            for (vtkIdType voxelIndex=0; voxelIndex<sliceSize; ++voxelIndex)
+            {
+              sliceCounts[voxelIndex] = std::max(sliceCounts[voxelIndex], planeCounts[voxelIndex]);
+            }
+          }
+        }
+
+        // Write slice to the output
+        if (this->FractionalOutput)
+        {
+          const int fractionalRange = this->FractionalMaximum - this->FractionalMinimum;
+          char* sliceScalars = static_cast<char*>(this->Scalars) + sliceIndex * sliceSize;
+          for (vtkIdType voxelIndex=0; voxelIndex<sliceSize; ++voxelIndex)
+          {
+            int count = std::min<int>(sliceCounts[voxelIndex], numberOfSamplesPerVoxel);
+            sliceScalars[voxelIndex] = (char)(this->FractionalMinimum
+              + (fractionalRange * count + numberOfSamplesPerVoxel / 2) / numberOfSamplesPerVoxel);
+          }
+        }
+        else
+        {
+          unsigned char* sliceScalars = static_cast<unsigned char*>(this->Scalars) + sliceIndex * sliceSize;
+          for (vtkIdType voxelIndex=0; voxelIndex<sliceSize; ++voxelIndex)
+          {
+            sliceScalars[voxelIndex] = (sliceCounts[voxelIndex] > 0 ? 1 : 0);
+          }
+        }
+      }
+    }
+
+  private:
+    const std::vector<ContourPlane>& Planes;
+    const std::vector< std::vector<int> >& PlanesForSlices;
+    int Extent[6];
+    int SupersamplingFactor;
+    bool FractionalOutput;
+    int FractionalMinimum;
+    int FractionalMaximum;
+    void* Scalars;
+
+    vtkSMPThreadLocal< std::vector<unsigned short> > SliceCounts;
+    vtkSMPThreadLocal< std::vector<unsigned short> > PlaneCounts;
+    vtkSMPThreadLocal< std::vector<double> > Crossings;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToBinaryLabelmapConversionRule);
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToBinaryLabelmapConversionRule::vtkPlanarContourToBinaryLabelmapConversionRule()
+{
+}
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToBinaryLabelmapConversionRule::~vtkPlanarContourToBinaryLabelmapConversionRule()
+{
+}
+
+//----------------------------------------------------------------------------
+unsigned int vtkPlanarContourToBinaryLabelmapConversionRule::GetConversionCost(vtkDataObject* vtkNotUsed(sourceRepresentation)/*=NULL*/, vtkDataObject* vtkNotUsed(targetRepresentation)/*=NULL*/)
+{
+  // Rough input-independent guess (ms). Lower than planar contour to ribbon model, so that this path is preferred
+  return 40;
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation)
+{
+  // Check validity of source and target representation objects
+  vtkPolyData* planarContourPolyData = vtkPolyData::SafeDownCast(sourceRepresentation);
+  if (!planarContourPolyData)
+  {
+    vtkErrorMacro("Convert: Source representation is not a poly data!");
+    return false;
+  }
+  vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(targetRepresentation);
+  if (!binaryLabelmap)
+  {
+    vtkErrorMacro("Convert: Target representation is not an oriented image data!");
+    return false;
+  }
+
+  return this->FillLabelmapFromContours(planarContourPolyData, binaryLabelmap, false, 1);
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToBinaryLabelmapConversionRule::FillLabelmapFromContours(
+  vtkPolyData* planarContourPolyData, vtkOrientedImageData* labelmap, bool fractionalOutput, int supersamplingFactor)
+{
+  if (!planarContourPolyData || !labelmap)
+  {
+    vtkErrorMacro("FillLabelmapFromContours: Invalid arguments!");
+    return false;
+  }
+  if (supersamplingFactor < 1)
+  {
+    supersamplingFactor = 1;
+  }
+  vtkPoints* points = planarContourPolyData->GetPoints();
+  if (!points || planarContourPolyData->GetNumberOfPoints() < 3 || planarContourPolyData->GetNumberOfCells() < 1)
+  {
+    vtkErrorMacro("FillLabelmapFromContours: Cannot create labelmap from planar contour with number of points: "
+      << planarContourPolyData->GetNumberOfPoints() << " and number of cells: " << planarContourPolyData->GetNumberOfCells());
+    return false;
+  }
+
+  // Collect contours
+  std::vector< std::vector<vtkIdType> > contours;
+  GetContourPointIds(planarContourPolyData, contours);
+  double contourNormal[3] = {0.0,0.0,0.0};
+  bool validNormal = false;
+  for (size_t contourIndex=0; contourIndex<contours.size() && !validNormal; ++contourIndex)
+  {
+    validNormal = ComputeContourNormal(points, contours[contourIndex], contourNormal);
+  }
+  if (!validNormal)
+  {
+    vtkErrorMacro("FillLabelmapFromContours: Unable to determine the plane of the contours");
+    return false;
+  }
+
+  // Determine contour plane spacing along the normal (1mm if there is only one plane, same as the ribbon conversion)
+  std::vector<double> contourOffsets;
+  double point[3] = {0.0,0.0,0.0};
+  for (size_t contourIndex=0; contourIndex<contours.size(); ++contourIndex)
+  {
+    points->GetPoint(contours[contourIndex][0], point);
+    contourOffsets.push_back(vtkMath::Dot(point, contourNormal));
+  }
+  std::sort(contourOffsets.begin(), contourOffsets.end());
+  std::vector<double> contourSpacings;
+  for (size_t offsetIndex=1; offsetIndex<contourOffsets.size(); ++offsetIndex)
+  {
+    double spacing = contourOffsets[offsetIndex] - contourOffsets[offsetIndex-1];
+    if (spacing > EPSILON)
+    {
+      contourSpacings.push_back(spacing);
+    }
+  }
+  double sliceThickness = (contourSpacings.empty() ? 1.0 : MajorityValue(contourSpacings));
+
+  // Compute output geometry from the slab covered by the contours, the same way as for closed surfaces
+  double bounds[6] = {0.0,0.0,0.0,0.0,0.0,0.0};
+  planarContourPolyData->GetBounds(bounds);
+  for (int axis=0; axis<3; ++axis)
+  {
+    double halfThicknessAlongAxis = fabs(contourNormal[axis]) * sliceThickness / 2.0;
+    bounds[2*axis] -= halfThicknessAlongAxis;
+    bounds[2*axis+1] += halfThicknessAlongAxis;
+  }
+  vtkSmartPointer<vtkCubeSource> boundingBox = vtkSmartPointer<vtkCubeSource>::New();
+  boundingBox->SetBounds(bounds);
+  vtkSmartPointer<vtkTriangleFilter> boundingBoxTriangulator = vtkSmartPointer<vtkTriangleFilter>::New();
+  boundingBoxTriangulator->SetInputConnection(boundingBox->GetOutputPort());
+  boundingBoxTriangulator->Update();
+  if (!this->CalculateOutputGeometry(boundingBoxTriangulator->GetOutput(), labelmap))
+  {
+    vtkErrorMacro("FillLabelmapFromContours: Failed to calculate output image geometry!");
+    return false;
+  }
+
+  // Transform contours to the voxel coordinate system, and check that they are parallel to the slices
+  vtkSmartPointer<vtkMatrix4x4> worldToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  labelmap->GetWorldToImageMatrix(worldToImageMatrix);
+  std::vector<ContourPlane> planes;
+  std::vector< std::pair<double, size_t> > contourSlicePositions; // (continuous slice index, contour index)
+  std::vector< std::vector<double> > contourIjPoints(contours.size());
+  bool contoursParallelToSlices = true;
+  for (size_t contourIndex=0; contourIndex<contours.size() && contoursParallelToSlices; ++contourIndex)
+  {
+    const std::vector<vtkIdType>& contour = contours[contourIndex];
+    double minimumK = VTK_DOUBLE_MAX;
+    double maximumK = VTK_DOUBLE_MIN;
+    double sumK = 0.0;
+    for (size_t pointIndex=0; pointIndex<contour.size(); ++pointIndex)
+    {
+      double worldPoint[4] = {0.0,0.0,0.0,1.0};
+      points->GetPoint(contour[pointIndex], worldPoint);
+      double ijkPoint[4] = {0.0,0.0,0.0,1.0};
+      worldToImageMatrix->MultiplyPoint(worldPoint, ijkPoint);
+      contourIjPoints[contourIndex].push_back(ijkPoint[0]);
+      contourIjPoints[contourIndex].push_back(ijkPoint[1]);
+      minimumK = std::min(minimumK, ijkPoint[2]);
+      maximumK = std::max(maximumK, ijkPoint[2]);
+      sumK += ijkPoint[2];
+    }
+    if (maximumK - minimumK > CONTOUR_SLICE_ALIGNMENT_TOLERANCE)
+    {
+      contoursParallelToSlices = false;
+    }
+    contourSlicePositions.push_back(std::make_pair(sumK / contour.size(), contourIndex));
+  }
+
+  if (!contoursParallelToSlices)
+  {
+    // Contours are oblique to the labelmap slices, convert through ribbon model
+    vtkDebugMacro("FillLabelmapFromContours: Contours are not parallel to the labelmap slices, converting through ribbon model");
+    vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule> ribbonRule = vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule>::New();
+    vtkSmartPointer<vtkPolyData> ribbonModel = vtkSmartPointer<vtkPolyData>::New();
+    if (!ribbonRule->Convert(planarContourPolyData, ribbonModel))
+    {
+      vtkErrorMacro("FillLabelmapFromContours: Failed to create ribbon model from planar contours");
+      return false;
+    }
+    if (!vtkClosedSurfaceToBinaryLabelmapConversionRule::Convert(ribbonModel, labelmap))
+    {
+      return false;
+    }
+    if (fractionalOutput)
+    {
+      vtkSmartPointer<vtkOrientedImageData> binaryLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+      binaryLabelmap->DeepCopy(labelmap);
+      labelmap->AllocateScalars(VTK_CHAR, 1);
+      const unsigned char* binaryScalars = static_cast<unsigned char*>(binaryLabelmap->GetScalarPointer());
+      char* fractionalScalars = static_cast<char*>(labelmap->GetScalarPointer());
+      vtkIdType numberOfVoxels = labelmap->GetNumberOfPoints();
+      for (vtkIdType voxelIndex=0; voxelIndex<numberOfVoxels; ++voxelIndex)
+      {
+        fractionalScalars[voxelIndex] = (char)(binaryScalars[voxelIndex] ? FractionalMaximum : FractionalMinimum);
+      }
+      vtkPlanarContourToBinaryLabelmapConversionRule::SetFractionalLabelmapFieldData(labelmap);
+    }
+    return true;
+  }
+
+  // Group contours lying on the same plane
+  std::sort(contourSlicePositions.begin(), contourSlicePositions.end());
+  for (size_t positionIndex=0; positionIndex<contourSlicePositions.size(); ++positionIndex)
+  {
+    double k = contourSlicePositions[positionIndex].first;
+    if (planes.empty() || k - planes.back().K > CONTOUR_SLICE_ALIGNMENT_TOLERANCE)
+    {
+      ContourPlane plane;
+      plane.K = k;
+      plane.MinimumY = VTK_DOUBLE_MAX;
+      plane.MaximumY = VTK_DOUBLE_MIN;
+      planes.push_back(plane);
+    }
+    ContourPlane& plane = planes.back();
+    const std::vector<double>& ijPoints = contourIjPoints[contourSlicePositions[positionIndex].second];
+    size_t numberOfPoints = ijPoints.size() / 2;
+    for (size_t pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+    {
+      // Contours are always closed, even if the last point is not repeated
+      size_t nextPointIndex = (pointIndex + 1) % numberOfPoints;
+      ContourEdge edge;
+      edge.X0 = ijPoints[2*pointIndex];
+      edge.Y0 = ijPoints[2*pointIndex+1];
+      edge.X1 = ijPoints[2*nextPointIndex];
+      edge.Y1 = ijPoints[2*nextPointIndex+1];
+      plane.Edges.push_back(edge);
+      plane.MinimumY = std::min(plane.MinimumY, edge.Y0);
+      plane.MaximumY = std::max(plane.MaximumY, edge.Y0);
+    }
+  }
+
+  // Half slab thickness in voxels along the slice axis. Each plane fills at least the nearest slice
+  double normalInImage[4] = { contourNormal[0], contourNormal[1], contourNormal[2], 0.0 };
+  worldToImageMatrix->MultiplyPoint(normalInImage, normalInImage);
+  double halfThicknessInSlices = std::max(0.5, fabs(normalInImage[2]) * sliceThickness / 2.0);
+
+  // Allocate output
+  int extent[6] = {0,-1,0,-1,0,-1};
+  labelmap->GetExtent(extent);
+  labelmap->AllocateScalars(fractionalOutput ? VTK_CHAR : VTK_UNSIGNED_CHAR, 1);
+  if (fractionalOutput)
+  {
+    vtkPlanarContourToBinaryLabelmapConversionRule::SetFractionalLabelmapFieldData(labelmap);
+  }
+  if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+  {
+    // Empty output
+    return true;
+  }
+
+  // Assign planes to the slices they cover
+  int numberOfSlices = extent[5] - extent[4] + 1;
+  std::vector< std::vector<int> > planesForSlices(numberOfSlices);
+  for (size_t planeIndex=0; planeIndex<planes.size(); ++planeIndex)
+  {
+    int firstSlice = std::max(extent[4], vtkMath::Ceil(planes[planeIndex].K - halfThicknessInSlices));
+    int lastSlice = std::min(extent[5], vtkMath::Ceil(planes[planeIndex].K + halfThicknessInSlices) - 1);
+    for (int slice=firstSlice; slice<=lastSlice; ++slice)
+    {
+      planesForSlices[slice - extent[4]].push_back((int)planeIndex);
+    }
+  }
+
+  ScanlineFillFunctor functor(planes, planesForSlices, extent, (fractionalOutput ? supersamplingFactor : 1),
+    fractionalOutput, FractionalMinimum, FractionalMaximum, labelmap->GetScalarPointer());
+  vtkSMPTools::For(0, numberOfSlices, functor);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarContourToBinaryLabelmapConversionRule::SetFractionalLabelmapFieldData(vtkOrientedImageData* labelmap)
+{
+  if (!labelmap)
+  {
+    return;
+  }
+
+  // Specify the scalar range of values in the labelmap
+  vtkSmartPointer<vtkDoubleArray> scalarRange = vtkSmartPointer<vtkDoubleArray>::New();
+  scalarRange->SetName(vtkSegmentationConverter::GetScalarRangeFieldName());
+  scalarRange->InsertNextValue(FractionalMinimum);
+  scalarRange->InsertNextValue(FractionalMaximum);
+  labelmap->GetFieldData()->AddArray(scalarRange);
+
+  // Specify the surface threshold value for visualization
+  vtkSmartPointer<vtkDoubleArray> thresholdValue = vtkSmartPointer<vtkDoubleArray>::New();
+  thresholdValue->SetName(vtkSegmentationConverter::GetThresholdValueFieldName());
+  thresholdValue->InsertNextValue((FractionalMinimum + FractionalMaximum) / 2.0);
+  labelmap->GetFieldData()->AddArray(thresholdValue);
+
+  // Specify the interpolation type for visualization
+  vtkSmartPointer<vtkIntArray> interpolationType = vtkSmartPointer<vtkIntArray>::New();
+  interpolationType->SetName(vtkSegmentationConverter::GetInterpolationTypeFieldName());
+  interpolationType->InsertNextValue(VTK_LINEAR_INTERPOLATION);
+  labelmap->GetFieldData()->AddArray(interpolationType);
+}
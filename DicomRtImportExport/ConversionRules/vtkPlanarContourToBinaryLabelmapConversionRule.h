@@ -0,0 +1,95 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkPlanarContourToBinaryLabelmapConversionRule_h
+#define __vtkPlanarContourToBinaryLabelmapConversionRule_h
+
+// SegmentationCore includes
+#include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
+#include "vtkSegmentationConverter.h"
+
+#include "vtkSlicerDicomRtImportExportConversionRulesExport.h"
+
+class vtkOrientedImageData;
+class vtkPolyData;
+
+/// \ingroup DicomRtImportImportExportConversionRules
+/// \brief Convert planar contour representation (vtkPolyData type) directly to binary
+///   labelmap representation (vtkOrientedImageData type) without building an intermediate mesh.
+///
+/// The contours are transformed into the voxel coordinate system of the output labelmap, and each contour
+/// plane fills the slices within half contour spacing from it. The slices are filled in parallel, using
+/// an even-odd scanline fill, so that contours inside other contours on the same plane are treated as holes.
+/// The output geometry is determined the same way as for closed surfaces (reference geometry, oversampling
+/// and cropping conversion parameters of the base class).
+/// If the contour planes are not parallel to the slices of the output labelmap, then the contours are
+/// converted through a ribbon model, as in the case of \sa vtkRibbonModelToBinaryLabelmapConversionRule.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_CONVERSIONRULES_EXPORT vtkPlanarContourToBinaryLabelmapConversionRule
+  : public vtkClosedSurfaceToBinaryLabelmapConversionRule
+{
+public:
+  static vtkPlanarContourToBinaryLabelmapConversionRule* New();
+  vtkTypeMacro(vtkPlanarContourToBinaryLabelmapConversionRule, vtkSegmentationConverterRule);
+  virtual vtkSegmentationConverterRule* CreateRuleInstance() VTK_OVERRIDE;
+
+  /// Update the target representation based on the source representation
+  virtual bool Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation) VTK_OVERRIDE;
+
+  /// Get the cost of the conversion. Lower than converting through ribbon model or closed surface
+  virtual unsigned int GetConversionCost(vtkDataObject* sourceRepresentation=NULL, vtkDataObject* targetRepresentation=NULL) VTK_OVERRIDE;
+
+  /// Human-readable name of the converter rule
+  virtual const char* GetName() VTK_OVERRIDE { return "Planar contour to binary labelmap"; };
+
+  /// Human-readable name of the source representation
+  virtual const char* GetSourceRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName(); };
+
+  /// Human-readable name of the target representation
+  virtual const char* GetTargetRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(); };
+
+protected:
+  /// Fill the labelmap from the planar contours
+  /// \param planarContourPolyData Input contours
+  /// \param labelmap Output labelmap. Its geometry is computed from the conversion parameters
+  /// \param fractionalOutput If true, then the output is a fractional labelmap (char type between
+  ///   \sa FractionalMinimum and \sa FractionalMaximum), otherwise a binary labelmap (unsigned char 0 or 1)
+  /// \param supersamplingFactor Number of samples per voxel along each in-plane axis (only used for fractional output)
+  /// \return Success flag
+  bool FillLabelmapFromContours(vtkPolyData* planarContourPolyData, vtkOrientedImageData* labelmap, bool fractionalOutput, int supersamplingFactor);
+
+  /// Set fractional labelmap field data (scalar range, threshold and interpolation type) on labelmap
+  static void SetFractionalLabelmapFieldData(vtkOrientedImageData* labelmap);
+
+protected:
+  /// Value of fractional labelmap voxels outside the structure
+  static const int FractionalMinimum;
+  /// Value of fractional labelmap voxels entirely inside the structure
+  static const int FractionalMaximum;
+
+protected:
+  vtkPlanarContourToBinaryLabelmapConversionRule();
+  ~vtkPlanarContourToBinaryLabelmapConversionRule();
+
+private:
+  vtkPlanarContourToBinaryLabelmapConversionRule(const vtkPlanarContourToBinaryLabelmapConversionRule&); // Not implemented
+  void operator=(const vtkPlanarContourToBinaryLabelmapConversionRule&); // Not implemented
+};
+
+#endif // __vtkPlanarContourToBinaryLabelmapConversionRule_h
@@ -0,0 +1,73 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToFractionalLabelmapConversionRule.h"
+
+// SegmentationCore includes
+#include <vtkOrientedImageData.h>
+
+// VTK includes
+#include <vtkObjectFactory.h>
+#include <vtkPolyData.h>
+#include <vtkVariant.h>
+
+//----------------------------------------------------------------------------
+vtkSegmentationConverterRuleNewMacro(vtkPlanarContourToFractionalLabelmapConversionRule);
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToFractionalLabelmapConversionRule::vtkPlanarContourToFractionalLabelmapConversionRule()
+{
+  this->ConversionParameters[this->GetSupersamplingFactorParameterName()] = std::make_pair("4",
+    "Number of samples per voxel along each in-plane axis. The fraction of covered samples determines the voxel value.");
+}
+
+//----------------------------------------------------------------------------
+vtkPlanarContourToFractionalLabelmapConversionRule::~vtkPlanarContourToFractionalLabelmapConversionRule()
+{
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarContourToFractionalLabelmapConversionRule::Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation)
+{
+  // Check validity of source and target representation objects
+  vtkPolyData* planarContourPolyData = vtkPolyData::SafeDownCast(sourceRepresentation);
+  if (!planarContourPolyData)
+  {
+    vtkErrorMacro("Convert: Source representation is not a poly data!");
+    return false;
+  }
+  vtkOrientedImageData* fractionalLabelmap = vtkOrientedImageData::SafeDownCast(targetRepresentation);
+  if (!fractionalLabelmap)
+  {
+    vtkErrorMacro("Convert: Target representation is not an oriented image data!");
+    return false;
+  }
+
+  // Number of samples per voxel must fit in the per-voxel sample counter
+  int supersamplingFactor = vtkVariant(this->ConversionParameters[this->GetSupersamplingFactorParameterName()].first).ToInt();
+  if (supersamplingFactor < 1 || supersamplingFactor > 16)
+  {
+    vtkWarningMacro("Convert: Invalid supersampling factor " << supersamplingFactor << ", using 4 instead");
+    supersamplingFactor = 4;
+  }
+
+  return this->FillLabelmapFromContours(planarContourPolyData, fractionalLabelmap, true, supersamplingFactor);
+}
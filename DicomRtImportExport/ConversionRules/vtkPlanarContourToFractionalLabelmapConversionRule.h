@@ -0,0 +1,64 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkPlanarContourToFractionalLabelmapConversionRule_h
+#define __vtkPlanarContourToFractionalLabelmapConversionRule_h
+
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+
+#include "vtkSlicerDicomRtImportExportConversionRulesExport.h"
+
+/// \ingroup DicomRtImportImportExportConversionRules
+/// \brief Convert planar contour representation (vtkPolyData type) directly to fractional
+///   labelmap representation (vtkOrientedImageData type).
+///
+/// Same as \sa vtkPlanarContourToBinaryLabelmapConversionRule, but each voxel is sampled on a regular
+/// in-plane grid (supersampling factor squared samples), and the voxel value is the covered fraction.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_CONVERSIONRULES_EXPORT vtkPlanarContourToFractionalLabelmapConversionRule
+  : public vtkPlanarContourToBinaryLabelmapConversionRule
+{
+public:
+  /// Conversion parameter: number of samples per voxel along each in-plane axis
+  static const std::string GetSupersamplingFactorParameterName() { return "Supersampling factor"; };
+
+public:
+  static vtkPlanarContourToFractionalLabelmapConversionRule* New();
+  vtkTypeMacro(vtkPlanarContourToFractionalLabelmapConversionRule, vtkSegmentationConverterRule);
+  virtual vtkSegmentationConverterRule* CreateRuleInstance() VTK_OVERRIDE;
+
+  /// Update the target representation based on the source representation
+  virtual bool Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation) VTK_OVERRIDE;
+
+  /// Human-readable name of the converter rule
+  virtual const char* GetName() VTK_OVERRIDE { return "Planar contour to fractional labelmap"; };
+
+  /// Human-readable name of the target representation
+  virtual const char* GetTargetRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationFractionalLabelmapRepresentationName(); };
+
+protected:
+  vtkPlanarContourToFractionalLabelmapConversionRule();
+  ~vtkPlanarContourToFractionalLabelmapConversionRule();
+
+private:
+  vtkPlanarContourToFractionalLabelmapConversionRule(const vtkPlanarContourToFractionalLabelmapConversionRule&); // Not implemented
+  void operator=(const vtkPlanarContourToFractionalLabelmapConversionRule&); // Not implemented
+};
+
+#endif // __vtkPlanarContourToFractionalLabelmapConversionRule_h
@@ -21,8 +21,19 @@
 // DicomRtImportExport includes
 #include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
 
+// SlicerRT includes
+#include "vtkPolyDataToLabelmapFilter.h"
+
+// SegmentationCore includes
+#include <vtkOrientedImageData.h>
+
 // VTK includes
+#include <vtkMatrix4x4.h>
 #include <vtkObjectFactory.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
 
 //----------------------------------------------------------------------------
 vtkSegmentationConverterRuleNewMacro(vtkRibbonModelToBinaryLabelmapConversionRule);
@@ -36,3 +47,61 @@ vtkRibbonModelToBinaryLabelmapConversionRule::vtkRibbonModelToBinaryLabelmapConv
 vtkRibbonModelToBinaryLabelmapConversionRule::~vtkRibbonModelToBinaryLabelmapConversionRule()
 {
 }
+
+//----------------------------------------------------------------------------
+bool vtkRibbonModelToBinaryLabelmapConversionRule::Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation)
+{
+  // Check validity of source and target representation objects
+  vtkPolyData* ribbonModelPolyData = vtkPolyData::SafeDownCast(sourceRepresentation);
+  if (!ribbonModelPolyData)
+  {
+    vtkErrorMacro("Convert: Source representation is not a poly data!");
+    return false;
+  }
+  vtkOrientedImageData* binaryLabelmap = vtkOrientedImageData::SafeDownCast(targetRepresentation);
+  if (!binaryLabelmap)
+  {
+    vtkErrorMacro("Convert: Target representation is not an oriented image data!");
+    return false;
+  }
+  if (ribbonModelPolyData->GetNumberOfPoints() < 2 || ribbonModelPolyData->GetNumberOfCells() < 2)
+  {
+    vtkErrorMacro("Convert: Cannot create binary labelmap from surface with number of points: "
+      << ribbonModelPolyData->GetNumberOfPoints() << " and number of cells: " << ribbonModelPolyData->GetNumberOfCells());
+    return false;
+  }
+
+  // Compute output geometry the same way as the base class
+  if (!this->CalculateOutputGeometry(ribbonModelPolyData, binaryLabelmap))
+  {
+    vtkErrorMacro("Convert: Failed to calculate output image geometry!");
+    return false;
+  }
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  binaryLabelmap->GetImageToWorldMatrix(imageToWorldMatrix);
+
+  // Transform the ribbon model to the IJK coordinate system of the output, as expected by the rasterizer
+  vtkSmartPointer<vtkTransform> worldToImageTransform = vtkSmartPointer<vtkTransform>::New();
+  worldToImageTransform->SetMatrix(imageToWorldMatrix);
+  worldToImageTransform->Inverse();
+  vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyDataFilter = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+  transformPolyDataFilter->SetInputData(ribbonModelPolyData);
+  transformPolyDataFilter->SetTransform(worldToImageTransform);
+  transformPolyDataFilter->Update();
+
+  // Rasterize on the voxel grid of the output geometry, only allocating the extent covered by the ribbon model
+  vtkSmartPointer<vtkImageData> referenceGrid = vtkSmartPointer<vtkImageData>::New();
+  referenceGrid->SetExtent(binaryLabelmap->GetExtent());
+  vtkSmartPointer<vtkPolyDataToLabelmapFilter> rasterizer = vtkSmartPointer<vtkPolyDataToLabelmapFilter>::New();
+  rasterizer->SetInputPolyData(transformPolyDataFilter->GetOutput());
+  rasterizer->SetReferenceImage(referenceGrid);
+  rasterizer->UseReferenceValuesOff();
+  rasterizer->CropToInputExtentOn();
+  rasterizer->SetLabelValue(1);
+  rasterizer->SetOutputScalarType(VTK_UNSIGNED_CHAR);
+  rasterizer->Update();
+
+  binaryLabelmap->ShallowCopy(rasterizer->GetOutput());
+  binaryLabelmap->SetGeometryFromImageToWorldMatrix(imageToWorldMatrix);
+  return true;
+}
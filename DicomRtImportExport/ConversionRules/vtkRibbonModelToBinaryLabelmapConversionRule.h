@@ -32,8 +32,9 @@
 
 /// \ingroup DicomRtImportImportExportConversionRules
 /// \brief Convert ribbon model representation (vtkPolyData type) to binary
-///   labelmap representation (vtkOrientedImageData type). The conversion algorithm
-///   is the same as the base class \sa vtkClosedSurfaceToBinaryLabelmapConversionRule
+///   labelmap representation (vtkOrientedImageData type). The output geometry is computed
+///   the same way as in the base class \sa vtkClosedSurfaceToBinaryLabelmapConversionRule, and the
+///   ribbon model is rasterized by \sa vtkPolyDataToLabelmapFilter cropped to its own extent
 class VTK_SLICER_DICOMRTIMPORTEXPORT_CONVERSIONRULES_EXPORT vtkRibbonModelToBinaryLabelmapConversionRule
   : public vtkClosedSurfaceToBinaryLabelmapConversionRule
 {
@@ -51,6 +52,9 @@ public:
   /// Human-readable name of the target representation
   virtual const char* GetTargetRepresentationName() VTK_OVERRIDE { return vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(); };
 
+  /// Update the target representation based on the source representation
+  virtual bool Convert(vtkDataObject* sourceRepresentation, vtkDataObject* targetRepresentation) VTK_OVERRIDE;
+
 protected:
   vtkRibbonModelToBinaryLabelmapConversionRule();
   ~vtkRibbonModelToBinaryLabelmapConversionRule();
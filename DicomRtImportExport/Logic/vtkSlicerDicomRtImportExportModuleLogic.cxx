@@ -30,6 +30,8 @@
 #include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
 #include "vtkPlanarContourToRibbonModelConversionRule.h"
 #include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToFractionalLabelmapConversionRule.h"
 #include "vtkClosedSurfaceToFractionalLabelmapConversionRule.h"
 #include "vtkFractionalLabelmapToClosedSurfaceConversionRule.h"
 
@@ -47,6 +49,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtPerformanceMonitor.h"
 #include "PlmCommon.h"
 #include "vtkMRMLIsodoseNode.h"
 #include "vtkMRMLPlanarImageNode.h"
@@ -109,6 +112,9 @@
 #include <vtkStripper.h>
 #include <vtkPlane.h>
 
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
 // ITK includes
 #include <itkImage.h>
 
@@ -721,8 +727,6 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtPlan(vtkSlicerD
     scene->AddNode(beamNode);
     // Add beam to plan
     planNode->AddBeam(beamNode);
-    // Update beam transforms (batch processing prevents processing events that would do this)
-    this->External->BeamsLogic->UpdateTransformForBeam(beamNode);
 
     // Create beam model hierarchy root node if has not been created yet
     if (beamModelHierarchyRootNode.GetPointer() == NULL)
@@ -762,6 +766,9 @@ bool vtkSlicerDicomRtImportExportModuleLogic::vtkInternal::LoadRtPlan(vtkSlicerD
     beamModelHierarchyNode->SetAndObserveDisplayNodeID( beamModelHierarchyDisplayNode->GetID() );
   }
 
+  // Update transforms of all beams at once (batch processing prevents processing events that would do this)
+  this->External->BeamsLogic->UpdateTransformsForPlan(planNode);
+
   // Insert plan isocenter series in subject hierarchy
   this->InsertSeriesInSubjectHierarchy(rtReader);
 
@@ -1623,6 +1630,10 @@ void vtkSlicerDicomRtImportExportModuleLogic::RegisterNodes()
     vtkSmartPointer<vtkPlanarContourToRibbonModelConversionRule>::New() );
   vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
     vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New() );
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkPlanarContourToBinaryLabelmapConversionRule>::New() );
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkPlanarContourToFractionalLabelmapConversionRule>::New() );
 
 }
 
@@ -1724,9 +1735,23 @@ bool vtkSlicerDicomRtImportExportModuleLogic::LoadDicomRT(vtkSlicerDICOMLoadable
 
   std::cout << "Loading series '" << loadable->GetName() << "' from file '" << firstFileName << "'" << std::endl;
 
+  vtkSlicerRtScopedTimer timer("DicomRtImportExport.LoadDicomRT");
+  if (vtkSlicerRtPerformanceMonitor::IsEnabled())
+  {
+    double bytesRead = 0.0;
+    for (int fileIndex=0; fileIndex<loadable->GetFiles()->GetNumberOfValues(); ++fileIndex)
+    {
+      bytesRead += static_cast<double>(vtksys::SystemTools::FileLength(loadable->GetFiles()->GetValue(fileIndex)));
+    }
+    vtkSlicerRtPerformanceMonitor::AddToCounter("DicomRtImportExport.LoadDicomRT", "Bytes read", bytesRead);
+  }
+
   vtkSmartPointer<vtkSlicerDicomRtReader> rtReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
   rtReader->SetFileName(firstFileName);
-  rtReader->Update();
+  {
+    vtkSlicerRtScopedTimer readTimer("DicomRtImportExport.LoadDicomRT.Read");
+    rtReader->Update();
+  }
 
   // One series can contain composite information, e.g, an RTPLAN series can contain structure sets and plans as well
   // TODO: vtkSlicerDicomRtReader class does not support this yet
@@ -1734,24 +1759,28 @@ bool vtkSlicerDicomRtImportExportModuleLogic::LoadDicomRT(vtkSlicerDICOMLoadable
   // RTSTRUCT
   if (rtReader->GetLoadRTStructureSetSuccessful())
   {
+    vtkSlicerRtScopedTimer loadTimer("DicomRtImportExport.LoadRtStructureSet");
     loadSuccessful = this->Internal->LoadRtStructureSet(rtReader, loadable);
   }
 
   // RTDOSE
   if (rtReader->GetLoadRTDoseSuccessful())
   {
+    vtkSlicerRtScopedTimer loadTimer("DicomRtImportExport.LoadRtDose");
     loadSuccessful = this->Internal->LoadRtDose(rtReader, loadable);
   }
 
   // RTPLAN
   if (rtReader->GetLoadRTPlanSuccessful())
   {
+    vtkSlicerRtScopedTimer loadTimer("DicomRtImportExport.LoadRtPlan");
     loadSuccessful = this->Internal->LoadRtPlan(rtReader, loadable);
   }
 
   // RTIMAGE
   if (rtReader->GetLoadRTImageSuccessful())
   {
+    vtkSlicerRtScopedTimer loadTimer("DicomRtImportExport.LoadRtImage");
     loadSuccessful = this->Internal->LoadRtImage(rtReader, loadable);
   }
 
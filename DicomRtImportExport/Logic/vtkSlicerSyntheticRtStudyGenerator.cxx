@@ -0,0 +1,614 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkSlicerSyntheticRtStudyGenerator.h"
+#include "vtkSlicerDicomRtWriter.h"
+
+// SlicerRtCommon includes
+#include "vtkSlicerRtPerformanceMonitor.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkDirectory.h>
+#include <vtkMath.h>
+#include <vtkMinimalStandardRandomSequence.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// DCMTK includes
+#include <dcmtk/config/osconfig.h> // make sure OS specific configuration is included first
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcuid.h>
+#include <dcmtk/dcmrt/drtplan.h>
+
+// Plastimatch includes
+#include "plm_image.h"
+#include "rt_study.h"
+#include "synthetic_mha.h"
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerSyntheticRtStudyGenerator);
+
+namespace
+{
+  const char* SYNTHETIC_PATIENT_NAME = "Synthetic^Patient";
+  const char* SYNTHETIC_PATIENT_ID = "SYNTHETIC";
+
+  /// Half size of the square field of the beams at the isocenter (mm)
+  const double FIELD_HALF_SIZE_MM = 50.0;
+  /// Gap between the MLC leaf banks sweeping across the field (mm)
+  const double LEAF_GAP_MM = 10.0;
+
+  /// Ellipsoid structure in LPS
+  struct SyntheticStructure
+  {
+    double Center[3];
+    double Radius[3];
+    double Color[3];
+  };
+
+  //----------------------------------------------------------------------------
+  double GetNextRandomValue(vtkMinimalStandardRandomSequence* randomSequence, double rangeMin, double rangeMax)
+  {
+    double value = randomSequence->GetRangeValue(rangeMin, rangeMax);
+    randomSequence->Next();
+    return value;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Format number or list of numbers as DICOM decimal string
+  std::string FormatDecimalString(const double* values, int numberOfValues)
+  {
+    std::ostringstream ss;
+    for (int index=0; index<numberOfValues; ++index)
+    {
+      if (index > 0)
+      {
+        ss << "\\";
+      }
+      ss << values[index];
+    }
+    return ss.str();
+  }
+
+  //----------------------------------------------------------------------------
+  std::string FormatDecimalString(double value)
+  {
+    return FormatDecimalString(&value, 1);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerSyntheticRtStudyGenerator::vtkSlicerSyntheticRtStudyGenerator()
+{
+  this->OutputDirectory = NULL;
+
+  // Clinical size by default
+  this->ImageDimensions[0] = 512;
+  this->ImageDimensions[1] = 512;
+  this->ImageDimensions[2] = 100;
+  this->ImageSpacing[0] = 1.0;
+  this->ImageSpacing[1] = 1.0;
+  this->ImageSpacing[2] = 3.0;
+  this->DoseSpacing[0] = 3.0;
+  this->DoseSpacing[1] = 3.0;
+  this->DoseSpacing[2] = 3.0;
+  this->PrescriptionDose = 60.0;
+  this->NumberOfStructures = 20;
+  this->NumberOfContourPoints = 100;
+  this->NumberOfBeams = 7;
+  this->NumberOfControlPoints = 10;
+  this->NumberOfLeafPairs = 60;
+  this->RandomSeed = 1;
+
+  this->StudyInstanceUid = NULL;
+  this->StructureSetFilePath = NULL;
+  this->DoseFilePath = NULL;
+  this->PlanFilePath = NULL;
+  this->NumberOfImageFiles = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerSyntheticRtStudyGenerator::~vtkSlicerSyntheticRtStudyGenerator()
+{
+  this->SetOutputDirectory(NULL);
+  this->SetStudyInstanceUid(NULL);
+  this->SetStructureSetFilePath(NULL);
+  this->SetDoseFilePath(NULL);
+  this->SetPlanFilePath(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerSyntheticRtStudyGenerator::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "OutputDirectory: " << (this->OutputDirectory ? this->OutputDirectory : "NULL") << "\n";
+  os << indent << "ImageDimensions: " << this->ImageDimensions[0] << ", " << this->ImageDimensions[1] << ", " << this->ImageDimensions[2] << "\n";
+  os << indent << "ImageSpacing: " << this->ImageSpacing[0] << ", " << this->ImageSpacing[1] << ", " << this->ImageSpacing[2] << "\n";
+  os << indent << "DoseSpacing: " << this->DoseSpacing[0] << ", " << this->DoseSpacing[1] << ", " << this->DoseSpacing[2] << "\n";
+  os << indent << "PrescriptionDose: " << this->PrescriptionDose << "\n";
+  os << indent << "NumberOfStructures: " << this->NumberOfStructures << "\n";
+  os << indent << "NumberOfContourPoints: " << this->NumberOfContourPoints << "\n";
+  os << indent << "NumberOfBeams: " << this->NumberOfBeams << "\n";
+  os << indent << "NumberOfControlPoints: " << this->NumberOfControlPoints << "\n";
+  os << indent << "NumberOfLeafPairs: " << this->NumberOfLeafPairs << "\n";
+  os << indent << "RandomSeed: " << this->RandomSeed << "\n";
+  os << indent << "StudyInstanceUid: " << (this->StudyInstanceUid ? this->StudyInstanceUid : "NULL") << "\n";
+  os << indent << "StructureSetFilePath: " << (this->StructureSetFilePath ? this->StructureSetFilePath : "NULL") << "\n";
+  os << indent << "DoseFilePath: " << (this->DoseFilePath ? this->DoseFilePath : "NULL") << "\n";
+  os << indent << "PlanFilePath: " << (this->PlanFilePath ? this->PlanFilePath : "NULL") << "\n";
+  os << indent << "NumberOfImageFiles: " << this->NumberOfImageFiles << "\n";
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerSyntheticRtStudyGenerator::Write()
+{
+  this->SetStudyInstanceUid(NULL);
+  this->SetStructureSetFilePath(NULL);
+  this->SetDoseFilePath(NULL);
+  this->SetPlanFilePath(NULL);
+  this->NumberOfImageFiles = 0;
+
+  if (!this->OutputDirectory || this->OutputDirectory[0] == 0)
+  {
+    vtkErrorMacro("Write: Output directory is not set");
+    return false;
+  }
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (this->ImageDimensions[axis] < 2 || this->ImageSpacing[axis] <= 0.0 || this->DoseSpacing[axis] <= 0.0)
+    {
+      vtkErrorMacro("Write: Invalid image or dose grid geometry");
+      return false;
+    }
+  }
+  if ( this->NumberOfStructures < 1 || this->NumberOfContourPoints < 3
+    || this->NumberOfBeams < 1 || this->NumberOfControlPoints < 2 || this->NumberOfLeafPairs < 0 )
+  {
+    vtkErrorMacro("Write: Invalid structure or plan parameters");
+    return false;
+  }
+
+  vtkSlicerRtScopedTimer timer("DicomRtImportExport.GenerateSyntheticStudy");
+
+  // CT grid in LPS, centered on the origin
+  double imageSize[3] = {0.0, 0.0, 0.0};
+  double imageOrigin[3] = {0.0, 0.0, 0.0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    imageSize[axis] = (this->ImageDimensions[axis] - 1) * this->ImageSpacing[axis];
+    imageOrigin[axis] = -0.5 * imageSize[axis];
+  }
+
+  // Create CT: box of water in air, filling 80% of the axial field of view
+  Synthetic_mha_parms imageParms;
+  for (int axis=0; axis<3; ++axis)
+  {
+    imageParms.dim[axis] = this->ImageDimensions[axis];
+    imageParms.origin[axis] = imageOrigin[axis];
+    imageParms.spacing[axis] = this->ImageSpacing[axis];
+  }
+  imageParms.pattern = PATTERN_RECT;
+  imageParms.background = -1000.0;
+  imageParms.foreground = 0.0;
+  double bodyHalfSize[3] = { 0.4 * imageSize[0], 0.4 * imageSize[1], 0.5 * imageSize[2] };
+  for (int axis=0; axis<3; ++axis)
+  {
+    imageParms.rect_size[2*axis] = -bodyHalfSize[axis];
+    imageParms.rect_size[2*axis+1] = bodyHalfSize[axis];
+  }
+  Rt_study imageStudy;
+  synthetic_mha(&imageStudy, &imageParms);
+
+  // Place ellipsoid structures inside the body. The first one is the target
+  vtkSmartPointer<vtkMinimalStandardRandomSequence> randomSequence = vtkSmartPointer<vtkMinimalStandardRandomSequence>::New();
+  randomSequence->SetSeed(this->RandomSeed);
+  double axialSize = std::min(imageSize[0], imageSize[1]);
+  std::vector<SyntheticStructure> structures(this->NumberOfStructures);
+  for (int structureIndex=0; structureIndex<this->NumberOfStructures; ++structureIndex)
+  {
+    SyntheticStructure& structure = structures[structureIndex];
+    structure.Radius[0] = GetNextRandomValue(randomSequence, 0.02, 0.08) * axialSize;
+    structure.Radius[1] = GetNextRandomValue(randomSequence, 0.02, 0.08) * axialSize;
+    structure.Radius[2] = std::max(GetNextRandomValue(randomSequence, 0.02, 0.1) * imageSize[2], 2.0 * this->ImageSpacing[2]);
+    for (int axis=0; axis<2; ++axis)
+    {
+      double centerRange = bodyHalfSize[axis] - 0.08 * axialSize;
+      structure.Center[axis] = GetNextRandomValue(randomSequence, -centerRange, centerRange);
+    }
+    structure.Center[2] = GetNextRandomValue(randomSequence, -0.35 * imageSize[2], 0.35 * imageSize[2]);
+    for (int component=0; component<3; ++component)
+    {
+      structure.Color[component] = GetNextRandomValue(randomSequence, 0.2, 1.0);
+    }
+  }
+
+  // Create dose: Gaussian around the target, on a dose grid covering the CT
+  Synthetic_mha_parms doseParms;
+  for (int axis=0; axis<3; ++axis)
+  {
+    doseParms.dim[axis] = static_cast<int>(floor(imageSize[axis] / this->DoseSpacing[axis])) + 1;
+    doseParms.origin[axis] = imageOrigin[axis];
+    doseParms.spacing[axis] = this->DoseSpacing[axis];
+    doseParms.gauss_center[axis] = structures[0].Center[axis];
+    doseParms.gauss_std[axis] = 2.0 * structures[0].Radius[axis];
+  }
+  doseParms.pattern = PATTERN_GAUSS;
+  doseParms.background = 0.0;
+  doseParms.foreground = this->PrescriptionDose;
+  Rt_study doseStudy;
+  synthetic_mha(&doseStudy, &doseParms);
+
+  // Set up RT writer. The study gets a new UID, so that its files can be told apart from others in the output directory
+  char uid[100];
+  this->SetStudyInstanceUid(dcmGenerateUniqueIdentifier(uid, SITE_STUDY_UID_ROOT));
+  vtkSmartPointer<vtkSlicerDicomRtWriter> rtWriter = vtkSmartPointer<vtkSlicerDicomRtWriter>::New();
+  rtWriter->SetStudyInstanceUid(this->StudyInstanceUid);
+  rtWriter->SetPatientName(SYNTHETIC_PATIENT_NAME);
+  rtWriter->SetPatientID(SYNTHETIC_PATIENT_ID);
+  rtWriter->SetStudyDescription("Synthetic RT study");
+  rtWriter->SetImageSeriesDescription("Synthetic CT");
+  rtWriter->SetImageSeriesModality("CT");
+  rtWriter->SetDoseSeriesDescription("Synthetic dose");
+  rtWriter->SetRtssSeriesDescription("Synthetic structures");
+  rtWriter->SetImage(imageStudy.get_image());
+  rtWriter->SetDose(doseStudy.get_image());
+
+  // Contour each structure on the CT slices it intersects
+  std::vector<double> contourCos(this->NumberOfContourPoints);
+  std::vector<double> contourSin(this->NumberOfContourPoints);
+  for (int pointIndex=0; pointIndex<this->NumberOfContourPoints; ++pointIndex)
+  {
+    double angle = 2.0 * vtkMath::Pi() * pointIndex / this->NumberOfContourPoints;
+    contourCos[pointIndex] = cos(angle);
+    contourSin[pointIndex] = sin(angle);
+  }
+  vtkIdType numberOfContours = 0;
+  for (int structureIndex=0; structureIndex<this->NumberOfStructures; ++structureIndex)
+  {
+    const SyntheticStructure& structure = structures[structureIndex];
+    std::vector<int> sliceNumbers;
+    std::vector<std::string> sliceUIDs;
+    std::vector<vtkPolyData*> sliceContours;
+    std::vector<vtkSmartPointer<vtkPolyData> > sliceContourPolyDatas;
+    for (int slice=0; slice<this->ImageDimensions[2]; ++slice)
+    {
+      double sliceZ = imageOrigin[2] + slice * this->ImageSpacing[2];
+      double normalizedZ = (sliceZ - structure.Center[2]) / structure.Radius[2];
+      if (normalizedZ <= -1.0 || normalizedZ >= 1.0)
+      {
+        continue;
+      }
+      double scale = sqrt(1.0 - normalizedZ * normalizedZ);
+
+      vtkSmartPointer<vtkPoints> contourPoints = vtkSmartPointer<vtkPoints>::New();
+      contourPoints->SetNumberOfPoints(this->NumberOfContourPoints);
+      vtkSmartPointer<vtkCellArray> contourCells = vtkSmartPointer<vtkCellArray>::New();
+      contourCells->InsertNextCell(this->NumberOfContourPoints);
+      for (int pointIndex=0; pointIndex<this->NumberOfContourPoints; ++pointIndex)
+      {
+        // The writer expects RAS coordinates
+        contourPoints->SetPoint(pointIndex,
+          -(structure.Center[0] + scale * structure.Radius[0] * contourCos[pointIndex]),
+          -(structure.Center[1] + scale * structure.Radius[1] * contourSin[pointIndex]),
+          sliceZ );
+        contourCells->InsertCellPoint(pointIndex);
+      }
+      vtkSmartPointer<vtkPolyData> contourPolyData = vtkSmartPointer<vtkPolyData>::New();
+      contourPolyData->SetPoints(contourPoints);
+      contourPolyData->SetPolys(contourCells);
+
+      sliceNumbers.push_back(slice);
+      sliceUIDs.push_back(""); // Assigned by Plastimatch when writing the CT
+      sliceContours.push_back(contourPolyData);
+      sliceContourPolyDatas.push_back(contourPolyData);
+    }
+    numberOfContours += static_cast<vtkIdType>(sliceContours.size());
+
+    std::ostringstream structureNameStream;
+    if (structureIndex == 0)
+    {
+      structureNameStream << "Target";
+    }
+    else
+    {
+      structureNameStream << "Structure_" << structureIndex;
+    }
+    double color[3] = { structure.Color[0], structure.Color[1], structure.Color[2] };
+    rtWriter->AddStructure(structureNameStream.str().c_str(), color, sliceNumbers, sliceUIDs, sliceContours);
+  }
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DicomRtImportExport.GenerateSyntheticStudy", "Contours", numberOfContours);
+
+  // Write CT, structure set and dose
+  rtWriter->SetFileName(this->OutputDirectory);
+  rtWriter->Write();
+
+  // The writer does not report errors, so check that the files of this study were written
+  std::string frameOfReferenceUid(""), structureSetInstanceUid(""), doseInstanceUid("");
+  if (!this->FindWrittenFiles(frameOfReferenceUid, structureSetInstanceUid, doseInstanceUid))
+  {
+    vtkErrorMacro("Write: Failed to write CT, structure set and dose to " << this->OutputDirectory);
+    this->SetStructureSetFilePath(NULL);
+    this->SetDoseFilePath(NULL);
+    return false;
+  }
+
+  // Write plan with the isocenter in the target
+  if (!this->WritePlan(structures[0].Center, frameOfReferenceUid, structureSetInstanceUid, doseInstanceUid))
+  {
+    this->SetStructureSetFilePath(NULL);
+    this->SetDoseFilePath(NULL);
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerSyntheticRtStudyGenerator::FindWrittenFiles(std::string& frameOfReferenceUid,
+  std::string& structureSetInstanceUid, std::string& doseInstanceUid)
+{
+  frameOfReferenceUid = "";
+  structureSetInstanceUid = "";
+  doseInstanceUid = "";
+  this->NumberOfImageFiles = 0;
+
+  vtkSmartPointer<vtkDirectory> directory = vtkSmartPointer<vtkDirectory>::New();
+  if (!this->StudyInstanceUid || !directory->Open(this->OutputDirectory))
+  {
+    vtkErrorMacro("FindWrittenFiles: Failed to open output directory " << this->OutputDirectory);
+    return false;
+  }
+  for (vtkIdType fileIndex=0; fileIndex<directory->GetNumberOfFiles(); ++fileIndex)
+  {
+    std::string filePath = std::string(this->OutputDirectory) + "/" + directory->GetFile(fileIndex);
+    if (directory->FileIsDirectory(directory->GetFile(fileIndex)))
+    {
+      continue;
+    }
+
+    // Only the header is needed, so long element values (pixel data) are not loaded
+    DcmFileFormat fileFormat;
+    if (fileFormat.loadFile(filePath.c_str(), EXS_Unknown, EGL_noChange, 1024).bad())
+    {
+      continue;
+    }
+    DcmDataset* dataset = fileFormat.getDataset();
+    OFString studyInstanceUid("");
+    dataset->findAndGetOFString(DCM_StudyInstanceUID, studyInstanceUid);
+    if (studyInstanceUid != this->StudyInstanceUid)
+    {
+      continue;
+    }
+    OFString modality("");
+    dataset->findAndGetOFString(DCM_Modality, modality);
+    if (modality == "CT")
+    {
+      if (frameOfReferenceUid.empty())
+      {
+        OFString uid("");
+        dataset->findAndGetOFString(DCM_FrameOfReferenceUID, uid);
+        frameOfReferenceUid = uid.c_str();
+      }
+      ++this->NumberOfImageFiles;
+    }
+    else if (modality == "RTSTRUCT" || modality == "RTDOSE")
+    {
+      OFString uid("");
+      dataset->findAndGetOFString(DCM_SOPInstanceUID, uid);
+      (modality == "RTSTRUCT" ? structureSetInstanceUid : doseInstanceUid) = uid.c_str();
+      if (modality == "RTSTRUCT")
+      {
+        this->SetStructureSetFilePath(filePath.c_str());
+      }
+      else
+      {
+        this->SetDoseFilePath(filePath.c_str());
+      }
+    }
+  }
+
+  if (this->NumberOfImageFiles != this->ImageDimensions[2] || frameOfReferenceUid.empty())
+  {
+    vtkErrorMacro("FindWrittenFiles: Found " << this->NumberOfImageFiles << " CT slices of the generated study in "
+      << this->OutputDirectory << ", expected " << this->ImageDimensions[2]);
+    return false;
+  }
+  if (structureSetInstanceUid.empty() || doseInstanceUid.empty())
+  {
+    vtkErrorMacro("FindWrittenFiles: Structure set or dose of the generated study is not found in " << this->OutputDirectory);
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerSyntheticRtStudyGenerator::WritePlan(double isocenterLps[3], const std::string& frameOfReferenceUid,
+  const std::string& structureSetInstanceUid, const std::string& doseInstanceUid)
+{
+  // Patient, study, series and plan
+  char uid[100];
+  DRTPlanIOD rtPlanObject;
+  rtPlanObject.setPatientName(SYNTHETIC_PATIENT_NAME);
+  rtPlanObject.setPatientID(SYNTHETIC_PATIENT_ID);
+  rtPlanObject.setStudyInstanceUID(this->StudyInstanceUid);
+  rtPlanObject.setStudyDescription("Synthetic RT study");
+  rtPlanObject.setFrameOfReferenceUID(frameOfReferenceUid.c_str());
+  rtPlanObject.setModality("RTPLAN");
+  rtPlanObject.setSeriesInstanceUID(dcmGenerateUniqueIdentifier(uid, SITE_SERIES_UID_ROOT));
+  rtPlanObject.setSeriesDescription("Synthetic plan");
+  rtPlanObject.setSOPClassUID(UID_RTPlanStorage);
+  rtPlanObject.setSOPInstanceUID(dcmGenerateUniqueIdentifier(uid, SITE_INSTANCE_UID_ROOT));
+  rtPlanObject.setRTPlanLabel("Synthetic");
+  rtPlanObject.setRTPlanGeometry("PATIENT");
+
+  DRTReferencedStructureSetSequence::Item* structureSetItem = NULL;
+  rtPlanObject.getReferencedStructureSetSequence().addItem(structureSetItem);
+  structureSetItem->setReferencedSOPClassUID(UID_RTStructureSetStorage);
+  structureSetItem->setReferencedSOPInstanceUID(structureSetInstanceUid.c_str());
+
+  DRTReferencedDoseSequence::Item* doseItem = NULL;
+  rtPlanObject.getReferencedDoseSequence().addItem(doseItem);
+  doseItem->setReferencedSOPClassUID(UID_RTDoseStorage);
+  doseItem->setReferencedSOPInstanceUID(doseInstanceUid.c_str());
+
+  DRTPatientSetupSequence::Item* patientSetupItem = NULL;
+  rtPlanObject.getPatientSetupSequence().addItem(patientSetupItem);
+  patientSetupItem->setPatientSetupNumber("1");
+  patientSetupItem->setPatientPosition("HFS");
+
+  // Single fraction group delivering 2 Gy per fraction with all beams
+  DRTFractionGroupSequence::Item* fractionGroupItem = NULL;
+  rtPlanObject.getFractionGroupSequence().addItem(fractionGroupItem);
+  fractionGroupItem->setFractionGroupNumber("1");
+  fractionGroupItem->setNumberOfFractionsPlanned(FormatDecimalString(vtkMath::Round(this->PrescriptionDose / 2.0)).c_str());
+  fractionGroupItem->setNumberOfBeams(FormatDecimalString(this->NumberOfBeams).c_str());
+  fractionGroupItem->setNumberOfBrachyApplicationSetups("0");
+  double beamMeterset = 200.0 / this->NumberOfBeams;
+
+  // Leaf boundaries and jaws are the same for all beams
+  std::vector<double> leafPositionBoundaries(this->NumberOfLeafPairs + 1, 0.0);
+  for (int boundaryIndex=0; this->NumberOfLeafPairs > 0 && boundaryIndex<=this->NumberOfLeafPairs; ++boundaryIndex)
+  {
+    leafPositionBoundaries[boundaryIndex] = -FIELD_HALF_SIZE_MM + 2.0 * FIELD_HALF_SIZE_MM * boundaryIndex / this->NumberOfLeafPairs;
+  }
+  double jawPositions[2] = { -FIELD_HALF_SIZE_MM, FIELD_HALF_SIZE_MM };
+  std::string jawPositionsString = FormatDecimalString(jawPositions, 2);
+  std::vector<double> leafPositions(2 * this->NumberOfLeafPairs);
+
+  for (int beamIndex=0; beamIndex<this->NumberOfBeams; ++beamIndex)
+  {
+    std::string beamNumberString = FormatDecimalString(beamIndex + 1);
+
+    DRTReferencedBeamSequenceInRTFractionSchemeModule::Item* referencedBeamItem = NULL;
+    fractionGroupItem->getReferencedBeamSequence().addItem(referencedBeamItem);
+    referencedBeamItem->setReferencedBeamNumber(beamNumberString.c_str());
+    referencedBeamItem->setBeamMeterset(FormatDecimalString(beamMeterset).c_str());
+
+    DRTBeamSequence::Item* beamItem = NULL;
+    rtPlanObject.getBeamSequence().addItem(beamItem);
+    beamItem->setBeamNumber(beamNumberString.c_str());
+    beamItem->setBeamName(("Beam_" + beamNumberString).c_str());
+    beamItem->setBeamType(this->NumberOfLeafPairs > 0 ? "DYNAMIC" : "STATIC");
+    beamItem->setRadiationType("PHOTON");
+    beamItem->setTreatmentMachineName("Synthetic");
+    beamItem->setPrimaryDosimeterUnit("MU");
+    beamItem->setSourceAxisDistance("1000");
+    beamItem->setTreatmentDeliveryType("TREATMENT");
+    beamItem->setReferencedPatientSetupNumber("1");
+    beamItem->setNumberOfWedges("0");
+    beamItem->setNumberOfCompensators("0");
+    beamItem->setNumberOfBoli("0");
+    beamItem->setNumberOfBlocks("0");
+    beamItem->setFinalCumulativeMetersetWeight("1");
+    beamItem->setNumberOfControlPoints(FormatDecimalString(this->NumberOfControlPoints).c_str());
+
+    // Beam limiting devices
+    const char* jawTypes[2] = { "ASYMX", "ASYMY" };
+    for (int jawIndex=0; jawIndex<2; ++jawIndex)
+    {
+      DRTBeamLimitingDeviceSequenceInRTBeamsModule::Item* deviceItem = NULL;
+      beamItem->getBeamLimitingDeviceSequence().addItem(deviceItem);
+      deviceItem->setRTBeamLimitingDeviceType(jawTypes[jawIndex]);
+      deviceItem->setNumberOfLeafJawPairs("1");
+    }
+    if (this->NumberOfLeafPairs > 0)
+    {
+      DRTBeamLimitingDeviceSequenceInRTBeamsModule::Item* deviceItem = NULL;
+      beamItem->getBeamLimitingDeviceSequence().addItem(deviceItem);
+      deviceItem->setRTBeamLimitingDeviceType("MLCX");
+      deviceItem->setNumberOfLeafJawPairs(FormatDecimalString(this->NumberOfLeafPairs).c_str());
+      deviceItem->setLeafPositionBoundaries(FormatDecimalString(&leafPositionBoundaries[0], this->NumberOfLeafPairs + 1).c_str());
+    }
+
+    // Control points. Gantry angles are evenly distributed, and the leaves sweep across the field with a fixed gap
+    double gantryAngle = 360.0 * beamIndex / this->NumberOfBeams;
+    for (int controlPointIndex=0; controlPointIndex<this->NumberOfControlPoints; ++controlPointIndex)
+    {
+      double cumulativeMetersetWeight = static_cast<double>(controlPointIndex) / (this->NumberOfControlPoints - 1);
+
+      DRTControlPointSequence::Item* controlPointItem = NULL;
+      beamItem->getControlPointSequence().addItem(controlPointItem);
+      controlPointItem->setControlPointIndex(FormatDecimalString(controlPointIndex).c_str());
+      controlPointItem->setCumulativeMetersetWeight(FormatDecimalString(cumulativeMetersetWeight).c_str());
+      if (controlPointIndex == 0)
+      {
+        controlPointItem->setNominalBeamEnergy("6");
+        controlPointItem->setGantryAngle(FormatDecimalString(gantryAngle).c_str());
+        controlPointItem->setGantryRotationDirection("NONE");
+        controlPointItem->setBeamLimitingDeviceAngle("0");
+        controlPointItem->setBeamLimitingDeviceRotationDirection("NONE");
+        controlPointItem->setPatientSupportAngle("0");
+        controlPointItem->setPatientSupportRotationDirection("NONE");
+        controlPointItem->setTableTopEccentricAngle("0");
+        controlPointItem->setTableTopEccentricRotationDirection("NONE");
+        controlPointItem->setIsocenterPosition(FormatDecimalString(isocenterLps, 3).c_str());
+
+        for (int jawIndex=0; jawIndex<2; ++jawIndex)
+        {
+          DRTBeamLimitingDevicePositionSequence::Item* positionItem = NULL;
+          controlPointItem->getBeamLimitingDevicePositionSequence().addItem(positionItem);
+          positionItem->setRTBeamLimitingDeviceType(jawTypes[jawIndex]);
+          positionItem->setLeafJawPositions(jawPositionsString.c_str());
+        }
+      }
+      if (this->NumberOfLeafPairs > 0)
+      {
+        double bankAPosition = -FIELD_HALF_SIZE_MM + cumulativeMetersetWeight * (2.0 * FIELD_HALF_SIZE_MM - LEAF_GAP_MM);
+        for (int leafIndex=0; leafIndex<this->NumberOfLeafPairs; ++leafIndex)
+        {
+          leafPositions[leafIndex] = bankAPosition;
+          leafPositions[this->NumberOfLeafPairs + leafIndex] = bankAPosition + LEAF_GAP_MM;
+        }
+        DRTBeamLimitingDevicePositionSequence::Item* positionItem = NULL;
+        controlPointItem->getBeamLimitingDevicePositionSequence().addItem(positionItem);
+        positionItem->setRTBeamLimitingDeviceType("MLCX");
+        positionItem->setLeafJawPositions(FormatDecimalString(&leafPositions[0], 2 * this->NumberOfLeafPairs).c_str());
+      }
+    }
+  }
+
+  // Write plan file
+  DcmFileFormat fileFormat;
+  OFCondition result = rtPlanObject.write(*fileFormat.getDataset());
+  if (result.bad())
+  {
+    vtkErrorMacro("WritePlan: Failed to create RT plan: " << result.text());
+    return false;
+  }
+  std::string planFilePath = std::string(this->OutputDirectory) + "/rtplan.dcm";
+  result = fileFormat.saveFile(planFilePath.c_str(), EXS_LittleEndianExplicit);
+  if (result.bad())
+  {
+    vtkErrorMacro("WritePlan: Failed to write RT plan to " << planFilePath << ": " << result.text());
+    return false;
+  }
+
+  this->SetPlanFilePath(planFilePath.c_str());
+  return true;
+}
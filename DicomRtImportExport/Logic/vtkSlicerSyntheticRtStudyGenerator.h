@@ -0,0 +1,159 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkSlicerSyntheticRtStudyGenerator_h
+#define __vtkSlicerSyntheticRtStudyGenerator_h
+
+#include "vtkSlicerDicomRtImportExportModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <string>
+
+/// \ingroup SlicerRt_QtModules_DicomRtImportExport
+/// \brief Generate a consistent synthetic DICOM RT study of configurable size
+///
+/// Writes a CT, an RTSTRUCT, an RT Dose and an RT Plan into the output directory, all in the same study and
+/// frame of reference, without the need of patient data. Intended for benchmarking the loading, conversion,
+/// DVH computation and export of large studies reproducibly.
+///
+/// The CT is a water box in air, and the dose is a Gaussian around the first structure, both created with the
+/// Plastimatch synthetic image generator (the shapes of the PlmSynth module) on their own grids. The structures
+/// are ellipsoids inside the box, written as planar contours on every CT slice they intersect. Their positions
+/// and sizes come from a random sequence initialized with \sa RandomSeed, so the same parameters always give
+/// the same study. The CT, structures and dose are written with \sa vtkSlicerDicomRtWriter. The plan has
+/// static gantry angles evenly distributed around the patient, and the MLC leaves of each beam sweep across
+/// the field over the control points. It is written with DCMTK, as the writer does not support plans.
+/// Each generated study gets a new study instance UID, and only the files of that study are referenced by the
+/// plan and reported as written, even if the output directory contains other studies.
+///
+/// For example, for a study about ten times the size of a clinical one, set 512x512x1000 CT voxels, 1 mm dose
+/// spacing, 200 structures with 500 contour points per slice, and 50 beams with 100 control points.
+class VTK_SLICER_DICOMRTIMPORTEXPORT_LOGIC_EXPORT vtkSlicerSyntheticRtStudyGenerator : public vtkObject
+{
+public:
+  static vtkSlicerSyntheticRtStudyGenerator *New();
+  vtkTypeMacro(vtkSlicerSyntheticRtStudyGenerator, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Generate the study and write it to the output directory
+  /// \return Success flag
+  virtual bool Write();
+
+  /// Output directory. Needs to exist. Files of the same names from earlier runs are overwritten
+  vtkGetStringMacro(OutputDirectory);
+  vtkSetStringMacro(OutputDirectory);
+
+  /// Number of CT voxels along each axis
+  vtkGetVector3Macro(ImageDimensions, int);
+  vtkSetVector3Macro(ImageDimensions, int);
+
+  /// CT voxel spacing in mm
+  vtkGetVector3Macro(ImageSpacing, double);
+  vtkSetVector3Macro(ImageSpacing, double);
+
+  /// Dose grid spacing in mm. The dose grid covers the CT
+  vtkGetVector3Macro(DoseSpacing, double);
+  vtkSetVector3Macro(DoseSpacing, double);
+
+  /// Maximum dose in Gy
+  vtkGetMacro(PrescriptionDose, double);
+  vtkSetMacro(PrescriptionDose, double);
+
+  /// Number of structures in the structure set
+  vtkGetMacro(NumberOfStructures, int);
+  vtkSetMacro(NumberOfStructures, int);
+
+  /// Number of points in each planar contour of the structures
+  vtkGetMacro(NumberOfContourPoints, int);
+  vtkSetMacro(NumberOfContourPoints, int);
+
+  /// Number of beams in the plan
+  vtkGetMacro(NumberOfBeams, int);
+  vtkSetMacro(NumberOfBeams, int);
+
+  /// Number of control points in each beam (at least 2)
+  vtkGetMacro(NumberOfControlPoints, int);
+  vtkSetMacro(NumberOfControlPoints, int);
+
+  /// Number of MLC leaf pairs in each beam. Zero means that the beams only have jaws
+  vtkGetMacro(NumberOfLeafPairs, int);
+  vtkSetMacro(NumberOfLeafPairs, int);
+
+  /// Seed of the random sequence that places the structures
+  vtkGetMacro(RandomSeed, int);
+  vtkSetMacro(RandomSeed, int);
+
+  /// Study instance UID of the last generated study
+  vtkGetStringMacro(StudyInstanceUid);
+  /// Path of the written structure set file. NULL if the last \sa Write failed
+  vtkGetStringMacro(StructureSetFilePath);
+  /// Path of the written dose file. NULL if the last \sa Write failed
+  vtkGetStringMacro(DoseFilePath);
+  /// Path of the written plan file. NULL if the last \sa Write failed
+  vtkGetStringMacro(PlanFilePath);
+  /// Number of written CT slice files
+  vtkGetMacro(NumberOfImageFiles, int);
+
+protected:
+  vtkSetStringMacro(StudyInstanceUid);
+  vtkSetStringMacro(StructureSetFilePath);
+  vtkSetStringMacro(DoseFilePath);
+  vtkSetStringMacro(PlanFilePath);
+
+  /// Find the files of the generated study (\sa StudyInstanceUid) in the output directory, and get the UIDs
+  /// the plan references. The RT writer does not report errors, so this also checks that all files were written
+  bool FindWrittenFiles(std::string& frameOfReferenceUid, std::string& structureSetInstanceUid, std::string& doseInstanceUid);
+
+  /// Write RT plan referencing the generated study, structure set and dose
+  bool WritePlan(double isocenterLps[3], const std::string& frameOfReferenceUid,
+    const std::string& structureSetInstanceUid, const std::string& doseInstanceUid);
+
+protected:
+  char* OutputDirectory;
+  int ImageDimensions[3];
+  double ImageSpacing[3];
+  double DoseSpacing[3];
+  double PrescriptionDose;
+  int NumberOfStructures;
+  int NumberOfContourPoints;
+  int NumberOfBeams;
+  int NumberOfControlPoints;
+  int NumberOfLeafPairs;
+  int RandomSeed;
+
+  char* StudyInstanceUid;
+  char* StructureSetFilePath;
+  char* DoseFilePath;
+  char* PlanFilePath;
+  int NumberOfImageFiles;
+
+protected:
+  vtkSlicerSyntheticRtStudyGenerator();
+  virtual ~vtkSlicerSyntheticRtStudyGenerator();
+
+private:
+  vtkSlicerSyntheticRtStudyGenerator(const vtkSlicerSyntheticRtStudyGenerator&); // Not implemented
+  void operator=(const vtkSlicerSyntheticRtStudyGenerator&);                     // Not implemented
+};
+
+#endif
@@ -41,6 +41,9 @@
 // CTK includes
 #include <ctkDICOMDatabase.h>
 
+// STD includes
+#include <algorithm>
+
 //----------------------------------------------------------------------------
 const std::string vtkSlicerDicomSroReader::DICOMSROREADER_DICOM_DATABASE_FILENAME = "/ctkDICOM.sql";
 const std::string vtkSlicerDicomSroReader::DICOMSROREADER_DICOM_CONNECTION_NAME = "Slicer";
@@ -502,36 +505,14 @@ void vtkSlicerDicomSroReader::LoadDeformableSpatialRegistration(DcmDataset* data
           this->DeformableRegistrationGridOrientationMatrix->SetElement(2,3,0);
 
           // Grid vector
-          OFString  tmpStrX;
-          OFString  tmpStrY;
-          OFString  tmpStrZ;
           this->DeformableRegistrationGrid->SetOrigin(imagePositionPatient[0], imagePositionPatient[1], imagePositionPatient[2]);
           this->DeformableRegistrationGrid->SetSpacing(gridSpacingX, gridSpacingY, gridSpacingZ);
-          this->DeformableRegistrationGrid->SetExtent(0,gridDimX-1,0,gridDimY-1,0,gridDimZ-1);
-          this->DeformableRegistrationGrid->AllocateScalars(VTK_DOUBLE, 3);
-
-          unsigned int n = 0;
-          for (unsigned int k=0; k<gridDimZ; k++)
+          unsigned int gridDimensions[3] = {gridDimX, gridDimY, gridDimZ};
+          if ( !vtkSlicerDicomSroReader::ReadVectorGridData(deformableRegistrationGridSequenceItem, gridDimensions, this->DeformableRegistrationGrid)
+            && !vtkSlicerDicomSroReader::ReadVectorGridDataPerValue(deformableRegistrationGridSequenceItem, gridDimensions, this->DeformableRegistrationGrid) )
           {
-            for (unsigned int j=0; j<gridDimY; j++)
-            {
-              for (unsigned int i=0; i<gridDimX; i++)
-              {
-                n = i + j*gridDimX + k*gridDimX*gridDimY ;
-                if (deformableRegistrationGridSequenceItem->findAndGetOFString(DCM_VectorGridData, tmpStrX, 3*n).good() &&
-                    deformableRegistrationGridSequenceItem->findAndGetOFString(DCM_VectorGridData, tmpStrY, 3*n + 1).good() &&
-                    deformableRegistrationGridSequenceItem->findAndGetOFString(DCM_VectorGridData, tmpStrZ, 3*n + 2).good())
-                {
-                  this->DeformableRegistrationGrid->SetScalarComponentFromDouble(i,j,k,0,-atof(tmpStrX.c_str()));
-                  this->DeformableRegistrationGrid->SetScalarComponentFromDouble(i,j,k,1,-atof(tmpStrY.c_str()));
-                  this->DeformableRegistrationGrid->SetScalarComponentFromDouble(i,j,k,2,atof(tmpStrZ.c_str()));
-                }
-                else
-                {
-                  continue;
-                }
-              }
-            }
+            vtkErrorMacro("LoadDeformableSpatialRegistration: Failed to read vector grid data");
+            break;
           }
         } // numOfMatrixRegistrationSequenceItems
       } // if 
@@ -540,3 +521,68 @@ void vtkSlicerDicomSroReader::LoadDeformableSpatialRegistration(DcmDataset* data
     this->LoadDeformableSpatialRegistrationSuccessful = true; 
   }
 }
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomSroReader::ReadVectorGridData(DcmItem* gridItem, const unsigned int gridDimensions[3], vtkImageData* grid)
+{
+  if (!gridItem || !grid)
+  {
+    return false;
+  }
+
+  const Float32* vectorGridData = NULL;
+  unsigned long numberOfValues = 0;
+  if (!gridItem->findAndGetFloat32Array(DCM_VectorGridData, vectorGridData, &numberOfValues).good() || !vectorGridData)
+  {
+    return false;
+  }
+  vtkIdType numberOfPoints = static_cast<vtkIdType>(gridDimensions[0]) * gridDimensions[1] * gridDimensions[2];
+  if (numberOfPoints == 0 || static_cast<vtkIdType>(numberOfValues) != 3 * numberOfPoints)
+  {
+    return false;
+  }
+
+  grid->SetExtent(0, gridDimensions[0]-1, 0, gridDimensions[1]-1, 0, gridDimensions[2]-1);
+  grid->AllocateScalars(VTK_FLOAT, 3);
+  float* gridScalars = static_cast<float*>(grid->GetScalarPointer());
+
+  // Displacements are stored in LPS, negate the first two components to get RAS
+  for (vtkIdType pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+  {
+    gridScalars[3*pointIndex] = -vectorGridData[3*pointIndex];
+    gridScalars[3*pointIndex+1] = -vectorGridData[3*pointIndex+1];
+    gridScalars[3*pointIndex+2] = vectorGridData[3*pointIndex+2];
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerDicomSroReader::ReadVectorGridDataPerValue(DcmItem* gridItem, const unsigned int gridDimensions[3], vtkImageData* grid)
+{
+  if (!gridItem || !grid || !gridItem->tagExists(DCM_VectorGridData))
+  {
+    return false;
+  }
+
+  grid->SetExtent(0, gridDimensions[0]-1, 0, gridDimensions[1]-1, 0, gridDimensions[2]-1);
+  grid->AllocateScalars(VTK_DOUBLE, 3);
+  double* gridScalars = static_cast<double*>(grid->GetScalarPointer());
+  vtkIdType numberOfPoints = static_cast<vtkIdType>(gridDimensions[0]) * gridDimensions[1] * gridDimensions[2];
+  std::fill(gridScalars, gridScalars + 3*numberOfPoints, 0.0);
+
+  OFString tmpStrX;
+  OFString tmpStrY;
+  OFString tmpStrZ;
+  for (vtkIdType n=0; n<numberOfPoints; ++n)
+  {
+    if (gridItem->findAndGetOFString(DCM_VectorGridData, tmpStrX, 3*n).good() &&
+        gridItem->findAndGetOFString(DCM_VectorGridData, tmpStrY, 3*n + 1).good() &&
+        gridItem->findAndGetOFString(DCM_VectorGridData, tmpStrZ, 3*n + 2).good())
+    {
+      gridScalars[3*n] = -atof(tmpStrX.c_str());
+      gridScalars[3*n+1] = -atof(tmpStrY.c_str());
+      gridScalars[3*n+2] = atof(tmpStrZ.c_str());
+    }
+  }
+  return true;
+}
@@ -35,6 +35,7 @@
 #include "vtkSlicerDicomSroImportModuleLogicExport.h"
 
 class DcmDataset;
+class DcmItem;
 class vtkMatrix4x4;
 class vtkImageData;
 
@@ -53,6 +54,21 @@ public:
   /// Do reading
   void Update();
 
+  /// Decode the VectorGridData element of a deformable registration grid item into a displacement field in RAS.
+  /// The float32 values are accessed as one block (DCMTK converts them to host byte order when loading),
+  /// and copied into a float vector image, changing the displacements from LPS to RAS in the same pass
+  /// \param gridItem Deformable registration grid sequence item
+  /// \param gridDimensions Number of grid points along each axis
+  /// \param grid Output image. Its extent is set from the grid dimensions, origin and spacing are not changed
+  /// \return Success flag. Fails if the values are not available as float32 array or their number does not match the grid
+  static bool ReadVectorGridData(DcmItem* gridItem, const unsigned int gridDimensions[3], vtkImageData* grid);
+
+  /// Decode the VectorGridData element value by value through the string representation of the values
+  /// into a double vector image. Much slower than \sa ReadVectorGridData, only used if that fails.
+  /// Grid points with missing values have zero displacement
+  /// \return Success flag. Fails if the grid item has no VectorGridData element
+  static bool ReadVectorGridDataPerValue(DcmItem* gridItem, const unsigned int gridDimensions[3], vtkImageData* grid);
+
 public:
   /// Get spatial registration matrix
   vtkGetObjectMacro(SpatialRegistrationMatrix, vtkMatrix4x4);
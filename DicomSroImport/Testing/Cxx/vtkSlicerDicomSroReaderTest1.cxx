@@ -0,0 +1,125 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomSroImport includes
+#include "vtkSlicerDicomSroReader.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+
+// DCMTK includes
+#include <dcmtk/config/osconfig.h>
+#include <dcmtk/dcmdata/dctk.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+//----------------------------------------------------------------------------
+int vtkSlicerDicomSroReaderTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // Create synthetic deformable registration grid item with smoothly varying displacements (in LPS)
+  const unsigned int gridDimensions[3] = {13, 11, 7};
+  const unsigned long numberOfPoints = gridDimensions[0] * gridDimensions[1] * gridDimensions[2];
+  std::vector<Float32> vectorGridData(3 * numberOfPoints, 0.0f);
+  for (unsigned long n=0; n<numberOfPoints; ++n)
+  {
+    vectorGridData[3*n] = static_cast<Float32>(5.0 * sin(0.1 * n));
+    vectorGridData[3*n+1] = static_cast<Float32>(2.0 - 0.01 * n);
+    vectorGridData[3*n+2] = static_cast<Float32>(0.25 * cos(0.03 * n));
+  }
+  DcmItem gridItem;
+  if (!gridItem.putAndInsertFloat32Array(DCM_VectorGridData, &(vectorGridData[0]), vectorGridData.size()).good())
+  {
+    std::cerr << "ERROR: Failed to create vector grid data element" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Decode with the bulk and the per-value method
+  vtkNew<vtkImageData> bulkGrid;
+  if (!vtkSlicerDicomSroReader::ReadVectorGridData(&gridItem, gridDimensions, bulkGrid.GetPointer()))
+  {
+    std::cerr << "ERROR: Failed to read vector grid data" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkNew<vtkImageData> perValueGrid;
+  if (!vtkSlicerDicomSroReader::ReadVectorGridDataPerValue(&gridItem, gridDimensions, perValueGrid.GetPointer()))
+  {
+    std::cerr << "ERROR: Failed to read vector grid data value by value" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (bulkGrid->GetScalarType() != VTK_FLOAT || bulkGrid->GetNumberOfScalarComponents() != 3)
+  {
+    std::cerr << "ERROR: Vector grid is expected to have three float components" << std::endl;
+    return EXIT_FAILURE;
+  }
+  int bulkDimensions[3] = {0, 0, 0};
+  int perValueDimensions[3] = {0, 0, 0};
+  bulkGrid->GetDimensions(bulkDimensions);
+  perValueGrid->GetDimensions(perValueDimensions);
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (bulkDimensions[axis] != static_cast<int>(gridDimensions[axis]) || perValueDimensions[axis] != bulkDimensions[axis])
+    {
+      std::cerr << "ERROR: Vector grid dimension mismatch along axis " << axis << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Compare the two decoded grids, and check the change from LPS to RAS
+  for (unsigned int k=0; k<gridDimensions[2]; ++k)
+  {
+    for (unsigned int j=0; j<gridDimensions[1]; ++j)
+    {
+      for (unsigned int i=0; i<gridDimensions[0]; ++i)
+      {
+        unsigned long n = i + j*gridDimensions[0] + k*gridDimensions[0]*gridDimensions[1];
+        for (int component=0; component<3; ++component)
+        {
+          double bulkValue = bulkGrid->GetScalarComponentAsDouble(i, j, k, component);
+          double perValueValue = perValueGrid->GetScalarComponentAsDouble(i, j, k, component);
+          double expectedValue = (component < 2 ? -1.0 : 1.0) * vectorGridData[3*n + component];
+          if (bulkValue != expectedValue || fabs(perValueValue - bulkValue) > 1e-5 * std::max(1.0, fabs(bulkValue)))
+          {
+            std::cerr << "ERROR: Vector grid value mismatch at point (" << i << ", " << j << ", " << k << "), component " << component
+              << ": bulk " << bulkValue << ", per-value " << perValueValue << ", expected " << expectedValue << std::endl;
+            return EXIT_FAILURE;
+          }
+        }
+      }
+    }
+  }
+
+  // Grid dimensions that do not match the number of values are rejected
+  const unsigned int invalidGridDimensions[3] = {13, 11, 8};
+  vtkNew<vtkImageData> invalidGrid;
+  if (vtkSlicerDicomSroReader::ReadVectorGridData(&gridItem, invalidGridDimensions, invalidGrid.GetPointer()))
+  {
+    std::cerr << "ERROR: Vector grid data was read with grid dimensions not matching the number of values" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Vector grid data decoding test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
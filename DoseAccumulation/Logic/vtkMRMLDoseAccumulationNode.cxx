@@ -24,6 +24,7 @@
 // MRML includes
 #include <vtkMRMLScene.h>
 #include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLTransformNode.h>
 
 // VTK includes
 #include <vtkObjectFactory.h>
@@ -44,7 +45,9 @@ vtkMRMLNodeNewMacro(vtkMRMLDoseAccumulationNode);
 vtkMRMLDoseAccumulationNode::vtkMRMLDoseAccumulationNode()
 {
   this->ShowDoseVolumesOnly = true;
+  this->UseDeformableAccumulation = false;
   this->VolumeNodeIdsToWeightsMap.clear();
+  this->VolumeNodeIdsToDeformationTransformNodeIdsMap.clear();
 
   this->HideFromEditors = false;
 }
@@ -53,6 +56,7 @@ vtkMRMLDoseAccumulationNode::vtkMRMLDoseAccumulationNode()
 vtkMRMLDoseAccumulationNode::~vtkMRMLDoseAccumulationNode()
 {
   this->VolumeNodeIdsToWeightsMap.clear();
+  this->VolumeNodeIdsToDeformationTransformNodeIdsMap.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -62,6 +66,7 @@ void vtkMRMLDoseAccumulationNode::WriteXML(ostream& of, int nIndent)
 
   // Write all MRML node attributes into output stream
   of << " ShowDoseVolumesOnly=\"" << (this->ShowDoseVolumesOnly ? "true" : "false") << "\"";
+  of << " UseDeformableAccumulation=\"" << (this->UseDeformableAccumulation ? "true" : "false") << "\"";
 
   {
     of << " VolumeNodeIdsToWeightsMap=\"";
@@ -71,6 +76,15 @@ void vtkMRMLDoseAccumulationNode::WriteXML(ostream& of, int nIndent)
       }
     of << "\"";
   }
+
+  {
+    of << " VolumeNodeIdsToDeformationTransformNodeIdsMap=\"";
+    for (std::map<std::string,std::string>::iterator it = this->VolumeNodeIdsToDeformationTransformNodeIdsMap.begin(); it != this->VolumeNodeIdsToDeformationTransformNodeIdsMap.end(); ++it)
+      {
+      of << it->first << ":" << it->second << "|";
+      }
+    of << "\"";
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -90,6 +104,26 @@ void vtkMRMLDoseAccumulationNode::ReadXMLAttributes(const char** atts)
       this->ShowDoseVolumesOnly = 
         (strcmp(attValue,"true") ? false : true);
       }
+    else if (!strcmp(attName, "UseDeformableAccumulation")) 
+      {
+      this->UseDeformableAccumulation = 
+        (strcmp(attValue,"true") ? false : true);
+      }
+    else if (!strcmp(attName, "VolumeNodeIdsToDeformationTransformNodeIdsMap")) 
+      {
+      this->VolumeNodeIdsToDeformationTransformNodeIdsMap.clear();
+      std::stringstream ss(attValue);
+      std::string mapPairStr;
+      while (std::getline(ss, mapPairStr, '|'))
+        {
+        size_t colonPosition = mapPairStr.find( ":" );
+        if (colonPosition == std::string::npos)
+          {
+          continue;
+          }
+        this->VolumeNodeIdsToDeformationTransformNodeIdsMap[mapPairStr.substr(0, colonPosition)] = mapPairStr.substr(colonPosition+1);
+        }
+      }
     else if (!strcmp(attName, "VolumeNodeIdsToWeightsMap")) 
       {
       std::string valueStr(attValue);
@@ -135,8 +169,10 @@ void vtkMRMLDoseAccumulationNode::Copy(vtkMRMLNode *anode)
   vtkMRMLDoseAccumulationNode *node = (vtkMRMLDoseAccumulationNode *) anode;
 
   this->SetShowDoseVolumesOnly(node->ShowDoseVolumesOnly);
+  this->SetUseDeformableAccumulation(node->UseDeformableAccumulation);
 
   this->VolumeNodeIdsToWeightsMap = node->VolumeNodeIdsToWeightsMap;
+  this->VolumeNodeIdsToDeformationTransformNodeIdsMap = node->VolumeNodeIdsToDeformationTransformNodeIdsMap;
 
   this->DisableModifiedEventOff();
   this->InvokePendingModifiedEvent();
@@ -148,6 +184,7 @@ void vtkMRMLDoseAccumulationNode::PrintSelf(ostream& os, vtkIndent indent)
   Superclass::PrintSelf(os,indent);
 
   os << indent << "ShowDoseVolumesOnly:   " << (this->ShowDoseVolumesOnly ? "true" : "false") << "\n";
+  os << indent << "UseDeformableAccumulation:   " << (this->UseDeformableAccumulation ? "true" : "false") << "\n";
 
   {
     os << indent << "VolumeNodeIdsToWeightsMap:   ";
@@ -157,6 +194,15 @@ void vtkMRMLDoseAccumulationNode::PrintSelf(ostream& os, vtkIndent indent)
       }
     os << "\n";
   }
+
+  {
+    os << indent << "VolumeNodeIdsToDeformationTransformNodeIdsMap:   ";
+    for (std::map<std::string,std::string>::iterator it = this->VolumeNodeIdsToDeformationTransformNodeIdsMap.begin(); it != this->VolumeNodeIdsToDeformationTransformNodeIdsMap.end(); ++it)
+      {
+      os << it->first << ":" << it->second << "|";
+      }
+    os << "\n";
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -270,3 +316,40 @@ double vtkMRMLDoseAccumulationNode::GetWeightForDoseVolume(vtkMRMLScalarVolumeNo
 
   return weightIt->second;
 }
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseAccumulationNode::SetDeformationTransformForDoseVolume(vtkMRMLScalarVolumeNode* node, vtkMRMLTransformNode* transformNode)
+{
+  if (!node)
+  {
+    vtkErrorMacro("SetDeformationTransformForDoseVolume: Invalid dose volume node given");
+    return;
+  }
+
+  if (transformNode)
+  {
+    this->VolumeNodeIdsToDeformationTransformNodeIdsMap[node->GetID()] = transformNode->GetID();
+  }
+  else
+  {
+    this->VolumeNodeIdsToDeformationTransformNodeIdsMap.erase(node->GetID());
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLTransformNode* vtkMRMLDoseAccumulationNode::GetDeformationTransformForDoseVolume(vtkMRMLScalarVolumeNode* node)
+{
+  if (!node || !this->Scene)
+  {
+    return NULL;
+  }
+
+  std::map<std::string, std::string>::iterator transformIt = this->VolumeNodeIdsToDeformationTransformNodeIdsMap.find(node->GetID());
+  if (transformIt == this->VolumeNodeIdsToDeformationTransformNodeIdsMap.end())
+  {
+    return NULL;
+  }
+
+  return vtkMRMLTransformNode::SafeDownCast(this->Scene->GetNodeByID(transformIt->second));
+}
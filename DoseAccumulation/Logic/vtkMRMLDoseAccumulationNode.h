@@ -31,6 +31,7 @@
 #include "vtkSlicerDoseAccumulationModuleLogicExport.h"
 
 class vtkMRMLScalarVolumeNode;
+class vtkMRMLTransformNode;
 
 /// \ingroup SlicerRt_QtModules_DoseAccumulation
 class VTK_SLICER_DOSEACCUMULATION_LOGIC_EXPORT vtkMRMLDoseAccumulationNode : public vtkMRMLNode
@@ -61,6 +62,12 @@ public:
   vtkGetMacro(ShowDoseVolumesOnly, bool);
   vtkSetMacro(ShowDoseVolumesOnly, bool);
 
+  /// Enable/Disable deformable accumulation. If enabled, each input dose is pulled through its
+  /// deformation transform (or its parent transform if no deformation is set) while accumulating
+  vtkBooleanMacro(UseDeformableAccumulation, bool);
+  vtkGetMacro(UseDeformableAccumulation, bool);
+  vtkSetMacro(UseDeformableAccumulation, bool);
+
   /// Get input reference dose volume node
   vtkMRMLScalarVolumeNode* GetReferenceDoseVolumeNode();
   /// Set and observe input reference dose volume node
@@ -91,6 +98,20 @@ public:
     return &this->VolumeNodeIdsToWeightsMap;
   }
 
+  /// Set deformation transform (typically a grid transform loaded from a deformable SRO or
+  /// Pinnacle DVF) for an input dose volume node. The input dose is considered to be placed
+  /// under this transform, so the transform maps the input dose into the reference dose space.
+  /// Set NULL to use the parent transform of the input dose volume.
+  void SetDeformationTransformForDoseVolume(vtkMRMLScalarVolumeNode* node, vtkMRMLTransformNode* transformNode);
+  /// Get deformation transform for an input dose volume node
+  /// \return The deformation transform node if set, NULL otherwise
+  vtkMRMLTransformNode* GetDeformationTransformForDoseVolume(vtkMRMLScalarVolumeNode* node);
+  /// Get volume node IDs to deformation transform node IDs map
+  std::map<std::string,std::string>* GetVolumeNodeIdsToDeformationTransformNodeIdsMap()
+  {
+    return &this->VolumeNodeIdsToDeformationTransformNodeIdsMap;
+  }
+
 protected:
   vtkMRMLDoseAccumulationNode();
   ~vtkMRMLDoseAccumulationNode();
@@ -101,9 +122,15 @@ protected:
   /// State of Show dose volumes only checkbox
   bool ShowDoseVolumesOnly;
 
+  /// Flag determining whether input doses are accumulated through their deformation transforms
+  bool UseDeformableAccumulation;
+
   /// Map assigning a weight to the available input volume nodes
   /// (as the user set it on the module GUI)
   std::map<std::string, double> VolumeNodeIdsToWeightsMap;
+
+  /// Map assigning a deformation transform node to the input volume nodes
+  std::map<std::string, std::string> VolumeNodeIdsToDeformationTransformNodeIdsMap;
 };
 
 #endif
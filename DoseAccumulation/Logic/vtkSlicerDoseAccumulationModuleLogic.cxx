@@ -47,23 +47,192 @@
 // VTK includes
 #include <vtkNew.h>
 #include <vtkImageMathematics.h>
+#include <vtkImageCast.h>
 #include <vtkImageData.h>
 #include <vtkSmartPointer.h>
 #include <vtkImageReslice.h>
 #include <vtkGeneralTransform.h>
+#include <vtkMatrix4x4.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
 
 //----------------------------------------------------------------------------
 const std::string vtkSlicerDoseAccumulationModuleLogic::DOSEACCUMULATION_ATTRIBUTE_PREFIX = "DoseAccumulation.";
 const std::string vtkSlicerDoseAccumulationModuleLogic::DOSEACCUMULATION_DOSE_VOLUME_NODE_NAME_ATTRIBUTE_NAME = vtkSlicerDoseAccumulationModuleLogic::DOSEACCUMULATION_ATTRIBUTE_PREFIX + "DoseVolumeNodeName";
 const std::string vtkSlicerDoseAccumulationModuleLogic::DOSEACCUMULATION_OUTPUT_BASE_NAME_PREFIX = "Accumulated_";
 
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Number of reference slices processed together by one thread in deformable accumulation
+  const vtkIdType DEFORMABLE_ACCUMULATION_TILE_SLICES = 4;
+
+  //----------------------------------------------------------------------------
+  /// Samples an input dose through a reference IJK to input IJK transform, and adds the
+  /// weighted samples to the accumulated dose. Works on a range of reference slices, so that
+  /// the reference grid can be processed tile by tile in parallel.
+  template<class T>
+  class DeformableDoseAccumulationFunctor
+  {
+  public:
+    DeformableDoseAccumulationFunctor(vtkImageData* inputImageData, vtkAbstractTransform* referenceIjkToInputIjkTransform, double weight, vtkImageData* accumulatedImageData)
+      : ReferenceIjkToInputIjkTransform(referenceIjkToInputIjkTransform)
+      , Weight(weight)
+    {
+      this->InputScalars = static_cast<T*>(inputImageData->GetScalarPointer());
+      inputImageData->GetExtent(this->InputExtent);
+      inputImageData->GetDimensions(this->InputDimensions);
+      this->AccumulatedScalars = static_cast<float*>(accumulatedImageData->GetScalarPointer());
+      accumulatedImageData->GetExtent(this->AccumulatedExtent);
+      accumulatedImageData->GetDimensions(this->AccumulatedDimensions);
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      const vtkIdType sliceSize = static_cast<vtkIdType>(this->AccumulatedDimensions[0]) * this->AccumulatedDimensions[1];
+      double referenceIjk[3] = {0.0, 0.0, 0.0};
+      double inputIjk[3] = {0.0, 0.0, 0.0};
+      for (vtkIdType k=beginSlice; k<endSlice; ++k)
+      {
+        referenceIjk[2] = this->AccumulatedExtent[4] + k;
+        float* accumulatedVoxel = this->AccumulatedScalars + k * sliceSize;
+        for (int j=0; j<this->AccumulatedDimensions[1]; ++j)
+        {
+          referenceIjk[1] = this->AccumulatedExtent[2] + j;
+          for (int i=0; i<this->AccumulatedDimensions[0]; ++i, ++accumulatedVoxel)
+          {
+            referenceIjk[0] = this->AccumulatedExtent[0] + i;
+            // Transform has been updated before the parallel section, so the internal
+            // transform function can be called without locking
+            this->ReferenceIjkToInputIjkTransform->InternalTransformPoint(referenceIjk, inputIjk);
+            double dose = 0.0;
+            if (this->Interpolate(inputIjk, dose))
+            {
+              (*accumulatedVoxel) += static_cast<float>(this->Weight * dose);
+            }
+          }
+        }
+      }
+    }
+
+  protected:
+    /// Trilinear interpolation of the input dose at a continuous IJK position
+    /// \return False if the position is outside the input dose grid
+    bool Interpolate(const double ijk[3], double& value) const
+    {
+      int lowerIndex[3] = {0, 0, 0};
+      int upperIndex[3] = {0, 0, 0};
+      double fraction[3] = {0.0, 0.0, 0.0};
+      for (int axis=0; axis<3; ++axis)
+      {
+        double position = ijk[axis] - this->InputExtent[2*axis];
+        int lastIndex = this->InputDimensions[axis] - 1;
+        if (position < -EPSILON || position > lastIndex + EPSILON)
+        {
+          return false;
+        }
+        if (position <= 0.0)
+        {
+          lowerIndex[axis] = upperIndex[axis] = 0;
+        }
+        else if (position >= lastIndex)
+        {
+          lowerIndex[axis] = upperIndex[axis] = lastIndex;
+        }
+        else
+        {
+          lowerIndex[axis] = static_cast<int>(position);
+          upperIndex[axis] = lowerIndex[axis] + 1;
+          fraction[axis] = position - lowerIndex[axis];
+        }
+      }
+
+      const vtkIdType incY = this->InputDimensions[0];
+      const vtkIdType incZ = static_cast<vtkIdType>(this->InputDimensions[0]) * this->InputDimensions[1];
+      const T* lowerSlice = this->InputScalars + lowerIndex[2] * incZ;
+      const T* upperSlice = this->InputScalars + upperIndex[2] * incZ;
+
+      double c00 = lowerSlice[lowerIndex[1]*incY + lowerIndex[0]] * (1.0-fraction[0]) + lowerSlice[lowerIndex[1]*incY + upperIndex[0]] * fraction[0];
+      double c10 = lowerSlice[upperIndex[1]*incY + lowerIndex[0]] * (1.0-fraction[0]) + lowerSlice[upperIndex[1]*incY + upperIndex[0]] * fraction[0];
+      double c01 = upperSlice[lowerIndex[1]*incY + lowerIndex[0]] * (1.0-fraction[0]) + upperSlice[lowerIndex[1]*incY + upperIndex[0]] * fraction[0];
+      double c11 = upperSlice[upperIndex[1]*incY + lowerIndex[0]] * (1.0-fraction[0]) + upperSlice[upperIndex[1]*incY + upperIndex[0]] * fraction[0];
+      double c0 = c00 * (1.0-fraction[1]) + c10 * fraction[1];
+      double c1 = c01 * (1.0-fraction[1]) + c11 * fraction[1];
+      value = c0 * (1.0-fraction[2]) + c1 * fraction[2];
+      return true;
+    }
+
+  protected:
+    vtkAbstractTransform* ReferenceIjkToInputIjkTransform;
+    double Weight;
+    T* InputScalars;
+    int InputExtent[6];
+    int InputDimensions[3];
+    float* AccumulatedScalars;
+    int AccumulatedExtent[6];
+    int AccumulatedDimensions[3];
+  };
+
+  //----------------------------------------------------------------------------
+  template<class T>
+  void AccumulateDeformedDose(vtkImageData* inputImageData, vtkAbstractTransform* referenceIjkToInputIjkTransform, double weight, vtkImageData* accumulatedImageData)
+  {
+    DeformableDoseAccumulationFunctor<T> functor(inputImageData, referenceIjkToInputIjkTransform, weight, accumulatedImageData);
+    int accumulatedDimensions[3] = {0, 0, 0};
+    accumulatedImageData->GetDimensions(accumulatedDimensions);
+    vtkSMPTools::For(0, accumulatedDimensions[2], DEFORMABLE_ACCUMULATION_TILE_SLICES, functor);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Adds the weighted sum of float images to a float accumulated image. All inputs are read
+  /// in the same pass over the voxels, so the accumulated image is read and written only once.
+  class WeightedSumFunctor
+  {
+  public:
+    WeightedSumFunctor(float* accumulatedScalars, const std::vector<const float*>& inputScalars, const std::vector<double>& weights, bool replace)
+      : AccumulatedScalars(accumulatedScalars)
+      , InputScalars(inputScalars)
+      , Weights(weights)
+      , Replace(replace)
+    {
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      const size_t numberOfInputs = this->InputScalars.size();
+      for (vtkIdType voxelIndex=begin; voxelIndex<end; ++voxelIndex)
+      {
+        double sum = (this->Replace ? 0.0 : this->AccumulatedScalars[voxelIndex]);
+        for (size_t inputIndex=0; inputIndex<numberOfInputs; ++inputIndex)
+        {
+          sum += this->Weights[inputIndex] * this->InputScalars[inputIndex][voxelIndex];
+        }
+        this->AccumulatedScalars[voxelIndex] = static_cast<float>(sum);
+      }
+    }
+
+  protected:
+    float* AccumulatedScalars;
+    const std::vector<const float*>& InputScalars;
+    const std::vector<double>& Weights;
+    bool Replace;
+  };
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseAccumulationModuleLogic);
 
 //----------------------------------------------------------------------------
 vtkSlicerDoseAccumulationModuleLogic::vtkSlicerDoseAccumulationModuleLogic()
 {
+  this->LastAccumulationPeakMemoryUsageMB = 0.0;
+  this->LastAccumulationWorkingMemoryMB = 0.0;
 }
 
 //----------------------------------------------------------------------------
@@ -75,6 +244,9 @@ vtkSlicerDoseAccumulationModuleLogic::~vtkSlicerDoseAccumulationModuleLogic()
 void vtkSlicerDoseAccumulationModuleLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "LastAccumulationPeakMemoryUsageMB: " << this->LastAccumulationPeakMemoryUsageMB << "\n";
+  os << indent << "LastAccumulationWorkingMemoryMB: " << this->LastAccumulationWorkingMemoryMB << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -147,6 +319,31 @@ void vtkSlicerDoseAccumulationModuleLogic::OnMRMLSceneNodeRemoved(vtkMRMLNode* n
       vtkMRMLDoseAccumulationNode* doseAccumulationNode = vtkMRMLDoseAccumulationNode::SafeDownCast(*nodeIt);
       doseAccumulationNode->RemoveSelectedInputVolumeNode(volumeNode);
       doseAccumulationNode->GetVolumeNodeIdsToWeightsMap()->erase(volumeNode->GetID());
+      doseAccumulationNode->GetVolumeNodeIdsToDeformationTransformNodeIdsMap()->erase(volumeNode->GetID());
+    }
+  }
+
+  // Remove deformation transform node from parameter set nodes
+  vtkMRMLTransformNode* transformNode = vtkMRMLTransformNode::SafeDownCast(node);
+  if (transformNode)
+  {
+    std::vector<vtkMRMLNode*> nodes;
+    this->GetMRMLScene()->GetNodesByClass("vtkMRMLDoseAccumulationNode", nodes);
+    for (std::vector<vtkMRMLNode*>::iterator nodeIt=nodes.begin(); nodeIt!=nodes.end(); ++nodeIt)
+    {
+      vtkMRMLDoseAccumulationNode* doseAccumulationNode = vtkMRMLDoseAccumulationNode::SafeDownCast(*nodeIt);
+      std::map<std::string,std::string>* transformMap = doseAccumulationNode->GetVolumeNodeIdsToDeformationTransformNodeIdsMap();
+      for (std::map<std::string,std::string>::iterator transformIt=transformMap->begin(); transformIt!=transformMap->end(); )
+      {
+        if (transformIt->second == transformNode->GetID())
+        {
+          transformMap->erase(transformIt++);
+        }
+        else
+        {
+          ++transformIt;
+        }
+      }
     }
   }
 
@@ -203,55 +400,75 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
     return errorMessage;
   }
 
-  // Get reference image info
-  int referenceDimensions[3] = {0, 0, 0};
-  referenceDoseVolumeNode->GetImageData()->GetDimensions(referenceDimensions);
+  if (!referenceDoseVolumeNode->GetImageData())
+  {
+    std::string errorMessage("No image data in reference volume");
+    vtkErrorMacro("AccumulateDoseVolumes: " << errorMessage);
+    return errorMessage;
+  }
+
+  this->LastAccumulationPeakMemoryUsageMB = vtkSlicerRtCommon::GetProcessPeakMemoryUsageMB();
+  this->LastAccumulationWorkingMemoryMB = 0.0;
 
   // Apply weight and accumulate input dose volumes
   vtkSmartPointer<vtkImageData> accumulatedImageData = vtkSmartPointer<vtkImageData>::New();
-  for (int inputVolumeIndex = 0; inputVolumeIndex<numberOfInputDoseVolumes; inputVolumeIndex++)
+  if (parameterNode->GetUseDeformableAccumulation())
   {
-    vtkMRMLScalarVolumeNode* currentInputDoseVolumeNode = parameterNode->GetNthSelectedInputVolumeNode(inputVolumeIndex);
-    if (!currentInputDoseVolumeNode->GetImageData())
-    {
-      std::stringstream errorMessage;
-      errorMessage << "No image data in input volume #" << inputVolumeIndex;
-      vtkErrorMacro("AccumulateDoseVolumes: " << errorMessage.str());
-      return errorMessage.str().c_str();
-    }
-    std::map<std::string,double>* volumeNodeIdsToWeightsMap = parameterNode->GetVolumeNodeIdsToWeightsMap();
-    double currentWeight = (*volumeNodeIdsToWeightsMap)[currentInputDoseVolumeNode->GetID()];
-
-    vtkMRMLScalarVolumeNode* resampledInputDoseVolumeNode = 
-      vtkSlicerVolumesLogic::ResampleVolumeToReferenceVolume(currentInputDoseVolumeNode, referenceDoseVolumeNode);
-
-    // Apply weight
-    vtkSmartPointer<vtkImageMathematics> multiplyFilter = vtkSmartPointer<vtkImageMathematics>::New();
-    multiplyFilter->SetInputConnection(resampledInputDoseVolumeNode->GetImageDataConnection());
-    multiplyFilter->SetConstantK(currentWeight);
-    multiplyFilter->SetOperationToMultiplyByK();
-    multiplyFilter->Update();
-
-    // Add (accumulate) current input volume to the intermediate accumulated volume
-    if (inputVolumeIndex > 0)
+    std::string errorMessage = this->AccumulateDoseVolumesDeformable(parameterNode, accumulatedImageData);
+    if (!errorMessage.empty())
     {
-      vtkSmartPointer<vtkImageMathematics> addFilter = vtkSmartPointer<vtkImageMathematics>::New(); 
-      addFilter->SetInput1Data(accumulatedImageData);
-      addFilter->SetInput2Data(multiplyFilter->GetOutput());
-      addFilter->SetOperationToAdd();
-      addFilter->Update();
-
-      accumulatedImageData->DeepCopy(addFilter->GetOutput());
+      return errorMessage;
     }
-    // If intermediate accumulated volume is empty (first iteration)
-    // then just copy the weighted input dose volume in it
-    else
+  }
+  else
+  {
+    for (int inputVolumeIndex = 0; inputVolumeIndex<numberOfInputDoseVolumes; inputVolumeIndex++)
     {
-      accumulatedImageData->DeepCopy(multiplyFilter->GetOutput());
+      vtkMRMLScalarVolumeNode* currentInputDoseVolumeNode = parameterNode->GetNthSelectedInputVolumeNode(inputVolumeIndex);
+      if (!currentInputDoseVolumeNode->GetImageData())
+      {
+        std::stringstream errorMessage;
+        errorMessage << "No image data in input volume #" << inputVolumeIndex;
+        vtkErrorMacro("AccumulateDoseVolumes: " << errorMessage.str());
+        return errorMessage.str().c_str();
+      }
+      std::map<std::string,double>* volumeNodeIdsToWeightsMap = parameterNode->GetVolumeNodeIdsToWeightsMap();
+      double currentWeight = (*volumeNodeIdsToWeightsMap)[currentInputDoseVolumeNode->GetID()];
+
+      vtkMRMLScalarVolumeNode* resampledInputDoseVolumeNode = 
+        vtkSlicerVolumesLogic::ResampleVolumeToReferenceVolume(currentInputDoseVolumeNode, referenceDoseVolumeNode);
+
+      // Apply weight
+      vtkSmartPointer<vtkImageMathematics> multiplyFilter = vtkSmartPointer<vtkImageMathematics>::New();
+      multiplyFilter->SetInputConnection(resampledInputDoseVolumeNode->GetImageDataConnection());
+      multiplyFilter->SetConstantK(currentWeight);
+      multiplyFilter->SetOperationToMultiplyByK();
+      multiplyFilter->Update();
+
+      // Add (accumulate) current input volume to the intermediate accumulated volume
+      if (inputVolumeIndex > 0)
+      {
+        vtkSmartPointer<vtkImageMathematics> addFilter = vtkSmartPointer<vtkImageMathematics>::New(); 
+        addFilter->SetInput1Data(accumulatedImageData);
+        addFilter->SetInput2Data(multiplyFilter->GetOutput());
+        addFilter->SetOperationToAdd();
+        addFilter->Update();
+
+        accumulatedImageData->DeepCopy(addFilter->GetOutput());
+      }
+      // If intermediate accumulated volume is empty (first iteration)
+      // then just copy the weighted input dose volume in it
+      else
+      {
+        accumulatedImageData->DeepCopy(multiplyFilter->GetOutput());
+      }
+
+      // Remove the resample dose currentNode from scene and release the memory
+      this->GetMRMLScene()->RemoveNode(resampledInputDoseVolumeNode);
     }
 
-    // Remove the resample dose currentNode from scene and release the memory
-    this->GetMRMLScene()->RemoveNode(resampledInputDoseVolumeNode);
+    this->LastAccumulationWorkingMemoryMB = accumulatedImageData->GetActualMemorySize() / 1024.0;
+    this->LastAccumulationPeakMemoryUsageMB = vtkSlicerRtCommon::GetProcessPeakMemoryUsageMB();
   }
 
   // Create display currentNode for the accumulated volume
@@ -325,3 +542,197 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
 
   return "";
 }
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumesDeformable(vtkMRMLDoseAccumulationNode* parameterNode, vtkImageData* accumulatedImageData)
+{
+  if (!parameterNode || !accumulatedImageData)
+  {
+    std::string errorMessage("Invalid input arguments");
+    vtkErrorMacro("AccumulateDoseVolumesDeformable: " << errorMessage);
+    return errorMessage;
+  }
+  vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = parameterNode->GetReferenceDoseVolumeNode();
+  if (!referenceDoseVolumeNode || !referenceDoseVolumeNode->GetImageData())
+  {
+    std::string errorMessage("Invalid reference volume");
+    vtkErrorMacro("AccumulateDoseVolumesDeformable: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Allocate accumulated dose in the reference geometry. This is the only full-size buffer
+  // allocated by the accumulation, its size does not depend on the number of fractions.
+  vtkImageData* referenceImageData = referenceDoseVolumeNode->GetImageData();
+  accumulatedImageData->SetExtent(referenceImageData->GetExtent());
+  accumulatedImageData->SetOrigin(referenceImageData->GetOrigin());
+  accumulatedImageData->SetSpacing(referenceImageData->GetSpacing());
+  accumulatedImageData->AllocateScalars(VTK_FLOAT, 1);
+  float* accumulatedScalars = static_cast<float*>(accumulatedImageData->GetScalarPointer());
+  std::fill(accumulatedScalars, accumulatedScalars + accumulatedImageData->GetNumberOfPoints(), 0.0f);
+  this->LastAccumulationWorkingMemoryMB = accumulatedImageData->GetActualMemorySize() / 1024.0;
+
+  // Reference IJK to world transform
+  vtkSmartPointer<vtkMatrix4x4> referenceIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceDoseVolumeNode->GetIJKToRASMatrix(referenceIjkToRasMatrix);
+  vtkSmartPointer<vtkGeneralTransform> referenceRasToWorldTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+  if (referenceDoseVolumeNode->GetParentTransformNode())
+  {
+    referenceDoseVolumeNode->GetParentTransformNode()->GetTransformToWorld(referenceRasToWorldTransform);
+  }
+
+  int numberOfInputDoseVolumes = parameterNode->GetNumberOfSelectedInputVolumeNodes();
+  for (int inputVolumeIndex = 0; inputVolumeIndex<numberOfInputDoseVolumes; inputVolumeIndex++)
+  {
+    vtkMRMLScalarVolumeNode* currentInputDoseVolumeNode = parameterNode->GetNthSelectedInputVolumeNode(inputVolumeIndex);
+    vtkImageData* currentInputImageData = (currentInputDoseVolumeNode ? currentInputDoseVolumeNode->GetImageData() : NULL);
+    if (!currentInputImageData || !currentInputImageData->GetScalarPointer())
+    {
+      std::stringstream errorMessage;
+      errorMessage << "No image data in input volume #" << inputVolumeIndex;
+      vtkErrorMacro("AccumulateDoseVolumesDeformable: " << errorMessage.str());
+      return errorMessage.str();
+    }
+    if (currentInputImageData->GetNumberOfScalarComponents() != 1)
+    {
+      std::stringstream errorMessage;
+      errorMessage << "Input volume #" << inputVolumeIndex << " is not a scalar volume";
+      vtkErrorMacro("AccumulateDoseVolumesDeformable: " << errorMessage.str());
+      return errorMessage.str();
+    }
+    double currentWeight = parameterNode->GetWeightForDoseVolume(currentInputDoseVolumeNode);
+
+    // Assemble reference IJK to input IJK transform. The input dose is pulled through its deformation
+    // transform if specified, otherwise through its parent transform (identity if there is none)
+    vtkMRMLTransformNode* deformationTransformNode = parameterNode->GetDeformationTransformForDoseVolume(currentInputDoseVolumeNode);
+    if (!deformationTransformNode)
+    {
+      deformationTransformNode = currentInputDoseVolumeNode->GetParentTransformNode();
+    }
+    vtkSmartPointer<vtkMatrix4x4> inputRasToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    currentInputDoseVolumeNode->GetRASToIJKMatrix(inputRasToIjkMatrix);
+
+    vtkSmartPointer<vtkGeneralTransform> referenceIjkToInputIjkTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+    referenceIjkToInputIjkTransform->PostMultiply();
+    referenceIjkToInputIjkTransform->Concatenate(referenceIjkToRasMatrix);
+    referenceIjkToInputIjkTransform->Concatenate(referenceRasToWorldTransform);
+    if (deformationTransformNode)
+    {
+      vtkSmartPointer<vtkGeneralTransform> worldToInputRasTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+      deformationTransformNode->GetTransformFromWorld(worldToInputRasTransform);
+      referenceIjkToInputIjkTransform->Concatenate(worldToInputRasTransform);
+    }
+    referenceIjkToInputIjkTransform->Concatenate(inputRasToIjkMatrix);
+    // Update before the parallel section so that the transform is not updated concurrently
+    referenceIjkToInputIjkTransform->Update();
+
+    // Sample the input dose through the transform directly into the accumulated dose
+    switch (currentInputImageData->GetScalarType())
+    {
+      vtkTemplateMacro(AccumulateDeformedDose<VTK_TT>(
+        currentInputImageData, referenceIjkToInputIjkTransform, currentWeight, accumulatedImageData ));
+    default:
+      {
+        std::stringstream errorMessage;
+        errorMessage << "Unsupported scalar type in input volume #" << inputVolumeIndex;
+        vtkErrorMacro("AccumulateDoseVolumesDeformable: " << errorMessage.str());
+        return errorMessage.str();
+      }
+    }
+
+    // Record memory high-water mark after each fraction
+    this->LastAccumulationPeakMemoryUsageMB = vtkSlicerRtCommon::GetProcessPeakMemoryUsageMB();
+    vtkDebugMacro("AccumulateDoseVolumesDeformable: Accumulated input volume #" << inputVolumeIndex << " ('" << currentInputDoseVolumeNode->GetName()
+      << "', weight " << currentWeight << (deformationTransformNode ? ", deformed" : "") << "). Peak memory usage: " << this->LastAccumulationPeakMemoryUsageMB << " MB");
+
+    double progress = (double)(inputVolumeIndex+1) / numberOfInputDoseVolumes;
+    this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseAccumulationModuleLogic::ResampleDoseVolumeToReferenceGeometry(vtkMRMLScalarVolumeNode* doseVolumeNode,
+  vtkMRMLScalarVolumeNode* referenceVolumeNode, vtkImageData* resampledImageData)
+{
+  if (!doseVolumeNode || !doseVolumeNode->GetImageData() || !referenceVolumeNode || !referenceVolumeNode->GetImageData() || !resampledImageData)
+  {
+    vtkGenericWarningMacro("vtkSlicerDoseAccumulationModuleLogic::ResampleDoseVolumeToReferenceGeometry: Invalid input arguments");
+    return false;
+  }
+
+  vtkMRMLScalarVolumeNode* resampledVolumeNode = vtkSlicerVolumesLogic::ResampleVolumeToReferenceVolume(doseVolumeNode, referenceVolumeNode);
+  if (!resampledVolumeNode || !resampledVolumeNode->GetImageData())
+  {
+    vtkGenericWarningMacro("vtkSlicerDoseAccumulationModuleLogic::ResampleDoseVolumeToReferenceGeometry: Failed to resample dose volume "
+      << doseVolumeNode->GetName());
+    return false;
+  }
+
+  if (resampledVolumeNode->GetImageData()->GetScalarType() == VTK_FLOAT)
+  {
+    resampledImageData->ShallowCopy(resampledVolumeNode->GetImageData());
+  }
+  else
+  {
+    vtkSmartPointer<vtkImageCast> castFilter = vtkSmartPointer<vtkImageCast>::New();
+    castFilter->SetInputData(resampledVolumeNode->GetImageData());
+    castFilter->SetOutputScalarTypeToFloat();
+    castFilter->Update();
+    resampledImageData->ShallowCopy(castFilter->GetOutput());
+  }
+
+  // Only the voxels are needed, the resampled node is not kept in the scene
+  if (resampledVolumeNode->GetScene())
+  {
+    resampledVolumeNode->GetScene()->RemoveNode(resampledVolumeNode);
+  }
+
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseAccumulationModuleLogic::AddWeightedImages(vtkImageData* accumulatedImageData,
+  const std::vector<vtkImageData*>& images, const std::vector<double>& weights, bool replace)
+{
+  if (!accumulatedImageData || images.size() != weights.size())
+  {
+    vtkGenericWarningMacro("vtkSlicerDoseAccumulationModuleLogic::AddWeightedImages: Invalid input arguments");
+    return false;
+  }
+  if (accumulatedImageData->GetScalarType() != VTK_FLOAT || accumulatedImageData->GetNumberOfScalarComponents() != 1)
+  {
+    vtkGenericWarningMacro("vtkSlicerDoseAccumulationModuleLogic::AddWeightedImages: Accumulated image must have one float component");
+    return false;
+  }
+
+  int accumulatedDimensions[3] = {0, 0, 0};
+  accumulatedImageData->GetDimensions(accumulatedDimensions);
+  std::vector<const float*> inputScalars;
+  for (std::vector<vtkImageData*>::const_iterator imageIt=images.begin(); imageIt!=images.end(); ++imageIt)
+  {
+    vtkImageData* image = (*imageIt);
+    int dimensions[3] = {0, 0, 0};
+    if (image)
+    {
+      image->GetDimensions(dimensions);
+    }
+    if ( !image || image->GetScalarType() != VTK_FLOAT || image->GetNumberOfScalarComponents() != 1
+      || dimensions[0] != accumulatedDimensions[0] || dimensions[1] != accumulatedDimensions[1] || dimensions[2] != accumulatedDimensions[2] )
+    {
+      vtkGenericWarningMacro("vtkSlicerDoseAccumulationModuleLogic::AddWeightedImages: Input images must have one float component and the same dimensions as the accumulated image");
+      return false;
+    }
+    inputScalars.push_back(static_cast<const float*>(image->GetScalarPointer()));
+  }
+
+  vtkIdType numberOfVoxels = static_cast<vtkIdType>(accumulatedDimensions[0]) * accumulatedDimensions[1] * accumulatedDimensions[2];
+  WeightedSumFunctor functor(static_cast<float*>(accumulatedImageData->GetScalarPointer()), inputScalars, weights, replace);
+  vtkSMPTools::For(0, numberOfVoxels, functor);
+  // The scalars are modified in place, so their modified time needs to be updated as well for the pipeline
+  // consumers of the image (such as the slice views) that check the array instead of the image
+  accumulatedImageData->GetPointData()->GetScalars()->Modified();
+  accumulatedImageData->Modified();
+
+  return true;
+}
@@ -33,7 +33,12 @@
 
 #include "vtkSlicerDoseAccumulationModuleLogicExport.h"
 
+// STD includes
+#include <vector>
+
+class vtkImageData;
 class vtkMRMLDoseAccumulationNode;
+class vtkMRMLScalarVolumeNode;
 
 /// \ingroup SlicerRt_QtModules_DoseAccumulation
 class VTK_SLICER_DOSEACCUMULATION_LOGIC_EXPORT vtkSlicerDoseAccumulationModuleLogic :
@@ -54,6 +59,35 @@ public:
   /// \return Error message on failure, NULL otherwise
   std::string AccumulateDoseVolumes(vtkMRMLDoseAccumulationNode* parameterNode);
 
+  /// Resample dose volume to the geometry of a reference volume.
+  /// The temporary resampled volume node is removed from the scene, only its voxels are kept.
+  /// \param resampledImageData Output image data with float scalars in the reference IJK geometry
+  /// \return Success flag
+  static bool ResampleDoseVolumeToReferenceGeometry(vtkMRMLScalarVolumeNode* doseVolumeNode,
+    vtkMRMLScalarVolumeNode* referenceVolumeNode, vtkImageData* resampledImageData);
+
+  /// Add weighted sum of images to an accumulated image in a single multi-threaded pass:
+  ///   accumulated = (replace ? 0 : accumulated) + sum(weight_i * image_i)
+  /// All images must have float scalars with one component and the same dimensions.
+  /// Negative weights can be used to remove previously added contributions.
+  /// \return Success flag
+  static bool AddWeightedImages(vtkImageData* accumulatedImageData,
+    const std::vector<vtkImageData*>& images, const std::vector<double>& weights, bool replace);
+
+  /// Get peak memory usage of the process (high-water mark) measured during the last accumulation, in MB
+  vtkGetMacro(LastAccumulationPeakMemoryUsageMB, double);
+  /// Get memory allocated for the accumulated dose during the last accumulation, in MB
+  vtkGetMacro(LastAccumulationWorkingMemoryMB, double);
+
+protected:
+  /// Accumulate input doses in the reference dose geometry by pulling each input dose through
+  /// its deformation transform. Each input is processed in one multi-threaded pass over slabs
+  /// of the reference grid, and is sampled directly into the accumulated dose, so a warped copy
+  /// of the input doses is never created.
+  /// \param accumulatedImageData Output image data, allocated as float in the reference geometry
+  /// \return Error message on failure, empty string otherwise
+  std::string AccumulateDoseVolumesDeformable(vtkMRMLDoseAccumulationNode* parameterNode, vtkImageData* accumulatedImageData);
+
 protected:
   vtkSlicerDoseAccumulationModuleLogic();
   virtual ~vtkSlicerDoseAccumulationModuleLogic();
@@ -68,6 +102,12 @@ protected:
   virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node) VTK_OVERRIDE;
   virtual void OnMRMLSceneEndClose() VTK_OVERRIDE;
 
+protected:
+  /// Peak memory usage of the process measured during the last accumulation
+  double LastAccumulationPeakMemoryUsageMB;
+  /// Memory allocated for the accumulated dose during the last accumulation
+  double LastAccumulationWorkingMemoryMB;
+
 private:
   vtkSlicerDoseAccumulationModuleLogic(const vtkSlicerDoseAccumulationModuleLogic&); // Not implemented
   void operator=(const vtkSlicerDoseAccumulationModuleLogic&);               // Not implemented
@@ -32,6 +32,8 @@
 
 // MRML includes
 #include <vtkMRMLCoreTestingMacros.h>
+#include <vtkMRMLGridTransformNode.h>
+#include <vtkMRMLLinearTransformNode.h>
 #include <vtkMRMLVolumeArchetypeStorageNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
@@ -43,6 +45,7 @@
 #include <vtkImageAccumulate.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageMathematics.h>
+#include <vtkOrientedGridTransform.h>
 
 // ITK includes
 #if ITK_VERSION_MAJOR > 3
@@ -52,6 +55,70 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+// Accumulate a constant dose with weight 0.5 through a deformation transform that shifts it by whole voxels
+// along the first IJK axis of the reference dose, and check that the accumulated dose is shifted accordingly
+int CheckShiftedConstantDose(vtkSlicerDoseAccumulationModuleLogic* doseAccumulationLogic, vtkMRMLScene* mrmlScene,
+  vtkMRMLScalarVolumeNode* referenceDoseVolumeNode, vtkMRMLScalarVolumeNode* constantDoseVolumeNode, double constantDose,
+  vtkMRMLTransformNode* deformationTransformNode, int shiftVoxels)
+{
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> outputVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  outputVolumeNode->SetName("DeformedOutputDose");
+  mrmlScene->AddNode(outputVolumeNode);
+
+  vtkSmartPointer<vtkMRMLDoseAccumulationNode> paramNode = vtkSmartPointer<vtkMRMLDoseAccumulationNode>::New();
+  mrmlScene->AddNode(paramNode);
+  paramNode->SetUseDeformableAccumulation(true);
+  paramNode->AddSelectedInputVolumeNode(constantDoseVolumeNode, 0.5);
+  paramNode->SetDeformationTransformForDoseVolume(constantDoseVolumeNode, deformationTransformNode);
+  paramNode->SetAndObserveAccumulatedDoseVolumeNode(outputVolumeNode);
+  paramNode->SetAndObserveReferenceDoseVolumeNode(referenceDoseVolumeNode);
+
+  std::string errorMessage = doseAccumulationLogic->AccumulateDoseVolumes(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Deformable accumulation through " << deformationTransformNode->GetName() << " failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkImageData* accumulatedImageData = outputVolumeNode->GetImageData();
+  if (!accumulatedImageData)
+  {
+    std::cerr << "ERROR: No accumulated dose after accumulating through " << deformationTransformNode->GetName() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The voxels at the boundaries of the shifted dose are skipped, as they are sampled exactly at the
+  // edge of the input dose, which depends on the accuracy of the transform inversion
+  int extent[6] = {0,-1,0,-1,0,-1};
+  accumulatedImageData->GetExtent(extent);
+  for (int k=extent[4]+1; k<extent[5]; ++k)
+  {
+    for (int j=extent[2]+1; j<extent[3]; ++j)
+    {
+      for (int i=extent[0]; i<=extent[1]; ++i)
+      {
+        if (i - extent[0] == shiftVoxels)
+        {
+          continue;
+        }
+        double expectedDose = (i - extent[0] > shiftVoxels ? 0.5 * constantDose : 0.0);
+        double accumulatedDose = accumulatedImageData->GetScalarComponentAsDouble(i, j, k, 0);
+        if (fabs(accumulatedDose - expectedDose) > 1.0e-3)
+        {
+          std::cerr << "ERROR: Dose accumulated through " << deformationTransformNode->GetName() << " at voxel ("
+            << i << ", " << j << ", " << k << ") is " << accumulatedDose << " instead of " << expectedDose << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
+
 //-----------------------------------------------------------------------------
 int vtkSlicerDoseAccumulationModuleLogicTest1( int argc, char * argv[] )
 {
@@ -233,6 +300,76 @@ int vtkSlicerDoseAccumulationModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // Deformable accumulation of a constant dose in the reference dose geometry, shifted along the first IJK axis
+  const double constantDose = 2.0;
+  const int shiftVoxels = 3;
+  vtkSmartPointer<vtkImageData> constantDoseImageData = vtkSmartPointer<vtkImageData>::New();
+  constantDoseImageData->SetExtent(doseScalarVolumeNode->GetImageData()->GetExtent());
+  constantDoseImageData->AllocateScalars(VTK_FLOAT, 1);
+  float* constantDoseScalars = static_cast<float*>(constantDoseImageData->GetScalarPointer());
+  std::fill(constantDoseScalars, constantDoseScalars + constantDoseImageData->GetNumberOfPoints(), static_cast<float>(constantDose));
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> constantDoseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  constantDoseVolumeNode->SetName("ConstantDose");
+  constantDoseVolumeNode->CopyOrientation(doseScalarVolumeNode);
+  constantDoseVolumeNode->SetAndObserveImageData(constantDoseImageData);
+  mrmlScene->AddNode(constantDoseVolumeNode);
+
+  vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseScalarVolumeNode->GetIJKToRASMatrix(doseIjkToRasMatrix);
+  double shiftRas[3] = { 0.0, 0.0, 0.0 };
+  for (int axis=0; axis<3; ++axis)
+  {
+    shiftRas[axis] = shiftVoxels * doseIjkToRasMatrix->GetElement(axis, 0);
+  }
+
+  // Known translation
+  vtkSmartPointer<vtkMatrix4x4> translationMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  for (int axis=0; axis<3; ++axis)
+  {
+    translationMatrix->SetElement(axis, 3, shiftRas[axis]);
+  }
+  vtkSmartPointer<vtkMRMLLinearTransformNode> translationTransformNode = vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
+  translationTransformNode->SetName("Translation");
+  mrmlScene->AddNode(translationTransformNode);
+  translationTransformNode->SetMatrixTransformToParent(translationMatrix);
+  if (CheckShiftedConstantDose(doseAccumulationLogic, mrmlScene, doseScalarVolumeNode, constantDoseVolumeNode, constantDose,
+    translationTransformNode, shiftVoxels) != EXIT_SUCCESS)
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Known displacement field: the same shift everywhere on a coarse grid covering the dose with a margin
+  double doseBounds[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  doseScalarVolumeNode->GetRASBounds(doseBounds);
+  const double gridSpacing = 10.0;
+  vtkSmartPointer<vtkImageData> displacementGrid = vtkSmartPointer<vtkImageData>::New();
+  displacementGrid->SetOrigin(doseBounds[0] - 2.0*gridSpacing, doseBounds[2] - 2.0*gridSpacing, doseBounds[4] - 2.0*gridSpacing);
+  displacementGrid->SetSpacing(gridSpacing, gridSpacing, gridSpacing);
+  displacementGrid->SetDimensions(
+    static_cast<int>(ceil((doseBounds[1] - doseBounds[0]) / gridSpacing)) + 5,
+    static_cast<int>(ceil((doseBounds[3] - doseBounds[2]) / gridSpacing)) + 5,
+    static_cast<int>(ceil((doseBounds[5] - doseBounds[4]) / gridSpacing)) + 5 );
+  displacementGrid->AllocateScalars(VTK_DOUBLE, 3);
+  double* displacements = static_cast<double*>(displacementGrid->GetScalarPointer());
+  for (vtkIdType pointIndex=0; pointIndex<displacementGrid->GetNumberOfPoints(); ++pointIndex)
+  {
+    displacements[3*pointIndex] = shiftRas[0];
+    displacements[3*pointIndex+1] = shiftRas[1];
+    displacements[3*pointIndex+2] = shiftRas[2];
+  }
+  vtkSmartPointer<vtkOrientedGridTransform> gridTransform = vtkSmartPointer<vtkOrientedGridTransform>::New();
+  gridTransform->SetDisplacementGridData(displacementGrid);
+  gridTransform->SetInterpolationModeToLinear();
+  vtkSmartPointer<vtkMRMLGridTransformNode> gridTransformNode = vtkSmartPointer<vtkMRMLGridTransformNode>::New();
+  gridTransformNode->SetName("DisplacementField");
+  mrmlScene->AddNode(gridTransformNode);
+  gridTransformNode->SetAndObserveTransformToParent(gridTransform);
+  if (CheckShiftedConstantDose(doseAccumulationLogic, mrmlScene, doseScalarVolumeNode, constantDoseVolumeNode, constantDose,
+    gridTransformNode, shiftVoxels) != EXIT_SUCCESS)
+  {
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,756 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkGammaDoseComparisonFilter.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtCommon.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkCommand.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Number of parallel sections the computation is split into, so that progress can be reported in between
+  const int GAMMA_NUMBER_OF_PROGRESS_STEPS = 20;
+
+  /// Tolerance for considering a continuous index inside an image
+  const double GAMMA_INDEX_TOLERANCE = 1e-4;
+
+  //----------------------------------------------------------------------------
+  /// Position in the search neighborhood of a reference voxel
+  struct GammaSearchOffset
+  {
+    /// Squared distance in mm^2
+    double DistanceSquared;
+    /// Offset vector transformed into the index space of the compare image
+    double CompareIjkDelta[3];
+
+    bool operator<(const GammaSearchOffset& other) const
+    {
+      return this->DistanceSquared < other.DistanceSquared;
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  /// Voxel counts accumulated separately by each thread
+  struct GammaStatistics
+  {
+    GammaStatistics() : NumberOfAnalyzedVoxels(0) { }
+    vtkIdType NumberOfAnalyzedVoxels;
+    /// Number of passed voxels for each criterion
+    std::vector<vtkIdType> NumberOfPassedVoxels;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Criterion parameters precomputed for the neighborhood search
+  struct GammaCriterionParameters
+  {
+    double DtaSquared;
+    double InverseDtaSquared;
+    double GlobalDoseTolerance;
+    double LocalDoseToleranceFraction;
+    float* GammaScalars;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Samples an image at continuous index positions with trilinear or nearest neighbor interpolation
+  class ImageSampler
+  {
+  public:
+    ImageSampler()
+      : Scalars(NULL)
+      , Linear(true)
+    {
+    }
+
+    void Initialize(vtkImageData* image, const float* scalars, bool linear)
+    {
+      this->Scalars = scalars;
+      this->Linear = linear;
+      image->GetExtent(this->Extent);
+      image->GetDimensions(this->Dimensions);
+      this->IncrementY = this->Dimensions[0];
+      this->IncrementZ = static_cast<vtkIdType>(this->Dimensions[0]) * this->Dimensions[1];
+    }
+
+    /// Sample image at a continuous index position (in extent coordinates)
+    /// \return False if the position is outside the image
+    bool Sample(const double ijk[3], double& value) const
+    {
+      if (!this->Linear)
+      {
+        vtkIdType offset = 0;
+        const vtkIdType increments[3] = {1, this->IncrementY, this->IncrementZ};
+        for (int axis=0; axis<3; ++axis)
+        {
+          int index = static_cast<int>(std::floor(ijk[axis] - this->Extent[2*axis] + 0.5));
+          if (index < 0 || index >= this->Dimensions[axis])
+          {
+            return false;
+          }
+          offset += index * increments[axis];
+        }
+        value = this->Scalars[offset];
+        return true;
+      }
+
+      int lower[3] = {0, 0, 0};
+      int upper[3] = {0, 0, 0};
+      double weight[3] = {0.0, 0.0, 0.0};
+      for (int axis=0; axis<3; ++axis)
+      {
+        double position = ijk[axis] - this->Extent[2*axis];
+        int lastIndex = this->Dimensions[axis] - 1;
+        if (position < -GAMMA_INDEX_TOLERANCE || position > lastIndex + GAMMA_INDEX_TOLERANCE)
+        {
+          return false;
+        }
+        if (position <= 0.0)
+        {
+          lower[axis] = upper[axis] = 0;
+        }
+        else if (position >= lastIndex)
+        {
+          lower[axis] = upper[axis] = lastIndex;
+        }
+        else
+        {
+          lower[axis] = static_cast<int>(position);
+          upper[axis] = lower[axis] + 1;
+          weight[axis] = position - lower[axis];
+        }
+      }
+
+      const float* lowerSlice = this->Scalars + lower[2] * this->IncrementZ;
+      const float* upperSlice = this->Scalars + upper[2] * this->IncrementZ;
+      const vtkIdType lowerRow = lower[1] * this->IncrementY;
+      const vtkIdType upperRow = upper[1] * this->IncrementY;
+      double c00 = lowerSlice[lowerRow + lower[0]] + (lowerSlice[lowerRow + upper[0]] - lowerSlice[lowerRow + lower[0]]) * weight[0];
+      double c10 = lowerSlice[upperRow + lower[0]] + (lowerSlice[upperRow + upper[0]] - lowerSlice[upperRow + lower[0]]) * weight[0];
+      double c01 = upperSlice[lowerRow + lower[0]] + (upperSlice[lowerRow + upper[0]] - upperSlice[lowerRow + lower[0]]) * weight[0];
+      double c11 = upperSlice[upperRow + lower[0]] + (upperSlice[upperRow + upper[0]] - upperSlice[upperRow + lower[0]]) * weight[0];
+      double c0 = c00 + (c10 - c00) * weight[1];
+      double c1 = c01 + (c11 - c01) * weight[1];
+      value = c0 + (c1 - c0) * weight[2];
+      return true;
+    }
+
+  protected:
+    const float* Scalars;
+    bool Linear;
+    int Extent[6];
+    int Dimensions[3];
+    vtkIdType IncrementY;
+    vtkIdType IncrementZ;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Computes gamma for a range of reference slices
+  class GammaFunctor
+  {
+  public:
+    GammaFunctor()
+      : ReferenceScalars(NULL)
+      , Offsets(NULL)
+      , UseMask(false)
+      , ThresholdDose(0.0)
+      , LocalDoseDifference(false)
+      , DoseThresholdOnReferenceOnly(false)
+      , MaximumGamma(2.0)
+    {
+    }
+
+    void Initialize()
+    {
+      GammaStatistics& statistics = this->Statistics.Local();
+      statistics.NumberOfAnalyzedVoxels = 0;
+      statistics.NumberOfPassedVoxels.assign(this->Criteria.size(), 0);
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      GammaStatistics& statistics = this->Statistics.Local();
+      const double maximumGammaSquared = this->MaximumGamma * this->MaximumGamma;
+      const vtkIdType sliceSize = static_cast<vtkIdType>(this->ReferenceDimensions[0]) * this->ReferenceDimensions[1];
+      const size_t numberOfOffsets = this->Offsets->size();
+      const GammaSearchOffset* offsets = &((*this->Offsets)[0]);
+      const size_t numberOfCriteria = this->Criteria.size();
+      const GammaCriterionParameters* criteria = &(this->Criteria[0]);
+
+      // Search radius is limited by the criterion with the largest DTA
+      double maximumDistanceSquared = 0.0;
+      for (size_t criterionIndex=0; criterionIndex<numberOfCriteria; ++criterionIndex)
+      {
+        maximumDistanceSquared = std::max(maximumDistanceSquared, maximumGammaSquared * criteria[criterionIndex].DtaSquared);
+      }
+
+      std::vector<double> minimumGammaSquared(numberOfCriteria, maximumGammaSquared);
+      std::vector<double> inverseDoseToleranceSquared(numberOfCriteria, 1.0);
+
+      double referenceIjk[4] = {0.0, 0.0, 0.0, 1.0};
+      double compareIjk[3] = {0.0, 0.0, 0.0};
+      double searchIjk[3] = {0.0, 0.0, 0.0};
+      double maskIjk[3] = {0.0, 0.0, 0.0};
+      for (vtkIdType k=beginSlice; k<endSlice; ++k)
+      {
+        referenceIjk[2] = this->ReferenceExtent[4] + k;
+        vtkIdType voxelIndex = k * sliceSize;
+        for (int j=0; j<this->ReferenceDimensions[1]; ++j)
+        {
+          referenceIjk[1] = this->ReferenceExtent[2] + j;
+          for (int i=0; i<this->ReferenceDimensions[0]; ++i, ++voxelIndex)
+          {
+            referenceIjk[0] = this->ReferenceExtent[0] + i;
+            for (size_t criterionIndex=0; criterionIndex<numberOfCriteria; ++criterionIndex)
+            {
+              criteria[criterionIndex].GammaScalars[voxelIndex] = 0.0f;
+            }
+
+            // Skip voxels outside mask
+            if (this->UseMask)
+            {
+              TransformIndex(this->ReferenceIjkToMaskIjk, referenceIjk, maskIjk);
+              double maskValue = 0.0;
+              if (!this->MaskSampler.Sample(maskIjk, maskValue) || maskValue == 0.0)
+              {
+                continue;
+              }
+            }
+
+            // Skip voxels below threshold
+            const double referenceDose = this->ReferenceScalars[voxelIndex];
+            TransformIndex(this->ReferenceIjkToCompareIjk, referenceIjk, compareIjk);
+            if (referenceDose < this->ThresholdDose)
+            {
+              double compareDose = 0.0;
+              if ( this->DoseThresholdOnReferenceOnly
+                || !this->CompareSampler.Sample(compareIjk, compareDose) || compareDose < this->ThresholdDose )
+              {
+                continue;
+              }
+            }
+
+            for (size_t criterionIndex=0; criterionIndex<numberOfCriteria; ++criterionIndex)
+            {
+              // Fall back to global tolerance where the local dose is zero
+              double doseTolerance = criteria[criterionIndex].GlobalDoseTolerance;
+              if (this->LocalDoseDifference && referenceDose > 0.0)
+              {
+                doseTolerance = criteria[criterionIndex].LocalDoseToleranceFraction * referenceDose;
+              }
+              inverseDoseToleranceSquared[criterionIndex] = 1.0 / (doseTolerance * doseTolerance);
+              minimumGammaSquared[criterionIndex] = maximumGammaSquared;
+            }
+
+            // Search neighborhood in increasing distance. Stop when the distance term alone
+            // reaches the minimum found so far for every criterion, as farther offsets cannot yield lower gamma.
+            double stopDistanceSquared = maximumDistanceSquared;
+            for (size_t offsetIndex=0; offsetIndex<numberOfOffsets; ++offsetIndex)
+            {
+              const GammaSearchOffset& offset = offsets[offsetIndex];
+              if (offset.DistanceSquared >= stopDistanceSquared)
+              {
+                break;
+              }
+              searchIjk[0] = compareIjk[0] + offset.CompareIjkDelta[0];
+              searchIjk[1] = compareIjk[1] + offset.CompareIjkDelta[1];
+              searchIjk[2] = compareIjk[2] + offset.CompareIjkDelta[2];
+              double compareDose = 0.0;
+              if (!this->CompareSampler.Sample(searchIjk, compareDose))
+              {
+                continue;
+              }
+              const double doseDifference = compareDose - referenceDose;
+              const double doseDifferenceSquared = doseDifference * doseDifference;
+              bool minimumChanged = false;
+              for (size_t criterionIndex=0; criterionIndex<numberOfCriteria; ++criterionIndex)
+              {
+                const double gammaSquared = offset.DistanceSquared * criteria[criterionIndex].InverseDtaSquared
+                  + doseDifferenceSquared * inverseDoseToleranceSquared[criterionIndex];
+                if (gammaSquared < minimumGammaSquared[criterionIndex])
+                {
+                  minimumGammaSquared[criterionIndex] = gammaSquared;
+                  minimumChanged = true;
+                }
+              }
+              if (minimumChanged)
+              {
+                stopDistanceSquared = 0.0;
+                for (size_t criterionIndex=0; criterionIndex<numberOfCriteria; ++criterionIndex)
+                {
+                  stopDistanceSquared = std::max(stopDistanceSquared, minimumGammaSquared[criterionIndex] * criteria[criterionIndex].DtaSquared);
+                }
+              }
+            }
+
+            ++statistics.NumberOfAnalyzedVoxels;
+            for (size_t criterionIndex=0; criterionIndex<numberOfCriteria; ++criterionIndex)
+            {
+              const double gamma = std::sqrt(minimumGammaSquared[criterionIndex]);
+              criteria[criterionIndex].GammaScalars[voxelIndex] = static_cast<float>(gamma);
+              if (gamma <= 1.0)
+              {
+                ++statistics.NumberOfPassedVoxels[criterionIndex];
+              }
+            }
+          }
+        }
+      }
+    }
+
+    void Reduce()
+    {
+      // Thread local counts are reset after summing them, because threads that do not take part
+      // in the next parallel section are not initialized again
+      this->Total.NumberOfPassedVoxels.resize(this->Criteria.size(), 0);
+      for (vtkSMPThreadLocal<GammaStatistics>::iterator it = this->Statistics.begin(); it != this->Statistics.end(); ++it)
+      {
+        this->Total.NumberOfAnalyzedVoxels += it->NumberOfAnalyzedVoxels;
+        it->NumberOfAnalyzedVoxels = 0;
+        for (size_t criterionIndex=0; criterionIndex<it->NumberOfPassedVoxels.size(); ++criterionIndex)
+        {
+          this->Total.NumberOfPassedVoxels[criterionIndex] += it->NumberOfPassedVoxels[criterionIndex];
+          it->NumberOfPassedVoxels[criterionIndex] = 0;
+        }
+      }
+    }
+
+    static void TransformIndex(const double matrix[3][4], const double in[4], double out[3])
+    {
+      for (int row=0; row<3; ++row)
+      {
+        out[row] = matrix[row][0]*in[0] + matrix[row][1]*in[1] + matrix[row][2]*in[2] + matrix[row][3];
+      }
+    }
+
+  public:
+    const float* ReferenceScalars;
+    int ReferenceExtent[6];
+    int ReferenceDimensions[3];
+    std::vector<GammaCriterionParameters> Criteria;
+
+    ImageSampler CompareSampler;
+    double ReferenceIjkToCompareIjk[3][4];
+    const std::vector<GammaSearchOffset>* Offsets;
+
+    bool UseMask;
+    ImageSampler MaskSampler;
+    double ReferenceIjkToMaskIjk[3][4];
+
+    double ThresholdDose;
+    bool LocalDoseDifference;
+    bool DoseThresholdOnReferenceOnly;
+    double MaximumGamma;
+
+    vtkSMPThreadLocal<GammaStatistics> Statistics;
+    GammaStatistics Total;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Get the matrix transforming image indices of one image into image indices of another (top three rows)
+  void GetIjkToIjkMatrix(vtkOrientedImageData* fromImage, vtkOrientedImageData* toImage, double matrix[3][4])
+  {
+    vtkSmartPointer<vtkMatrix4x4> fromImageToWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+    fromImage->GetImageToWorldMatrix(fromImageToWorld);
+    vtkSmartPointer<vtkMatrix4x4> worldToToImage = vtkSmartPointer<vtkMatrix4x4>::New();
+    toImage->GetWorldToImageMatrix(worldToToImage);
+    vtkSmartPointer<vtkMatrix4x4> fromIjkToToIjk = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Multiply4x4(worldToToImage, fromImageToWorld, fromIjkToToIjk);
+    for (int row=0; row<3; ++row)
+    {
+      for (int column=0; column<4; ++column)
+      {
+        matrix[row][column] = fromIjkToToIjk->GetElement(row, column);
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkGammaDoseComparisonFilter);
+
+//----------------------------------------------------------------------------
+vtkGammaDoseComparisonFilter::vtkGammaDoseComparisonFilter()
+{
+  this->ReferenceDoseImageData = NULL;
+  this->CompareDoseImageData = NULL;
+  this->MaskImageData = NULL;
+
+  this->DtaDistanceToleranceMm = 3.0;
+  this->DoseDifferenceTolerancePercent = 3.0;
+  this->ReferenceDoseGy = 0.0;
+  this->AnalysisThresholdPercent = 0.0;
+  this->MaximumGamma = 2.0;
+  this->LocalDoseDifference = false;
+  this->DoseThresholdOnReferenceOnly = false;
+  this->UseLinearInterpolation = true;
+  this->SubvoxelSamplingFactor = 1;
+  this->NumberOfThreads = 0;
+
+  this->NumberOfAnalyzedVoxels = 0;
+  this->NumberOfSearchOffsets = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkGammaDoseComparisonFilter::~vtkGammaDoseComparisonFilter()
+{
+  this->SetReferenceDoseImageData(NULL);
+  this->SetCompareDoseImageData(NULL);
+  this->SetMaskImageData(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "DtaDistanceToleranceMm: " << this->DtaDistanceToleranceMm << "\n";
+  os << indent << "DoseDifferenceTolerancePercent: " << this->DoseDifferenceTolerancePercent << "\n";
+  os << indent << "ReferenceDoseGy: " << this->ReferenceDoseGy << "\n";
+  os << indent << "AnalysisThresholdPercent: " << this->AnalysisThresholdPercent << "\n";
+  os << indent << "MaximumGamma: " << this->MaximumGamma << "\n";
+  os << indent << "LocalDoseDifference: " << (this->LocalDoseDifference ? "true" : "false") << "\n";
+  os << indent << "DoseThresholdOnReferenceOnly: " << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\n";
+  os << indent << "UseLinearInterpolation: " << (this->UseLinearInterpolation ? "true" : "false") << "\n";
+  os << indent << "SubvoxelSamplingFactor: " << this->SubvoxelSamplingFactor << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "Criteria:\n";
+  std::vector<GammaCriterion>& criteria = this->GetEvaluatedCriteria();
+  for (std::vector<GammaCriterion>::iterator criterionIt=criteria.begin(); criterionIt!=criteria.end(); ++criterionIt)
+  {
+    os << indent.GetNextIndent() << criterionIt->DoseDifferenceTolerancePercent << "%/" << criterionIt->DtaDistanceToleranceMm << "mm: "
+      << "PassFractionPercent=" << criterionIt->PassFractionPercent << ", NumberOfPassedVoxels=" << criterionIt->NumberOfPassedVoxels << "\n";
+  }
+  os << indent << "NumberOfAnalyzedVoxels: " << this->NumberOfAnalyzedVoxels << "\n";
+  os << indent << "NumberOfSearchOffsets: " << this->NumberOfSearchOffsets << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::AddCriterion(double dtaDistanceToleranceMm, double doseDifferenceTolerancePercent)
+{
+  this->Criteria.push_back(GammaCriterion(dtaDistanceToleranceMm, doseDifferenceTolerancePercent));
+  this->Criteria.back().OutputGammaImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::RemoveAllCriteria()
+{
+  this->Criteria.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+std::vector<vtkGammaDoseComparisonFilter::GammaCriterion>& vtkGammaDoseComparisonFilter::GetEvaluatedCriteria()
+{
+  if (!this->Criteria.empty())
+  {
+    return this->Criteria;
+  }
+
+  // Keep the default criterion in sync with the single DTA and dose difference pair
+  if (this->DefaultCriterion.empty())
+  {
+    this->DefaultCriterion.push_back(GammaCriterion(this->DtaDistanceToleranceMm, this->DoseDifferenceTolerancePercent));
+    this->DefaultCriterion[0].OutputGammaImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+  }
+  this->DefaultCriterion[0].DtaDistanceToleranceMm = this->DtaDistanceToleranceMm;
+  this->DefaultCriterion[0].DoseDifferenceTolerancePercent = this->DoseDifferenceTolerancePercent;
+  return this->DefaultCriterion;
+}
+
+//----------------------------------------------------------------------------
+int vtkGammaDoseComparisonFilter::GetNumberOfCriteria()
+{
+  return static_cast<int>(this->GetEvaluatedCriteria().size());
+}
+
+//----------------------------------------------------------------------------
+double vtkGammaDoseComparisonFilter::GetCriterionDtaDistanceToleranceMm(int criterionIndex)
+{
+  std::vector<GammaCriterion>& criteria = this->GetEvaluatedCriteria();
+  if (criterionIndex < 0 || criterionIndex >= static_cast<int>(criteria.size()))
+  {
+    vtkErrorMacro("GetCriterionDtaDistanceToleranceMm: Invalid criterion index " << criterionIndex);
+    return 0.0;
+  }
+  return criteria[criterionIndex].DtaDistanceToleranceMm;
+}
+
+//----------------------------------------------------------------------------
+double vtkGammaDoseComparisonFilter::GetCriterionDoseDifferenceTolerancePercent(int criterionIndex)
+{
+  std::vector<GammaCriterion>& criteria = this->GetEvaluatedCriteria();
+  if (criterionIndex < 0 || criterionIndex >= static_cast<int>(criteria.size()))
+  {
+    vtkErrorMacro("GetCriterionDoseDifferenceTolerancePercent: Invalid criterion index " << criterionIndex);
+    return 0.0;
+  }
+  return criteria[criterionIndex].DoseDifferenceTolerancePercent;
+}
+
+//----------------------------------------------------------------------------
+vtkOrientedImageData* vtkGammaDoseComparisonFilter::GetOutputGammaImageData()
+{
+  return this->GetOutputGammaImageData(0);
+}
+
+//----------------------------------------------------------------------------
+vtkOrientedImageData* vtkGammaDoseComparisonFilter::GetOutputGammaImageData(int criterionIndex)
+{
+  std::vector<GammaCriterion>& criteria = this->GetEvaluatedCriteria();
+  if (criterionIndex < 0 || criterionIndex >= static_cast<int>(criteria.size()))
+  {
+    vtkErrorMacro("GetOutputGammaImageData: Invalid criterion index " << criterionIndex);
+    return NULL;
+  }
+  return criteria[criterionIndex].OutputGammaImageData;
+}
+
+//----------------------------------------------------------------------------
+double vtkGammaDoseComparisonFilter::GetPassFractionPercent(int criterionIndex)
+{
+  std::vector<GammaCriterion>& criteria = this->GetEvaluatedCriteria();
+  if (criterionIndex < 0 || criterionIndex >= static_cast<int>(criteria.size()))
+  {
+    vtkErrorMacro("GetPassFractionPercent: Invalid criterion index " << criterionIndex);
+    return 0.0;
+  }
+  return criteria[criterionIndex].PassFractionPercent;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkGammaDoseComparisonFilter::GetNumberOfPassedVoxels(int criterionIndex)
+{
+  std::vector<GammaCriterion>& criteria = this->GetEvaluatedCriteria();
+  if (criterionIndex < 0 || criterionIndex >= static_cast<int>(criteria.size()))
+  {
+    vtkErrorMacro("GetNumberOfPassedVoxels: Invalid criterion index " << criterionIndex);
+    return 0;
+  }
+  return criteria[criterionIndex].NumberOfPassedVoxels;
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparisonFilter::Update()
+{
+  std::vector<GammaCriterion>& criteria = this->GetEvaluatedCriteria();
+  for (std::vector<GammaCriterion>::iterator criterionIt=criteria.begin(); criterionIt!=criteria.end(); ++criterionIt)
+  {
+    criterionIt->PassFractionPercent = 0.0;
+    criterionIt->NumberOfPassedVoxels = 0;
+  }
+  this->NumberOfAnalyzedVoxels = 0;
+  this->NumberOfSearchOffsets = 0;
+  this->ReportString.clear();
+
+  if (!this->ReferenceDoseImageData || !this->ReferenceDoseImageData->GetPointData()->GetScalars()
+    || !this->CompareDoseImageData || !this->CompareDoseImageData->GetPointData()->GetScalars() )
+  {
+    vtkErrorMacro("Update: Reference and compare dose images have to be initialized!");
+    return;
+  }
+  if ( this->ReferenceDoseImageData->GetNumberOfScalarComponents() != 1
+    || this->CompareDoseImageData->GetNumberOfScalarComponents() != 1 )
+  {
+    vtkErrorMacro("Update: Reference and compare dose images have to be scalar images!");
+    return;
+  }
+  if (this->MaximumGamma <= 0.0)
+  {
+    vtkErrorMacro("Update: Maximum gamma has to be positive!");
+    return;
+  }
+  double maximumDtaDistanceToleranceMm = 0.0;
+  for (std::vector<GammaCriterion>::iterator criterionIt=criteria.begin(); criterionIt!=criteria.end(); ++criterionIt)
+  {
+    if (criterionIt->DtaDistanceToleranceMm <= 0.0 || criterionIt->DoseDifferenceTolerancePercent <= 0.0)
+    {
+      vtkErrorMacro("Update: DTA and dose difference tolerance have to be positive!");
+      return;
+    }
+    maximumDtaDistanceToleranceMm = std::max(maximumDtaDistanceToleranceMm, criterionIt->DtaDistanceToleranceMm);
+  }
+
+  // Get float scalars for the inputs (copies are only made for non-float images)
+  vtkSmartPointer<vtkImageData> referenceFloatImage;
+  vtkSmartPointer<vtkImageData> compareFloatImage;
+  vtkSmartPointer<vtkImageData> maskFloatImage;
+  GammaFunctor functor;
+  functor.ReferenceScalars = vtkSlicerRtCommon::GetFloatScalars(this->ReferenceDoseImageData, referenceFloatImage);
+  this->ReferenceDoseImageData->GetExtent(functor.ReferenceExtent);
+  this->ReferenceDoseImageData->GetDimensions(functor.ReferenceDimensions);
+  functor.CompareSampler.Initialize(this->CompareDoseImageData,
+    vtkSlicerRtCommon::GetFloatScalars(this->CompareDoseImageData, compareFloatImage), this->UseLinearInterpolation );
+  GetIjkToIjkMatrix(this->ReferenceDoseImageData, this->CompareDoseImageData, functor.ReferenceIjkToCompareIjk);
+  if (this->MaskImageData && this->MaskImageData->GetPointData()->GetScalars())
+  {
+    functor.UseMask = true;
+    functor.MaskSampler.Initialize(this->MaskImageData, vtkSlicerRtCommon::GetFloatScalars(this->MaskImageData, maskFloatImage), false);
+    GetIjkToIjkMatrix(this->ReferenceDoseImageData, this->MaskImageData, functor.ReferenceIjkToMaskIjk);
+  }
+
+  // Determine reference dose and tolerances
+  double referenceDoseGy = this->ReferenceDoseGy;
+  if (referenceDoseGy <= 0.0)
+  {
+    double referenceRange[2] = {0.0, 0.0};
+    this->ReferenceDoseImageData->GetScalarRange(referenceRange);
+    referenceDoseGy = referenceRange[1];
+  }
+  if (referenceDoseGy <= 0.0)
+  {
+    vtkErrorMacro("Update: Reference dose has to be positive!");
+    return;
+  }
+  functor.ThresholdDose = this->AnalysisThresholdPercent / 100.0 * referenceDoseGy;
+  functor.LocalDoseDifference = this->LocalDoseDifference;
+  functor.DoseThresholdOnReferenceOnly = this->DoseThresholdOnReferenceOnly;
+  functor.MaximumGamma = this->MaximumGamma;
+
+  // Build search offsets within the sphere of radius MaximumGamma*DTA, sorted by distance
+  double referenceSpacing[3] = {1.0, 1.0, 1.0};
+  this->ReferenceDoseImageData->GetSpacing(referenceSpacing);
+  double referenceToCompareDirections[3][3] = {{0.0}};
+  for (int row=0; row<3; ++row)
+  {
+    for (int column=0; column<3; ++column)
+    {
+      referenceToCompareDirections[row][column] = functor.ReferenceIjkToCompareIjk[row][column];
+    }
+  }
+  const double searchRadiusMm = this->MaximumGamma * maximumDtaDistanceToleranceMm;
+  const double searchRadiusSquared = searchRadiusMm * searchRadiusMm;
+  const double stepFraction = 1.0 / this->SubvoxelSamplingFactor;
+  int halfSize[3] = {0, 0, 0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    halfSize[axis] = static_cast<int>(std::floor(searchRadiusMm / referenceSpacing[axis] * this->SubvoxelSamplingFactor));
+    // Do not search along axes the reference has no extent in (planar doses)
+    if (functor.ReferenceDimensions[axis] < 2)
+    {
+      halfSize[axis] = 0;
+    }
+  }
+  std::vector<GammaSearchOffset> offsets;
+  for (int dk=-halfSize[2]; dk<=halfSize[2]; ++dk)
+  {
+    for (int dj=-halfSize[1]; dj<=halfSize[1]; ++dj)
+    {
+      for (int di=-halfSize[0]; di<=halfSize[0]; ++di)
+      {
+        double offsetIjk[3] = { di*stepFraction, dj*stepFraction, dk*stepFraction };
+        double distanceSquared = 0.0;
+        for (int axis=0; axis<3; ++axis)
+        {
+          distanceSquared += offsetIjk[axis]*referenceSpacing[axis] * offsetIjk[axis]*referenceSpacing[axis];
+        }
+        if (distanceSquared > searchRadiusSquared)
+        {
+          continue;
+        }
+        GammaSearchOffset offset;
+        offset.DistanceSquared = distanceSquared;
+        for (int row=0; row<3; ++row)
+        {
+          offset.CompareIjkDelta[row] = referenceToCompareDirections[row][0]*offsetIjk[0]
+            + referenceToCompareDirections[row][1]*offsetIjk[1] + referenceToCompareDirections[row][2]*offsetIjk[2];
+        }
+        offsets.push_back(offset);
+      }
+    }
+  }
+  std::sort(offsets.begin(), offsets.end());
+  functor.Offsets = &offsets;
+  this->NumberOfSearchOffsets = static_cast<vtkIdType>(offsets.size());
+
+  // Allocate outputs in the reference geometry
+  vtkSmartPointer<vtkMatrix4x4> referenceImageToWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->ReferenceDoseImageData->GetImageToWorldMatrix(referenceImageToWorld);
+  for (std::vector<GammaCriterion>::iterator criterionIt=criteria.begin(); criterionIt!=criteria.end(); ++criterionIt)
+  {
+    vtkOrientedImageData* outputGammaImageData = criterionIt->OutputGammaImageData;
+    outputGammaImageData->SetExtent(this->ReferenceDoseImageData->GetExtent());
+    outputGammaImageData->SetGeometryFromImageToWorldMatrix(referenceImageToWorld);
+    outputGammaImageData->AllocateScalars(VTK_FLOAT, 1);
+
+    GammaCriterionParameters parameters;
+    parameters.DtaSquared = criterionIt->DtaDistanceToleranceMm * criterionIt->DtaDistanceToleranceMm;
+    parameters.InverseDtaSquared = 1.0 / parameters.DtaSquared;
+    parameters.GlobalDoseTolerance = criterionIt->DoseDifferenceTolerancePercent / 100.0 * referenceDoseGy;
+    parameters.LocalDoseToleranceFraction = criterionIt->DoseDifferenceTolerancePercent / 100.0;
+    parameters.GammaScalars = static_cast<float*>(outputGammaImageData->GetScalarPointer());
+    functor.Criteria.push_back(parameters);
+  }
+
+  // Process slabs of slices in parallel, in a few sections so that progress can be reported
+  const int numberOfSlices = functor.ReferenceDimensions[2];
+  const int numberOfSections = std::max(1, std::min(GAMMA_NUMBER_OF_PROGRESS_STEPS, numberOfSlices));
+  for (int section=0; section<numberOfSections; ++section)
+  {
+    vtkIdType beginSlice = static_cast<vtkIdType>(numberOfSlices) * section / numberOfSections;
+    vtkIdType endSlice = static_cast<vtkIdType>(numberOfSlices) * (section+1) / numberOfSections;
+    vtkSlicerRtCommon::SMPFor(beginSlice, endSlice, 1, functor, this->NumberOfThreads);
+
+    double progress = (double)(section+1) / numberOfSections;
+    this->InvokeEvent(vtkCommand::ProgressEvent, (void*)&progress);
+  }
+
+  this->NumberOfAnalyzedVoxels = functor.Total.NumberOfAnalyzedVoxels;
+  functor.Total.NumberOfPassedVoxels.resize(criteria.size(), 0);
+  for (size_t criterionIndex=0; criterionIndex<criteria.size(); ++criterionIndex)
+  {
+    criteria[criterionIndex].NumberOfPassedVoxels = functor.Total.NumberOfPassedVoxels[criterionIndex];
+    criteria[criterionIndex].PassFractionPercent = ( this->NumberOfAnalyzedVoxels > 0
+      ? 100.0 * criteria[criterionIndex].NumberOfPassedVoxels / this->NumberOfAnalyzedVoxels : 0.0 );
+  }
+
+  // Assemble report
+  std::stringstream report;
+  report << "Reference dose: " << referenceDoseGy << " Gy" << (this->ReferenceDoseGy <= 0.0 ? " (maximum of reference)" : "") << std::endl
+    << "Dose difference: " << (this->LocalDoseDifference ? "local" : "global") << std::endl
+    << "Analysis threshold: " << this->AnalysisThresholdPercent << " % (" << functor.ThresholdDose << " Gy" << (this->DoseThresholdOnReferenceOnly ? ", reference only" : "") << ")" << std::endl
+    << "Maximum gamma: " << this->MaximumGamma << std::endl
+    << "Interpolation: " << (this->UseLinearInterpolation ? "linear" : "nearest neighbor") << ", sub-voxel sampling factor: " << this->SubvoxelSamplingFactor << std::endl
+    << "Number of search offsets: " << this->NumberOfSearchOffsets << std::endl
+    << "Number of analyzed voxels: " << this->NumberOfAnalyzedVoxels << std::endl;
+  for (std::vector<GammaCriterion>::iterator criterionIt=criteria.begin(); criterionIt!=criteria.end(); ++criterionIt)
+  {
+    report << "Criterion " << criterionIt->DoseDifferenceTolerancePercent << " % / " << criterionIt->DtaDistanceToleranceMm << " mm: "
+      << "passed voxels: " << criterionIt->NumberOfPassedVoxels << ", pass rate: " << criterionIt->PassFractionPercent << " %" << std::endl;
+  }
+  this->ReportString = report.str();
+}
@@ -0,0 +1,211 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkGammaDoseComparisonFilter_h
+#define __vtkGammaDoseComparisonFilter_h
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+#include "vtkSlicerDoseComparisonModuleLogicExport.h"
+
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_QtModules_DoseComparison
+/// \brief Multi-threaded gamma dose comparison
+///
+/// Computes the gamma index of the compare dose against the reference dose on the reference grid.
+/// The compare dose is sampled directly in its own geometry, so it does not need to be resampled
+/// to the reference grid beforehand. The neighborhood search uses a precomputed list of offsets
+/// within the sphere of radius MaximumGamma * DTA, sorted by distance. The search for a voxel stops
+/// as soon as the distance term alone reaches the running minimum gamma, so in well matching regions
+/// only a few offsets are evaluated. Slabs of reference slices are processed in parallel.
+///
+/// Multiple criteria (DTA and dose difference tolerance pairs, such as 3%/3mm, 2%/2mm and 1%/1mm)
+/// can be evaluated in a single neighborhood traversal, sharing the compare dose samples and the
+/// distances between the criteria. One gamma image and pass fraction is computed for each criterion.
+///
+/// The parameters and the outputs follow the conventions of the plastimatch gamma computation.
+class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkGammaDoseComparisonFilter : public vtkObject
+{
+public:
+  static vtkGammaDoseComparisonFilter *New();
+  vtkTypeMacro(vtkGammaDoseComparisonFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Compute gamma volume and pass fraction.
+  /// Invokes vtkCommand::ProgressEvent with a double progress value between 0 and 1 as call data.
+  virtual void Update();
+
+  /// Get output gamma image in the reference dose geometry (for the first criterion)
+  vtkOrientedImageData* GetOutputGammaImageData();
+  /// Get output gamma image in the reference dose geometry for a given criterion
+  vtkOrientedImageData* GetOutputGammaImageData(int criterionIndex);
+
+  /// Set reference dose image
+  vtkSetObjectMacro(ReferenceDoseImageData, vtkOrientedImageData);
+  /// Get reference dose image
+  vtkGetObjectMacro(ReferenceDoseImageData, vtkOrientedImageData);
+
+  /// Set compare dose image. Its geometry may differ from the reference
+  vtkSetObjectMacro(CompareDoseImageData, vtkOrientedImageData);
+  /// Get compare dose image
+  vtkGetObjectMacro(CompareDoseImageData, vtkOrientedImageData);
+
+  /// Set mask image (optional). Only voxels where the mask is nonzero are analyzed. Its geometry may differ from the reference
+  vtkSetObjectMacro(MaskImageData, vtkOrientedImageData);
+  /// Get mask image
+  vtkGetObjectMacro(MaskImageData, vtkOrientedImageData);
+
+  /// Add gamma criterion to be evaluated in the same pass as the other criteria.
+  /// If no criteria are added, then the single DtaDistanceToleranceMm and DoseDifferenceTolerancePercent pair is used.
+  void AddCriterion(double dtaDistanceToleranceMm, double doseDifferenceTolerancePercent);
+  /// Remove all added criteria
+  void RemoveAllCriteria();
+  /// Get number of criteria evaluated by Update (at least one)
+  int GetNumberOfCriteria();
+  /// Get DTA tolerance of a given criterion, in mm
+  double GetCriterionDtaDistanceToleranceMm(int criterionIndex);
+  /// Get dose difference tolerance of a given criterion, in percent
+  double GetCriterionDoseDifferenceTolerancePercent(int criterionIndex);
+
+  /// Distance to agreement (DTA) tolerance, in mm. Used if no criteria are added
+  vtkGetMacro(DtaDistanceToleranceMm, double);
+  vtkSetMacro(DtaDistanceToleranceMm, double);
+
+  /// Dose difference tolerance in percent (of the reference dose, or of the local dose in case of local gamma).
+  /// Used if no criteria are added
+  vtkGetMacro(DoseDifferenceTolerancePercent, double);
+  vtkSetMacro(DoseDifferenceTolerancePercent, double);
+
+  /// Reference dose (prescription dose) in Gy. If zero or negative, then the maximum of the reference dose is used
+  vtkGetMacro(ReferenceDoseGy, double);
+  vtkSetMacro(ReferenceDoseGy, double);
+
+  /// Dose threshold for gamma analysis in percent of the reference dose
+  vtkGetMacro(AnalysisThresholdPercent, double);
+  vtkSetMacro(AnalysisThresholdPercent, double);
+
+  /// Maximum gamma. Gamma values are capped at this value, and together with the largest DTA it limits the search radius
+  vtkGetMacro(MaximumGamma, double);
+  vtkSetMacro(MaximumGamma, double);
+
+  /// Use local dose difference instead of global
+  vtkGetMacro(LocalDoseDifference, bool);
+  vtkSetMacro(LocalDoseDifference, bool);
+  vtkBooleanMacro(LocalDoseDifference, bool);
+
+  /// Apply analysis threshold on the reference dose only (otherwise voxels above threshold in either dose are analyzed)
+  vtkGetMacro(DoseThresholdOnReferenceOnly, bool);
+  vtkSetMacro(DoseThresholdOnReferenceOnly, bool);
+  vtkBooleanMacro(DoseThresholdOnReferenceOnly, bool);
+
+  /// Use trilinear interpolation when sampling the compare dose (nearest neighbor otherwise)
+  vtkGetMacro(UseLinearInterpolation, bool);
+  vtkSetMacro(UseLinearInterpolation, bool);
+  vtkBooleanMacro(UseLinearInterpolation, bool);
+
+  /// Number of search positions per reference voxel spacing along each axis. Values above 1 enable
+  /// sub-voxel search, where the compare dose is interpolated between the grid points. Default is 1.
+  vtkGetMacro(SubvoxelSamplingFactor, int);
+  vtkSetClampMacro(SubvoxelSamplingFactor, int, 1, 10);
+
+  /// Number of threads to use. Zero (default) means that the default of the SMP backend is used.
+  /// The setting only applies to this filter and needs VTK 9.1 or later, see \sa vtkSlicerRtCommon::SMPFor
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
+  /// Get percentage of analyzed voxels that passed (gamma <= 1) for the first criterion
+  double GetPassFractionPercent() { return this->GetPassFractionPercent(0); };
+  /// Get percentage of analyzed voxels that passed (gamma <= 1) for a given criterion
+  double GetPassFractionPercent(int criterionIndex);
+  /// Get number of analyzed voxels (same for all criteria)
+  vtkGetMacro(NumberOfAnalyzedVoxels, vtkIdType);
+  /// Get number of analyzed voxels that passed for the first criterion
+  vtkIdType GetNumberOfPassedVoxels() { return this->GetNumberOfPassedVoxels(0); };
+  /// Get number of analyzed voxels that passed for a given criterion
+  vtkIdType GetNumberOfPassedVoxels(int criterionIndex);
+  /// Get number of offsets in the search neighborhood
+  vtkGetMacro(NumberOfSearchOffsets, vtkIdType);
+
+  /// Get report string listing the input parameters and the results
+  std::string GetReportString() { return this->ReportString; };
+
+protected:
+  /// Gamma criterion and its results
+  struct GammaCriterion
+  {
+    GammaCriterion(double dtaDistanceToleranceMm, double doseDifferenceTolerancePercent)
+      : DtaDistanceToleranceMm(dtaDistanceToleranceMm)
+      , DoseDifferenceTolerancePercent(doseDifferenceTolerancePercent)
+      , NumberOfPassedVoxels(0)
+      , PassFractionPercent(0.0)
+    {
+    }
+    double DtaDistanceToleranceMm;
+    double DoseDifferenceTolerancePercent;
+    vtkIdType NumberOfPassedVoxels;
+    double PassFractionPercent;
+    vtkSmartPointer<vtkOrientedImageData> OutputGammaImageData;
+  };
+
+  /// Get criteria evaluated by Update. Contains the single DTA and dose difference pair if no criteria are added
+  std::vector<GammaCriterion>& GetEvaluatedCriteria();
+
+protected:
+  vtkOrientedImageData* ReferenceDoseImageData;
+  vtkOrientedImageData* CompareDoseImageData;
+  vtkOrientedImageData* MaskImageData;
+
+  /// Criteria added by AddCriterion
+  std::vector<GammaCriterion> Criteria;
+  /// Criterion made of DtaDistanceToleranceMm and DoseDifferenceTolerancePercent, used if no criteria are added
+  std::vector<GammaCriterion> DefaultCriterion;
+
+  double DtaDistanceToleranceMm;
+  double DoseDifferenceTolerancePercent;
+  double ReferenceDoseGy;
+  double AnalysisThresholdPercent;
+  double MaximumGamma;
+  bool LocalDoseDifference;
+  bool DoseThresholdOnReferenceOnly;
+  bool UseLinearInterpolation;
+  int SubvoxelSamplingFactor;
+  int NumberOfThreads;
+
+  vtkIdType NumberOfAnalyzedVoxels;
+  vtkIdType NumberOfSearchOffsets;
+  std::string ReportString;
+
+protected:
+  vtkGammaDoseComparisonFilter();
+  virtual ~vtkGammaDoseComparisonFilter();
+
+private:
+  vtkGammaDoseComparisonFilter(const vtkGammaDoseComparisonFilter&); // Not implemented
+  void operator=(const vtkGammaDoseComparisonFilter&);               // Not implemented
+};
+
+#endif
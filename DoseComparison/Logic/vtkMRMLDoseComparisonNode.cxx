@@ -25,6 +25,7 @@
 #include <vtkMRMLScene.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLSegmentationNode.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkObjectFactory.h>
@@ -38,6 +39,8 @@ static const char* REFERENCE_DOSE_VOLUME_REFERENCE_ROLE = "referenceDoseVolumeRe
 static const char* COMPARE_DOSE_VOLUME_REFERENCE_ROLE = "compareDoseVolumeRef";
 static const char* MASK_SEGMENTATION_REFERENCE_ROLE = "maskSegmentationRef";
 static const char* GAMMA_VOLUME_REFERENCE_ROLE = "outputGammaVolumeRef";
+static const char* GAMMA_CRITERION_VOLUME_REFERENCE_ROLE = "outputCriterionGammaVolumeRef";
+static const char* GAMMA_REPORT_TABLE_REFERENCE_ROLE = "gammaReportTableRef";
 
 //------------------------------------------------------------------------------
 vtkMRMLNodeNewMacro(vtkMRMLDoseComparisonNode);
@@ -58,6 +61,9 @@ vtkMRMLDoseComparisonNode::vtkMRMLDoseComparisonNode()
   this->ResultsValid = false;
   this->ReportString = NULL;
   this->LocalDoseDifference = false;
+  this->UseNativeGammaEngine = false;
+  this->SubvoxelSamplingFactor = 1;
+  this->NumberOfThreads = 0;
 
   this->HideFromEditors = false;
 }
@@ -84,7 +90,16 @@ void vtkMRMLDoseComparisonNode::WriteXML(ostream& of, int nIndent)
   of << " UseLinearInterpolation=\"" << (this->UseLinearInterpolation ? "true" : "false") << "\"";
   of << " LocalDoseDifference=\"" << (this->LocalDoseDifference ? "true" : "false") << "\"";
   of << " DoseThresholdOnReferenceOnly=\"" << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\"";
+  of << " UseNativeGammaEngine=\"" << (this->UseNativeGammaEngine ? "true" : "false") << "\"";
+  of << " SubvoxelSamplingFactor=\"" << this->SubvoxelSamplingFactor << "\"";
+  of << " NumberOfThreads=\"" << this->NumberOfThreads << "\"";
   of << " PassFractionPercent=\"" << this->PassFractionPercent << "\"";
+  of << " GammaCriteria=\"";
+  for (std::vector<GammaCriterion>::iterator criterionIt=this->GammaCriteria.begin(); criterionIt!=this->GammaCriteria.end(); ++criterionIt)
+  {
+    of << criterionIt->DtaDistanceToleranceMm << ":" << criterionIt->DoseDifferenceTolerancePercent << ":" << criterionIt->PassFractionPercent << "|";
+  }
+  of << "\"";
   of << " ResultsValid=\"" << (this->ResultsValid ? "true" : "false") << "\"";
   of << " ReportString=\"" << (this->ReportString ? this->ReportString : "") << "\"";
 }
@@ -143,10 +158,47 @@ void vtkMRMLDoseComparisonNode::ReadXMLAttributes(const char** atts)
       {
       this->DoseThresholdOnReferenceOnly = (strcmp(attValue,"true") ? false : true);
       }
+    else if (!strcmp(attName, "UseNativeGammaEngine")) 
+      {
+      this->UseNativeGammaEngine = (strcmp(attValue,"true") ? false : true);
+      }
+    else if (!strcmp(attName, "SubvoxelSamplingFactor")) 
+      {
+      this->SubvoxelSamplingFactor = vtkVariant(attValue).ToInt();
+      }
+    else if (!strcmp(attName, "NumberOfThreads")) 
+      {
+      this->NumberOfThreads = vtkVariant(attValue).ToInt();
+      }
     else if (!strcmp(attName, "PassFractionPercent")) 
       {
       this->PassFractionPercent = vtkVariant(attValue).ToDouble();
       }
+    else if (!strcmp(attName, "GammaCriteria")) 
+      {
+      this->GammaCriteria.clear();
+      std::stringstream ss;
+      ss << attValue;
+      std::string criteriaString = ss.str();
+      size_t separatorPosition = criteriaString.find("|");
+      while (separatorPosition != std::string::npos)
+        {
+        std::string criterionString = criteriaString.substr(0, separatorPosition);
+        size_t firstColonPosition = criterionString.find(":");
+        size_t secondColonPosition = criterionString.find(":", firstColonPosition + 1);
+        if (firstColonPosition != std::string::npos && secondColonPosition != std::string::npos)
+          {
+          GammaCriterion criterion;
+          criterion.DtaDistanceToleranceMm = vtkVariant(criterionString.substr(0, firstColonPosition)).ToDouble();
+          criterion.DoseDifferenceTolerancePercent = vtkVariant(
+            criterionString.substr(firstColonPosition + 1, secondColonPosition - firstColonPosition - 1) ).ToDouble();
+          criterion.PassFractionPercent = vtkVariant(criterionString.substr(secondColonPosition + 1)).ToDouble();
+          this->GammaCriteria.push_back(criterion);
+          }
+        criteriaString = criteriaString.substr(separatorPosition+1);
+        separatorPosition = criteriaString.find("|");
+        }
+      }
     else if (!strcmp(attName, "ResultsValid")) 
       {
       this->ResultsValid = (strcmp(attValue,"true") ? false : true);
@@ -177,6 +229,10 @@ void vtkMRMLDoseComparisonNode::Copy(vtkMRMLNode *anode)
   this->UseLinearInterpolation = node->UseLinearInterpolation;
   this->LocalDoseDifference = node->LocalDoseDifference;
   this->DoseThresholdOnReferenceOnly = node->DoseThresholdOnReferenceOnly;
+  this->UseNativeGammaEngine = node->UseNativeGammaEngine;
+  this->SubvoxelSamplingFactor = node->SubvoxelSamplingFactor;
+  this->NumberOfThreads = node->NumberOfThreads;
+  this->GammaCriteria = node->GammaCriteria;
   this->ResultsValid = node->ResultsValid;
   this->ReportString = node->ReportString;
 
@@ -199,7 +255,17 @@ void vtkMRMLDoseComparisonNode::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "UseLinearInterpolation:   " << (this->UseLinearInterpolation ? "true" : "false") << "\n";
   os << indent << "LocalDoseDifference:   " << (this->LocalDoseDifference ? "true" : "false") << "\n";
   os << indent << "DoseThresholdOnReferenceOnly:   " << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\n";
+  os << indent << "UseNativeGammaEngine:   " << (this->UseNativeGammaEngine ? "true" : "false") << "\n";
+  os << indent << "SubvoxelSamplingFactor:   " << this->SubvoxelSamplingFactor << "\n";
+  os << indent << "NumberOfThreads:   " << this->NumberOfThreads << "\n";
   os << indent << "PassFractionPercent:   " << this->PassFractionPercent << "\n";
+  os << indent << "GammaCriteria:   ";
+  for (std::vector<GammaCriterion>::iterator criterionIt=this->GammaCriteria.begin(); criterionIt!=this->GammaCriteria.end(); ++criterionIt)
+  {
+    os << criterionIt->DoseDifferenceTolerancePercent << "%/" << criterionIt->DtaDistanceToleranceMm << "mm (pass "
+      << criterionIt->PassFractionPercent << "%) ";
+  }
+  os << "\n";
   os << indent << "ResultsValid:   " << (this->ResultsValid ? "true" : "false") << "\n";
   os << indent << "ReportString:   " << (this->ReportString ? this->ReportString : "") << "\n";
 }
@@ -275,3 +341,108 @@ void vtkMRMLDoseComparisonNode::SetAndObserveGammaVolumeNode(vtkMRMLScalarVolume
 
   this->SetNodeReferenceID(GAMMA_VOLUME_REFERENCE_ROLE, (node ? node->GetID() : NULL));
 }
+
+//----------------------------------------------------------------------------
+vtkMRMLScalarVolumeNode* vtkMRMLDoseComparisonNode::GetNthGammaCriterionVolumeNode(int n)
+{
+  return vtkMRMLScalarVolumeNode::SafeDownCast( this->GetNthNodeReference(GAMMA_CRITERION_VOLUME_REFERENCE_ROLE, n) );
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::SetAndObserveNthGammaCriterionVolumeNode(int n, vtkMRMLScalarVolumeNode* node)
+{
+  if (node && this->Scene != node->GetScene())
+    {
+    vtkErrorMacro("Cannot set reference: the referenced and referencing node are not in the same scene");
+    return;
+    }
+
+  this->SetNthNodeReferenceID(GAMMA_CRITERION_VOLUME_REFERENCE_ROLE, n, (node ? node->GetID() : NULL));
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLTableNode* vtkMRMLDoseComparisonNode::GetGammaReportTableNode()
+{
+  return vtkMRMLTableNode::SafeDownCast( this->GetNodeReference(GAMMA_REPORT_TABLE_REFERENCE_ROLE) );
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::SetAndObserveGammaReportTableNode(vtkMRMLTableNode* node)
+{
+  if (node && this->Scene != node->GetScene())
+    {
+    vtkErrorMacro("Cannot set reference: the referenced and referencing node are not in the same scene");
+    return;
+    }
+
+  this->SetNodeReferenceID(GAMMA_REPORT_TABLE_REFERENCE_ROLE, (node ? node->GetID() : NULL));
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::AddGammaCriterion(double dtaDistanceToleranceMm, double doseDifferenceTolerancePercent)
+{
+  GammaCriterion criterion;
+  criterion.DtaDistanceToleranceMm = dtaDistanceToleranceMm;
+  criterion.DoseDifferenceTolerancePercent = doseDifferenceTolerancePercent;
+  criterion.PassFractionPercent = -1.0;
+  this->GammaCriteria.push_back(criterion);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::RemoveAllGammaCriteria()
+{
+  this->GammaCriteria.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkMRMLDoseComparisonNode::GetNumberOfGammaCriteria()
+{
+  return static_cast<int>(this->GammaCriteria.size());
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLDoseComparisonNode::GetNthGammaCriterionDtaDistanceToleranceMm(int n)
+{
+  if (n < 0 || n >= static_cast<int>(this->GammaCriteria.size()))
+    {
+    vtkErrorMacro("GetNthGammaCriterionDtaDistanceToleranceMm: Invalid criterion index " << n);
+    return 0.0;
+    }
+  return this->GammaCriteria[n].DtaDistanceToleranceMm;
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLDoseComparisonNode::GetNthGammaCriterionDoseDifferenceTolerancePercent(int n)
+{
+  if (n < 0 || n >= static_cast<int>(this->GammaCriteria.size()))
+    {
+    vtkErrorMacro("GetNthGammaCriterionDoseDifferenceTolerancePercent: Invalid criterion index " << n);
+    return 0.0;
+    }
+  return this->GammaCriteria[n].DoseDifferenceTolerancePercent;
+}
+
+//----------------------------------------------------------------------------
+double vtkMRMLDoseComparisonNode::GetNthGammaCriterionPassFractionPercent(int n)
+{
+  if (n < 0 || n >= static_cast<int>(this->GammaCriteria.size()))
+    {
+    vtkErrorMacro("GetNthGammaCriterionPassFractionPercent: Invalid criterion index " << n);
+    return -1.0;
+    }
+  return this->GammaCriteria[n].PassFractionPercent;
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLDoseComparisonNode::SetNthGammaCriterionPassFractionPercent(int n, double passFractionPercent)
+{
+  if (n < 0 || n >= static_cast<int>(this->GammaCriteria.size()))
+    {
+    vtkErrorMacro("SetNthGammaCriterionPassFractionPercent: Invalid criterion index " << n);
+    return;
+    }
+  this->GammaCriteria[n].PassFractionPercent = passFractionPercent;
+  this->Modified();
+}
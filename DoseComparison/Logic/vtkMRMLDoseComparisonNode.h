@@ -33,6 +33,7 @@
 
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLSegmentationNode;
+class vtkMRMLTableNode;
 
 /// \ingroup SlicerRt_QtModules_DoseComparison
 class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkMRMLDoseComparisonNode : public vtkMRMLNode
@@ -78,6 +79,31 @@ public:
   /// Set and observe output gamma volume node
   void SetAndObserveGammaVolumeNode(vtkMRMLScalarVolumeNode* node);
 
+  /// Get output gamma volume node of a criterion in multi-criteria gamma computation
+  vtkMRMLScalarVolumeNode* GetNthGammaCriterionVolumeNode(int n);
+  /// Set and observe output gamma volume node of a criterion in multi-criteria gamma computation
+  void SetAndObserveNthGammaCriterionVolumeNode(int n, vtkMRMLScalarVolumeNode* node);
+
+  /// Get output report table node of multi-criteria gamma computation
+  vtkMRMLTableNode* GetGammaReportTableNode();
+  /// Set and observe output report table node of multi-criteria gamma computation
+  void SetAndObserveGammaReportTableNode(vtkMRMLTableNode* node);
+
+  /// Add criterion (DTA and dose difference tolerance pair) for multi-criteria gamma computation
+  void AddGammaCriterion(double dtaDistanceToleranceMm, double doseDifferenceTolerancePercent);
+  /// Remove all criteria for multi-criteria gamma computation
+  void RemoveAllGammaCriteria();
+  /// Get number of criteria for multi-criteria gamma computation
+  int GetNumberOfGammaCriteria();
+  /// Get DTA tolerance of a criterion, in mm
+  double GetNthGammaCriterionDtaDistanceToleranceMm(int n);
+  /// Get dose difference tolerance of a criterion, in percent
+  double GetNthGammaCriterionDoseDifferenceTolerancePercent(int n);
+  /// Get pass fraction of a criterion (output)
+  double GetNthGammaCriterionPassFractionPercent(int n);
+  /// Set pass fraction of a criterion (output)
+  void SetNthGammaCriterionPassFractionPercent(int n, double passFractionPercent);
+
   /// Get mask segment ID
   vtkGetStringMacro(MaskSegmentID);
   /// Set mask segment ID
@@ -136,6 +162,23 @@ public:
   /// Set local dose difference flag
   vtkBooleanMacro(LocalDoseDifference, bool);
 
+  /// Get use native gamma engine flag
+  vtkGetMacro(UseNativeGammaEngine, bool);
+  /// Set use native gamma engine flag
+  vtkSetMacro(UseNativeGammaEngine, bool);
+  /// Set use native gamma engine flag
+  vtkBooleanMacro(UseNativeGammaEngine, bool);
+
+  /// Get sub-voxel sampling factor of the native gamma engine
+  vtkGetMacro(SubvoxelSamplingFactor, int);
+  /// Set sub-voxel sampling factor of the native gamma engine
+  vtkSetMacro(SubvoxelSamplingFactor, int);
+
+  /// Get number of threads used by the native gamma engine
+  vtkGetMacro(NumberOfThreads, int);
+  /// Set number of threads used by the native gamma engine
+  vtkSetMacro(NumberOfThreads, int);
+
   /// Get valid flag
   vtkGetMacro(ResultsValid, bool);
   /// Set valid flag
@@ -159,6 +202,15 @@ protected:
   vtkMRMLDoseComparisonNode(const vtkMRMLDoseComparisonNode&);
   void operator=(const vtkMRMLDoseComparisonNode&);
 
+protected:
+  /// Gamma criterion for multi-criteria gamma computation
+  struct GammaCriterion
+  {
+    double DtaDistanceToleranceMm;
+    double DoseDifferenceTolerancePercent;
+    double PassFractionPercent;
+  };
+
 protected:
   /// Mask segment ID in mask segmentation node
   char* MaskSegmentID;
@@ -197,10 +249,24 @@ protected:
   /// Flag determining whether dose thresholding should be performed using only the reference image
   /// Default value is false, meaning that both images will be used
   bool DoseThresholdOnReferenceOnly;
+
+  /// Flag determining whether the in-tree multi-threaded gamma engine is used instead of plastimatch.
+  /// Default value is false.
+  bool UseNativeGammaEngine;
+
+  /// Number of compare dose sampling positions per reference voxel spacing in the native gamma engine.
+  /// Values above 1 enable sub-voxel search with interpolated compare dose. Default value is 1.
+  int SubvoxelSamplingFactor;
+
+  /// Number of threads used by the native gamma engine. Zero (default) means the default number of threads.
+  int NumberOfThreads;
   
   /// Percentage of voxels that passed (output)
   double PassFractionPercent;
 
+  /// Criteria evaluated in a single pass by multi-criteria gamma computation, with their pass fractions (output)
+  std::vector<GammaCriterion> GammaCriteria;
+
   /// Flag indicating if the results are valid
   bool ResultsValid;
 
@@ -0,0 +1,605 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkPlanarGammaBatchFilter.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtCommon.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// VTK includes
+#include <vtkCommand.h>
+#include <vtkDoubleArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkStringArray.h>
+#include <vtkTable.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Number of parallel sections the computation is split into, so that progress can be reported in between
+  const int PLANAR_GAMMA_NUMBER_OF_PROGRESS_STEPS = 20;
+
+  /// Number of image rows processed as one parallel work item
+  const int PLANAR_GAMMA_ROWS_PER_BLOCK = 8;
+
+  //----------------------------------------------------------------------------
+  /// Row of the search neighborhood of a pixel
+  struct PlanarGammaSearchRow
+  {
+    /// Squared distance of the row from the pixel divided by the squared DTA
+    float DistanceTerm;
+    /// Row offset from the pixel
+    int RowOffset;
+    /// Number of pixels searched on each side of the pixel in the row
+    int HalfWidth;
+
+    bool operator<(const PlanarGammaSearchRow& other) const
+    {
+      return this->DistanceTerm < other.DistanceTerm;
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  /// Image pair data prepared for the parallel computation
+  struct PlanarGammaPairData
+  {
+    PlanarGammaPairData()
+      : ReferenceScalars(NULL)
+      , CompareScalars(NULL)
+      , GammaScalars(NULL)
+      , ThresholdDose(0.0)
+      , GlobalDoseTolerance(0.0)
+      , LocalDoseToleranceFraction(0.0)
+      , MaximumHalfWidth(0)
+    {
+      this->Dimensions[0] = this->Dimensions[1] = 0;
+    }
+
+    const float* ReferenceScalars;
+    /// Compare pixels on the reference grid
+    const float* CompareScalars;
+    /// Output gamma pixels. NULL if gamma images are not stored
+    float* GammaScalars;
+    int Dimensions[2];
+    double ThresholdDose;
+    double GlobalDoseTolerance;
+    double LocalDoseToleranceFraction;
+    /// Search rows in increasing distance
+    std::vector<PlanarGammaSearchRow> SearchRows;
+    /// Squared distance of each column offset from -MaximumHalfWidth to MaximumHalfWidth divided by the squared DTA
+    std::vector<float> ColumnDistanceTerms;
+    int MaximumHalfWidth;
+
+    /// Float copies of non-float or resampled inputs, kept alive for the computation
+    vtkSmartPointer<vtkImageData> ReferenceFloatImage;
+    vtkSmartPointer<vtkImageData> CompareFloatImage;
+    vtkSmartPointer<vtkOrientedImageData> ResampledCompareImage;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Range of rows of one image pair, the unit of parallel work
+  struct PlanarGammaRowBlock
+  {
+    int PairIndex;
+    int BeginRow;
+    int EndRow;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Pixel counts and gamma sums accumulated separately by each thread
+  struct PlanarGammaStatistics
+  {
+    PlanarGammaStatistics()
+      : NumberOfAnalyzedPixels(0)
+      , NumberOfPassedPixels(0)
+      , GammaSum(0.0)
+      , LargestGamma(0.0)
+    {
+    }
+    vtkIdType NumberOfAnalyzedPixels;
+    vtkIdType NumberOfPassedPixels;
+    double GammaSum;
+    double LargestGamma;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Computes gamma for blocks of rows of the image pairs
+  class PlanarGammaFunctor
+  {
+  public:
+    PlanarGammaFunctor()
+      : Pairs(NULL)
+      , RowBlocks(NULL)
+      , LocalDoseDifference(false)
+      , DoseThresholdOnReferenceOnly(false)
+      , MaximumGamma(2.0)
+    {
+    }
+
+    void Initialize()
+    {
+      this->Statistics.Local().assign(this->Pairs->size(), PlanarGammaStatistics());
+    }
+
+    void operator()(vtkIdType beginBlock, vtkIdType endBlock)
+    {
+      std::vector<PlanarGammaStatistics>& statistics = this->Statistics.Local();
+      const float maximumGammaSquared = static_cast<float>(this->MaximumGamma * this->MaximumGamma);
+      for (vtkIdType blockIndex=beginBlock; blockIndex<endBlock; ++blockIndex)
+      {
+        const PlanarGammaRowBlock& block = (*this->RowBlocks)[blockIndex];
+        const PlanarGammaPairData& pair = (*this->Pairs)[block.PairIndex];
+        PlanarGammaStatistics& pairStatistics = statistics[block.PairIndex];
+        const int numberOfColumns = pair.Dimensions[0];
+        const int numberOfRows = pair.Dimensions[1];
+        const size_t numberOfSearchRows = pair.SearchRows.size();
+        const PlanarGammaSearchRow* searchRows = &(pair.SearchRows[0]);
+        // Indexed by column offset, from -MaximumHalfWidth to MaximumHalfWidth
+        const float* columnDistanceTerms = &(pair.ColumnDistanceTerms[pair.MaximumHalfWidth]);
+
+        for (int j=block.BeginRow; j<block.EndRow; ++j)
+        {
+          vtkIdType pixelIndex = static_cast<vtkIdType>(j) * numberOfColumns;
+          for (int i=0; i<numberOfColumns; ++i, ++pixelIndex)
+          {
+            if (pair.GammaScalars)
+            {
+              pair.GammaScalars[pixelIndex] = 0.0f;
+            }
+
+            // Skip pixels below threshold
+            const float referenceDose = pair.ReferenceScalars[pixelIndex];
+            if ( referenceDose < pair.ThresholdDose
+              && (this->DoseThresholdOnReferenceOnly || pair.CompareScalars[pixelIndex] < pair.ThresholdDose) )
+            {
+              continue;
+            }
+
+            // Fall back to global tolerance where the local dose is zero
+            double doseTolerance = pair.GlobalDoseTolerance;
+            if (this->LocalDoseDifference && referenceDose > 0.0f)
+            {
+              doseTolerance = pair.LocalDoseToleranceFraction * referenceDose;
+            }
+            const float inverseDoseToleranceSquared = static_cast<float>(1.0 / (doseTolerance * doseTolerance));
+
+            // Search rows in increasing distance. Stop when the distance of the row alone reaches the
+            // minimum found so far, as farther rows cannot yield lower gamma.
+            float minimumGammaSquared = maximumGammaSquared;
+            for (size_t searchRowIndex=0; searchRowIndex<numberOfSearchRows; ++searchRowIndex)
+            {
+              const PlanarGammaSearchRow& searchRow = searchRows[searchRowIndex];
+              if (searchRow.DistanceTerm >= minimumGammaSquared)
+              {
+                break;
+              }
+              const int compareRow = j + searchRow.RowOffset;
+              if (compareRow < 0 || compareRow >= numberOfRows)
+              {
+                continue;
+              }
+              const int firstOffset = std::max(-searchRow.HalfWidth, -i);
+              const int lastOffset = std::min(searchRow.HalfWidth, numberOfColumns - 1 - i);
+              const float* compareScalars = pair.CompareScalars + static_cast<vtkIdType>(compareRow) * numberOfColumns + i;
+
+              // Contiguous span without early exit, so that the loop can be vectorized
+              float rowMinimum = minimumGammaSquared - searchRow.DistanceTerm;
+              for (int offset=firstOffset; offset<=lastOffset; ++offset)
+              {
+                const float doseDifference = compareScalars[offset] - referenceDose;
+                const float gammaSquared = columnDistanceTerms[offset] + doseDifference * doseDifference * inverseDoseToleranceSquared;
+                rowMinimum = (gammaSquared < rowMinimum ? gammaSquared : rowMinimum);
+              }
+              minimumGammaSquared = rowMinimum + searchRow.DistanceTerm;
+            }
+
+            const double gamma = std::sqrt(static_cast<double>(minimumGammaSquared));
+            if (pair.GammaScalars)
+            {
+              pair.GammaScalars[pixelIndex] = static_cast<float>(gamma);
+            }
+            ++pairStatistics.NumberOfAnalyzedPixels;
+            if (gamma <= 1.0)
+            {
+              ++pairStatistics.NumberOfPassedPixels;
+            }
+            pairStatistics.GammaSum += gamma;
+            pairStatistics.LargestGamma = std::max(pairStatistics.LargestGamma, gamma);
+          }
+        }
+      }
+    }
+
+    void Reduce()
+    {
+      // Thread local statistics are reset after summing them, because threads that do not take part
+      // in the next parallel section are not initialized again
+      this->Total.resize(this->Pairs->size());
+      for (vtkSMPThreadLocal<std::vector<PlanarGammaStatistics> >::iterator it = this->Statistics.begin(); it != this->Statistics.end(); ++it)
+      {
+        for (size_t pairIndex=0; pairIndex<it->size(); ++pairIndex)
+        {
+          PlanarGammaStatistics& local = (*it)[pairIndex];
+          PlanarGammaStatistics& total = this->Total[pairIndex];
+          total.NumberOfAnalyzedPixels += local.NumberOfAnalyzedPixels;
+          total.NumberOfPassedPixels += local.NumberOfPassedPixels;
+          total.GammaSum += local.GammaSum;
+          total.LargestGamma = std::max(total.LargestGamma, local.LargestGamma);
+          local = PlanarGammaStatistics();
+        }
+      }
+    }
+
+  public:
+    const std::vector<PlanarGammaPairData>* Pairs;
+    const std::vector<PlanarGammaRowBlock>* RowBlocks;
+    bool LocalDoseDifference;
+    bool DoseThresholdOnReferenceOnly;
+    double MaximumGamma;
+
+    vtkSMPThreadLocal<std::vector<PlanarGammaStatistics> > Statistics;
+    std::vector<PlanarGammaStatistics> Total;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkPlanarGammaBatchFilter);
+
+//----------------------------------------------------------------------------
+vtkPlanarGammaBatchFilter::vtkPlanarGammaBatchFilter()
+{
+  this->DtaDistanceToleranceMm = 3.0;
+  this->DoseDifferenceTolerancePercent = 3.0;
+  this->ReferenceDoseGy = 0.0;
+  this->AnalysisThresholdPercent = 0.0;
+  this->MaximumGamma = 2.0;
+  this->LocalDoseDifference = false;
+  this->DoseThresholdOnReferenceOnly = false;
+  this->StoreGammaImages = false;
+  this->NumberOfThreads = 0;
+
+  this->TotalNumberOfAnalyzedPixels = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkPlanarGammaBatchFilter::~vtkPlanarGammaBatchFilter()
+{
+  this->RemoveAllImagePairs();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarGammaBatchFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "DtaDistanceToleranceMm: " << this->DtaDistanceToleranceMm << "\n";
+  os << indent << "DoseDifferenceTolerancePercent: " << this->DoseDifferenceTolerancePercent << "\n";
+  os << indent << "ReferenceDoseGy: " << this->ReferenceDoseGy << "\n";
+  os << indent << "AnalysisThresholdPercent: " << this->AnalysisThresholdPercent << "\n";
+  os << indent << "MaximumGamma: " << this->MaximumGamma << "\n";
+  os << indent << "LocalDoseDifference: " << (this->LocalDoseDifference ? "true" : "false") << "\n";
+  os << indent << "DoseThresholdOnReferenceOnly: " << (this->DoseThresholdOnReferenceOnly ? "true" : "false") << "\n";
+  os << indent << "StoreGammaImages: " << (this->StoreGammaImages ? "true" : "false") << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "NumberOfImagePairs: " << this->ImagePairs.size() << "\n";
+  os << indent << "TotalNumberOfAnalyzedPixels: " << this->TotalNumberOfAnalyzedPixels << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarGammaBatchFilter::AddImagePair(vtkOrientedImageData* referenceImage, vtkOrientedImageData* compareImage, const char* name/*=NULL*/)
+{
+  ImagePair pair;
+  if (name && name[0])
+  {
+    pair.Name = name;
+  }
+  else
+  {
+    std::stringstream nameStream;
+    nameStream << this->ImagePairs.size();
+    pair.Name = nameStream.str();
+  }
+  pair.ReferenceImageData = referenceImage;
+  pair.CompareImageData = compareImage;
+  this->ImagePairs.push_back(pair);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarGammaBatchFilter::RemoveAllImagePairs()
+{
+  this->ImagePairs.clear();
+  this->TotalNumberOfAnalyzedPixels = 0;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+vtkPlanarGammaBatchFilter::ImagePair* vtkPlanarGammaBatchFilter::GetImagePair(int pairIndex, const char* callerName)
+{
+  if (pairIndex < 0 || pairIndex >= static_cast<int>(this->ImagePairs.size()))
+  {
+    vtkErrorMacro(<< callerName << ": Invalid image pair index " << pairIndex);
+    return NULL;
+  }
+  return &(this->ImagePairs[pairIndex]);
+}
+
+//----------------------------------------------------------------------------
+double vtkPlanarGammaBatchFilter::GetPassFractionPercent(int pairIndex)
+{
+  ImagePair* pair = this->GetImagePair(pairIndex, "GetPassFractionPercent");
+  return (pair ? pair->PassFractionPercent : 0.0);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkPlanarGammaBatchFilter::GetNumberOfAnalyzedPixels(int pairIndex)
+{
+  ImagePair* pair = this->GetImagePair(pairIndex, "GetNumberOfAnalyzedPixels");
+  return (pair ? pair->NumberOfAnalyzedPixels : 0);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkPlanarGammaBatchFilter::GetNumberOfPassedPixels(int pairIndex)
+{
+  ImagePair* pair = this->GetImagePair(pairIndex, "GetNumberOfPassedPixels");
+  return (pair ? pair->NumberOfPassedPixels : 0);
+}
+
+//----------------------------------------------------------------------------
+double vtkPlanarGammaBatchFilter::GetMeanGamma(int pairIndex)
+{
+  ImagePair* pair = this->GetImagePair(pairIndex, "GetMeanGamma");
+  return (pair ? pair->MeanGamma : 0.0);
+}
+
+//----------------------------------------------------------------------------
+double vtkPlanarGammaBatchFilter::GetLargestGamma(int pairIndex)
+{
+  ImagePair* pair = this->GetImagePair(pairIndex, "GetLargestGamma");
+  return (pair ? pair->LargestGamma : 0.0);
+}
+
+//----------------------------------------------------------------------------
+vtkOrientedImageData* vtkPlanarGammaBatchFilter::GetOutputGammaImageData(int pairIndex)
+{
+  ImagePair* pair = this->GetImagePair(pairIndex, "GetOutputGammaImageData");
+  return (pair ? pair->OutputGammaImageData.GetPointer() : NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkPlanarGammaBatchFilter::GetSummaryTable(vtkTable* table)
+{
+  if (!table)
+  {
+    vtkErrorMacro("GetSummaryTable: Invalid table!");
+    return;
+  }
+
+  vtkIdType numberOfPairs = static_cast<vtkIdType>(this->ImagePairs.size());
+  table->Initialize();
+  vtkNew<vtkStringArray> nameColumn;
+  nameColumn->SetName("Image");
+  nameColumn->SetNumberOfValues(numberOfPairs);
+  table->AddColumn(nameColumn.GetPointer());
+  const char* valueColumnNames[] = { "Analyzed pixels", "Passed pixels", "Pass fraction (%)", "Mean gamma", "Maximum gamma" };
+  std::vector<vtkDoubleArray*> valueColumns;
+  for (int columnIndex=0; columnIndex<5; ++columnIndex)
+  {
+    vtkNew<vtkDoubleArray> column;
+    column->SetName(valueColumnNames[columnIndex]);
+    column->SetNumberOfValues(numberOfPairs);
+    table->AddColumn(column.GetPointer());
+    valueColumns.push_back(column.GetPointer());
+  }
+  for (vtkIdType pairIndex=0; pairIndex<numberOfPairs; ++pairIndex)
+  {
+    const ImagePair& pair = this->ImagePairs[pairIndex];
+    nameColumn->SetValue(pairIndex, pair.Name);
+    valueColumns[0]->SetValue(pairIndex, pair.NumberOfAnalyzedPixels);
+    valueColumns[1]->SetValue(pairIndex, pair.NumberOfPassedPixels);
+    valueColumns[2]->SetValue(pairIndex, pair.PassFractionPercent);
+    valueColumns[3]->SetValue(pairIndex, pair.MeanGamma);
+    valueColumns[4]->SetValue(pairIndex, pair.LargestGamma);
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkPlanarGammaBatchFilter::Update()
+{
+  for (std::vector<ImagePair>::iterator pairIt=this->ImagePairs.begin(); pairIt!=this->ImagePairs.end(); ++pairIt)
+  {
+    pairIt->NumberOfAnalyzedPixels = 0;
+    pairIt->NumberOfPassedPixels = 0;
+    pairIt->PassFractionPercent = 0.0;
+    pairIt->MeanGamma = 0.0;
+    pairIt->LargestGamma = 0.0;
+    pairIt->OutputGammaImageData = vtkSmartPointer<vtkOrientedImageData>();
+  }
+  this->TotalNumberOfAnalyzedPixels = 0;
+
+  if (this->ImagePairs.empty())
+  {
+    vtkErrorMacro("Update: No image pairs are added!");
+    return false;
+  }
+  if (this->DtaDistanceToleranceMm <= 0.0 || this->DoseDifferenceTolerancePercent <= 0.0 || this->MaximumGamma <= 0.0)
+  {
+    vtkErrorMacro("Update: DTA, dose difference tolerance and maximum gamma have to be positive!");
+    return false;
+  }
+
+  // Prepare pairs and split them into blocks of rows
+  const double searchRadiusMm = this->MaximumGamma * this->DtaDistanceToleranceMm;
+  const double inverseDtaSquared = 1.0 / (this->DtaDistanceToleranceMm * this->DtaDistanceToleranceMm);
+  std::vector<PlanarGammaPairData> pairs(this->ImagePairs.size());
+  std::vector<PlanarGammaRowBlock> rowBlocks;
+  for (size_t pairIndex=0; pairIndex<this->ImagePairs.size(); ++pairIndex)
+  {
+    ImagePair& imagePair = this->ImagePairs[pairIndex];
+    PlanarGammaPairData& pair = pairs[pairIndex];
+    vtkOrientedImageData* referenceImage = imagePair.ReferenceImageData;
+    vtkOrientedImageData* compareImage = imagePair.CompareImageData;
+    if ( !referenceImage || !referenceImage->GetPointData()->GetScalars()
+      || !compareImage || !compareImage->GetPointData()->GetScalars() )
+    {
+      vtkErrorMacro("Update: Reference and compare images of pair " << imagePair.Name << " have to be initialized!");
+      return false;
+    }
+    if (referenceImage->GetNumberOfScalarComponents() != 1 || compareImage->GetNumberOfScalarComponents() != 1)
+    {
+      vtkErrorMacro("Update: Reference and compare images of pair " << imagePair.Name << " have to be scalar images!");
+      return false;
+    }
+    int referenceDimensions[3] = {0, 0, 0};
+    referenceImage->GetDimensions(referenceDimensions);
+    if (referenceDimensions[2] != 1)
+    {
+      vtkErrorMacro("Update: Reference image of pair " << imagePair.Name << " is not planar (" << referenceDimensions[2] << " slices)!");
+      return false;
+    }
+    pair.Dimensions[0] = referenceDimensions[0];
+    pair.Dimensions[1] = referenceDimensions[1];
+
+    // Search is done on the reference grid, so resample compare image if needed
+    if (!vtkOrientedImageDataResample::DoGeometriesMatch(referenceImage, compareImage))
+    {
+      pair.ResampledCompareImage = vtkSmartPointer<vtkOrientedImageData>::New();
+      if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(compareImage, referenceImage, pair.ResampledCompareImage, true))
+      {
+        vtkErrorMacro("Update: Failed to resample compare image of pair " << imagePair.Name << " to the reference geometry!");
+        return false;
+      }
+      compareImage = pair.ResampledCompareImage;
+    }
+    pair.ReferenceScalars = vtkSlicerRtCommon::GetFloatScalars(referenceImage, pair.ReferenceFloatImage);
+    pair.CompareScalars = vtkSlicerRtCommon::GetFloatScalars(compareImage, pair.CompareFloatImage);
+
+    // Determine reference dose and tolerances
+    double referenceDoseGy = this->ReferenceDoseGy;
+    if (referenceDoseGy <= 0.0)
+    {
+      double referenceRange[2] = {0.0, 0.0};
+      referenceImage->GetScalarRange(referenceRange);
+      referenceDoseGy = referenceRange[1];
+    }
+    if (referenceDoseGy <= 0.0)
+    {
+      vtkErrorMacro("Update: Reference dose of pair " << imagePair.Name << " has to be positive!");
+      return false;
+    }
+    pair.ThresholdDose = this->AnalysisThresholdPercent / 100.0 * referenceDoseGy;
+    pair.GlobalDoseTolerance = this->DoseDifferenceTolerancePercent / 100.0 * referenceDoseGy;
+    pair.LocalDoseToleranceFraction = this->DoseDifferenceTolerancePercent / 100.0;
+
+    // Search rows within the disk of radius MaximumGamma*DTA, sorted by distance
+    double spacing[3] = {1.0, 1.0, 1.0};
+    referenceImage->GetSpacing(spacing);
+    pair.MaximumHalfWidth = static_cast<int>(std::floor(searchRadiusMm / spacing[0]));
+    pair.ColumnDistanceTerms.resize(2 * pair.MaximumHalfWidth + 1);
+    for (int columnOffset=-pair.MaximumHalfWidth; columnOffset<=pair.MaximumHalfWidth; ++columnOffset)
+    {
+      double distanceMm = columnOffset * spacing[0];
+      pair.ColumnDistanceTerms[columnOffset + pair.MaximumHalfWidth] = static_cast<float>(distanceMm * distanceMm * inverseDtaSquared);
+    }
+    int maximumRowOffset = static_cast<int>(std::floor(searchRadiusMm / spacing[1]));
+    for (int rowOffset=-maximumRowOffset; rowOffset<=maximumRowOffset; ++rowOffset)
+    {
+      double rowDistanceMm = rowOffset * spacing[1];
+      double remainingRadiusSquared = std::max(0.0, searchRadiusMm * searchRadiusMm - rowDistanceMm * rowDistanceMm);
+      PlanarGammaSearchRow searchRow;
+      searchRow.DistanceTerm = static_cast<float>(rowDistanceMm * rowDistanceMm * inverseDtaSquared);
+      searchRow.RowOffset = rowOffset;
+      searchRow.HalfWidth = std::min(pair.MaximumHalfWidth, static_cast<int>(std::floor(std::sqrt(remainingRadiusSquared) / spacing[0])));
+      pair.SearchRows.push_back(searchRow);
+    }
+    std::sort(pair.SearchRows.begin(), pair.SearchRows.end());
+
+    // Allocate gamma image in the reference geometry
+    if (this->StoreGammaImages)
+    {
+      vtkSmartPointer<vtkMatrix4x4> referenceImageToWorld = vtkSmartPointer<vtkMatrix4x4>::New();
+      referenceImage->GetImageToWorldMatrix(referenceImageToWorld);
+      imagePair.OutputGammaImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+      imagePair.OutputGammaImageData->SetExtent(referenceImage->GetExtent());
+      imagePair.OutputGammaImageData->SetGeometryFromImageToWorldMatrix(referenceImageToWorld);
+      imagePair.OutputGammaImageData->AllocateScalars(VTK_FLOAT, 1);
+      pair.GammaScalars = static_cast<float*>(imagePair.OutputGammaImageData->GetScalarPointer());
+    }
+
+    for (int beginRow=0; beginRow<pair.Dimensions[1]; beginRow+=PLANAR_GAMMA_ROWS_PER_BLOCK)
+    {
+      PlanarGammaRowBlock block;
+      block.PairIndex = static_cast<int>(pairIndex);
+      block.BeginRow = beginRow;
+      block.EndRow = std::min(beginRow + PLANAR_GAMMA_ROWS_PER_BLOCK, pair.Dimensions[1]);
+      rowBlocks.push_back(block);
+    }
+  }
+
+  // Process the row blocks of all pairs together, in a few sections so that progress can be reported
+  PlanarGammaFunctor functor;
+  functor.Pairs = &pairs;
+  functor.RowBlocks = &rowBlocks;
+  functor.LocalDoseDifference = this->LocalDoseDifference;
+  functor.DoseThresholdOnReferenceOnly = this->DoseThresholdOnReferenceOnly;
+  functor.MaximumGamma = this->MaximumGamma;
+  const vtkIdType numberOfBlocks = static_cast<vtkIdType>(rowBlocks.size());
+  const int numberOfSections = static_cast<int>(std::max<vtkIdType>(1, std::min<vtkIdType>(PLANAR_GAMMA_NUMBER_OF_PROGRESS_STEPS, numberOfBlocks)));
+  for (int section=0; section<numberOfSections; ++section)
+  {
+    vtkIdType beginBlock = numberOfBlocks * section / numberOfSections;
+    vtkIdType endBlock = numberOfBlocks * (section+1) / numberOfSections;
+    vtkSlicerRtCommon::SMPFor(beginBlock, endBlock, 1, functor, this->NumberOfThreads);
+
+    double progress = (double)(section+1) / numberOfSections;
+    this->InvokeEvent(vtkCommand::ProgressEvent, (void*)&progress);
+  }
+
+  functor.Total.resize(pairs.size());
+  for (size_t pairIndex=0; pairIndex<this->ImagePairs.size(); ++pairIndex)
+  {
+    ImagePair& imagePair = this->ImagePairs[pairIndex];
+    const PlanarGammaStatistics& statistics = functor.Total[pairIndex];
+    imagePair.NumberOfAnalyzedPixels = statistics.NumberOfAnalyzedPixels;
+    imagePair.NumberOfPassedPixels = statistics.NumberOfPassedPixels;
+    if (statistics.NumberOfAnalyzedPixels > 0)
+    {
+      imagePair.PassFractionPercent = 100.0 * statistics.NumberOfPassedPixels / statistics.NumberOfAnalyzedPixels;
+      imagePair.MeanGamma = statistics.GammaSum / statistics.NumberOfAnalyzedPixels;
+    }
+    imagePair.LargestGamma = statistics.LargestGamma;
+    this->TotalNumberOfAnalyzedPixels += statistics.NumberOfAnalyzedPixels;
+  }
+
+  return true;
+}
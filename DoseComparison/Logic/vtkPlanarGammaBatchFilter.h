@@ -0,0 +1,181 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkPlanarGammaBatchFilter_h
+#define __vtkPlanarGammaBatchFilter_h
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+#include "vtkSlicerDoseComparisonModuleLogicExport.h"
+
+class vtkOrientedImageData;
+class vtkTable;
+
+/// \ingroup SlicerRt_QtModules_DoseComparison
+/// \brief Multi-threaded 2D gamma comparison of many planar image pairs
+///
+/// Intended for portal dosimetry, where a batch of measured (EPID) RT images is compared against the
+/// predicted images. Each image has to have a single slice. The compare image is resampled to the reference
+/// grid if their geometries differ, so that the neighborhood search reads contiguous compare pixels.
+///
+/// The pairs are split into blocks of rows, and the blocks of all pairs are processed in a single parallel
+/// section, so that small images do not leave threads idle. The search neighborhood is the disk of radius
+/// MaximumGamma * DTA, stored as rows ordered by their distance from the pixel. Each row is a contiguous
+/// span of compare pixels evaluated in a branch-free loop that the compiler can vectorize. The search for
+/// a pixel stops at the first row whose distance term alone reaches the running minimum gamma.
+///
+/// The parameters follow \sa vtkGammaDoseComparisonFilter. Pixels are not interpolated between the grid points.
+class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkPlanarGammaBatchFilter : public vtkObject
+{
+public:
+  static vtkPlanarGammaBatchFilter *New();
+  vtkTypeMacro(vtkPlanarGammaBatchFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Add image pair to the batch
+  /// \param name Name of the pair in the summary table. The index of the pair is used if empty
+  void AddImagePair(vtkOrientedImageData* referenceImage, vtkOrientedImageData* compareImage, const char* name=NULL);
+  /// Remove all image pairs and results
+  void RemoveAllImagePairs();
+  /// Get number of image pairs in the batch
+  int GetNumberOfImagePairs() { return static_cast<int>(this->ImagePairs.size()); };
+
+  /// Compute gamma for all image pairs.
+  /// Invokes vtkCommand::ProgressEvent with a double progress value between 0 and 1 as call data.
+  /// \return Success flag. Fails without computing anything if any of the pairs is invalid
+  virtual bool Update();
+
+  /// Distance to agreement (DTA) tolerance, in mm
+  vtkGetMacro(DtaDistanceToleranceMm, double);
+  vtkSetMacro(DtaDistanceToleranceMm, double);
+
+  /// Dose difference tolerance in percent (of the reference dose, or of the local dose in case of local gamma)
+  vtkGetMacro(DoseDifferenceTolerancePercent, double);
+  vtkSetMacro(DoseDifferenceTolerancePercent, double);
+
+  /// Reference dose. If zero or negative, then the maximum of each reference image is used for its pair
+  vtkGetMacro(ReferenceDoseGy, double);
+  vtkSetMacro(ReferenceDoseGy, double);
+
+  /// Dose threshold for gamma analysis in percent of the reference dose
+  vtkGetMacro(AnalysisThresholdPercent, double);
+  vtkSetMacro(AnalysisThresholdPercent, double);
+
+  /// Maximum gamma. Gamma values are capped at this value, and together with the DTA it limits the search radius
+  vtkGetMacro(MaximumGamma, double);
+  vtkSetMacro(MaximumGamma, double);
+
+  /// Use local dose difference instead of global
+  vtkGetMacro(LocalDoseDifference, bool);
+  vtkSetMacro(LocalDoseDifference, bool);
+  vtkBooleanMacro(LocalDoseDifference, bool);
+
+  /// Apply analysis threshold on the reference dose only (otherwise pixels above threshold in either image are analyzed)
+  vtkGetMacro(DoseThresholdOnReferenceOnly, bool);
+  vtkSetMacro(DoseThresholdOnReferenceOnly, bool);
+  vtkBooleanMacro(DoseThresholdOnReferenceOnly, bool);
+
+  /// Keep the gamma image of each pair. Off by default, as for large batches usually only the summary is needed
+  vtkGetMacro(StoreGammaImages, bool);
+  vtkSetMacro(StoreGammaImages, bool);
+  vtkBooleanMacro(StoreGammaImages, bool);
+
+  /// Number of threads to use. Zero (default) means that the default of the SMP backend is used.
+  /// The setting only applies to this filter and needs VTK 9.1 or later, see \sa vtkSlicerRtCommon::SMPFor
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
+  /// Get percentage of analyzed pixels that passed (gamma <= 1) in a pair
+  double GetPassFractionPercent(int pairIndex);
+  /// Get number of analyzed pixels in a pair
+  vtkIdType GetNumberOfAnalyzedPixels(int pairIndex);
+  /// Get number of analyzed pixels that passed in a pair
+  vtkIdType GetNumberOfPassedPixels(int pairIndex);
+  /// Get mean gamma of the analyzed pixels in a pair
+  double GetMeanGamma(int pairIndex);
+  /// Get largest gamma of the analyzed pixels in a pair (at most MaximumGamma)
+  double GetLargestGamma(int pairIndex);
+  /// Get gamma image of a pair in the reference geometry. Only available if StoreGammaImages is on
+  vtkOrientedImageData* GetOutputGammaImageData(int pairIndex);
+
+  /// Get total number of analyzed pixels in the batch
+  vtkGetMacro(TotalNumberOfAnalyzedPixels, vtkIdType);
+
+  /// Fill summary table with one row per image pair, with the columns
+  ///   "Image", "Analyzed pixels", "Passed pixels", "Pass fraction (%)", "Mean gamma", "Maximum gamma"
+  void GetSummaryTable(vtkTable* table);
+
+protected:
+  /// Image pair and its results
+  struct ImagePair
+  {
+    ImagePair()
+      : NumberOfAnalyzedPixels(0)
+      , NumberOfPassedPixels(0)
+      , PassFractionPercent(0.0)
+      , MeanGamma(0.0)
+      , LargestGamma(0.0)
+    {
+    }
+    std::string Name;
+    vtkSmartPointer<vtkOrientedImageData> ReferenceImageData;
+    vtkSmartPointer<vtkOrientedImageData> CompareImageData;
+    vtkIdType NumberOfAnalyzedPixels;
+    vtkIdType NumberOfPassedPixels;
+    double PassFractionPercent;
+    double MeanGamma;
+    double LargestGamma;
+    vtkSmartPointer<vtkOrientedImageData> OutputGammaImageData;
+  };
+
+  /// Get pair by index, NULL if the index is invalid
+  ImagePair* GetImagePair(int pairIndex, const char* callerName);
+
+protected:
+  std::vector<ImagePair> ImagePairs;
+
+  double DtaDistanceToleranceMm;
+  double DoseDifferenceTolerancePercent;
+  double ReferenceDoseGy;
+  double AnalysisThresholdPercent;
+  double MaximumGamma;
+  bool LocalDoseDifference;
+  bool DoseThresholdOnReferenceOnly;
+  bool StoreGammaImages;
+  int NumberOfThreads;
+
+  vtkIdType TotalNumberOfAnalyzedPixels;
+
+protected:
+  vtkPlanarGammaBatchFilter();
+  virtual ~vtkPlanarGammaBatchFilter();
+
+private:
+  vtkPlanarGammaBatchFilter(const vtkPlanarGammaBatchFilter&); // Not implemented
+  void operator=(const vtkPlanarGammaBatchFilter&);            // Not implemented
+};
+
+#endif
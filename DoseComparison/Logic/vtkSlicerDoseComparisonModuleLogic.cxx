@@ -21,9 +21,12 @@
 // DoseComparison includes
 #include "vtkSlicerDoseComparisonModuleLogic.h"
 #include "vtkMRMLDoseComparisonNode.h"
+#include "vtkGammaDoseComparisonFilter.h"
+#include "vtkPlanarGammaBatchFilter.h"
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtPerformanceMonitor.h"
 #include "PlmCommon.h"
 
 // Plastimatch includes
@@ -44,6 +47,7 @@
 #include <vtkMRMLScene.h>
 #include <vtkMRMLSubjectHierarchyConstants.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
+#include <vtkMRMLTableNode.h>
 
 // MRMLLogic includes
 #include <vtkMRMLColorLogic.h>
@@ -52,12 +56,18 @@
 
 // VTK includes
 #include <vtkNew.h>
-#include <vtkTimerLog.h>
+#include <vtkCallbackCommand.h>
+#include <vtkCollection.h>
+#include <vtkPointData.h>
+#include <vtkStringArray.h>
 #include <vtkLookupTable.h>
 #include <vtkImageConstantPad.h>
 #include <vtkObjectFactory.h>
 #include "vtksys/SystemTools.hxx"
 
+// STD includes
+#include <sstream>
+
 // SlicerBase includes
 #include "vtkSlicerApplicationLogic.h"
 
@@ -78,6 +88,17 @@ void GammaProgressCallback(float progress)
   }
 }
 
+//---------------------------------------------------------------------------
+void GammaFilterProgressCallback(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eid), void* clientData, void* callData)
+{
+  vtkSlicerDoseComparisonModuleLogic* logic = reinterpret_cast<vtkSlicerDoseComparisonModuleLogic*>(clientData);
+  double* progress = reinterpret_cast<double*>(callData);
+  if (logic && progress)
+  {
+    logic->GammaProgressUpdated(static_cast<float>(*progress));
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseComparisonModuleLogic);
 
@@ -191,105 +212,470 @@ void vtkSlicerDoseComparisonModuleLogic::GammaProgressUpdated(float progress)
 //---------------------------------------------------------------------------
 std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMRMLDoseComparisonNode* parameterNode)
 {
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
-  double checkpointStart = timer->GetUniversalTime();
+  vtkSlicerRtScopedTimer timer("DoseComparison.ComputeGammaDoseDifference", this->LogSpeedMeasurements);
 
   parameterNode->ResultsValidOff();
 
-  double checkpointConvertStart = timer->GetUniversalTime();
+  vtkSlicerRtScopedTimer convertInputTimer("DoseComparison.ComputeGammaDoseDifference.ConvertInputs", this->LogSpeedMeasurements);
   vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = parameterNode->GetReferenceDoseVolumeNode();
-  Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode);
-  Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(parameterNode->GetCompareDoseVolumeNode());
+  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
+  if (gammaVolumeNode == NULL)
+  {
+    std::string errorMessage("Invalid gamma volume node in parameter set node");
+    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+    return errorMessage;
+  }
 
-  Plm_image::Pointer maskVolume;
-  vtkMRMLSegmentationNode* maskSegmentationNode = parameterNode->GetMaskSegmentationNode();
-  const char* maskSegmentID = parameterNode->GetMaskSegmentID();
-  if (maskSegmentationNode && maskSegmentID)
+  vtkSmartPointer<vtkOrientedImageData> maskSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  std::string errorMessage = this->GetMaskSegmentLabelmap(parameterNode, maskSegmentLabelmap);
+  if (!errorMessage.empty())
   {
-    // Extract a labelmap for the dose comparison to use it as a mask
-    vtkSegmentation* maskSegmentation = maskSegmentationNode->GetSegmentation();
-    vtkSegment* maskSegment = maskSegmentation->GetSegment(maskSegmentID);
-    if (!maskSegment)
+    return errorMessage;
+  }
+
+  double gammaSeconds = 0.0;
+  double convertOutputSeconds = 0.0;
+  if (parameterNode->GetUseNativeGammaEngine())
+  {
+    // Compute gamma dose volume
+    convertInputTimer.Stop();
+    vtkSlicerRtScopedTimer gammaTimer("DoseComparison.ComputeGammaDoseDifference.Gamma", this->LogSpeedMeasurements);
+    vtkSmartPointer<vtkGammaDoseComparisonFilter> gammaFilter = vtkSmartPointer<vtkGammaDoseComparisonFilter>::New();
+    gammaFilter->SetDtaDistanceToleranceMm(parameterNode->GetDtaDistanceToleranceMm());
+    gammaFilter->SetDoseDifferenceTolerancePercent(parameterNode->GetDoseDifferenceTolerancePercent());
+    errorMessage = this->RunNativeGammaFilter(parameterNode, maskSegmentLabelmap, gammaFilter);
+    if (!errorMessage.empty())
     {
-      std::string errorMessage("Failed to get mask segment");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
       return errorMessage;
     }
+    parameterNode->SetPassFractionPercent(gammaFilter->GetPassFractionPercent());
+    parameterNode->SetReportString(gammaFilter->GetReportString().c_str());
+
+    gammaTimer.Stop();
+    gammaSeconds = gammaTimer.GetElapsedSeconds();
+    vtkSlicerRtPerformanceMonitor::AddToCounter("DoseComparison.ComputeGammaDoseDifference", "Voxels", gammaFilter->GetNumberOfAnalyzedVoxels());
+
+    // Set output to gamma volume node
+    vtkSlicerRtScopedTimer convertOutputTimer("DoseComparison.ComputeGammaDoseDifference.ConvertOutput", this->LogSpeedMeasurements);
+    vtkSlicerSegmentationsModuleLogic::CopyOrientedImageDataToVolumeNode(gammaFilter->GetOutputGammaImageData(), gammaVolumeNode);
+    convertOutputTimer.Stop();
+    convertOutputSeconds = convertOutputTimer.GetElapsedSeconds();
+  }
+  else
+  {
+    Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode);
+    Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(parameterNode->GetCompareDoseVolumeNode());
 
-    // Temporarily duplicate selected segments to contain binary labelmap of a different geometry (tied to dose volume)
-    vtkSmartPointer<vtkSegmentation> segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
-    segmentationCopy->SetMasterRepresentationName(maskSegmentation->GetMasterRepresentationName());
-    segmentationCopy->CopyConversionParameters(maskSegmentation);
-    segmentationCopy->CopySegmentFromSegmentation(maskSegmentation, maskSegmentID);
-    if (!segmentationCopy->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+    // Convert mask to Plm image
+    Plm_image::Pointer maskVolume;
+    if (maskSegmentLabelmap->GetPointData()->GetScalars())
     {
-      std::string errorMessage("Failed to create binary labelmap representation for mask segment");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
-      return errorMessage;
+      maskVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(maskSegmentLabelmap);
+      if (!maskVolume)
+      {
+        errorMessage = "Failed to convert mask segment labelmap into Plm_image";
+        vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+        return errorMessage;
+      }
     }
-    // Get segment binary labelmap
-    vtkOrientedImageData* maskSegmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(maskSegmentID)->GetRepresentation(
-      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
 
-    // Apply parent transformation nodes if necessary
-    if ( maskSegmentationNode->GetParentTransformNode()
-      && (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(maskSegmentationNode, maskSegmentLabelmap)) )
+    // Compute gamma dose volume
+    convertInputTimer.Stop();
+    vtkSlicerRtScopedTimer gammaTimer("DoseComparison.ComputeGammaDoseDifference.Gamma", this->LogSpeedMeasurements);
+    Gamma_dose_comparison gamma;
+    gamma.set_reference_image(referenceDose->itk_float());
+    gamma.set_compare_image(compareDose->itk_float());
+    if (maskVolume)
     {
-      std::string errorMessage("Failed to apply parent transform on mask segment");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
-      return errorMessage;
+      gamma.set_mask_image(maskVolume->itk_uchar());
     }
+    gamma.set_spatial_tolerance(parameterNode->GetDtaDistanceToleranceMm());
+    gamma.set_dose_difference_tolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
+    gamma.set_resample_nn(!parameterNode->GetUseLinearInterpolation());
+    gamma.set_local_gamma(parameterNode->GetLocalDoseDifference());
+    if (!parameterNode->GetUseMaximumDose())
+    {
+      gamma.set_reference_dose(parameterNode->GetReferenceDoseGy());
+    }
+    gamma.set_analysis_threshold(parameterNode->GetAnalysisThresholdPercent() / 100.0 );
+    gamma.set_gamma_max(parameterNode->GetMaximumGamma());
+    gamma.set_ref_only_threshold(parameterNode->GetDoseThresholdOnReferenceOnly());
+    gamma.set_progress_callback(&GammaProgressCallback);
 
-    // Convert mask to Plm image
-    maskVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(maskSegmentLabelmap);
-    if (!maskVolume)
+    gamma.run();
+
+    itk::Image<float, 3>::Pointer gammaVolumeItk = gamma.get_gamma_image_itk();
+    parameterNode->SetPassFractionPercent( gamma.get_pass_fraction() * 100.0 );
+    parameterNode->SetReportString(gamma.get_report_string().c_str());
+
+    gammaTimer.Stop();
+    gammaSeconds = gammaTimer.GetElapsedSeconds();
+
+    // Convert output to VTK
+    vtkSlicerRtScopedTimer convertOutputTimer("DoseComparison.ComputeGammaDoseDifference.ConvertOutput", this->LogSpeedMeasurements);
+    vtkSlicerRtCommon::ConvertItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT);
+    convertOutputTimer.Stop();
+    convertOutputSeconds = convertOutputTimer.GetElapsedSeconds();
+  }
+
+  errorMessage = this->SetupGammaVolumeNode(parameterNode, gammaVolumeNode);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+
+  // Select as active volume
+  if (this->GetApplicationLogic()!=NULL)
+  {
+    if (this->GetApplicationLogic()->GetSelectionNode()!=NULL)
+    {
+      this->GetApplicationLogic()->GetSelectionNode()->SetReferenceActiveVolumeID(gammaVolumeNode->GetID());
+      this->GetApplicationLogic()->PropagateVolumeSelection();
+    }
+  }
+
+  parameterNode->ResultsValidOn();
+
+  timer.Stop();
+  if (this->LogSpeedMeasurements)
+  {
+    std::cout << "Total gamma computation time: " << timer.GetElapsedSeconds() << " s" << std::endl
+              << "\tConverting input volumes: " << convertInputTimer.GetElapsedSeconds() << " s" << std::endl
+              << "\tGamma computation: " << gammaSeconds << " s" << std::endl
+              << "\tConverting output volume: " << convertOutputSeconds << " s" << std::endl;
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::ComputeMultiCriteriaGammaDoseDifference(vtkMRMLDoseComparisonNode* parameterNode)
+{
+  if (!parameterNode || !this->GetMRMLScene())
+  {
+    std::string errorMessage("Invalid parameter set node or MRML scene");
+    vtkErrorMacro("ComputeMultiCriteriaGammaDoseDifference: " << errorMessage);
+    return errorMessage;
+  }
+  int numberOfCriteria = parameterNode->GetNumberOfGammaCriteria();
+  if (numberOfCriteria == 0)
+  {
+    std::string errorMessage("No gamma criteria are specified");
+    vtkErrorMacro("ComputeMultiCriteriaGammaDoseDifference: " << errorMessage);
+    return errorMessage;
+  }
+  vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = parameterNode->GetReferenceDoseVolumeNode();
+  if (!referenceDoseVolumeNode || !parameterNode->GetCompareDoseVolumeNode())
+  {
+    std::string errorMessage("Invalid input dose volumes");
+    vtkErrorMacro("ComputeMultiCriteriaGammaDoseDifference: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkSlicerRtScopedTimer timer("DoseComparison.ComputeMultiCriteriaGammaDoseDifference", this->LogSpeedMeasurements);
+
+  parameterNode->ResultsValidOff();
+
+  vtkSlicerRtScopedTimer convertInputTimer("DoseComparison.ComputeMultiCriteriaGammaDoseDifference.ConvertInputs", this->LogSpeedMeasurements);
+  vtkSmartPointer<vtkOrientedImageData> maskSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  std::string errorMessage = this->GetMaskSegmentLabelmap(parameterNode, maskSegmentLabelmap);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+
+  convertInputTimer.Stop();
+
+  // Compute gamma for all criteria in one neighborhood traversal
+  vtkSlicerRtScopedTimer gammaTimer("DoseComparison.ComputeMultiCriteriaGammaDoseDifference.Gamma", this->LogSpeedMeasurements);
+  vtkSmartPointer<vtkGammaDoseComparisonFilter> gammaFilter = vtkSmartPointer<vtkGammaDoseComparisonFilter>::New();
+  for (int criterionIndex=0; criterionIndex<numberOfCriteria; ++criterionIndex)
+  {
+    gammaFilter->AddCriterion( parameterNode->GetNthGammaCriterionDtaDistanceToleranceMm(criterionIndex),
+      parameterNode->GetNthGammaCriterionDoseDifferenceTolerancePercent(criterionIndex) );
+  }
+  errorMessage = this->RunNativeGammaFilter(parameterNode, maskSegmentLabelmap, gammaFilter);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+  parameterNode->SetReportString(gammaFilter->GetReportString().c_str());
+  gammaTimer.Stop();
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DoseComparison.ComputeMultiCriteriaGammaDoseDifference", "Voxels", gammaFilter->GetNumberOfAnalyzedVoxels());
+
+  // Set outputs to gamma volume nodes, create the ones that are missing
+  vtkSlicerRtScopedTimer convertOutputTimer("DoseComparison.ComputeMultiCriteriaGammaDoseDifference.ConvertOutput", this->LogSpeedMeasurements);
+  for (int criterionIndex=0; criterionIndex<numberOfCriteria; ++criterionIndex)
+  {
+    parameterNode->SetNthGammaCriterionPassFractionPercent(criterionIndex, gammaFilter->GetPassFractionPercent(criterionIndex));
+
+    vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetNthGammaCriterionVolumeNode(criterionIndex);
+    if (!gammaVolumeNode)
+    {
+      std::stringstream gammaVolumeNameStream;
+      gammaVolumeNameStream << vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_OUTPUT_BASE_NAME_PREFIX << referenceDoseVolumeNode->GetName()
+        << "_" << parameterNode->GetNthGammaCriterionDoseDifferenceTolerancePercent(criterionIndex) << "pct"
+        << parameterNode->GetNthGammaCriterionDtaDistanceToleranceMm(criterionIndex) << "mm";
+      vtkSmartPointer<vtkMRMLScalarVolumeNode> newGammaVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+      newGammaVolumeNode->SetName(this->GetMRMLScene()->GenerateUniqueName(gammaVolumeNameStream.str()).c_str());
+      this->GetMRMLScene()->AddNode(newGammaVolumeNode);
+      parameterNode->SetAndObserveNthGammaCriterionVolumeNode(criterionIndex, newGammaVolumeNode);
+      gammaVolumeNode = newGammaVolumeNode;
+    }
+
+    vtkSlicerSegmentationsModuleLogic::CopyOrientedImageDataToVolumeNode(gammaFilter->GetOutputGammaImageData(criterionIndex), gammaVolumeNode);
+    errorMessage = this->SetupGammaVolumeNode(parameterNode, gammaVolumeNode);
+    if (!errorMessage.empty())
     {
-      std::string errorMessage("Failed to convert mask segment labelmap into Plm_image");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
       return errorMessage;
     }
   }
 
-  // Compute gamma dose volume
-  double checkpointGammaStart = timer->GetUniversalTime();
-  Gamma_dose_comparison gamma;
-  gamma.set_reference_image(referenceDose->itk_float());
-  gamma.set_compare_image(compareDose->itk_float());
-  if (maskSegmentationNode && maskSegmentID)
+  // Set results to report table node
+  vtkMRMLTableNode* tableNode = parameterNode->GetGammaReportTableNode();
+  if (!tableNode)
   {
-    gamma.set_mask_image(maskVolume->itk_uchar());
+    vtkSmartPointer<vtkMRMLTableNode> newTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+    std::string tableNodeName = vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_OUTPUT_BASE_NAME_PREFIX + referenceDoseVolumeNode->GetName() + "_Report";
+    newTableNode->SetName(this->GetMRMLScene()->GenerateUniqueName(tableNodeName).c_str());
+    this->GetMRMLScene()->AddNode(newTableNode);
+    parameterNode->SetAndObserveGammaReportTableNode(newTableNode);
+    tableNode = newTableNode;
   }
-  gamma.set_spatial_tolerance(parameterNode->GetDtaDistanceToleranceMm());
-  gamma.set_dose_difference_tolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
-  gamma.set_resample_nn(!parameterNode->GetUseLinearInterpolation());
-  gamma.set_local_gamma(parameterNode->GetLocalDoseDifference());
-  if (!parameterNode->GetUseMaximumDose())
+  tableNode->SetUseColumnNameAsColumnHeader(true);
+  tableNode->RemoveAllColumns();
+  vtkStringArray* criterionColumn = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+  criterionColumn->SetName("Criterion");
+  vtkStringArray* dtaColumn = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+  dtaColumn->SetName("DTA (mm)");
+  vtkStringArray* doseDifferenceColumn = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+  doseDifferenceColumn->SetName("Dose difference (%)");
+  vtkStringArray* passFractionColumn = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+  passFractionColumn->SetName("Pass fraction (%)");
+  vtkStringArray* passedVoxelsColumn = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+  passedVoxelsColumn->SetName("Passed voxels");
+  vtkStringArray* analyzedVoxelsColumn = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+  analyzedVoxelsColumn->SetName("Analyzed voxels");
+  vtkStringArray* gammaVolumeColumn = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+  gammaVolumeColumn->SetName("Gamma volume");
+  for (int criterionIndex=0; criterionIndex<numberOfCriteria; ++criterionIndex)
   {
-    gamma.set_reference_dose(parameterNode->GetReferenceDoseGy());
+    double dtaDistanceToleranceMm = parameterNode->GetNthGammaCriterionDtaDistanceToleranceMm(criterionIndex);
+    double doseDifferenceTolerancePercent = parameterNode->GetNthGammaCriterionDoseDifferenceTolerancePercent(criterionIndex);
+    std::stringstream criterionStream;
+    criterionStream << doseDifferenceTolerancePercent << "%/" << dtaDistanceToleranceMm << "mm";
+    criterionColumn->InsertNextValue(criterionStream.str());
+    dtaColumn->InsertNextValue(vtkVariant(dtaDistanceToleranceMm).ToString());
+    doseDifferenceColumn->InsertNextValue(vtkVariant(doseDifferenceTolerancePercent).ToString());
+    passFractionColumn->InsertNextValue(vtkVariant(gammaFilter->GetPassFractionPercent(criterionIndex)).ToString());
+    passedVoxelsColumn->InsertNextValue(vtkVariant(gammaFilter->GetNumberOfPassedVoxels(criterionIndex)).ToString());
+    analyzedVoxelsColumn->InsertNextValue(vtkVariant(gammaFilter->GetNumberOfAnalyzedVoxels()).ToString());
+    gammaVolumeColumn->InsertNextValue(parameterNode->GetNthGammaCriterionVolumeNode(criterionIndex)->GetName());
   }
-  gamma.set_analysis_threshold(parameterNode->GetAnalysisThresholdPercent() / 100.0 );
-  gamma.set_gamma_max(parameterNode->GetMaximumGamma());
-  gamma.set_ref_only_threshold(parameterNode->GetDoseThresholdOnReferenceOnly());
-  gamma.set_progress_callback(&GammaProgressCallback);
+  // Trigger UI update
+  tableNode->Modified();
 
-  gamma.run();
+  // Select gamma volume of the first criterion as active volume
+  if (this->GetApplicationLogic()!=NULL)
+  {
+    if (this->GetApplicationLogic()->GetSelectionNode()!=NULL)
+    {
+      this->GetApplicationLogic()->GetSelectionNode()->SetReferenceActiveVolumeID(parameterNode->GetNthGammaCriterionVolumeNode(0)->GetID());
+      this->GetApplicationLogic()->PropagateVolumeSelection();
+    }
+  }
 
-  itk::Image<float, 3>::Pointer gammaVolumeItk = gamma.get_gamma_image_itk();
-  parameterNode->SetPassFractionPercent( gamma.get_pass_fraction() * 100.0 );
-  parameterNode->SetReportString(gamma.get_report_string().c_str());
+  parameterNode->ResultsValidOn();
 
-  // Convert output to VTK
-  double checkpointVtkConvertStart = timer->GetUniversalTime();
+  convertOutputTimer.Stop();
+  timer.Stop();
+  if (this->LogSpeedMeasurements)
+  {
+    std::cout << "Total multi-criteria gamma computation time (" << numberOfCriteria << " criteria): " << timer.GetElapsedSeconds() << " s" << std::endl
+              << "\tApplying transforms: " << convertInputTimer.GetElapsedSeconds() << " s" << std::endl
+              << "\tGamma computation: " << gammaTimer.GetElapsedSeconds() << " s" << std::endl
+              << "\tSetting output volumes and table: " << convertOutputTimer.GetElapsedSeconds() << " s" << std::endl;
+  }
 
-  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
-  if (gammaVolumeNode == NULL)
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::ComputePlanarGammaBatch(vtkMRMLDoseComparisonNode* parameterNode,
+  vtkCollection* referenceImageNodes, vtkCollection* compareImageNodes, vtkMRMLTableNode* summaryTableNode)
+{
+  if (!parameterNode || !referenceImageNodes || !compareImageNodes || !summaryTableNode || !summaryTableNode->GetTable())
   {
-    std::string errorMessage("Invalid gamma volume node in parameter set node");
-    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+    std::string errorMessage("Invalid parameter set node, image collections or summary table node");
+    vtkErrorMacro("ComputePlanarGammaBatch: " << errorMessage);
+    return errorMessage;
+  }
+  int numberOfPairs = referenceImageNodes->GetNumberOfItems();
+  if (numberOfPairs == 0 || compareImageNodes->GetNumberOfItems() != numberOfPairs)
+  {
+    std::stringstream errorMessageStream;
+    errorMessageStream << "Number of reference and compare images do not match or are zero ("
+      << numberOfPairs << "<>" << compareImageNodes->GetNumberOfItems() << ")";
+    vtkErrorMacro("ComputePlanarGammaBatch: " << errorMessageStream.str());
+    return errorMessageStream.str();
+  }
+
+  vtkSlicerRtScopedTimer timer("DoseComparison.ComputePlanarGammaBatch", this->LogSpeedMeasurements);
+
+  // Get the images with parent transforms applied
+  vtkSmartPointer<vtkPlanarGammaBatchFilter> gammaFilter = vtkSmartPointer<vtkPlanarGammaBatchFilter>::New();
+  for (int pairIndex=0; pairIndex<numberOfPairs; ++pairIndex)
+  {
+    vtkMRMLScalarVolumeNode* referenceImageNode = vtkMRMLScalarVolumeNode::SafeDownCast(referenceImageNodes->GetItemAsObject(pairIndex));
+    vtkMRMLScalarVolumeNode* compareImageNode = vtkMRMLScalarVolumeNode::SafeDownCast(compareImageNodes->GetItemAsObject(pairIndex));
+    vtkSmartPointer<vtkOrientedImageData> referenceImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+    vtkSmartPointer<vtkOrientedImageData> compareImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+    if ( !referenceImageNode || !compareImageNode
+      || !vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(referenceImageNode, referenceImageData)
+      || !vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(compareImageNode, compareImageData) )
+    {
+      std::stringstream errorMessageStream;
+      errorMessageStream << "Failed to access images of pair " << pairIndex;
+      vtkErrorMacro("ComputePlanarGammaBatch: " << errorMessageStream.str());
+      return errorMessageStream.str();
+    }
+    gammaFilter->AddImagePair(referenceImageData, compareImageData, referenceImageNode->GetName());
+  }
+
+  gammaFilter->SetDtaDistanceToleranceMm(parameterNode->GetDtaDistanceToleranceMm());
+  gammaFilter->SetDoseDifferenceTolerancePercent(parameterNode->GetDoseDifferenceTolerancePercent());
+  gammaFilter->SetReferenceDoseGy(parameterNode->GetUseMaximumDose() ? 0.0 : parameterNode->GetReferenceDoseGy());
+  gammaFilter->SetAnalysisThresholdPercent(parameterNode->GetAnalysisThresholdPercent());
+  gammaFilter->SetMaximumGamma(parameterNode->GetMaximumGamma());
+  gammaFilter->SetLocalDoseDifference(parameterNode->GetLocalDoseDifference());
+  gammaFilter->SetDoseThresholdOnReferenceOnly(parameterNode->GetDoseThresholdOnReferenceOnly());
+  gammaFilter->SetNumberOfThreads(parameterNode->GetNumberOfThreads());
+  vtkSmartPointer<vtkCallbackCommand> progressCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+  progressCallback->SetCallback(&GammaFilterProgressCallback);
+  progressCallback->SetClientData(this);
+  gammaFilter->AddObserver(vtkCommand::ProgressEvent, progressCallback);
+  bool success = gammaFilter->Update();
+  gammaFilter->RemoveObserver(progressCallback);
+  if (!success)
+  {
+    std::string errorMessage("Planar gamma computation failed");
+    vtkErrorMacro("ComputePlanarGammaBatch: " << errorMessage);
     return errorMessage;
   }
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DoseComparison.ComputePlanarGammaBatch", "Pixels", gammaFilter->GetTotalNumberOfAnalyzedPixels());
 
-  vtkSlicerRtCommon::ConvertItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT);
+  gammaFilter->GetSummaryTable(summaryTableNode->GetTable());
+  summaryTableNode->SetUseColumnNameAsColumnHeader(true);
+  // Trigger UI update
+  summaryTableNode->Modified();
+
+  timer.Stop();
+  if (this->LogSpeedMeasurements)
+  {
+    std::cout << "Planar gamma computation time (" << numberOfPairs << " image pairs): " << timer.GetElapsedSeconds() << " s" << std::endl;
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::GetMaskSegmentLabelmap(vtkMRMLDoseComparisonNode* parameterNode, vtkOrientedImageData* maskLabelmap)
+{
+  vtkMRMLSegmentationNode* maskSegmentationNode = parameterNode->GetMaskSegmentationNode();
+  const char* maskSegmentID = parameterNode->GetMaskSegmentID();
+  if (!maskSegmentationNode || !maskSegmentID)
+  {
+    // No mask is used
+    return "";
+  }
+
+  // Extract a labelmap for the dose comparison to use it as a mask
+  vtkSegmentation* maskSegmentation = maskSegmentationNode->GetSegmentation();
+  vtkSegment* maskSegment = maskSegmentation->GetSegment(maskSegmentID);
+  if (!maskSegment)
+  {
+    std::string errorMessage("Failed to get mask segment");
+    vtkErrorMacro("GetMaskSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Temporarily duplicate selected segments to contain binary labelmap of a different geometry (tied to dose volume)
+  vtkSmartPointer<vtkSegmentation> segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
+  segmentationCopy->SetMasterRepresentationName(maskSegmentation->GetMasterRepresentationName());
+  segmentationCopy->CopyConversionParameters(maskSegmentation);
+  segmentationCopy->CopySegmentFromSegmentation(maskSegmentation, maskSegmentID);
+  if (!segmentationCopy->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName()))
+  {
+    std::string errorMessage("Failed to create binary labelmap representation for mask segment");
+    vtkErrorMacro("GetMaskSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+  // Get segment binary labelmap
+  vtkOrientedImageData* maskSegmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(maskSegmentID)->GetRepresentation(
+    vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
+  maskLabelmap->ShallowCopy(maskSegmentLabelmap);
+
+  // Apply parent transformation nodes if necessary
+  if ( maskSegmentationNode->GetParentTransformNode()
+    && (!vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(maskSegmentationNode, maskLabelmap)) )
+  {
+    std::string errorMessage("Failed to apply parent transform on mask segment");
+    vtkErrorMacro("GetMaskSegmentLabelmap: " << errorMessage);
+    return errorMessage;
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::RunNativeGammaFilter(
+  vtkMRMLDoseComparisonNode* parameterNode, vtkOrientedImageData* maskLabelmap, vtkGammaDoseComparisonFilter* gammaFilter )
+{
+  // Native engine samples the compare dose in its own geometry, so only the parent transforms need to be applied
+  vtkSmartPointer<vtkOrientedImageData> referenceDoseImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+  vtkSmartPointer<vtkOrientedImageData> compareDoseImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+  if ( !vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(parameterNode->GetReferenceDoseVolumeNode(), referenceDoseImageData)
+    || !vtkSlicerRtCommon::ConvertVolumeNodeToVtkOrientedImageData(parameterNode->GetCompareDoseVolumeNode(), compareDoseImageData) )
+  {
+    std::string errorMessage("Failed to access input dose volumes");
+    vtkErrorMacro("RunNativeGammaFilter: " << errorMessage);
+    return errorMessage;
+  }
+
+  gammaFilter->SetReferenceDoseImageData(referenceDoseImageData);
+  gammaFilter->SetCompareDoseImageData(compareDoseImageData);
+  if (maskLabelmap && maskLabelmap->GetPointData()->GetScalars())
+  {
+    gammaFilter->SetMaskImageData(maskLabelmap);
+  }
+  gammaFilter->SetReferenceDoseGy(parameterNode->GetUseMaximumDose() ? 0.0 : parameterNode->GetReferenceDoseGy());
+  gammaFilter->SetAnalysisThresholdPercent(parameterNode->GetAnalysisThresholdPercent());
+  gammaFilter->SetMaximumGamma(parameterNode->GetMaximumGamma());
+  gammaFilter->SetLocalDoseDifference(parameterNode->GetLocalDoseDifference());
+  gammaFilter->SetDoseThresholdOnReferenceOnly(parameterNode->GetDoseThresholdOnReferenceOnly());
+  gammaFilter->SetUseLinearInterpolation(parameterNode->GetUseLinearInterpolation());
+  gammaFilter->SetSubvoxelSamplingFactor(parameterNode->GetSubvoxelSamplingFactor());
+  gammaFilter->SetNumberOfThreads(parameterNode->GetNumberOfThreads());
+  vtkSmartPointer<vtkCallbackCommand> progressCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+  progressCallback->SetCallback(&GammaFilterProgressCallback);
+  progressCallback->SetClientData(this);
+  gammaFilter->AddObserver(vtkCommand::ProgressEvent, progressCallback);
+  gammaFilter->Update();
+  gammaFilter->RemoveObserver(progressCallback);
+
+  if (gammaFilter->GetReportString().empty())
+  {
+    std::string errorMessage("Gamma computation failed");
+    vtkErrorMacro("RunNativeGammaFilter: " << errorMessage);
+    return errorMessage;
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::SetupGammaVolumeNode(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode)
+{
   gammaVolumeNode->SetAttribute(vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_GAMMA_VOLUME_IDENTIFIER_ATTRIBUTE_NAME, "1");
 
   // Set default colormap to red
@@ -312,21 +698,21 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
     }
     else
     {
-      vtkWarningMacro("ComputeGammaDoseDifference: Loading gamma color table failed, stock color table is used!");
+      vtkWarningMacro("SetupGammaVolumeNode: Loading gamma color table failed, stock color table is used!");
       gammaScalarVolumeDisplayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeRainbow");
     }
   }
   else
   {
-    vtkWarningMacro("ComputeGammaDoseDifference: Display node is not available for gamma volume node. The default color table will be used.");
+    vtkWarningMacro("SetupGammaVolumeNode: Display node is not available for gamma volume node. The default color table will be used.");
   }
 
   // Get common ancestor of the two input dose volumes in subject hierarchy
   vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->GetMRMLScene());
   if (!shNode)
   {
-    std::string errorMessage("");
-    vtkErrorMacro("ComputeGammaDoseDifference: Failed to access subject hierarchy node" << errorMessage);
+    std::string errorMessage("Failed to access subject hierarchy node");
+    vtkErrorMacro("SetupGammaVolumeNode: " << errorMessage);
     return errorMessage;
   }
   vtkIdType commonAncestorItemID = vtkSlicerSubjectHierarchyModuleLogic::AreNodesInSameBranch(
@@ -346,28 +732,6 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
   gammaVolumeNode->AddNodeReferenceID( vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_COMPARE_DOSE_VOLUME_REFERENCE_ROLE.c_str(),
     parameterNode->GetCompareDoseVolumeNode()->GetID() );
 
-  // Select as active volume
-  if (this->GetApplicationLogic()!=NULL)
-  {
-    if (this->GetApplicationLogic()->GetSelectionNode()!=NULL)
-    {
-      this->GetApplicationLogic()->GetSelectionNode()->SetReferenceActiveVolumeID(gammaVolumeNode->GetID());
-      this->GetApplicationLogic()->PropagateVolumeSelection();
-    }
-  }
-
-  parameterNode->ResultsValidOn();
-
-  if (this->LogSpeedMeasurements)
-  {
-    double checkpointEnd = timer->GetUniversalTime();
-    std::cout << "Total gamma computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
-              << "\tApplying transforms: " << checkpointConvertStart-checkpointStart << " s" << std::endl
-              << "\tConverting from VTK to ITK: " << checkpointGammaStart-checkpointConvertStart << " s" << std::endl
-              << "\tGamma computation: " << checkpointVtkConvertStart-checkpointGammaStart << " s" << std::endl
-              << "\tConverting back from ITK to VTK: " << checkpointEnd-checkpointVtkConvertStart << " s" << std::endl;
-  }
-
   return "";
 }
 
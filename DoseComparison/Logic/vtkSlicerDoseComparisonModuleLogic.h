@@ -32,7 +32,12 @@
 
 #include "vtkSlicerDoseComparisonModuleLogicExport.h"
 
+class vtkCollection;
 class vtkMRMLDoseComparisonNode;
+class vtkMRMLScalarVolumeNode;
+class vtkMRMLTableNode;
+class vtkGammaDoseComparisonFilter;
+class vtkOrientedImageData;
 
 /// \ingroup SlicerRt_QtModules_DoseComparison
 class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkSlicerDoseComparisonModuleLogic :
@@ -55,6 +60,20 @@ public:
   /// \return Error message, empty string if no error
   std::string ComputeGammaDoseDifference(vtkMRMLDoseComparisonNode* parameterNode);
 
+  /// Compute gamma metric for all criteria of the parameter set node in a single pass using the native gamma engine.
+  /// One gamma volume (created if not set) and pass fraction is output for each criterion, and the results of
+  /// all criteria are written to the gamma report table node (created if not set)
+  /// \return Error message, empty string if no error
+  std::string ComputeMultiCriteriaGammaDoseDifference(vtkMRMLDoseComparisonNode* parameterNode);
+
+  /// Compute 2D gamma for a batch of planar image pairs (such as RT images from portal dosimetry) in parallel.
+  /// The ith node in referenceImageNodes is compared to the ith node in compareImageNodes. Tolerances and analysis
+  /// parameters are taken from the parameter set node, its input volume and output references are not used.
+  /// The summary table gets one row per pair (see \sa vtkPlanarGammaBatchFilter::GetSummaryTable)
+  /// \return Error message, empty string if no error
+  std::string ComputePlanarGammaBatch(vtkMRMLDoseComparisonNode* parameterNode,
+    vtkCollection* referenceImageNodes, vtkCollection* compareImageNodes, vtkMRMLTableNode* summaryTableNode);
+
   /// Function called when gamma progress is updated by algorithm
   void GammaProgressUpdated(float progress);
 
@@ -66,6 +85,20 @@ protected:
   /// Loads default gamma color table from the supplied color table file
   void LoadDefaultGammaColorTable();
 
+  /// Get binary labelmap of the mask segment with parent transforms applied.
+  /// If no mask is selected, then the labelmap is left empty
+  /// \return Error message, empty string if no error
+  std::string GetMaskSegmentLabelmap(vtkMRMLDoseComparisonNode* parameterNode, vtkOrientedImageData* maskLabelmap);
+
+  /// Set input dose images and common parameters to the native gamma filter and run it.
+  /// Tolerances (single pair or criteria) need to be set by the caller
+  /// \return Error message, empty string if no error
+  std::string RunNativeGammaFilter(vtkMRMLDoseComparisonNode* parameterNode, vtkOrientedImageData* maskLabelmap, vtkGammaDoseComparisonFilter* gammaFilter);
+
+  /// Set up display, subject hierarchy item and input references of a computed gamma volume
+  /// \return Error message, empty string if no error
+  std::string SetupGammaVolumeNode(vtkMRMLDoseComparisonNode* parameterNode, vtkMRMLScalarVolumeNode* gammaVolumeNode);
+
 public:
   vtkGetMacro(LogSpeedMeasurements, bool);
   vtkSetMacro(LogSpeedMeasurements, bool);
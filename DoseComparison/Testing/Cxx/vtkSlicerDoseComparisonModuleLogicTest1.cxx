@@ -30,12 +30,15 @@
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkNew.h>
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageMathematics.h>
+#include <vtkExtractVOI.h>
+#include <vtkImageResample.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -43,6 +46,61 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+//-----------------------------------------------------------------------------
+/// Create a planar volume node from a slice of a volume, optionally scaling its values
+vtkMRMLScalarVolumeNode* CreatePlanarVolumeNode(vtkMRMLScene* scene, vtkMRMLScalarVolumeNode* volumeNode, int slice, double scale, const char* name)
+{
+  int extent[6] = {0, -1, 0, -1, 0, -1};
+  volumeNode->GetImageData()->GetExtent(extent);
+  vtkSmartPointer<vtkExtractVOI> extractSlice = vtkSmartPointer<vtkExtractVOI>::New();
+  extractSlice->SetInputData(volumeNode->GetImageData());
+  extractSlice->SetVOI(extent[0], extent[1], extent[2], extent[3], slice, slice);
+  vtkSmartPointer<vtkImageMathematics> scaleSlice = vtkSmartPointer<vtkImageMathematics>::New();
+  scaleSlice->SetInputConnection(extractSlice->GetOutputPort());
+  scaleSlice->SetOperationToMultiplyByK();
+  scaleSlice->SetConstantK(scale);
+  scaleSlice->Update();
+
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> planarVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  planarVolumeNode->SetName(name);
+  vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  volumeNode->GetIJKToRASMatrix(ijkToRasMatrix);
+  planarVolumeNode->SetIJKToRASMatrix(ijkToRasMatrix);
+  planarVolumeNode->SetAndObserveImageData(scaleSlice->GetOutput());
+  scene->AddNode(planarVolumeNode);
+  return planarVolumeNode;
+}
+
+//-----------------------------------------------------------------------------
+/// Create a planar volume node covering the same area as a planar volume node with twice the in-plane resolution.
+/// Every second pixel of the new node is a pixel of the original node, so resampling to the original grid restores the original image.
+vtkMRMLScalarVolumeNode* CreateUpsampledPlanarVolumeNode(vtkMRMLScene* scene, vtkMRMLScalarVolumeNode* planarVolumeNode, const char* name)
+{
+  vtkSmartPointer<vtkImageResample> upsampleSlice = vtkSmartPointer<vtkImageResample>::New();
+  upsampleSlice->SetInputData(planarVolumeNode->GetImageData());
+  upsampleSlice->SetAxisMagnificationFactor(0, 2.0);
+  upsampleSlice->SetAxisMagnificationFactor(1, 2.0);
+  upsampleSlice->SetInterpolationModeToLinear();
+  upsampleSlice->Update();
+  vtkSmartPointer<vtkImageData> upsampledImageData = vtkSmartPointer<vtkImageData>::New();
+  upsampledImageData->ShallowCopy(upsampleSlice->GetOutput());
+  upsampledImageData->SetSpacing(1.0, 1.0, 1.0);
+
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> upsampledVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  upsampledVolumeNode->SetName(name);
+  vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  planarVolumeNode->GetIJKToRASMatrix(ijkToRasMatrix);
+  for (int row=0; row<3; ++row)
+  {
+    ijkToRasMatrix->SetElement(row, 0, ijkToRasMatrix->GetElement(row, 0) * 0.5);
+    ijkToRasMatrix->SetElement(row, 1, ijkToRasMatrix->GetElement(row, 1) * 0.5);
+  }
+  upsampledVolumeNode->SetIJKToRASMatrix(ijkToRasMatrix);
+  upsampledVolumeNode->SetAndObserveImageData(upsampledImageData);
+  scene->AddNode(upsampledVolumeNode);
+  return upsampledVolumeNode;
+}
+
 //-----------------------------------------------------------------------------
 int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
 {
@@ -182,5 +240,139 @@ int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // Compute gamma with the native engine and compare pass fraction with the plastimatch result
+  double plastimatchPassFractionPercent = paramNode->GetPassFractionPercent();
+
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> nativeGammaVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  nativeGammaVolumeNode->SetName("OutputDoseNative");
+  mrmlScene->AddNode(nativeGammaVolumeNode);
+  paramNode->SetAndObserveGammaVolumeNode(nativeGammaVolumeNode);
+  paramNode->UseNativeGammaEngineOn();
+
+  std::string errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  if (!errorMessage.empty())
+  {
+    errorStream << "ERROR: Native gamma computation failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double nativePassFractionPercent = paramNode->GetPassFractionPercent();
+  outputStream << "Pass fraction: plastimatch " << plastimatchPassFractionPercent << "%, native " << nativePassFractionPercent << "%" << std::endl;
+  const double passFractionTolerancePercent = 1.0;
+  if (fabs(nativePassFractionPercent - plastimatchPassFractionPercent) > passFractionTolerancePercent)
+  {
+    errorStream << "ERROR: Native gamma pass fraction (" << nativePassFractionPercent
+      << "%) differs from plastimatch pass fraction (" << plastimatchPassFractionPercent
+      << "%) by more than " << passFractionTolerancePercent << "%" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Compute multiple criteria in one pass. The criterion matching the single computation has to give the same result
+  paramNode->AddGammaCriterion(paramNode->GetDtaDistanceToleranceMm(), paramNode->GetDoseDifferenceTolerancePercent());
+  paramNode->AddGammaCriterion(2.0, 2.0);
+  paramNode->AddGammaCriterion(1.0, 1.0);
+  errorMessage = doseComparisonLogic->ComputeMultiCriteriaGammaDoseDifference(paramNode);
+  if (!errorMessage.empty())
+  {
+    errorStream << "ERROR: Multi-criteria gamma computation failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!paramNode->GetGammaReportTableNode() || paramNode->GetGammaReportTableNode()->GetNumberOfRows() != 3)
+  {
+    errorStream << "ERROR: Invalid multi-criteria gamma report table!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int criterionIndex=0; criterionIndex<paramNode->GetNumberOfGammaCriteria(); ++criterionIndex)
+  {
+    outputStream << "Pass fraction for criterion " << paramNode->GetNthGammaCriterionDoseDifferenceTolerancePercent(criterionIndex) << "%/"
+      << paramNode->GetNthGammaCriterionDtaDistanceToleranceMm(criterionIndex) << "mm: "
+      << paramNode->GetNthGammaCriterionPassFractionPercent(criterionIndex) << "%" << std::endl;
+    if (!paramNode->GetNthGammaCriterionVolumeNode(criterionIndex))
+    {
+      errorStream << "ERROR: Missing gamma volume for criterion " << criterionIndex << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (fabs(paramNode->GetNthGammaCriterionPassFractionPercent(0) - nativePassFractionPercent) > 1e-6)
+  {
+    errorStream << "ERROR: Multi-criteria pass fraction (" << paramNode->GetNthGammaCriterionPassFractionPercent(0)
+      << "%) differs from single criterion pass fraction (" << nativePassFractionPercent << "%)" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( paramNode->GetNthGammaCriterionPassFractionPercent(1) > paramNode->GetNthGammaCriterionPassFractionPercent(0)
+    || paramNode->GetNthGammaCriterionPassFractionPercent(2) > paramNode->GetNthGammaCriterionPassFractionPercent(1) )
+  {
+    errorStream << "ERROR: Pass fraction is expected to decrease with stricter criteria!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Planar gamma batch on slices of the day 1 dose: a slice compared to itself has to pass everywhere,
+  // and a slice compared to its scaled copy has to give the same pass fraction as the 3D native engine.
+  // A compare image with a different geometry is resampled to the reference grid, which has to restore the reference slice
+  int day1Extent[6] = {0, -1, 0, -1, 0, -1};
+  day1DoseScalarVolumeNode->GetImageData()->GetExtent(day1Extent);
+  int middleSlice = (day1Extent[4] + day1Extent[5]) / 2;
+  vtkMRMLScalarVolumeNode* planarReferenceNode = CreatePlanarVolumeNode(mrmlScene, day1DoseScalarVolumeNode, middleSlice, 1.0, "PlanarReference");
+  vtkMRMLScalarVolumeNode* planarCompareNode = CreatePlanarVolumeNode(mrmlScene, day1DoseScalarVolumeNode, middleSlice, 1.05, "PlanarCompare");
+  vtkMRMLScalarVolumeNode* planarUpsampledNode = CreateUpsampledPlanarVolumeNode(mrmlScene, planarReferenceNode, "PlanarUpsampled");
+  vtkSmartPointer<vtkCollection> referenceImageNodes = vtkSmartPointer<vtkCollection>::New();
+  vtkSmartPointer<vtkCollection> compareImageNodes = vtkSmartPointer<vtkCollection>::New();
+  referenceImageNodes->AddItem(planarReferenceNode);
+  compareImageNodes->AddItem(planarReferenceNode);
+  referenceImageNodes->AddItem(planarReferenceNode);
+  compareImageNodes->AddItem(planarCompareNode);
+  referenceImageNodes->AddItem(planarReferenceNode);
+  compareImageNodes->AddItem(planarUpsampledNode);
+  vtkSmartPointer<vtkMRMLTableNode> planarGammaTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  mrmlScene->AddNode(planarGammaTableNode);
+  errorMessage = doseComparisonLogic->ComputePlanarGammaBatch(paramNode, referenceImageNodes, compareImageNodes, planarGammaTableNode);
+  if (!errorMessage.empty())
+  {
+    errorStream << "ERROR: Planar gamma batch computation failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (planarGammaTableNode->GetNumberOfRows() != 3)
+  {
+    errorStream << "ERROR: Invalid planar gamma summary table!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  double identicalPassFractionPercent = planarGammaTableNode->GetTable()->GetValueByName(0, "Pass fraction (%)").ToDouble();
+  double scaledPassFractionPercent = planarGammaTableNode->GetTable()->GetValueByName(1, "Pass fraction (%)").ToDouble();
+  outputStream << "Planar pass fraction: identical " << identicalPassFractionPercent << "%, scaled " << scaledPassFractionPercent << "%" << std::endl;
+  if ( planarGammaTableNode->GetTable()->GetValueByName(0, "Analyzed pixels").ToDouble() == 0.0
+    || identicalPassFractionPercent != 100.0 || planarGammaTableNode->GetTable()->GetValueByName(0, "Maximum gamma").ToDouble() != 0.0 )
+  {
+    errorStream << "ERROR: Planar gamma of identical images is expected to be zero everywhere!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Resampled values differ from the reference only by rounding
+  const double resampledMaximumGammaTolerance = 1e-3;
+  double resampledPassFractionPercent = planarGammaTableNode->GetTable()->GetValueByName(2, "Pass fraction (%)").ToDouble();
+  double resampledMaximumGamma = planarGammaTableNode->GetTable()->GetValueByName(2, "Maximum gamma").ToDouble();
+  outputStream << "Planar pass fraction: resampled " << resampledPassFractionPercent << "%, maximum gamma " << resampledMaximumGamma << std::endl;
+  if ( planarGammaTableNode->GetTable()->GetValueByName(2, "Analyzed pixels").ToDouble() != planarGammaTableNode->GetTable()->GetValueByName(0, "Analyzed pixels").ToDouble()
+    || resampledPassFractionPercent != 100.0 || resampledMaximumGamma > resampledMaximumGammaTolerance )
+  {
+    errorStream << "ERROR: Planar gamma of a compare image resampled from a finer grid is expected to be zero everywhere!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  paramNode->SetAndObserveReferenceDoseVolumeNode(planarReferenceNode);
+  paramNode->SetAndObserveCompareDoseVolumeNode(planarCompareNode);
+  errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  if (!errorMessage.empty())
+  {
+    errorStream << "ERROR: Native gamma computation on planar images failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Small tolerance for the single precision arithmetic of the planar search
+  const double planarPassFractionTolerancePercent = 0.1;
+  if (fabs(paramNode->GetPassFractionPercent() - scaledPassFractionPercent) > planarPassFractionTolerancePercent)
+  {
+    errorStream << "ERROR: Planar gamma pass fraction (" << scaledPassFractionPercent
+      << "%) differs from native gamma pass fraction on the same images (" << paramNode->GetPassFractionPercent() << "%)" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
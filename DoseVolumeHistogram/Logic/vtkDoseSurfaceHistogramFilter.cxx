@@ -0,0 +1,483 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkDoseSurfaceHistogramFilter.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkIdList.h>
+#include <vtkImageCast.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataNormals.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+#include <vtkSmartPointer.h>
+#include <vtkTriangleFilter.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Maximum number of subdivisions along a triangle edge, limiting the number of samples on very large triangles
+  const int DSH_MAXIMUM_TRIANGLE_SUBDIVISIONS = 64;
+
+  /// Tolerance for considering a continuous index inside an image
+  const double DSH_INDEX_TOLERANCE = 1e-4;
+
+  //----------------------------------------------------------------------------
+  /// Sums accumulated separately by each thread
+  struct SurfaceDoseStatistics
+  {
+    SurfaceDoseStatistics()
+      : SampledArea(0.0)
+      , TotalArea(0.0)
+      , WeightedDoseSum(0.0)
+      , NumberOfSamples(0)
+      , Minimum(std::numeric_limits<double>::max())
+      , Maximum(-std::numeric_limits<double>::max())
+      , AreaBelowHistogramOrigin(0.0)
+    {
+    }
+
+    void Reset(int numberOfBins)
+    {
+      *this = SurfaceDoseStatistics();
+      this->Histogram.assign(numberOfBins, 0.0);
+    }
+
+    double SampledArea;
+    double TotalArea;
+    double WeightedDoseSum;
+    vtkIdType NumberOfSamples;
+    double Minimum;
+    double Maximum;
+    double AreaBelowHistogramOrigin;
+    std::vector<double> Histogram;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Samples the dose on a range of triangles
+  class SurfaceDoseSamplingFunctor
+  {
+  public:
+    SurfaceDoseSamplingFunctor()
+      : Surface(NULL)
+      , TriangleIds(NULL)
+      , Scalars(NULL)
+      , SurfaceOffset(0.0)
+      , SampleSpacing(1.0)
+      , HistogramOrigin(0.0)
+      , HistogramBinSpacing(1.0)
+      , NumberOfHistogramBins(0)
+    {
+    }
+
+    void Initialize()
+    {
+      this->Statistics.Local().Reset(this->NumberOfHistogramBins);
+    }
+
+    void operator()(vtkIdType beginTriangle, vtkIdType endTriangle)
+    {
+      SurfaceDoseStatistics& statistics = this->Statistics.Local();
+      double p0[3] = {0.0, 0.0, 0.0};
+      double p1[3] = {0.0, 0.0, 0.0};
+      double p2[3] = {0.0, 0.0, 0.0};
+      double edge1[3] = {0.0, 0.0, 0.0};
+      double edge2[3] = {0.0, 0.0, 0.0};
+      double normal[3] = {0.0, 0.0, 0.0};
+      double point[3] = {0.0, 0.0, 0.0};
+      for (vtkIdType triangleIndex=beginTriangle; triangleIndex<endTriangle; ++triangleIndex)
+      {
+        const vtkIdType* pointIds = &((*this->TriangleIds)[3*triangleIndex]);
+        this->Surface->GetPoint(pointIds[0], p0);
+        this->Surface->GetPoint(pointIds[1], p1);
+        this->Surface->GetPoint(pointIds[2], p2);
+        for (int axis=0; axis<3; ++axis)
+        {
+          edge1[axis] = p1[axis] - p0[axis];
+          edge2[axis] = p2[axis] - p0[axis];
+        }
+        vtkMath::Cross(edge1, edge2, normal);
+        double normalLength = vtkMath::Norm(normal);
+        if (normalLength <= 0.0)
+        {
+          // Degenerate triangle
+          continue;
+        }
+        const double area = 0.5 * normalLength;
+        statistics.TotalArea += area;
+
+        // Shift the triangle along its normal. The winding of the triangles is made consistent and outward facing
+        // before sampling, so a negative offset moves the samples inside the structure
+        double offset[3] = {0.0, 0.0, 0.0};
+        if (this->SurfaceOffset != 0.0)
+        {
+          for (int axis=0; axis<3; ++axis)
+          {
+            offset[axis] = normal[axis] / normalLength * this->SurfaceOffset;
+          }
+        }
+
+        // Subdivide the triangle uniformly so that samples are not farther than the sample spacing
+        double longestEdge = std::max( std::max(vtkMath::Distance2BetweenPoints(p0, p1),
+          vtkMath::Distance2BetweenPoints(p1, p2)), vtkMath::Distance2BetweenPoints(p2, p0) );
+        longestEdge = std::sqrt(longestEdge);
+        int subdivisions = static_cast<int>(std::ceil(longestEdge / this->SampleSpacing));
+        subdivisions = std::max(1, std::min(subdivisions, DSH_MAXIMUM_TRIANGLE_SUBDIVISIONS));
+        const double subTriangleArea = area / (subdivisions * subdivisions);
+        const double inverseSubdivisions = 1.0 / subdivisions;
+
+        // Sample the centroids of the sub-triangles. Upward facing sub-triangles have centroids at barycentric
+        // coordinates (i+1/3, j+1/3)/n, downward facing ones (i+2/3, j+2/3)/n
+        for (int i=0; i<subdivisions; ++i)
+        {
+          for (int j=0; j<subdivisions-i; ++j)
+          {
+            for (int orientation=0; orientation<2; ++orientation)
+            {
+              if (orientation == 1 && i+j >= subdivisions-1)
+              {
+                break;
+              }
+              const double shift = (orientation == 0 ? 1.0/3.0 : 2.0/3.0);
+              const double u = (i + shift) * inverseSubdivisions;
+              const double v = (j + shift) * inverseSubdivisions;
+              for (int axis=0; axis<3; ++axis)
+              {
+                point[axis] = p0[axis] + u*edge1[axis] + v*edge2[axis] + offset[axis];
+              }
+              double dose = 0.0;
+              if (!this->SampleDose(point, dose))
+              {
+                continue;
+              }
+              this->AddSample(statistics, dose, subTriangleArea);
+            }
+          }
+        }
+      }
+    }
+
+    void Reduce()
+    {
+      this->Total.Reset(this->NumberOfHistogramBins);
+      for (vtkSMPThreadLocal<SurfaceDoseStatistics>::iterator it = this->Statistics.begin(); it != this->Statistics.end(); ++it)
+      {
+        this->Total.SampledArea += it->SampledArea;
+        this->Total.TotalArea += it->TotalArea;
+        this->Total.WeightedDoseSum += it->WeightedDoseSum;
+        this->Total.NumberOfSamples += it->NumberOfSamples;
+        this->Total.Minimum = std::min(this->Total.Minimum, it->Minimum);
+        this->Total.Maximum = std::max(this->Total.Maximum, it->Maximum);
+        this->Total.AreaBelowHistogramOrigin += it->AreaBelowHistogramOrigin;
+        for (size_t binIndex=0; binIndex<it->Histogram.size() && binIndex<this->Total.Histogram.size(); ++binIndex)
+        {
+          this->Total.Histogram[binIndex] += it->Histogram[binIndex];
+        }
+      }
+    }
+
+  protected:
+    /// Sample the dose with trilinear interpolation at a world position
+    /// \return False if the position is outside the dose volume
+    bool SampleDose(const double worldPosition[3], double& dose) const
+    {
+      int lower[3] = {0, 0, 0};
+      int upper[3] = {0, 0, 0};
+      double weight[3] = {0.0, 0.0, 0.0};
+      for (int axis=0; axis<3; ++axis)
+      {
+        double position = this->WorldToIjk[axis][0]*worldPosition[0] + this->WorldToIjk[axis][1]*worldPosition[1]
+          + this->WorldToIjk[axis][2]*worldPosition[2] + this->WorldToIjk[axis][3] - this->Extent[2*axis];
+        int lastIndex = this->Dimensions[axis] - 1;
+        if (position < -DSH_INDEX_TOLERANCE || position > lastIndex + DSH_INDEX_TOLERANCE)
+        {
+          return false;
+        }
+        if (position <= 0.0)
+        {
+          lower[axis] = upper[axis] = 0;
+        }
+        else if (position >= lastIndex)
+        {
+          lower[axis] = upper[axis] = lastIndex;
+        }
+        else
+        {
+          lower[axis] = static_cast<int>(position);
+          upper[axis] = lower[axis] + 1;
+          weight[axis] = position - lower[axis];
+        }
+      }
+
+      const vtkIdType incrementY = this->Dimensions[0];
+      const vtkIdType incrementZ = static_cast<vtkIdType>(this->Dimensions[0]) * this->Dimensions[1];
+      const float* lowerSlice = this->Scalars + lower[2] * incrementZ;
+      const float* upperSlice = this->Scalars + upper[2] * incrementZ;
+      const vtkIdType lowerRow = lower[1] * incrementY;
+      const vtkIdType upperRow = upper[1] * incrementY;
+      double c00 = lowerSlice[lowerRow + lower[0]] + (lowerSlice[lowerRow + upper[0]] - lowerSlice[lowerRow + lower[0]]) * weight[0];
+      double c10 = lowerSlice[upperRow + lower[0]] + (lowerSlice[upperRow + upper[0]] - lowerSlice[upperRow + lower[0]]) * weight[0];
+      double c01 = upperSlice[lowerRow + lower[0]] + (upperSlice[lowerRow + upper[0]] - upperSlice[lowerRow + lower[0]]) * weight[0];
+      double c11 = upperSlice[upperRow + lower[0]] + (upperSlice[upperRow + upper[0]] - upperSlice[upperRow + lower[0]]) * weight[0];
+      double c0 = c00 + (c10 - c00) * weight[1];
+      double c1 = c01 + (c11 - c01) * weight[1];
+      dose = c0 + (c1 - c0) * weight[2];
+      return true;
+    }
+
+    /// Add area weighted dose sample to the statistics and the histogram
+    void AddSample(SurfaceDoseStatistics& statistics, double dose, double area) const
+    {
+      statistics.SampledArea += area;
+      statistics.WeightedDoseSum += dose * area;
+      ++statistics.NumberOfSamples;
+      statistics.Minimum = std::min(statistics.Minimum, dose);
+      statistics.Maximum = std::max(statistics.Maximum, dose);
+      if (this->NumberOfHistogramBins <= 0)
+      {
+        return;
+      }
+      if (dose < this->HistogramOrigin)
+      {
+        statistics.AreaBelowHistogramOrigin += area;
+        return;
+      }
+      double binIndex = std::floor((dose - this->HistogramOrigin) / this->HistogramBinSpacing);
+      if (binIndex < this->NumberOfHistogramBins)
+      {
+        statistics.Histogram[static_cast<int>(binIndex)] += area;
+      }
+    }
+
+  public:
+    vtkPolyData* Surface;
+    const std::vector<vtkIdType>* TriangleIds;
+
+    const float* Scalars;
+    int Extent[6];
+    int Dimensions[3];
+    double WorldToIjk[3][4];
+
+    double SurfaceOffset;
+    double SampleSpacing;
+    double HistogramOrigin;
+    double HistogramBinSpacing;
+    int NumberOfHistogramBins;
+
+    vtkSMPThreadLocal<SurfaceDoseStatistics> Statistics;
+    SurfaceDoseStatistics Total;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkDoseSurfaceHistogramFilter);
+
+//----------------------------------------------------------------------------
+vtkDoseSurfaceHistogramFilter::vtkDoseSurfaceHistogramFilter()
+{
+  this->InputSurface = NULL;
+  this->DoseImageData = NULL;
+
+  this->SurfaceOffsetMm = 0.0;
+  this->MaximumSampleSpacingMm = 0.0;
+  this->HistogramOrigin = 0.0;
+  this->HistogramBinSpacing = 1.0;
+  this->NumberOfHistogramBins = 0;
+
+  this->SampledAreaMm2 = 0.0;
+  this->TotalAreaMm2 = 0.0;
+  this->NumberOfSamples = 0;
+  this->MeanDose = 0.0;
+  this->MinimumDose = 0.0;
+  this->MaximumDose = 0.0;
+  this->AreaBelowHistogramOriginMm2 = 0.0;
+}
+
+//----------------------------------------------------------------------------
+vtkDoseSurfaceHistogramFilter::~vtkDoseSurfaceHistogramFilter()
+{
+  this->SetInputSurface(NULL);
+  this->SetDoseImageData(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkDoseSurfaceHistogramFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "SurfaceOffsetMm: " << this->SurfaceOffsetMm << "\n";
+  os << indent << "MaximumSampleSpacingMm: " << this->MaximumSampleSpacingMm << "\n";
+  os << indent << "HistogramOrigin: " << this->HistogramOrigin << "\n";
+  os << indent << "HistogramBinSpacing: " << this->HistogramBinSpacing << "\n";
+  os << indent << "NumberOfHistogramBins: " << this->NumberOfHistogramBins << "\n";
+  os << indent << "SampledAreaMm2: " << this->SampledAreaMm2 << "\n";
+  os << indent << "TotalAreaMm2: " << this->TotalAreaMm2 << "\n";
+  os << indent << "NumberOfSamples: " << this->NumberOfSamples << "\n";
+  os << indent << "MeanDose: " << this->MeanDose << "\n";
+  os << indent << "MinimumDose: " << this->MinimumDose << "\n";
+  os << indent << "MaximumDose: " << this->MaximumDose << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkDoseSurfaceHistogramFilter::Update()
+{
+  this->SampledAreaMm2 = 0.0;
+  this->TotalAreaMm2 = 0.0;
+  this->NumberOfSamples = 0;
+  this->MeanDose = 0.0;
+  this->MinimumDose = 0.0;
+  this->MaximumDose = 0.0;
+  this->AreaBelowHistogramOriginMm2 = 0.0;
+  this->HistogramAreasMm2.assign(std::max(0, this->NumberOfHistogramBins), 0.0);
+
+  if (!this->InputSurface || !this->DoseImageData)
+  {
+    vtkErrorMacro("Update: Input surface and dose image need to be set");
+    return;
+  }
+  if (this->NumberOfHistogramBins > 0 && this->HistogramBinSpacing <= 0.0)
+  {
+    vtkErrorMacro("Update: Invalid histogram bin spacing " << this->HistogramBinSpacing);
+    return;
+  }
+  int* doseDimensions = this->DoseImageData->GetDimensions();
+  if (doseDimensions[0] <= 0 || doseDimensions[1] <= 0 || doseDimensions[2] <= 0 || !this->DoseImageData->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("Update: Empty dose image");
+    return;
+  }
+
+  // Make sure the surface consists of triangles
+  vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+  triangleFilter->SetInputData(this->InputSurface);
+  triangleFilter->PassVertsOff();
+  triangleFilter->PassLinesOff();
+  vtkSmartPointer<vtkPolyData> surface;
+  if (this->SurfaceOffsetMm != 0.0)
+  {
+    // Make triangle winding consistent and outward facing so that the offset is applied in the right direction.
+    // The normals filter only reorders the triangles if it computes normals, so cell normals are requested
+    vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+    normals->SetInputConnection(triangleFilter->GetOutputPort());
+    normals->ConsistencyOn();
+    normals->AutoOrientNormalsOn();
+    normals->SplittingOff();
+    normals->ComputePointNormalsOff();
+    normals->ComputeCellNormalsOn();
+    normals->Update();
+    surface = normals->GetOutput();
+  }
+  else
+  {
+    triangleFilter->Update();
+    surface = triangleFilter->GetOutput();
+  }
+
+  // Collect triangle point IDs so that the triangles can be accessed randomly from the threads
+  std::vector<vtkIdType> triangleIds;
+  triangleIds.reserve(3 * surface->GetNumberOfPolys());
+  vtkCellArray* polys = surface->GetPolys();
+  vtkSmartPointer<vtkIdList> cellPointIds = vtkSmartPointer<vtkIdList>::New();
+  polys->InitTraversal();
+  while (polys->GetNextCell(cellPointIds))
+  {
+    if (cellPointIds->GetNumberOfIds() != 3)
+    {
+      continue;
+    }
+    triangleIds.push_back(cellPointIds->GetId(0));
+    triangleIds.push_back(cellPointIds->GetId(1));
+    triangleIds.push_back(cellPointIds->GetId(2));
+  }
+  vtkIdType numberOfTriangles = static_cast<vtkIdType>(triangleIds.size() / 3);
+  if (numberOfTriangles == 0)
+  {
+    vtkErrorMacro("Update: Input surface contains no triangles");
+    return;
+  }
+
+  // Sample float dose
+  vtkSmartPointer<vtkImageData> floatDoseImage;
+  const float* doseScalars = NULL;
+  if (this->DoseImageData->GetScalarType() == VTK_FLOAT)
+  {
+    doseScalars = static_cast<const float*>(this->DoseImageData->GetScalarPointer());
+  }
+  else
+  {
+    vtkSmartPointer<vtkImageCast> cast = vtkSmartPointer<vtkImageCast>::New();
+    cast->SetInputData(this->DoseImageData);
+    cast->SetOutputScalarTypeToFloat();
+    cast->Update();
+    floatDoseImage = cast->GetOutput();
+    doseScalars = static_cast<const float*>(floatDoseImage->GetScalarPointer());
+  }
+
+  SurfaceDoseSamplingFunctor functor;
+  functor.Surface = surface;
+  functor.TriangleIds = &triangleIds;
+  functor.Scalars = doseScalars;
+  this->DoseImageData->GetExtent(functor.Extent);
+  this->DoseImageData->GetDimensions(functor.Dimensions);
+  vtkSmartPointer<vtkMatrix4x4> worldToIjk = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->DoseImageData->GetWorldToImageMatrix(worldToIjk);
+  for (int row=0; row<3; ++row)
+  {
+    for (int column=0; column<4; ++column)
+    {
+      functor.WorldToIjk[row][column] = worldToIjk->GetElement(row, column);
+    }
+  }
+  functor.SurfaceOffset = this->SurfaceOffsetMm;
+  double* doseSpacing = this->DoseImageData->GetSpacing();
+  functor.SampleSpacing = (this->MaximumSampleSpacingMm > 0.0 ? this->MaximumSampleSpacingMm
+    : std::min(std::min(doseSpacing[0], doseSpacing[1]), doseSpacing[2]) );
+  functor.HistogramOrigin = this->HistogramOrigin;
+  functor.HistogramBinSpacing = this->HistogramBinSpacing;
+  functor.NumberOfHistogramBins = std::max(0, this->NumberOfHistogramBins);
+
+  vtkSMPTools::For(0, numberOfTriangles, functor);
+
+  const SurfaceDoseStatistics& total = functor.Total;
+  this->SampledAreaMm2 = total.SampledArea;
+  this->TotalAreaMm2 = total.TotalArea;
+  this->NumberOfSamples = total.NumberOfSamples;
+  if (total.NumberOfSamples > 0)
+  {
+    this->MeanDose = (total.SampledArea > 0.0 ? total.WeightedDoseSum / total.SampledArea : 0.0);
+    this->MinimumDose = total.Minimum;
+    this->MaximumDose = total.Maximum;
+  }
+  this->AreaBelowHistogramOriginMm2 = total.AreaBelowHistogramOrigin;
+  this->HistogramAreasMm2 = total.Histogram;
+}
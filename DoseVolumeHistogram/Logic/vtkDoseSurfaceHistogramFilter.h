@@ -0,0 +1,132 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkDoseSurfaceHistogramFilter_h
+#define __vtkDoseSurfaceHistogramFilter_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <vector>
+
+#include "vtkSlicerDoseVolumeHistogramModuleLogicExport.h"
+
+class vtkOrientedImageData;
+class vtkPolyData;
+
+/// \ingroup SlicerRt_QtModules_DoseVolumeHistogram
+/// \brief Multi-threaded area-weighted dose sampling on a closed surface
+///
+/// Computes the dose surface histogram (DSH) of a structure directly from its closed surface mesh.
+/// Each triangle is subdivided so that the samples are not farther apart than the sample spacing,
+/// and the dose is interpolated trilinearly at the center of each sub-triangle, weighted by its area.
+/// The sample points can be shifted along the outward surface normal to sample just inside or
+/// outside the structure. Triangles are processed in parallel, and no labelmap or morphological
+/// operation is needed, so the result does not depend on the labelmap type (binary or fractional).
+class VTK_SLICER_DOSEVOLUMEHISTOGRAM_LOGIC_EXPORT vtkDoseSurfaceHistogramFilter : public vtkObject
+{
+public:
+  static vtkDoseSurfaceHistogramFilter *New();
+  vtkTypeMacro(vtkDoseSurfaceHistogramFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Sample dose on the surface, compute statistics and histogram (if number of bins is positive)
+  virtual void Update();
+
+  /// Set closed surface of the structure, in world coordinates
+  vtkSetObjectMacro(InputSurface, vtkPolyData);
+  /// Get closed surface of the structure
+  vtkGetObjectMacro(InputSurface, vtkPolyData);
+
+  /// Set dose image to sample. Its geometry is not changed, so no resampling is needed
+  vtkSetObjectMacro(DoseImageData, vtkOrientedImageData);
+  /// Get dose image
+  vtkGetObjectMacro(DoseImageData, vtkOrientedImageData);
+
+  /// Distance of the sample points from the surface along the outward normal, in mm.
+  /// Negative value samples inside the structure, positive outside. Default is zero (on the surface)
+  vtkGetMacro(SurfaceOffsetMm, double);
+  vtkSetMacro(SurfaceOffsetMm, double);
+
+  /// Maximum distance between the samples on a triangle, in mm. If zero or negative (default),
+  /// then the smallest spacing of the dose image is used
+  vtkGetMacro(MaximumSampleSpacingMm, double);
+  vtkSetMacro(MaximumSampleSpacingMm, double);
+
+  /// Lower bound of the first histogram bin. Samples below it are accumulated in \sa GetAreaBelowHistogramOriginMm2
+  vtkGetMacro(HistogramOrigin, double);
+  vtkSetMacro(HistogramOrigin, double);
+
+  /// Width of the histogram bins
+  vtkGetMacro(HistogramBinSpacing, double);
+  vtkSetMacro(HistogramBinSpacing, double);
+
+  /// Number of histogram bins. If zero (default), then only the statistics are computed.
+  /// Samples above the last bin are not included in the histogram
+  vtkGetMacro(NumberOfHistogramBins, int);
+  vtkSetMacro(NumberOfHistogramBins, int);
+
+  /// Get area of the surface where the dose could be sampled (inside the dose volume), in mm^2
+  vtkGetMacro(SampledAreaMm2, double);
+  /// Get total area of the surface, in mm^2
+  vtkGetMacro(TotalAreaMm2, double);
+  /// Get number of dose samples taken within the dose volume
+  vtkGetMacro(NumberOfSamples, vtkIdType);
+  /// Get area weighted mean dose
+  vtkGetMacro(MeanDose, double);
+  /// Get minimum sampled dose
+  vtkGetMacro(MinimumDose, double);
+  /// Get maximum sampled dose
+  vtkGetMacro(MaximumDose, double);
+  /// Get area of the samples with dose below the histogram origin, in mm^2
+  vtkGetMacro(AreaBelowHistogramOriginMm2, double);
+  /// Get area of the samples in each histogram bin, in mm^2
+  const std::vector<double>& GetHistogramAreasMm2() { return this->HistogramAreasMm2; };
+
+protected:
+  vtkPolyData* InputSurface;
+  vtkOrientedImageData* DoseImageData;
+
+  double SurfaceOffsetMm;
+  double MaximumSampleSpacingMm;
+  double HistogramOrigin;
+  double HistogramBinSpacing;
+  int NumberOfHistogramBins;
+
+  double SampledAreaMm2;
+  double TotalAreaMm2;
+  vtkIdType NumberOfSamples;
+  double MeanDose;
+  double MinimumDose;
+  double MaximumDose;
+  double AreaBelowHistogramOriginMm2;
+  std::vector<double> HistogramAreasMm2;
+
+protected:
+  vtkDoseSurfaceHistogramFilter();
+  virtual ~vtkDoseSurfaceHistogramFilter();
+
+private:
+  vtkDoseSurfaceHistogramFilter(const vtkDoseSurfaceHistogramFilter&); // Not implemented
+  void operator=(const vtkDoseSurfaceHistogramFilter&);               // Not implemented
+};
+
+#endif
@@ -0,0 +1,464 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DoseVolumeHistogram includes
+#include "vtkDoseVolumeHistogramArchive.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtPerformanceMonitor.h"
+
+// MRML includes
+#include <vtkMRMLTableNode.h>
+
+// VTK includes
+#include <vtkCollection.h>
+#include <vtkDataArray.h>
+#include <vtkDoubleArray.h>
+#include <vtkFloatArray.h>
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+#include <vtkStringArray.h>
+#include <vtkTable.h>
+
+// STD includes
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  const char DVH_ARCHIVE_MAGIC[8] = { 'S', 'R', 'T', 'D', 'V', 'H', 'A', '\0' };
+  const vtkTypeUInt32 DVH_ARCHIVE_VERSION = 1;
+  const vtkTypeUInt32 DVH_ARCHIVE_BYTE_ORDER_MARK = 0x01020304;
+
+  //-----------------------------------------------------------------------------
+  /// Appends directory entries to a memory buffer, so that the directory is written with one call
+  class DirectoryWriter
+  {
+  public:
+    void WriteBytes(const void* data, size_t size)
+    {
+      const char* bytes = static_cast<const char*>(data);
+      this->Buffer.insert(this->Buffer.end(), bytes, bytes + size);
+    }
+    void WriteUInt32(vtkTypeUInt32 value)
+    {
+      this->WriteBytes(&value, sizeof(value));
+    }
+    void WriteUInt64(vtkTypeUInt64 value)
+    {
+      this->WriteBytes(&value, sizeof(value));
+    }
+    void WriteString(const std::string& value)
+    {
+      this->WriteUInt32((vtkTypeUInt32)value.size());
+      this->WriteBytes(value.c_str(), value.size());
+    }
+
+    std::vector<char> Buffer;
+  };
+
+  //-----------------------------------------------------------------------------
+  /// Reads entries from the archive loaded into memory, with bounds checking
+  class ArchiveReader
+  {
+  public:
+    ArchiveReader(const std::vector<char>& buffer)
+      : Buffer(buffer)
+      , Position(0)
+      , Failed(false)
+    {
+    }
+    bool ReadBytes(void* data, size_t size)
+    {
+      if (this->Failed || this->Position + size > this->Buffer.size())
+      {
+        this->Failed = true;
+        return false;
+      }
+      if (size > 0)
+      {
+        memcpy(data, &(this->Buffer[this->Position]), size);
+      }
+      this->Position += size;
+      return true;
+    }
+    vtkTypeUInt32 ReadUInt32()
+    {
+      vtkTypeUInt32 value = 0;
+      this->ReadBytes(&value, sizeof(value));
+      return value;
+    }
+    vtkTypeUInt64 ReadUInt64()
+    {
+      vtkTypeUInt64 value = 0;
+      this->ReadBytes(&value, sizeof(value));
+      return value;
+    }
+    std::string ReadString()
+    {
+      vtkTypeUInt32 length = this->ReadUInt32();
+      if (this->Failed || this->Position + length > this->Buffer.size())
+      {
+        this->Failed = true;
+        return std::string();
+      }
+      std::string value(this->Buffer.begin() + this->Position, this->Buffer.begin() + this->Position + length);
+      this->Position += length;
+      return value;
+    }
+
+    size_t GetNumberOfRemainingBytes() const
+    {
+      return (this->Position < this->Buffer.size() ? this->Buffer.size() - this->Position : 0);
+    }
+
+    const std::vector<char>& Buffer;
+    size_t Position;
+    bool Failed;
+  };
+
+  //-----------------------------------------------------------------------------
+  /// Columns of a structure that are stored in the archive (single component float or double arrays)
+  struct StructureColumns
+  {
+    std::vector<vtkSmartPointer<vtkDataArray> > Columns;
+    vtkTypeUInt64 NumberOfRows;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkDoseVolumeHistogramArchive);
+
+//----------------------------------------------------------------------------
+vtkDoseVolumeHistogramArchive::vtkDoseVolumeHistogramArchive()
+{
+}
+
+//----------------------------------------------------------------------------
+vtkDoseVolumeHistogramArchive::~vtkDoseVolumeHistogramArchive()
+{
+}
+
+//----------------------------------------------------------------------------
+bool vtkDoseVolumeHistogramArchive::WriteArchive(const char* fileName, vtkCollection* dvhTableNodes, vtkTable* metadata/*=NULL*/)
+{
+  if (!fileName || !dvhTableNodes)
+  {
+    vtkErrorMacro("WriteArchive: Invalid arguments");
+    return false;
+  }
+
+  vtkSlicerRtScopedTimer timer("DoseVolumeHistogram.WriteArchive");
+
+  // Collect numeric columns. Double and float columns are stored as they are, other numeric types as double
+  std::vector<vtkMRMLTableNode*> tableNodes;
+  std::vector<StructureColumns> structureColumns;
+  size_t maximumNumberOfColumns = 0;
+  for (int itemIndex=0; itemIndex<dvhTableNodes->GetNumberOfItems(); ++itemIndex)
+  {
+    vtkMRMLTableNode* tableNode = vtkMRMLTableNode::SafeDownCast(dvhTableNodes->GetItemAsObject(itemIndex));
+    if (!tableNode || !tableNode->GetTable())
+    {
+      vtkWarningMacro("WriteArchive: Item " << itemIndex << " is not a valid table node, skipped");
+      continue;
+    }
+    vtkTable* table = tableNode->GetTable();
+    StructureColumns columns;
+    columns.NumberOfRows = (vtkTypeUInt64)table->GetNumberOfRows();
+    for (vtkIdType columnIndex=0; columnIndex<table->GetNumberOfColumns(); ++columnIndex)
+    {
+      vtkDataArray* column = vtkDataArray::SafeDownCast(table->GetColumn(columnIndex));
+      if (!column || column->GetNumberOfComponents() != 1)
+      {
+        vtkWarningMacro("WriteArchive: Column " << columnIndex << " of table "
+          << (tableNode->GetName() ? tableNode->GetName() : "") << " is not a numeric column, skipped");
+        continue;
+      }
+      if (column->GetDataType() == VTK_DOUBLE || column->GetDataType() == VTK_FLOAT)
+      {
+        columns.Columns.push_back(column);
+      }
+      else
+      {
+        vtkSmartPointer<vtkDoubleArray> doubleColumn = vtkSmartPointer<vtkDoubleArray>::New();
+        doubleColumn->DeepCopy(column);
+        doubleColumn->SetName(column->GetName());
+        columns.Columns.push_back(doubleColumn);
+      }
+    }
+    if (columns.Columns.size() > maximumNumberOfColumns)
+    {
+      maximumNumberOfColumns = columns.Columns.size();
+    }
+    tableNodes.push_back(tableNode);
+    structureColumns.push_back(columns);
+  }
+
+  // Assemble directory
+  DirectoryWriter directory;
+  directory.WriteBytes(DVH_ARCHIVE_MAGIC, sizeof(DVH_ARCHIVE_MAGIC));
+  directory.WriteUInt32(DVH_ARCHIVE_VERSION);
+  directory.WriteUInt32(DVH_ARCHIVE_BYTE_ORDER_MARK);
+  vtkIdType numberOfMetadataEntries = (metadata && metadata->GetNumberOfColumns() >= 2 ? metadata->GetNumberOfRows() : 0);
+  directory.WriteUInt32((vtkTypeUInt32)numberOfMetadataEntries);
+  directory.WriteUInt32((vtkTypeUInt32)tableNodes.size());
+  for (vtkIdType row=0; row<numberOfMetadataEntries; ++row)
+  {
+    directory.WriteString(metadata->GetValue(row, 0).ToString());
+    directory.WriteString(metadata->GetValue(row, 1).ToString());
+  }
+  for (size_t structureIndex=0; structureIndex<tableNodes.size(); ++structureIndex)
+  {
+    vtkMRMLTableNode* tableNode = tableNodes[structureIndex];
+    directory.WriteString(tableNode->GetName() ? tableNode->GetName() : "");
+    std::vector<std::string> attributeNames = tableNode->GetAttributeNames();
+    directory.WriteUInt32((vtkTypeUInt32)attributeNames.size());
+    for (std::vector<std::string>::iterator attributeIt=attributeNames.begin(); attributeIt!=attributeNames.end(); ++attributeIt)
+    {
+      const char* attributeValue = tableNode->GetAttribute(attributeIt->c_str());
+      directory.WriteString(*attributeIt);
+      directory.WriteString(attributeValue ? attributeValue : "");
+    }
+    const StructureColumns& columns = structureColumns[structureIndex];
+    directory.WriteUInt64(columns.NumberOfRows);
+    directory.WriteUInt32((vtkTypeUInt32)columns.Columns.size());
+    for (size_t columnIndex=0; columnIndex<columns.Columns.size(); ++columnIndex)
+    {
+      vtkDataArray* column = columns.Columns[columnIndex];
+      directory.WriteString(column->GetName() ? column->GetName() : "");
+      directory.WriteUInt32((vtkTypeUInt32)column->GetDataType());
+    }
+  }
+
+  std::ofstream archiveStream(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!archiveStream)
+  {
+    vtkErrorMacro("WriteArchive: Output file '" << fileName << "' cannot be opened");
+    return false;
+  }
+  archiveStream.write(&(directory.Buffer[0]), directory.Buffer.size());
+  double numberOfBytesWritten = (double)directory.Buffer.size();
+
+  // Write column blocks. Columns shorter than the row count of the table are padded with zeros
+  std::vector<char> padding;
+  for (size_t columnIndex=0; columnIndex<maximumNumberOfColumns; ++columnIndex)
+  {
+    for (size_t structureIndex=0; structureIndex<structureColumns.size(); ++structureIndex)
+    {
+      const StructureColumns& columns = structureColumns[structureIndex];
+      if (columnIndex >= columns.Columns.size())
+      {
+        continue;
+      }
+      vtkDataArray* column = columns.Columns[columnIndex];
+      size_t valueSize = column->GetDataTypeSize();
+      vtkTypeUInt64 numberOfStoredValues = std::min<vtkTypeUInt64>(columns.NumberOfRows, (vtkTypeUInt64)column->GetNumberOfTuples());
+      if (numberOfStoredValues > 0)
+      {
+        archiveStream.write(static_cast<const char*>(column->GetVoidPointer(0)), (std::streamsize)(numberOfStoredValues * valueSize));
+      }
+      if (numberOfStoredValues < columns.NumberOfRows)
+      {
+        padding.assign((size_t)(columns.NumberOfRows - numberOfStoredValues) * valueSize, 0);
+        archiveStream.write(&(padding[0]), (std::streamsize)padding.size());
+      }
+      numberOfBytesWritten += (double)(columns.NumberOfRows * valueSize);
+    }
+  }
+
+  archiveStream.close();
+  if (archiveStream.fail())
+  {
+    vtkErrorMacro("WriteArchive: Failed to write file '" << fileName << "'");
+    return false;
+  }
+
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DoseVolumeHistogram.WriteArchive", "Bytes written", numberOfBytesWritten);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+vtkCollection* vtkDoseVolumeHistogramArchive::ReadArchive(const char* fileName, vtkTable* metadata/*=NULL*/)
+{
+  if (!fileName)
+  {
+    vtkErrorMacro("ReadArchive: Invalid file name");
+    return NULL;
+  }
+
+  vtkSlicerRtScopedTimer timer("DoseVolumeHistogram.ReadArchive");
+
+  // Read the whole file with one call
+  std::ifstream archiveStream(fileName, std::ios::in | std::ios::binary | std::ios::ate);
+  if (!archiveStream)
+  {
+    vtkErrorMacro("ReadArchive: Input file '" << fileName << "' cannot be opened");
+    return NULL;
+  }
+  std::streamsize fileSize = archiveStream.tellg();
+  archiveStream.seekg(0, std::ios::beg);
+  std::vector<char> buffer(fileSize > 0 ? (size_t)fileSize : 0);
+  if (fileSize <= 0 || !archiveStream.read(&(buffer[0]), fileSize))
+  {
+    vtkErrorMacro("ReadArchive: Failed to read file '" << fileName << "'");
+    return NULL;
+  }
+  archiveStream.close();
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DoseVolumeHistogram.ReadArchive", "Bytes read", (double)fileSize);
+
+  ArchiveReader reader(buffer);
+  char magic[8] = {0};
+  reader.ReadBytes(magic, sizeof(magic));
+  vtkTypeUInt32 version = reader.ReadUInt32();
+  vtkTypeUInt32 byteOrderMark = reader.ReadUInt32();
+  if (reader.Failed || memcmp(magic, DVH_ARCHIVE_MAGIC, sizeof(DVH_ARCHIVE_MAGIC)) != 0)
+  {
+    vtkErrorMacro("ReadArchive: File '" << fileName << "' is not a DVH archive");
+    return NULL;
+  }
+  if (version != DVH_ARCHIVE_VERSION)
+  {
+    vtkErrorMacro("ReadArchive: Unsupported DVH archive version " << version);
+    return NULL;
+  }
+  if (byteOrderMark != DVH_ARCHIVE_BYTE_ORDER_MARK)
+  {
+    vtkErrorMacro("ReadArchive: DVH archive was written with a different byte order");
+    return NULL;
+  }
+  vtkTypeUInt32 numberOfMetadataEntries = reader.ReadUInt32();
+  vtkTypeUInt32 numberOfStructures = reader.ReadUInt32();
+
+  // Metadata
+  vtkSmartPointer<vtkStringArray> metadataKeys = vtkSmartPointer<vtkStringArray>::New();
+  metadataKeys->SetName("Key");
+  vtkSmartPointer<vtkStringArray> metadataValues = vtkSmartPointer<vtkStringArray>::New();
+  metadataValues->SetName("Value");
+  for (vtkTypeUInt32 entryIndex=0; entryIndex<numberOfMetadataEntries && !reader.Failed; ++entryIndex)
+  {
+    metadataKeys->InsertNextValue(reader.ReadString());
+    metadataValues->InsertNextValue(reader.ReadString());
+  }
+
+  // Structure directory
+  vtkSmartPointer<vtkCollection> tableNodes = vtkSmartPointer<vtkCollection>::New();
+  std::vector<StructureColumns> structureColumns;
+  size_t maximumNumberOfColumns = 0;
+  vtkTypeUInt64 numberOfColumnBytes = 0; // Total size of the column blocks declared in the directory so far
+  for (vtkTypeUInt32 structureIndex=0; structureIndex<numberOfStructures && !reader.Failed; ++structureIndex)
+  {
+    vtkSmartPointer<vtkMRMLTableNode> tableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+    tableNode->SetName(reader.ReadString().c_str());
+    vtkTypeUInt32 numberOfAttributes = reader.ReadUInt32();
+    for (vtkTypeUInt32 attributeIndex=0; attributeIndex<numberOfAttributes && !reader.Failed; ++attributeIndex)
+    {
+      std::string attributeName = reader.ReadString();
+      std::string attributeValue = reader.ReadString();
+      tableNode->SetAttribute(attributeName.c_str(), attributeValue.c_str());
+    }
+
+    StructureColumns columns;
+    columns.NumberOfRows = reader.ReadUInt64();
+    vtkTypeUInt32 numberOfColumns = reader.ReadUInt32();
+    vtkSmartPointer<vtkTable> table = vtkSmartPointer<vtkTable>::New();
+    for (vtkTypeUInt32 columnIndex=0; columnIndex<numberOfColumns && !reader.Failed; ++columnIndex)
+    {
+      std::string columnName = reader.ReadString();
+      vtkTypeUInt32 columnType = reader.ReadUInt32();
+      vtkSmartPointer<vtkDataArray> column;
+      if (columnType == VTK_DOUBLE)
+      {
+        column = vtkSmartPointer<vtkDoubleArray>::New();
+      }
+      else if (columnType == VTK_FLOAT)
+      {
+        column = vtkSmartPointer<vtkFloatArray>::New();
+      }
+      else
+      {
+        vtkErrorMacro("ReadArchive: Unsupported column type " << columnType);
+        return NULL;
+      }
+      // The column blocks follow the directory, so the declared sizes cannot exceed the rest of the file.
+      // Checked before allocation so that a corrupt row count does not cause a huge allocation
+      vtkTypeUInt64 numberOfRemainingBytes = (vtkTypeUInt64)reader.GetNumberOfRemainingBytes();
+      vtkTypeUInt64 valueSize = (vtkTypeUInt64)column->GetDataTypeSize();
+      if ( numberOfColumnBytes > numberOfRemainingBytes
+        || columns.NumberOfRows > (numberOfRemainingBytes - numberOfColumnBytes) / valueSize )
+      {
+        vtkErrorMacro("ReadArchive: Column '" << columnName << "' of structure '" << (tableNode->GetName() ? tableNode->GetName() : "")
+          << "' has " << columns.NumberOfRows << " rows, which exceeds the size of DVH archive '" << fileName << "'");
+        return NULL;
+      }
+      numberOfColumnBytes += columns.NumberOfRows * valueSize;
+
+      column->SetName(columnName.c_str());
+      column->SetNumberOfTuples((vtkIdType)columns.NumberOfRows);
+      table->AddColumn(column);
+      columns.Columns.push_back(column);
+    }
+    if (columns.Columns.size() > maximumNumberOfColumns)
+    {
+      maximumNumberOfColumns = columns.Columns.size();
+    }
+    tableNode->SetAndObserveTable(table);
+    tableNodes->AddItem(tableNode);
+    structureColumns.push_back(columns);
+  }
+
+  // Column blocks, copied directly into the arrays
+  for (size_t columnIndex=0; columnIndex<maximumNumberOfColumns && !reader.Failed; ++columnIndex)
+  {
+    for (size_t structureIndex=0; structureIndex<structureColumns.size() && !reader.Failed; ++structureIndex)
+    {
+      const StructureColumns& columns = structureColumns[structureIndex];
+      if (columnIndex >= columns.Columns.size())
+      {
+        continue;
+      }
+      vtkDataArray* column = columns.Columns[columnIndex];
+      size_t numberOfBytes = (size_t)columns.NumberOfRows * column->GetDataTypeSize();
+      if (numberOfBytes > 0)
+      {
+        reader.ReadBytes(column->GetVoidPointer(0), numberOfBytes);
+      }
+    }
+  }
+
+  if (reader.Failed)
+  {
+    vtkErrorMacro("ReadArchive: DVH archive '" << fileName << "' is truncated or corrupt");
+    return NULL;
+  }
+
+  if (metadata)
+  {
+    metadata->Initialize();
+    metadata->AddColumn(metadataKeys);
+    metadata->AddColumn(metadataValues);
+  }
+
+  tableNodes->Register(NULL);
+  return tableNodes.GetPointer();
+}
@@ -0,0 +1,74 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkDoseVolumeHistogramArchive_h
+#define __vtkDoseVolumeHistogramArchive_h
+
+// VTK includes
+#include <vtkObject.h>
+
+#include "vtkSlicerDoseVolumeHistogramModuleLogicExport.h"
+
+class vtkCollection;
+class vtkTable;
+
+/// \ingroup SlicerRt_QtModules_DoseVolumeHistogram
+/// \brief Compact binary archive of DVH tables
+///
+/// Stores a set of DVH table nodes (one per structure) in a single file that is written and read with bulk I/O.
+/// The file starts with a directory: archive metadata (key-value pairs), then for each structure its name,
+/// node attributes (segment ID, total volume, etc.), number of rows, and the names and VTK scalar types of its
+/// columns. The directory is followed by the raw column values, grouped by column index across structures
+/// (all dose columns, then all volume columns), so that similar values are adjacent for external compression.
+///
+/// Layout (integers are unsigned 32 bit unless noted, strings are length followed by characters):
+///   "SRTDVHA\0", version, byte order mark (0x01020304), number of metadata entries, number of structures
+///   metadata entries: key, value
+///   structures: name, number of attributes, (attribute name, value)*, number of rows (64 bit), number of columns, (column name, VTK type)*
+///   column blocks: for each column index, values of that column of each structure that has it
+/// Values are written in the byte order of the writing machine, and the reader rejects archives with a different byte order.
+class VTK_SLICER_DOSEVOLUMEHISTOGRAM_LOGIC_EXPORT vtkDoseVolumeHistogramArchive : public vtkObject
+{
+public:
+  static vtkDoseVolumeHistogramArchive *New();
+  vtkTypeMacro(vtkDoseVolumeHistogramArchive, vtkObject);
+
+  /// Write DVH tables to archive file
+  /// \param dvhTableNodes Collection of vtkMRMLTableNode objects. Name, attributes and numeric columns are stored
+  /// \param metadata Optional table with two string columns (key and value), stored as archive metadata
+  /// \return Success flag
+  bool WriteArchive(const char* fileName, vtkCollection* dvhTableNodes, vtkTable* metadata=NULL);
+
+  /// Read DVH tables from archive file
+  /// \param metadata Optional output table, filled with the archive metadata (key and value string columns)
+  /// \return Collection of vtkMRMLTableNode objects (same as \sa vtkSlicerDoseVolumeHistogramModuleLogic::ReadCsvToTableNode),
+  ///   NULL on failure. The caller takes ownership of the collection
+  vtkCollection* ReadArchive(const char* fileName, vtkTable* metadata=NULL);
+
+protected:
+  vtkDoseVolumeHistogramArchive();
+  virtual ~vtkDoseVolumeHistogramArchive();
+
+private:
+  vtkDoseVolumeHistogramArchive(const vtkDoseVolumeHistogramArchive&); // Not implemented
+  void operator=(const vtkDoseVolumeHistogramArchive&);               // Not implemented
+};
+
+#endif
@@ -26,15 +26,227 @@
 #include "vtkSlicerDoseVolumeHistogramModuleLogic.h"
 #include "vtkMRMLDoseVolumeHistogramNode.h"
 
+// SlicerRT includes
+#include "vtkSlicerRtPerformanceMonitor.h"
+
 // VTK includes
+#include <vtkCollection.h>
+#include <vtkDataArray.h>
+#include <vtkDoubleArray.h>
 #include <vtkImageData.h>
 #include <vtkImageAccumulate.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
 #include <vtkSmartPointer.h>
+#include <vtkStringArray.h>
 #include <vtkTable.h>
 #include <vtkVersion.h>
 
+// STD includes
+#include <algorithm>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //---------------------------------------------------------------------------
+  /// Input of one DVH comparison, collected before the parallel section
+  struct DvhComparisonPair
+  {
+    vtkDataArray* BaselineDose;
+    vtkDataArray* BaselineVolume;
+    vtkDataArray* CurrentDose;
+    vtkDataArray* CurrentVolume;
+    double TotalVolumeCCs;
+  };
+
+  //---------------------------------------------------------------------------
+  /// Results of one DVH comparison
+  struct DvhComparisonResult
+  {
+    double AgreementAcceptancePercentage;
+    double MeanVolumeDifference;
+    double MaxVolumeDifference;
+    double DoseAtMaxVolumeDifference;
+  };
+
+  //---------------------------------------------------------------------------
+  /// Copy DVH to (dose, volume) points sorted by dose
+  void GetSortedDvhPoints(vtkDataArray* doseArray, vtkDataArray* volumeArray, std::vector<std::pair<double, double> >& points)
+  {
+    vtkIdType numberOfPoints = std::min(doseArray->GetNumberOfTuples(), volumeArray->GetNumberOfTuples());
+    points.resize(numberOfPoints);
+    bool sorted = true;
+    for (vtkIdType pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+    {
+      points[pointIndex].first = doseArray->GetComponent(pointIndex, 0);
+      points[pointIndex].second = volumeArray->GetComponent(pointIndex, 0);
+      if (pointIndex > 0 && points[pointIndex].first < points[pointIndex-1].first)
+      {
+        sorted = false;
+      }
+    }
+    if (!sorted)
+    {
+      std::stable_sort(points.begin(), points.end());
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  /// Linearly interpolate DVH (sorted by dose) at the uniformly spaced doses i*doseStep (i=0..n-1).
+  /// Volume is constant outside the dose range of the DVH
+  void ResampleDvh(const std::vector<std::pair<double, double> >& points, double doseStep, std::vector<double>& resampledVolumes)
+  {
+    size_t numberOfPoints = points.size();
+    size_t segmentIndex = 0;
+    for (size_t binIndex=0; binIndex<resampledVolumes.size(); ++binIndex)
+    {
+      double dose = binIndex * doseStep;
+      // Sampled doses are increasing, so the segment containing the dose only moves forward
+      while (segmentIndex < numberOfPoints && points[segmentIndex].first < dose)
+      {
+        ++segmentIndex;
+      }
+      if (segmentIndex == 0)
+      {
+        resampledVolumes[binIndex] = points[0].second;
+      }
+      else if (segmentIndex == numberOfPoints)
+      {
+        resampledVolumes[binIndex] = points[numberOfPoints-1].second;
+      }
+      else
+      {
+        const std::pair<double, double>& previousPoint = points[segmentIndex-1];
+        const std::pair<double, double>& nextPoint = points[segmentIndex];
+        double doseDifference = nextPoint.first - previousPoint.first;
+        double weight = (doseDifference > 0.0 ? (dose - previousPoint.first) / doseDifference : 0.0);
+        resampledVolumes[binIndex] = previousPoint.second + weight * (nextPoint.second - previousPoint.second);
+      }
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  /// Compare DVH pairs. Same agreement formula as vtkSlicerDoseVolumeHistogramComparisonLogic::GetAgreementForDvhPlotPoint,
+  /// but the search for the closest point of the current DVH starts at the baseline dose and stops when the dose term
+  /// alone exceeds the best match, which gives the same minimum without visiting all points of the current DVH.
+  class CompareDvhPairsFunctor
+  {
+  public:
+    CompareDvhPairsFunctor( const std::vector<DvhComparisonPair>& pairs, std::vector<DvhComparisonResult>& results,
+                            double volumeDifferenceCriterion, double doseToAgreementCriterion, double doseMax, int numberOfCommonDoseBins )
+      : Pairs(pairs)
+      , Results(results)
+      , VolumeDifferenceCriterion(volumeDifferenceCriterion)
+      , DoseToAgreementCriterion(doseToAgreementCriterion)
+      , DoseMax(doseMax)
+      , NumberOfCommonDoseBins(numberOfCommonDoseBins)
+    {
+    }
+
+    void operator()(vtkIdType beginPair, vtkIdType endPair)
+    {
+      std::vector<std::pair<double, double> > baselinePoints;
+      std::vector<std::pair<double, double> > currentPoints;
+      std::vector<double> baselineResampled;
+      std::vector<double> currentResampled;
+
+      for (vtkIdType pairIndex=beginPair; pairIndex<endPair; ++pairIndex)
+      {
+        const DvhComparisonPair& pair = this->Pairs[pairIndex];
+        DvhComparisonResult& result = this->Results[pairIndex];
+        result.AgreementAcceptancePercentage = 0.0;
+        result.MeanVolumeDifference = 0.0;
+        result.MaxVolumeDifference = 0.0;
+        result.DoseAtMaxVolumeDifference = 0.0;
+
+        GetSortedDvhPoints(pair.BaselineDose, pair.BaselineVolume, baselinePoints);
+        GetSortedDvhPoints(pair.CurrentDose, pair.CurrentVolume, currentPoints);
+        if (baselinePoints.empty() || currentPoints.empty())
+        {
+          continue;
+        }
+        double highestDose = std::max(baselinePoints.back().first, currentPoints.back().first);
+        double doseMax = (this->DoseMax > 0.0 ? this->DoseMax : highestDose);
+
+        // Agreement acceptance: the baseline (shorter) DVH points are evaluated against all points of the other DVH
+        double volumeDenominator = this->VolumeDifferenceCriterion * pair.TotalVolumeCCs;
+        double doseDenominator = this->DoseToAgreementCriterion * doseMax;
+        int numberOfAcceptedAgreements = 0;
+        size_t numberOfCurrentPoints = currentPoints.size();
+        for (size_t baselineIndex=0; baselineIndex<baselinePoints.size(); ++baselineIndex)
+        {
+          double di = baselinePoints[baselineIndex].first;
+          double vi = baselinePoints[baselineIndex].second;
+          size_t startIndex = std::lower_bound(currentPoints.begin(), currentPoints.end(), std::make_pair(di, -VTK_DOUBLE_MAX)) - currentPoints.begin();
+
+          double minimumGammaSquared = VTK_DOUBLE_MAX;
+          for (size_t currentIndex=startIndex; currentIndex<numberOfCurrentPoints; ++currentIndex)
+          {
+            double doseTerm = ( 100.0*(currentPoints[currentIndex].first - di) ) / doseDenominator;
+            if (doseTerm * doseTerm >= minimumGammaSquared)
+            {
+              break;
+            }
+            double volumeTerm = ( 100.0*(currentPoints[currentIndex].second - vi) ) / volumeDenominator;
+            minimumGammaSquared = std::min(minimumGammaSquared, doseTerm * doseTerm + volumeTerm * volumeTerm);
+          }
+          for (size_t currentIndex=startIndex; currentIndex>0; --currentIndex)
+          {
+            double doseTerm = ( 100.0*(currentPoints[currentIndex-1].first - di) ) / doseDenominator;
+            if (doseTerm * doseTerm >= minimumGammaSquared)
+            {
+              break;
+            }
+            double volumeTerm = ( 100.0*(currentPoints[currentIndex-1].second - vi) ) / volumeDenominator;
+            minimumGammaSquared = std::min(minimumGammaSquared, doseTerm * doseTerm + volumeTerm * volumeTerm);
+          }
+
+          if (sqrt(minimumGammaSquared) <= 1.0)
+          {
+            ++numberOfAcceptedAgreements;
+          }
+        }
+        result.AgreementAcceptancePercentage = 100.0 * (double)numberOfAcceptedAgreements / (double)baselinePoints.size();
+
+        // Volume differences on common dose axis
+        int numberOfBins = this->NumberOfCommonDoseBins;
+        if (numberOfBins <= 0)
+        {
+          numberOfBins = (int)std::max(baselinePoints.size(), currentPoints.size());
+        }
+        double doseStep = (numberOfBins > 1 ? highestDose / (numberOfBins - 1) : 0.0);
+        baselineResampled.resize(numberOfBins);
+        currentResampled.resize(numberOfBins);
+        ResampleDvh(baselinePoints, doseStep, baselineResampled);
+        ResampleDvh(currentPoints, doseStep, currentResampled);
+
+        double sumVolumeDifference = 0.0;
+        for (int binIndex=0; binIndex<numberOfBins; ++binIndex)
+        {
+          double volumeDifference = fabs(baselineResampled[binIndex] - currentResampled[binIndex]);
+          sumVolumeDifference += volumeDifference;
+          if (volumeDifference > result.MaxVolumeDifference)
+          {
+            result.MaxVolumeDifference = volumeDifference;
+            result.DoseAtMaxVolumeDifference = binIndex * doseStep;
+          }
+        }
+        result.MeanVolumeDifference = sumVolumeDifference / numberOfBins;
+      }
+    }
+
+  private:
+    const std::vector<DvhComparisonPair>& Pairs;
+    std::vector<DvhComparisonResult>& Results;
+    double VolumeDifferenceCriterion;
+    double DoseToAgreementCriterion;
+    double DoseMax;
+    int NumberOfCommonDoseBins;
+  };
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseVolumeHistogramComparisonLogic);
 
@@ -71,10 +283,8 @@ double vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTables(vtkMRMLTabl
   vtkTable* currentDoubleArray = NULL;
   //unsigned int currentSize = 0; //This variable might be used for sanity checks later
 
-  // Determine total volume from the attribute of the current double array node
-  std::ostringstream attributeNameStream;
-  attributeNameStream << vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_VOLUME_CC;
-  const char* totalVolumeChar;
+  // Determine total volume (or surface area in case of DSH) from the attribute of the current double array node
+  double totalVolumeCCs = 0;
 
   // The vtkDoubleArray with the smallest number of tuples is the baseline
   if (dvh1Size < dvh2Size)
@@ -85,7 +295,7 @@ double vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTables(vtkMRMLTabl
     currentDoubleArray = dvh2Table;
     //currentSize = dvh2Size;
   
-    totalVolumeChar = dvh2TableNode->GetAttribute(attributeNameStream.str().c_str());
+    totalVolumeCCs = vtkSlicerDoseVolumeHistogramModuleLogic::GetDvhTableTotalAmount(dvh2TableNode);
   }
   else
   {
@@ -95,16 +305,9 @@ double vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTables(vtkMRMLTabl
     currentDoubleArray = dvh1Table;
     //currentSize = dvh1Size;
 
-    totalVolumeChar = dvh1TableNode->GetAttribute(attributeNameStream.str().c_str());
+    totalVolumeCCs = vtkSlicerDoseVolumeHistogramModuleLogic::GetDvhTableTotalAmount(dvh1TableNode);
   }
 
-  // Read the total volume from the current node attribute
-  double totalVolumeCCs = 0;
-  if (totalVolumeChar != NULL)
-  {
-    totalVolumeCCs = vtkVariant(totalVolumeChar).ToDouble();
-  }
-  
   if (totalVolumeCCs == 0)
   {
     vtkErrorWithObjectMacro(dvh1TableNode, "vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTables: Invalid volume for structure!");
@@ -146,6 +349,113 @@ double vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTables(vtkMRMLTabl
   return agreementAcceptancePercentage;
 }
 
+//-----------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTablesBatch( vtkCollection* dvh1TableNodes, vtkCollection* dvh2TableNodes, vtkTable* resultTable,
+                                                                         double volumeDifferenceCriterion, double doseToAgreementCriterion, double doseMax/*=0.0*/,
+                                                                         int numberOfCommonDoseBins/*=0*/ )
+{
+  if (!dvh1TableNodes || !dvh2TableNodes || !resultTable)
+  {
+    vtkGenericWarningMacro("vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTablesBatch: Invalid input DVH collections or result table!");
+    return false;
+  }
+  if (dvh1TableNodes->GetNumberOfItems() != dvh2TableNodes->GetNumberOfItems())
+  {
+    vtkGenericWarningMacro("vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTablesBatch: Number of DVHs to compare do not match ("
+      << dvh1TableNodes->GetNumberOfItems() << "<>" << dvh2TableNodes->GetNumberOfItems() << ")");
+    return false;
+  }
+  if (volumeDifferenceCriterion <= 0.0 || doseToAgreementCriterion <= 0.0)
+  {
+    vtkGenericWarningMacro("vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTablesBatch: Criteria must be positive!");
+    return false;
+  }
+
+  vtkSlicerRtScopedTimer timer("DoseVolumeHistogram.CompareDvhTablesBatch");
+
+  // Collect input arrays. The DVH with fewer rows is the baseline, and the total volume is taken from the other one (same as in CompareDvhTables)
+  vtkIdType numberOfPairs = dvh1TableNodes->GetNumberOfItems();
+  std::vector<DvhComparisonPair> pairs(numberOfPairs);
+  std::vector<std::string> dvh1Names(numberOfPairs);
+  std::vector<std::string> dvh2Names(numberOfPairs);
+  for (vtkIdType pairIndex=0; pairIndex<numberOfPairs; ++pairIndex)
+  {
+    vtkMRMLTableNode* dvh1TableNode = vtkMRMLTableNode::SafeDownCast(dvh1TableNodes->GetItemAsObject(pairIndex));
+    vtkMRMLTableNode* dvh2TableNode = vtkMRMLTableNode::SafeDownCast(dvh2TableNodes->GetItemAsObject(pairIndex));
+    if ( !dvh1TableNode || !dvh2TableNode || !dvh1TableNode->GetTable() || !dvh2TableNode->GetTable()
+      || dvh1TableNode->GetNumberOfColumns() < 2 || dvh2TableNode->GetNumberOfColumns() < 2 )
+    {
+      vtkGenericWarningMacro("vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTablesBatch: Invalid DVH table node in pair " << pairIndex);
+      return false;
+    }
+    dvh1Names[pairIndex] = (dvh1TableNode->GetName() ? dvh1TableNode->GetName() : "");
+    dvh2Names[pairIndex] = (dvh2TableNode->GetName() ? dvh2TableNode->GetName() : "");
+
+    vtkMRMLTableNode* baselineTableNode = dvh2TableNode;
+    vtkMRMLTableNode* currentTableNode = dvh1TableNode;
+    if (dvh1TableNode->GetNumberOfRows() < dvh2TableNode->GetNumberOfRows())
+    {
+      baselineTableNode = dvh1TableNode;
+      currentTableNode = dvh2TableNode;
+    }
+
+    DvhComparisonPair& pair = pairs[pairIndex];
+    pair.BaselineDose = vtkDataArray::SafeDownCast(baselineTableNode->GetTable()->GetColumn(0));
+    pair.BaselineVolume = vtkDataArray::SafeDownCast(baselineTableNode->GetTable()->GetColumn(1));
+    pair.CurrentDose = vtkDataArray::SafeDownCast(currentTableNode->GetTable()->GetColumn(0));
+    pair.CurrentVolume = vtkDataArray::SafeDownCast(currentTableNode->GetTable()->GetColumn(1));
+    if (!pair.BaselineDose || !pair.BaselineVolume || !pair.CurrentDose || !pair.CurrentVolume)
+    {
+      vtkGenericWarningMacro("vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTablesBatch: DVH table columns are not numeric in pair " << pairIndex);
+      return false;
+    }
+
+    pair.TotalVolumeCCs = vtkSlicerDoseVolumeHistogramModuleLogic::GetDvhTableTotalAmount(currentTableNode);
+    if (pair.TotalVolumeCCs == 0)
+    {
+      vtkErrorWithObjectMacro(currentTableNode, "vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTablesBatch: Invalid volume for structure!");
+    }
+  }
+
+  // Compare all pairs in parallel
+  std::vector<DvhComparisonResult> results(numberOfPairs);
+  CompareDvhPairsFunctor functor(pairs, results, volumeDifferenceCriterion, doseToAgreementCriterion, doseMax, numberOfCommonDoseBins);
+  vtkSMPTools::For(0, numberOfPairs, 1, functor);
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DoseVolumeHistogram.CompareDvhTablesBatch", "Pairs", numberOfPairs);
+
+  // Fill result table, one row per pair
+  resultTable->Initialize();
+  vtkNew<vtkStringArray> dvh1NameColumn;
+  dvh1NameColumn->SetName("DVH 1");
+  dvh1NameColumn->SetNumberOfValues(numberOfPairs);
+  resultTable->AddColumn(dvh1NameColumn);
+  vtkNew<vtkStringArray> dvh2NameColumn;
+  dvh2NameColumn->SetName("DVH 2");
+  dvh2NameColumn->SetNumberOfValues(numberOfPairs);
+  resultTable->AddColumn(dvh2NameColumn);
+  const char* valueColumnNames[] = { "Agreement acceptance (%)", "Mean volume difference", "Max volume difference", "Dose at max volume difference" };
+  std::vector<vtkDoubleArray*> valueColumns;
+  for (int columnIndex=0; columnIndex<4; ++columnIndex)
+  {
+    vtkNew<vtkDoubleArray> column;
+    column->SetName(valueColumnNames[columnIndex]);
+    column->SetNumberOfValues(numberOfPairs);
+    resultTable->AddColumn(column);
+    valueColumns.push_back(column);
+  }
+  for (vtkIdType pairIndex=0; pairIndex<numberOfPairs; ++pairIndex)
+  {
+    dvh1NameColumn->SetValue(pairIndex, dvh1Names[pairIndex]);
+    dvh2NameColumn->SetValue(pairIndex, dvh2Names[pairIndex]);
+    valueColumns[0]->SetValue(pairIndex, results[pairIndex].AgreementAcceptancePercentage);
+    valueColumns[1]->SetValue(pairIndex, results[pairIndex].MeanVolumeDifference);
+    valueColumns[2]->SetValue(pairIndex, results[pairIndex].MaxVolumeDifference);
+    valueColumns[3]->SetValue(pairIndex, results[pairIndex].DoseAtMaxVolumeDifference);
+  }
+
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 double vtkSlicerDoseVolumeHistogramComparisonLogic::GetAgreementForDvhPlotPoint( vtkTable* referenceDvhPlot, vtkTable* compareDvhPlot,
                                                                                  unsigned int compareIndex, double totalVolumeCCs, double doseMax,
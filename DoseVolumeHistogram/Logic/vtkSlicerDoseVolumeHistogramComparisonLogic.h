@@ -31,6 +31,8 @@
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLTableNode.h>
 
+class vtkCollection;
+
 class VTK_SLICER_DOSEVOLUMEHISTOGRAM_LOGIC_EXPORT  vtkSlicerDoseVolumeHistogramComparisonLogic : public vtkObject
 {
 
@@ -44,6 +46,20 @@ public:
   static double CompareDvhTables( vtkMRMLTableNode* dvh1TableNode, vtkMRMLTableNode* dvh2TableNode, vtkMRMLScalarVolumeNode* doseVolumeNode, 
                                   double volumeDifferenceCriterion, double doseToAgreementCriterion, double doseMax=0.0 );
 
+  // Compare many DVH pairs in parallel. The ith table node in dvh1TableNodes is compared to the ith in dvh2TableNodes.
+  // Result table gets one row per pair with the columns
+  //   "DVH 1", "DVH 2": names of the compared table nodes
+  //   "Agreement acceptance (%)": same value as returned by CompareDvhTables for the pair
+  //   "Mean volume difference", "Max volume difference", "Dose at max volume difference": absolute volume
+  //     differences (in the unit of the volume column) of the DVHs resampled on a common dose axis
+  // If doseMax is not positive, then the maximum dose of each pair is the highest dose bin of the two DVHs.
+  // numberOfCommonDoseBins is the number of bins of the common dose axis (spanning from zero to the highest dose bin),
+  //   if not positive, then the number of rows of the longer DVH is used.
+  // Returns false if the inputs are invalid.
+  static bool CompareDvhTablesBatch( vtkCollection* dvh1TableNodes, vtkCollection* dvh2TableNodes, vtkTable* resultTable,
+                                     double volumeDifferenceCriterion, double doseToAgreementCriterion, double doseMax=0.0,
+                                     int numberOfCommonDoseBins=0 );
+
 protected:
   // Formula is (based on the article Ebert2010):
   //   gamma(i) = min{ Gamma[(di, vi), (dr, vr)] } for all {r=1..P}, where
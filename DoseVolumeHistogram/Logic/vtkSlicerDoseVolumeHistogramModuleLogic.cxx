@@ -21,9 +21,12 @@
 // DoseVolumeHistogram includes
 #include "vtkMRMLDoseVolumeHistogramNode.h"
 #include "vtkSlicerDoseVolumeHistogramModuleLogic.h"
+#include "vtkDoseSurfaceHistogramFilter.h"
+#include "vtkDoseVolumeHistogramArchive.h"
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtPerformanceMonitor.h"
 #include "vtkFractionalImageAccumulate.h"
 
 // Segmentations includes
@@ -57,24 +60,31 @@
 #include <vtkDoubleArray.h>
 #include <vtkFieldData.h>
 #include <vtkImageAccumulate.h>
+#include <vtkImageCast.h>
 #include <vtkImageConstantPad.h>
-#include <vtkImageDilateErode3D.h>
-#include <vtkImageMathematics.h>
 #include <vtkImageStencilData.h>
 #include <vtkImageToImageStencil.h>
 #include <vtkMath.h>
+#include <vtkMatrix4x4.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkPiecewiseFunction.h>
+#include <vtkPolyData.h>
+#include <vtkSMPTools.h>
 #include <vtkStringArray.h>
 #include <vtkTable.h>
-#include <vtkTimerLog.h>
 #include <vtkWeakPointer.h>
 
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
 // STD includes
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <locale>
 #include <set>
 
 //----------------------------------------------------------------------------
@@ -90,6 +100,7 @@ const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_SURFACE_INSIDE_AT
 
 const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_STRUCTURE = "Structure";
 const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_VOLUME_CC = "Volume (cc)";
+const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_SURFACE_AREA_CM2 = "Surface area (cm2)";
 const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_MEAN_PREFIX = "Mean ";
 const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_MIN_PREFIX = "Min ";
 const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_MAX_PREFIX = "Max ";
@@ -99,6 +110,219 @@ const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_TABLE_NODE_NAME_P
 
 const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE = " Value (% of ";
 const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_CSV_HEADER_VOLUME_FIELD_END = " cc)";
+const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_CSV_HEADER_SURFACE_AREA_FIELD_END = " cm2)";
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //---------------------------------------------------------------------------
+  /// Split a CSV line into fields, given as [begin, end) character ranges of the line
+  void SplitCsvLine(const std::string& line, char separator, std::vector<std::pair<size_t, size_t> >& fields)
+  {
+    fields.clear();
+    size_t fieldBegin = 0;
+    size_t separatorPosition = line.find(separator);
+    while (separatorPosition != std::string::npos)
+    {
+      fields.push_back(std::make_pair(fieldBegin, separatorPosition));
+      fieldBegin = separatorPosition + 1;
+      separatorPosition = line.find(separator, fieldBegin);
+    }
+    if (fieldBegin < line.size())
+    {
+      fields.push_back(std::make_pair(fieldBegin, line.size()));
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  /// Parse number in a CSV field. Empty or invalid fields are zero
+  /// \param decimalComma Comma is the decimal separator (tab separated files written with the comma flag off)
+  double ParseCsvNumber(const std::string& line, const std::pair<size_t, size_t>& field, bool decimalComma)
+  {
+    char numberString[64] = {0};
+    size_t length = std::min<size_t>(field.second - field.first, sizeof(numberString) - 1);
+    if (length == 0)
+    {
+      return 0.0;
+    }
+    memcpy(numberString, line.c_str() + field.first, length);
+    if (decimalComma)
+    {
+      char* commaPosition = strchr(numberString, ',');
+      if (commaPosition)
+      {
+        (*commaPosition) = '.';
+      }
+    }
+    return strtod(numberString, NULL);
+  }
+
+  //---------------------------------------------------------------------------
+  /// Format DVH value for CSV export with fixed six decimals
+  void WriteCsvNumber(std::ostream& outfile, double value, bool comma)
+  {
+    char numberString[64] = {0};
+    snprintf(numberString, sizeof(numberString), "%.6f", value);
+    // The decimal separator written by snprintf depends on the C locale of the application, so replace
+    // it (the first character that is not a sign or digit, unless it is inf or nan) with the one required by the file format
+    char* separatorPosition = numberString + strspn(numberString, "-0123456789");
+    if (*separatorPosition != '\0' && !isalpha((unsigned char)(*separatorPosition)))
+    {
+      (*separatorPosition) = (comma ? '.' : ',');
+    }
+    outfile << numberString;
+  }
+
+  //---------------------------------------------------------------------------
+  /// Tolerance of the off-diagonal elements of the sampling grid to dose grid index transform
+  /// for considering the two grids axis aligned
+  const double DOSE_SAMPLING_AXIS_ALIGNMENT_TOLERANCE = 1e-6;
+
+  //---------------------------------------------------------------------------
+  /// Linear interpolation positions and weights along one axis of the sampling grid
+  struct DoseSamplingAxis
+  {
+    /// Dose index of the lower neighbor of each sample
+    std::vector<int> LowerIndex;
+    /// Dose index of the upper neighbor of each sample
+    std::vector<int> UpperIndex;
+    /// Weight of the upper neighbor
+    std::vector<float> Weight;
+    /// One if the sample is inside the dose volume, zero otherwise
+    std::vector<float> Mask;
+    /// Range of dose indices used by the samples inside the dose volume (empty if none is inside)
+    int MinimumIndex;
+    int MaximumIndex;
+  };
+
+  //---------------------------------------------------------------------------
+  /// Compute interpolation positions along an axis, where the dose index of sample n is
+  /// scale * (firstSampleIndex + n) + offset. Samples are clamped to the dose volume up to half a voxel
+  /// outside (same as the border mode of vtkImageReslice), and are outside beyond that.
+  void ComputeDoseSamplingAxis(double scale, double offset, int firstSampleIndex, int numberOfSamples,
+    int doseDimension, DoseSamplingAxis& axis)
+  {
+    axis.LowerIndex.assign(numberOfSamples, 0);
+    axis.UpperIndex.assign(numberOfSamples, 0);
+    axis.Weight.assign(numberOfSamples, 0.0f);
+    axis.Mask.assign(numberOfSamples, 0.0f);
+    axis.MinimumIndex = doseDimension;
+    axis.MaximumIndex = -1;
+    for (int sampleIndex=0; sampleIndex<numberOfSamples; ++sampleIndex)
+    {
+      double position = scale * (firstSampleIndex + sampleIndex) + offset;
+      if (position < -0.5 || position > doseDimension - 0.5)
+      {
+        continue;
+      }
+      position = std::min(std::max(position, 0.0), static_cast<double>(doseDimension - 1));
+      int lowerIndex = std::min(static_cast<int>(floor(position)), doseDimension - 1);
+      int upperIndex = std::min(lowerIndex + 1, doseDimension - 1);
+      axis.LowerIndex[sampleIndex] = lowerIndex;
+      axis.UpperIndex[sampleIndex] = upperIndex;
+      axis.Weight[sampleIndex] = static_cast<float>(position - lowerIndex);
+      axis.Mask[sampleIndex] = 1.0f;
+      axis.MinimumIndex = std::min(axis.MinimumIndex, lowerIndex);
+      axis.MaximumIndex = std::max(axis.MaximumIndex, upperIndex);
+    }
+  }
+
+  //---------------------------------------------------------------------------
+  /// Interpolates dose on a range of slices of an axis aligned sampling grid.
+  /// For each output row the dose rows of the two neighboring dose slices and rows are first blended
+  /// in the dose resolution, then the samples of the row are interpolated from the blended row.
+  /// Both loops run on contiguous arrays without branches, so that the compiler can vectorize them.
+  class DoseSamplingFunctor
+  {
+  public:
+    DoseSamplingFunctor()
+      : DoseScalars(NULL)
+      , OutputScalars(NULL)
+    {
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      const int numberOfColumns = static_cast<int>(this->AxisX.Mask.size());
+      const int numberOfRows = static_cast<int>(this->AxisY.Mask.size());
+      const vtkIdType doseRowSize = this->DoseDimensions[0];
+      const vtkIdType doseSliceSize = doseRowSize * this->DoseDimensions[1];
+      const int doseRowBegin = this->AxisX.MinimumIndex;
+      const int blendedRowLength = this->AxisX.MaximumIndex - this->AxisX.MinimumIndex + 1;
+
+      // Dose indices relative to the blended row
+      std::vector<int> lowerColumn(numberOfColumns, 0);
+      std::vector<int> upperColumn(numberOfColumns, 0);
+      for (int column=0; column<numberOfColumns; ++column)
+      {
+        if (this->AxisX.Mask[column] > 0.0f)
+        {
+          lowerColumn[column] = this->AxisX.LowerIndex[column] - doseRowBegin;
+          upperColumn[column] = this->AxisX.UpperIndex[column] - doseRowBegin;
+        }
+      }
+      const int* lowerColumnPtr = &(lowerColumn[0]);
+      const int* upperColumnPtr = &(upperColumn[0]);
+      const float* weightXPtr = &(this->AxisX.Weight[0]);
+      const float* maskXPtr = &(this->AxisX.Mask[0]);
+      std::vector<float> blendedRow(blendedRowLength, 0.0f);
+      float* blendedRowPtr = &(blendedRow[0]);
+
+      for (vtkIdType slice=beginSlice; slice<endSlice; ++slice)
+      {
+        float* outputSlicePtr = this->OutputScalars + slice * numberOfRows * numberOfColumns;
+        if (this->AxisZ.Mask[slice] == 0.0f)
+        {
+          std::fill(outputSlicePtr, outputSlicePtr + numberOfRows * numberOfColumns, 0.0f);
+          continue;
+        }
+        const float* lowerSlicePtr = this->DoseScalars + this->AxisZ.LowerIndex[slice] * doseSliceSize + doseRowBegin;
+        const float* upperSlicePtr = this->DoseScalars + this->AxisZ.UpperIndex[slice] * doseSliceSize + doseRowBegin;
+        const float weightZ = this->AxisZ.Weight[slice];
+
+        for (int row=0; row<numberOfRows; ++row)
+        {
+          float* outputRowPtr = outputSlicePtr + row * numberOfColumns;
+          if (this->AxisY.Mask[row] == 0.0f)
+          {
+            std::fill(outputRowPtr, outputRowPtr + numberOfColumns, 0.0f);
+            continue;
+          }
+          const vtkIdType lowerRowOffset = this->AxisY.LowerIndex[row] * doseRowSize;
+          const vtkIdType upperRowOffset = this->AxisY.UpperIndex[row] * doseRowSize;
+          const float* dose00 = lowerSlicePtr + lowerRowOffset;
+          const float* dose01 = lowerSlicePtr + upperRowOffset;
+          const float* dose10 = upperSlicePtr + lowerRowOffset;
+          const float* dose11 = upperSlicePtr + upperRowOffset;
+          const float weightY = this->AxisY.Weight[row];
+
+          // Blend the four neighboring dose rows in Y and Z
+          for (int doseColumn=0; doseColumn<blendedRowLength; ++doseColumn)
+          {
+            float lowerSliceDose = dose00[doseColumn] + (dose01[doseColumn] - dose00[doseColumn]) * weightY;
+            float upperSliceDose = dose10[doseColumn] + (dose11[doseColumn] - dose10[doseColumn]) * weightY;
+            blendedRowPtr[doseColumn] = lowerSliceDose + (upperSliceDose - lowerSliceDose) * weightZ;
+          }
+
+          // Interpolate samples in X
+          for (int column=0; column<numberOfColumns; ++column)
+          {
+            float lowerDose = blendedRowPtr[lowerColumnPtr[column]];
+            float upperDose = blendedRowPtr[upperColumnPtr[column]];
+            outputRowPtr[column] = (lowerDose + (upperDose - lowerDose) * weightXPtr[column]) * maskXPtr[column];
+          }
+        }
+      }
+    }
+
+    const float* DoseScalars;
+    int DoseDimensions[3];
+    DoseSamplingAxis AxisX;
+    DoseSamplingAxis AxisY;
+    DoseSamplingAxis AxisZ;
+    float* OutputScalars;
+  };
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseVolumeHistogramModuleLogic);
@@ -234,9 +458,15 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   segmentationCopy->SetConversionParameter( vtkClosedSurfaceToBinaryLabelmapConversionRule::GetOversamplingFactorParameterName(),
     parameterNode->GetAutomaticOversampling() ? "A" : fixedOversamplingValueStream.str().c_str() );
 
+  // Dose surface histogram is computed from the closed surface, sampling the original dose volume directly
+  bool computeDoseSurfaceHistogram = parameterNode->GetDoseSurfaceHistogram();
   char* representationName = 0;
   bool useFractionalLabelmap = parameterNode->GetUseFractionalLabelmap();
-  if (useFractionalLabelmap)
+  if (computeDoseSurfaceHistogram)
+  {
+    representationName = (char*)vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName();
+  }
+  else if (useFractionalLabelmap)
   {
     representationName = (char*)vtkSegmentationConverter::GetSegmentationFractionalLabelmapRepresentationName();
   }
@@ -252,7 +482,8 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     // If conversion failed and there is no binary labelmap in the segmentation, then cannot calculate DVH
     if (!segmentationCopy->ContainsRepresentation(representationName) )
     {
-      std::string errorMessage("Unable to acquire binary labelmap from segmentation");
+      std::string errorMessage( computeDoseSurfaceHistogram ? "Unable to acquire closed surface from segmentation"
+        : "Unable to acquire binary labelmap from segmentation" );
       vtkErrorMacro("ComputeDvh: " << errorMessage);
       return errorMessage;
     }
@@ -262,7 +493,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   }
 
   // Calculate and store oversampling factors if automatically calculated for reporting purposes
-  if (parameterNode->GetAutomaticOversampling())
+  if (parameterNode->GetAutomaticOversampling() && !computeDoseSurfaceHistogram)
   {
     // Get spacing for dose volume
     double doseSpacing[3] = {0.0,0.0,0.0};
@@ -295,22 +526,37 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     }
   }
 
-  // Use the same resampled dose volume if oversampling is fixed
-  vtkSmartPointer<vtkOrientedImageData> fixedOversampledDoseVolume;
-  if (!parameterNode->GetAutomaticOversampling())
+  // The oversampled dose is not created for the whole dose volume. Instead, the dose is interpolated
+  // at the voxel centers of each segment labelmap, only within the extent of the segment
+  vtkSmartPointer<vtkOrientedImageData> floatDoseImageData;
+  vtkSmartPointer<vtkOrientedImageData> fixedOversampledDoseGeometry;
+  if (!computeDoseSurfaceHistogram)
   {
-    // Get geometry of oversampled dose volume
-    fixedOversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
-    fixedOversampledDoseVolume->ShallowCopy(doseImageData);
-    vtkCalculateOversamplingFactor::ApplyOversamplingOnImageGeometry(fixedOversampledDoseVolume, this->DefaultDoseVolumeOversamplingFactor);
+    // Dose sampling needs float scalars, make the float copy only once for all segments
+    if (doseImageData->GetScalarType() == VTK_FLOAT)
+    {
+      floatDoseImageData = doseImageData;
+    }
+    else
+    {
+      vtkNew<vtkImageCast> doseCast;
+      doseCast->SetInputData(doseImageData);
+      doseCast->SetOutputScalarTypeToFloat();
+      doseCast->Update();
+      floatDoseImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+      floatDoseImageData->ShallowCopy(doseCast->GetOutput());
+      floatDoseImageData->CopyDirections(doseImageData);
+    }
 
-    // Resample dose volume using linear interpolation
-    if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
-      doseImageData, fixedOversampledDoseVolume, fixedOversampledDoseVolume, true ) )
+    // Geometry of the oversampled dose volume if oversampling is fixed (without scalars)
+    if (!parameterNode->GetAutomaticOversampling())
     {
-      std::string errorMessage("Failed to resample dose volume");
-      vtkErrorMacro("ComputeDvh: " << errorMessage);
-      return errorMessage;
+      vtkNew<vtkMatrix4x4> doseImageToWorldMatrix;
+      doseImageData->GetImageToWorldMatrix(doseImageToWorldMatrix.GetPointer());
+      fixedOversampledDoseGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+      fixedOversampledDoseGeometry->SetGeometryFromImageToWorldMatrix(doseImageToWorldMatrix.GetPointer());
+      fixedOversampledDoseGeometry->SetExtent(doseImageData->GetExtent());
+      vtkCalculateOversamplingFactor::ApplyOversamplingOnImageGeometry(fixedOversampledDoseGeometry, this->DefaultDoseVolumeOversamplingFactor);
     }
   }
 
@@ -324,6 +570,37 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     std::string segmentID = *segmentIdIt;
     vtkSegment* segment = segmentationCopy->GetSegment(*segmentIdIt);
 
+    // Calculate DSH for current segment from its closed surface
+    if (computeDoseSurfaceHistogram)
+    {
+      vtkPolyData* segmentSurface = vtkPolyData::SafeDownCast(segment->GetRepresentation(representationName));
+      if (!segmentSurface)
+      {
+        std::string errorMessage("Failed to get closed surface for segments");
+        vtkErrorMacro("ComputeDvh: " << errorMessage);
+        return errorMessage;
+      }
+      if ( segmentationNode->GetParentTransformNode()
+        && !vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToPolyData(segmentationNode, segmentSurface) )
+      {
+        std::string errorMessage("Failed to apply parent transformation to segment");
+        vtkErrorMacro("ComputeDvh: " << errorMessage);
+        return errorMessage;
+      }
+
+      std::string errorMessage = this->ComputeDsh(parameterNode, segmentSurface, doseImageData, segmentID, maxDose);
+      if (!errorMessage.empty())
+      {
+        vtkErrorMacro("ComputeDvh: " << errorMessage);
+        return errorMessage;
+      }
+
+      // Update progress bar
+      double progress = (double)counter / (double)numberOfSelectedSegments;
+      this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+      continue;
+    }
+
     // Get segment labelmap
     vtkOrientedImageData* segmentLabelmap = vtkOrientedImageData::SafeDownCast( segment->GetRepresentation(
       representationName ) );
@@ -359,7 +636,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     {
       // Resample segmentation labelmap volume
       if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
-        segmentLabelmap, fixedOversampledDoseVolume, segmentLabelmap, useFractionalLabelmap, false, NULL, minimumValue ) )
+        segmentLabelmap, fixedOversampledDoseGeometry, segmentLabelmap, useFractionalLabelmap, false, NULL, minimumValue ) )
       {
         std::string errorMessage("Failed to resample segment binary labelmap");
         vtkErrorMacro("ComputeDvh: " << errorMessage);
@@ -367,32 +644,52 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
       }
     }
 
-    // Get oversampled dose volume
-    vtkSmartPointer<vtkOrientedImageData> oversampledDoseVolume;
-    // Use the same resampled dose volume if oversampling is fixed
-    if (!parameterNode->GetAutomaticOversampling())
+    // Determine the extent in which the dose is sampled: the segment with a margin of one voxel (so that the stencil
+    // is valid for thin segments too), or the whole labelmap if the segment is empty.
+    // In case of fixed oversampling the extent is limited to the oversampled dose volume, in case of automatic
+    // oversampling the dose is zero in the parts of the segment outside the dose volume
+    int extent[6] = {0,-1,0,-1,0,-1};
+    if (vtkOrientedImageDataResample::CalculateEffectiveExtent(segmentLabelmap, extent, minimumValue))
     {
-      oversampledDoseVolume = fixedOversampledDoseVolume;
+      for (int axis=0; axis<3; ++axis)
+      {
+        extent[2*axis] -= 1;
+        extent[2*axis+1] += 1;
+      }
     }
-    // Resample dose volume to match automatically oversampled segment labelmap geometry
     else
     {
-      oversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
-      if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
-        doseImageData, segmentLabelmap, oversampledDoseVolume, true ) )
+      segmentLabelmap->GetExtent(extent);
+    }
+    if (fixedOversampledDoseGeometry.GetPointer())
+    {
+      int doseExtent[6] = {0,-1,0,-1,0,-1};
+      fixedOversampledDoseGeometry->GetExtent(doseExtent);
+      for (int axis=0; axis<3; ++axis)
       {
-        std::string errorMessage("Failed to resample dose volume");
-        vtkErrorMacro("ComputeDvh: " << errorMessage);
-        return errorMessage;
+        extent[2*axis] = std::max(extent[2*axis], doseExtent[2*axis]);
+        extent[2*axis+1] = std::min(extent[2*axis+1], doseExtent[2*axis+1]);
+      }
+      if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+      {
+        // Segment is outside the dose volume, the DVH is computed on the dose extent with no voxels in the segment
+        fixedOversampledDoseGeometry->GetExtent(extent);
       }
     }
 
-    // Make sure the segment labelmap is the same dimension as the dose volume
+    // Interpolate dose on the segment labelmap grid
+    vtkSmartPointer<vtkOrientedImageData> oversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkSlicerDoseVolumeHistogramModuleLogic::SampleDoseOnLabelmapGrid(floatDoseImageData, segmentLabelmap, extent, oversampledDoseVolume))
+    {
+      std::string errorMessage("Failed to resample dose volume");
+      vtkErrorMacro("ComputeDvh: " << errorMessage);
+      return errorMessage;
+    }
+
+    // Make sure the segment labelmap has the same extent as the sampled dose
     vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
     padder->SetInputData(segmentLabelmap);
     padder->SetConstant(minimumValue);
-    int extent[6] = {0,-1,0,-1,0,-1};
-    oversampledDoseVolume->GetExtent(extent);
     padder->SetOutputWholeExtent(extent);
     padder->Update();
     segmentLabelmap->vtkImageData::DeepCopy(padder->GetOutput());
@@ -444,63 +741,16 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     vtkErrorMacro("ComputeDvh: " << errorMessage);
     return errorMessage;
   }
-  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
   vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
-  if ( !segmentationNode || !doseVolumeNode )
+  if (!parameterNode->GetSegmentationNode() || !doseVolumeNode)
   {
     std::string errorMessage("Both segmentation node and dose volume node need to be set");
     vtkErrorMacro("ComputeDvh: " << errorMessage);
     return errorMessage;
   }
-  std::string segmentName = parameterNode->GetSegmentationNode()->GetSegmentation()->GetSegment(segmentID)->GetName();
   bool isDoseVolume = vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode);
 
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
-  double checkpointStart = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
-
-  // If the user has enabled the flag to calculate the dose surface histogram, then extract the surface from the labelmap
-  if (parameterNode->GetDoseSurfaceHistogram())
-  {
-    if (parameterNode->GetUseFractionalLabelmap())
-    {
-      std::string errorMessage("Dose surface histogram is not currently supported for fractional labelmaps");
-      vtkErrorMacro("ComputeDvh: " << errorMessage);
-      return errorMessage;
-    }
-
-    double dilateValue = 0.0;
-    double erodeValue = 1.0;
-    if (!parameterNode->GetUseInsideDoseSurface())
-    {
-      dilateValue = 1.0;
-      erodeValue = 0.0;
-    }
-
-    // Current implementation uses the segment labelmap and gets its inner or outer shell to calculate the DSH.
-    // However, the limitation of this is that it does not support open contours. It would be more comprehensive
-    // to use the original planar contour and probe filter to get the surface dose points.
-    vtkNew<vtkImageDilateErode3D> dilateErodeFilter;
-    dilateErodeFilter->SetInputData(segmentLabelmap);
-    dilateErodeFilter->SetErodeValue(erodeValue);
-    dilateErodeFilter->SetDilateValue(dilateValue);
-    dilateErodeFilter->SetKernelSize(3, 3, 3);
-
-    vtkNew<vtkImageMathematics> imageMathematics;
-    imageMathematics->SetOperationToSubtract();
-    if (parameterNode->GetUseInsideDoseSurface())
-    {
-      imageMathematics->SetInput1Data(segmentLabelmap);
-      imageMathematics->SetInputConnection(1, dilateErodeFilter->GetOutputPort());
-    }
-    else
-    {
-      imageMathematics->SetInputConnection(0, dilateErodeFilter->GetOutputPort());
-      imageMathematics->SetInput2Data(segmentLabelmap);
-    }
-    imageMathematics->Update();
-    segmentLabelmap->vtkImageData::DeepCopy(imageMathematics->GetOutput());
-  }
+  vtkSlicerRtScopedTimer timer("DoseVolumeHistogram.ComputeDvh", this->LogSpeedMeasurements);
 
   // Create stencil for structure
   vtkNew<vtkImageToImageStencil> stencil;
@@ -571,6 +821,277 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     return errorMessage;
   }
 
+  // Get spacing and voxel volume
+  double* segmentLabelmapSpacing = segmentLabelmap->GetSpacing();
+  double cubicMMPerVoxel = segmentLabelmapSpacing[0] * segmentLabelmapSpacing[1] * segmentLabelmapSpacing[2];
+  double ccPerCubicMM = 0.001;
+
+  // Volume (cc)
+  double totalVoxels = 0;
+  if (useFractionalLabelmap)
+  {
+    totalVoxels = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount();
+  }
+  else
+  {
+    totalVoxels = structureStat->GetVoxelCount();
+  }
+  double volumeCc = totalVoxels * cubicMMPerVoxel * ccPerCubicMM;
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DoseVolumeHistogram.ComputeDvh", "Voxels", structureStat->GetVoxelCount());
+
+  // Create DVH plot values
+  int numSamples = 0;
+  double startValue = 0.0;
+  double stepSize = 0.0;
+  double rangeMin = structureStat->GetMin()[0];
+  double rangeMax = structureStat->GetMax()[0];
+  std::string errorMessage = this->GetHistogramBinning(isDoseVolume, rangeMin, rangeMax, maxDoseGy, startValue, stepSize, numSamples);
+  if (!errorMessage.empty())
+  {
+    vtkErrorMacro("ComputeDvh: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Get the number of voxels with smaller dose than at the start value
+  structureStat->SetComponentExtent(0,1,0,0,0,0);
+  structureStat->SetComponentOrigin(0,0,0);
+  structureStat->SetComponentSpacing(startValue,1,1);
+  structureStat->Update();
+  double voxelBelowDose = structureStat->GetOutput()->GetScalarComponentAsDouble(0,0,0,0);
+
+  structureStat->SetComponentExtent(0,numSamples-1,0,0,0,0);
+  structureStat->SetComponentOrigin(startValue,0,0);
+  structureStat->SetComponentSpacing(stepSize,1,1);
+  structureStat->Update();
+
+  vtkImageData* statArray = structureStat->GetOutput();
+  std::vector<double> voxelsInBins(numSamples, 0.0);
+  for (int sampleIndex=0; sampleIndex<numSamples; ++sampleIndex)
+  {
+    voxelsInBins[sampleIndex] = statArray->GetScalarComponentAsDouble(sampleIndex,0,0,0);
+  }
+
+  errorMessage = this->StoreDvhResults(parameterNode, segmentID, volumeCc,
+    structureStat->GetMean()[0], rangeMin, rangeMax,
+    startValue, stepSize, voxelBelowDose, voxelsInBins, totalVoxels);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+
+  // Log measured time
+  timer.Stop();
+  if (this->LogSpeedMeasurements)
+  {
+    vtkDebugMacro("ComputeDvh: DVH computation time for structure '" << segmentID << "': " << timer.GetElapsedSeconds() << " s");
+  }
+
+  return ""; // No error
+} // end ComputeDvh
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::SampleDoseOnLabelmapGrid(vtkOrientedImageData* doseImageData,
+  vtkOrientedImageData* labelmapGeometry, int extent[6], vtkOrientedImageData* sampledDose)
+{
+  if (!doseImageData || !labelmapGeometry || !sampledDose)
+  {
+    vtkGenericWarningMacro("vtkSlicerDoseVolumeHistogramModuleLogic::SampleDoseOnLabelmapGrid: Invalid input arguments");
+    return false;
+  }
+  if (doseImageData->GetScalarType() != VTK_FLOAT || !doseImageData->GetScalarPointer())
+  {
+    vtkGenericWarningMacro("vtkSlicerDoseVolumeHistogramModuleLogic::SampleDoseOnLabelmapGrid: Dose image needs to have float scalars");
+    return false;
+  }
+  if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+  {
+    vtkGenericWarningMacro("vtkSlicerDoseVolumeHistogramModuleLogic::SampleDoseOnLabelmapGrid: Empty sampling extent");
+    return false;
+  }
+
+  // Output has the geometry of the labelmap, restricted to the extent
+  vtkNew<vtkMatrix4x4> labelmapImageToWorldMatrix;
+  labelmapGeometry->GetImageToWorldMatrix(labelmapImageToWorldMatrix.GetPointer());
+  sampledDose->SetGeometryFromImageToWorldMatrix(labelmapImageToWorldMatrix.GetPointer());
+  sampledDose->SetExtent(extent);
+  sampledDose->AllocateScalars(VTK_FLOAT, 1);
+
+  // Transform from sampling grid index to dose index
+  vtkNew<vtkMatrix4x4> doseWorldToImageMatrix;
+  doseImageData->GetWorldToImageMatrix(doseWorldToImageMatrix.GetPointer());
+  vtkNew<vtkMatrix4x4> samplingToDoseIjkMatrix;
+  vtkMatrix4x4::Multiply4x4(doseWorldToImageMatrix.GetPointer(), labelmapImageToWorldMatrix.GetPointer(), samplingToDoseIjkMatrix.GetPointer());
+
+  bool axisAligned = true;
+  for (int row=0; row<3; ++row)
+  {
+    for (int column=0; column<3; ++column)
+    {
+      if (row != column && fabs(samplingToDoseIjkMatrix->GetElement(row, column)) > DOSE_SAMPLING_AXIS_ALIGNMENT_TOLERANCE)
+      {
+        axisAligned = false;
+      }
+    }
+  }
+  if (!axisAligned)
+  {
+    // Rotated grids are rare (the labelmaps are converted or resampled in the dose geometry), use the generic resampling
+    return vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      doseImageData, sampledDose, sampledDose, true );
+  }
+
+  // Precompute interpolation positions and weights per axis
+  int doseExtent[6] = {0,-1,0,-1,0,-1};
+  doseImageData->GetExtent(doseExtent);
+  DoseSamplingFunctor functor;
+  functor.DoseScalars = static_cast<const float*>(doseImageData->GetScalarPointer());
+  doseImageData->GetDimensions(functor.DoseDimensions);
+  functor.OutputScalars = static_cast<float*>(sampledDose->GetScalarPointer());
+  DoseSamplingAxis* axes[3] = { &functor.AxisX, &functor.AxisY, &functor.AxisZ };
+  bool overlapping = true;
+  for (int axis=0; axis<3; ++axis)
+  {
+    ComputeDoseSamplingAxis(samplingToDoseIjkMatrix->GetElement(axis, axis),
+      samplingToDoseIjkMatrix->GetElement(axis, 3) - doseExtent[2*axis],
+      extent[2*axis], extent[2*axis+1] - extent[2*axis] + 1, functor.DoseDimensions[axis], *(axes[axis]));
+    if (axes[axis]->MaximumIndex < 0)
+    {
+      overlapping = false;
+    }
+  }
+  if (!overlapping)
+  {
+    // Sampling extent is completely outside the dose volume
+    std::fill(functor.OutputScalars, functor.OutputScalars + sampledDose->GetNumberOfPoints(), 0.0f);
+    return true;
+  }
+
+  vtkSMPTools::For(0, extent[5] - extent[4] + 1, functor);
+  return true;
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDsh(vtkMRMLDoseVolumeHistogramNode* parameterNode, vtkPolyData* segmentSurface, vtkOrientedImageData* doseImageData, std::string segmentID, double maxDoseGy)
+{
+  if (!this->GetMRMLScene() || !parameterNode)
+  {
+    std::string errorMessage("Invalid MRML scene or parameter set node");
+    vtkErrorMacro("ComputeDsh: " << errorMessage);
+    return errorMessage;
+  }
+  if (!segmentSurface || !doseImageData)
+  {
+    std::string errorMessage("Invalid segment surface or dose volume");
+    vtkErrorMacro("ComputeDsh: " << errorMessage);
+    return errorMessage;
+  }
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  if (!parameterNode->GetSegmentationNode() || !doseVolumeNode)
+  {
+    std::string errorMessage("Both segmentation node and dose volume node need to be set");
+    vtkErrorMacro("ComputeDsh: " << errorMessage);
+    return errorMessage;
+  }
+  bool isDoseVolume = vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode);
+
+  vtkSlicerRtScopedTimer timer("DoseVolumeHistogram.ComputeDsh", this->LogSpeedMeasurements);
+
+  // Sample the dose half a dose voxel inside or outside the surface, which is where the centers
+  // of the boundary voxels are on average
+  double* doseSpacing = doseImageData->GetSpacing();
+  double surfaceOffsetMm = 0.5 * std::min(std::min(doseSpacing[0], doseSpacing[1]), doseSpacing[2]);
+  if (parameterNode->GetUseInsideDoseSurface())
+  {
+    surfaceOffsetMm = -surfaceOffsetMm;
+  }
+
+  vtkNew<vtkDoseSurfaceHistogramFilter> surfaceSampler;
+  surfaceSampler->SetInputSurface(segmentSurface);
+  surfaceSampler->SetDoseImageData(doseImageData);
+  surfaceSampler->SetSurfaceOffsetMm(surfaceOffsetMm);
+  surfaceSampler->Update();
+
+  // Report error if no samples could be taken from the dose volume
+  if (surfaceSampler->GetNumberOfSamples() < 1 || surfaceSampler->GetSampledAreaMm2() <= 0.0)
+  {
+    std::string errorMessage("Dose volume and the structure do not overlap"); // User-friendly error to help troubleshooting
+    vtkErrorMacro("ComputeDsh: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Create DSH plot values
+  int numSamples = 0;
+  double startValue = 0.0;
+  double stepSize = 0.0;
+  double rangeMin = surfaceSampler->GetMinimumDose();
+  double rangeMax = surfaceSampler->GetMaximumDose();
+  std::string errorMessage = this->GetHistogramBinning(isDoseVolume, rangeMin, rangeMax, maxDoseGy, startValue, stepSize, numSamples);
+  if (!errorMessage.empty())
+  {
+    vtkErrorMacro("ComputeDsh: " << errorMessage);
+    return errorMessage;
+  }
+
+  surfaceSampler->SetHistogramOrigin(startValue);
+  surfaceSampler->SetHistogramBinSpacing(stepSize);
+  surfaceSampler->SetNumberOfHistogramBins(numSamples);
+  surfaceSampler->Update();
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DoseVolumeHistogram.ComputeDsh", "Surface samples", surfaceSampler->GetNumberOfSamples());
+
+  double squareMMToSquareCm = 0.01;
+  errorMessage = this->StoreDvhResults(parameterNode, segmentID, surfaceSampler->GetSampledAreaMm2() * squareMMToSquareCm,
+    surfaceSampler->GetMeanDose(), rangeMin, rangeMax,
+    startValue, stepSize, surfaceSampler->GetAreaBelowHistogramOriginMm2(), surfaceSampler->GetHistogramAreasMm2(),
+    surfaceSampler->GetSampledAreaMm2() );
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+
+  // Log measured time
+  timer.Stop();
+  if (this->LogSpeedMeasurements)
+  {
+    vtkDebugMacro("ComputeDsh: DSH computation time for structure '" << segmentID << "': " << timer.GetElapsedSeconds() << " s");
+  }
+
+  return ""; // No error
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::GetHistogramBinning(bool isDoseVolume, double rangeMin, double rangeMax, double maxDoseGy, double &startValue, double &stepSize, int &numSamples)
+{
+  if (isDoseVolume)
+  {
+    if (rangeMin<0)
+    {
+      return "The dose volume contains negative dose values";
+    }
+
+    startValue = this->StartValue;
+    stepSize = this->StepSize;
+    numSamples = (int)ceil( (maxDoseGy-startValue)/stepSize ) + 1;
+  }
+  else
+  {
+    startValue = rangeMin;
+    numSamples = this->NumberOfSamplesForNonDoseVolumes;
+    stepSize = (rangeMax - rangeMin) / (double)(numSamples-1);
+  }
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::StoreDvhResults(vtkMRMLDoseVolumeHistogramNode* parameterNode, std::string segmentID,
+  double totalVolumeOrArea, double meanDose, double minDose, double maxDose,
+  double startValue, double stepSize, double amountBelowStartValue, const std::vector<double>& amountsInBins, double totalAmount)
+{
+  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  std::string segmentName = segmentationNode->GetSegmentation()->GetSegment(segmentID)->GetName();
+  bool isDoseVolume = vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode);
+  int numSamples = static_cast<int>(amountsInBins.size());
+
   // Get metrics table for the parameter node; Create one if missing
   vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
   vtkTable* metricsTable = metricsTableNode->GetTable();
@@ -607,13 +1128,6 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     tableNode->Delete(); // Release ownership to scene only
     metricsTable->InsertNextBlankRow();
 
-    // Dose surface histogram attributes
-    if (parameterNode->GetDoseSurfaceHistogram())
-    {
-      tableNode->SetAttribute(DVH_SURFACE_ATTRIBUTE_NAME.c_str(), "1");
-      tableNode->SetAttribute(DVH_SURFACE_INSIDE_ATTRIBUTE_NAME.c_str(), parameterNode->GetUseInsideDoseSurface() ? "1" : "0");
-    }
-
     // Set node references
     metricsTableNode->SetNodeReferenceID(structureDvhNodeRef.c_str(), tableNode->GetID());
     tableNode->SetNodeReferenceID(vtkMRMLDoseVolumeHistogramNode::DOSE_VOLUME_REFERENCE_ROLE, doseVolumeNode->GetID());
@@ -638,11 +1152,18 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   std::ostringstream oversamplingAttrValueStream;
   oversamplingAttrValueStream << (parameterNode->GetAutomaticOversampling() ? (-1.0) : this->DefaultDoseVolumeOversamplingFactor);
   tableNode->SetAttribute(DVH_DOSE_VOLUME_OVERSAMPLING_FACTOR_ATTRIBUTE_NAME.c_str(), oversamplingAttrValueStream.str().c_str());
-
-  // Get spacing and voxel volume
-  double* segmentLabelmapSpacing = segmentLabelmap->GetSpacing();
-  double cubicMMPerVoxel = segmentLabelmapSpacing[0] * segmentLabelmapSpacing[1] * segmentLabelmapSpacing[2];
-  double ccPerCubicMM = 0.001;
+  // Dose surface histogram attributes (the table may have contained the other kind of histogram for the segment)
+  bool doseSurfaceHistogram = parameterNode->GetDoseSurfaceHistogram();
+  if (doseSurfaceHistogram)
+  {
+    tableNode->SetAttribute(DVH_SURFACE_ATTRIBUTE_NAME.c_str(), "1");
+    tableNode->SetAttribute(DVH_SURFACE_INSIDE_ATTRIBUTE_NAME.c_str(), parameterNode->GetUseInsideDoseSurface() ? "1" : "0");
+  }
+  else
+  {
+    tableNode->RemoveAttribute(DVH_SURFACE_ATTRIBUTE_NAME.c_str());
+    tableNode->RemoveAttribute(DVH_SURFACE_INSIDE_ATTRIBUTE_NAME.c_str());
+  }
 
   // Set default column values
 
@@ -650,61 +1171,40 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure, vtkVariant(segmentName));
   // Volume name
   metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnDoseVolume, vtkVariant(doseVolumeNode->GetName()));
-  // Volume (cc) - save as attribute too (the DVH contains percentages that often need to be converted to volume)
-  double volumeCc = 0;
-  if (useFractionalLabelmap)
-  {
-    volumeCc = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount() * cubicMMPerVoxel * ccPerCubicMM;
-  }
-  else
-  {
-    volumeCc = structureStat->GetVoxelCount() * cubicMMPerVoxel * ccPerCubicMM;
-  }
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc, vtkVariant(volumeCc));
-  std::ostringstream attributeNameStream;
+  // Volume (cc) or surface area (cm2) - save as attribute too (the DVH contains percentages that often need to be converted to volume or area)
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc, vtkVariant(totalVolumeOrArea));
   std::ostringstream attributeValueStream;
-  attributeNameStream << vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_VOLUME_CC;
-  attributeValueStream << volumeCc;
-  tableNode->SetAttribute(attributeNameStream.str().c_str(), attributeValueStream.str().c_str());
-  // Mean dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMeanDose, vtkVariant(structureStat->GetMean()[0]));
-  // Min dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMinDose, vtkVariant(structureStat->GetMin()[0]));
-  // Max dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMaxDose, vtkVariant(structureStat->GetMax()[0]));
-
-  // Create DVH plot values
-  int numSamples = 0;
-  double startValue = 0.0;
-  double stepSize = 0.0;
-  double rangeMin = structureStat->GetMin()[0];
-  double rangeMax = structureStat->GetMax()[0];
-  if (isDoseVolume)
+  attributeValueStream << totalVolumeOrArea;
+  tableNode->SetAttribute(GetDvhTableTotalAmountAttributeName(doseSurfaceHistogram).c_str(), attributeValueStream.str().c_str());
+  tableNode->RemoveAttribute(GetDvhTableTotalAmountAttributeName(!doseSurfaceHistogram).c_str());
+  // Name the column after the kind of histograms in the table
+  bool containsDvh = false;
+  bool containsDsh = false;
+  std::vector<vtkMRMLTableNode*> dvhTableNodes;
+  parameterNode->GetDvhTableNodes(dvhTableNodes);
+  for (std::vector<vtkMRMLTableNode*>::iterator dvhIt=dvhTableNodes.begin(); dvhIt!=dvhTableNodes.end(); ++dvhIt)
   {
-    if (rangeMin<0)
+    if ((*dvhIt)->GetAttribute(DVH_SURFACE_ATTRIBUTE_NAME.c_str()))
     {
-      std::string errorMessage("The dose volume contains negative dose values");
-      vtkErrorMacro("ComputeDvh: " << errorMessage);
-      return errorMessage;
+      containsDsh = true;
+    }
+    else
+    {
+      containsDvh = true;
     }
-
-    startValue = this->StartValue;
-    stepSize = this->StepSize;
-    numSamples = (int)ceil( (maxDoseGy-startValue)/stepSize ) + 1;
   }
-  else
+  std::string totalVolumeOrAreaColumnName = DVH_METRIC_TOTAL_VOLUME_CC;
+  if (containsDsh)
   {
-    startValue = rangeMin;
-    numSamples = this->NumberOfSamplesForNonDoseVolumes;
-    stepSize = (rangeMax - rangeMin) / (double)(numSamples-1);
+    totalVolumeOrAreaColumnName = (containsDvh ? DVH_METRIC_TOTAL_VOLUME_CC + " / " + DVH_METRIC_TOTAL_SURFACE_AREA_CM2 : DVH_METRIC_TOTAL_SURFACE_AREA_CM2);
   }
-
-  // Get the number of voxels with smaller dose than at the start value
-  structureStat->SetComponentExtent(0,1,0,0,0,0);
-  structureStat->SetComponentOrigin(0,0,0);
-  structureStat->SetComponentSpacing(startValue,1,1);
-  structureStat->Update();
-  double voxelBelowDose = structureStat->GetOutput()->GetScalarComponentAsDouble(0,0,0,0);
+  metricsTable->GetColumn(vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc)->SetName(totalVolumeOrAreaColumnName.c_str());
+  // Mean dose
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMeanDose, vtkVariant(meanDose));
+  // Min dose
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMinDose, vtkVariant(minDose));
+  // Max dose
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMaxDose, vtkVariant(maxDose));
 
   // We put a fixed point at (0.0, 100%), but only if there are only positive values in the histogram
   // Negative values can occur when the user requests histogram for an image, such as s CT volume (in
@@ -716,11 +1216,6 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     insertPointAtOrigin = false;
   }
 
-  structureStat->SetComponentExtent(0,numSamples-1,0,0,0,0);
-  structureStat->SetComponentOrigin(startValue,0,0);
-  structureStat->SetComponentSpacing(stepSize,1,1);
-  structureStat->Update();
-
   // Allocate table
   vtkTable* table = tableNode->GetTable();
   int numberOfRows = numSamples + (insertPointAtOrigin?1:0);
@@ -745,32 +1240,17 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     ++rowIndex;
   }
 
-  vtkImageData* statArray = structureStat->GetOutput();
-  double totalVoxels = 0;
-  if (useFractionalLabelmap)
-  {
-    totalVoxels = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount();
-  }
-  else
-  {
-    totalVoxels = structureStat->GetVoxelCount();
-  }
-
+  // The amounts below the current bin are accumulated, so that the table contains the percentage
+  // of the structure receiving at least the dose of the bin. Fractional amounts may add up to
+  // slightly more than the total due to rounding, so the percentage is clamped to zero
+  double amountBelowDose = amountBelowStartValue;
   for (int sampleIndex=0; sampleIndex<numSamples; ++sampleIndex)
   {
-    double voxelsInBin = statArray->GetScalarComponentAsDouble(sampleIndex,0,0,0);
     table->SetValue(rowIndex, 0, startValue + sampleIndex * stepSize);
-    if (useFractionalLabelmap)
-    {
-      table->SetValue(rowIndex, 1, std::max(0.0, (1.0-(double)voxelBelowDose/(double)totalVoxels)*100.0));
-    }
-    else
-    {
-      table->SetValue(rowIndex, 1, (1.0-(double)voxelBelowDose/(double)totalVoxels)*100.0);
-    }
+    table->SetValue(rowIndex, 1, std::max(0.0, (1.0-amountBelowDose/totalAmount)*100.0));
     table->SetValue(rowIndex, 2, 0);
     ++rowIndex;
-    voxelBelowDose += voxelsInBin;
+    amountBelowDose += amountsInBins[sampleIndex];
   }
 
   // Set the start of the first bin to 0 if the volume contains dose and the start value was negative
@@ -804,16 +1284,8 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   segmentationNode->AddNodeReferenceID(DVH_CREATED_DVH_NODE_REFERENCE_ROLE.c_str(), tableNode->GetID());
   doseVolumeNode->AddNodeReferenceID(DVH_CREATED_DVH_NODE_REFERENCE_ROLE.c_str(), tableNode->GetID());
 
-  // Log measured time
-  double checkpointEnd = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
-  if (this->LogSpeedMeasurements)
-  {
-    vtkDebugMacro("ComputeDvh: DVH computation time for structure '" << segmentID << "': " << checkpointEnd-checkpointStart << " s");
-  }
-
   return ""; // No error
-} // end ComputeDvh
+}
 
 //---------------------------------------------------------------------------
 vtkMRMLPlotViewNode* vtkSlicerDoseVolumeHistogramModuleLogic::GetPlotViewNode()
@@ -1577,6 +2049,8 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ExportDvhToCsv(vtkMRMLDoseVolumeHi
     vtkErrorMacro("ExportDvhToCsv: Output file '" << fileName << "' cannot be opened");
     return false;
   }
+  // Numbers in the header are written with the stream, make them independent of the application locale
+  outfile.imbue(std::locale::classic());
 
   // Determine the maximum number of values
   int maxNumberOfValues = -1;
@@ -1599,55 +2073,43 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ExportDvhToCsv(vtkMRMLDoseVolumeHi
     std::string structureName = metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure).ToString();
 
     outfile << structureName << " Dose (" << doseUnitName << ")" << (comma ? "," : "\t");
-    outfile << structureName << DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE
-      << std::fixed << std::setprecision(3) << volume << DVH_CSV_HEADER_VOLUME_FIELD_END << (comma ? "," : "\t");
+    bool doseSurfaceHistogram = (dvhTableNode->GetAttribute(DVH_SURFACE_ATTRIBUTE_NAME.c_str()) != NULL);
+    outfile << structureName << DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE << std::fixed << std::setprecision(3) << volume
+      << (doseSurfaceHistogram ? DVH_CSV_HEADER_SURFACE_AREA_FIELD_END : DVH_CSV_HEADER_VOLUME_FIELD_END) << (comma ? "," : "\t");
   }
   outfile << std::endl;
 
+  // Access dose and volume columns directly instead of through variants
+  std::vector<vtkDataArray*> doseColumns;
+  std::vector<vtkDataArray*> volumeColumns;
+  for (std::vector<vtkMRMLTableNode*>::iterator dvhIt=dvhTableNodes.begin(); dvhIt!=dvhTableNodes.end(); ++dvhIt)
+  {
+    vtkTable* dvhTable = (*dvhIt)->GetTable();
+    doseColumns.push_back(vtkDataArray::SafeDownCast(dvhTable->GetColumn(0)));
+    volumeColumns.push_back(vtkDataArray::SafeDownCast(dvhTable->GetColumn(1)));
+  }
+
   // Write values
   for (int row=0; row<maxNumberOfValues; ++row)
   {
-    for (std::vector<vtkMRMLTableNode*>::iterator dvhIt=dvhTableNodes.begin(); dvhIt!=dvhTableNodes.end(); ++dvhIt)
+    for (size_t dvhIndex=0; dvhIndex<dvhTableNodes.size(); ++dvhIndex)
     {
-      vtkMRMLTableNode* dvhTableNode = (*dvhIt);
+      vtkMRMLTableNode* dvhTableNode = dvhTableNodes[dvhIndex];
+      bool rowExists = (row < dvhTableNode->GetNumberOfRows() && doseColumns[dvhIndex] && volumeColumns[dvhIndex]);
 
-      if (row < dvhTableNode->GetNumberOfRows())
+      if (rowExists)
       {
-        std::ostringstream doseStringStream;
-        doseStringStream << std::fixed << std::setprecision(6) <<
-          dvhTableNode->GetTable()->GetValue(row, 0).ToDouble();
-        std::string dose = doseStringStream.str();
-        if (!comma)
-        {
-          size_t periodPosition = dose.find(".");
-          if (periodPosition != std::string::npos)
-          {
-            dose.replace(periodPosition, 1, ",");
-          }
-        }
-        outfile << dose;
+        WriteCsvNumber(outfile, doseColumns[dvhIndex]->GetComponent(row, 0), comma);
       }
       outfile << (comma ? "," : "\t");
 
-      if (row < dvhTableNode->GetNumberOfRows())
+      if (rowExists)
       {
-        std::ostringstream valueStringStream;
-        valueStringStream << std::fixed << std::setprecision(6) <<
-          dvhTableNode->GetTable()->GetValue(row, 1).ToDouble();
-        std::string value = valueStringStream.str();
-        if (!comma)
-        {
-          size_t periodPosition = value.find(".");
-          if (periodPosition != std::string::npos)
-          {
-            value.replace(periodPosition, 1, ",");
-          }
-        }
-        outfile << value;
+        WriteCsvNumber(outfile, volumeColumns[dvhIndex]->GetComponent(row, 0), comma);
       }
       outfile << (comma ? "," : "\t");
     }
-    outfile << std::endl;
+    outfile << "\n";
   }
 
   outfile.close();
@@ -1699,194 +2161,254 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ExportDvhMetricsToCsv(vtkMRMLDoseV
 }
 
 //-----------------------------------------------------------------------------
-vtkCollection* vtkSlicerDoseVolumeHistogramModuleLogic::ReadCsvToTableNode(std::string csvFilename)
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ExportDvhToArchive(vtkMRMLDoseVolumeHistogramNode* parameterNode, const char* fileName)
 {
-  std::string csvSeparatorCharacter = ",";
-
-  vtkNew<vtkCollection> dvhTables;
-
-  // Vectors containing the names and total volumes of structures
-  std::vector<std::string> structureNames;
-  std::vector<std::string> readLines;
-  std::vector<double> structureVolumeCCs;
+  if (!this->GetMRMLScene() || !parameterNode)
+  {
+    vtkErrorMacro("ExportDvhToArchive: Invalid MRML scene or parameter set node");
+    return false;
+  }
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  if (!doseVolumeNode)
+  {
+    vtkErrorMacro("ExportDvhToArchive: Unable to find dose volume node");
+    return false;
+  }
+  vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
+  if (!metricsTableNode)
+  {
+    vtkErrorMacro("ExportDvhToArchive: Unable to access DVH metrics table node");
+    return false;
+  }
+  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->GetMRMLScene());
+  if (!shNode)
+  {
+    vtkErrorMacro("ExportDvhToArchive: Failed to access subject hierarchy node");
+    return false;
+  }
+  vtkTable* metricsTable = metricsTableNode->GetTable();
 
-  // Load current DVH from CSV
-  std::ifstream dvhStream;
-  dvhStream.open(csvFilename.c_str(), std::ifstream::in);
+  // Get dose unit name
+  std::string doseUnitName("");
+  vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
+  if (doseShItemID != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+  {
+    doseUnitName = shNode->GetAttributeFromItemAncestor(
+      doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
+  }
 
-  bool firstLine = true;
-  int fieldCount = 0;
-  int lineNumber = 0;
-  char line[16384];
+  vtkNew<vtkTable> metadata;
+  vtkNew<vtkStringArray> metadataKeys;
+  vtkNew<vtkStringArray> metadataValues;
+  metadata->AddColumn(metadataKeys);
+  metadata->AddColumn(metadataValues);
+  metadataKeys->InsertNextValue("DoseVolumeName");
+  metadataValues->InsertNextValue(doseVolumeNode->GetName() ? doseVolumeNode->GetName() : "");
+  metadataKeys->InsertNextValue("DoseUnitName");
+  metadataValues->InsertNextValue(doseUnitName);
 
-  while (dvhStream.getline(line, 16384, '\n'))
+  // Archive table nodes share the DVH tables, and have the same attributes as the nodes read from CSV in addition to the DVH node attributes
+  std::vector<vtkMRMLTableNode*> dvhTableNodes;
+  parameterNode->GetDvhTableNodes(dvhTableNodes);
+  vtkNew<vtkCollection> archiveTableNodes;
+  for (std::vector<vtkMRMLTableNode*>::iterator dvhIt=dvhTableNodes.begin(); dvhIt!=dvhTableNodes.end(); ++dvhIt)
   {
-    std::string lineStr(line);
-    size_t commaPosition = lineStr.find(csvSeparatorCharacter);
+    vtkMRMLTableNode* dvhTableNode = (*dvhIt);
+    int tableRow = vtkVariant(dvhTableNode->GetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str())).ToInt();
+    std::string structureName = metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure).ToString();
+    std::string volume = metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc).ToString();
 
-    // Determine number of fields (twice the number of structures)
-    if (firstLine)
+    vtkNew<vtkMRMLTableNode> archiveTableNode;
+    archiveTableNode->SetAndObserveTable(dvhTableNode->GetTable());
+    std::vector<std::string> attributeNames = dvhTableNode->GetAttributeNames();
+    for (std::vector<std::string>::iterator attributeIt=attributeNames.begin(); attributeIt!=attributeNames.end(); ++attributeIt)
     {
-      while (commaPosition != std::string::npos)
-      {
-        if (fieldCount % 2 == 1)
-        {
-          // Get the structure's name
-          std::string field = lineStr.substr(0, commaPosition);
-          size_t middlePosition = field.find(DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE);
-          std::string structureName = field.substr(0, middlePosition);
-          if ( structureName.size() > DVH_TABLE_NODE_NAME_POSTFIX.size()
-            && structureName.substr(structureName.size() - DVH_TABLE_NODE_NAME_POSTFIX.size()) == DVH_TABLE_NODE_NAME_POSTFIX)
-            {
-            structureName = structureName.substr(0, structureName.size() - DVH_TABLE_NODE_NAME_POSTFIX.size());
-            }
-          structureNames.push_back(structureName);
-
-          // Get the structure's total volume and add it to the vector
-          double volumeCCs = 0;
-          {
-            std::string structureVolumeString = field.substr( middlePosition + DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE.size(),
-              field.size() - middlePosition - DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE.size() - DVH_CSV_HEADER_VOLUME_FIELD_END.size() );
-            volumeCCs = vtkVariant(structureVolumeString).ToDouble();
-          }
-          structureVolumeCCs.push_back(volumeCCs);
+      archiveTableNode->SetAttribute(attributeIt->c_str(), dvhTableNode->GetAttribute(attributeIt->c_str()));
+    }
+    bool doseSurfaceHistogram = (dvhTableNode->GetAttribute(DVH_SURFACE_ATTRIBUTE_NAME.c_str()) != NULL);
+    archiveTableNode->SetAttribute(GetDvhTableTotalAmountAttributeName(doseSurfaceHistogram).c_str(), volume.c_str());
+    archiveTableNode->SetName((structureName + DVH_TABLE_NODE_NAME_POSTFIX).c_str());
+    archiveTableNodes->AddItem(archiveTableNode);
+  }
 
-          if (volumeCCs == 0)
-          {
-            std::cerr << "Invalid structure volume in CSV header field " << field << std::endl;
-          }
-        }
+  vtkNew<vtkDoseVolumeHistogramArchive> archive;
+  if (!archive->WriteArchive(fileName, archiveTableNodes, metadata))
+  {
+    vtkErrorMacro("ExportDvhToArchive: Failed to write DVH archive to file " << fileName);
+    return false;
+  }
+  return true;
+}
 
-        // Move to the next structure's location in the string
-        fieldCount++;
-        lineStr = lineStr.substr(commaPosition+1);
-        commaPosition = lineStr.find(csvSeparatorCharacter);
-      }
+//-----------------------------------------------------------------------------
+vtkCollection* vtkSlicerDoseVolumeHistogramModuleLogic::ReadArchiveToTableNode(std::string archiveFilename)
+{
+  vtkNew<vtkDoseVolumeHistogramArchive> archive;
+  return archive->ReadArchive(archiveFilename.c_str());
+}
 
-      // Handle last field (if there was no comma at the end)
-      if (!lineStr.empty() )
-      {
-        // Get the structure's name
-        size_t middlePosition = lineStr.find(DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE);
-        if (middlePosition != std::string::npos)
-        {
-          structureNames.push_back(lineStr.substr(0, middlePosition - DVH_TABLE_NODE_NAME_POSTFIX.size()));
+//-----------------------------------------------------------------------------
+vtkCollection* vtkSlicerDoseVolumeHistogramModuleLogic::ReadCsvToTableNode(std::string csvFilename)
+{
+  vtkCollection* tableNodes = vtkCollection::New();
 
-          // Get the structure's total volume and add it to the vector
-          double volumeCCs = 0;
-          {
-            std::string structureVolumeString = lineStr.substr( middlePosition + DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE.size(),
-              lineStr.size() - middlePosition - DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE.size() - DVH_CSV_HEADER_VOLUME_FIELD_END.size() );
-            volumeCCs = vtkVariant(structureVolumeString).ToDouble();
-          }
-          structureVolumeCCs.push_back(volumeCCs);
+  std::ifstream dvhStream(csvFilename.c_str(), std::ifstream::in);
+  if (!dvhStream)
+  {
+    vtkErrorMacro("ReadCsvToTableNode: Input file '" << csvFilename << "' cannot be opened");
+    return tableNodes;
+  }
 
-          if (volumeCCs == 0)
-          {
-            std::cerr << "Invalid structure volume in CSV header field " << lineStr << std::endl;
-          }
+  // Header: two fields per structure, "<name> Dose (<unit>)" and "<name> Value (% of <volume> cc)",
+  // or "<name> Value (% of <area> cm2)" for dose surface histograms.
+  // Tab separated files use decimal comma (see ExportDvhToCsv)
+  std::string line;
+  if (!std::getline(dvhStream, line))
+  {
+    vtkErrorMacro("ReadCsvToTableNode: Empty file '" << csvFilename << "'");
+    return tableNodes;
+  }
+  if (!line.empty() && line[line.size()-1] == '\r')
+  {
+    line.erase(line.size()-1);
+  }
+  bool tabSeparated = (line.find(',') == std::string::npos && line.find('\t') != std::string::npos);
+  char separator = (tabSeparated ? '\t' : ',');
 
-          fieldCount++;
-        }
-      }
+  std::vector<std::pair<size_t, size_t> > fields;
+  SplitCsvLine(line, separator, fields);
 
-      firstLine = false;
+  // Vectors containing the names and total volumes (or surface areas) of structures
+  std::vector<std::string> structureNames;
+  std::vector<double> structureVolumeCCs;
+  std::vector<bool> structureDoseSurfaceHistogramFlags;
+  for (size_t fieldIndex=1; fieldIndex<fields.size(); fieldIndex+=2)
+  {
+    std::string field = line.substr(fields[fieldIndex].first, fields[fieldIndex].second - fields[fieldIndex].first);
+    size_t middlePosition = field.find(DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE);
+    if (middlePosition == std::string::npos)
+    {
+      vtkWarningMacro("ReadCsvToTableNode: Invalid volume field in CSV header: " << field);
       continue;
-    } // If firstLine then determine number of fields
+    }
 
-    // Store current line
-    readLines.push_back(lineStr);
-    lineNumber++;
-  } // Read all lines
+    // Get the structure's name
+    std::string structureName = field.substr(0, middlePosition);
+    if ( structureName.size() > DVH_TABLE_NODE_NAME_POSTFIX.size()
+      && structureName.compare(structureName.size() - DVH_TABLE_NODE_NAME_POSTFIX.size(), std::string::npos, DVH_TABLE_NODE_NAME_POSTFIX) == 0 )
+    {
+      structureName.erase(structureName.size() - DVH_TABLE_NODE_NAME_POSTFIX.size());
+    }
+    structureNames.push_back(structureName);
 
-  // Close file stream
-  dvhStream.close();
+    // Get the structure's total volume or surface area
+    size_t volumeBegin = middlePosition + DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE.size();
+    size_t volumeEnd = field.rfind(DVH_CSV_HEADER_SURFACE_AREA_FIELD_END);
+    bool doseSurfaceHistogram = (volumeEnd != std::string::npos && volumeEnd >= volumeBegin);
+    if (!doseSurfaceHistogram)
+    {
+      volumeEnd = field.rfind(DVH_CSV_HEADER_VOLUME_FIELD_END);
+    }
+    if (volumeEnd == std::string::npos || volumeEnd < volumeBegin)
+    {
+      volumeEnd = field.size();
+    }
+    structureDoseSurfaceHistogramFlags.push_back(doseSurfaceHistogram);
+    double volumeCCs = ParseCsvNumber(field, std::make_pair(volumeBegin, volumeEnd), false);
+    if (volumeCCs == 0)
+    {
+      vtkWarningMacro("ReadCsvToTableNode: Invalid structure volume in CSV header field " << field);
+    }
+    structureVolumeCCs.push_back(volumeCCs);
+  }
 
-  // Add a table for each structure into the vector
-  for (int structureIndex=0; structureIndex<structureNames.size(); ++structureIndex)
+  // Create the dose and volume columns of each structure, and fill them while reading the lines
+  std::vector<vtkDoubleArray*> doseColumns;
+  std::vector<vtkDoubleArray*> volumeColumns;
+  std::vector<vtkSmartPointer<vtkTable> > structureDvhTables;
+  for (size_t structureIndex=0; structureIndex<structureNames.size(); ++structureIndex)
   {
-    vtkNew<vtkTable> structureDvhTable;
+    vtkSmartPointer<vtkTable> structureDvhTable = vtkSmartPointer<vtkTable>::New();
     vtkNew<vtkDoubleArray> columnDose;
     columnDose->SetName("Dose");
-    columnDose->SetNumberOfTuples(lineNumber);
     structureDvhTable->AddColumn(columnDose);
     vtkNew<vtkDoubleArray> columnVolume;
     columnVolume->SetName("Volume");
-    columnVolume->SetNumberOfTuples(lineNumber);
     structureDvhTable->AddColumn(columnVolume);
-    structureDvhTable->SetNumberOfRows(lineNumber);
-    dvhTables->AddItem(structureDvhTable);
+    doseColumns.push_back(columnDose);
+    volumeColumns.push_back(columnVolume);
+    structureDvhTables.push_back(structureDvhTable);
   }
 
-  // Parse lines into the tables
-  lineNumber = 0;
-  for (std::vector<std::string>::iterator lineIt=readLines.begin(); lineIt!=readLines.end(); ++lineIt, ++lineNumber)
+  // Stream the lines. Missing values (structures with fewer bins) are zero
+  while (std::getline(dvhStream, line))
   {
-    std::string lineStr = (*lineIt);
-    size_t commaPosition = lineStr.find(csvSeparatorCharacter);
-
-    // Read all tuples from the current line
-    int structureIndex = 0;
-    while (commaPosition != std::string::npos && structureIndex < structureNames.size())
+    if (!line.empty() && line[line.size()-1] == '\r')
     {
-      // Get the current bin's dose from the string
-      double doseGy = 0.0;
-      {
-        vtkStdString doseStr(lineStr.substr(0, commaPosition));
-        doseGy = vtkVariant(doseStr).ToDouble();
-      }
-
-      // Get the current bin's volume from the string
-      double volumePercent = 0.0;
-      {
-        lineStr = lineStr.substr(commaPosition+1);
-        commaPosition = lineStr.find(csvSeparatorCharacter);
-        vtkStdString volumePercentStr(lineStr.substr(0, commaPosition));
-        volumePercent = vtkVariant(volumePercentStr).ToDouble();
-      }
-
-      vtkTable* currentStructureDvhTable = vtkTable::SafeDownCast(dvhTables->GetItemAsObject(structureIndex));
-      if ((doseGy != 0.0 || volumePercent != 0.0) && (commaPosition > 0))
-      {
-        // Add the current bin into the table for the current structure
-        currentStructureDvhTable->SetValue(lineNumber, 0, doseGy);
-        currentStructureDvhTable->SetValue(lineNumber, 1, volumePercent);
-      }
-
-      // Move to the next structure's bin in the string
-      lineStr = lineStr.substr(commaPosition+1);
-      commaPosition = lineStr.find(csvSeparatorCharacter);
-      structureIndex++;
-    } // For each tuple in current line
+      line.erase(line.size()-1);
+    }
+    if (line.empty())
+    {
+      continue;
+    }
+    SplitCsvLine(line, separator, fields);
+    for (size_t structureIndex=0; structureIndex<structureNames.size(); ++structureIndex)
+    {
+      size_t doseFieldIndex = 2 * structureIndex;
+      doseColumns[structureIndex]->InsertNextValue(
+        doseFieldIndex < fields.size() ? ParseCsvNumber(line, fields[doseFieldIndex], tabSeparated) : 0.0 );
+      volumeColumns[structureIndex]->InsertNextValue(
+        doseFieldIndex + 1 < fields.size() ? ParseCsvNumber(line, fields[doseFieldIndex + 1], tabSeparated) : 0.0 );
+    }
   }
+  dvhStream.close();
 
-  vtkCollection* tableNodes = vtkCollection::New();
-  for (unsigned int structureIndex=0; structureIndex<dvhTables->GetNumberOfItems(); structureIndex++)
+  for (size_t structureIndex=0; structureIndex<structureNames.size(); ++structureIndex)
   {
     // Create the table nodes which will be passed to the logic function.
     vtkNew<vtkMRMLTableNode> currentNode;
-    vtkTable* currentStructureDvhTable = vtkTable::SafeDownCast(dvhTables->GetItemAsObject(structureIndex));
-    currentNode->SetAndObserveTable(currentStructureDvhTable);
+    currentNode->SetAndObserveTable(structureDvhTables[structureIndex]);
 
-    // Set the total volume attribute in the vtkMRMLDoubleArrayNode attributes
-    std::ostringstream attributeNameStream;
-    attributeNameStream << vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_VOLUME_CC;
+    // Set the total volume (or surface area) attribute
+    bool doseSurfaceHistogram = structureDoseSurfaceHistogramFlags[structureIndex];
+    if (doseSurfaceHistogram)
+    {
+      currentNode->SetAttribute(DVH_SURFACE_ATTRIBUTE_NAME.c_str(), "1");
+    }
     std::ostringstream attributeValueStream;
     attributeValueStream << structureVolumeCCs[structureIndex];
-    currentNode->SetAttribute(attributeNameStream.str().c_str(), attributeValueStream.str().c_str());
+    currentNode->SetAttribute(GetDvhTableTotalAmountAttributeName(doseSurfaceHistogram).c_str(), attributeValueStream.str().c_str());
 
     // Set the structure's name attribute and variables
-    currentNode->SetAttribute(DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str(), structureNames.at(structureIndex).c_str());
-    std::string nameAttribute = structureNames.at(structureIndex) + DVH_TABLE_NODE_NAME_POSTFIX;
+    currentNode->SetAttribute(DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str(), structureNames[structureIndex].c_str());
+    std::string nameAttribute = structureNames[structureIndex] + DVH_TABLE_NODE_NAME_POSTFIX;
     currentNode->SetName(nameAttribute.c_str());
 
-    // add the new node to the vector
     tableNodes->AddItem(currentNode);
   }
 
   return tableNodes;
 }
 
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::GetDvhTableTotalAmountAttributeName(bool doseSurfaceHistogram)
+{
+  return vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX
+    + (doseSurfaceHistogram ? DVH_METRIC_TOTAL_SURFACE_AREA_CM2 : DVH_METRIC_TOTAL_VOLUME_CC);
+}
+
+//---------------------------------------------------------------------------
+double vtkSlicerDoseVolumeHistogramModuleLogic::GetDvhTableTotalAmount(vtkMRMLTableNode* dvhTableNode)
+{
+  if (!dvhTableNode)
+  {
+    return 0.0;
+  }
+  bool doseSurfaceHistogram = (dvhTableNode->GetAttribute(DVH_SURFACE_ATTRIBUTE_NAME.c_str()) != NULL);
+  const char* totalAmountChars = dvhTableNode->GetAttribute(GetDvhTableTotalAmountAttributeName(doseSurfaceHistogram).c_str());
+  return (totalAmountChars ? vtkVariant(totalAmountChars).ToDouble() : 0.0);
+}
+
 //---------------------------------------------------------------------------
 std::string vtkSlicerDoseVolumeHistogramModuleLogic::AssembleDoseMetricName(vtkMRMLScalarVolumeNode* doseVolumeNode, std::string doseMetricAttributeNamePrefix)
 {
@@ -1970,7 +2492,7 @@ void vtkSlicerDoseVolumeHistogramModuleLogic::InitializeMetricsTable(vtkMRMLDose
   volumeNameColumn->SetName("Volume name");
 
   vtkAbstractArray* volumeCcColumn = metricsTableNode->AddColumn();
-  volumeCcColumn->SetName(DVH_METRIC_TOTAL_VOLUME_CC.c_str());
+  volumeCcColumn->SetName(parameterNode->GetDoseSurfaceHistogram() ? DVH_METRIC_TOTAL_SURFACE_AREA_CM2.c_str() : DVH_METRIC_TOTAL_VOLUME_CC.c_str());
 
   vtkAbstractArray* meanDoseColumn = metricsTableNode->AddColumn();
   meanDoseColumn->SetName(meanDoseMetricName.c_str());
@@ -32,7 +32,11 @@
 
 #include "vtkSlicerDoseVolumeHistogramModuleLogicExport.h"
 
+// STD includes
+#include <vector>
+
 class vtkOrientedImageData;
+class vtkPolyData;
 class vtkCallbackCommand;
 
 class vtkMRMLDoseVolumeHistogramNode;
@@ -67,6 +71,7 @@ public:
 
   static const std::string DVH_METRIC_STRUCTURE;
   static const std::string DVH_METRIC_TOTAL_VOLUME_CC;
+  static const std::string DVH_METRIC_TOTAL_SURFACE_AREA_CM2;
   static const std::string DVH_METRIC_MEAN_PREFIX;
   static const std::string DVH_METRIC_MIN_PREFIX;
   static const std::string DVH_METRIC_MAX_PREFIX;
@@ -75,6 +80,7 @@ public:
   static const std::string DVH_TABLE_NODE_NAME_POSTFIX;
   static const std::string DVH_CSV_HEADER_VOLUME_FIELD_MIDDLE;
   static const std::string DVH_CSV_HEADER_VOLUME_FIELD_END;
+  static const std::string DVH_CSV_HEADER_SURFACE_AREA_FIELD_END;
 
 public:
   static vtkSlicerDoseVolumeHistogramModuleLogic *New();
@@ -113,14 +119,44 @@ public:
   /// Export DVH metrics
   bool ExportDvhMetricsToCsv(vtkMRMLDoseVolumeHistogramNode* parameterNode, const char* fileName, bool comma=true);
 
-  /// Read DVH tables from a CSV file
+  /// Export DVH tables to compact binary archive (see \sa vtkDoseVolumeHistogramArchive).
+  /// The structure names, total volumes, dose volume name and dose unit are stored with the tables
+  /// \return True if file written and saved successfully, false otherwise
+  bool ExportDvhToArchive(vtkMRMLDoseVolumeHistogramNode* parameterNode, const char* fileName);
+
+  /// Read DVH tables from a CSV file. Lines are streamed, so there is no limit on the number of structures.
+  /// Both comma separated and tab separated (with decimal comma) files written by \sa ExportDvhToCsv are supported
   /// \return a vtkCollection containing vtkMRMLTableNode. Each node represents one structure DVH and contains the vtkTable as well as the name and total volume attributes for the structure.
   vtkCollection* ReadCsvToTableNode(std::string csvFilename);
 
+  /// Read DVH tables from a binary archive written by \sa ExportDvhToArchive
+  /// \return a vtkCollection containing vtkMRMLTableNode, same as \sa ReadCsvToTableNode. NULL on failure
+  vtkCollection* ReadArchiveToTableNode(std::string archiveFilename);
+
   /// Assemble dose metric name, e.g. "Mean dose (Gy)". If selected volume is not a dose, it will contain "intensity" instead of "dose"
   /// \param doseMetricAttributeNamePrefix Prefix of the desired dose metric attribute name, e.g. "Mean "
   std::string AssembleDoseMetricName(vtkMRMLScalarVolumeNode* doseVolumeNode, std::string doseMetricAttributeNamePrefix);
 
+  /// Interpolate dose at the voxel centers of an (oversampled) labelmap grid, within the given extent only.
+  /// Trilinear interpolation is used, and voxels farther than half a dose voxel outside the dose volume get zero dose.
+  /// If the grids are axis aligned (always the case for labelmaps converted or resampled to the oversampled dose geometry)
+  /// then the weights are precomputed per axis, otherwise the dose is resampled with \sa vtkOrientedImageDataResample.
+  /// \param doseImageData Dose volume in its original geometry. Needs to have float scalars
+  /// \param labelmapGeometry Image defining the sampling grid. Only its geometry is used
+  /// \param extent Extent of the sampling grid to interpolate the dose in
+  /// \param sampledDose Output float image with the geometry of the labelmap and the given extent
+  /// \return Success flag
+  static bool SampleDoseOnLabelmapGrid(vtkOrientedImageData* doseImageData, vtkOrientedImageData* labelmapGeometry,
+    int extent[6], vtkOrientedImageData* sampledDose);
+
+  /// Get the total amount the percentages of a DVH table refer to: the total volume in cc for dose volume histograms,
+  /// and the total surface area in cm^2 for dose surface histograms (tables with the \sa DVH_SURFACE_ATTRIBUTE_NAME attribute)
+  /// \return Total volume or area, 0 if the attribute is missing
+  static double GetDvhTableTotalAmount(vtkMRMLTableNode* dvhTableNode);
+
+  /// Get the name of the DVH table attribute containing the total volume or surface area. See \sa GetDvhTableTotalAmount
+  static std::string GetDvhTableTotalAmountAttributeName(bool doseSurfaceHistogram);
+
 public:
   vtkGetMacro(StartValue, double);
   vtkSetMacro(StartValue, double);
@@ -152,6 +188,35 @@ protected:
     vtkOrientedImageData* segmentLabelmap, vtkOrientedImageData* oversampledDoseVolume,
     std::string segmentID, double maxDoseGy );
 
+  /// Compute dose surface histogram (DSH) for the given structure segment by sampling the dose on its closed surface
+  /// (just inside or outside the surface depending on the UseInsideDoseSurface parameter)
+  /// \param parameterNode Dose volume histogram parameter set node
+  /// \param segmentSurface Closed surface representation of the segment, in world coordinates
+  /// \param doseImageData Dose volume in its original geometry (it is sampled with trilinear interpolation)
+  /// \param segmentID ID of segment the DSH is calculated on
+  /// \param maxDoseGy Maximum dose determining the number of DSH bins
+  /// \return Error message, empty string if no error
+  std::string ComputeDsh(
+    vtkMRMLDoseVolumeHistogramNode* parameterNode,
+    vtkPolyData* segmentSurface, vtkOrientedImageData* doseImageData,
+    std::string segmentID, double maxDoseGy );
+
+  /// Determine histogram bins from the dose range of a structure
+  /// \return Error message, empty string if no error
+  std::string GetHistogramBinning(bool isDoseVolume, double rangeMin, double rangeMax, double maxDoseGy,
+    double &startValue, double &stepSize, int &numSamples);
+
+  /// Create or update the DVH table and metrics of a structure from its histogram.
+  /// Called from \sa ComputeDvh and \sa ComputeDsh
+  /// \param totalVolumeOrArea Total volume in cc, or surface area in cm^2 in case of DSH, stored in the metrics table
+  /// \param amountBelowStartValue Voxel count or area with lower dose than the start value
+  /// \param amountsInBins Voxel count or area in each bin starting from the start value
+  /// \param totalAmount Total voxel count or area, the percentages in the table are relative to this
+  /// \return Error message, empty string if no error
+  std::string StoreDvhResults(vtkMRMLDoseVolumeHistogramNode* parameterNode, std::string segmentID,
+    double totalVolumeOrArea, double meanDose, double minDose, double maxDose,
+    double startValue, double stepSize, double amountBelowStartValue, const std::vector<double>& amountsInBins, double totalAmount);
+
   /// Return the plot view node object from the layout
   vtkMRMLPlotViewNode* GetPlotViewNode();
 
@@ -0,0 +1,207 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DoseVolumeHistogram includes
+#include "vtkDoseSurfaceHistogramFilter.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkCleanPolyData.h>
+#include <vtkCubeSource.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkReverseSense.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  // Box of 20 mm edge length centered at the origin, surface area is 2400 mm^2
+  const double BOX_SIZE_MM = 20.0;
+  const double BOX_AREA_MM2 = 6.0 * BOX_SIZE_MM * BOX_SIZE_MM;
+
+  //----------------------------------------------------------------------------
+  // Dose grid of 1 mm spacing covering [-15,15] mm along each axis (or [0,15] along z if upper half only)
+  // with dose = z + 10 Gy, so that the dose is 0 Gy at the bottom and 20 Gy at the top of the box.
+  // The dose is linear, so trilinear interpolation gives the exact value everywhere
+  void CreateLinearDose(vtkOrientedImageData* doseImageData, bool upperHalfOnly)
+  {
+    doseImageData->SetExtent(0, 30, 0, 30, (upperHalfOnly ? 15 : 0), 30);
+    doseImageData->SetOrigin(-15.0, -15.0, -15.0);
+    doseImageData->SetSpacing(1.0, 1.0, 1.0);
+    doseImageData->AllocateScalars(VTK_FLOAT, 1);
+    int* extent = doseImageData->GetExtent();
+    for (int k=extent[4]; k<=extent[5]; ++k)
+    {
+      for (int j=extent[2]; j<=extent[3]; ++j)
+      {
+        for (int i=extent[0]; i<=extent[1]; ++i)
+        {
+          float* voxel = static_cast<float*>(doseImageData->GetScalarPointer(i, j, k));
+          (*voxel) = static_cast<float>(k - 5); // z + 10
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsEqualWithTolerance(const char* name, double actual, double expected, double tolerance)
+  {
+    if (std::fabs(actual - expected) > tolerance)
+    {
+      std::cerr << "ERROR: " << name << " mismatch: " << actual << " (expected " << expected << " +/- " << tolerance << ")" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkDoseSurfaceHistogramFilterTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkCubeSource> cubeSource;
+  cubeSource->SetXLength(BOX_SIZE_MM);
+  cubeSource->SetYLength(BOX_SIZE_MM);
+  cubeSource->SetZLength(BOX_SIZE_MM);
+  // Merge the points of the faces so that the surface is closed
+  vtkNew<vtkCleanPolyData> cleaner;
+  cleaner->SetInputConnection(cubeSource->GetOutputPort());
+  cleaner->Update();
+  vtkPolyData* boxSurface = cleaner->GetOutput();
+
+  vtkNew<vtkOrientedImageData> doseImageData;
+  CreateLinearDose(doseImageData.GetPointer(), false);
+
+  // Dose on the surface. The top face gets 20 Gy, the bottom 0 Gy, and the dose on the
+  // side faces is uniformly distributed between them.
+  // Bins are centered on the face doses so that the samples are not on bin boundaries
+  vtkNew<vtkDoseSurfaceHistogramFilter> surfaceSampler;
+  surfaceSampler->SetInputSurface(boxSurface);
+  surfaceSampler->SetDoseImageData(doseImageData.GetPointer());
+  surfaceSampler->SetMaximumSampleSpacingMm(0.25);
+  surfaceSampler->SetHistogramOrigin(-2.5);
+  surfaceSampler->SetHistogramBinSpacing(5.0);
+  surfaceSampler->SetNumberOfHistogramBins(5);
+  surfaceSampler->Update();
+
+  // Sub-triangles are sampled at their centroid, which integrates linear dose exactly,
+  // so the totals and statistics are exact, and only the binning of the side faces is approximate
+  if ( !IsEqualWithTolerance("Total area", surfaceSampler->GetTotalAreaMm2(), BOX_AREA_MM2, 1e-6 * BOX_AREA_MM2)
+    || !IsEqualWithTolerance("Sampled area", surfaceSampler->GetSampledAreaMm2(), BOX_AREA_MM2, 1e-6 * BOX_AREA_MM2)
+    || !IsEqualWithTolerance("Mean dose", surfaceSampler->GetMeanDose(), 10.0, 1e-4)
+    || !IsEqualWithTolerance("Minimum dose", surfaceSampler->GetMinimumDose(), 0.0, 1e-4)
+    || !IsEqualWithTolerance("Maximum dose", surfaceSampler->GetMaximumDose(), 20.0, 1e-4)
+    || !IsEqualWithTolerance("Area below histogram origin", surfaceSampler->GetAreaBelowHistogramOriginMm2(), 0.0, 1e-6) )
+  {
+    return EXIT_FAILURE;
+  }
+  if (surfaceSampler->GetNumberOfSamples() <= 0)
+  {
+    std::cerr << "ERROR: No samples were taken" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The side faces contribute 400 mm^2 to each 5 Gy bin (half of it to the first and last bins),
+  // and the bottom and top faces 400 mm^2 to the first and last bins
+  const double expectedBinAreas[5] = { 600.0, 400.0, 400.0, 400.0, 600.0 };
+  const std::vector<double>& binAreas = surfaceSampler->GetHistogramAreasMm2();
+  if (binAreas.size() != 5)
+  {
+    std::cerr << "ERROR: Invalid number of histogram bins: " << binAreas.size() << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int binIndex=0; binIndex<5; ++binIndex)
+  {
+    if (!IsEqualWithTolerance("Histogram bin area", binAreas[binIndex], expectedBinAreas[binIndex], 0.05 * expectedBinAreas[binIndex]))
+    {
+      std::cerr << "  in bin " << binIndex << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Sampling inside and outside the surface. The top and bottom faces are shifted by 2 mm along
+  // their outward normal, while the side faces are shifted horizontally, so the mean does not change
+  surfaceSampler->SetNumberOfHistogramBins(0);
+  surfaceSampler->SetSurfaceOffsetMm(-2.0);
+  surfaceSampler->Update();
+  if ( !IsEqualWithTolerance("Inside minimum dose", surfaceSampler->GetMinimumDose(), 2.0, 1e-4)
+    || !IsEqualWithTolerance("Inside maximum dose", surfaceSampler->GetMaximumDose(), 18.0, 1e-4)
+    || !IsEqualWithTolerance("Inside mean dose", surfaceSampler->GetMeanDose(), 10.0, 1e-4)
+    || !IsEqualWithTolerance("Inside sampled area", surfaceSampler->GetSampledAreaMm2(), BOX_AREA_MM2, 1e-6 * BOX_AREA_MM2) )
+  {
+    return EXIT_FAILURE;
+  }
+  surfaceSampler->SetSurfaceOffsetMm(2.0);
+  surfaceSampler->Update();
+  if ( !IsEqualWithTolerance("Outside minimum dose", surfaceSampler->GetMinimumDose(), -2.0, 1e-4)
+    || !IsEqualWithTolerance("Outside maximum dose", surfaceSampler->GetMaximumDose(), 22.0, 1e-4)
+    || !IsEqualWithTolerance("Outside mean dose", surfaceSampler->GetMeanDose(), 10.0, 1e-4) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Same box with inward facing triangles: the winding is corrected, so inside and outside are not swapped
+  vtkNew<vtkReverseSense> reverseSense;
+  reverseSense->SetInputData(boxSurface);
+  reverseSense->ReverseCellsOn();
+  reverseSense->ReverseNormalsOff();
+  reverseSense->Update();
+  surfaceSampler->SetInputSurface(reverseSense->GetOutput());
+  surfaceSampler->SetSurfaceOffsetMm(-2.0);
+  surfaceSampler->Update();
+  if ( !IsEqualWithTolerance("Reversed inside minimum dose", surfaceSampler->GetMinimumDose(), 2.0, 1e-4)
+    || !IsEqualWithTolerance("Reversed inside maximum dose", surfaceSampler->GetMaximumDose(), 18.0, 1e-4)
+    || !IsEqualWithTolerance("Reversed inside mean dose", surfaceSampler->GetMeanDose(), 10.0, 1e-4) )
+  {
+    return EXIT_FAILURE;
+  }
+  surfaceSampler->SetSurfaceOffsetMm(2.0);
+  surfaceSampler->Update();
+  if ( !IsEqualWithTolerance("Reversed outside minimum dose", surfaceSampler->GetMinimumDose(), -2.0, 1e-4)
+    || !IsEqualWithTolerance("Reversed outside maximum dose", surfaceSampler->GetMaximumDose(), 22.0, 1e-4)
+    || !IsEqualWithTolerance("Reversed outside mean dose", surfaceSampler->GetMeanDose(), 10.0, 1e-4) )
+  {
+    return EXIT_FAILURE;
+  }
+  surfaceSampler->SetInputSurface(boxSurface);
+
+  // Dose grid covering only the upper half of the box: the top face (400 mm^2) and the upper half
+  // of the side faces (800 mm^2) are sampled, with mean dose (400*20 + 800*15) / 1200 Gy
+  vtkNew<vtkOrientedImageData> upperHalfDoseImageData;
+  CreateLinearDose(upperHalfDoseImageData.GetPointer(), true);
+  surfaceSampler->SetDoseImageData(upperHalfDoseImageData.GetPointer());
+  surfaceSampler->SetSurfaceOffsetMm(0.0);
+  surfaceSampler->Update();
+  if ( !IsEqualWithTolerance("Partial total area", surfaceSampler->GetTotalAreaMm2(), BOX_AREA_MM2, 1e-6 * BOX_AREA_MM2)
+    || !IsEqualWithTolerance("Partial sampled area", surfaceSampler->GetSampledAreaMm2(), 1200.0, 0.02 * 1200.0)
+    || !IsEqualWithTolerance("Partial mean dose", surfaceSampler->GetMeanDose(), 20000.0 / 1200.0, 0.01 * 20000.0 / 1200.0)
+    || !IsEqualWithTolerance("Partial maximum dose", surfaceSampler->GetMaximumDose(), 20.0, 1e-4) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Dose surface histogram filter test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -32,7 +32,9 @@
 #include "vtkSlicerSegmentationsModuleLogic.h"
 
 // SegmentationCore includes
+#include "vtkCalculateOversamplingFactor.h"
 #include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
 #include "vtkSegmentationConverterFactory.h"
 
 // MRML includes
@@ -49,6 +51,7 @@
 // VTK includes
 #include <vtkImageData.h>
 #include <vtkImageAccumulate.h>
+#include <vtkImageCast.h>
 #include <vtkLookupTable.h>
 #include <vtkNew.h>
 #include <vtkTable.h>
@@ -416,6 +419,59 @@ int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
   doseStat->Update();
   double maxDose = doseStat->GetMax()[0];
 
+  // Check that dose sampled on an oversampled grid within a sub-extent matches resampling the whole dose volume
+  vtkSmartPointer<vtkOrientedImageData> doseImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
+    vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(doseScalarVolumeNode) );
+  vtkNew<vtkImageCast> doseCast;
+  doseCast->SetInputData(doseImageData);
+  doseCast->SetOutputScalarTypeToFloat();
+  doseCast->Update();
+  vtkNew<vtkOrientedImageData> floatDoseImageData;
+  floatDoseImageData->ShallowCopy(doseCast->GetOutput());
+  floatDoseImageData->CopyDirections(doseImageData);
+  vtkNew<vtkOrientedImageData> oversampledDoseImageData;
+  oversampledDoseImageData->ShallowCopy(floatDoseImageData.GetPointer());
+  vtkCalculateOversamplingFactor::ApplyOversamplingOnImageGeometry(oversampledDoseImageData.GetPointer(), 2.0);
+  if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+    floatDoseImageData.GetPointer(), oversampledDoseImageData.GetPointer(), oversampledDoseImageData.GetPointer(), true))
+  {
+    std::cerr << "ERROR: Failed to resample dose volume" << std::endl;
+    return EXIT_FAILURE;
+  }
+  int oversampledExtent[6] = {0,-1,0,-1,0,-1};
+  oversampledDoseImageData->GetExtent(oversampledExtent);
+  int samplingExtent[6] = {0,-1,0,-1,0,-1};
+  for (int axis=0; axis<3; ++axis)
+  {
+    int size = oversampledExtent[2*axis+1] - oversampledExtent[2*axis] + 1;
+    samplingExtent[2*axis] = oversampledExtent[2*axis] + size/4;
+    samplingExtent[2*axis+1] = oversampledExtent[2*axis] + (3*size)/4;
+  }
+  vtkNew<vtkOrientedImageData> sampledDoseImageData;
+  if (!vtkSlicerDoseVolumeHistogramModuleLogic::SampleDoseOnLabelmapGrid(floatDoseImageData.GetPointer(),
+    oversampledDoseImageData.GetPointer(), samplingExtent, sampledDoseImageData.GetPointer()))
+  {
+    std::cerr << "ERROR: Failed to sample dose on oversampled grid" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int k=samplingExtent[4]; k<=samplingExtent[5]; ++k)
+  {
+    for (int j=samplingExtent[2]; j<=samplingExtent[3]; ++j)
+    {
+      for (int i=samplingExtent[0]; i<=samplingExtent[1]; ++i)
+      {
+        float sampledDose = *static_cast<float*>(sampledDoseImageData->GetScalarPointer(i,j,k));
+        float resampledDose = *static_cast<float*>(oversampledDoseImageData->GetScalarPointer(i,j,k));
+        if (fabs(sampledDose - resampledDose) > 1e-4 * maxDose)
+        {
+          std::cerr << "ERROR: Sampled dose " << sampledDose << " differs from resampled dose " << resampledDose
+            << " at voxel (" << i << ", " << j << ", " << k << ")" << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
   // Create and set up logic
   vtkSmartPointer<vtkSlicerDoseVolumeHistogramModuleLogic> dvhLogic = vtkSmartPointer<vtkSlicerDoseVolumeHistogramModuleLogic>::New();
   dvhLogic->SetMRMLScene(mrmlScene);
@@ -503,6 +559,42 @@ int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
   vtksys::SystemTools::RemoveFile(temporaryDvhTableCsvFileName);
   dvhLogic->ExportDvhToCsv(paramNode, temporaryDvhTableCsvFileName);
 
+  // Export DVH to binary archive and check that the tables are read back unchanged
+  std::string temporaryDvhArchiveFileName = std::string(temporaryDvhTableCsvFileName) + ".dvha";
+  vtksys::SystemTools::RemoveFile(temporaryDvhArchiveFileName.c_str());
+  if (!dvhLogic->ExportDvhToArchive(paramNode, temporaryDvhArchiveFileName.c_str()))
+  {
+    std::cerr << "ERROR: Failed to export DVH archive" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkCollection> archiveTableNodes =
+    vtkSmartPointer<vtkCollection>::Take( dvhLogic->ReadArchiveToTableNode(temporaryDvhArchiveFileName) );
+  if (!archiveTableNodes || archiveTableNodes->GetNumberOfItems() != (int)dvhNodes.size())
+  {
+    std::cerr << "ERROR: Invalid number of DVH tables read from archive" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int dvhIndex=0; dvhIndex<archiveTableNodes->GetNumberOfItems(); ++dvhIndex)
+  {
+    vtkTable* archiveTable = vtkMRMLTableNode::SafeDownCast(archiveTableNodes->GetItemAsObject(dvhIndex))->GetTable();
+    vtkTable* dvhTable = dvhNodes[dvhIndex]->GetTable();
+    if (archiveTable->GetNumberOfRows() != dvhTable->GetNumberOfRows())
+    {
+      std::cerr << "ERROR: Invalid number of DVH values read from archive" << std::endl;
+      return EXIT_FAILURE;
+    }
+    for (vtkIdType row=0; row<dvhTable->GetNumberOfRows(); ++row)
+    {
+      if ( archiveTable->GetValue(row, 0).ToDouble() != dvhTable->GetValue(row, 0).ToDouble()
+        || archiveTable->GetValue(row, 1).ToDouble() != dvhTable->GetValue(row, 1).ToDouble() )
+      {
+        std::cerr << "ERROR: DVH value mismatch in archive at row " << row << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  vtksys::SystemTools::RemoveFile(temporaryDvhArchiveFileName.c_str());
+
   // Compute DVH metrics
   paramNode->SetVDoseValues("5, 20");
   paramNode->SetShowVMetricsCc(true);
@@ -631,14 +723,36 @@ int CompareCsvDvhTables(std::string dvhCsvFileName, std::string baselineCsvFileN
     }
     
     std::string segmentId = currentStructure->GetAttribute(vtkSlicerDoseVolumeHistogramModuleLogic::DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str());
-    std::ostringstream volumeAttributeNameStream;
-    volumeAttributeNameStream << vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_VOLUME_CC;
-    std::string structureVolume = currentStructure->GetAttribute(volumeAttributeNameStream.str().c_str());
+    bool doseSurfaceHistogram = (currentStructure->GetAttribute(vtkSlicerDoseVolumeHistogramModuleLogic::DVH_SURFACE_ATTRIBUTE_NAME.c_str()) != NULL);
+    double structureVolume = vtkSlicerDoseVolumeHistogramModuleLogic::GetDvhTableTotalAmount(currentStructure);
     
-    std::cout << "Accepted agreements per structure (" << segmentId << ", " << structureVolume << " cc): " << numberOfAcceptedAgreementsPerStructure
+    std::cout << "Accepted agreements per structure (" << segmentId << ", " << structureVolume << (doseSurfaceHistogram ? " cm2): " : " cc): ") << numberOfAcceptedAgreementsPerStructure
       << " out of " << numberOfBinsPerStructure << " (" << std::fixed << std::setprecision(2) << acceptedBinsRatio << "%)" << std::endl;
   } // for all structures
 
+  // Batch comparison must give the same agreement as the pairwise comparison
+  vtkNew<vtkTable> batchResultTable;
+  if (!vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTablesBatch(
+    currentDvh, baselineDvh, batchResultTable, volumeDifferenceCriterion, doseToAgreementCriterion, maxDose ))
+  {
+    std::cerr << "ERROR: Batch DVH comparison failed" << std::endl;
+    return 1;
+  }
+  for (int structureIndex=0; structureIndex < currentDvh->GetNumberOfItems(); structureIndex++)
+  {
+    double acceptedBinsRatio = vtkSlicerDoseVolumeHistogramComparisonLogic::CompareDvhTables(
+      vtkMRMLTableNode::SafeDownCast(currentDvh->GetItemAsObject(structureIndex)),
+      vtkMRMLTableNode::SafeDownCast(baselineDvh->GetItemAsObject(structureIndex)),
+      NULL, volumeDifferenceCriterion, doseToAgreementCriterion, maxDose );
+    double batchAcceptedBinsRatio = batchResultTable->GetValueByName(structureIndex, "Agreement acceptance (%)").ToDouble();
+    if (fabs(acceptedBinsRatio - batchAcceptedBinsRatio) > 1e-6)
+    {
+      std::cerr << "ERROR: Batch DVH comparison mismatch for structure " << structureIndex << " ("
+        << batchAcceptedBinsRatio << "<>" << acceptedBinsRatio << ")" << std::endl;
+      return 1;
+    }
+  }
+
   std::cout << "Accepted structures with threshold of 90%: " << std::fixed << std::setprecision(2) << (double)numberOfAcceptedStructuresWith90 / (double)currentDvh->GetNumberOfItems() * 100.0 << std::endl;
   std::cout << "Accepted structures with threshold of 95%: " << std::fixed << std::setprecision(2) << (double)numberOfAcceptedStructuresWith95 / (double)currentDvh->GetNumberOfItems() * 100.0 << std::endl;
 
@@ -0,0 +1,757 @@
+/*==========================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Anna Ilina, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario.
+
+==========================================================================*/
+
+// DosxyzNrc3dDoseFileReader includes
+#include "vtkDosxyzNrc3dDoseFileParser.h"
+#include "vtkSlicerDosxyzNrc3dDoseFileReaderLogic.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtPerformanceMonitor.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+// Memory mapping includes
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Size of the chunks the dose and uncertainty blocks are split into for parallel parsing
+  const size_t PARSE_CHUNK_SIZE_BYTES = 4 * 1024 * 1024;
+
+  /// Identifier and version of the sidecar cache file format
+  const char SIDECAR_CACHE_MAGIC[8] = { 'S', 'R', 'T', '3', 'D', 'D', 'C', '\0' };
+  const vtkTypeInt32 SIDECAR_CACHE_VERSION = 1;
+  const vtkTypeInt32 SIDECAR_CACHE_BYTE_ORDER_MARK = 0x01020304;
+
+  //-----------------------------------------------------------------------------
+  /// Header of the sidecar cache file, followed by the dose values and (if present) the uncertainty values as floats
+  struct SidecarCacheHeader
+  {
+    char Magic[8];
+    vtkTypeInt32 Version;
+    vtkTypeInt32 ByteOrderMark;
+    vtkTypeInt64 SourceFileLength;
+    vtkTypeInt64 SourceModifiedTime;
+    vtkTypeInt32 Size[3];
+    vtkTypeInt32 HasUncertainty;
+    double Origin[3];
+    double Spacing[3];
+  };
+
+  //-----------------------------------------------------------------------------
+  /// Read-only memory mapped file
+  class MappedFile
+  {
+  public:
+    MappedFile()
+      : Data(NULL)
+      , Size(0)
+#ifdef _WIN32
+      , FileHandle(INVALID_HANDLE_VALUE)
+      , MappingHandle(NULL)
+#endif
+    {
+    }
+
+    ~MappedFile()
+    {
+      this->Close();
+    }
+
+    bool Open(const char* fileName)
+    {
+      this->Close();
+#ifdef _WIN32
+      this->FileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+      if (this->FileHandle == INVALID_HANDLE_VALUE)
+      {
+        return false;
+      }
+      LARGE_INTEGER fileSize;
+      if (!GetFileSizeEx(this->FileHandle, &fileSize) || fileSize.QuadPart == 0)
+      {
+        this->Close();
+        return false;
+      }
+      this->Size = (size_t)fileSize.QuadPart;
+      this->MappingHandle = CreateFileMappingA(this->FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (!this->MappingHandle)
+      {
+        this->Close();
+        return false;
+      }
+      this->Data = static_cast<const char*>(MapViewOfFile(this->MappingHandle, FILE_MAP_READ, 0, 0, 0));
+      if (!this->Data)
+      {
+        this->Close();
+        return false;
+      }
+#else
+      int fileDescriptor = open(fileName, O_RDONLY);
+      if (fileDescriptor < 0)
+      {
+        return false;
+      }
+      struct stat fileStatus;
+      if (fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size == 0)
+      {
+        close(fileDescriptor);
+        return false;
+      }
+      this->Size = (size_t)fileStatus.st_size;
+      void* mappedData = mmap(NULL, this->Size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+      close(fileDescriptor); // Mapping stays valid after closing the descriptor
+      if (mappedData == MAP_FAILED)
+      {
+        this->Size = 0;
+        return false;
+      }
+      madvise(mappedData, this->Size, MADV_SEQUENTIAL);
+      this->Data = static_cast<const char*>(mappedData);
+#endif
+      return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+      if (this->Data)
+      {
+        UnmapViewOfFile(this->Data);
+      }
+      if (this->MappingHandle)
+      {
+        CloseHandle(this->MappingHandle);
+        this->MappingHandle = NULL;
+      }
+      if (this->FileHandle != INVALID_HANDLE_VALUE)
+      {
+        CloseHandle(this->FileHandle);
+        this->FileHandle = INVALID_HANDLE_VALUE;
+      }
+#else
+      if (this->Data)
+      {
+        munmap(const_cast<char*>(this->Data), this->Size);
+      }
+#endif
+      this->Data = NULL;
+      this->Size = 0;
+    }
+
+    const char* Data;
+    size_t Size;
+
+  private:
+#ifdef _WIN32
+    HANDLE FileHandle;
+    HANDLE MappingHandle;
+#endif
+  };
+
+  //-----------------------------------------------------------------------------
+  inline bool IsWhitespace(char c)
+  {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Parse a decimal floating point number independently of the locale. Fortran style 'D' exponent is accepted.
+  /// \return Pointer after the number, or NULL if the text at the position is not a number
+  const char* ParseNumber(const char* current, const char* end, double& value)
+  {
+    static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+      1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    bool negative = false;
+    if (current < end && (*current == '-' || *current == '+'))
+    {
+      negative = (*current == '-');
+      ++current;
+    }
+
+    // Digits beyond the precision of the mantissa only change the exponent
+    vtkTypeUInt64 mantissa = 0;
+    int exponent = 0;
+    int numberOfDigits = 0;
+    for (; current < end && *current >= '0' && *current <= '9'; ++current, ++numberOfDigits)
+    {
+      if (mantissa < 100000000000000000ULL)
+      {
+        mantissa = mantissa * 10 + (*current - '0');
+      }
+      else
+      {
+        ++exponent;
+      }
+    }
+    if (current < end && *current == '.')
+    {
+      ++current;
+      for (; current < end && *current >= '0' && *current <= '9'; ++current, ++numberOfDigits)
+      {
+        if (mantissa < 100000000000000000ULL)
+        {
+          mantissa = mantissa * 10 + (*current - '0');
+          --exponent;
+        }
+      }
+    }
+    if (numberOfDigits == 0)
+    {
+      return NULL;
+    }
+
+    if (current < end && (*current == 'e' || *current == 'E' || *current == 'd' || *current == 'D'))
+    {
+      ++current;
+      bool negativeExponent = false;
+      if (current < end && (*current == '-' || *current == '+'))
+      {
+        negativeExponent = (*current == '-');
+        ++current;
+      }
+      int exponentValue = 0;
+      int numberOfExponentDigits = 0;
+      for (; current < end && *current >= '0' && *current <= '9'; ++current, ++numberOfExponentDigits)
+      {
+        if (exponentValue < 10000)
+        {
+          exponentValue = exponentValue * 10 + (*current - '0');
+        }
+      }
+      if (numberOfExponentDigits == 0)
+      {
+        return NULL;
+      }
+      exponent += (negativeExponent ? -exponentValue : exponentValue);
+    }
+
+    double result = (double)mantissa;
+    if (exponent < 0 && exponent >= -22)
+    {
+      result /= powersOfTen[-exponent];
+    }
+    else if (exponent > 0 && exponent <= 22)
+    {
+      result *= powersOfTen[exponent];
+    }
+    else if (exponent != 0)
+    {
+      result *= pow(10.0, exponent);
+    }
+    value = (negative ? -result : result);
+    return current;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Parse the next whitespace separated number, advancing the current position
+  bool ReadNextNumber(const char*& current, const char* end, double& value)
+  {
+    while (current < end && IsWhitespace(*current))
+    {
+      ++current;
+    }
+    const char* numberEnd = ParseNumber(current, end, value);
+    if (!numberEnd || (numberEnd < end && !IsWhitespace(*numberEnd)))
+    {
+      return false;
+    }
+    current = numberEnd;
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Counts the whitespace separated tokens in each chunk
+  class CountTokensFunctor
+  {
+  public:
+    CountTokensFunctor(const std::vector<const char*>& chunkBoundaries, std::vector<vtkIdType>& tokenCounts)
+      : ChunkBoundaries(chunkBoundaries)
+      , TokenCounts(tokenCounts)
+    {
+    }
+
+    void operator()(vtkIdType beginChunk, vtkIdType endChunk)
+    {
+      for (vtkIdType chunkIndex=beginChunk; chunkIndex<endChunk; ++chunkIndex)
+      {
+        vtkIdType numberOfTokens = 0;
+        bool inToken = false;
+        const char* chunkEnd = this->ChunkBoundaries[chunkIndex+1];
+        for (const char* current=this->ChunkBoundaries[chunkIndex]; current<chunkEnd; ++current)
+        {
+          bool whitespace = IsWhitespace(*current);
+          if (!whitespace && !inToken)
+          {
+            ++numberOfTokens;
+          }
+          inToken = !whitespace;
+        }
+        this->TokenCounts[chunkIndex] = numberOfTokens;
+      }
+    }
+
+  private:
+    const std::vector<const char*>& ChunkBoundaries;
+    std::vector<vtkIdType>& TokenCounts;
+  };
+
+  //-----------------------------------------------------------------------------
+  /// Parses the numbers in each chunk into the dose and uncertainty arrays.
+  /// Each chunk knows the index of its first token from the token counts of the preceding chunks.
+  class ParseTokensFunctor
+  {
+  public:
+    ParseTokensFunctor(const std::vector<const char*>& chunkBoundaries, const std::vector<vtkIdType>& firstTokenIndices,
+      vtkIdType numberOfVoxels, float* dose, float* uncertainty, std::vector<char>& chunkErrors)
+      : ChunkBoundaries(chunkBoundaries)
+      , FirstTokenIndices(firstTokenIndices)
+      , NumberOfVoxels(numberOfVoxels)
+      , Dose(dose)
+      , Uncertainty(uncertainty)
+      , ChunkErrors(chunkErrors)
+    {
+    }
+
+    void operator()(vtkIdType beginChunk, vtkIdType endChunk)
+    {
+      for (vtkIdType chunkIndex=beginChunk; chunkIndex<endChunk; ++chunkIndex)
+      {
+        vtkIdType tokenIndex = this->FirstTokenIndices[chunkIndex];
+        const char* current = this->ChunkBoundaries[chunkIndex];
+        const char* chunkEnd = this->ChunkBoundaries[chunkIndex+1];
+        while (true)
+        {
+          while (current < chunkEnd && IsWhitespace(*current))
+          {
+            ++current;
+          }
+          if (current >= chunkEnd)
+          {
+            break;
+          }
+          double value = 0.0;
+          if (!ReadNextNumber(current, chunkEnd, value))
+          {
+            this->ChunkErrors[chunkIndex] = 1;
+            break;
+          }
+          if (tokenIndex < this->NumberOfVoxels)
+          {
+            this->Dose[tokenIndex] = (float)value;
+          }
+          else if (this->Uncertainty && tokenIndex < 2 * this->NumberOfVoxels)
+          {
+            this->Uncertainty[tokenIndex - this->NumberOfVoxels] = (float)value;
+          }
+          ++tokenIndex;
+        }
+      }
+    }
+
+  private:
+    const std::vector<const char*>& ChunkBoundaries;
+    const std::vector<vtkIdType>& FirstTokenIndices;
+    vtkIdType NumberOfVoxels;
+    float* Dose;
+    float* Uncertainty;
+    std::vector<char>& ChunkErrors;
+  };
+
+  //-----------------------------------------------------------------------------
+  vtkSmartPointer<vtkImageData> AllocateFloatVolume(const int size[3])
+  {
+    vtkSmartPointer<vtkImageData> imageData = vtkSmartPointer<vtkImageData>::New();
+    imageData->SetExtent(0, size[0] - 1, 0, size[1] - 1, 0, size[2] - 1);
+    imageData->AllocateScalars(VTK_FLOAT, 1);
+    return imageData;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkDosxyzNrc3dDoseFileParser);
+
+//----------------------------------------------------------------------------
+vtkDosxyzNrc3dDoseFileParser::vtkDosxyzNrc3dDoseFileParser()
+{
+  this->FileName = NULL;
+  this->IntensityScalingFactor = 1.0;
+  this->ReadSidecarCache = false;
+  this->WriteSidecarCache = false;
+  this->LoadedFromSidecarCache = false;
+  for (int i=0; i<3; ++i)
+  {
+    this->Origin[i] = 0.0;
+    this->Spacing[i] = 1.0;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkDosxyzNrc3dDoseFileParser::~vtkDosxyzNrc3dDoseFileParser()
+{
+  this->SetFileName(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkDosxyzNrc3dDoseFileParser::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "FileName: " << (this->FileName ? this->FileName : "NULL") << "\n";
+  os << indent << "IntensityScalingFactor: " << this->IntensityScalingFactor << "\n";
+  os << indent << "ReadSidecarCache: " << (this->ReadSidecarCache ? "true" : "false") << "\n";
+  os << indent << "WriteSidecarCache: " << (this->WriteSidecarCache ? "true" : "false") << "\n";
+  os << indent << "Origin: " << this->Origin[0] << ", " << this->Origin[1] << ", " << this->Origin[2] << "\n";
+  os << indent << "Spacing: " << this->Spacing[0] << ", " << this->Spacing[1] << ", " << this->Spacing[2] << "\n";
+  os << indent << "LoadedFromSidecarCache: " << (this->LoadedFromSidecarCache ? "true" : "false") << "\n";
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkDosxyzNrc3dDoseFileParser::GetDoseImageData()
+{
+  return this->DoseImageData;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkDosxyzNrc3dDoseFileParser::GetUncertaintyImageData()
+{
+  return this->UncertaintyImageData;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkDosxyzNrc3dDoseFileParser::GetSidecarCacheFileName(const std::string& fileName)
+{
+  return fileName + ".cache";
+}
+
+//----------------------------------------------------------------------------
+bool vtkDosxyzNrc3dDoseFileParser::Parse()
+{
+  this->DoseImageData = NULL;
+  this->UncertaintyImageData = NULL;
+  this->LoadedFromSidecarCache = false;
+  if (!this->FileName)
+  {
+    vtkErrorMacro("Parse: No file name specified");
+    return false;
+  }
+
+  vtkSlicerRtScopedTimer timer("DosxyzNrc3dDoseFileReader.Parse");
+
+  if (this->ReadSidecarCache && this->ReadSidecarCacheFile())
+  {
+    this->LoadedFromSidecarCache = true;
+    vtkSlicerRtPerformanceMonitor::AddToCounter("DosxyzNrc3dDoseFileReader.Parse", "Sidecar cache hits", 1);
+  }
+  else
+  {
+    if (!this->ParseAsciiFile())
+    {
+      this->DoseImageData = NULL;
+      this->UncertaintyImageData = NULL;
+      return false;
+    }
+    if (this->WriteSidecarCache && !this->WriteSidecarCacheFile())
+    {
+      vtkWarningMacro("Parse: Failed to write sidecar cache file " << GetSidecarCacheFileName(this->FileName));
+    }
+  }
+
+  // Both the parsed values and the cache contain unscaled dose
+  if (this->IntensityScalingFactor != 1.0)
+  {
+    float* dose = static_cast<float*>(this->DoseImageData->GetScalarPointer());
+    vtkIdType numberOfVoxels = this->DoseImageData->GetNumberOfPoints();
+    float scalingFactor = (float)this->IntensityScalingFactor;
+    for (vtkIdType voxelIndex=0; voxelIndex<numberOfVoxels; ++voxelIndex)
+    {
+      dose[voxelIndex] *= scalingFactor;
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDosxyzNrc3dDoseFileParser::ParseAsciiFile()
+{
+  MappedFile file;
+  if (!file.Open(this->FileName))
+  {
+    vtkErrorMacro("ParseAsciiFile: The specified file could not be opened: " << this->FileName);
+    return false;
+  }
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DosxyzNrc3dDoseFileReader.Parse", "Bytes read", (double)file.Size);
+
+  const char* current = file.Data;
+  const char* end = file.Data + file.Size;
+
+  // Block 1: number of voxels in x, y, z directions
+  int size[3] = { 0, 0, 0 };
+  for (int axis=0; axis<3; ++axis)
+  {
+    double value = 0.0;
+    if (!ReadNextNumber(current, end, value))
+    {
+      vtkErrorMacro("ParseAsciiFile: Failed to read number of voxels from file " << this->FileName);
+      return false;
+    }
+    size[axis] = (int)value;
+  }
+  if (size[0] <= 0 || size[1] <= 0 || size[2] <= 0)
+  {
+    vtkErrorMacro("ParseAsciiFile: Number of voxels in X, Y, or Z direction must be greater than zero." << "numVoxelsX " << size[0] << ", numVoxelsY " << size[1] << ", numVoxelsZ " << size[2]);
+    return false;
+  }
+
+  // Blocks 2-4: voxel boundaries in x, y, z directions (cm)
+  const char* axisNames[3] = { "X", "Y", "Z" };
+  for (int axis=0; axis<3; ++axis)
+  {
+    double firstBoundary = 0.0;
+    double previousBoundary = 0.0;
+    bool unevenSpacing = false;
+    for (int boundaryIndex=0; boundaryIndex<size[axis]+1; ++boundaryIndex)
+    {
+      double boundary = 0.0;
+      if (!ReadNextNumber(current, end, boundary))
+      {
+        vtkErrorMacro("ParseAsciiFile: Failed to read voxel boundaries in " << axisNames[axis] << " direction from file " << this->FileName);
+        return false;
+      }
+      boundary *= 10.0; // convert from cm to mm
+      if (boundaryIndex == 0)
+      {
+        firstBoundary = boundary;
+      }
+      else if (boundaryIndex == 1)
+      {
+        this->Spacing[axis] = fabs(boundary - previousBoundary);
+      }
+      else if (!vtkSlicerDosxyzNrc3dDoseFileReaderLogic::AreEqualWithTolerance(this->Spacing[axis], fabs(boundary - previousBoundary)))
+      {
+        unevenSpacing = true;
+      }
+      previousBoundary = boundary;
+    }
+    this->Origin[axis] = firstBoundary;
+    if (unevenSpacing)
+    {
+      vtkWarningMacro("ParseAsciiFile: Voxels have uneven spacing in " << axisNames[axis] << " direction.");
+    }
+  }
+
+  // Blocks 5-6: dose values and relative uncertainties. Split the rest of the file into chunks at whitespace
+  std::vector<const char*> chunkBoundaries;
+  chunkBoundaries.push_back(current);
+  while (chunkBoundaries.back() < end)
+  {
+    const char* chunkEnd = chunkBoundaries.back() + PARSE_CHUNK_SIZE_BYTES;
+    if (chunkEnd >= end)
+    {
+      chunkEnd = end;
+    }
+    while (chunkEnd < end && !IsWhitespace(*chunkEnd))
+    {
+      ++chunkEnd;
+    }
+    chunkBoundaries.push_back(chunkEnd);
+  }
+  vtkIdType numberOfChunks = (vtkIdType)chunkBoundaries.size() - 1;
+
+  std::vector<vtkIdType> tokenCounts(numberOfChunks, 0);
+  CountTokensFunctor countTokensFunctor(chunkBoundaries, tokenCounts);
+  vtkSMPTools::For(0, numberOfChunks, 1, countTokensFunctor);
+
+  std::vector<vtkIdType> firstTokenIndices(numberOfChunks, 0);
+  vtkIdType numberOfTokens = 0;
+  for (vtkIdType chunkIndex=0; chunkIndex<numberOfChunks; ++chunkIndex)
+  {
+    firstTokenIndices[chunkIndex] = numberOfTokens;
+    numberOfTokens += tokenCounts[chunkIndex];
+  }
+
+  vtkIdType numberOfVoxels = (vtkIdType)size[0] * size[1] * size[2];
+  if (numberOfTokens < numberOfVoxels)
+  {
+    vtkErrorMacro("ParseAsciiFile: The end of file was reached earlier than specified. Expected " << numberOfVoxels
+      << " dose values, found " << numberOfTokens);
+    return false;
+  }
+  bool hasUncertainty = (numberOfTokens >= 2 * numberOfVoxels);
+  if (!hasUncertainty && numberOfTokens > numberOfVoxels)
+  {
+    vtkWarningMacro("ParseAsciiFile: Incomplete uncertainty block in file " << this->FileName << ", uncertainty is not loaded");
+  }
+  else if (numberOfTokens > 2 * numberOfVoxels)
+  {
+    vtkWarningMacro("ParseAsciiFile: Extra values found after the uncertainty block in file " << this->FileName);
+  }
+
+  this->DoseImageData = AllocateFloatVolume(size);
+  if (hasUncertainty)
+  {
+    this->UncertaintyImageData = AllocateFloatVolume(size);
+  }
+
+  std::vector<char> chunkErrors(numberOfChunks, 0);
+  ParseTokensFunctor parseTokensFunctor(chunkBoundaries, firstTokenIndices, numberOfVoxels,
+    static_cast<float*>(this->DoseImageData->GetScalarPointer()),
+    (hasUncertainty ? static_cast<float*>(this->UncertaintyImageData->GetScalarPointer()) : NULL),
+    chunkErrors);
+  vtkSMPTools::For(0, numberOfChunks, 1, parseTokensFunctor);
+
+  for (vtkIdType chunkIndex=0; chunkIndex<numberOfChunks; ++chunkIndex)
+  {
+    if (chunkErrors[chunkIndex])
+    {
+      vtkErrorMacro("ParseAsciiFile: Invalid number found in dose or uncertainty block of file " << this->FileName);
+      return false;
+    }
+  }
+
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DosxyzNrc3dDoseFileReader.Parse", "Voxels", (double)numberOfVoxels);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDosxyzNrc3dDoseFileParser::ReadSidecarCacheFile()
+{
+  std::string cacheFileName = GetSidecarCacheFileName(this->FileName);
+  if (!vtksys::SystemTools::FileExists(cacheFileName.c_str(), true))
+  {
+    return false;
+  }
+
+  std::ifstream cacheStream(cacheFileName.c_str(), std::ios::in | std::ios::binary);
+  SidecarCacheHeader header;
+  if (!cacheStream.read(reinterpret_cast<char*>(&header), sizeof(header)))
+  {
+    vtkWarningMacro("ReadSidecarCacheFile: Failed to read header of sidecar cache file " << cacheFileName);
+    return false;
+  }
+
+  // Only use the cache if it was written by the same format on the same architecture from the current 3ddose file
+  if ( memcmp(header.Magic, SIDECAR_CACHE_MAGIC, sizeof(SIDECAR_CACHE_MAGIC)) != 0
+    || header.Version != SIDECAR_CACHE_VERSION
+    || header.ByteOrderMark != SIDECAR_CACHE_BYTE_ORDER_MARK
+    || header.SourceFileLength != (vtkTypeInt64)vtksys::SystemTools::FileLength(this->FileName)
+    || header.SourceModifiedTime != (vtkTypeInt64)vtksys::SystemTools::ModifiedTime(this->FileName)
+    || header.Size[0] <= 0 || header.Size[1] <= 0 || header.Size[2] <= 0 )
+  {
+    vtkDebugMacro("ReadSidecarCacheFile: Sidecar cache file " << cacheFileName << " is out of date, parsing 3ddose file");
+    return false;
+  }
+
+  int size[3] = { header.Size[0], header.Size[1], header.Size[2] };
+  vtkSmartPointer<vtkImageData> doseImageData = AllocateFloatVolume(size);
+  std::streamsize volumeSizeBytes = (std::streamsize)doseImageData->GetNumberOfPoints() * sizeof(float);
+  if (!cacheStream.read(static_cast<char*>(doseImageData->GetScalarPointer()), volumeSizeBytes))
+  {
+    vtkWarningMacro("ReadSidecarCacheFile: Failed to read dose from sidecar cache file " << cacheFileName);
+    return false;
+  }
+  vtkSmartPointer<vtkImageData> uncertaintyImageData;
+  if (header.HasUncertainty)
+  {
+    uncertaintyImageData = AllocateFloatVolume(size);
+    if (!cacheStream.read(static_cast<char*>(uncertaintyImageData->GetScalarPointer()), volumeSizeBytes))
+    {
+      vtkWarningMacro("ReadSidecarCacheFile: Failed to read uncertainty from sidecar cache file " << cacheFileName);
+      return false;
+    }
+  }
+
+  this->DoseImageData = doseImageData;
+  this->UncertaintyImageData = uncertaintyImageData;
+  for (int axis=0; axis<3; ++axis)
+  {
+    this->Origin[axis] = header.Origin[axis];
+    this->Spacing[axis] = header.Spacing[axis];
+  }
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DosxyzNrc3dDoseFileReader.Parse", "Bytes read",
+    (double)sizeof(header) + (header.HasUncertainty ? 2 : 1) * (double)volumeSizeBytes);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDosxyzNrc3dDoseFileParser::WriteSidecarCacheFile()
+{
+  if (!this->DoseImageData)
+  {
+    return false;
+  }
+
+  SidecarCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.Magic, SIDECAR_CACHE_MAGIC, sizeof(SIDECAR_CACHE_MAGIC));
+  header.Version = SIDECAR_CACHE_VERSION;
+  header.ByteOrderMark = SIDECAR_CACHE_BYTE_ORDER_MARK;
+  header.SourceFileLength = (vtkTypeInt64)vtksys::SystemTools::FileLength(this->FileName);
+  header.SourceModifiedTime = (vtkTypeInt64)vtksys::SystemTools::ModifiedTime(this->FileName);
+  int* dimensions = this->DoseImageData->GetDimensions();
+  for (int axis=0; axis<3; ++axis)
+  {
+    header.Size[axis] = dimensions[axis];
+    header.Origin[axis] = this->Origin[axis];
+    header.Spacing[axis] = this->Spacing[axis];
+  }
+  header.HasUncertainty = (this->UncertaintyImageData.GetPointer() ? 1 : 0);
+
+  std::string cacheFileName = GetSidecarCacheFileName(this->FileName);
+  std::ofstream cacheStream(cacheFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!cacheStream)
+  {
+    return false;
+  }
+  std::streamsize volumeSizeBytes = (std::streamsize)this->DoseImageData->GetNumberOfPoints() * sizeof(float);
+  cacheStream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  cacheStream.write(static_cast<const char*>(this->DoseImageData->GetScalarPointer()), volumeSizeBytes);
+  if (header.HasUncertainty)
+  {
+    cacheStream.write(static_cast<const char*>(this->UncertaintyImageData->GetScalarPointer()), volumeSizeBytes);
+  }
+  cacheStream.close();
+  if (cacheStream.fail())
+  {
+    vtksys::SystemTools::RemoveFile(cacheFileName.c_str());
+    return false;
+  }
+  return true;
+}
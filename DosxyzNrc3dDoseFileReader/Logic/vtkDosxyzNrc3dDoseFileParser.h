@@ -0,0 +1,125 @@
+/*==========================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Anna Ilina, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario.
+
+==========================================================================*/
+
+#ifndef __vtkDosxyzNrc3dDoseFileParser_h
+#define __vtkDosxyzNrc3dDoseFileParser_h
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <string>
+
+#include "vtkSlicerDosxyzNrc3dDoseFileReaderLogicExport.h"
+
+class vtkImageData;
+
+/// \ingroup SlicerRt_QtModules_DosxyzNrc3dDoseFileReader
+/// \brief Parser of DOSXYZnrc .3ddose files
+///
+/// The file is memory mapped, and the dose and relative uncertainty blocks are tokenized in parallel
+/// chunks. Numbers are parsed without the C locale, so the result does not depend on the application
+/// locale. Dose values are multiplied by \sa IntensityScalingFactor, uncertainty values (relative errors)
+/// are stored as they are in the file.
+///
+/// Optionally a binary sidecar cache file (see \sa GetSidecarCacheFileName) is written next to the
+/// 3ddose file. The next time the same file is parsed, the volumes are read from the cache with a single
+/// bulk read, provided that the size and modification time of the 3ddose file did not change.
+class VTK_SLICER_DOSXYZNRC3DDOSEFILEREADER_LOGIC_EXPORT vtkDosxyzNrc3dDoseFileParser : public vtkObject
+{
+public:
+  static vtkDosxyzNrc3dDoseFileParser *New();
+  vtkTypeMacro(vtkDosxyzNrc3dDoseFileParser, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Parse the file specified by \sa FileName
+  /// \return Success flag
+  bool Parse();
+
+  /// Get parsed dose volume (float). Origin and spacing of the image data are not set, see \sa GetOrigin and \sa GetSpacing
+  vtkImageData* GetDoseImageData();
+  /// Get parsed relative uncertainty volume (float). NULL if the file does not contain the uncertainty block
+  vtkImageData* GetUncertaintyImageData();
+
+  /// Get file name of the binary sidecar cache belonging to a 3ddose file
+  static std::string GetSidecarCacheFileName(const std::string& fileName);
+
+public:
+  /// Path of the 3ddose file to parse
+  vtkGetStringMacro(FileName);
+  vtkSetStringMacro(FileName);
+
+  /// Factor applied on the dose values. Default is 1
+  vtkGetMacro(IntensityScalingFactor, double);
+  vtkSetMacro(IntensityScalingFactor, double);
+
+  /// Read volumes from the sidecar cache if it is up to date. Off by default
+  vtkGetMacro(ReadSidecarCache, bool);
+  vtkSetMacro(ReadSidecarCache, bool);
+  vtkBooleanMacro(ReadSidecarCache, bool);
+
+  /// Write sidecar cache after parsing the 3ddose file. Off by default
+  vtkGetMacro(WriteSidecarCache, bool);
+  vtkSetMacro(WriteSidecarCache, bool);
+  vtkBooleanMacro(WriteSidecarCache, bool);
+
+  /// Position of the first voxel boundaries (in mm) after parsing
+  vtkGetVector3Macro(Origin, double);
+  /// Voxel size (in mm) after parsing. If spacing is uneven, then it is the size of the first voxel
+  vtkGetVector3Macro(Spacing, double);
+
+  /// Flag indicating whether the last parsed volumes were read from the sidecar cache
+  vtkGetMacro(LoadedFromSidecarCache, bool);
+
+protected:
+  /// Parse the ASCII 3ddose file
+  bool ParseAsciiFile();
+
+  /// Read volumes from the sidecar cache
+  /// \return False if the cache does not exist, is not up to date, or could not be read
+  bool ReadSidecarCacheFile();
+
+  /// Write volumes to the sidecar cache
+  bool WriteSidecarCacheFile();
+
+protected:
+  char* FileName;
+  double IntensityScalingFactor;
+  bool ReadSidecarCache;
+  bool WriteSidecarCache;
+
+  double Origin[3];
+  double Spacing[3];
+  bool LoadedFromSidecarCache;
+
+  vtkSmartPointer<vtkImageData> DoseImageData;
+  vtkSmartPointer<vtkImageData> UncertaintyImageData;
+
+protected:
+  vtkDosxyzNrc3dDoseFileParser();
+  virtual ~vtkDosxyzNrc3dDoseFileParser();
+
+private:
+  vtkDosxyzNrc3dDoseFileParser(const vtkDosxyzNrc3dDoseFileParser&);  // Not implemented
+  void operator=(const vtkDosxyzNrc3dDoseFileParser&);  // Not implemented
+};
+
+#endif
@@ -20,12 +20,17 @@
 
 // DosxyzNrc3dDoseFileReader includes
 #include "vtkSlicerDosxyzNrc3dDoseFileReaderLogic.h"
+#include "vtkDosxyzNrc3dDoseFileParser.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtPerformanceMonitor.h"
 
 // VTK includes
+#include <vtkDoubleArray.h>
 #include <vtkImageData.h>
-#include <vtkMatrix4x4.h>
-#include <vtkImageShiftScale.h>
 #include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+#include <vtkStringArray.h>
 #include "vtksys/SystemTools.hxx"
 
 // MRML includes
@@ -38,12 +43,86 @@
 #include <vtkSlicerApplicationLogic.h>
 
 // STD includes
-#include <vector>
-#include <fstream>
 #include <string>
-#include <algorithm>
-#include <cctype>
-#include <functional>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //-----------------------------------------------------------------------------
+  /// Adds the history-weighted dose and variance of one run to the running sums
+  class AccumulateRunFunctor
+  {
+  public:
+    AccumulateRunFunctor(const float* dose, const float* relativeUncertainty, double numberOfHistories,
+      double* weightedDoseSum, double* weightedVarianceSum)
+      : Dose(dose)
+      , RelativeUncertainty(relativeUncertainty)
+      , NumberOfHistories(numberOfHistories)
+      , WeightedDoseSum(weightedDoseSum)
+      , WeightedVarianceSum(weightedVarianceSum)
+    {
+    }
+
+    void operator()(vtkIdType beginVoxel, vtkIdType endVoxel)
+    {
+      for (vtkIdType voxelIndex=beginVoxel; voxelIndex<endVoxel; ++voxelIndex)
+      {
+        this->WeightedDoseSum[voxelIndex] += this->NumberOfHistories * this->Dose[voxelIndex];
+        if (this->RelativeUncertainty)
+        {
+          double weightedUncertainty = this->NumberOfHistories * this->RelativeUncertainty[voxelIndex] * this->Dose[voxelIndex];
+          this->WeightedVarianceSum[voxelIndex] += weightedUncertainty * weightedUncertainty;
+        }
+      }
+    }
+
+  private:
+    const float* Dose;
+    const float* RelativeUncertainty;
+    double NumberOfHistories;
+    double* WeightedDoseSum;
+    double* WeightedVarianceSum;
+  };
+
+  //-----------------------------------------------------------------------------
+  /// Computes merged dose and relative uncertainty from the running sums
+  class FinalizeMergeFunctor
+  {
+  public:
+    FinalizeMergeFunctor(const double* weightedDoseSum, const double* weightedVarianceSum, double totalNumberOfHistories,
+      float* dose, float* relativeUncertainty)
+      : WeightedDoseSum(weightedDoseSum)
+      , WeightedVarianceSum(weightedVarianceSum)
+      , TotalNumberOfHistories(totalNumberOfHistories)
+      , Dose(dose)
+      , RelativeUncertainty(relativeUncertainty)
+    {
+    }
+
+    void operator()(vtkIdType beginVoxel, vtkIdType endVoxel)
+    {
+      for (vtkIdType voxelIndex=beginVoxel; voxelIndex<endVoxel; ++voxelIndex)
+      {
+        double doseSum = this->WeightedDoseSum[voxelIndex];
+        this->Dose[voxelIndex] = (float)(doseSum / this->TotalNumberOfHistories);
+        if (this->RelativeUncertainty)
+        {
+          // sigma / D = sqrt(sum(N_i^2 * sigma_i^2)) / sum(N_i * D_i)
+          this->RelativeUncertainty[voxelIndex] = (doseSum != 0.0
+            ? (float)(sqrt(this->WeightedVarianceSum[voxelIndex]) / fabs(doseSum)) : 0.0f);
+        }
+      }
+    }
+
+  private:
+    const double* WeightedDoseSum;
+    const double* WeightedVarianceSum;
+    double TotalNumberOfHistories;
+    float* Dose;
+    float* RelativeUncertainty;
+  };
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDosxyzNrc3dDoseFileReaderLogic);
@@ -51,6 +130,7 @@ vtkStandardNewMacro(vtkSlicerDosxyzNrc3dDoseFileReaderLogic);
 //----------------------------------------------------------------------------
 vtkSlicerDosxyzNrc3dDoseFileReaderLogic::vtkSlicerDosxyzNrc3dDoseFileReaderLogic()
 {
+  this->UseSidecarCache = false;
 }
 
 //----------------------------------------------------------------------------
@@ -68,164 +148,201 @@ bool vtkSlicerDosxyzNrc3dDoseFileReaderLogic::AreEqualWithTolerance(double a, do
 void vtkSlicerDosxyzNrc3dDoseFileReaderLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "UseSidecarCache: " << (this->UseSidecarCache ? "true" : "false") << "\n";
 }
 
 //----------------------------------------------------------------------------
 void vtkSlicerDosxyzNrc3dDoseFileReaderLogic::LoadDosxyzNrc3dDoseFile(char* filename, float intensityScalingFactor/*=1.0*/)
 {
-  ifstream readFileStream(filename); 
-  if (!readFileStream)
-  {
-    vtkErrorMacro("LoadDosxyzNrc3dDoseFile: The specified file could not be opened.");
-    return;
-  }
-
   if (intensityScalingFactor == 0)
   {
     vtkWarningMacro("LoadDosxyzNrc3dDoseFile: Invalid scaling factor of 0 found, setting default value of 1");
     intensityScalingFactor = 1.0;
   }
 
-  int size[3] = { 0, 0, 0 };
-
-  // read in block 1 (number of voxels in x, y, z directions)
-  readFileStream >> size[0] >> size[1] >> size[2];
-
-  if (size[0] <= 0 || size[1] <= 0 || size[2] <= 0)
+  // Parse dose (block 5) and relative errors (block 6)
+  vtkSmartPointer<vtkDosxyzNrc3dDoseFileParser> parser = vtkSmartPointer<vtkDosxyzNrc3dDoseFileParser>::New();
+  parser->SetFileName(filename);
+  parser->SetIntensityScalingFactor(intensityScalingFactor);
+  parser->SetReadSidecarCache(this->UseSidecarCache);
+  parser->SetWriteSidecarCache(this->UseSidecarCache);
+  if (!parser->Parse())
   {
-    vtkErrorMacro("LoadDosxyzNrc3dDoseFile: Number of voxels in X, Y, or Z direction must be greater than zero." << "numVoxelsX " << size[0] << ", numVoxelsY " << size[1] << ", numVoxelsZ " << size[2]);
+    vtkErrorMacro("LoadDosxyzNrc3dDoseFile: Failed to load file " << filename);
     return;
   }
 
-  std::vector<double> voxelBoundariesX(size[0] + 1); 
-  std::vector<double> voxelBoundariesY(size[1] + 1);
-  std::vector<double> voxelBoundariesZ(size[2] + 1);
-  double spacingX = 0;
-  double spacingY = 0;
-  double spacingZ = 0;
+  // create volume node for dose values
+  std::string volumeName = vtksys::SystemTools::GetFilenameWithoutExtension(filename);
+  vtkMRMLScalarVolumeNode* dosxyzNrc3dDoseVolumeNode = this->AddVolumeNode(volumeName, parser->GetDoseImageData(), parser->GetOrigin(), parser->GetSpacing());
 
-  int counter = 0;
-  double initialVoxelSpacing = 0;
-  double currentVoxelSpacing = 0;
+  // create volume node for relative uncertainty values
+  if (parser->GetUncertaintyImageData())
+  {
+    this->AddVolumeNode(volumeName + "_Uncertainty", parser->GetUncertaintyImageData(), parser->GetOrigin(), parser->GetSpacing());
+  }
 
-  // read in block 2 (voxel boundaries, cm, in x direction)
-  while (!readFileStream.eof() && counter < size[0] + 1)
+  if (this->GetApplicationLogic() != NULL)
   {
-    readFileStream >> voxelBoundariesX[counter];
-    voxelBoundariesX[counter] = voxelBoundariesX[counter] * 10.0; // convert from cm to mm
-    if (counter == 1)
-    {
-      initialVoxelSpacing = fabs(voxelBoundariesX[counter] - voxelBoundariesX[counter - 1]);
-      spacingX = initialVoxelSpacing;
-    }
-    else if (counter > 1)
+    if (this->GetApplicationLogic()->GetSelectionNode() != NULL)
     {
-      currentVoxelSpacing = abs(voxelBoundariesX[counter] - voxelBoundariesX[counter - 1]);
-      if (AreEqualWithTolerance(initialVoxelSpacing, currentVoxelSpacing) == false)
-      {
-        vtkWarningMacro("LoadDosxyzNrc3dDoseFile: Voxels have uneven spacing in X direction.");
-      }
+      this->GetApplicationLogic()->GetSelectionNode()->SetReferenceActiveVolumeID(dosxyzNrc3dDoseVolumeNode->GetID());
+      this->GetApplicationLogic()->PropagateVolumeSelection();
+      this->GetApplicationLogic()->FitSliceToAll();
     }
-    counter += 1;
   }
+}
 
-  // read in block 3 (voxel boundaries, cm, in y direction)
-  counter = 0;
-  while (!readFileStream.eof() && counter < size[1] + 1)
+//----------------------------------------------------------------------------
+vtkMRMLScalarVolumeNode* vtkSlicerDosxyzNrc3dDoseFileReaderLogic::MergeDosxyzNrc3dDoseFiles(
+  vtkStringArray* fileNames, vtkDoubleArray* numbersOfHistories, const char* outputName, float intensityScalingFactor/*=1.0*/)
+{
+  if (!this->GetMRMLScene())
   {
-    readFileStream >> voxelBoundariesY[counter];
-    voxelBoundariesY[counter] = voxelBoundariesY[counter] * 10.0; // convert from cm to mm
-    if (counter == 1)
-    {
-      initialVoxelSpacing = fabs(voxelBoundariesY[counter] - voxelBoundariesY[counter - 1]);
-      spacingY = initialVoxelSpacing;
-    }
-    else if (counter > 1)
-    {
-      currentVoxelSpacing = abs(voxelBoundariesY[counter] - voxelBoundariesY[counter - 1]);
-      if (AreEqualWithTolerance(initialVoxelSpacing, currentVoxelSpacing) == false)
-      {
-        vtkWarningMacro("LoadDosxyzNrc3dDoseFile: Voxels have uneven spacing in Y direction.");
-      }
-    }
-    counter += 1;
+    vtkErrorMacro("MergeDosxyzNrc3dDoseFiles: Invalid MRML scene");
+    return NULL;
+  }
+  if (!fileNames || fileNames->GetNumberOfValues() == 0)
+  {
+    vtkErrorMacro("MergeDosxyzNrc3dDoseFiles: No input files given");
+    return NULL;
+  }
+  if (numbersOfHistories && numbersOfHistories->GetNumberOfTuples() != fileNames->GetNumberOfValues())
+  {
+    vtkErrorMacro("MergeDosxyzNrc3dDoseFiles: Number of history counts (" << numbersOfHistories->GetNumberOfTuples()
+      << ") does not match the number of files (" << fileNames->GetNumberOfValues() << ")");
+    return NULL;
+  }
+  if (intensityScalingFactor == 0)
+  {
+    vtkWarningMacro("MergeDosxyzNrc3dDoseFiles: Invalid scaling factor of 0 found, setting default value of 1");
+    intensityScalingFactor = 1.0;
   }
 
-  // read in block 4 (voxel boundaries, cm, in z direction)
-  counter = 0;
-  while (!readFileStream.eof() && counter < size[2] + 1)
+  vtkSlicerRtScopedTimer timer("DosxyzNrc3dDoseFileReader.Merge");
+
+  vtkSmartPointer<vtkDosxyzNrc3dDoseFileParser> parser = vtkSmartPointer<vtkDosxyzNrc3dDoseFileParser>::New();
+  parser->SetIntensityScalingFactor(intensityScalingFactor);
+  parser->SetReadSidecarCache(this->UseSidecarCache);
+  parser->SetWriteSidecarCache(this->UseSidecarCache);
+
+  // Running sums
+  std::vector<double> weightedDoseSum;
+  std::vector<double> weightedVarianceSum;
+  double totalNumberOfHistories = 0.0;
+  bool allRunsHaveUncertainty = true;
+  int referenceDimensions[3] = {0,0,0};
+  double referenceOrigin[3] = {0.0,0.0,0.0};
+  double referenceSpacing[3] = {0.0,0.0,0.0};
+
+  for (vtkIdType fileIndex=0; fileIndex<fileNames->GetNumberOfValues(); ++fileIndex)
   {
-    readFileStream >> voxelBoundariesZ[counter];
-    voxelBoundariesZ[counter] = voxelBoundariesZ[counter] * 10.0; // convert from cm to mm
-    if (counter == 1)
+    std::string fileName = fileNames->GetValue(fileIndex);
+    double numberOfHistories = (numbersOfHistories ? numbersOfHistories->GetValue(fileIndex) : 1.0);
+    if (numberOfHistories <= 0.0)
     {
-      initialVoxelSpacing = fabs(voxelBoundariesZ[counter] - voxelBoundariesZ[counter - 1]);
-      spacingZ = initialVoxelSpacing;
+      vtkErrorMacro("MergeDosxyzNrc3dDoseFiles: Invalid number of histories " << numberOfHistories << " for file " << fileName);
+      return NULL;
     }
-    else if (counter > 1)
+
+    parser->SetFileName(fileName.c_str());
+    if (!parser->Parse())
     {
-      currentVoxelSpacing = abs(voxelBoundariesZ[counter] - voxelBoundariesZ[counter - 1]);
-      if (AreEqualWithTolerance(initialVoxelSpacing, currentVoxelSpacing) == false)
-      {
-        vtkWarningMacro("LoadDosxyzNrc3dDoseFile: Voxels have uneven spacing in Z direction.");
-      }
+      vtkErrorMacro("MergeDosxyzNrc3dDoseFiles: Failed to load file " << fileName);
+      return NULL;
     }
-    counter += 1;
-  }
-
-  // read in block 5 (dose array values)
-  vtkSmartPointer<vtkImageData> floatDosxyzNrc3dDoseVolumeData = vtkSmartPointer<vtkImageData>::New();
-  floatDosxyzNrc3dDoseVolumeData->SetExtent(0, size[0] - 1, 0, size[1] - 1, 0, size[2] - 1);
-  floatDosxyzNrc3dDoseVolumeData->AllocateScalars(VTK_FLOAT, 1); 
+    vtkImageData* doseImageData = parser->GetDoseImageData();
+    vtkImageData* uncertaintyImageData = parser->GetUncertaintyImageData();
 
-  float* floatPtr = (float*)floatDosxyzNrc3dDoseVolumeData->GetScalarPointer();
-  float currentValue = 0.0;
-  for (long z = 0; z < size[2]; z++)
-  {
-    for (long y = 0; y < size[1]; y++)
+    // All runs need to be on the same grid
+    if (fileIndex == 0)
     {
-      for (long x = 0; x < size[0]; x++)
+      doseImageData->GetDimensions(referenceDimensions);
+      parser->GetOrigin(referenceOrigin);
+      parser->GetSpacing(referenceSpacing);
+      weightedDoseSum.resize(doseImageData->GetNumberOfPoints(), 0.0);
+    }
+    else
+    {
+      int* dimensions = doseImageData->GetDimensions();
+      double* origin = parser->GetOrigin();
+      double* spacing = parser->GetSpacing();
+      for (int axis=0; axis<3; ++axis)
       {
-        if (readFileStream.eof())
+        if ( dimensions[axis] != referenceDimensions[axis]
+          || !AreEqualWithTolerance(origin[axis], referenceOrigin[axis])
+          || !AreEqualWithTolerance(spacing[axis], referenceSpacing[axis]) )
         {
-          vtkErrorMacro("LoadDosxyzNrc3dDoseFile: The end of file was reached earlier than specified.");
+          vtkErrorMacro("MergeDosxyzNrc3dDoseFiles: Dose grid of file " << fileName << " differs from the grid of " << fileNames->GetValue(0));
+          return NULL;
         }
-        readFileStream >> currentValue;
-        currentValue = currentValue * intensityScalingFactor;
-        (*floatPtr) = currentValue;
-        ++floatPtr;
       }
     }
-  }
 
-  // create volume node for dose values
-  vtkSmartPointer<vtkMRMLScalarVolumeNode> dosxyzNrc3dDoseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
-  dosxyzNrc3dDoseVolumeNode->SetScene(this->GetMRMLScene());
-  dosxyzNrc3dDoseVolumeNode->SetName(vtksys::SystemTools::GetFilenameWithoutExtension(filename).c_str());
-  dosxyzNrc3dDoseVolumeNode->SetSpacing(spacingX, spacingY, spacingZ);
-  dosxyzNrc3dDoseVolumeNode->SetOrigin(voxelBoundariesX[0], voxelBoundariesY[0], voxelBoundariesZ[0]);
-  this->GetMRMLScene()->AddNode(dosxyzNrc3dDoseVolumeNode);
-
-  dosxyzNrc3dDoseVolumeNode->SetAndObserveImageData(floatDosxyzNrc3dDoseVolumeData);
+    if (!uncertaintyImageData && allRunsHaveUncertainty)
+    {
+      vtkWarningMacro("MergeDosxyzNrc3dDoseFiles: File " << fileName << " does not contain uncertainty values, merged uncertainty is not computed");
+      allRunsHaveUncertainty = false;
+      std::vector<double>().swap(weightedVarianceSum);
+    }
+    if (allRunsHaveUncertainty && weightedVarianceSum.empty())
+    {
+      weightedVarianceSum.resize(weightedDoseSum.size(), 0.0);
+    }
 
-  vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode> dosxyzNrc3dDoseVolumeDisplayNode = vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode>::New();
-  this->GetMRMLScene()->AddNode(dosxyzNrc3dDoseVolumeDisplayNode);
-  dosxyzNrc3dDoseVolumeNode->SetAndObserveDisplayNodeID(dosxyzNrc3dDoseVolumeDisplayNode->GetID());
+    AccumulateRunFunctor accumulateFunctor(
+      static_cast<float*>(doseImageData->GetScalarPointer()),
+      (allRunsHaveUncertainty ? static_cast<float*>(uncertaintyImageData->GetScalarPointer()) : NULL),
+      numberOfHistories, &(weightedDoseSum[0]), (allRunsHaveUncertainty ? &(weightedVarianceSum[0]) : NULL));
+    vtkSMPTools::For(0, (vtkIdType)weightedDoseSum.size(), accumulateFunctor);
+    totalNumberOfHistories += numberOfHistories;
+  }
 
-  if (this->GetApplicationLogic() != NULL)
+  // Compute merged volumes
+  vtkSmartPointer<vtkImageData> mergedDoseImageData = vtkSmartPointer<vtkImageData>::New();
+  mergedDoseImageData->SetExtent(0, referenceDimensions[0] - 1, 0, referenceDimensions[1] - 1, 0, referenceDimensions[2] - 1);
+  mergedDoseImageData->AllocateScalars(VTK_FLOAT, 1);
+  vtkSmartPointer<vtkImageData> mergedUncertaintyImageData;
+  if (allRunsHaveUncertainty)
   {
-    if (this->GetApplicationLogic()->GetSelectionNode() != NULL)
-    {
-      this->GetApplicationLogic()->GetSelectionNode()->SetReferenceActiveVolumeID(dosxyzNrc3dDoseVolumeNode->GetID());
-      this->GetApplicationLogic()->PropagateVolumeSelection();
-      this->GetApplicationLogic()->FitSliceToAll();
-    }
+    mergedUncertaintyImageData = vtkSmartPointer<vtkImageData>::New();
+    mergedUncertaintyImageData->SetExtent(mergedDoseImageData->GetExtent());
+    mergedUncertaintyImageData->AllocateScalars(VTK_FLOAT, 1);
+  }
+  FinalizeMergeFunctor finalizeFunctor(&(weightedDoseSum[0]), (allRunsHaveUncertainty ? &(weightedVarianceSum[0]) : NULL),
+    totalNumberOfHistories, static_cast<float*>(mergedDoseImageData->GetScalarPointer()),
+    (allRunsHaveUncertainty ? static_cast<float*>(mergedUncertaintyImageData->GetScalarPointer()) : NULL));
+  vtkSMPTools::For(0, (vtkIdType)weightedDoseSum.size(), finalizeFunctor);
+
+  std::string volumeName = (outputName ? outputName : "MergedDose");
+  vtkMRMLScalarVolumeNode* mergedDoseVolumeNode = this->AddVolumeNode(volumeName, mergedDoseImageData, referenceOrigin, referenceSpacing);
+  if (allRunsHaveUncertainty)
+  {
+    this->AddVolumeNode(volumeName + "_Uncertainty", mergedUncertaintyImageData, referenceOrigin, referenceSpacing);
   }
 
-  dosxyzNrc3dDoseVolumeDisplayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeGrey");
-  dosxyzNrc3dDoseVolumeNode->SetAndObserveDisplayNodeID(dosxyzNrc3dDoseVolumeDisplayNode->GetID());
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DosxyzNrc3dDoseFileReader.Merge", "Files", (double)fileNames->GetNumberOfValues());
+  vtkSlicerRtPerformanceMonitor::AddToCounter("DosxyzNrc3dDoseFileReader.Merge", "Voxels",
+    (double)fileNames->GetNumberOfValues() * weightedDoseSum.size());
+  return mergedDoseVolumeNode;
+}
+
+//----------------------------------------------------------------------------
+vtkMRMLScalarVolumeNode* vtkSlicerDosxyzNrc3dDoseFileReaderLogic::AddVolumeNode(std::string name, vtkImageData* imageData, double origin[3], double spacing[3])
+{
+  vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+  volumeNode->SetScene(this->GetMRMLScene());
+  volumeNode->SetName(name.c_str());
+  volumeNode->SetSpacing(spacing);
+  volumeNode->SetOrigin(origin);
+  this->GetMRMLScene()->AddNode(volumeNode);
+
+  volumeNode->SetAndObserveImageData(imageData);
 
-  //todo: read in block 6 (relative errors) of .3ddose file in another volume node
+  vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode> volumeDisplayNode = vtkSmartPointer<vtkMRMLScalarVolumeDisplayNode>::New();
+  this->GetMRMLScene()->AddNode(volumeDisplayNode);
+  volumeDisplayNode->SetAndObserveColorNodeID("vtkMRMLColorTableNodeGrey");
+  volumeNode->SetAndObserveDisplayNodeID(volumeDisplayNode->GetID());
 
-  readFileStream.close();
+  return volumeNode;
 }
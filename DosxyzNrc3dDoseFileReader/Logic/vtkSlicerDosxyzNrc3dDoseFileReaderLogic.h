@@ -27,11 +27,13 @@
 #include "vtkSlicerModuleLogic.h"
 
 // STD includes
-#include <vector>
+#include <string>
 
 // DosxyzNrc3dDoseFileReader includes
 #include "vtkSlicerDosxyzNrc3dDoseFileReaderLogicExport.h"
 
+class vtkDoubleArray;
+class vtkImageData;
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLScalarVolumeDisplayNode;
 class vtkMRMLVolumeHeaderlessStorageNode;
@@ -46,13 +48,41 @@ public:
   vtkTypeMacro(vtkSlicerDosxyzNrc3dDoseFileReaderLogic, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
 
-  /// Load DosxyzNrc3dDose volume from file
+  /// Load DosxyzNrc3dDose volume from file. If the file contains relative errors, then they are
+  /// loaded into a second volume named after the dose volume with an "_Uncertainty" suffix
   /// \param filename Path and filename of the DosxyzNrc3dDose file
   void LoadDosxyzNrc3dDoseFile(char* filename, float intensityScalingFactor=1.0);
 
+  /// Merge 3ddose files of independent runs of the same simulation (such as jobs of a split DOSXYZnrc simulation)
+  /// into a dose volume and a relative uncertainty volume.
+  /// The files are parsed one by one, and only running sums are kept in memory. The merged dose is the mean of
+  /// the doses weighted by the number of histories, and the merged uncertainty is the uncertainty of this mean:
+  ///   D = sum(N_i * D_i) / sum(N_i),  sigma^2 = sum(N_i^2 * sigma_i^2) / sum(N_i)^2
+  /// where sigma_i is the absolute uncertainty of run i (relative error times dose). Relative uncertainty of zero
+  /// dose voxels is zero. If any of the files lacks the uncertainty block, then no uncertainty volume is created.
+  /// \param fileNames Paths of the 3ddose files. The dose grids need to be identical
+  /// \param numbersOfHistories Number of simulated histories for each file. If NULL, then the runs are weighted equally
+  /// \param outputName Name of the merged dose volume. Uncertainty volume is named with an "_Uncertainty" suffix
+  /// \return Merged dose volume node, NULL on failure
+  vtkMRMLScalarVolumeNode* MergeDosxyzNrc3dDoseFiles(vtkStringArray* fileNames, vtkDoubleArray* numbersOfHistories,
+    const char* outputName, float intensityScalingFactor=1.0);
+
   /// Determine if two numbers are equal within a small tolerance (0.001)
   static bool AreEqualWithTolerance(double a, double b);
 
+  /// Use binary sidecar cache next to the 3ddose file: read volumes from it if it is up to date,
+  /// otherwise parse the 3ddose file and write the cache. Off by default
+  vtkGetMacro(UseSidecarCache, bool);
+  vtkSetMacro(UseSidecarCache, bool);
+  vtkBooleanMacro(UseSidecarCache, bool);
+
+protected:
+  /// Add scalar volume node with grey display node to the scene
+  vtkMRMLScalarVolumeNode* AddVolumeNode(std::string name, vtkImageData* imageData, double origin[3], double spacing[3]);
+
+protected:
+  bool UseSidecarCache;
+
 protected:
   vtkSlicerDosxyzNrc3dDoseFileReaderLogic();
   virtual ~vtkSlicerDosxyzNrc3dDoseFileReaderLogic();
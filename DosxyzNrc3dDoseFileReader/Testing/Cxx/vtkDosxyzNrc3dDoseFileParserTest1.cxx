@@ -0,0 +1,281 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DosxyzNrc3dDoseFileReader includes
+#include "vtkDosxyzNrc3dDoseFileParser.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+  // 2x3x2 grid with 5 mm, 2 mm and 3 mm voxels, first voxel boundaries at (-10, 0, 10) mm.
+  // Boundaries are in cm, the dose of voxel n (x fastest) is 0.015*(n+1), its relative error is 0.01*(n+1).
+  // One value uses the Fortran style exponent
+  const char* HEADER =
+    "   2   3   2\n"
+    "  -1.0000  -0.5000   0.0000\n"
+    "   0.0000   0.2000   0.4000   0.6000\n"
+    "   1.0000   1.3000   1.6000\n";
+  const char* DOSE_BLOCK =
+    " 1.500E-02 3.000E-02 4.500E-02 6.000E-02 7.500E-02 9.000E-02\n"
+    " 1.050E-01 1.200E-01 1.350E-01 1.500E-01 1.650D-01 1.800E-01\n";
+  // Same size as DOSE_BLOCK, only the first value differs (0.025 instead of 0.015)
+  const char* MODIFIED_DOSE_BLOCK =
+    " 2.500E-02 3.000E-02 4.500E-02 6.000E-02 7.500E-02 9.000E-02\n"
+    " 1.050E-01 1.200E-01 1.350E-01 1.500E-01 1.650D-01 1.800E-01\n";
+  const char* UNCERTAINTY_BLOCK =
+    " 1.000E-02 2.000E-02 3.000E-02 4.000E-02 5.000E-02 6.000E-02\n"
+    " 7.000E-02 8.000E-02 9.000E-02 1.000E-01 1.100E-01 1.200E-01\n";
+  // Dose block ending after the seventh value
+  const char* TRUNCATED_DOSE_BLOCK =
+    " 1.500E-02 3.000E-02 4.500E-02 6.000E-02 7.500E-02 9.000E-02\n"
+    " 1.050E-01\n";
+
+  const int EXPECTED_DIMENSIONS[3] = { 2, 3, 2 };
+  const double EXPECTED_ORIGIN[3] = { -10.0, 0.0, 10.0 };
+  const double EXPECTED_SPACING[3] = { 5.0, 2.0, 3.0 };
+  const int NUMBER_OF_VOXELS = 12;
+
+  //----------------------------------------------------------------------------
+  bool WriteFile(const std::string& fileName, const std::string& content)
+  {
+    std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+      std::cerr << "ERROR: Failed to open file " << fileName << " for writing" << std::endl;
+      return false;
+    }
+    file << content;
+    file.close();
+    return !file.fail();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Check geometry and values of the parsed volumes
+  /// \param firstDose Expected dose of the first voxel (before scaling)
+  bool CheckParsedVolumes(vtkDosxyzNrc3dDoseFileParser* parser, double firstDose, double scalingFactor, bool expectUncertainty)
+  {
+    vtkImageData* doseImageData = parser->GetDoseImageData();
+    if (!doseImageData)
+    {
+      std::cerr << "ERROR: No dose volume was parsed" << std::endl;
+      return false;
+    }
+    int* dimensions = doseImageData->GetDimensions();
+    double* origin = parser->GetOrigin();
+    double* spacing = parser->GetSpacing();
+    for (int axis=0; axis<3; ++axis)
+    {
+      if ( dimensions[axis] != EXPECTED_DIMENSIONS[axis]
+        || fabs(origin[axis] - EXPECTED_ORIGIN[axis]) > 1e-6
+        || fabs(spacing[axis] - EXPECTED_SPACING[axis]) > 1e-6 )
+      {
+        std::cerr << "ERROR: Invalid geometry along axis " << axis << ": dimension " << dimensions[axis] << " (expected "
+          << EXPECTED_DIMENSIONS[axis] << "), origin " << origin[axis] << " (expected " << EXPECTED_ORIGIN[axis]
+          << "), spacing " << spacing[axis] << " (expected " << EXPECTED_SPACING[axis] << ")" << std::endl;
+        return false;
+      }
+    }
+
+    vtkImageData* uncertaintyImageData = parser->GetUncertaintyImageData();
+    if (expectUncertainty != (uncertaintyImageData != NULL))
+    {
+      std::cerr << "ERROR: Uncertainty volume is " << (expectUncertainty ? "missing" : "not expected") << std::endl;
+      return false;
+    }
+    if (uncertaintyImageData && uncertaintyImageData->GetNumberOfPoints() != NUMBER_OF_VOXELS)
+    {
+      std::cerr << "ERROR: Invalid number of uncertainty voxels: " << uncertaintyImageData->GetNumberOfPoints() << std::endl;
+      return false;
+    }
+
+    const float* dose = static_cast<float*>(doseImageData->GetScalarPointer());
+    const float* uncertainty = (uncertaintyImageData ? static_cast<float*>(uncertaintyImageData->GetScalarPointer()) : NULL);
+    for (int voxelIndex=0; voxelIndex<NUMBER_OF_VOXELS; ++voxelIndex)
+    {
+      double expectedDose = scalingFactor * (voxelIndex == 0 ? firstDose : 0.015 * (voxelIndex + 1));
+      if (fabs(dose[voxelIndex] - expectedDose) > 1e-6)
+      {
+        std::cerr << "ERROR: Invalid dose in voxel " << voxelIndex << ": " << dose[voxelIndex] << " (expected " << expectedDose << ")" << std::endl;
+        return false;
+      }
+      // Relative errors are not scaled
+      if (uncertainty && fabs(uncertainty[voxelIndex] - 0.01 * (voxelIndex + 1)) > 1e-6)
+      {
+        std::cerr << "ERROR: Invalid uncertainty in voxel " << voxelIndex << ": " << uncertainty[voxelIndex]
+          << " (expected " << 0.01 * (voxelIndex + 1) << ")" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool ParseAndCheck(vtkDosxyzNrc3dDoseFileParser* parser, const char* description,
+    bool expectLoadedFromCache, double firstDose, double scalingFactor, bool expectUncertainty)
+  {
+    std::cout << "Parsing " << description << std::endl;
+    if (!parser->Parse())
+    {
+      std::cerr << "ERROR: Failed to parse " << description << std::endl;
+      return false;
+    }
+    if (parser->GetLoadedFromSidecarCache() != expectLoadedFromCache)
+    {
+      std::cerr << "ERROR: " << description << " was " << (expectLoadedFromCache ? "not " : "")
+        << "expected to be loaded from the sidecar cache" << std::endl;
+      return false;
+    }
+    return CheckParsedVolumes(parser, firstDose, scalingFactor, expectUncertainty);
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkDosxyzNrc3dDoseFileParserTest1(int argc, char* argv[])
+{
+  int argIndex = 1;
+
+  // TemporaryDirectoryPath
+  const char* temporaryDirectoryPath = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-TemporaryDirectoryPath") == 0)
+    {
+      temporaryDirectoryPath = argv[argIndex+1];
+      std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+      argIndex += 2;
+    }
+  }
+  if (!temporaryDirectoryPath)
+  {
+    std::cerr << "Invalid arguments! Usage: vtkDosxyzNrc3dDoseFileParserTest1 -TemporaryDirectoryPath <path>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtksys::SystemTools::MakeDirectory(temporaryDirectoryPath);
+
+  std::string fileName = std::string(temporaryDirectoryPath) + "/ParserTest.3ddose";
+  std::string cacheFileName = vtkDosxyzNrc3dDoseFileParser::GetSidecarCacheFileName(fileName);
+  vtksys::SystemTools::RemoveFile(cacheFileName.c_str());
+
+  vtkNew<vtkDosxyzNrc3dDoseFileParser> parser;
+  parser->SetFileName(fileName.c_str());
+
+  // File without uncertainty block
+  if (!WriteFile(fileName, std::string(HEADER) + DOSE_BLOCK))
+  {
+    return EXIT_FAILURE;
+  }
+  if (!ParseAndCheck(parser.GetPointer(), "file without uncertainty", false, 0.015, 1.0, false))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // File with uncertainty block, dose scaled
+  if (!WriteFile(fileName, std::string(HEADER) + DOSE_BLOCK + UNCERTAINTY_BLOCK))
+  {
+    return EXIT_FAILURE;
+  }
+  parser->SetIntensityScalingFactor(2.0);
+  if (!ParseAndCheck(parser.GetPointer(), "file with uncertainty", false, 0.015, 2.0, true))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Sidecar cache: written by the first parse, used by the second one. The cache holds unscaled dose
+  parser->ReadSidecarCacheOn();
+  parser->WriteSidecarCacheOn();
+  if (!ParseAndCheck(parser.GetPointer(), "file with uncertainty, writing cache", false, 0.015, 2.0, true))
+  {
+    return EXIT_FAILURE;
+  }
+  if (!vtksys::SystemTools::FileExists(cacheFileName.c_str(), true))
+  {
+    std::cerr << "ERROR: Sidecar cache file " << cacheFileName << " was not written" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!ParseAndCheck(parser.GetPointer(), "file with uncertainty from cache", true, 0.015, 2.0, true))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Cache is stale if the size of the file changes
+  parser->SetIntensityScalingFactor(1.0);
+  if (!WriteFile(fileName, std::string(HEADER) + DOSE_BLOCK))
+  {
+    return EXIT_FAILURE;
+  }
+  if (!ParseAndCheck(parser.GetPointer(), "file of changed size", false, 0.015, 1.0, false))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Cache is stale if only the modification time of the file changes. Modification time has one second resolution
+  if (!ParseAndCheck(parser.GetPointer(), "file of changed size from cache", true, 0.015, 1.0, false))
+  {
+    return EXIT_FAILURE;
+  }
+  long originalModifiedTime = vtksys::SystemTools::ModifiedTime(fileName.c_str());
+  vtksys::SystemTools::Delay(1100);
+  if (!WriteFile(fileName, std::string(HEADER) + MODIFIED_DOSE_BLOCK))
+  {
+    return EXIT_FAILURE;
+  }
+  if ( vtksys::SystemTools::FileLength(fileName.c_str()) != (unsigned long)(strlen(HEADER) + strlen(DOSE_BLOCK))
+    || vtksys::SystemTools::ModifiedTime(fileName.c_str()) == originalModifiedTime )
+  {
+    std::cerr << "ERROR: Modified test file is expected to have the same size and a different modification time" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!ParseAndCheck(parser.GetPointer(), "modified file of the same size", false, 0.025, 1.0, false))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Truncated file is rejected (and the cache of the previous file is not used for it)
+  if (!WriteFile(fileName, std::string(HEADER) + TRUNCATED_DOSE_BLOCK))
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "Parsing truncated file, an error is expected" << std::endl;
+  vtkObject::GlobalWarningDisplayOff();
+  bool truncatedFileParsed = parser->Parse();
+  vtkObject::GlobalWarningDisplayOn();
+  if (truncatedFileParsed || parser->GetDoseImageData() || parser->GetUncertaintyImageData())
+  {
+    std::cerr << "ERROR: Truncated file was not rejected" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  vtksys::SystemTools::RemoveFile(cacheFileName.c_str());
+  std::cout << "DosxyzNrc 3ddose file parser test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
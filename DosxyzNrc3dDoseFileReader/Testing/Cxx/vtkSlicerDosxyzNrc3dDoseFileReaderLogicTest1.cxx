@@ -0,0 +1,217 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DosxyzNrc3dDoseFileReader includes
+#include "vtkSlicerDosxyzNrc3dDoseFileReaderLogic.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkStringArray.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace
+{
+  // Two runs on a 2x1x1 grid of 1 mm voxels, with dose and relative error blocks
+  const char* RUN1_FILE_CONTENT =
+    "   2   1   1\n"
+    "   0.0000   0.1000   0.2000\n"
+    "   0.0000   0.1000\n"
+    "   0.0000   0.1000\n"
+    " 1.000E+00 2.000E+00\n"
+    " 1.000E-01 5.000E-02\n";
+  const char* RUN2_FILE_CONTENT =
+    "   2   1   1\n"
+    "   0.0000   0.1000   0.2000\n"
+    "   0.0000   0.1000\n"
+    "   0.0000   0.1000\n"
+    " 2.000E+00 0.000E+00\n"
+    " 2.000E-01 0.000E+00\n";
+  // Same number of voxels as the runs above, but 2 mm spacing along X
+  const char* OTHER_GRID_FILE_CONTENT =
+    "   2   1   1\n"
+    "   0.0000   0.2000   0.4000\n"
+    "   0.0000   0.1000\n"
+    "   0.0000   0.1000\n"
+    " 1.000E+00 1.000E+00\n"
+    " 1.000E-01 1.000E-01\n";
+  const double RUN1_NUMBER_OF_HISTORIES = 1000.0;
+  const double RUN2_NUMBER_OF_HISTORIES = 3000.0;
+
+  // Hand-computed merged values
+  //   Voxel 0: D = (1000*1 + 3000*2) / 4000 = 1.75
+  //            sigma/D = sqrt((1000*0.1*1)^2 + (3000*0.2*2)^2) / (1000*1 + 3000*2) = sqrt(1450000) / 7000
+  //   Voxel 1: D = (1000*2 + 3000*0) / 4000 = 0.5
+  //            sigma/D = sqrt((1000*0.05*2)^2 + 0) / (1000*2) = 0.05
+  const double EXPECTED_MERGED_DOSE[2] = { 1.75, 0.5 };
+  const double EXPECTED_MERGED_UNCERTAINTY[2] = { 0.17202279, 0.05 };
+
+  //----------------------------------------------------------------------------
+  bool WriteFile(const std::string& fileName, const char* content)
+  {
+    std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+      std::cerr << "ERROR: Failed to open file " << fileName << " for writing" << std::endl;
+      return false;
+    }
+    file << content;
+    file.close();
+    return !file.fail();
+  }
+
+  //----------------------------------------------------------------------------
+  bool CheckVoxelValues(vtkMRMLScalarVolumeNode* volumeNode, const char* name, const double expectedValues[2])
+  {
+    if (!volumeNode || !volumeNode->GetImageData() || volumeNode->GetImageData()->GetNumberOfPoints() != 2)
+    {
+      std::cerr << "ERROR: Invalid " << name << " volume" << std::endl;
+      return false;
+    }
+    const float* values = static_cast<float*>(volumeNode->GetImageData()->GetScalarPointer());
+    for (int voxelIndex=0; voxelIndex<2; ++voxelIndex)
+    {
+      if (fabs(values[voxelIndex] - expectedValues[voxelIndex]) > 1e-5)
+      {
+        std::cerr << "ERROR: Invalid " << name << " in voxel " << voxelIndex << ": " << values[voxelIndex]
+          << " (expected " << expectedValues[voxelIndex] << ")" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerDosxyzNrc3dDoseFileReaderLogicTest1(int argc, char* argv[])
+{
+  int argIndex = 1;
+
+  // TemporaryDirectoryPath
+  const char* temporaryDirectoryPath = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-TemporaryDirectoryPath") == 0)
+    {
+      temporaryDirectoryPath = argv[argIndex+1];
+      std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+      argIndex += 2;
+    }
+  }
+  if (!temporaryDirectoryPath)
+  {
+    std::cerr << "Invalid arguments! Usage: vtkSlicerDosxyzNrc3dDoseFileReaderLogicTest1 -TemporaryDirectoryPath <path>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtksys::SystemTools::MakeDirectory(temporaryDirectoryPath);
+
+  std::string run1FileName = std::string(temporaryDirectoryPath) + "/MergeTestRun1.3ddose";
+  std::string run2FileName = std::string(temporaryDirectoryPath) + "/MergeTestRun2.3ddose";
+  std::string otherGridFileName = std::string(temporaryDirectoryPath) + "/MergeTestOtherGrid.3ddose";
+  if ( !WriteFile(run1FileName, RUN1_FILE_CONTENT)
+    || !WriteFile(run2FileName, RUN2_FILE_CONTENT)
+    || !WriteFile(otherGridFileName, OTHER_GRID_FILE_CONTENT) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  vtkNew<vtkMRMLScene> mrmlScene;
+  vtkNew<vtkSlicerDosxyzNrc3dDoseFileReaderLogic> logic;
+  logic->SetMRMLScene(mrmlScene.GetPointer());
+
+  // Merge runs with different numbers of histories
+  vtkNew<vtkStringArray> fileNames;
+  fileNames->InsertNextValue(run1FileName);
+  fileNames->InsertNextValue(run2FileName);
+  vtkNew<vtkDoubleArray> numbersOfHistories;
+  numbersOfHistories->InsertNextValue(RUN1_NUMBER_OF_HISTORIES);
+  numbersOfHistories->InsertNextValue(RUN2_NUMBER_OF_HISTORIES);
+  vtkMRMLScalarVolumeNode* mergedDoseVolumeNode = logic->MergeDosxyzNrc3dDoseFiles(
+    fileNames.GetPointer(), numbersOfHistories.GetPointer(), "MergedDose");
+  if (!mergedDoseVolumeNode)
+  {
+    std::cerr << "ERROR: Failed to merge 3ddose files" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkMRMLScalarVolumeNode* mergedUncertaintyVolumeNode = vtkMRMLScalarVolumeNode::SafeDownCast(
+    mrmlScene->GetFirstNodeByName("MergedDose_Uncertainty"));
+  if ( !CheckVoxelValues(mergedDoseVolumeNode, "merged dose", EXPECTED_MERGED_DOSE)
+    || !CheckVoxelValues(mergedUncertaintyVolumeNode, "merged relative uncertainty", EXPECTED_MERGED_UNCERTAINTY) )
+  {
+    return EXIT_FAILURE;
+  }
+  double* spacing = mergedDoseVolumeNode->GetSpacing();
+  if (fabs(spacing[0] - 1.0) > 1e-6 || fabs(spacing[1] - 1.0) > 1e-6 || fabs(spacing[2] - 1.0) > 1e-6)
+  {
+    std::cerr << "ERROR: Invalid merged dose spacing: " << spacing[0] << ", " << spacing[1] << ", " << spacing[2] << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Invalid inputs are rejected without adding volumes to the scene
+  int numberOfVolumeNodes = mrmlScene->GetNumberOfNodesByClass("vtkMRMLScalarVolumeNode");
+  std::cout << "Merging invalid inputs, errors are expected" << std::endl;
+  vtkObject::GlobalWarningDisplayOff();
+
+  // Number of history counts differs from the number of files
+  vtkNew<vtkDoubleArray> tooFewNumbersOfHistories;
+  tooFewNumbersOfHistories->InsertNextValue(RUN1_NUMBER_OF_HISTORIES);
+  vtkMRMLScalarVolumeNode* historyCountMismatchVolumeNode = logic->MergeDosxyzNrc3dDoseFiles(
+    fileNames.GetPointer(), tooFewNumbersOfHistories.GetPointer(), "HistoryCountMismatch");
+
+  // Dose grids differ
+  vtkNew<vtkStringArray> mismatchedGridFileNames;
+  mismatchedGridFileNames->InsertNextValue(run1FileName);
+  mismatchedGridFileNames->InsertNextValue(otherGridFileName);
+  vtkMRMLScalarVolumeNode* gridMismatchVolumeNode = logic->MergeDosxyzNrc3dDoseFiles(
+    mismatchedGridFileNames.GetPointer(), numbersOfHistories.GetPointer(), "GridMismatch");
+
+  vtkObject::GlobalWarningDisplayOn();
+  if (historyCountMismatchVolumeNode)
+  {
+    std::cerr << "ERROR: Files were merged with mismatching number of history counts" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (gridMismatchVolumeNode)
+  {
+    std::cerr << "ERROR: Files with different dose grids were merged" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (mrmlScene->GetNumberOfNodesByClass("vtkMRMLScalarVolumeNode") != numberOfVolumeNodes)
+  {
+    std::cerr << "ERROR: Volumes were added to the scene by failed merges" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "DosxyzNrc 3ddose file reader logic test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -49,6 +49,7 @@ qSlicerDosxyzNrc3dDoseFileReaderOptionsWidget::qSlicerDosxyzNrc3dDoseFileReaderO
   ctkFlowLayout::replaceLayout(this);
 
   connect(d->ScalingFactorLineEdit, SIGNAL(textChanged(QString)), this, SLOT(updateProperties()));
+  connect(d->UseSidecarCacheCheckBox, SIGNAL(toggled(bool)), this, SLOT(updateProperties()));
 
   // Image intensity scaling factor is 1.0 by default
   float defaultScalingFactorValue = 1.0;
@@ -75,4 +76,5 @@ void qSlicerDosxyzNrc3dDoseFileReaderOptionsWidget::updateProperties()
   }
 
   d->Properties["scalingFactor"] = scalingFactor;
+  d->Properties["useSidecarCache"] = d->UseSidecarCacheCheckBox->isChecked();
 }
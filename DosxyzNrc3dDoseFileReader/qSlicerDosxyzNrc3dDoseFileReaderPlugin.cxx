@@ -104,6 +104,7 @@ bool qSlicerDosxyzNrc3dDoseFileReaderPlugin::load(const IOProperties& properties
   Q_ASSERT(d->Logic);
 
   float intensityScalingFactor = properties["scalingFactor"].toFloat();
+  d->Logic->SetUseSidecarCache(properties.contains("useSidecarCache") && properties["useSidecarCache"].toBool());
   d->Logic->LoadDosxyzNrc3dDoseFile(fileName.toLatin1().data(), intensityScalingFactor);
 
   this->setLoadedNodes(QStringList());
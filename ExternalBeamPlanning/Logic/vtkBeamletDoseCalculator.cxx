@@ -0,0 +1,302 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// ExternalBeamPlanning includes
+#include "vtkBeamletDoseCalculator.h"
+#include "vtkDoseInfluenceMatrix.h"
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkBeamletDoseCalculator);
+
+namespace
+{
+  /// Entries smaller than this fraction of the beamlet dose on its axis at the isocenter are not stored
+  const float MINIMUM_RELATIVE_DOSE = 1.0e-4f;
+
+  //----------------------------------------------------------------------------
+  /// Projects the voxels of the rows to the isocenter plane and computes their depth factor
+  class ProjectVoxelsFunctor
+  {
+  public:
+    ProjectVoxelsFunctor(vtkDoseInfluenceMatrix* matrix, vtkMatrix4x4* worldToBeamMatrix, double sad, double attenuationCoefficient,
+      double* projectedX, double* projectedY, double* depthFactors)
+      : Matrix(matrix)
+      , WorldToBeamMatrix(worldToBeamMatrix)
+      , SAD(sad)
+      , AttenuationCoefficient(attenuationCoefficient)
+      , ProjectedX(projectedX)
+      , ProjectedY(projectedY)
+      , DepthFactors(depthFactors)
+    {
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      double world[4] = {0.0, 0.0, 0.0, 1.0};
+      double beam[4] = {0.0, 0.0, 0.0, 1.0};
+      for (vtkIdType row=begin; row<end; ++row)
+      {
+        this->Matrix->GetVoxelPosition(row, world);
+        this->WorldToBeamMatrix->MultiplyPoint(world, beam);
+        double distanceFromSource = this->SAD - beam[2];
+        if (distanceFromSource <= 0.0)
+        {
+          // Behind the source
+          this->DepthFactors[row] = 0.0;
+          continue;
+        }
+        double magnification = this->SAD / distanceFromSource;
+        this->ProjectedX[row] = beam[0] * magnification;
+        this->ProjectedY[row] = beam[1] * magnification;
+        this->DepthFactors[row] = magnification * magnification * exp(this->AttenuationCoefficient * std::min(beam[2], 0.0));
+      }
+    }
+
+  protected:
+    vtkDoseInfluenceMatrix* Matrix;
+    vtkMatrix4x4* WorldToBeamMatrix;
+    double SAD;
+    double AttenuationCoefficient;
+    double* ProjectedX;
+    double* ProjectedY;
+    double* DepthFactors;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Computes the columns of the beamlets. Rows are bucketed by the beamlet cell they project into,
+  /// so each beamlet only visits the rows in the cells within the cutoff distance
+  class BeamletColumnsFunctor
+  {
+  public:
+    BeamletColumnsFunctor(vtkDoseInfluenceMatrix* matrix, int firstColumn, const double jaws[4], int numberOfBeamletsX, int numberOfBeamletsY,
+      double beamletSize, double penumbraSigma, int cutoffCells,
+      const std::vector<vtkIdType>& cellStarts, const std::vector<int>& cellRows,
+      const std::vector<double>& projectedX, const std::vector<double>& projectedY, const std::vector<double>& depthFactors)
+      : Matrix(matrix)
+      , FirstColumn(firstColumn)
+      , NumberOfBeamletsX(numberOfBeamletsX)
+      , NumberOfBeamletsY(numberOfBeamletsY)
+      , BeamletSize(beamletSize)
+      , PenumbraSigma(penumbraSigma)
+      , CutoffCells(cutoffCells)
+      , CellStarts(cellStarts)
+      , CellRows(cellRows)
+      , ProjectedX(projectedX)
+      , ProjectedY(projectedY)
+      , DepthFactors(depthFactors)
+    {
+      this->FieldOriginX = jaws[0];
+      this->FieldOriginY = jaws[2];
+    }
+
+    /// Fraction of a beamlet of the given half width seen from the given offset from its center
+    double ApertureFraction(double offset) const
+    {
+      const double halfWidth = 0.5 * this->BeamletSize;
+      if (this->PenumbraSigma <= 0.0)
+      {
+        return (fabs(offset) <= halfWidth ? 1.0 : 0.0);
+      }
+      const double scale = 1.0 / (sqrt(2.0) * this->PenumbraSigma);
+      return 0.5 * (erf((offset + halfWidth) * scale) - erf((offset - halfWidth) * scale));
+    }
+
+    void operator()(vtkIdType beginBeamlet, vtkIdType endBeamlet)
+    {
+      std::vector<std::pair<int, float> > entries;
+      std::vector<int> rows;
+      std::vector<float> values;
+      for (vtkIdType beamlet=beginBeamlet; beamlet<endBeamlet; ++beamlet)
+      {
+        int beamletX = static_cast<int>(beamlet % this->NumberOfBeamletsX);
+        int beamletY = static_cast<int>(beamlet / this->NumberOfBeamletsX);
+        double centerX = this->FieldOriginX + (beamletX + 0.5) * this->BeamletSize;
+        double centerY = this->FieldOriginY + (beamletY + 0.5) * this->BeamletSize;
+
+        entries.clear();
+        // Cells are indexed with a margin of CutoffCells on each side of the field, so the cell of the
+        // beamlet is (beamletX+CutoffCells, beamletY+CutoffCells), and its neighborhood is always within the cells
+        const int numberOfCellsX = this->NumberOfBeamletsX + 2*this->CutoffCells;
+        for (int cellY=beamletY; cellY<=beamletY+2*this->CutoffCells; ++cellY)
+        {
+          for (int cellX=beamletX; cellX<=beamletX+2*this->CutoffCells; ++cellX)
+          {
+            int cell = cellX + cellY * numberOfCellsX;
+            for (vtkIdType cellEntry=this->CellStarts[cell]; cellEntry<this->CellStarts[cell+1]; ++cellEntry)
+            {
+              int row = this->CellRows[cellEntry];
+              double dose = this->DepthFactors[row]
+                * this->ApertureFraction(this->ProjectedX[row] - centerX)
+                * this->ApertureFraction(this->ProjectedY[row] - centerY);
+              if (dose > MINIMUM_RELATIVE_DOSE)
+              {
+                entries.push_back(std::make_pair(row, static_cast<float>(dose)));
+              }
+            }
+          }
+        }
+
+        // Rows of the cells are ascending within each cell, but not across cells
+        std::sort(entries.begin(), entries.end());
+        rows.resize(entries.size());
+        values.resize(entries.size());
+        for (size_t entryIndex=0; entryIndex<entries.size(); ++entryIndex)
+        {
+          rows[entryIndex] = entries[entryIndex].first;
+          values[entryIndex] = entries[entryIndex].second;
+        }
+        this->Matrix->SetColumn(this->FirstColumn + static_cast<int>(beamlet), rows, values);
+      }
+    }
+
+  protected:
+    vtkDoseInfluenceMatrix* Matrix;
+    int FirstColumn;
+    double FieldOriginX;
+    double FieldOriginY;
+    int NumberOfBeamletsX;
+    int NumberOfBeamletsY;
+    double BeamletSize;
+    double PenumbraSigma;
+    int CutoffCells;
+    const std::vector<vtkIdType>& CellStarts;
+    const std::vector<int>& CellRows;
+    const std::vector<double>& ProjectedX;
+    const std::vector<double>& ProjectedY;
+    const std::vector<double>& DepthFactors;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkBeamletDoseCalculator::vtkBeamletDoseCalculator()
+  : BeamletSize(5.0)
+  , PenumbraSigma(3.0)
+  , AttenuationCoefficient(0.005)
+  , CutoffSigmas(3.0)
+{
+}
+
+//----------------------------------------------------------------------------
+vtkBeamletDoseCalculator::~vtkBeamletDoseCalculator()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkBeamletDoseCalculator::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "BeamletSize: " << this->BeamletSize << "\n";
+  os << indent << "PenumbraSigma: " << this->PenumbraSigma << "\n";
+  os << indent << "AttenuationCoefficient: " << this->AttenuationCoefficient << "\n";
+  os << indent << "CutoffSigmas: " << this->CutoffSigmas << "\n";
+}
+
+//----------------------------------------------------------------------------
+int vtkBeamletDoseCalculator::AddBeam(vtkDoseInfluenceMatrix* matrix, const char* beamID, vtkMatrix4x4* beamToWorldMatrix, double sad, const double jaws[4])
+{
+  if (!matrix || !beamToWorldMatrix || sad <= 0.0 || this->BeamletSize <= 0.0)
+  {
+    vtkErrorMacro("AddBeam: Invalid input arguments");
+    return -1;
+  }
+  if (jaws[1] <= jaws[0] || jaws[3] <= jaws[2])
+  {
+    vtkErrorMacro("AddBeam: Empty field for beam " << (beamID ? beamID : ""));
+    return -1;
+  }
+
+  int numberOfBeamletsX = static_cast<int>(ceil((jaws[1] - jaws[0]) / this->BeamletSize - 1.0e-6));
+  int numberOfBeamletsY = static_cast<int>(ceil((jaws[3] - jaws[2]) / this->BeamletSize - 1.0e-6));
+  int numberOfBeamlets = numberOfBeamletsX * numberOfBeamletsY;
+  int firstColumn = matrix->AddBeamlets(beamID, numberOfBeamlets);
+  if (firstColumn < 0)
+  {
+    return -1;
+  }
+
+  // Project voxels to the isocenter plane
+  vtkIdType numberOfRows = matrix->GetNumberOfVoxels();
+  std::vector<double> projectedX(numberOfRows, 0.0);
+  std::vector<double> projectedY(numberOfRows, 0.0);
+  std::vector<double> depthFactors(numberOfRows, 0.0);
+  if (numberOfRows > 0)
+  {
+    vtkSmartPointer<vtkMatrix4x4> worldToBeamMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    vtkMatrix4x4::Invert(beamToWorldMatrix, worldToBeamMatrix);
+    ProjectVoxelsFunctor projectFunctor(matrix, worldToBeamMatrix, sad, this->AttenuationCoefficient,
+      &projectedX[0], &projectedY[0], &depthFactors[0]);
+    vtkSMPTools::For(0, numberOfRows, projectFunctor);
+  }
+
+  // Bucket rows by beamlet cell (with a margin of cells around the field for the penumbra).
+  // Counting sort keeps the rows ascending within each cell
+  int cutoffCells = static_cast<int>(ceil(this->CutoffSigmas * std::max(this->PenumbraSigma, 0.0) / this->BeamletSize));
+  int numberOfCellsX = numberOfBeamletsX + 2*cutoffCells;
+  int numberOfCellsY = numberOfBeamletsY + 2*cutoffCells;
+  std::vector<int> rowCells(numberOfRows, -1);
+  std::vector<vtkIdType> cellStarts(numberOfCellsX * numberOfCellsY + 1, 0);
+  for (vtkIdType row=0; row<numberOfRows; ++row)
+  {
+    if (depthFactors[row] <= 0.0)
+    {
+      continue;
+    }
+    int cellX = static_cast<int>(floor((projectedX[row] - jaws[0]) / this->BeamletSize)) + cutoffCells;
+    int cellY = static_cast<int>(floor((projectedY[row] - jaws[2]) / this->BeamletSize)) + cutoffCells;
+    if (cellX < 0 || cellX >= numberOfCellsX || cellY < 0 || cellY >= numberOfCellsY)
+    {
+      continue;
+    }
+    rowCells[row] = cellX + cellY * numberOfCellsX;
+    ++cellStarts[rowCells[row] + 1];
+  }
+  for (size_t cell=1; cell<cellStarts.size(); ++cell)
+  {
+    cellStarts[cell] += cellStarts[cell-1];
+  }
+  std::vector<int> cellRows(cellStarts.back());
+  std::vector<vtkIdType> nextEntryInCell(cellStarts.begin(), cellStarts.end() - 1);
+  for (vtkIdType row=0; row<numberOfRows; ++row)
+  {
+    if (rowCells[row] >= 0)
+    {
+      cellRows[nextEntryInCell[rowCells[row]]++] = static_cast<int>(row);
+    }
+  }
+
+  // Compute beamlet columns
+  BeamletColumnsFunctor columnsFunctor(matrix, firstColumn, jaws, numberOfBeamletsX, numberOfBeamletsY,
+    this->BeamletSize, this->PenumbraSigma, cutoffCells, cellStarts, cellRows, projectedX, projectedY, depthFactors);
+  vtkSMPTools::For(0, numberOfBeamlets, columnsFunctor);
+
+  return numberOfBeamlets;
+}
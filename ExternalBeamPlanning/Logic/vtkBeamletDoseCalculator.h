@@ -0,0 +1,88 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkBeamletDoseCalculator_h
+#define __vtkBeamletDoseCalculator_h
+
+#include "vtkSlicerExternalBeamPlanningModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+class vtkDoseInfluenceMatrix;
+class vtkMatrix4x4;
+
+/// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
+/// \brief Reference beamlet dose model for filling dose influence matrices
+///
+/// The field defined by the jaws is divided into square beamlets at the isocenter plane. The dose of a
+/// beamlet in a voxel is the fraction of the beamlet aperture seen from the voxel blurred by a Gaussian
+/// penumbra (product of error functions along the two axes), scaled by the inverse square law and an
+/// exponential attenuation with the depth below the isocenter plane. This is not a physical dose model,
+/// it is meant for testing optimizers and benchmarking influence matrix storage, like the mock dose engine.
+///
+/// The beam coordinate system is the same as that of the beam model: the source is at (0, 0, SAD),
+/// the isocenter is at the origin, and the beam points toward -Z.
+class VTK_SLICER_EXTERNALBEAMPLANNING_MODULE_LOGIC_EXPORT vtkBeamletDoseCalculator : public vtkObject
+{
+public:
+  static vtkBeamletDoseCalculator *New();
+  vtkTypeMacro(vtkBeamletDoseCalculator, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Add the beamlets of a beam to the influence matrix and compute their columns in parallel
+  /// \param matrix Influence matrix with the voxels already added
+  /// \param beamToWorldMatrix Transform from the beam coordinate system to world (RAS)
+  /// \param jaws X1, X2, Y1, Y2 jaw positions at the isocenter plane (mm)
+  /// \return Number of beamlets added, -1 on failure
+  int AddBeam(vtkDoseInfluenceMatrix* matrix, const char* beamID, vtkMatrix4x4* beamToWorldMatrix, double sad, const double jaws[4]);
+
+  /// Size of the beamlets at the isocenter plane (mm)
+  vtkGetMacro(BeamletSize, double);
+  vtkSetMacro(BeamletSize, double);
+
+  /// Standard deviation of the Gaussian penumbra at the isocenter plane (mm)
+  vtkGetMacro(PenumbraSigma, double);
+  vtkSetMacro(PenumbraSigma, double);
+
+  /// Linear attenuation coefficient (1/mm)
+  vtkGetMacro(AttenuationCoefficient, double);
+  vtkSetMacro(AttenuationCoefficient, double);
+
+  /// Entries are only stored within this many penumbra sigmas from the edge of the beamlet
+  vtkGetMacro(CutoffSigmas, double);
+  vtkSetMacro(CutoffSigmas, double);
+
+protected:
+  double BeamletSize;
+  double PenumbraSigma;
+  double AttenuationCoefficient;
+  double CutoffSigmas;
+
+protected:
+  vtkBeamletDoseCalculator();
+  virtual ~vtkBeamletDoseCalculator();
+
+private:
+  vtkBeamletDoseCalculator(const vtkBeamletDoseCalculator&); // Not implemented
+  void operator=(const vtkBeamletDoseCalculator&);           // Not implemented
+};
+
+#endif
@@ -0,0 +1,550 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// ExternalBeamPlanning includes
+#include "vtkDoseInfluenceMatrix.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkDoseInfluenceMatrix);
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Get IJK coordinates of a voxel from its index in an image with the given extent
+  void GetVoxelIjk(vtkIdType voxelIndex, const int extent[6], double ijk[3])
+  {
+    vtkIdType dimensionX = extent[1] - extent[0] + 1;
+    vtkIdType dimensionY = extent[3] - extent[2] + 1;
+    ijk[0] = extent[0] + voxelIndex % dimensionX;
+    ijk[1] = extent[2] + (voxelIndex / dimensionX) % dimensionY;
+    ijk[2] = extent[4] + voxelIndex / (dimensionX * dimensionY);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Tests whether the centers of dose grid voxels are inside a mask (nearest neighbor sampling)
+  template<class T>
+  class MaskSamplingFunctor
+  {
+  public:
+    MaskSamplingFunctor(vtkOrientedImageData* mask, vtkMatrix4x4* gridIjkToMaskIjk, const int gridExtent[6],
+      const std::vector<vtkIdType>* gridVoxelIndices, unsigned char* inside)
+      : GridIjkToMaskIjk(gridIjkToMaskIjk)
+      , GridVoxelIndices(gridVoxelIndices)
+      , Inside(inside)
+    {
+      std::copy(gridExtent, gridExtent+6, this->GridExtent);
+      mask->GetExtent(this->MaskExtent);
+      this->MaskScalars = static_cast<T*>(mask->GetScalarPointer());
+      this->NumberOfComponents = mask->GetNumberOfScalarComponents();
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      const vtkIdType maskDimensionX = this->MaskExtent[1] - this->MaskExtent[0] + 1;
+      const vtkIdType maskDimensionY = this->MaskExtent[3] - this->MaskExtent[2] + 1;
+      double gridIjk[4] = {0.0, 0.0, 0.0, 1.0};
+      double maskIjk[4] = {0.0, 0.0, 0.0, 1.0};
+      for (vtkIdType n=begin; n<end; ++n)
+      {
+        vtkIdType gridVoxelIndex = (this->GridVoxelIndices ? (*this->GridVoxelIndices)[n] : n);
+        GetVoxelIjk(gridVoxelIndex, this->GridExtent, gridIjk);
+        this->GridIjkToMaskIjk->MultiplyPoint(gridIjk, maskIjk);
+        int i = static_cast<int>(floor(maskIjk[0] + 0.5));
+        int j = static_cast<int>(floor(maskIjk[1] + 0.5));
+        int k = static_cast<int>(floor(maskIjk[2] + 0.5));
+        if ( i < this->MaskExtent[0] || i > this->MaskExtent[1]
+          || j < this->MaskExtent[2] || j > this->MaskExtent[3]
+          || k < this->MaskExtent[4] || k > this->MaskExtent[5] )
+        {
+          this->Inside[n] = 0;
+          continue;
+        }
+        vtkIdType maskVoxelIndex = (i - this->MaskExtent[0])
+          + (j - this->MaskExtent[2]) * maskDimensionX
+          + (k - this->MaskExtent[4]) * maskDimensionX * maskDimensionY;
+        this->Inside[n] = (this->MaskScalars[maskVoxelIndex * this->NumberOfComponents] != 0 ? 1 : 0);
+      }
+    }
+
+  protected:
+    vtkMatrix4x4* GridIjkToMaskIjk;
+    const std::vector<vtkIdType>* GridVoxelIndices;
+    unsigned char* Inside;
+    int GridExtent[6];
+    int MaskExtent[6];
+    T* MaskScalars;
+    int NumberOfComponents;
+  };
+
+  //----------------------------------------------------------------------------
+  template<class T>
+  void SampleMaskTemplated(vtkOrientedImageData* mask, vtkMatrix4x4* gridIjkToMaskIjk, const int gridExtent[6],
+    const std::vector<vtkIdType>* gridVoxelIndices, vtkIdType numberOfVoxels, unsigned char* inside)
+  {
+    MaskSamplingFunctor<T> functor(mask, gridIjkToMaskIjk, gridExtent, gridVoxelIndices, inside);
+    vtkSMPTools::For(0, numberOfVoxels, functor);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Copies the columns set before finalization into the compressed column arrays
+  class PackColumnsFunctor
+  {
+  public:
+    PackColumnsFunctor(const std::vector<std::vector<int> >& columnRows, const std::vector<std::vector<float> >& columnValues,
+      const vtkIdType* columnPointers, int* rowIndices, float* values)
+      : ColumnRows(columnRows)
+      , ColumnValues(columnValues)
+      , ColumnPointers(columnPointers)
+      , RowIndices(rowIndices)
+      , Values(values)
+    {
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      for (vtkIdType column=begin; column<end; ++column)
+      {
+        std::copy(this->ColumnRows[column].begin(), this->ColumnRows[column].end(), this->RowIndices + this->ColumnPointers[column]);
+        std::copy(this->ColumnValues[column].begin(), this->ColumnValues[column].end(), this->Values + this->ColumnPointers[column]);
+      }
+    }
+
+  protected:
+    const std::vector<std::vector<int> >& ColumnRows;
+    const std::vector<std::vector<float> >& ColumnValues;
+    const vtkIdType* ColumnPointers;
+    int* RowIndices;
+    float* Values;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Sparse matrix-vector product of a compressed (row or column) layout.
+  /// Each output element is the dot product of one compressed row or column, so outputs are independent
+  class CompressedProductFunctor
+  {
+  public:
+    CompressedProductFunctor(const vtkIdType* pointers, const int* indices, const float* values, const double* input, double* output)
+      : Pointers(pointers)
+      , Indices(indices)
+      , Values(values)
+      , Input(input)
+      , Output(output)
+    {
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      for (vtkIdType outputIndex=begin; outputIndex<end; ++outputIndex)
+      {
+        double sum = 0.0;
+        const vtkIdType entryEnd = this->Pointers[outputIndex+1];
+        for (vtkIdType entry=this->Pointers[outputIndex]; entry<entryEnd; ++entry)
+        {
+          sum += this->Values[entry] * this->Input[this->Indices[entry]];
+        }
+        this->Output[outputIndex] = sum;
+      }
+    }
+
+  protected:
+    const vtkIdType* Pointers;
+    const int* Indices;
+    const float* Values;
+    const double* Input;
+    double* Output;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkDoseInfluenceMatrix::vtkDoseInfluenceMatrix()
+  : DoseGridImageToWorldMatrix(vtkSmartPointer<vtkMatrix4x4>::New())
+  , Finalized(false)
+{
+  for (int i=0; i<3; ++i)
+  {
+    this->DoseGridExtent[2*i] = 0;
+    this->DoseGridExtent[2*i+1] = -1;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkDoseInfluenceMatrix::~vtkDoseInfluenceMatrix()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkDoseInfluenceMatrix::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "DoseGridExtent: " << this->DoseGridExtent[0] << " " << this->DoseGridExtent[1] << " " << this->DoseGridExtent[2]
+    << " " << this->DoseGridExtent[3] << " " << this->DoseGridExtent[4] << " " << this->DoseGridExtent[5] << "\n";
+  os << indent << "NumberOfVoxels: " << this->GetNumberOfVoxels() << "\n";
+  os << indent << "NumberOfBeamlets: " << this->GetNumberOfBeamlets() << "\n";
+  os << indent << "Finalized: " << (this->Finalized ? "true" : "false") << "\n";
+  os << indent << "NumberOfNonZeros: " << this->GetNumberOfNonZeros() << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkDoseInfluenceMatrix::SetDoseGrid(vtkOrientedImageData* geometry)
+{
+  if (!geometry)
+  {
+    vtkErrorMacro("SetDoseGrid: Invalid dose grid geometry");
+    return;
+  }
+
+  geometry->GetExtent(this->DoseGridExtent);
+  geometry->GetImageToWorldMatrix(this->DoseGridImageToWorldMatrix);
+
+  this->VoxelIndices.clear();
+  this->BeamIDs.clear();
+  this->BeamletBeamIndices.clear();
+  this->ColumnRows.clear();
+  this->ColumnValues.clear();
+  this->ColumnPointers.clear();
+  this->RowIndices.clear();
+  this->Values.clear();
+  this->RowPointers.clear();
+  this->ColumnIndices.clear();
+  this->RowValues.clear();
+  this->Finalized = false;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkDoseInfluenceMatrix::GetDoseGrid(vtkOrientedImageData* geometry)
+{
+  if (!geometry)
+  {
+    vtkErrorMacro("GetDoseGrid: Invalid output geometry");
+    return;
+  }
+  geometry->SetExtent(this->DoseGridExtent);
+  geometry->SetImageToWorldMatrix(this->DoseGridImageToWorldMatrix);
+}
+
+//----------------------------------------------------------------------------
+bool vtkDoseInfluenceMatrix::SampleMask(vtkOrientedImageData* mask, const std::vector<vtkIdType>* gridVoxelIndices, std::vector<unsigned char>& inside)
+{
+  if (!mask || !mask->GetPointData() || !mask->GetPointData()->GetScalars())
+  {
+    vtkErrorMacro("SampleMask: Invalid mask");
+    return false;
+  }
+
+  vtkIdType numberOfVoxels = 0;
+  if (gridVoxelIndices)
+  {
+    numberOfVoxels = static_cast<vtkIdType>(gridVoxelIndices->size());
+  }
+  else
+  {
+    numberOfVoxels = static_cast<vtkIdType>(this->DoseGridExtent[1] - this->DoseGridExtent[0] + 1)
+      * (this->DoseGridExtent[3] - this->DoseGridExtent[2] + 1) * (this->DoseGridExtent[5] - this->DoseGridExtent[4] + 1);
+  }
+  inside.assign(numberOfVoxels, 0);
+  if (numberOfVoxels == 0)
+  {
+    return true;
+  }
+
+  // Dose grid IJK to mask IJK
+  vtkSmartPointer<vtkMatrix4x4> maskWorldToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  mask->GetWorldToImageMatrix(maskWorldToImageMatrix);
+  vtkSmartPointer<vtkMatrix4x4> gridIjkToMaskIjk = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Multiply4x4(maskWorldToImageMatrix, this->DoseGridImageToWorldMatrix, gridIjkToMaskIjk);
+
+  switch (mask->GetScalarType())
+  {
+    vtkTemplateMacro(SampleMaskTemplated<VTK_TT>(mask, gridIjkToMaskIjk, this->DoseGridExtent, gridVoxelIndices, numberOfVoxels, &inside[0]));
+    default:
+      vtkErrorMacro("SampleMask: Unsupported mask scalar type");
+      return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDoseInfluenceMatrix::AddVoxelsInMask(vtkOrientedImageData* mask)
+{
+  if (!this->BeamletBeamIndices.empty())
+  {
+    vtkErrorMacro("AddVoxelsInMask: Voxels cannot be added after the beamlets");
+    return false;
+  }
+
+  std::vector<unsigned char> inside;
+  if (!this->SampleMask(mask, NULL, inside))
+  {
+    return false;
+  }
+
+  // Merge with the existing rows, keeping the ascending order
+  for (std::vector<vtkIdType>::iterator voxelIt=this->VoxelIndices.begin(); voxelIt!=this->VoxelIndices.end(); ++voxelIt)
+  {
+    inside[*voxelIt] = 1;
+  }
+  this->VoxelIndices.clear();
+  vtkIdType numberOfGridVoxels = static_cast<vtkIdType>(inside.size());
+  for (vtkIdType voxelIndex=0; voxelIndex<numberOfGridVoxels; ++voxelIndex)
+  {
+    if (inside[voxelIndex])
+    {
+      this->VoxelIndices.push_back(voxelIndex);
+    }
+  }
+  if (this->VoxelIndices.size() > static_cast<size_t>(VTK_INT_MAX))
+  {
+    vtkErrorMacro("AddVoxelsInMask: Number of voxels exceeds the maximum row index");
+    this->VoxelIndices.clear();
+    return false;
+  }
+
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkDoseInfluenceMatrix::GetVoxelPosition(vtkIdType row, double position[3])
+{
+  double ijk[4] = {0.0, 0.0, 0.0, 1.0};
+  GetVoxelIjk(this->VoxelIndices[row], this->DoseGridExtent, ijk);
+  double world[4] = {0.0, 0.0, 0.0, 1.0};
+  this->DoseGridImageToWorldMatrix->MultiplyPoint(ijk, world);
+  position[0] = world[0];
+  position[1] = world[1];
+  position[2] = world[2];
+}
+
+//----------------------------------------------------------------------------
+bool vtkDoseInfluenceMatrix::GetRowsInMask(vtkOrientedImageData* mask, std::vector<int>& rows)
+{
+  rows.clear();
+  std::vector<unsigned char> inside;
+  if (!this->SampleMask(mask, &this->VoxelIndices, inside))
+  {
+    return false;
+  }
+  int numberOfRows = static_cast<int>(inside.size());
+  for (int row=0; row<numberOfRows; ++row)
+  {
+    if (inside[row])
+    {
+      rows.push_back(row);
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int vtkDoseInfluenceMatrix::AddBeamlets(const char* beamID, int numberOfBeamlets)
+{
+  if (this->Finalized)
+  {
+    vtkErrorMacro("AddBeamlets: Beamlets cannot be added to a finalized matrix");
+    return -1;
+  }
+  if (numberOfBeamlets < 0)
+  {
+    vtkErrorMacro("AddBeamlets: Invalid number of beamlets");
+    return -1;
+  }
+
+  int firstColumn = this->GetNumberOfBeamlets();
+  int beamIndex = static_cast<int>(this->BeamIDs.size());
+  this->BeamIDs.push_back(beamID ? beamID : "");
+  this->BeamletBeamIndices.resize(firstColumn + numberOfBeamlets, beamIndex);
+  this->ColumnRows.resize(firstColumn + numberOfBeamlets);
+  this->ColumnValues.resize(firstColumn + numberOfBeamlets);
+
+  this->Modified();
+  return firstColumn;
+}
+
+//----------------------------------------------------------------------------
+const char* vtkDoseInfluenceMatrix::GetBeamletBeamID(int column)
+{
+  if (column < 0 || column >= this->GetNumberOfBeamlets())
+  {
+    vtkErrorMacro("GetBeamletBeamID: Invalid column " << column);
+    return NULL;
+  }
+  return this->BeamIDs[this->BeamletBeamIndices[column]].c_str();
+}
+
+//----------------------------------------------------------------------------
+bool vtkDoseInfluenceMatrix::SetColumn(int column, const std::vector<int>& rows, const std::vector<float>& values)
+{
+  // No Modified call, as the function is called from multiple threads
+  if (this->Finalized || column < 0 || column >= this->GetNumberOfBeamlets() || rows.size() != values.size())
+  {
+    vtkGenericWarningMacro("vtkDoseInfluenceMatrix::SetColumn: Invalid column " << column);
+    return false;
+  }
+  // Rows are used as indices when the row-major copy is built in Finalize
+  vtkIdType numberOfRows = this->GetNumberOfVoxels();
+  for (size_t entry=0; entry<rows.size(); ++entry)
+  {
+    if (rows[entry] < 0 || rows[entry] >= numberOfRows || (entry > 0 && rows[entry] <= rows[entry-1]))
+    {
+      vtkGenericWarningMacro("vtkDoseInfluenceMatrix::SetColumn: Invalid row " << rows[entry] << " in column " << column
+        << " (rows need to be ascending and less than " << numberOfRows << ")");
+      return false;
+    }
+  }
+  this->ColumnRows[column] = rows;
+  this->ColumnValues[column] = values;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkDoseInfluenceMatrix::Finalize()
+{
+  if (this->Finalized)
+  {
+    return;
+  }
+
+  // Compressed columns
+  int numberOfBeamlets = this->GetNumberOfBeamlets();
+  this->ColumnPointers.assign(numberOfBeamlets + 1, 0);
+  for (int column=0; column<numberOfBeamlets; ++column)
+  {
+    this->ColumnPointers[column+1] = this->ColumnPointers[column] + static_cast<vtkIdType>(this->ColumnRows[column].size());
+  }
+  vtkIdType numberOfNonZeros = this->ColumnPointers[numberOfBeamlets];
+  this->RowIndices.resize(numberOfNonZeros);
+  this->Values.resize(numberOfNonZeros);
+  if (numberOfNonZeros > 0)
+  {
+    PackColumnsFunctor packFunctor(this->ColumnRows, this->ColumnValues, &this->ColumnPointers[0], &this->RowIndices[0], &this->Values[0]);
+    vtkSMPTools::For(0, numberOfBeamlets, packFunctor);
+  }
+  std::vector<std::vector<int> >().swap(this->ColumnRows);
+  std::vector<std::vector<float> >().swap(this->ColumnValues);
+
+  // Compressed rows. Filled by traversing the columns in order, so the columns in each row are ascending
+  vtkIdType numberOfRows = this->GetNumberOfVoxels();
+  this->RowPointers.assign(numberOfRows + 1, 0);
+  for (vtkIdType entry=0; entry<numberOfNonZeros; ++entry)
+  {
+    ++this->RowPointers[this->RowIndices[entry] + 1];
+  }
+  for (vtkIdType row=0; row<numberOfRows; ++row)
+  {
+    this->RowPointers[row+1] += this->RowPointers[row];
+  }
+  this->ColumnIndices.resize(numberOfNonZeros);
+  this->RowValues.resize(numberOfNonZeros);
+  std::vector<vtkIdType> nextEntryInRow(this->RowPointers.begin(), this->RowPointers.end() - 1);
+  for (int column=0; column<numberOfBeamlets; ++column)
+  {
+    for (vtkIdType entry=this->ColumnPointers[column]; entry<this->ColumnPointers[column+1]; ++entry)
+    {
+      vtkIdType rowEntry = nextEntryInRow[this->RowIndices[entry]]++;
+      this->ColumnIndices[rowEntry] = column;
+      this->RowValues[rowEntry] = this->Values[entry];
+    }
+  }
+
+  this->Finalized = true;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkDoseInfluenceMatrix::GetMemorySizeMB()
+{
+  double bytes = static_cast<double>(this->Values.size()) * 2.0 * (sizeof(float) + sizeof(int))
+    + static_cast<double>(this->ColumnPointers.size() + this->RowPointers.size() + this->VoxelIndices.size()) * sizeof(vtkIdType);
+  return bytes / (1024.0 * 1024.0);
+}
+
+//----------------------------------------------------------------------------
+void vtkDoseInfluenceMatrix::MultiplyFluence(const double* fluence, double* dose)
+{
+  if (!this->Finalized || !fluence || !dose)
+  {
+    vtkErrorMacro("MultiplyFluence: Matrix is not finalized or invalid arguments");
+    return;
+  }
+  vtkIdType numberOfRows = this->GetNumberOfVoxels();
+  if (this->Values.empty())
+  {
+    std::fill(dose, dose + numberOfRows, 0.0);
+    return;
+  }
+  CompressedProductFunctor functor(&this->RowPointers[0], &this->ColumnIndices[0], &this->RowValues[0], fluence, dose);
+  vtkSMPTools::For(0, numberOfRows, functor);
+}
+
+//----------------------------------------------------------------------------
+void vtkDoseInfluenceMatrix::MultiplyTransposed(const double* voxelValues, double* result)
+{
+  if (!this->Finalized || !voxelValues || !result)
+  {
+    vtkErrorMacro("MultiplyTransposed: Matrix is not finalized or invalid arguments");
+    return;
+  }
+  int numberOfBeamlets = this->GetNumberOfBeamlets();
+  if (this->Values.empty())
+  {
+    std::fill(result, result + numberOfBeamlets, 0.0);
+    return;
+  }
+  CompressedProductFunctor functor(&this->ColumnPointers[0], &this->RowIndices[0], &this->Values[0], voxelValues, result);
+  vtkSMPTools::For(0, numberOfBeamlets, functor);
+}
+
+//----------------------------------------------------------------------------
+void vtkDoseInfluenceMatrix::ScatterToImage(const double* dose, vtkOrientedImageData* doseImage)
+{
+  if (!dose || !doseImage)
+  {
+    vtkErrorMacro("ScatterToImage: Invalid arguments");
+    return;
+  }
+
+  this->GetDoseGrid(doseImage);
+  doseImage->AllocateScalars(VTK_FLOAT, 1);
+  float* doseScalars = static_cast<float*>(doseImage->GetScalarPointer());
+  vtkIdType numberOfGridVoxels = doseImage->GetNumberOfPoints();
+  memset(doseScalars, 0, numberOfGridVoxels * sizeof(float));
+  vtkIdType numberOfRows = this->GetNumberOfVoxels();
+  for (vtkIdType row=0; row<numberOfRows; ++row)
+  {
+    doseScalars[this->VoxelIndices[row]] = static_cast<float>(dose[row]);
+  }
+  doseImage->Modified();
+}
@@ -0,0 +1,166 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkDoseInfluenceMatrix_h
+#define __vtkDoseInfluenceMatrix_h
+
+#include "vtkSlicerExternalBeamPlanningModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <string>
+#include <vector>
+
+class vtkMatrix4x4;
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
+/// \brief Sparse dose influence matrix: dose in each voxel of interest per unit fluence of each beamlet
+///
+/// Rows are the voxels of the dose grid that are inside the structures of interest, columns are the
+/// beamlets of the beams in the plan. Entries are stored in compressed column (CSC) layout with float
+/// values, so that the columns of the beamlets can be computed independently (and in parallel) by the
+/// dose engines. A row-major copy of the entries is built when the matrix is finalized, so that both
+/// the dose (A*x) and the gradient (A^T*g) products are computed without write conflicts between threads.
+///
+/// Usage:
+///   1. \sa SetDoseGrid, then \sa AddVoxelsInMask for each structure of interest
+///   2. \sa AddBeamlets for each beam, then \sa SetColumn for each beamlet (may be called from multiple threads)
+///   3. \sa Finalize, after which the products can be computed
+class VTK_SLICER_EXTERNALBEAMPLANNING_MODULE_LOGIC_EXPORT vtkDoseInfluenceMatrix : public vtkObject
+{
+public:
+  static vtkDoseInfluenceMatrix *New();
+  vtkTypeMacro(vtkDoseInfluenceMatrix, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set dose grid geometry (extent and image to world matrix). Removes all voxels and beamlets
+  void SetDoseGrid(vtkOrientedImageData* geometry);
+  /// Get dose grid geometry. Scalars are not allocated
+  void GetDoseGrid(vtkOrientedImageData* geometry);
+
+  /// Add the dose grid voxels whose center is inside a mask (nonzero voxel) as rows of the matrix.
+  /// The mask can have any geometry, it is sampled with nearest neighbor interpolation.
+  /// Voxels can only be added before the first beamlet
+  /// \return Success flag
+  bool AddVoxelsInMask(vtkOrientedImageData* mask);
+
+  /// Get number of voxels (rows)
+  vtkIdType GetNumberOfVoxels() { return static_cast<vtkIdType>(this->VoxelIndices.size()); };
+  /// Get index of the voxel of a row in the dose grid (in the order of the scalars of an image with the dose grid geometry)
+  vtkIdType GetVoxelIndex(vtkIdType row) { return this->VoxelIndices[row]; };
+  /// Get world (RAS) position of the center of the voxel of a row
+  void GetVoxelPosition(vtkIdType row, double position[3]);
+
+  /// Get rows whose voxel center is inside a mask (same sampling as \sa AddVoxelsInMask)
+  /// \param rows Output row indices in ascending order
+  /// \return Success flag
+  bool GetRowsInMask(vtkOrientedImageData* mask, std::vector<int>& rows);
+
+  /// Add columns for the beamlets of a beam
+  /// \return Index of the column of the first beamlet of the beam, -1 on failure
+  int AddBeamlets(const char* beamID, int numberOfBeamlets);
+  /// Get number of beamlets (columns)
+  int GetNumberOfBeamlets() { return static_cast<int>(this->BeamletBeamIndices.size()); };
+  /// Get ID of the beam a beamlet belongs to
+  const char* GetBeamletBeamID(int column);
+
+  /// Set the nonzero entries of a column. Can be called for different columns from multiple threads
+  /// \param rows Row indices of the entries in ascending order
+  /// \param values Dose per unit fluence at the rows
+  /// \return False if the column or any of the rows is out of range, or the rows are not ascending. The column is not set then
+  bool SetColumn(int column, const std::vector<int>& rows, const std::vector<float>& values);
+
+  /// Pack the columns into the compressed column arrays and build the row-major copy.
+  /// Columns cannot be set after the matrix is finalized
+  void Finalize();
+  /// Get whether the matrix is finalized and the products can be computed
+  bool GetFinalized() { return this->Finalized; };
+
+  /// Get number of nonzero entries. Valid after \sa Finalize
+  vtkIdType GetNumberOfNonZeros() { return static_cast<vtkIdType>(this->Values.size()); };
+  /// Get memory used by the entries (both layouts), in MB
+  double GetMemorySizeMB();
+
+  /// Compressed column layout: entries of column c are at [ColumnPointers[c], ColumnPointers[c+1])
+  const vtkIdType* GetColumnPointers() { return this->ColumnPointers.empty() ? NULL : &this->ColumnPointers[0]; };
+  const int* GetRowIndices() { return this->RowIndices.empty() ? NULL : &this->RowIndices[0]; };
+  const float* GetValues() { return this->Values.empty() ? NULL : &this->Values[0]; };
+
+  /// Compute dose in the rows: dose = A * fluence. Parallel over rows
+  /// \param fluence Fluence of each beamlet (number of beamlets values)
+  /// \param dose Output dose of each row (number of voxels values)
+  void MultiplyFluence(const double* fluence, double* dose);
+  /// Compute the product with the transposed matrix: result = A^T * voxelValues. Parallel over beamlets
+  /// \param voxelValues Value of each row (e.g. derivative of the objective function by the dose)
+  /// \param result Output value for each beamlet
+  void MultiplyTransposed(const double* voxelValues, double* result);
+
+  /// Write dose of the rows into an image with the dose grid geometry. Voxels outside the rows are zero
+  void ScatterToImage(const double* dose, vtkOrientedImageData* doseImage);
+
+protected:
+  /// Compute for each given dose grid voxel whether its center is inside the mask
+  /// \param gridVoxelIndices Dose grid voxel indices to test. All dose grid voxels are tested if NULL
+  bool SampleMask(vtkOrientedImageData* mask, const std::vector<vtkIdType>* gridVoxelIndices, std::vector<unsigned char>& inside);
+
+protected:
+  /// Extent of the dose grid
+  int DoseGridExtent[6];
+  /// Image to world matrix of the dose grid
+  vtkSmartPointer<vtkMatrix4x4> DoseGridImageToWorldMatrix;
+
+  /// Dose grid voxel index of each row, ascending
+  std::vector<vtkIdType> VoxelIndices;
+
+  /// IDs of the beams that have beamlets
+  std::vector<std::string> BeamIDs;
+  /// Index in \sa BeamIDs of the beam of each beamlet
+  std::vector<int> BeamletBeamIndices;
+
+  /// Columns set by \sa SetColumn before \sa Finalize
+  std::vector<std::vector<int> > ColumnRows;
+  std::vector<std::vector<float> > ColumnValues;
+
+  /// Compressed column layout
+  std::vector<vtkIdType> ColumnPointers;
+  std::vector<int> RowIndices;
+  std::vector<float> Values;
+
+  /// Compressed row layout (same entries)
+  std::vector<vtkIdType> RowPointers;
+  std::vector<int> ColumnIndices;
+  std::vector<float> RowValues;
+
+  bool Finalized;
+
+protected:
+  vtkDoseInfluenceMatrix();
+  virtual ~vtkDoseInfluenceMatrix();
+
+private:
+  vtkDoseInfluenceMatrix(const vtkDoseInfluenceMatrix&); // Not implemented
+  void operator=(const vtkDoseInfluenceMatrix&);         // Not implemented
+};
+
+#endif
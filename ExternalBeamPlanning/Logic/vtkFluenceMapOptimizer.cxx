@@ -0,0 +1,360 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// ExternalBeamPlanning includes
+#include "vtkFluenceMapOptimizer.h"
+#include "vtkDoseInfluenceMatrix.h"
+
+// SlicerRt includes
+#include "vtkSlicerRtPerformanceMonitor.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkFluenceMapOptimizer);
+vtkCxxSetObjectMacro(vtkFluenceMapOptimizer, InfluenceMatrix, vtkDoseInfluenceMatrix);
+
+namespace
+{
+  /// Maximum number of step size halvings in the line search of one iteration
+  const int MAXIMUM_LINE_SEARCH_STEPS = 30;
+  /// Sufficient decrease constant of the line search
+  const double LINE_SEARCH_SUFFICIENT_DECREASE = 1.0e-4;
+
+  //----------------------------------------------------------------------------
+  /// Sum of squared violations of one objective, and their derivative by the dose of each row
+  class ObjectiveFunctor
+  {
+  public:
+    ObjectiveFunctor(const std::vector<int>& rows, int type, double dose, double scale, const double* rowDose, double* doseGradient)
+      : Rows(rows)
+      , Type(type)
+      , Dose(dose)
+      , Scale(scale)
+      , RowDose(rowDose)
+      , DoseGradient(doseGradient)
+      , Total(0.0)
+    {
+    }
+
+    void Initialize()
+    {
+      this->Sum.Local() = 0.0;
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      double& sum = this->Sum.Local();
+      for (vtkIdType n=begin; n<end; ++n)
+      {
+        int row = this->Rows[n];
+        double difference = this->RowDose[row] - this->Dose;
+        if ( (this->Type == vtkFluenceMapOptimizer::MinimumDose && difference > 0.0)
+          || (this->Type == vtkFluenceMapOptimizer::MaximumDose && difference < 0.0) )
+        {
+          continue;
+        }
+        sum += difference * difference;
+        if (this->DoseGradient)
+        {
+          // Rows of an objective are unique, so threads never write the same element
+          this->DoseGradient[row] += 2.0 * this->Scale * difference;
+        }
+      }
+    }
+
+    void Reduce()
+    {
+      this->Total = 0.0;
+      for (vtkSMPThreadLocal<double>::iterator sumIt=this->Sum.begin(); sumIt!=this->Sum.end(); ++sumIt)
+      {
+        this->Total += (*sumIt);
+      }
+    }
+
+    const std::vector<int>& Rows;
+    int Type;
+    double Dose;
+    double Scale;
+    const double* RowDose;
+    double* DoseGradient;
+    vtkSMPThreadLocal<double> Sum;
+    double Total;
+  };
+}
+
+//----------------------------------------------------------------------------
+vtkFluenceMapOptimizer::vtkFluenceMapOptimizer()
+  : InfluenceMatrix(NULL)
+  , Fluence(vtkDoubleArray::New())
+  , MaximumNumberOfIterations(200)
+  , RelativeTolerance(1.0e-5)
+  , LastNumberOfIterations(0)
+  , LastObjectiveValue(0.0)
+{
+  this->Fluence->SetName("Fluence");
+}
+
+//----------------------------------------------------------------------------
+vtkFluenceMapOptimizer::~vtkFluenceMapOptimizer()
+{
+  this->SetInfluenceMatrix(NULL);
+  this->Fluence->Delete();
+}
+
+//----------------------------------------------------------------------------
+void vtkFluenceMapOptimizer::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "NumberOfObjectives: " << this->GetNumberOfObjectives() << "\n";
+  os << indent << "MaximumNumberOfIterations: " << this->MaximumNumberOfIterations << "\n";
+  os << indent << "RelativeTolerance: " << this->RelativeTolerance << "\n";
+  os << indent << "LastNumberOfIterations: " << this->LastNumberOfIterations << "\n";
+  os << indent << "LastObjectiveValue: " << this->LastObjectiveValue << "\n";
+}
+
+//----------------------------------------------------------------------------
+int vtkFluenceMapOptimizer::AddObjective(vtkOrientedImageData* structureMask, int type, double dose, double weight)
+{
+  if (!this->InfluenceMatrix)
+  {
+    vtkErrorMacro("AddObjective: Influence matrix is not set");
+    return -1;
+  }
+  if (type < UniformDose || type > MaximumDose || weight < 0.0)
+  {
+    vtkErrorMacro("AddObjective: Invalid objective type or weight");
+    return -1;
+  }
+
+  Objective objective;
+  if (!this->InfluenceMatrix->GetRowsInMask(structureMask, objective.Rows))
+  {
+    return -1;
+  }
+  if (objective.Rows.empty())
+  {
+    vtkErrorMacro("AddObjective: No voxels of the influence matrix are in the structure");
+    return -1;
+  }
+  objective.Type = type;
+  objective.Dose = dose;
+  objective.Weight = weight;
+  this->Objectives.push_back(objective);
+
+  this->Modified();
+  return static_cast<int>(this->Objectives.size()) - 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkFluenceMapOptimizer::RemoveAllObjectives()
+{
+  this->Objectives.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkFluenceMapOptimizer::EvaluateObjectiveFromDose(const double* dose, double* doseGradient)
+{
+  if (doseGradient)
+  {
+    std::fill(doseGradient, doseGradient + this->InfluenceMatrix->GetNumberOfVoxels(), 0.0);
+  }
+
+  double objectiveValue = 0.0;
+  for (std::vector<Objective>::iterator objectiveIt=this->Objectives.begin(); objectiveIt!=this->Objectives.end(); ++objectiveIt)
+  {
+    double scale = objectiveIt->Weight / objectiveIt->Rows.size();
+    ObjectiveFunctor functor(objectiveIt->Rows, objectiveIt->Type, objectiveIt->Dose, scale, dose, doseGradient);
+    vtkSMPTools::For(0, static_cast<vtkIdType>(objectiveIt->Rows.size()), functor);
+    objectiveValue += scale * functor.Total;
+  }
+  return objectiveValue;
+}
+
+//----------------------------------------------------------------------------
+double vtkFluenceMapOptimizer::EvaluateObjective(const double* fluence)
+{
+  if (!this->InfluenceMatrix || !this->InfluenceMatrix->GetFinalized() || !fluence)
+  {
+    vtkErrorMacro("EvaluateObjective: Invalid influence matrix or fluence");
+    return 0.0;
+  }
+  std::vector<double> dose(this->InfluenceMatrix->GetNumberOfVoxels(), 0.0);
+  if (!dose.empty())
+  {
+    this->InfluenceMatrix->MultiplyFluence(fluence, &dose[0]);
+  }
+  return this->EvaluateObjectiveFromDose(dose.empty() ? NULL : &dose[0], NULL);
+}
+
+//----------------------------------------------------------------------------
+bool vtkFluenceMapOptimizer::Optimize()
+{
+  this->LastNumberOfIterations = 0;
+  if (!this->InfluenceMatrix || !this->InfluenceMatrix->GetFinalized())
+  {
+    vtkErrorMacro("Optimize: Influence matrix is not set or not finalized");
+    return false;
+  }
+  int numberOfBeamlets = this->InfluenceMatrix->GetNumberOfBeamlets();
+  vtkIdType numberOfVoxels = this->InfluenceMatrix->GetNumberOfVoxels();
+  if (numberOfBeamlets == 0 || numberOfVoxels == 0 || this->Objectives.empty())
+  {
+    vtkErrorMacro("Optimize: No beamlets, voxels or objectives");
+    return false;
+  }
+
+  vtkSlicerRtScopedTimer timer("ExternalBeamPlanning.FluenceOptimization");
+
+  // Initial fluence
+  if (this->Fluence->GetNumberOfTuples() != numberOfBeamlets || this->Fluence->GetNumberOfComponents() != 1)
+  {
+    this->Fluence->SetNumberOfComponents(1);
+    this->Fluence->SetNumberOfTuples(numberOfBeamlets);
+    this->Fluence->FillComponent(0, 1.0);
+  }
+  std::vector<double> fluence(this->Fluence->GetPointer(0), this->Fluence->GetPointer(0) + numberOfBeamlets);
+  for (int beamlet=0; beamlet<numberOfBeamlets; ++beamlet)
+  {
+    fluence[beamlet] = std::max(fluence[beamlet], 0.0);
+  }
+
+  std::vector<double> dose(numberOfVoxels, 0.0);
+  std::vector<double> doseGradient(numberOfVoxels, 0.0);
+  std::vector<double> gradient(numberOfBeamlets, 0.0);
+  std::vector<double> candidateFluence(numberOfBeamlets, 0.0);
+  std::vector<double> candidateDose(numberOfVoxels, 0.0);
+  std::vector<double> candidateDoseGradient(numberOfVoxels, 0.0);
+  std::vector<double> candidateGradient(numberOfBeamlets, 0.0);
+
+  this->InfluenceMatrix->MultiplyFluence(&fluence[0], &dose[0]);
+  double objectiveValue = this->EvaluateObjectiveFromDose(&dose[0], &doseGradient[0]);
+  this->InfluenceMatrix->MultiplyTransposed(&doseGradient[0], &gradient[0]);
+
+  // Initial step moves the beamlet with the largest gradient by the mean fluence
+  double meanFluence = 0.0;
+  double maximumGradient = 0.0;
+  for (int beamlet=0; beamlet<numberOfBeamlets; ++beamlet)
+  {
+    meanFluence += fluence[beamlet] / numberOfBeamlets;
+    maximumGradient = std::max(maximumGradient, fabs(gradient[beamlet]));
+  }
+  double stepSize = (maximumGradient > 0.0 ? std::max(meanFluence, 1.0) / maximumGradient : 1.0);
+
+  int iteration = 0;
+  for (iteration=0; iteration<this->MaximumNumberOfIterations; ++iteration)
+  {
+    // Projected gradient step with backtracking line search
+    bool accepted = false;
+    bool stationary = false;
+    double candidateObjectiveValue = objectiveValue;
+    double squaredStepLength = 0.0;
+    for (int lineSearchStep=0; lineSearchStep<MAXIMUM_LINE_SEARCH_STEPS; ++lineSearchStep)
+    {
+      squaredStepLength = 0.0;
+      for (int beamlet=0; beamlet<numberOfBeamlets; ++beamlet)
+      {
+        candidateFluence[beamlet] = std::max(fluence[beamlet] - stepSize * gradient[beamlet], 0.0);
+        double change = candidateFluence[beamlet] - fluence[beamlet];
+        squaredStepLength += change * change;
+      }
+      if (squaredStepLength == 0.0)
+      {
+        stationary = true;
+        break;
+      }
+      this->InfluenceMatrix->MultiplyFluence(&candidateFluence[0], &candidateDose[0]);
+      candidateObjectiveValue = this->EvaluateObjectiveFromDose(&candidateDose[0], &candidateDoseGradient[0]);
+      if (candidateObjectiveValue <= objectiveValue - LINE_SEARCH_SUFFICIENT_DECREASE / stepSize * squaredStepLength)
+      {
+        accepted = true;
+        break;
+      }
+      stepSize *= 0.5;
+    }
+    if (!accepted || stationary)
+    {
+      break;
+    }
+
+    this->InfluenceMatrix->MultiplyTransposed(&candidateDoseGradient[0], &candidateGradient[0]);
+
+    // Barzilai-Borwein step size for the next iteration
+    double stepDotGradientChange = 0.0;
+    for (int beamlet=0; beamlet<numberOfBeamlets; ++beamlet)
+    {
+      stepDotGradientChange += (candidateFluence[beamlet] - fluence[beamlet]) * (candidateGradient[beamlet] - gradient[beamlet]);
+    }
+    stepSize = (stepDotGradientChange > 0.0 ? squaredStepLength / stepDotGradientChange : 2.0 * stepSize);
+
+    double relativeDecrease = (objectiveValue - candidateObjectiveValue) / std::max(objectiveValue, 1.0e-12);
+    fluence.swap(candidateFluence);
+    dose.swap(candidateDose);
+    gradient.swap(candidateGradient);
+    objectiveValue = candidateObjectiveValue;
+    if (relativeDecrease < this->RelativeTolerance)
+    {
+      ++iteration;
+      break;
+    }
+  }
+
+  std::copy(fluence.begin(), fluence.end(), this->Fluence->GetPointer(0));
+  this->Fluence->Modified();
+  this->LastNumberOfIterations = iteration;
+  this->LastObjectiveValue = objectiveValue;
+  vtkSlicerRtPerformanceMonitor::AddToCounter("ExternalBeamPlanning.FluenceOptimization", "Iterations", iteration);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkFluenceMapOptimizer::GetDose(vtkOrientedImageData* doseImage)
+{
+  if (!this->InfluenceMatrix || !this->InfluenceMatrix->GetFinalized() || !doseImage)
+  {
+    vtkErrorMacro("GetDose: Invalid influence matrix or output image");
+    return;
+  }
+  if (this->Fluence->GetNumberOfTuples() != this->InfluenceMatrix->GetNumberOfBeamlets())
+  {
+    vtkErrorMacro("GetDose: Fluence has not been optimized for the current influence matrix");
+    return;
+  }
+
+  std::vector<double> dose(this->InfluenceMatrix->GetNumberOfVoxels(), 0.0);
+  if (!dose.empty())
+  {
+    this->InfluenceMatrix->MultiplyFluence(this->Fluence->GetPointer(0), &dose[0]);
+  }
+  this->InfluenceMatrix->ScatterToImage(dose.empty() ? NULL : &dose[0], doseImage);
+}
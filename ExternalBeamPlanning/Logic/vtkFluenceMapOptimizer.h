@@ -0,0 +1,139 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkFluenceMapOptimizer_h
+#define __vtkFluenceMapOptimizer_h
+
+#include "vtkSlicerExternalBeamPlanningModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <vector>
+
+class vtkDoseInfluenceMatrix;
+class vtkDoubleArray;
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
+/// \brief Fluence map optimization on a sparse dose influence matrix
+///
+/// Minimizes the sum of weighted quadratic dose objectives of structures over non-negative beamlet fluences:
+///   f(x) = sum_o weight_o / N_o * sum_{voxels v of o} penalty_o(d_v - dose_o)^2,  d = A x
+/// where the penalty is the full difference for uniform dose objectives, and only the underdose
+/// or overdose part for minimum and maximum dose objectives.
+///
+/// Projected gradient descent is used with Barzilai-Borwein step sizes and backtracking line search.
+/// Each iteration computes the gradient with one transposed product (A^T g, parallel over beamlets),
+/// and the dose with one forward product (A x, parallel over voxels) per line search step.
+class VTK_SLICER_EXTERNALBEAMPLANNING_MODULE_LOGIC_EXPORT vtkFluenceMapOptimizer : public vtkObject
+{
+public:
+  enum ObjectiveType
+  {
+    UniformDose = 0,
+    MinimumDose,
+    MaximumDose
+  };
+
+public:
+  static vtkFluenceMapOptimizer *New();
+  vtkTypeMacro(vtkFluenceMapOptimizer, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Set finalized dose influence matrix. Objectives refer to its rows, so they need to be added after setting the matrix
+  void SetInfluenceMatrix(vtkDoseInfluenceMatrix* matrix);
+  vtkGetObjectMacro(InfluenceMatrix, vtkDoseInfluenceMatrix);
+
+  /// Add objective for the voxels of the influence matrix inside a structure mask
+  /// \param type Objective type (\sa ObjectiveType)
+  /// \param dose Prescribed dose (uniform), lower limit (minimum) or upper limit (maximum)
+  /// \param weight Relative importance of the objective
+  /// \return Index of the objective, -1 on failure (e.g. no matrix voxels in the mask)
+  int AddObjective(vtkOrientedImageData* structureMask, int type, double dose, double weight);
+  /// Remove all objectives
+  void RemoveAllObjectives();
+  /// Get number of objectives
+  int GetNumberOfObjectives() { return static_cast<int>(this->Objectives.size()); };
+
+  /// Run the optimization. Starts from the current fluence if it matches the number of beamlets,
+  /// otherwise from uniform unit fluence
+  /// \return Success flag
+  bool Optimize();
+
+  /// Evaluate the objective function for a fluence
+  /// \param fluence Fluence of each beamlet
+  double EvaluateObjective(const double* fluence);
+
+  /// Get optimized fluence (one value per beamlet)
+  vtkGetObjectMacro(Fluence, vtkDoubleArray);
+
+  /// Get dose of the optimized fluence in the dose grid of the influence matrix
+  void GetDose(vtkOrientedImageData* doseImage);
+
+  /// Maximum number of iterations
+  vtkGetMacro(MaximumNumberOfIterations, int);
+  vtkSetMacro(MaximumNumberOfIterations, int);
+
+  /// Optimization stops when the relative decrease of the objective function in an iteration is smaller than this
+  vtkGetMacro(RelativeTolerance, double);
+  vtkSetMacro(RelativeTolerance, double);
+
+  /// Number of iterations in the last optimization
+  vtkGetMacro(LastNumberOfIterations, int);
+  /// Objective function value at the end of the last optimization
+  vtkGetMacro(LastObjectiveValue, double);
+
+protected:
+  /// Objective on a set of matrix rows
+  struct Objective
+  {
+    std::vector<int> Rows;
+    int Type;
+    double Dose;
+    double Weight;
+  };
+
+  /// Compute objective function from the dose of the rows
+  /// \param doseGradient Output derivative of the objective function by the dose of each row. Not computed if NULL
+  double EvaluateObjectiveFromDose(const double* dose, double* doseGradient);
+
+protected:
+  vtkDoseInfluenceMatrix* InfluenceMatrix;
+  vtkDoubleArray* Fluence;
+  std::vector<Objective> Objectives;
+
+  int MaximumNumberOfIterations;
+  double RelativeTolerance;
+
+  int LastNumberOfIterations;
+  double LastObjectiveValue;
+
+protected:
+  vtkFluenceMapOptimizer();
+  virtual ~vtkFluenceMapOptimizer();
+
+private:
+  vtkFluenceMapOptimizer(const vtkFluenceMapOptimizer&); // Not implemented
+  void operator=(const vtkFluenceMapOptimizer&);         // Not implemented
+};
+
+#endif
@@ -0,0 +1,200 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// ExternalBeamPlanning includes
+#include "qSlicerMockDoseEngine.h"
+
+// Beams includes
+#include "vtkMRMLRTBeamNode.h"
+#include "vtkMRMLRTPlanNode.h"
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+
+// SegmentationCore includes
+#include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
+#include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
+#include "vtkSegmentationConverterFactory.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtPerformanceMonitor.h"
+
+// MRML includes
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+
+// STD includes
+#include <iostream>
+
+namespace
+{
+  const char* PLAN_INPUT_CACHE_OPERATION_NAME = "ExternalBeamPlanning.PlanInputCache";
+  const char* TARGET_SEGMENT_ID = "Target";
+  const char* ORGAN_AT_RISK_SEGMENT_ID = "OrganAtRisk";
+
+  //----------------------------------------------------------------------------
+  void AddSphereSegment(vtkSegmentation* segmentation, const char* segmentID, double center[3], double radius)
+  {
+    vtkNew<vtkSphereSource> sphereSource;
+    sphereSource->SetCenter(center);
+    sphereSource->SetRadius(radius);
+    sphereSource->Update();
+    vtkNew<vtkSegment> segment;
+    segment->SetName(segmentID);
+    segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName(), sphereSource->GetOutput());
+    segmentation->AddSegment(segment.GetPointer(), segmentID);
+  }
+
+  //----------------------------------------------------------------------------
+  bool CheckCacheCounters(const char* stage, double expectedHits, double expectedMisses, double expectedInvalidations)
+  {
+    vtkSlicerRtPerformanceMonitor* monitor = vtkSlicerRtPerformanceMonitor::GetInstance();
+    double hits = monitor->GetCounterValue(PLAN_INPUT_CACHE_OPERATION_NAME, "Hits");
+    double misses = monitor->GetCounterValue(PLAN_INPUT_CACHE_OPERATION_NAME, "Misses");
+    double invalidations = monitor->GetCounterValue(PLAN_INPUT_CACHE_OPERATION_NAME, "Invalidations");
+    std::cout << stage << ": " << hits << " hits, " << misses << " misses, " << invalidations << " invalidations" << std::endl;
+    if (hits != expectedHits || misses != expectedMisses || invalidations != expectedInvalidations)
+    {
+      std::cerr << "ERROR: " << stage << ": Invalid plan input cache counters (expected " << expectedHits << " hits, "
+        << expectedMisses << " misses, " << expectedInvalidations << " invalidations)" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerAbstractDoseEngineTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSlicerRtPerformanceMonitor* monitor = vtkSlicerRtPerformanceMonitor::GetInstance();
+  monitor->Reset();
+  monitor->EnabledOn();
+
+  // The segments are converted to labelmap when the dose engine asks for them
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkClosedSurfaceToBinaryLabelmapConversionRule>::New() );
+
+  vtkNew<vtkMRMLScene> mrmlScene;
+
+  // Reference volume of 30x30x30 voxels with 1 mm spacing
+  vtkNew<vtkImageData> referenceImageData;
+  referenceImageData->SetExtent(0, 29, 0, 29, 0, 29);
+  referenceImageData->AllocateScalars(VTK_FLOAT, 1);
+  referenceImageData->GetPointData()->GetScalars()->FillComponent(0, 0.0);
+  vtkNew<vtkMRMLScalarVolumeNode> referenceVolumeNode;
+  referenceVolumeNode->SetAndObserveImageData(referenceImageData.GetPointer());
+  mrmlScene->AddNode(referenceVolumeNode.GetPointer());
+
+  // Segmentation with closed surface master representation, so that the binary labelmap representation
+  // is only created when the inputs of the first beam are computed
+  vtkNew<vtkMRMLSegmentationNode> segmentationNode;
+  mrmlScene->AddNode(segmentationNode.GetPointer());
+  segmentationNode->SetReferenceImageGeometryParameterFromVolumeNode(referenceVolumeNode.GetPointer());
+  vtkSegmentation* segmentation = segmentationNode->GetSegmentation();
+  segmentation->SetMasterRepresentationName(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName());
+  double targetCenter[3] = { 15.0, 15.0, 12.0 };
+  AddSphereSegment(segmentation, TARGET_SEGMENT_ID, targetCenter, 6.0);
+  double organAtRiskCenter[3] = { 15.0, 15.0, 22.0 };
+  AddSphereSegment(segmentation, ORGAN_AT_RISK_SEGMENT_ID, organAtRiskCenter, 3.0);
+
+  // Plan with two beams
+  vtkNew<vtkMRMLRTPlanNode> planNode;
+  mrmlScene->AddNode(planNode.GetPointer());
+  planNode->SetAndObserveReferenceVolumeNode(referenceVolumeNode.GetPointer());
+  planNode->SetAndObserveSegmentationNode(segmentationNode.GetPointer());
+  planNode->SetTargetSegmentID(TARGET_SEGMENT_ID);
+  vtkSmartPointer<vtkMRMLRTBeamNode> beamNodes[2];
+  for (int beamIndex=0; beamIndex<2; ++beamIndex)
+  {
+    beamNodes[beamIndex] = vtkSmartPointer<vtkMRMLRTBeamNode>::New();
+    beamNodes[beamIndex]->SetGantryAngle(90.0 * beamIndex);
+    mrmlScene->AddNode(beamNodes[beamIndex]);
+    planNode->AddBeam(beamNodes[beamIndex]);
+  }
+
+  // Get the inputs for each beam the way dose engines do
+  qSlicerMockDoseEngine engine;
+  vtkOrientedImageData* firstBeamTargetLabelmap = NULL;
+  vtkOrientedImageData* firstBeamOrganAtRiskLabelmap = NULL;
+  for (int beamIndex=0; beamIndex<2; ++beamIndex)
+  {
+    vtkMRMLRTPlanNode* beamPlanNode = beamNodes[beamIndex]->GetParentPlanNode();
+    vtkOrientedImageData* targetLabelmap = engine.planTargetLabelmap(beamPlanNode);
+    vtkOrientedImageData* organAtRiskLabelmap = engine.planSegmentLabelmap(beamPlanNode, ORGAN_AT_RISK_SEGMENT_ID);
+    if (!targetLabelmap || !organAtRiskLabelmap)
+    {
+      std::cerr << "ERROR: Failed to get plan input labelmaps for beam " << beamIndex << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (beamIndex == 0)
+    {
+      firstBeamTargetLabelmap = targetLabelmap;
+      firstBeamOrganAtRiskLabelmap = organAtRiskLabelmap;
+    }
+    else if (targetLabelmap != firstBeamTargetLabelmap || organAtRiskLabelmap != firstBeamOrganAtRiskLabelmap)
+    {
+      std::cerr << "ERROR: Second beam did not get the labelmaps cached for the first beam" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // First beam computes both labelmaps, second beam uses the cached ones. Creating the binary labelmap
+  // representation for the first beam must not invalidate the cache
+  if (!CheckCacheCounters("Two beams", 2, 2, 0))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Modifying a segment invalidates the cache
+  vtkNew<vtkSphereSource> largerTargetSource;
+  largerTargetSource->SetCenter(targetCenter);
+  largerTargetSource->SetRadius(7.0);
+  largerTargetSource->Update();
+  vtkPolyData* targetSurface = vtkPolyData::SafeDownCast( segmentation->GetSegment(TARGET_SEGMENT_ID)->GetRepresentation(
+    vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName() ) );
+  targetSurface->DeepCopy(largerTargetSource->GetOutput());
+  if (!engine.planTargetLabelmap(planNode.GetPointer()))
+  {
+    std::cerr << "ERROR: Failed to get plan target labelmap after modifying the target" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CheckCacheCounters("Modified target", 2, 3, 1))
+  {
+    return EXIT_FAILURE;
+  }
+
+  monitor->Reset();
+  monitor->EnabledOff();
+
+  std::cout << "Abstract dose engine plan input cache test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,221 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// ExternalBeamPlanning includes
+#include "qSlicerDoseEngineLogic.h"
+#include "qSlicerDoseEnginePluginHandler.h"
+#include "qSlicerMockDoseEngine.h"
+
+// Beams includes
+#include "vtkMRMLRTBeamNode.h"
+#include "vtkMRMLRTPlanNode.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtPerformanceMonitor.h"
+
+// MRML includes
+#include <vtkMRMLColorTableNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkDataArray.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkPointData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+  const int NUMBER_OF_BEAMS = 3;
+  const char* ACCUMULATION_OPERATION_NAME = "ExternalBeamPlanning.AccumulateTotalDose";
+
+  //----------------------------------------------------------------------------
+  /// Create 10x10x10 image with 1 mm spacing. Each beam gets a different dose pattern
+  /// so that a wrong weight shows up in the total
+  void CreateImage(vtkImageData* imageData, int beamIndex)
+  {
+    imageData->SetExtent(0, 9, 0, 9, 0, 9);
+    imageData->AllocateScalars(VTK_FLOAT, 1);
+    float* values = static_cast<float*>(imageData->GetScalarPointer());
+    for (vtkIdType voxelIndex=0; voxelIndex<imageData->GetNumberOfPoints(); ++voxelIndex)
+    {
+      values[voxelIndex] = (beamIndex < 0 ? 0.0f : static_cast<float>((beamIndex + 1) * (1 + (voxelIndex + beamIndex) % 7)));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Compare total dose with the weighted sum of the beam doses computed from scratch
+  bool CheckTotalDose(const char* stage, vtkImageData* totalDose, vtkImageData* beamDoses[NUMBER_OF_BEAMS], vtkMRMLRTBeamNode* beamNodes[NUMBER_OF_BEAMS])
+  {
+    if (!totalDose || totalDose->GetNumberOfPoints() != beamDoses[0]->GetNumberOfPoints())
+    {
+      std::cerr << "ERROR: " << stage << ": Invalid total dose" << std::endl;
+      return false;
+    }
+    const float* totalValues = static_cast<float*>(totalDose->GetScalarPointer());
+    for (vtkIdType voxelIndex=0; voxelIndex<totalDose->GetNumberOfPoints(); ++voxelIndex)
+    {
+      double expectedValue = 0.0;
+      for (int beamIndex=0; beamIndex<NUMBER_OF_BEAMS; ++beamIndex)
+      {
+        expectedValue += beamNodes[beamIndex]->GetBeamWeight() * static_cast<float*>(beamDoses[beamIndex]->GetScalarPointer())[voxelIndex];
+      }
+      if (fabs(totalValues[voxelIndex] - expectedValue) > 1e-5 * (1.0 + fabs(expectedValue)))
+      {
+        std::cerr << "ERROR: " << stage << ": Total dose in voxel " << voxelIndex << " is " << totalValues[voxelIndex]
+          << " (expected " << expectedValue << ")" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int qSlicerDoseEngineLogicTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkSlicerRtPerformanceMonitor* monitor = vtkSlicerRtPerformanceMonitor::GetInstance();
+  monitor->Reset();
+  monitor->EnabledOn();
+
+  // The beam parameter widgets of the engine are not available without the Beams module
+  qSlicerMockDoseEngine* engine = new qSlicerMockDoseEngine();
+  qSlicerDoseEnginePluginHandler::instance()->registerDoseEngine(engine);
+
+  vtkNew<vtkMRMLScene> mrmlScene;
+  qSlicerDoseEngineLogic doseEngineLogic;
+  doseEngineLogic.setMRMLScene(mrmlScene.GetPointer());
+
+  // Existing dose color table is used for the total dose, so that it does not need to be loaded
+  vtkNew<vtkMRMLColorTableNode> doseColorTableNode;
+  doseColorTableNode->SetName(vtkSlicerRtCommon::DEFAULT_DOSE_COLOR_TABLE_NAME);
+  doseColorTableNode->SetTypeToRainbow();
+  mrmlScene->AddNode(doseColorTableNode.GetPointer());
+
+  vtkNew<vtkImageData> referenceImageData;
+  CreateImage(referenceImageData.GetPointer(), -1);
+  vtkNew<vtkMRMLScalarVolumeNode> referenceVolumeNode;
+  referenceVolumeNode->SetAndObserveImageData(referenceImageData.GetPointer());
+  mrmlScene->AddNode(referenceVolumeNode.GetPointer());
+  vtkNew<vtkMRMLScalarVolumeNode> totalDoseVolumeNode;
+  mrmlScene->AddNode(totalDoseVolumeNode.GetPointer());
+
+  // Engine is set before adding the plan so that the engine change does not update the beam parameter widgets
+  vtkNew<vtkMRMLRTPlanNode> planNode;
+  planNode->SetDoseEngineName(engine->name().toLatin1().constData());
+  mrmlScene->AddNode(planNode.GetPointer());
+  planNode->SetAndObserveReferenceVolumeNode(referenceVolumeNode.GetPointer());
+  planNode->SetAndObserveOutputTotalDoseVolumeNode(totalDoseVolumeNode.GetPointer());
+
+  // Beams with doses on the reference geometry, as if calculated by the engine
+  vtkSmartPointer<vtkMRMLRTBeamNode> beamNodePointers[NUMBER_OF_BEAMS];
+  vtkMRMLRTBeamNode* beamNodes[NUMBER_OF_BEAMS];
+  vtkSmartPointer<vtkImageData> beamDosePointers[NUMBER_OF_BEAMS];
+  vtkImageData* beamDoses[NUMBER_OF_BEAMS];
+  for (int beamIndex=0; beamIndex<NUMBER_OF_BEAMS; ++beamIndex)
+  {
+    beamNodePointers[beamIndex] = vtkSmartPointer<vtkMRMLRTBeamNode>::New();
+    beamNodes[beamIndex] = beamNodePointers[beamIndex];
+    mrmlScene->AddNode(beamNodes[beamIndex]);
+    planNode->AddBeam(beamNodes[beamIndex]);
+
+    beamDosePointers[beamIndex] = vtkSmartPointer<vtkImageData>::New();
+    beamDoses[beamIndex] = beamDosePointers[beamIndex];
+    CreateImage(beamDoses[beamIndex], beamIndex);
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> beamDoseVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    beamDoseVolumeNode->SetAndObserveImageData(beamDoses[beamIndex]);
+    mrmlScene->AddNode(beamDoseVolumeNode);
+    engine->addResultDose(beamDoseVolumeNode, beamNodes[beamIndex]);
+  }
+
+  // Weight change before the first accumulation is only used when the total dose is created
+  beamNodes[2]->SetBeamWeight(0.5);
+  if (monitor->GetNumberOfCalls(ACCUMULATION_OPERATION_NAME) != 0)
+  {
+    std::cerr << "ERROR: Total dose was accumulated on weight change before it was created" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  QString errorMessage = doseEngineLogic.createAccumulatedDose(planNode.GetPointer());
+  if (!errorMessage.isEmpty())
+  {
+    std::cerr << "ERROR: Failed to accumulate total dose: " << errorMessage.toLatin1().constData() << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkImageData* totalDose = totalDoseVolumeNode->GetImageData();
+  if (!CheckTotalDose("Initial accumulation", totalDose, beamDoses, beamNodes))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Changing the weight of one beam updates the total dose in place
+  vtkMTimeType totalDoseScalarsMTime = totalDose->GetPointData()->GetScalars()->GetMTime();
+  beamNodes[1]->SetBeamWeight(2.5);
+  if (monitor->GetNumberOfCalls(ACCUMULATION_OPERATION_NAME) != 2)
+  {
+    std::cerr << "ERROR: Total dose was not updated on beam weight change (number of accumulations: "
+      << monitor->GetNumberOfCalls(ACCUMULATION_OPERATION_NAME) << ", expected 2)" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (totalDoseVolumeNode->GetImageData() != totalDose)
+  {
+    std::cerr << "ERROR: Total dose image was replaced instead of updated in place" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (totalDose->GetPointData()->GetScalars()->GetMTime() <= totalDoseScalarsMTime)
+  {
+    std::cerr << "ERROR: Total dose scalars were not marked as modified" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CheckTotalDose("Beam weight change", totalDose, beamDoses, beamNodes))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Setting the same weight does not update the total dose
+  beamNodes[1]->SetBeamWeight(2.5);
+  if (monitor->GetNumberOfCalls(ACCUMULATION_OPERATION_NAME) != 2)
+  {
+    std::cerr << "ERROR: Total dose was updated without beam weight change" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Accumulation requested again without changes gives the same result as the full recompute
+  errorMessage = doseEngineLogic.createAccumulatedDose(planNode.GetPointer());
+  if (!errorMessage.isEmpty() || !CheckTotalDose("Repeated accumulation", totalDose, beamDoses, beamNodes))
+  {
+    std::cerr << "ERROR: Repeated accumulation failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  doseEngineLogic.setMRMLScene(NULL);
+  qSlicerDoseEnginePluginHandler::setInstance(NULL);
+  monitor->Reset();
+  monitor->EnabledOff();
+
+  std::cout << "Dose engine logic test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
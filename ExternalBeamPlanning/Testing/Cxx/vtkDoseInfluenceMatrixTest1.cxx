@@ -0,0 +1,216 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// ExternalBeamPlanning includes
+#include "vtkDoseInfluenceMatrix.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkNew.h>
+
+// STD includes
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  // Dose grid of 3x2x1 voxels. All voxels but the one with index 4 are rows of the matrix
+  const int NUMBER_OF_GRID_VOXELS = 6;
+  const int EXCLUDED_GRID_VOXEL = 4;
+  const int NUMBER_OF_ROWS = 5;
+  const int NUMBER_OF_COLUMNS = 3;
+  // Hand-built matrix with an empty row, and with different numbers of entries in the rows and columns.
+  // Columns 0 and 1 are the beamlets of beam A, column 2 of beam B
+  const double MATRIX[NUMBER_OF_ROWS][NUMBER_OF_COLUMNS] = {
+    { 1.0, 0.0, 2.0 },
+    { 0.0, 3.0, 0.0 },
+    { 4.0, 0.0, 0.0 },
+    { 0.0, 0.0, 0.0 },
+    { 0.5, 6.0, 7.0 } };
+  const double FLUENCE[NUMBER_OF_COLUMNS] = { 1.0, 2.0, 3.0 };
+  const double VOXEL_VALUES[NUMBER_OF_ROWS] = { 1.0, -1.0, 2.0, 5.0, 0.5 };
+  // Products computed by hand
+  const double EXPECTED_DOSE[NUMBER_OF_ROWS] = { 7.0, 6.0, 4.0, 0.0, 33.5 };
+  const double EXPECTED_TRANSPOSED_PRODUCT[NUMBER_OF_COLUMNS] = { 9.25, 0.0, 5.5 };
+
+  //----------------------------------------------------------------------------
+  bool CheckValues(const char* name, const std::vector<double>& values, const double* expectedValues)
+  {
+    for (size_t index=0; index<values.size(); ++index)
+    {
+      if (fabs(values[index] - expectedValues[index]) > 1e-9)
+      {
+        std::cerr << "ERROR: " << name << " mismatch at index " << index << ": " << values[index]
+          << " (expected " << expectedValues[index] << ")" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkDoseInfluenceMatrixTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkOrientedImageData> doseGrid;
+  doseGrid->SetExtent(0, 2, 0, 1, 0, 0);
+  doseGrid->SetSpacing(2.0, 2.0, 2.0);
+  doseGrid->SetOrigin(-10.0, 5.0, 0.0);
+
+  vtkNew<vtkOrientedImageData> mask;
+  mask->ShallowCopy(doseGrid.GetPointer());
+  mask->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  unsigned char* maskScalars = static_cast<unsigned char*>(mask->GetScalarPointer());
+  memset(maskScalars, 1, NUMBER_OF_GRID_VOXELS);
+  maskScalars[EXCLUDED_GRID_VOXEL] = 0;
+
+  vtkNew<vtkDoseInfluenceMatrix> matrix;
+  matrix->SetDoseGrid(doseGrid.GetPointer());
+  if (!matrix->AddVoxelsInMask(mask.GetPointer()) || matrix->GetNumberOfVoxels() != NUMBER_OF_ROWS
+    || matrix->GetVoxelIndex(3) != 3 || matrix->GetVoxelIndex(4) != 5)
+  {
+    std::cerr << "ERROR: Invalid rows of the influence matrix: " << matrix->GetNumberOfVoxels() << " (expected " << NUMBER_OF_ROWS << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+  double position[3] = { 0.0, 0.0, 0.0 };
+  matrix->GetVoxelPosition(4, position);
+  if (fabs(position[0] - (-6.0)) > 1e-9 || fabs(position[1] - 7.0) > 1e-9 || fabs(position[2]) > 1e-9)
+  {
+    std::cerr << "ERROR: Invalid position of row 4: " << position[0] << ", " << position[1] << ", " << position[2] << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (matrix->AddBeamlets("A", 2) != 0 || matrix->AddBeamlets("B", 1) != 2 || matrix->GetNumberOfBeamlets() != NUMBER_OF_COLUMNS
+    || strcmp(matrix->GetBeamletBeamID(1), "A") != 0 || strcmp(matrix->GetBeamletBeamID(2), "B") != 0)
+  {
+    std::cerr << "ERROR: Invalid beamlets of the influence matrix" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Columns with rows out of range or not in ascending order are rejected
+  std::vector<int> invalidRows(1, NUMBER_OF_ROWS);
+  std::vector<float> invalidValues(1, 1.0f);
+  vtkObject::GlobalWarningDisplayOff();
+  bool outOfRangeRowAccepted = matrix->SetColumn(0, invalidRows, invalidValues);
+  invalidRows[0] = -1;
+  bool negativeRowAccepted = matrix->SetColumn(0, invalidRows, invalidValues);
+  invalidRows[0] = 2;
+  invalidRows.push_back(1);
+  invalidValues.push_back(1.0f);
+  bool descendingRowsAccepted = matrix->SetColumn(0, invalidRows, invalidValues);
+  vtkObject::GlobalWarningDisplayOn();
+  if (outOfRangeRowAccepted || negativeRowAccepted || descendingRowsAccepted)
+  {
+    std::cerr << "ERROR: Column with invalid rows was accepted" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Set the columns in reverse order, as they may be set in any order by the dose engines
+  int numberOfNonZeros = 0;
+  for (int column=NUMBER_OF_COLUMNS-1; column>=0; --column)
+  {
+    std::vector<int> rows;
+    std::vector<float> values;
+    for (int row=0; row<NUMBER_OF_ROWS; ++row)
+    {
+      if (MATRIX[row][column] != 0.0)
+      {
+        rows.push_back(row);
+        values.push_back(static_cast<float>(MATRIX[row][column]));
+        ++numberOfNonZeros;
+      }
+    }
+    if (!matrix->SetColumn(column, rows, values))
+    {
+      std::cerr << "ERROR: Failed to set column " << column << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  matrix->Finalize();
+  if (!matrix->GetFinalized() || matrix->GetNumberOfNonZeros() != numberOfNonZeros)
+  {
+    std::cerr << "ERROR: Invalid number of nonzeros after finalization: " << matrix->GetNumberOfNonZeros()
+      << " (expected " << numberOfNonZeros << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Dose product uses the row-major layout, compare it with the product computed from the compressed columns
+  std::vector<double> dose(NUMBER_OF_ROWS, -1.0);
+  matrix->MultiplyFluence(FLUENCE, &dose[0]);
+  std::vector<double> columnLayoutDose(NUMBER_OF_ROWS, 0.0);
+  const vtkIdType* columnPointers = matrix->GetColumnPointers();
+  const int* rowIndices = matrix->GetRowIndices();
+  const float* values = matrix->GetValues();
+  for (int column=0; column<NUMBER_OF_COLUMNS; ++column)
+  {
+    for (vtkIdType entry=columnPointers[column]; entry<columnPointers[column+1]; ++entry)
+    {
+      columnLayoutDose[rowIndices[entry]] += values[entry] * FLUENCE[column];
+    }
+  }
+  if ( !CheckValues("Dose (row layout)", dose, EXPECTED_DOSE)
+    || !CheckValues("Dose (column layout)", columnLayoutDose, EXPECTED_DOSE) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Transposed product uses the column layout
+  std::vector<double> transposedProduct(NUMBER_OF_COLUMNS, -1.0);
+  matrix->MultiplyTransposed(VOXEL_VALUES, &transposedProduct[0]);
+  if (!CheckValues("Transposed product", transposedProduct, EXPECTED_TRANSPOSED_PRODUCT))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // The two layouts represent the same matrix: g.(A x) = (A^T g).x
+  double voxelValuesDotDose = 0.0;
+  for (int row=0; row<NUMBER_OF_ROWS; ++row)
+  {
+    voxelValuesDotDose += VOXEL_VALUES[row] * dose[row];
+  }
+  double transposedProductDotFluence = 0.0;
+  for (int column=0; column<NUMBER_OF_COLUMNS; ++column)
+  {
+    transposedProductDotFluence += transposedProduct[column] * FLUENCE[column];
+  }
+  if (fabs(voxelValuesDotDose - transposedProductDotFluence) > 1e-9)
+  {
+    std::cerr << "ERROR: Row and column layouts differ: g.(A x) = " << voxelValuesDotDose
+      << ", (A^T g).x = " << transposedProductDotFluence << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Dose scattered to the grid is zero outside the rows
+  vtkNew<vtkOrientedImageData> doseImage;
+  matrix->ScatterToImage(&dose[0], doseImage.GetPointer());
+  const float* doseScalars = static_cast<float*>(doseImage->GetScalarPointer());
+  if (doseImage->GetNumberOfPoints() != NUMBER_OF_GRID_VOXELS || doseScalars[EXCLUDED_GRID_VOXEL] != 0.0f
+    || fabs(doseScalars[5] - EXPECTED_DOSE[4]) > 1e-6 || fabs(doseScalars[0] - EXPECTED_DOSE[0]) > 1e-6)
+  {
+    std::cerr << "ERROR: Invalid dose image scattered from the rows" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Dose influence matrix test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// ExternalBeamPlanning includes
+#include "vtkDoseInfluenceMatrix.h"
+#include "vtkFluenceMapOptimizer.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkNew.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Create mask on a dose grid of two voxels with 1 mm spacing
+  void CreateMask(vtkOrientedImageData* mask, bool voxel0Inside, bool voxel1Inside)
+  {
+    mask->SetExtent(0, 1, 0, 0, 0, 0);
+    mask->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    unsigned char* scalars = static_cast<unsigned char*>(mask->GetScalarPointer());
+    scalars[0] = (voxel0Inside ? 1 : 0);
+    scalars[1] = (voxel1Inside ? 1 : 0);
+  }
+
+  //----------------------------------------------------------------------------
+  /// Build influence matrix of the two voxels from dense columns
+  void CreateMatrix(vtkDoseInfluenceMatrix* matrix, int numberOfBeamlets, const double columns[][2])
+  {
+    vtkNew<vtkOrientedImageData> allVoxelsMask;
+    CreateMask(allVoxelsMask.GetPointer(), true, true);
+    matrix->SetDoseGrid(allVoxelsMask.GetPointer());
+    matrix->AddVoxelsInMask(allVoxelsMask.GetPointer());
+    matrix->AddBeamlets("Beam", numberOfBeamlets);
+    for (int column=0; column<numberOfBeamlets; ++column)
+    {
+      std::vector<int> rows;
+      std::vector<float> values;
+      for (int row=0; row<2; ++row)
+      {
+        if (columns[column][row] != 0.0)
+        {
+          rows.push_back(row);
+          values.push_back(static_cast<float>(columns[column][row]));
+        }
+      }
+      matrix->SetColumn(column, rows, values);
+    }
+    matrix->Finalize();
+  }
+
+  //----------------------------------------------------------------------------
+  bool CheckOptimum(const char* name, vtkFluenceMapOptimizer* optimizer, const double* expectedFluence, double expectedObjectiveValue)
+  {
+    if (!optimizer->Optimize())
+    {
+      std::cerr << "ERROR: " << name << ": Optimization failed" << std::endl;
+      return false;
+    }
+    vtkDoubleArray* fluence = optimizer->GetFluence();
+    std::cout << name << ": " << optimizer->GetLastNumberOfIterations() << " iterations, objective " << optimizer->GetLastObjectiveValue() << std::endl;
+    for (vtkIdType beamlet=0; beamlet<fluence->GetNumberOfTuples(); ++beamlet)
+    {
+      if (fabs(fluence->GetValue(beamlet) - expectedFluence[beamlet]) > 1e-3)
+      {
+        std::cerr << "ERROR: " << name << ": Fluence of beamlet " << beamlet << " is " << fluence->GetValue(beamlet)
+          << " (expected " << expectedFluence[beamlet] << ")" << std::endl;
+        return false;
+      }
+    }
+    double objectiveValue = optimizer->EvaluateObjective(fluence->GetPointer(0));
+    if ( fabs(optimizer->GetLastObjectiveValue() - expectedObjectiveValue) > 1e-5 * (1.0 + expectedObjectiveValue)
+      || fabs(objectiveValue - optimizer->GetLastObjectiveValue()) > 1e-9 * (1.0 + expectedObjectiveValue) )
+    {
+      std::cerr << "ERROR: " << name << ": Objective value is " << optimizer->GetLastObjectiveValue() << " (evaluated "
+        << objectiveValue << ", expected " << expectedObjectiveValue << ")" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkFluenceMapOptimizerTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkOrientedImageData> voxel0Mask;
+  CreateMask(voxel0Mask.GetPointer(), true, false);
+  vtkNew<vtkOrientedImageData> voxel1Mask;
+  CreateMask(voxel1Mask.GetPointer(), false, true);
+  vtkNew<vtkOrientedImageData> allVoxelsMask;
+  CreateMask(allVoxelsMask.GetPointer(), true, true);
+
+  // Least squares with one beamlet giving 1 and 3 Gy per unit fluence to the two voxels, 6 Gy prescribed to both:
+  //   f(x) = ((x-6)^2 + (3x-6)^2) / 2, minimum at x = 6*(1+3)/(1+9) = 2.4 with f = (12.96 + 1.44) / 2 = 7.2
+  const double singleBeamletColumns[1][2] = { { 1.0, 3.0 } };
+  vtkNew<vtkDoseInfluenceMatrix> singleBeamletMatrix;
+  CreateMatrix(singleBeamletMatrix.GetPointer(), 1, singleBeamletColumns);
+  vtkNew<vtkFluenceMapOptimizer> optimizer;
+  optimizer->SetInfluenceMatrix(singleBeamletMatrix.GetPointer());
+  optimizer->SetMaximumNumberOfIterations(1000);
+  optimizer->SetRelativeTolerance(1e-12);
+  if (optimizer->AddObjective(allVoxelsMask.GetPointer(), vtkFluenceMapOptimizer::UniformDose, 6.0, 1.0) != 0)
+  {
+    std::cerr << "ERROR: Failed to add objective" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const double expectedSingleBeamletFluence[1] = { 2.4 };
+  if (!CheckOptimum("Single beamlet", optimizer.GetPointer(), expectedSingleBeamletFluence, 7.2))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Two beamlets where the unconstrained optimum has negative fluence. Beamlet 0 gives 1 Gy to both voxels,
+  // beamlet 1 only to voxel 1. Prescribing 4 Gy to voxel 0 and 2 Gy to voxel 1 would need fluence (4,-2),
+  // so the non-negativity constraint is active: x1 = 0 and x0 minimizes (x0-4)^2 + (x0-2)^2, so x0 = 3 and f = 2
+  const double twoBeamletColumns[2][2] = { { 1.0, 1.0 }, { 0.0, 1.0 } };
+  vtkNew<vtkDoseInfluenceMatrix> twoBeamletMatrix;
+  CreateMatrix(twoBeamletMatrix.GetPointer(), 2, twoBeamletColumns);
+  optimizer->SetInfluenceMatrix(twoBeamletMatrix.GetPointer());
+  optimizer->RemoveAllObjectives();
+  optimizer->AddObjective(voxel0Mask.GetPointer(), vtkFluenceMapOptimizer::UniformDose, 4.0, 1.0);
+  optimizer->AddObjective(voxel1Mask.GetPointer(), vtkFluenceMapOptimizer::UniformDose, 2.0, 1.0);
+  const double expectedTwoBeamletFluence[2] = { 3.0, 0.0 };
+  if (!CheckOptimum("Non-negative fluence", optimizer.GetPointer(), expectedTwoBeamletFluence, 2.0))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Maximum dose objective is only violated by overdose: with a 5 Gy limit on voxel 1 instead of the
+  // uniform 2 Gy, beamlet 0 reaches 4 Gy in voxel 0 without penalty
+  optimizer->RemoveAllObjectives();
+  optimizer->AddObjective(voxel0Mask.GetPointer(), vtkFluenceMapOptimizer::UniformDose, 4.0, 1.0);
+  optimizer->AddObjective(voxel1Mask.GetPointer(), vtkFluenceMapOptimizer::MaximumDose, 5.0, 1.0);
+  vtkNew<vtkOrientedImageData> doseImage;
+  if (!optimizer->Optimize())
+  {
+    std::cerr << "ERROR: Optimization with maximum dose objective failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  optimizer->GetDose(doseImage.GetPointer());
+  const float* dose = static_cast<float*>(doseImage->GetScalarPointer());
+  if (optimizer->GetLastObjectiveValue() > 1e-6 || fabs(dose[0] - 4.0) > 1e-3 || dose[1] > 5.0 + 1e-3)
+  {
+    std::cerr << "ERROR: Invalid optimum with maximum dose objective: objective " << optimizer->GetLastObjectiveValue()
+      << ", dose " << dose[0] << ", " << dose[1] << " (expected 0, 4 and at most 5)" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Fluence map optimizer test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
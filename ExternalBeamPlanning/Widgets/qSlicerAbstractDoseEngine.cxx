@@ -26,9 +26,20 @@ Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
 #include "vtkMRMLRTPlanNode.h"
 #include "qMRMLBeamParametersTabWidget.h"
 
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkSlicerSegmentationsModuleLogic.h"
+#include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+
+// ExternalBeamPlanning includes
+#include "vtkDoseInfluenceMatrix.h"
+
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
 #include "vtkSlicerIsodoseModuleLogic.h"
+#include "vtkSlicerRtPerformanceMonitor.h"
 
 // MRML includes
 #include <vtkMRMLScene.h>
@@ -37,8 +48,10 @@ Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
 #include <vtkMRMLSubjectHierarchyNode.h>
 #include <vtkMRMLSubjectHierarchyConstants.h>
 #include <vtkMRMLColorTableNode.h>
+#include <vtkMRMLTransformNode.h>
 
 // VTK includes
+#include <vtkImageData.h>
 #include <vtkSmartPointer.h>
 
 // SlicerQt includes
@@ -55,6 +68,8 @@ Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
 #include <QSlider>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QSharedPointer>
+#include <QStringList>
 
 //----------------------------------------------------------------------------
 double qSlicerAbstractDoseEngine::DEFAULT_DOSE_VOLUME_WINDOW_LEVEL_MAXIMUM = 16.0;
@@ -62,6 +77,7 @@ double qSlicerAbstractDoseEngine::DEFAULT_DOSE_VOLUME_WINDOW_LEVEL_MAXIMUM = 16.
 //----------------------------------------------------------------------------
 static const char* INTERMEDIATE_RESULT_REFERENCE_ROLE = "IntermediateResultRef";
 static const char* RESULT_DOSE_REFERENCE_ROLE = "ResultDoseRef";
+static const char* PLAN_INPUT_CACHE_OPERATION_NAME = "ExternalBeamPlanning.PlanInputCache";
 
 //-----------------------------------------------------------------------------
 /// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
@@ -72,10 +88,43 @@ protected:
   qSlicerAbstractDoseEngine* const q_ptr;
 public:
   qSlicerAbstractDoseEnginePrivate(qSlicerAbstractDoseEngine& object);
+public:
+  /// Inputs of a plan shared by all its beams
+  struct PlanInputCache
+  {
+    /// Modification time signature of the plan inputs at the time the cached inputs were computed
+    QString InputSignature;
+    /// Target segment labelmap
+    vtkSmartPointer<vtkOrientedImageData> TargetLabelmap;
+    /// Segment labelmaps. Key is the segment ID
+    QMap<QString, vtkSmartPointer<vtkOrientedImageData> > SegmentLabelmaps;
+    /// Engine-specific inputs. Key is the name given by the engine
+    QMap<QString, vtkSmartPointer<vtkObject> > Inputs;
+    /// Engine-specific inputs that are not VTK objects. Key is the name given by the engine
+    QMap<QString, QSharedPointer<qSlicerAbstractDoseEngine::PlanInputCacheEntry> > Entries;
+  };
+
+  /// Get input cache of a plan. The cache is emptied if the plan inputs changed since it was filled
+  /// \return NULL if the plan is invalid
+  PlanInputCache* validPlanInputCache(vtkMRMLRTPlanNode* planNode);
+
+  /// Get modification time signature of the inputs of a plan (reference volume and segmentation)
+  static QString planInputSignature(vtkMRMLRTPlanNode* planNode);
+
+  /// Update the signature of a valid cache after a labelmap representation was created in the segmentation of the plan.
+  /// Creating a representation modifies the segmentation, but it does not invalidate the cached inputs
+  static void updatePlanInputSignature(PlanInputCache* cache, vtkMRMLRTPlanNode* planNode);
+
+  /// Count cache lookup in the performance monitor (counters of the ExternalBeamPlanning.PlanInputCache operation)
+  static void countPlanInputCacheLookup(bool hit);
+
 public:
   /// Engine-specific parameters defined in \sa defineBeamParameters.
   /// Key is the parameter name (without engine name prefix), value is the default
   QMap<QString,QVariant> BeamParameters;
+
+  /// Input caches of the plans. Key is the plan node ID
+  QMap<QString, PlanInputCache> PlanInputCaches;
 };
 
 //-----------------------------------------------------------------------------
@@ -87,6 +136,91 @@ qSlicerAbstractDoseEnginePrivate::qSlicerAbstractDoseEnginePrivate(qSlicerAbstra
 {
 }
 
+//-----------------------------------------------------------------------------
+qSlicerAbstractDoseEnginePrivate::PlanInputCache* qSlicerAbstractDoseEnginePrivate::validPlanInputCache(vtkMRMLRTPlanNode* planNode)
+{
+  if (!planNode || !planNode->GetID())
+  {
+    qCritical() << Q_FUNC_INFO << ": Invalid plan node";
+    return NULL;
+  }
+
+  QString signature = qSlicerAbstractDoseEnginePrivate::planInputSignature(planNode);
+  PlanInputCache& cache = this->PlanInputCaches[QString(planNode->GetID())];
+  if (cache.InputSignature != signature)
+  {
+    if (!cache.InputSignature.isEmpty())
+    {
+      vtkSlicerRtPerformanceMonitor::AddToCounter(PLAN_INPUT_CACHE_OPERATION_NAME, "Invalidations", 1);
+    }
+    cache = PlanInputCache();
+    cache.InputSignature = signature;
+  }
+  return &cache;
+}
+
+//-----------------------------------------------------------------------------
+QString qSlicerAbstractDoseEnginePrivate::planInputSignature(vtkMRMLRTPlanNode* planNode)
+{
+  QStringList signature;
+
+  vtkMRMLScalarVolumeNode* referenceVolumeNode = planNode->GetReferenceVolumeNode();
+  if (referenceVolumeNode)
+  {
+    signature << referenceVolumeNode->GetID() << QString::number(referenceVolumeNode->GetMTime());
+    if (referenceVolumeNode->GetImageData())
+    {
+      signature << QString::number(referenceVolumeNode->GetImageData()->GetMTime());
+    }
+    if (referenceVolumeNode->GetParentTransformNode())
+    {
+      signature << QString::number(referenceVolumeNode->GetParentTransformNode()->GetTransformToWorldMTime());
+    }
+  }
+
+  vtkMRMLSegmentationNode* segmentationNode = planNode->GetSegmentationNode();
+  if (segmentationNode && segmentationNode->GetSegmentation())
+  {
+    vtkSegmentation* segmentation = segmentationNode->GetSegmentation();
+    signature << segmentationNode->GetID() << QString::number(segmentationNode->GetMTime())
+      << QString::number(segmentation->GetMTime());
+    if (segmentationNode->GetParentTransformNode())
+    {
+      signature << QString::number(segmentationNode->GetParentTransformNode()->GetTransformToWorldMTime());
+    }
+
+    // Representations of the segments can be modified without modifying the segmentation
+    std::vector<std::string> segmentIDs;
+    segmentation->GetSegmentIDs(segmentIDs);
+    for (std::vector<std::string>::iterator segmentIdIt=segmentIDs.begin(); segmentIdIt!=segmentIDs.end(); ++segmentIdIt)
+    {
+      vtkSegment* segment = segmentation->GetSegment(*segmentIdIt);
+      std::vector<std::string> representationNames;
+      segment->GetContainedRepresentationNames(representationNames);
+      for (std::vector<std::string>::iterator reprIt=representationNames.begin(); reprIt!=representationNames.end(); ++reprIt)
+      {
+        vtkDataObject* representation = segment->GetRepresentation(*reprIt);
+        signature << QString::number(representation ? representation->GetMTime() : 0);
+      }
+    }
+  }
+
+  signature << (planNode->GetTargetSegmentID() ? planNode->GetTargetSegmentID() : "");
+  return signature.join(";");
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAbstractDoseEnginePrivate::updatePlanInputSignature(PlanInputCache* cache, vtkMRMLRTPlanNode* planNode)
+{
+  cache->InputSignature = qSlicerAbstractDoseEnginePrivate::planInputSignature(planNode);
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerAbstractDoseEnginePrivate::countPlanInputCacheLookup(bool hit)
+{
+  vtkSlicerRtPerformanceMonitor::AddToCounter(PLAN_INPUT_CACHE_OPERATION_NAME, (hit ? "Hits" : "Misses"), 1);
+}
+
 
 //-----------------------------------------------------------------------------
 // qSlicerAbstractDoseEngine methods
@@ -192,6 +326,40 @@ QString qSlicerAbstractDoseEngine::calculateDose(vtkMRMLRTBeamNode* beamNode)
   return errorMessage;
 }
 
+//---------------------------------------------------------------------------
+QString qSlicerAbstractDoseEngine::calculateDoseInfluenceMatrix(vtkMRMLRTBeamNode* beamNode, vtkDoseInfluenceMatrix* matrix)
+{
+  if (!beamNode || !beamNode->GetParentPlanNode())
+  {
+    QString errorMessage("Invalid beam node or parent plan");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  if (!matrix || matrix->GetFinalized())
+  {
+    QString errorMessage("Invalid or already finalized influence matrix");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
+  vtkSlicerRtScopedTimer timer("ExternalBeamPlanning.CalculateBeamInfluenceMatrix");
+  int numberOfBeamletsBefore = matrix->GetNumberOfBeamlets();
+  QString errorMessage = this->calculateDoseInfluenceMatrixUsingEngine(beamNode, matrix);
+  vtkSlicerRtPerformanceMonitor::AddToCounter("ExternalBeamPlanning.CalculateBeamInfluenceMatrix", "Beamlets",
+    matrix->GetNumberOfBeamlets() - numberOfBeamletsBefore);
+  return errorMessage;
+}
+
+//---------------------------------------------------------------------------
+QString qSlicerAbstractDoseEngine::calculateDoseInfluenceMatrixUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkDoseInfluenceMatrix* matrix)
+{
+  Q_UNUSED(beamNode);
+  Q_UNUSED(matrix);
+  QString errorMessage = QString("Dose engine %1 does not support dose influence matrix calculation").arg(this->m_Name);
+  qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+  return errorMessage;
+}
+
 //---------------------------------------------------------------------------
 void qSlicerAbstractDoseEngine::addIntermediateResult(vtkMRMLNode* result, vtkMRMLRTBeamNode* beamNode)
 {
@@ -361,6 +529,139 @@ void qSlicerAbstractDoseEngine::removeIntermediateResults(vtkMRMLRTBeamNode* bea
   }
 }
 
+//---------------------------------------------------------------------------
+vtkOrientedImageData* qSlicerAbstractDoseEngine::planTargetLabelmap(vtkMRMLRTPlanNode* planNode)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+
+  qSlicerAbstractDoseEnginePrivate::PlanInputCache* cache = d->validPlanInputCache(planNode);
+  if (!cache)
+  {
+    return NULL;
+  }
+  qSlicerAbstractDoseEnginePrivate::countPlanInputCacheLookup(cache->TargetLabelmap.GetPointer() != NULL);
+  if (!cache->TargetLabelmap.GetPointer())
+  {
+    cache->TargetLabelmap = planNode->GetTargetOrientedImageData();
+    // The signature is taken again after the labelmap representation may have been created
+    qSlicerAbstractDoseEnginePrivate::updatePlanInputSignature(cache, planNode);
+  }
+  return cache->TargetLabelmap.GetPointer();
+}
+
+//---------------------------------------------------------------------------
+vtkOrientedImageData* qSlicerAbstractDoseEngine::planSegmentLabelmap(vtkMRMLRTPlanNode* planNode, QString segmentID)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+
+  qSlicerAbstractDoseEnginePrivate::PlanInputCache* cache = d->validPlanInputCache(planNode);
+  if (!cache)
+  {
+    return NULL;
+  }
+  qSlicerAbstractDoseEnginePrivate::countPlanInputCacheLookup(cache->SegmentLabelmaps.contains(segmentID));
+  if (cache->SegmentLabelmaps.contains(segmentID))
+  {
+    return cache->SegmentLabelmaps[segmentID].GetPointer();
+  }
+
+  vtkMRMLSegmentationNode* segmentationNode = planNode->GetSegmentationNode();
+  if (!segmentationNode)
+  {
+    qCritical() << Q_FUNC_INFO << ": Failed to access segmentation node of plan " << planNode->GetName();
+    return NULL;
+  }
+  vtkSmartPointer<vtkOrientedImageData> segmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(
+    segmentationNode, segmentID.toLatin1().constData(), segmentLabelmap) )
+  {
+    qCritical() << Q_FUNC_INFO << ": Failed to get binary labelmap for segment " << segmentID;
+    return NULL;
+  }
+
+  cache->SegmentLabelmaps[segmentID] = segmentLabelmap;
+  // The signature is taken again after the labelmap representation may have been created
+  qSlicerAbstractDoseEnginePrivate::updatePlanInputSignature(cache, planNode);
+  return segmentLabelmap.GetPointer();
+}
+
+//---------------------------------------------------------------------------
+vtkObject* qSlicerAbstractDoseEngine::planInput(vtkMRMLRTPlanNode* planNode, QString name)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+
+  qSlicerAbstractDoseEnginePrivate::PlanInputCache* cache = d->validPlanInputCache(planNode);
+  if (!cache)
+  {
+    return NULL;
+  }
+  qSlicerAbstractDoseEnginePrivate::countPlanInputCacheLookup(cache->Inputs.contains(name));
+  if (!cache->Inputs.contains(name))
+  {
+    return NULL;
+  }
+  return cache->Inputs[name].GetPointer();
+}
+
+//---------------------------------------------------------------------------
+void qSlicerAbstractDoseEngine::setPlanInput(vtkMRMLRTPlanNode* planNode, QString name, vtkObject* input)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+
+  qSlicerAbstractDoseEnginePrivate::PlanInputCache* cache = d->validPlanInputCache(planNode);
+  if (cache)
+  {
+    cache->Inputs[name] = input;
+  }
+}
+
+//---------------------------------------------------------------------------
+qSlicerAbstractDoseEngine::PlanInputCacheEntry* qSlicerAbstractDoseEngine::planInputCacheEntry(vtkMRMLRTPlanNode* planNode, QString name)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+
+  qSlicerAbstractDoseEnginePrivate::PlanInputCache* cache = d->validPlanInputCache(planNode);
+  if (!cache)
+  {
+    return NULL;
+  }
+  qSlicerAbstractDoseEnginePrivate::countPlanInputCacheLookup(cache->Entries.contains(name));
+  if (!cache->Entries.contains(name))
+  {
+    return NULL;
+  }
+  return cache->Entries[name].data();
+}
+
+//---------------------------------------------------------------------------
+void qSlicerAbstractDoseEngine::setPlanInputCacheEntry(vtkMRMLRTPlanNode* planNode, QString name, PlanInputCacheEntry* entry)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+
+  qSlicerAbstractDoseEnginePrivate::PlanInputCache* cache = d->validPlanInputCache(planNode);
+  if (!cache)
+  {
+    delete entry;
+    return;
+  }
+  cache->Entries[name] = QSharedPointer<PlanInputCacheEntry>(entry);
+}
+
+//---------------------------------------------------------------------------
+void qSlicerAbstractDoseEngine::clearPlanInputCache(vtkMRMLRTPlanNode* planNode/*=NULL*/)
+{
+  Q_D(qSlicerAbstractDoseEngine);
+
+  if (!planNode)
+  {
+    d->PlanInputCaches.clear();
+  }
+  else if (planNode->GetID())
+  {
+    d->PlanInputCaches.remove(QString(planNode->GetID()));
+  }
+}
+
 //---------------------------------------------------------------------------
 // Beam parameter definition functions.
 // Need to be called from the implemented \sa defineBeamParameters method.
@@ -703,6 +1004,10 @@ qMRMLBeamParametersTabWidget* qSlicerAbstractDoseEngine::beamParametersTabWidget
 {
   // Get tab widget from beams module widget
   //TODO: Kind of a hack, a direct way of accessing it would be nicer, for example through a MRML node
+  if (!qSlicerApplication::application() || !qSlicerApplication::application()->moduleManager())
+  {
+    return NULL;
+  }
   qSlicerAbstractCoreModule* module = qSlicerApplication::application()->moduleManager()->module("Beams");
   if (!module)
   {
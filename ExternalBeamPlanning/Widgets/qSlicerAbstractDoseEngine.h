@@ -28,9 +28,13 @@
 #include <QStringList>
 
 class qSlicerAbstractDoseEnginePrivate;
+class vtkDoseInfluenceMatrix;
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLRTBeamNode;
+class vtkMRMLRTPlanNode;
 class vtkMRMLNode;
+class vtkObject;
+class vtkOrientedImageData;
 class qMRMLBeamParametersTabWidget;
 
 /// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
@@ -49,6 +53,15 @@ public:
   /// Maximum Gray value for visualization window/level of the newly created per-beam dose volumes
   static double DEFAULT_DOSE_VOLUME_WINDOW_LEVEL_MAXIMUM;
 
+  /// Base class for engine-specific plan inputs that are not VTK objects (e.g. images converted
+  /// to the format of an external library), so that they can be stored in the plan input cache.
+  /// \sa planInputCacheEntry
+  class PlanInputCacheEntry
+  {
+  public:
+    virtual ~PlanInputCacheEntry() { };
+  };
+
 public:
   typedef QObject Superclass;
   /// Constructor
@@ -75,6 +88,15 @@ public:
   /// Remove intermediate nodes created by the dose engine for a certain beam
   Q_INVOKABLE void removeIntermediateResults(vtkMRMLRTBeamNode* beamNode);
 
+  /// Calculate the dose influence matrix columns of the beamlets of a beam, for inverse planning
+  /// \param matrix Influence matrix with the dose grid and the voxels of interest already set
+  ///   (see \sa qSlicerDoseEngineLogic::calculateDoseInfluenceMatrix). Beamlets of the beam are added to it
+  /// \return Error message. Empty string on success
+  QString calculateDoseInfluenceMatrix(vtkMRMLRTBeamNode* beamNode, vtkDoseInfluenceMatrix* matrix);
+
+  /// Get whether the engine implements \sa calculateDoseInfluenceMatrixUsingEngine
+  virtual bool isDoseInfluenceMatrixSupported() { return false; };
+
 // API functions to implement in the subclass
 protected:
   /// Calculate dose for a single beam. Called by \sa CalculateDose that performs actions generic
@@ -88,6 +110,15 @@ protected:
     vtkMRMLRTBeamNode* beamNode,
     vtkMRMLScalarVolumeNode* resultDoseVolumeNode ) = 0;
 
+  /// Calculate the dose influence matrix columns (dose per unit fluence in the voxels of the matrix)
+  /// of the beamlets of a beam. Called by \sa calculateDoseInfluenceMatrix.
+  /// Optional, engines that support inverse planning implement it and \sa isDoseInfluenceMatrixSupported.
+  /// The beamlets are added with \sa vtkDoseInfluenceMatrix::AddBeamlets, and the columns can be set in parallel.
+  /// The default implementation returns an error.
+  virtual QString calculateDoseInfluenceMatrixUsingEngine(
+    vtkMRMLRTBeamNode* beamNode,
+    vtkDoseInfluenceMatrix* matrix );
+
   /// Define engine-specific beam parameters.
   /// This is the method that needs to be implemented in each engine.
   virtual void defineBeamParameters() = 0;
@@ -106,6 +137,37 @@ public:
   /// \param replace Remove referenced dose volume if already exists. True by default
   Q_INVOKABLE void addResultDose(vtkMRMLScalarVolumeNode* resultDose, vtkMRMLRTBeamNode* beamNode, bool replace=true);
 
+// Plan input cache functions (functions to call from the subclass).
+// Inputs are computed once per plan and shared by all its beams. The cache of a plan is
+// invalidated when the reference volume or the segmentation of the plan is modified.
+// Cached inputs are shared, so they must not be modified by the engine.
+// Lookups are counted as Hits and Misses, and discarded caches as Invalidations of the
+// ExternalBeamPlanning.PlanInputCache operation in \sa vtkSlicerRtPerformanceMonitor.
+public:
+  /// Get binary labelmap of the target segment of the plan (see \sa vtkMRMLRTPlanNode::GetTargetOrientedImageData)
+  /// \return Cached labelmap, NULL on failure
+  vtkOrientedImageData* planTargetLabelmap(vtkMRMLRTPlanNode* planNode);
+
+  /// Get binary labelmap of a segment (e.g. organ at risk) in the segmentation of the plan
+  /// \return Cached labelmap, NULL on failure
+  vtkOrientedImageData* planSegmentLabelmap(vtkMRMLRTPlanNode* planNode, QString segmentID);
+
+  /// Get engine-specific preprocessed input of the plan stored by \sa setPlanInput
+  /// \return NULL if the input has not been stored, or the plan inputs changed since then
+  Q_INVOKABLE vtkObject* planInput(vtkMRMLRTPlanNode* planNode, QString name);
+  /// Store engine-specific preprocessed input of the plan (e.g. density volume)
+  Q_INVOKABLE void setPlanInput(vtkMRMLRTPlanNode* planNode, QString name, vtkObject* input);
+
+  /// Get engine-specific preprocessed input of the plan stored by \sa setPlanInputCacheEntry
+  /// \return NULL if the entry has not been stored, or the plan inputs changed since then
+  PlanInputCacheEntry* planInputCacheEntry(vtkMRMLRTPlanNode* planNode, QString name);
+  /// Store engine-specific preprocessed input of the plan that is not a VTK object. The cache takes ownership of the entry
+  void setPlanInputCacheEntry(vtkMRMLRTPlanNode* planNode, QString name, PlanInputCacheEntry* entry);
+
+  /// Remove cached inputs of a plan
+  /// \param planNode Plan to remove the inputs for. Inputs of all plans are removed if NULL
+  Q_INVOKABLE void clearPlanInputCache(vtkMRMLRTPlanNode* planNode=NULL);
+
 // Beam parameter definition functions.
 // Need to be called from the implemented \sa defineBeamParameters method.
 // Public so that they can be called from python.
@@ -28,10 +28,18 @@
 #include "vtkMRMLRTBeamNode.h"
 #include "vtkMRMLRTPlanNode.h"
 
+// ExternalBeamPlanning includes
+#include "vtkDoseInfluenceMatrix.h"
+
+// Segmentations includes
+#include "vtkOrientedImageData.h"
+#include "vtkSlicerSegmentationsModuleLogic.h"
+
 // SlicerRT includes
-#include "vtkMRMLDoseAccumulationNode.h"
 #include "vtkSlicerDoseAccumulationModuleLogic.h"
 #include "vtkSlicerIsodoseModuleLogic.h"
+#include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtPerformanceMonitor.h"
 
 // MRML includes
 #include <vtkMRMLScene.h>
@@ -48,10 +56,28 @@
 #include "vtkSlicerApplicationLogic.h"
 
 // VTK includes
+#include <vtkImageData.h>
 #include <vtkSmartPointer.h>
 
 // Qt includes
 #include <QDebug>
+#include <QMap>
+#include <QSet>
+
+//-----------------------------------------------------------------------------
+namespace
+{
+  /// Number of incremental total dose updates after which the total is summed again from the per-beam
+  /// doses, so that rounding errors of the float additions and subtractions do not accumulate
+  const int MAXIMUM_INCREMENTAL_TOTAL_DOSE_UPDATES = 32;
+
+  //-----------------------------------------------------------------------------
+  QString GetVolumeSignature(vtkMRMLScalarVolumeNode* volumeNode)
+  {
+    return QString("%1;%2;%3").arg(volumeNode->GetID()).arg(volumeNode->GetMTime())
+      .arg(volumeNode->GetImageData() ? volumeNode->GetImageData()->GetMTime() : 0);
+  }
+}
 
 //-----------------------------------------------------------------------------
 /// \ingroup Slicer_QtModules_SubjectHierarchy
@@ -64,6 +90,37 @@ public:
   qSlicerDoseEngineLogicPrivate(qSlicerDoseEngineLogic& object);
   ~qSlicerDoseEngineLogicPrivate();
   void loadApplicationSettings();
+
+public:
+  /// Dose of a beam resampled to the reference geometry of its plan, and the weight
+  /// it is included in the total dose with
+  struct BeamDoseBuffer
+  {
+    BeamDoseBuffer() : Weight(0.0) { }
+    /// ID and modified times of the per-beam dose volume the buffer was resampled from
+    QString DoseSignature;
+    vtkSmartPointer<vtkImageData> ResampledDose;
+    double Weight;
+  };
+
+  /// Per-beam doses and total dose of a plan. Used to update the total dose incrementally
+  /// when only some of the beams or beam weights change
+  struct PlanDoseBuffers
+  {
+    PlanDoseBuffers() : TotalDoseMTime(0), NumberOfIncrementalUpdates(0) { }
+    /// ID and modified times of the reference volume of the plan
+    QString ReferenceSignature;
+    vtkSmartPointer<vtkImageData> TotalDose;
+    /// Modified time of the total dose after the last update. Used to detect external changes
+    vtkMTimeType TotalDoseMTime;
+    /// Number of incremental updates since the total dose was last summed from all beams
+    int NumberOfIncrementalUpdates;
+    /// Beam dose buffers by beam node ID
+    QMap<QString, BeamDoseBuffer> BeamDoses;
+  };
+
+  /// Dose buffers by plan node ID
+  QMap<QString, PlanDoseBuffers> DoseBuffers;
 };
 
 //-----------------------------------------------------------------------------
@@ -110,6 +167,9 @@ void qSlicerDoseEngineLogic::setMRMLScene(vtkMRMLScene* scene)
   qvtkReconnect( scene, vtkMRMLScene::NodeAddedEvent, this, SLOT( onNodeAdded(vtkObject*,vtkObject*) ) );
   // Connect scene import ended event so that subject hierarchy nodes can be created for supported data nodes if missing (backwards compatibility)
   qvtkReconnect( scene, vtkMRMLScene::EndImportEvent, this, SLOT( onSceneImportEnded(vtkObject*) ) );
+  // Connect node removed and scene close events so that cached plan inputs are released
+  qvtkReconnect( scene, vtkMRMLScene::NodeRemovedEvent, this, SLOT( onNodeRemoved(vtkObject*,vtkObject*) ) );
+  qvtkReconnect( scene, vtkMRMLScene::EndCloseEvent, this, SLOT( onSceneClosed(vtkObject*) ) );
 }
 
 //-----------------------------------------------------------------------------
@@ -128,6 +188,41 @@ void qSlicerDoseEngineLogic::onNodeAdded(vtkObject* sceneObject, vtkObject* node
     vtkMRMLRTPlanNode* planNode = vtkMRMLRTPlanNode::SafeDownCast(nodeObject);
     qvtkConnect( planNode, vtkMRMLRTPlanNode::DoseEngineChanged, this, SLOT( onDoseEngineChangedInPlan(vtkObject*) ) );
   }
+  else if (nodeObject->IsA("vtkMRMLRTBeamNode"))
+  {
+    // Observe beam weight changes so that the total dose can be updated without recalculating the beam doses
+    qvtkConnect( nodeObject, vtkMRMLRTBeamNode::BeamWeightModified, this, SLOT( onBeamWeightModified(vtkObject*) ) );
+  }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDoseEngineLogic::onNodeRemoved(vtkObject* sceneObject, vtkObject* nodeObject)
+{
+  Q_UNUSED(sceneObject);
+  Q_D(qSlicerDoseEngineLogic);
+  vtkMRMLRTPlanNode* planNode = vtkMRMLRTPlanNode::SafeDownCast(nodeObject);
+  if (!planNode)
+  {
+    return;
+  }
+
+  d->DoseBuffers.remove(planNode->GetID());
+  foreach (qSlicerAbstractDoseEngine* engine, qSlicerDoseEnginePluginHandler::instance()->registeredDoseEngines())
+  {
+    engine->clearPlanInputCache(planNode);
+  }
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerDoseEngineLogic::onSceneClosed(vtkObject* sceneObject)
+{
+  Q_D(qSlicerDoseEngineLogic);
+  Q_UNUSED(sceneObject);
+  d->DoseBuffers.clear();
+  foreach (qSlicerAbstractDoseEngine* engine, qSlicerDoseEnginePluginHandler::instance()->registeredDoseEngines())
+  {
+    engine->clearPlanInputCache();
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -148,6 +243,14 @@ void qSlicerDoseEngineLogic::onSceneImportEnded(vtkObject* sceneObject)
     vtkMRMLNode* planNode = (*planNodeIt);
     qvtkConnect( planNode, vtkMRMLRTPlanNode::DoseEngineChanged, this, SLOT( onDoseEngineChangedInPlan(vtkObject*) ) );
   }
+
+  // Observe beam weight changes of all beams in the scene
+  std::vector<vtkMRMLNode*> beamNodes;
+  scene->GetNodesByClass("vtkMRMLRTBeamNode", beamNodes);
+  for (std::vector<vtkMRMLNode*>::iterator beamNodeIt = beamNodes.begin(); beamNodeIt != beamNodes.end(); ++beamNodeIt)
+  {
+    qvtkConnect( (*beamNodeIt), vtkMRMLRTBeamNode::BeamWeightModified, this, SLOT( onBeamWeightModified(vtkObject*) ) );
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -187,6 +290,36 @@ void qSlicerDoseEngineLogic::onDoseEngineChangedInPlan(vtkObject* nodeObject)
   }
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerDoseEngineLogic::onBeamWeightModified(vtkObject* nodeObject)
+{
+  Q_D(qSlicerDoseEngineLogic);
+  vtkMRMLRTBeamNode* beamNode = vtkMRMLRTBeamNode::SafeDownCast(nodeObject);
+  if (!beamNode || !beamNode->GetID())
+  {
+    return;
+  }
+  vtkMRMLRTPlanNode* planNode = beamNode->GetParentPlanNode();
+  if (!planNode || !planNode->GetID())
+  {
+    return;
+  }
+
+  // Only update total doses that have been accumulated with the dose of this beam. Before the first
+  // accumulation the new weight is used when the total dose is created
+  QMap<QString, qSlicerDoseEngineLogicPrivate::PlanDoseBuffers>::iterator buffersIt = d->DoseBuffers.find(planNode->GetID());
+  if (buffersIt == d->DoseBuffers.end() || !buffersIt.value().BeamDoses.contains(beamNode->GetID()))
+  {
+    return;
+  }
+
+  QString errorMessage = this->createAccumulatedDose(planNode);
+  if (!errorMessage.isEmpty())
+  {
+    qCritical() << Q_FUNC_INFO << ": Failed to update total dose after beam weight change: " << errorMessage;
+  }
+}
+
 //---------------------------------------------------------------------------
 QString qSlicerDoseEngineLogic::calculateDose(vtkMRMLRTPlanNode* planNode)
 {
@@ -259,6 +392,7 @@ QString qSlicerDoseEngineLogic::calculateDose(vtkMRMLRTPlanNode* planNode)
 //---------------------------------------------------------------------------
 QString qSlicerDoseEngineLogic::createAccumulatedDose(vtkMRMLRTPlanNode* planNode)
 {
+  Q_D(qSlicerDoseEngineLogic);
   if (!planNode || !planNode->GetScene())
   {
     QString errorMessage("Invalid MRML scene or RT plan node");
@@ -299,16 +433,32 @@ QString qSlicerDoseEngineLogic::createAccumulatedDose(vtkMRMLRTPlanNode* planNod
     return errorMessage;
   }
 
-  // Create parameter node for dose accumulation
-  vtkSmartPointer<vtkMRMLDoseAccumulationNode> doseAccumulationNode = vtkSmartPointer<vtkMRMLDoseAccumulationNode>::New();
-  planNode->GetScene()->AddNode(doseAccumulationNode);
-  std::string doseAccumulationNodeName = std::string("DoseAccumulation_") + planNode->GetName();
-  doseAccumulationNodeName = planNode->GetScene()->GenerateUniqueName(doseAccumulationNodeName);
-  doseAccumulationNode->SetName(doseAccumulationNodeName.c_str());
-  doseAccumulationNode->SetAndObserveAccumulatedDoseVolumeNode(totalDoseVolumeNode);
-  doseAccumulationNode->SetAndObserveReferenceDoseVolumeNode(referenceVolumeNode); //TODO: CT seems to be the reference based on old code but dose accumulation code suggests it should be a dose
+  if (!referenceVolumeNode->GetImageData())
+  {
+    QString errorMessage("No image data in reference volume");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
+  vtkSlicerRtScopedTimer timer("ExternalBeamPlanning.AccumulateTotalDose");
 
-  // Collect per-beam dose volumes from beams under the plan
+  // Start over if the reference geometry or the total dose has been changed since the last accumulation
+  qSlicerDoseEngineLogicPrivate::PlanDoseBuffers& buffers = d->DoseBuffers[planNode->GetID()];
+  QString referenceSignature = GetVolumeSignature(referenceVolumeNode);
+  if ( buffers.ReferenceSignature != referenceSignature || !buffers.TotalDose
+    || totalDoseVolumeNode->GetImageData() != buffers.TotalDose.GetPointer()
+    || buffers.TotalDose->GetMTime() != buffers.TotalDoseMTime )
+  {
+    buffers = qSlicerDoseEngineLogicPrivate::PlanDoseBuffers();
+    buffers.ReferenceSignature = referenceSignature;
+  }
+
+  // Collect the changes of the per-beam doses and weights as weighted images to add to the total dose.
+  // Only the doses that changed since the last accumulation are resampled to the reference geometry.
+  std::vector<vtkSmartPointer<vtkImageData> > changedDoses;
+  std::vector<double> changedWeights;
+  int numberOfChangedBeams = 0;
+  QSet<QString> beamIDs;
   std::vector<vtkMRMLRTBeamNode*> beams;
   planNode->GetBeams(beams);
   for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt)
@@ -323,26 +473,127 @@ QString qSlicerDoseEngineLogic::createAccumulatedDose(vtkMRMLRTPlanNode* planNod
 
     // Get calculation result dose volume from beam
     vtkMRMLScalarVolumeNode* perBeamDoseVolume = selectedEngine->getResultDoseForBeam(beamNode);
-    if (!perBeamDoseVolume)
+    if (!perBeamDoseVolume || !perBeamDoseVolume->GetImageData())
     {
       QString errorMessage = QString("No calculated dose found for beam %1").arg(beamNode->GetName());
       qCritical() << Q_FUNC_INFO << ": " << errorMessage;
       continue;
     }
 
-    // Add dose volume to dose accumulation
-    doseAccumulationNode->AddSelectedInputVolumeNode(perBeamDoseVolume, beamNode->GetBeamWeight());
+    QString beamID(beamNode->GetID());
+    beamIDs.insert(beamID);
+    double weight = beamNode->GetBeamWeight();
+    QString doseSignature = GetVolumeSignature(perBeamDoseVolume);
+    qSlicerDoseEngineLogicPrivate::BeamDoseBuffer& beamBuffer = buffers.BeamDoses[beamID];
+    if (beamBuffer.DoseSignature != doseSignature)
+    {
+      // Dose has been (re)calculated: replace the old contribution of the beam
+      vtkSmartPointer<vtkImageData> resampledDose = vtkSmartPointer<vtkImageData>::New();
+      if (!vtkSlicerDoseAccumulationModuleLogic::ResampleDoseVolumeToReferenceGeometry(perBeamDoseVolume, referenceVolumeNode, resampledDose))
+      {
+        d->DoseBuffers.remove(planNode->GetID());
+        QString errorMessage = QString("Failed to resample dose of beam %1 to the reference volume").arg(beamNode->GetName());
+        qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+        return errorMessage;
+      }
+      if (beamBuffer.ResampledDose)
+      {
+        changedDoses.push_back(beamBuffer.ResampledDose);
+        changedWeights.push_back(-beamBuffer.Weight);
+      }
+      changedDoses.push_back(resampledDose);
+      changedWeights.push_back(weight);
+      beamBuffer.DoseSignature = doseSignature;
+      beamBuffer.ResampledDose = resampledDose;
+      beamBuffer.Weight = weight;
+      ++numberOfChangedBeams;
+    }
+    else if (beamBuffer.Weight != weight)
+    {
+      // Only the weight has changed: add the weight difference times the already resampled dose
+      changedDoses.push_back(beamBuffer.ResampledDose);
+      changedWeights.push_back(weight - beamBuffer.Weight);
+      beamBuffer.Weight = weight;
+      ++numberOfChangedBeams;
+    }
+  }
+
+  // Remove contribution of beams that have been removed from the plan or have no dose any more
+  QMap<QString, qSlicerDoseEngineLogicPrivate::BeamDoseBuffer>::iterator beamBufferIt = buffers.BeamDoses.begin();
+  while (beamBufferIt != buffers.BeamDoses.end())
+  {
+    if (!beamIDs.contains(beamBufferIt.key()))
+    {
+      changedDoses.push_back(beamBufferIt.value().ResampledDose);
+      changedWeights.push_back(-beamBufferIt.value().Weight);
+      beamBufferIt = buffers.BeamDoses.erase(beamBufferIt);
+      ++numberOfChangedBeams;
+    }
+    else
+    {
+      ++beamBufferIt;
+    }
+  }
+
+  if (buffers.BeamDoses.isEmpty())
+  {
+    d->DoseBuffers.remove(planNode->GetID());
+    QString errorMessage("No dose volume selected");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
   }
 
-  // Accumulate dose
-  vtkSmartPointer<vtkSlicerDoseAccumulationModuleLogic> doseAccumulationLogic = vtkSmartPointer<vtkSlicerDoseAccumulationModuleLogic>::New();
-  doseAccumulationLogic->SetMRMLScene(planNode->GetScene());
-  std::string errorMessage = doseAccumulationLogic->AccumulateDoseVolumes(doseAccumulationNode);
-  if (!errorMessage.empty())
+  // Sum all beams if there is no valid total dose yet, if most of the beams changed (the full sum is
+  // then not slower than applying the differences), or if there have been too many incremental updates.
+  // Otherwise only apply the changes to the existing total dose.
+  bool totalDoseCreated = (buffers.TotalDose.GetPointer() == NULL);
+  bool fullUpdate = totalDoseCreated || numberOfChangedBeams > buffers.BeamDoses.size() / 2
+    || buffers.NumberOfIncrementalUpdates >= MAXIMUM_INCREMENTAL_TOTAL_DOSE_UPDATES;
+  bool success = true;
+  if (fullUpdate)
+  {
+    if (totalDoseCreated)
+    {
+      buffers.TotalDose = vtkSmartPointer<vtkImageData>::New();
+      buffers.TotalDose->CopyStructure(buffers.BeamDoses.begin().value().ResampledDose);
+      buffers.TotalDose->AllocateScalars(VTK_FLOAT, 1);
+    }
+    std::vector<vtkImageData*> doses;
+    std::vector<double> weights;
+    foreach (const qSlicerDoseEngineLogicPrivate::BeamDoseBuffer& beamBuffer, buffers.BeamDoses)
+    {
+      doses.push_back(beamBuffer.ResampledDose);
+      weights.push_back(beamBuffer.Weight);
+    }
+    success = vtkSlicerDoseAccumulationModuleLogic::AddWeightedImages(buffers.TotalDose, doses, weights, true);
+    buffers.NumberOfIncrementalUpdates = 0;
+  }
+  else if (!changedDoses.empty())
+  {
+    std::vector<vtkImageData*> doses(changedDoses.begin(), changedDoses.end());
+    success = vtkSlicerDoseAccumulationModuleLogic::AddWeightedImages(buffers.TotalDose, doses, changedWeights, false);
+    ++buffers.NumberOfIncrementalUpdates;
+  }
+  if (!success)
   {
-    return QString(errorMessage.c_str());
+    d->DoseBuffers.remove(planNode->GetID());
+    QString errorMessage("Failed to accumulate per-beam doses");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
   }
 
+  if (!totalDoseCreated)
+  {
+    // The total dose volume observes the updated image data, so the views are refreshed without setting it again
+    buffers.TotalDoseMTime = buffers.TotalDose->GetMTime();
+    return QString();
+  }
+
+  totalDoseVolumeNode->SetAndObserveImageData(buffers.TotalDose);
+  totalDoseVolumeNode->CopyOrientation(referenceVolumeNode);
+  totalDoseVolumeNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_VOLUME_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
+  buffers.TotalDoseMTime = buffers.TotalDose->GetMTime();
+
   // Add total dose volume to subject hierarchy under the study of the reference volume
   vtkIdType referenceVolumeShItemID = shNode->GetItemByDataNode(referenceVolumeNode);
   if (referenceVolumeShItemID)
@@ -384,8 +635,9 @@ QString qSlicerDoseEngineLogic::createAccumulatedDose(vtkMRMLRTPlanNode* planNod
     qWarning() << Q_FUNC_INFO << ": Display node is not available for calculated dose volume node. The default color table will be used.";
   }
 
-  // Show total dose in foreground
-  vtkMRMLSelectionNode* selectionNode = qSlicerCoreApplication::application()->applicationLogic()->GetSelectionNode();
+  // Show total dose in foreground (if running in the application, not in a test for example)
+  vtkMRMLSelectionNode* selectionNode = (qSlicerCoreApplication::application() && qSlicerCoreApplication::application()->applicationLogic()
+    ? qSlicerCoreApplication::application()->applicationLogic()->GetSelectionNode() : NULL);
   if (selectionNode)
   {
     // Make sure reference volume is shown in background
@@ -410,6 +662,86 @@ QString qSlicerDoseEngineLogic::createAccumulatedDose(vtkMRMLRTPlanNode* planNod
   return QString();
 }
 
+//---------------------------------------------------------------------------
+QString qSlicerDoseEngineLogic::calculateDoseInfluenceMatrix(vtkMRMLRTPlanNode* planNode, QStringList segmentIDs, vtkDoseInfluenceMatrix* matrix)
+{
+  if (!planNode || !planNode->GetScene() || !matrix)
+  {
+    QString errorMessage("Invalid MRML scene, RT plan node or influence matrix");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  vtkMRMLScalarVolumeNode* referenceVolumeNode = planNode->GetReferenceVolumeNode();
+  if (!referenceVolumeNode || !referenceVolumeNode->GetImageData())
+  {
+    QString errorMessage("Unable to access reference volume");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  qSlicerAbstractDoseEngine* selectedEngine =
+    qSlicerDoseEnginePluginHandler::instance()->doseEngineByName(planNode->GetDoseEngineName());
+  if (!selectedEngine)
+  {
+    QString errorMessage = QString("Unable to access dose engine with name %1").arg(planNode->GetDoseEngineName() ? planNode->GetDoseEngineName() : "NULL");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  if (!selectedEngine->isDoseInfluenceMatrixSupported())
+  {
+    QString errorMessage = QString("Dose engine %1 does not support dose influence matrix calculation").arg(selectedEngine->name());
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  if (segmentIDs.isEmpty())
+  {
+    QString errorMessage("No segments selected for the dose influence matrix");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
+  vtkSlicerRtScopedTimer timer("ExternalBeamPlanning.CalculateDoseInfluenceMatrix");
+
+  // Dose grid is the reference volume geometry, rows are the voxels inside the selected segments
+  vtkSmartPointer<vtkOrientedImageData> doseGrid = vtkSmartPointer<vtkOrientedImageData>::Take(
+    vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(referenceVolumeNode) );
+  if (!doseGrid.GetPointer())
+  {
+    QString errorMessage("Failed to get reference volume geometry");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+  matrix->SetDoseGrid(doseGrid);
+  foreach (QString segmentID, segmentIDs)
+  {
+    vtkOrientedImageData* segmentLabelmap = selectedEngine->planSegmentLabelmap(planNode, segmentID);
+    if (!segmentLabelmap || !matrix->AddVoxelsInMask(segmentLabelmap))
+    {
+      QString errorMessage = QString("Failed to add voxels of segment %1 to the dose influence matrix").arg(segmentID);
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+      return errorMessage;
+    }
+  }
+
+  // Add beamlets of each beam
+  std::vector<vtkMRMLRTBeamNode*> beams;
+  planNode->GetBeams(beams);
+  int numberOfBeams = beams.size();
+  int currentBeamIndex = 0;
+  for (std::vector<vtkMRMLRTBeamNode*>::iterator beamIt = beams.begin(); beamIt != beams.end(); ++beamIt, ++currentBeamIndex)
+  {
+    emit progressUpdated((double)currentBeamIndex / (numberOfBeams+1));
+    QString errorMessage = selectedEngine->calculateDoseInfluenceMatrix(*beamIt, matrix);
+    if (!errorMessage.isEmpty())
+    {
+      return errorMessage;
+    }
+  }
+
+  matrix->Finalize();
+  emit progressUpdated(1.0);
+  return QString();
+}
+
 //---------------------------------------------------------------------------
 void qSlicerDoseEngineLogic::removeIntermediateResults(vtkMRMLRTPlanNode* planNode)
 {
@@ -32,7 +32,9 @@
 
 // Qt includes
 #include <QObject>
+#include <QStringList>
 
+class vtkDoseInfluenceMatrix;
 class vtkMRMLScene;
 class vtkMRMLRTPlanNode;
 class vtkMRMLRTBeamNode;
@@ -61,10 +63,20 @@ public:
   /// Calculate dose for a plan
   Q_INVOKABLE QString calculateDose(vtkMRMLRTPlanNode* planNode);
 
-  /// Accumulate per-beam dose volumes for each beam under given plan. The accumulated
-  /// total dose is
+  /// Accumulate per-beam dose volumes for each beam under given plan into the output total dose volume of the plan.
+  /// The per-beam doses resampled to the reference geometry are kept, so when called again only the doses
+  /// that changed are resampled, and the total dose is updated in place with the differences. If only beam
+  /// weights changed, then no resampling is done and the weight differences are applied in one parallel pass.
   Q_INVOKABLE QString createAccumulatedDose(vtkMRMLRTPlanNode* planNode);
 
+  /// Calculate sparse dose influence matrix of a plan for inverse planning (fluence map optimization).
+  /// The rows of the matrix are the voxels of the reference volume inside the given segments, the
+  /// columns are the beamlets of the beams under the plan, as computed by the dose engine of the plan.
+  /// \param segmentIDs Segments of the plan segmentation to compute the dose in (target and organs at risk)
+  /// \param matrix Output influence matrix. It is finalized on success
+  /// \return Error message. Empty string on success
+  Q_INVOKABLE QString calculateDoseInfluenceMatrix(vtkMRMLRTPlanNode* planNode, QStringList segmentIDs, vtkDoseInfluenceMatrix* matrix);
+
   /// Remove MRML nodes created by dose calculation for the current RT plan,
   /// such as apertures, range compensators, and doses
   Q_INVOKABLE void removeIntermediateResults(vtkMRMLRTPlanNode* planNode);
@@ -81,14 +93,24 @@ protected slots:
   /// Called when a node is added to the scene
   void onNodeAdded(vtkObject* scene, vtkObject* nodeObject);
 
+  /// Called when a node is removed from the scene. Removes cached inputs and per-beam dose buffers of removed plans
+  void onNodeRemoved(vtkObject* scene, vtkObject* nodeObject);
+
   /// Called when scene import is finished
   void onSceneImportEnded(vtkObject* sceneObject);
 
+  /// Called when scene is closed. Removes all cached plan inputs and per-beam dose buffers
+  void onSceneClosed(vtkObject* sceneObject);
+
   /// Called when the dose engine of a plan is changed.
   /// The beam parameters specific to the new engine are added to all the beams
   /// under the plan containing default values
   void onDoseEngineChangedInPlan(vtkObject* nodeObject);
 
+  /// Called when the weight of a beam is changed. Updates the total dose of the plan of the beam with
+  /// the weight difference if it has been accumulated before, without recalculating or resampling doses
+  void onBeamWeightModified(vtkObject* nodeObject);
+
 protected:
   QScopedPointer<qSlicerDoseEngineLogic> d_ptr;
 
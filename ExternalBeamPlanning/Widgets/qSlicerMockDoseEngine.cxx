@@ -25,6 +25,10 @@
 #include "vtkMRMLRTPlanNode.h"
 #include "vtkMRMLRTBeamNode.h"
 
+// ExternalBeamPlanning includes
+#include "vtkBeamletDoseCalculator.h"
+#include "vtkDoseInfluenceMatrix.h"
+
 // Segmentations includes
 #include "vtkOrientedImageData.h"
 #include "vtkSlicerSegmentationsModuleLogic.h"
@@ -32,8 +36,10 @@
 
 // MRML includes
 #include "vtkMRMLScalarVolumeNode.h"
+#include "vtkMRMLTransformNode.h"
 
 // VTK includes
+#include <vtkMatrix4x4.h>
 #include <vtkSmartPointer.h>
 #include <vtkImageData.h>
 #include <vtkPolyData.h>
@@ -60,6 +66,11 @@ void qSlicerMockDoseEngine::defineBeamParameters()
   this->addBeamParameterSpinBox(
     "Mock dose", "NoiseRange", "Noise range (% of Rx):", "Range of noise added to the prescription dose (+- half of the percentage of the Rx dose)",
     0.0, 99.99, 10.0, 1.0, 2 );
+
+  // Beamlet size parameter (for dose influence matrix)
+  this->addBeamParameterSpinBox(
+    "Mock dose", "BeamletSize", "Beamlet size (mm):", "Size of the beamlets at the isocenter plane used in dose influence matrix calculation",
+    1.0, 50.0, 5.0, 1.0, 1 );
 }
 
 //---------------------------------------------------------------------------
@@ -131,3 +142,33 @@ QString qSlicerMockDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamN
 
   return QString();
 }
+
+//---------------------------------------------------------------------------
+QString qSlicerMockDoseEngine::calculateDoseInfluenceMatrixUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkDoseInfluenceMatrix* matrix)
+{
+  if (!beamNode || !matrix)
+  {
+    QString errorMessage("Invalid beam node or influence matrix");
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
+  // The beam model is defined in the beam coordinate system, and its parent transform is the IEC beam transform
+  vtkSmartPointer<vtkMatrix4x4> beamToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (beamNode->GetParentTransformNode())
+  {
+    beamNode->GetParentTransformNode()->GetMatrixTransformToWorld(beamToWorldMatrix);
+  }
+  double jaws[4] = { beamNode->GetX1Jaw(), beamNode->GetX2Jaw(), beamNode->GetY1Jaw(), beamNode->GetY2Jaw() };
+
+  vtkSmartPointer<vtkBeamletDoseCalculator> beamletDoseCalculator = vtkSmartPointer<vtkBeamletDoseCalculator>::New();
+  beamletDoseCalculator->SetBeamletSize(this->doubleParameter(beamNode, "BeamletSize"));
+  if (beamletDoseCalculator->AddBeam(matrix, beamNode->GetID(), beamToWorldMatrix, beamNode->GetSAD(), jaws) < 0)
+  {
+    QString errorMessage = QString("Failed to calculate beamlet doses for beam %1").arg(beamNode->GetName());
+    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+    return errorMessage;
+  }
+
+  return QString();
+}
@@ -29,7 +29,8 @@
 /// \ingroup SlicerRt_QtModules_ExternalBeamPlanning
 /// \class qSlicerMockDoseEngine
 /// \brief Mock dose calculation algorithm. Simply fills the beam apertures with prescription dose adding some noise.
-///        Used for testing.
+///        Used for testing. Also provides the reference implementation of the dose influence matrix calculation
+///        using the simple beamlet model of \sa vtkBeamletDoseCalculator
 class Q_SLICER_MODULE_EXTERNALBEAMPLANNING_WIDGETS_EXPORT qSlicerMockDoseEngine : public qSlicerAbstractDoseEngine
 {
   Q_OBJECT
@@ -49,9 +50,17 @@ public:
   /// \param resultDoseVolumeNode Output volume node for the result dose. It is created by \sa CalculateDose
   Q_INVOKABLE QString calculateDoseUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkMRMLScalarVolumeNode* resultDoseVolumeNode);
 
+  /// The mock engine supports dose influence matrix calculation
+  virtual bool isDoseInfluenceMatrixSupported() { return true; };
+
   /// Define engine-specific beam parameters
   void defineBeamParameters();
 
+protected:
+  /// Calculate dose influence matrix columns of the beamlets of a beam with \sa vtkBeamletDoseCalculator.
+  /// Called by \sa calculateDoseInfluenceMatrix
+  QString calculateDoseInfluenceMatrixUsingEngine(vtkMRMLRTBeamNode* beamNode, vtkDoseInfluenceMatrix* matrix);
+
 private:
   Q_DISABLE_COPY(qSlicerMockDoseEngine);
 };
@@ -35,6 +35,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtPerformanceMonitor.h"
 
 // Beams includes
 #include "vtkMRMLRTBeamNode.h"
@@ -63,7 +64,6 @@
 
 // Qt includes
 #include <QDebug>
-#include <QTime>
 #include <QItemSelection>
 #include <QMessageBox>
 
@@ -980,8 +980,7 @@ void qSlicerExternalBeamPlanningModuleWidget::calculateDoseClicked()
   }
 
   // Start timer
-  QTime time;
-  time.start();
+  vtkSlicerRtScopedTimer timer("ExternalBeamPlanning.CalculateDose", true);
   // Set busy cursor
   QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
 
@@ -1000,7 +999,7 @@ void qSlicerExternalBeamPlanningModuleWidget::calculateDoseClicked()
 
   if (errorMessage.isEmpty())
   {
-    QString message = QString("Dose calculated successfully in %1 s").arg(time.elapsed()/1000.0);
+    QString message = QString("Dose calculated successfully in %1 s").arg(timer.GetElapsedSeconds());
     qDebug() << Q_FUNC_INFO << ": " << message;
     d->label_CalculateDoseStatus->setText(message);
   }
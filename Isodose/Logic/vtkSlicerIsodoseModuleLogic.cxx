@@ -30,6 +30,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtPerformanceMonitor.h"
 
 // MRML includes
 #include <vtkMRMLColorTableNode.h>
@@ -46,6 +47,7 @@
 
 // VTK includes
 #include <vtkColorTransferFunction.h>
+#include <vtkDataArray.h>
 #include <vtkDecimatePro.h>
 #include <vtkGeneralTransform.h>
 #include <vtkImageChangeInformation.h>
@@ -55,13 +57,21 @@
 #include <vtkLookupTable.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
 #include <vtkPolyDataNormals.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
 #include <vtkSmartPointer.h>
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkTriangleFilter.h>
+#include <vtkWeakPointer.h>
 #include <vtkWindowedSincPolyDataFilter.h>
 #include "vtksys/SystemTools.hxx"
 
+// STD includes
+#include <algorithm>
+#include <map>
+
 //----------------------------------------------------------------------------
 const char* DEFAULT_ISODOSE_COLOR_TABLE_FILE_NAME = "Isodose_ColorTable.ctbl";
 const char* DEFAULT_ISODOSE_COLOR_TABLE_NODE_NAME = "Isodose_ColorTable_Default";
@@ -73,17 +83,222 @@ const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_COLOR_TABLE_NODE_NAME_POS
 static const char* ISODOSE_ROOT_MODEL_HIERARCHY_REFERENCE_ROLE = "isodoseRootModelHierarchyRef";
 static const char* ISODOSE_ROOT_MODEL_HIERARCHY_DISPLAY_REFERENCE_ROLE = "isodoseRootModelHierarchyDisplayRef";
 
+// Surface generation parameters
+static const double ISODOSE_DECIMATE_TARGET_REDUCTION = 0.6;
+static const double ISODOSE_SMOOTHING_PASS_BAND = 0.1;
+static const int ISODOSE_SMOOTHING_NUMBER_OF_ITERATIONS = 2;
+
+// Relative tolerance of dose values and isovalues when matching rescaled dose against cached surfaces
+static const double ISODOSE_CACHE_RELATIVE_TOLERANCE = 1e-6;
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Maximum absolute value of two arrays in one pass
+  class MaximumAbsoluteValueFunctor
+  {
+  public:
+    MaximumAbsoluteValueFunctor(vtkDataArray* array1, vtkDataArray* array2)
+      : Array1(array1)
+      , Array2(array2)
+      , Maximum1(0.0)
+      , Maximum2(0.0)
+    {
+    }
+
+    void Initialize()
+    {
+      this->LocalMaximum1.Local() = 0.0;
+      this->LocalMaximum2.Local() = 0.0;
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      double& maximum1 = this->LocalMaximum1.Local();
+      double& maximum2 = this->LocalMaximum2.Local();
+      for (vtkIdType i=begin; i<end; ++i)
+      {
+        maximum1 = std::max(maximum1, fabs(this->Array1->GetComponent(i, 0)));
+        maximum2 = std::max(maximum2, fabs(this->Array2->GetComponent(i, 0)));
+      }
+    }
+
+    void Reduce()
+    {
+      for (vtkSMPThreadLocal<double>::iterator it = this->LocalMaximum1.begin(); it != this->LocalMaximum1.end(); ++it)
+      {
+        this->Maximum1 = std::max(this->Maximum1, *it);
+      }
+      for (vtkSMPThreadLocal<double>::iterator it = this->LocalMaximum2.begin(); it != this->LocalMaximum2.end(); ++it)
+      {
+        this->Maximum2 = std::max(this->Maximum2, *it);
+      }
+    }
+
+    vtkDataArray* Array1;
+    vtkDataArray* Array2;
+    double Maximum1;
+    double Maximum2;
+    vtkSMPThreadLocal<double> LocalMaximum1;
+    vtkSMPThreadLocal<double> LocalMaximum2;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Count values of the second array that differ from the scaled values of the first array more than the tolerance
+  class ScaledDifferenceFunctor
+  {
+  public:
+    ScaledDifferenceFunctor(vtkDataArray* baseArray, vtkDataArray* array, double scale, double tolerance)
+      : BaseArray(baseArray)
+      , Array(array)
+      , Scale(scale)
+      , Tolerance(tolerance)
+      , NumberOfDifferentValues(0)
+    {
+    }
+
+    void Initialize()
+    {
+      this->LocalNumberOfDifferentValues.Local() = 0;
+    }
+
+    void operator()(vtkIdType begin, vtkIdType end)
+    {
+      vtkIdType& numberOfDifferentValues = this->LocalNumberOfDifferentValues.Local();
+      for (vtkIdType i=begin; i<end; ++i)
+      {
+        if (fabs(this->Array->GetComponent(i, 0) - this->Scale * this->BaseArray->GetComponent(i, 0)) > this->Tolerance)
+        {
+          ++numberOfDifferentValues;
+        }
+      }
+    }
+
+    void Reduce()
+    {
+      for (vtkSMPThreadLocal<vtkIdType>::iterator it = this->LocalNumberOfDifferentValues.begin(); it != this->LocalNumberOfDifferentValues.end(); ++it)
+      {
+        this->NumberOfDifferentValues += (*it);
+      }
+    }
+
+    vtkDataArray* BaseArray;
+    vtkDataArray* Array;
+    double Scale;
+    double Tolerance;
+    vtkIdType NumberOfDifferentValues;
+    vtkSMPThreadLocal<vtkIdType> LocalNumberOfDifferentValues;
+  };
+}
+
+//----------------------------------------------------------------------------
+class vtkSlicerIsodoseModuleLogic::vtkInternal
+{
+public:
+  /// Isodose surfaces of one dose volume
+  struct IsodoseSurfaceCache
+  {
+    IsodoseSurfaceCache()
+      : DoseImageMTime(0)
+      , DoseScale(1.0)
+      , DecimateTargetReduction(0.0)
+      , SmoothingPassBand(0.0)
+      , SmoothingNumberOfIterations(0)
+    {
+      for (int i=0; i<16; ++i)
+      {
+        this->IJKToRASMatrixElements[i] = 0.0;
+        this->ParentTransformMatrixElements[i] = 0.0;
+      }
+    }
+
+    /// Dose image and its modified time when the cache was last updated
+    vtkWeakPointer<vtkImageData> DoseImage;
+    vtkMTimeType DoseImageMTime;
+    /// Geometry of the dose volume (IJK to RAS, and parent transform to world)
+    double IJKToRASMatrixElements[16];
+    double ParentTransformMatrixElements[16];
+    /// Resliced dose the cached surfaces were contoured on
+    vtkSmartPointer<vtkImageData> BaseDoseImage;
+    /// Current dose divided by the base dose. Isovalue on the base dose is the isodose level divided by this factor
+    double DoseScale;
+    /// Surface generation parameters
+    double DecimateTargetReduction;
+    double SmoothingPassBand;
+    int SmoothingNumberOfIterations;
+    /// Surfaces in RAS by isovalue on the base dose
+    std::map<double, vtkSmartPointer<vtkPolyData> > Surfaces;
+  };
+
+public:
+  /// Find cached surface for isovalue on the base dose. Returns end iterator if not found
+  std::map<double, vtkSmartPointer<vtkPolyData> >::iterator FindSurface(IsodoseSurfaceCache& cache, double baseIsovalue)
+  {
+    double tolerance = ISODOSE_CACHE_RELATIVE_TOLERANCE * std::max(fabs(baseIsovalue), 1e-12);
+    std::map<double, vtkSmartPointer<vtkPolyData> >::iterator surfaceIt = cache.Surfaces.lower_bound(baseIsovalue - tolerance);
+    if (surfaceIt != cache.Surfaces.end() && surfaceIt->first <= baseIsovalue + tolerance)
+    {
+      return surfaceIt;
+    }
+    return cache.Surfaces.end();
+  }
+
+  /// Determine factor by which the dose image is the scaled base dose image
+  /// \return Scale factor, zero if the dose is not a scaled version of the base dose
+  static double DetermineDoseScale(vtkImageData* baseDoseImage, vtkImageData* doseImage)
+  {
+    vtkDataArray* baseArray = baseDoseImage->GetPointData()->GetScalars();
+    vtkDataArray* array = doseImage->GetPointData()->GetScalars();
+    int baseDimensions[3] = {0, 0, 0};
+    int dimensions[3] = {0, 0, 0};
+    baseDoseImage->GetDimensions(baseDimensions);
+    doseImage->GetDimensions(dimensions);
+    if ( !baseArray || !array || baseArray->GetNumberOfTuples() != array->GetNumberOfTuples()
+      || baseDimensions[0] != dimensions[0] || baseDimensions[1] != dimensions[1] || baseDimensions[2] != dimensions[2] )
+    {
+      return 0.0;
+    }
+
+    MaximumAbsoluteValueFunctor maximumFunctor(baseArray, array);
+    vtkSMPTools::For(0, array->GetNumberOfTuples(), maximumFunctor);
+    if (maximumFunctor.Maximum1 <= 0.0 || maximumFunctor.Maximum2 <= 0.0)
+    {
+      return 0.0;
+    }
+    double scale = maximumFunctor.Maximum2 / maximumFunctor.Maximum1;
+
+    ScaledDifferenceFunctor differenceFunctor(baseArray, array, scale, ISODOSE_CACHE_RELATIVE_TOLERANCE * maximumFunctor.Maximum2);
+    vtkSMPTools::For(0, array->GetNumberOfTuples(), differenceFunctor);
+    return (differenceFunctor.NumberOfDifferentValues == 0 ? scale : 0.0);
+  }
+
+public:
+  /// Surface caches by dose volume node ID
+  std::map<std::string, IsodoseSurfaceCache> Caches;
+};
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerIsodoseModuleLogic);
 
 //----------------------------------------------------------------------------
 vtkSlicerIsodoseModuleLogic::vtkSlicerIsodoseModuleLogic()
 {
+  this->LastNumberOfContouredIsodoseLevels = 0;
+  this->Internal = new vtkInternal();
 }
 
 //----------------------------------------------------------------------------
 vtkSlicerIsodoseModuleLogic::~vtkSlicerIsodoseModuleLogic()
 {
+  delete this->Internal;
+  this->Internal = NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::ClearIsodoseSurfaceCache()
+{
+  this->Internal->Caches.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -152,6 +367,8 @@ void vtkSlicerIsodoseModuleLogic::OnMRMLSceneEndClose()
     return;
   }
 
+  this->ClearIsodoseSurfaceCache();
+
   this->Modified();
 }
 
@@ -185,6 +402,12 @@ void vtkSlicerIsodoseModuleLogic::OnMRMLSceneNodeRemoved(vtkMRMLNode* node)
     return;
   }
 
+  // Drop cached isodose surfaces of removed dose volume
+  if (node->GetID() && node->IsA("vtkMRMLScalarVolumeNode"))
+  {
+    this->Internal->Caches.erase(node->GetID());
+  }
+
   // if the scene is still updating, jump out
   if (this->GetMRMLScene()->IsBatchProcessing())
   {
@@ -551,23 +774,74 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
   outputIJK2IJKResliceTransform->Concatenate(inputRAS2IJKMatrix);
   outputIJK2IJKResliceTransform->Inverse();
 
-  int dimensions[3] = {0, 0, 0};
-  doseVolumeNode->GetImageData()->GetDimensions(dimensions);
-  vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
-  reslice->SetInputData(doseVolumeNode->GetImageData());
-  reslice->SetOutputOrigin(0, 0, 0);
-  reslice->SetOutputSpacing(1, 1, 1);
-  reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
-  reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
-  reslice->Update();
-  vtkSmartPointer<vtkImageData> reslicedDoseVolumeImage = reslice->GetOutput(); 
+  // Invalidate cached surfaces if dose geometry or surface generation parameters changed, and
+  // determine if dose changed only by scaling
+  vtkSlicerRtScopedTimer timer("Isodose.CreateIsodoseSurfaces");
+  vtkInternal::IsodoseSurfaceCache& cache = this->Internal->Caches[doseVolumeNode->GetID()];
+  bool cacheValid = (cache.BaseDoseImage.GetPointer() != NULL
+    && cache.DecimateTargetReduction == ISODOSE_DECIMATE_TARGET_REDUCTION
+    && cache.SmoothingPassBand == ISODOSE_SMOOTHING_PASS_BAND
+    && cache.SmoothingNumberOfIterations == ISODOSE_SMOOTHING_NUMBER_OF_ITERATIONS );
+  for (int i=0; i<16; ++i)
+  {
+    cacheValid = cacheValid && cache.IJKToRASMatrixElements[i] == inputIJK2RASMatrix->GetElement(i/4, i%4)
+      && cache.ParentTransformMatrixElements[i] == inputRAS2RASMatrix->GetElement(i/4, i%4);
+  }
+  bool doseChanged = (cache.DoseImage.GetPointer() != doseVolumeNode->GetImageData()
+    || cache.DoseImageMTime != doseVolumeNode->GetImageData()->GetMTime());
+
+  vtkSmartPointer<vtkImageData> reslicedDoseVolumeImage = cache.BaseDoseImage;
+  if (!cacheValid || doseChanged)
+  {
+    // Reslice dose volume
+    int dimensions[3] = {0, 0, 0};
+    doseVolumeNode->GetImageData()->GetDimensions(dimensions);
+    vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
+    reslice->SetInputData(doseVolumeNode->GetImageData());
+    reslice->SetOutputOrigin(0, 0, 0);
+    reslice->SetOutputSpacing(1, 1, 1);
+    reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
+    reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
+    reslice->Update();
+    reslicedDoseVolumeImage = reslice->GetOutput();
+
+    double doseScale = (cacheValid ? vtkInternal::DetermineDoseScale(cache.BaseDoseImage, reslicedDoseVolumeImage) : 0.0);
+    if (doseScale > 0.0)
+    {
+      // Keep surfaces of the base dose, and remap isovalues
+      cache.DoseScale = doseScale;
+      reslicedDoseVolumeImage = cache.BaseDoseImage;
+    }
+    else
+    {
+      cache.Surfaces.clear();
+      cache.BaseDoseImage = reslicedDoseVolumeImage;
+      cache.DoseScale = 1.0;
+      cache.DecimateTargetReduction = ISODOSE_DECIMATE_TARGET_REDUCTION;
+      cache.SmoothingPassBand = ISODOSE_SMOOTHING_PASS_BAND;
+      cache.SmoothingNumberOfIterations = ISODOSE_SMOOTHING_NUMBER_OF_ITERATIONS;
+      for (int i=0; i<16; ++i)
+      {
+        cache.IJKToRASMatrixElements[i] = inputIJK2RASMatrix->GetElement(i/4, i%4);
+        cache.ParentTransformMatrixElements[i] = inputRAS2RASMatrix->GetElement(i/4, i%4);
+      }
+    }
+    cache.DoseImage = doseVolumeNode->GetImageData();
+    cache.DoseImageMTime = doseVolumeNode->GetImageData()->GetMTime();
+  }
 
   // Report progress
   ++currentProgressStep;
   double progress = (double)(currentProgressStep) / (double)progressStepCount;
   this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
 
+  // Get dose unit name
+  std::string doseUnitName = shNode->GetAttributeFromItemAncestor(
+    doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
+
   // Create isodose surfaces
+  this->LastNumberOfContouredIsodoseLevels = 0;
+  std::map<double, vtkSmartPointer<vtkPolyData> > usedSurfaces;
   for (int i = 0; i < colorTableNode->GetNumberOfColors(); i++)
   {
     double val[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
@@ -575,54 +849,74 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
     double isoLevel = vtkVariant(strIsoLevel).ToDouble();
     colorTableNode->GetColor(i, val);
 
-    vtkSmartPointer<vtkImageMarchingCubes> marchingCubes = vtkSmartPointer<vtkImageMarchingCubes>::New();
-    marchingCubes->SetInputData(reslicedDoseVolumeImage);
-    marchingCubes->SetNumberOfContours(1); 
-    marchingCubes->SetValue(0, isoLevel);
-    marchingCubes->ComputeScalarsOff();
-    marchingCubes->ComputeGradientsOff();
-    marchingCubes->ComputeNormalsOff();
-    marchingCubes->Update();
-
-    vtkSmartPointer<vtkPolyData> isoPolyData= marchingCubes->GetOutput();
-    if (isoPolyData->GetNumberOfPoints() >= 1)
+    // Get surface from cache or contour the base dose
+    double baseIsoLevel = isoLevel / cache.DoseScale;
+    vtkSmartPointer<vtkPolyData> isodoseSurface;
+    std::map<double, vtkSmartPointer<vtkPolyData> >::iterator surfaceIt = this->Internal->FindSurface(cache, baseIsoLevel);
+    if (surfaceIt != cache.Surfaces.end())
+    {
+      isodoseSurface = surfaceIt->second;
+      baseIsoLevel = surfaceIt->first;
+    }
+    else
+    {
+      isodoseSurface = vtkSmartPointer<vtkPolyData>::New();
+      ++this->LastNumberOfContouredIsodoseLevels;
+
+      vtkSmartPointer<vtkImageMarchingCubes> marchingCubes = vtkSmartPointer<vtkImageMarchingCubes>::New();
+      marchingCubes->SetInputData(reslicedDoseVolumeImage);
+      marchingCubes->SetNumberOfContours(1); 
+      marchingCubes->SetValue(0, baseIsoLevel);
+      marchingCubes->ComputeScalarsOff();
+      marchingCubes->ComputeGradientsOff();
+      marchingCubes->ComputeNormalsOff();
+      marchingCubes->Update();
+
+      vtkSmartPointer<vtkPolyData> isoPolyData= marchingCubes->GetOutput();
+      if (isoPolyData->GetNumberOfPoints() >= 1)
+      {
+        vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
+        triangleFilter->SetInputData(marchingCubes->GetOutput());
+        triangleFilter->Update();
+
+        vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
+        decimate->SetInputData(triangleFilter->GetOutput());
+        decimate->SetTargetReduction(ISODOSE_DECIMATE_TARGET_REDUCTION);
+        decimate->SetFeatureAngle(60);
+        decimate->SplittingOff();
+        decimate->PreserveTopologyOn();
+        decimate->SetMaximumError(1);
+        decimate->Update();
+
+        vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
+        smootherSinc->SetPassBand(ISODOSE_SMOOTHING_PASS_BAND);
+        smootherSinc->SetInputData(decimate->GetOutput() );
+        smootherSinc->SetNumberOfIterations(ISODOSE_SMOOTHING_NUMBER_OF_ITERATIONS);
+        smootherSinc->FeatureEdgeSmoothingOff();
+        smootherSinc->BoundarySmoothingOff();
+        smootherSinc->Update();
+
+        vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+        normals->SetInputData(smootherSinc->GetOutput());
+        normals->ComputePointNormalsOn();
+        normals->SetFeatureAngle(60);
+        normals->Update();
+
+        vtkSmartPointer<vtkTransform> inputIJKToRASTransform = vtkSmartPointer<vtkTransform>::New();
+        inputIJKToRASTransform->Identity();
+        inputIJKToRASTransform->SetMatrix(inputIJK2RASMatrix);
+
+        vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+        transformPolyData->SetInputData(normals->GetOutput());
+        transformPolyData->SetTransform(inputIJKToRASTransform);
+        transformPolyData->Update();
+        isodoseSurface = transformPolyData->GetOutput();
+      }
+    }
+    usedSurfaces[baseIsoLevel] = isodoseSurface;
+
+    if (isodoseSurface->GetNumberOfPoints() >= 1)
     {
-      vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
-      triangleFilter->SetInputData(marchingCubes->GetOutput());
-      triangleFilter->Update();
-
-      vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
-      decimate->SetInputData(triangleFilter->GetOutput());
-      decimate->SetTargetReduction(0.6);
-      decimate->SetFeatureAngle(60);
-      decimate->SplittingOff();
-      decimate->PreserveTopologyOn();
-      decimate->SetMaximumError(1);
-      decimate->Update();
-
-      vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
-      smootherSinc->SetPassBand(0.1);
-      smootherSinc->SetInputData(decimate->GetOutput() );
-      smootherSinc->SetNumberOfIterations(2);
-      smootherSinc->FeatureEdgeSmoothingOff();
-      smootherSinc->BoundarySmoothingOff();
-      smootherSinc->Update();
-
-      vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
-      normals->SetInputData(smootherSinc->GetOutput());
-      normals->ComputePointNormalsOn();
-      normals->SetFeatureAngle(60);
-      normals->Update();
-
-      vtkSmartPointer<vtkTransform> inputIJKToRASTransform = vtkSmartPointer<vtkTransform>::New();
-      inputIJKToRASTransform->Identity();
-      inputIJKToRASTransform->SetMatrix(inputIJK2RASMatrix);
-
-      vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-      transformPolyData->SetInputData(normals->GetOutput());
-      transformPolyData->SetTransform(inputIJKToRASTransform);
-      transformPolyData->Update();
-  
       vtkSmartPointer<vtkMRMLModelDisplayNode> displayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
       displayNode = vtkMRMLModelDisplayNode::SafeDownCast(scene->AddNode(displayNode));
       displayNode->SliceIntersectionVisibilityOn();  
@@ -633,16 +927,16 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
       // Disable backface culling to make the back side of the model visible as well
       displayNode->SetBackfaceCulling(0);
 
-      // Get dose unit name
-      std::string doseUnitName = shNode->GetAttributeFromItemAncestor(
-        doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
+      // Model gets its own poly data object sharing the cached points and cells
+      vtkSmartPointer<vtkPolyData> isodoseModelPolyData = vtkSmartPointer<vtkPolyData>::New();
+      isodoseModelPolyData->ShallowCopy(isodoseSurface);
 
       vtkSmartPointer<vtkMRMLModelNode> isodoseModelNode = vtkSmartPointer<vtkMRMLModelNode>::New();
       isodoseModelNode = vtkMRMLModelNode::SafeDownCast(scene->AddNode(isodoseModelNode));
       std::string isodoseModelNodeName = vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + strIsoLevel + doseUnitName;
       isodoseModelNode->SetName(isodoseModelNodeName.c_str());
       isodoseModelNode->SetAndObserveDisplayNodeID(displayNode->GetID());
-      isodoseModelNode->SetAndObservePolyData(transformPolyData->GetOutput());
+      isodoseModelNode->SetAndObservePolyData(isodoseModelPolyData);
       isodoseModelNode->SetSelectable(1);
       isodoseModelNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_ISODOSE_MODEL_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
       shNode->RequestOwnerPluginSearch(isodoseModelNode); // The attribute above distinguishes isodoses from regular models
@@ -663,5 +957,9 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
     this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
   }
 
+  // Only keep the surfaces of the current levels
+  cache.Surfaces.swap(usedSurfaces);
+  vtkSlicerRtPerformanceMonitor::AddToCounter("Isodose.CreateIsodoseSurfaces", "ContouredLevels", this->LastNumberOfContouredIsodoseLevels);
+
   scene->EndState(vtkMRMLScene::BatchProcessState); 
 }
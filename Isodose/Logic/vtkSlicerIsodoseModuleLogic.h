@@ -57,9 +57,19 @@ public:
   /// Set number of isodose levels
   void SetNumberOfIsodoseLevels(vtkMRMLIsodoseNode* parameterNode, int newNumberOfColors);
 
-  /// Accumulates dose volumes with the given IDs and corresponding weights
+  /// Create isodose surface models for the levels of the isodose color table.
+  /// Surfaces are cached per dose volume and level. Only the levels whose surface is not cached are contoured,
+  /// i.e. new levels, or all levels if the dose volume or its geometry changed. If the dose volume was only
+  /// multiplied by a constant since the surfaces were contoured, then the cached surfaces are reused with
+  /// remapped isovalues.
   void CreateIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode);
 
+  /// Remove all cached isodose surfaces
+  void ClearIsodoseSurfaceCache();
+
+  /// Number of isodose levels that were contoured (not taken from the cache) in the last \sa CreateIsodoseSurfaces call
+  vtkGetMacro(LastNumberOfContouredIsodoseLevels, int);
+
   /// Get dose volume node
   vtkMRMLModelHierarchyNode* GetRootModelHierarchyNode(vtkMRMLIsodoseNode* parameterNode);
 
@@ -93,9 +103,15 @@ protected:
   vtkSlicerIsodoseModuleLogic();
   virtual ~vtkSlicerIsodoseModuleLogic();
 
+  int LastNumberOfContouredIsodoseLevels;
+
 private:
   vtkSlicerIsodoseModuleLogic(const vtkSlicerIsodoseModuleLogic&); // Not implemented
   void operator=(const vtkSlicerIsodoseModuleLogic&);               // Not implemented
+
+private:
+  class vtkInternal;
+  vtkInternal* Internal;
 };
 
 #endif
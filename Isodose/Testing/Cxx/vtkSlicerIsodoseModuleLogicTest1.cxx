@@ -35,7 +35,9 @@
 #include <vtkMRMLScene.h>
 
 // VTK includes
+#include <vtkDataArray.h>
 #include <vtkDoubleArray.h>
+#include <vtkPointData.h>
 #include <vtkPolyDataReader.h>
 #include <vtkPolyData.h>
 #include <vtkNew.h>
@@ -229,5 +231,45 @@ int vtkSlicerIsodoseModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // Unchanged dose and levels: surfaces are taken from the cache
+  isodoseLogic->CreateIsodoseSurfaces(paramNode);
+  if (isodoseLogic->GetLastNumberOfContouredIsodoseLevels() != 0)
+  {
+    std::cerr << "ERROR: Isodose surfaces were contoured again for unchanged dose" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Dose and level multiplied by the same factor: cached surface is reused with remapped isovalue
+  vtkDataArray* doseScalars = doseScalarVolumeNode->GetImageData()->GetPointData()->GetScalars();
+  for (vtkIdType i=0; i<doseScalars->GetNumberOfTuples(); ++i)
+  {
+    doseScalars->SetComponent(i, 0, 2.0 * doseScalars->GetComponent(i, 0));
+  }
+  doseScalars->Modified();
+  doseScalarVolumeNode->GetImageData()->Modified();
+  double isoLevel = vtkVariant(isodoseColorNode->GetColorName(0)).ToDouble();
+  isodoseColorNode->SetColorName(0, vtkVariant(2.0 * isoLevel).ToString().c_str());
+  isodoseLogic->CreateIsodoseSurfaces(paramNode);
+  if (isodoseLogic->GetLastNumberOfContouredIsodoseLevels() != 0)
+  {
+    std::cerr << "ERROR: Isodose surfaces were contoured again for rescaled dose" << std::endl;
+    return EXIT_FAILURE;
+  }
+  modelHierarchyRootNode = isodoseLogic->GetRootModelHierarchyNode(paramNode);
+  childrenNodes = modelHierarchyRootNode->GetChildrenNodes();
+  modelNode = (childrenNodes.empty() ? NULL : vtkMRMLModelNode::SafeDownCast(childrenNodes[0]->GetAssociatedNode()));
+  if (modelNode == NULL)
+  {
+    std::cerr << "No model node in output model hierarchy node after rescaling!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  propertiesCurrent->SetInputData(modelNode->GetPolyData());
+  propertiesCurrent->Update();
+  if (fabs(propertiesBaseline->GetVolume() - propertiesCurrent->GetVolume()) > volumeDifferenceToleranceCc)
+  {
+    std::cerr << "Volume difference Tolerance(Cc) exceeds threshold after rescaling!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
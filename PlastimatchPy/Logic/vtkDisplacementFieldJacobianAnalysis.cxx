@@ -0,0 +1,397 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// PlastimatchPy includes
+#include "vtkDisplacementFieldJacobianAnalysis.h"
+
+// SlicerRT includes
+#include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtPerformanceMonitor.h"
+
+// VTK includes
+#include <vtkIdTypeArray.h>
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPThreadLocal.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Jacobian determinant statistics accumulated separately by each thread
+  struct JacobianStatistics
+  {
+    JacobianStatistics()
+      : Minimum(std::numeric_limits<double>::max())
+      , Maximum(-std::numeric_limits<double>::max())
+      , Sum(0.0)
+      , NumberOfFoldingVoxels(0)
+    {
+    }
+    double Minimum;
+    double Maximum;
+    double Sum;
+    vtkIdType NumberOfFoldingVoxels;
+    std::vector<vtkIdType> Histogram;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Computes the Jacobian determinant on a range of slices of the displacement field
+  template <class T>
+  class JacobianFunctor
+  {
+  public:
+    JacobianFunctor()
+      : Field(NULL)
+      , HistogramMinimum(0.0)
+      , InverseBinWidth(1.0)
+      , NumberOfHistogramBins(1)
+      , DeterminantScalars(NULL)
+    {
+    }
+
+    void Initialize()
+    {
+      JacobianStatistics& statistics = this->Statistics.Local();
+      statistics = JacobianStatistics();
+      statistics.Histogram.assign(this->NumberOfHistogramBins, 0);
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      JacobianStatistics& statistics = this->Statistics.Local();
+      const vtkIdType rowSize = this->Dimensions[0];
+      const vtkIdType sliceSize = rowSize * this->Dimensions[1];
+      double derivative[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+      double jacobian[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+
+      for (vtkIdType k=beginSlice; k<endSlice; ++k)
+      {
+        // Neighbors are clamped at the boundary, as with a zero flux Neumann boundary condition
+        const vtkIdType previousSlice = std::max<vtkIdType>(k-1, 0) * sliceSize;
+        const vtkIdType nextSlice = std::min<vtkIdType>(k+1, this->Dimensions[2]-1) * sliceSize;
+        for (vtkIdType j=0; j<this->Dimensions[1]; ++j)
+        {
+          const vtkIdType previousRow = std::max<vtkIdType>(j-1, 0) * rowSize;
+          const vtkIdType nextRow = std::min<vtkIdType>(j+1, this->Dimensions[1]-1) * rowSize;
+          const vtkIdType rowOffset = k * sliceSize + j * rowSize;
+          for (vtkIdType i=0; i<this->Dimensions[0]; ++i)
+          {
+            const vtkIdType previousColumn = std::max<vtkIdType>(i-1, 0);
+            const vtkIdType nextColumn = std::min<vtkIdType>(i+1, this->Dimensions[0]-1);
+            const T* neighbors[3][2] =
+            {
+              { this->Field + 3 * (rowOffset + previousColumn), this->Field + 3 * (rowOffset + nextColumn) },
+              { this->Field + 3 * (k * sliceSize + previousRow + i), this->Field + 3 * (k * sliceSize + nextRow + i) },
+              { this->Field + 3 * (previousSlice + j * rowSize + i), this->Field + 3 * (nextSlice + j * rowSize + i) }
+            };
+
+            // Central differences of the displacement components along the grid axes
+            for (int component=0; component<3; ++component)
+            {
+              for (int axis=0; axis<3; ++axis)
+              {
+                derivative[component][axis] = 0.5 * (static_cast<double>(neighbors[axis][1][component])
+                  - static_cast<double>(neighbors[axis][0][component]));
+              }
+            }
+
+            // Jacobian of the transform in physical space: I + du/dijk * dijk/dx
+            for (int row=0; row<3; ++row)
+            {
+              for (int column=0; column<3; ++column)
+              {
+                jacobian[row][column] = (row == column ? 1.0 : 0.0)
+                  + derivative[row][0] * this->PhysicalToIndex[0][column]
+                  + derivative[row][1] * this->PhysicalToIndex[1][column]
+                  + derivative[row][2] * this->PhysicalToIndex[2][column];
+              }
+            }
+            const double determinant = vtkMath::Determinant3x3(jacobian);
+
+            statistics.Minimum = std::min(statistics.Minimum, determinant);
+            statistics.Maximum = std::max(statistics.Maximum, determinant);
+            statistics.Sum += determinant;
+            if (determinant <= 0.0)
+            {
+              ++statistics.NumberOfFoldingVoxels;
+            }
+            int binIndex = static_cast<int>(floor((determinant - this->HistogramMinimum) * this->InverseBinWidth));
+            binIndex = std::min(std::max(binIndex, 0), this->NumberOfHistogramBins - 1);
+            ++statistics.Histogram[binIndex];
+
+            if (this->DeterminantScalars)
+            {
+              this->DeterminantScalars[rowOffset + i] = static_cast<float>(determinant);
+            }
+          }
+        }
+      }
+    }
+
+    void Reduce()
+    {
+      this->Total = JacobianStatistics();
+      this->Total.Histogram.assign(this->NumberOfHistogramBins, 0);
+      for (typename vtkSMPThreadLocal<JacobianStatistics>::iterator it = this->Statistics.begin(); it != this->Statistics.end(); ++it)
+      {
+        this->Total.Minimum = std::min(this->Total.Minimum, it->Minimum);
+        this->Total.Maximum = std::max(this->Total.Maximum, it->Maximum);
+        this->Total.Sum += it->Sum;
+        this->Total.NumberOfFoldingVoxels += it->NumberOfFoldingVoxels;
+        for (size_t binIndex=0; binIndex<it->Histogram.size(); ++binIndex)
+        {
+          this->Total.Histogram[binIndex] += it->Histogram[binIndex];
+        }
+      }
+    }
+
+    const T* Field;
+    int Dimensions[3];
+    double PhysicalToIndex[3][3];
+    double HistogramMinimum;
+    double InverseBinWidth;
+    int NumberOfHistogramBins;
+    float* DeterminantScalars;
+
+    vtkSMPThreadLocal<JacobianStatistics> Statistics;
+    JacobianStatistics Total;
+  };
+
+  //----------------------------------------------------------------------------
+  /// Parameters of the Jacobian computation that do not depend on the scalar type
+  struct JacobianParameters
+  {
+    int Dimensions[3];
+    double PhysicalToIndex[3][3];
+    double HistogramMinimum;
+    double InverseBinWidth;
+    int NumberOfHistogramBins;
+    float* DeterminantScalars;
+    int NumberOfThreads;
+  };
+
+  //----------------------------------------------------------------------------
+  template <class T>
+  void ComputeJacobianStatistics(const T* field, const JacobianParameters& parameters, JacobianStatistics& total)
+  {
+    JacobianFunctor<T> functor;
+    functor.Field = field;
+    for (int row=0; row<3; ++row)
+    {
+      functor.Dimensions[row] = parameters.Dimensions[row];
+      for (int column=0; column<3; ++column)
+      {
+        functor.PhysicalToIndex[row][column] = parameters.PhysicalToIndex[row][column];
+      }
+    }
+    functor.HistogramMinimum = parameters.HistogramMinimum;
+    functor.InverseBinWidth = parameters.InverseBinWidth;
+    functor.NumberOfHistogramBins = parameters.NumberOfHistogramBins;
+    functor.DeterminantScalars = parameters.DeterminantScalars;
+
+    vtkSlicerRtCommon::SMPFor(0, parameters.Dimensions[2], 1, functor, parameters.NumberOfThreads);
+    total = functor.Total;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkDisplacementFieldJacobianAnalysis);
+
+vtkCxxSetObjectMacro(vtkDisplacementFieldJacobianAnalysis, DisplacementField, vtkImageData);
+
+//----------------------------------------------------------------------------
+vtkDisplacementFieldJacobianAnalysis::vtkDisplacementFieldJacobianAnalysis()
+{
+  this->DisplacementField = NULL;
+  this->IJKToRASMatrix = NULL;
+  this->ComputeDeterminantImage = false;
+  this->HistogramRange[0] = 0.0;
+  this->HistogramRange[1] = 2.0;
+  this->NumberOfHistogramBins = 100;
+  this->NumberOfThreads = 0;
+
+  this->Minimum = 0.0;
+  this->Maximum = 0.0;
+  this->Mean = 0.0;
+  this->NumberOfFoldingVoxels = 0;
+  this->Histogram = vtkIdTypeArray::New();
+  this->DeterminantImage = vtkImageData::New();
+}
+
+//----------------------------------------------------------------------------
+vtkDisplacementFieldJacobianAnalysis::~vtkDisplacementFieldJacobianAnalysis()
+{
+  this->SetDisplacementField(NULL);
+  if (this->IJKToRASMatrix)
+  {
+    this->IJKToRASMatrix->Delete();
+    this->IJKToRASMatrix = NULL;
+  }
+  this->Histogram->Delete();
+  this->DeterminantImage->Delete();
+}
+
+//----------------------------------------------------------------------------
+void vtkDisplacementFieldJacobianAnalysis::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "ComputeDeterminantImage: " << (this->ComputeDeterminantImage ? "true" : "false") << "\n";
+  os << indent << "HistogramRange: " << this->HistogramRange[0] << ", " << this->HistogramRange[1] << "\n";
+  os << indent << "NumberOfHistogramBins: " << this->NumberOfHistogramBins << "\n";
+  os << indent << "NumberOfThreads: " << this->NumberOfThreads << "\n";
+  os << indent << "Minimum: " << this->Minimum << "\n";
+  os << indent << "Maximum: " << this->Maximum << "\n";
+  os << indent << "Mean: " << this->Mean << "\n";
+  os << indent << "NumberOfFoldingVoxels: " << this->NumberOfFoldingVoxels << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkDisplacementFieldJacobianAnalysis::SetIJKToRASMatrix(vtkMatrix4x4* ijkToRasMatrix)
+{
+  if (!ijkToRasMatrix)
+  {
+    if (this->IJKToRASMatrix)
+    {
+      this->IJKToRASMatrix->Delete();
+      this->IJKToRASMatrix = NULL;
+      this->Modified();
+    }
+    return;
+  }
+  if (!this->IJKToRASMatrix)
+  {
+    this->IJKToRASMatrix = vtkMatrix4x4::New();
+  }
+  this->IJKToRASMatrix->DeepCopy(ijkToRasMatrix);
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkDisplacementFieldJacobianAnalysis::Update()
+{
+  this->Minimum = 0.0;
+  this->Maximum = 0.0;
+  this->Mean = 0.0;
+  this->NumberOfFoldingVoxels = 0;
+  this->Histogram->Initialize();
+  this->DeterminantImage->Initialize();
+
+  if (!this->DisplacementField || !this->DisplacementField->GetScalarPointer())
+  {
+    vtkErrorMacro("Update: Invalid displacement field");
+    return false;
+  }
+  if (this->DisplacementField->GetNumberOfScalarComponents() != 3)
+  {
+    vtkErrorMacro("Update: Displacement field needs to have three components, but it has "
+      << this->DisplacementField->GetNumberOfScalarComponents());
+    return false;
+  }
+  if (this->NumberOfHistogramBins < 1 || this->HistogramRange[1] <= this->HistogramRange[0])
+  {
+    vtkErrorMacro("Update: Invalid histogram range or number of bins");
+    return false;
+  }
+
+  JacobianParameters parameters;
+  this->DisplacementField->GetDimensions(parameters.Dimensions);
+  vtkIdType numberOfVoxels = static_cast<vtkIdType>(parameters.Dimensions[0]) * parameters.Dimensions[1] * parameters.Dimensions[2];
+  if (numberOfVoxels == 0)
+  {
+    vtkErrorMacro("Update: Empty displacement field");
+    return false;
+  }
+
+  vtkSlicerRtScopedTimer timer("PlastimatchPy.Jacobian");
+
+  // Derivatives along the grid axes are converted to physical space with the inverse of the index to physical matrix
+  double indexToPhysical[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+  if (this->IJKToRASMatrix)
+  {
+    for (int row=0; row<3; ++row)
+    {
+      for (int column=0; column<3; ++column)
+      {
+        indexToPhysical[row][column] = this->IJKToRASMatrix->GetElement(row, column);
+      }
+    }
+  }
+  else
+  {
+    double spacing[3] = {1.0, 1.0, 1.0};
+    this->DisplacementField->GetSpacing(spacing);
+    for (int axis=0; axis<3; ++axis)
+    {
+      indexToPhysical[axis][axis] = spacing[axis];
+    }
+  }
+  if (fabs(vtkMath::Determinant3x3(indexToPhysical)) < 1e-12)
+  {
+    vtkErrorMacro("Update: Displacement field grid geometry is degenerate");
+    return false;
+  }
+  vtkMath::Invert3x3(indexToPhysical, parameters.PhysicalToIndex);
+
+  parameters.HistogramMinimum = this->HistogramRange[0];
+  parameters.InverseBinWidth = this->NumberOfHistogramBins / (this->HistogramRange[1] - this->HistogramRange[0]);
+  parameters.NumberOfHistogramBins = this->NumberOfHistogramBins;
+  parameters.NumberOfThreads = this->NumberOfThreads;
+  parameters.DeterminantScalars = NULL;
+  if (this->ComputeDeterminantImage)
+  {
+    this->DeterminantImage->SetOrigin(this->DisplacementField->GetOrigin());
+    this->DeterminantImage->SetSpacing(this->DisplacementField->GetSpacing());
+    this->DeterminantImage->SetExtent(this->DisplacementField->GetExtent());
+    this->DeterminantImage->AllocateScalars(VTK_FLOAT, 1);
+    parameters.DeterminantScalars = static_cast<float*>(this->DeterminantImage->GetScalarPointer());
+  }
+
+  JacobianStatistics total;
+  void* fieldScalars = this->DisplacementField->GetScalarPointer();
+  switch (this->DisplacementField->GetScalarType())
+  {
+    vtkTemplateMacro(ComputeJacobianStatistics<VTK_TT>(static_cast<const VTK_TT*>(fieldScalars), parameters, total));
+    default:
+      vtkErrorMacro("Update: Unsupported displacement field scalar type " << this->DisplacementField->GetScalarTypeAsString());
+      return false;
+  }
+
+  this->Minimum = total.Minimum;
+  this->Maximum = total.Maximum;
+  this->Mean = total.Sum / numberOfVoxels;
+  this->NumberOfFoldingVoxels = total.NumberOfFoldingVoxels;
+  this->Histogram->SetNumberOfValues(this->NumberOfHistogramBins);
+  for (int binIndex=0; binIndex<this->NumberOfHistogramBins; ++binIndex)
+  {
+    this->Histogram->SetValue(binIndex, total.Histogram[binIndex]);
+  }
+
+  vtkSlicerRtPerformanceMonitor::AddToCounter("PlastimatchPy.Jacobian", "Voxels", numberOfVoxels);
+  return true;
+}
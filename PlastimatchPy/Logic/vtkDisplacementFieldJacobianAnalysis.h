@@ -0,0 +1,120 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkDisplacementFieldJacobianAnalysis_h
+#define __vtkDisplacementFieldJacobianAnalysis_h
+
+// PlastimatchPy includes
+#include "vtkSlicerPlastimatchPyModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+class vtkIdTypeArray;
+class vtkImageData;
+class vtkMatrix4x4;
+
+/// \ingroup SlicerRt_QtModules_PlastimatchPy
+/// \brief Statistics of the Jacobian determinant of a displacement field
+///
+/// The Jacobian determinant of the transform x + u(x) is computed with central differences at each grid
+/// point (det(I + du/dx)), the same way as itk::DisplacementFieldJacobianDeterminantFilter: the neighbors
+/// are clamped at the boundary of the grid. The derivatives are taken in the physical space defined by the
+/// IJK to RAS matrix of the grid, so the result does not depend on the orientation of the grid.
+///
+/// The slices of the grid are processed in parallel, each thread accumulating the minimum, maximum, sum,
+/// histogram and number of folding grid points (determinant <= 0) of its slices. The displacement field is
+/// read in place, and the determinant image is only allocated if \sa ComputeDeterminantImage is on.
+class VTK_SLICER_PLASTIMATCHPY_MODULE_LOGIC_EXPORT vtkDisplacementFieldJacobianAnalysis : public vtkObject
+{
+public:
+  static vtkDisplacementFieldJacobianAnalysis *New();
+  vtkTypeMacro(vtkDisplacementFieldJacobianAnalysis, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Compute the Jacobian determinant statistics
+  /// \return Success flag
+  virtual bool Update();
+
+  /// Displacement field with three float or double components
+  void SetDisplacementField(vtkImageData* displacementField);
+  vtkGetObjectMacro(DisplacementField, vtkImageData);
+
+  /// Set IJK to RAS matrix of the displacement field grid (including the spacing). It needs to map to the
+  /// coordinate frame the displacement vectors are defined in, i.e. it must not include parent transforms.
+  /// If not set, then the spacing of the displacement field image and no rotation is used
+  void SetIJKToRASMatrix(vtkMatrix4x4* ijkToRasMatrix);
+
+  /// Compute the determinant image (on the grid of the displacement field). Off by default
+  vtkGetMacro(ComputeDeterminantImage, bool);
+  vtkSetMacro(ComputeDeterminantImage, bool);
+  vtkBooleanMacro(ComputeDeterminantImage, bool);
+
+  /// Range of the histogram. Determinants outside the range are counted in the first or last bin
+  vtkGetVector2Macro(HistogramRange, double);
+  vtkSetVector2Macro(HistogramRange, double);
+
+  /// Number of histogram bins
+  vtkGetMacro(NumberOfHistogramBins, int);
+  vtkSetMacro(NumberOfHistogramBins, int);
+
+  /// Number of threads to use. Zero (default) means that the default of the SMP backend is used.
+  /// The setting only applies to this filter and needs VTK 9.1 or later, see \sa vtkSlicerRtCommon::SMPFor
+  vtkGetMacro(NumberOfThreads, int);
+  vtkSetMacro(NumberOfThreads, int);
+
+  /// Minimum Jacobian determinant
+  vtkGetMacro(Minimum, double);
+  /// Maximum Jacobian determinant
+  vtkGetMacro(Maximum, double);
+  /// Mean Jacobian determinant
+  vtkGetMacro(Mean, double);
+  /// Number of grid points where the transform folds (determinant <= 0)
+  vtkGetMacro(NumberOfFoldingVoxels, vtkIdType);
+  /// Number of grid points in each histogram bin
+  vtkGetObjectMacro(Histogram, vtkIdTypeArray);
+  /// Jacobian determinant image (float). Only computed if \sa ComputeDeterminantImage is on
+  vtkGetObjectMacro(DeterminantImage, vtkImageData);
+
+protected:
+  vtkImageData* DisplacementField;
+  vtkMatrix4x4* IJKToRASMatrix;
+  bool ComputeDeterminantImage;
+  double HistogramRange[2];
+  int NumberOfHistogramBins;
+  int NumberOfThreads;
+
+  double Minimum;
+  double Maximum;
+  double Mean;
+  vtkIdType NumberOfFoldingVoxels;
+  vtkIdTypeArray* Histogram;
+  vtkImageData* DeterminantImage;
+
+protected:
+  vtkDisplacementFieldJacobianAnalysis();
+  virtual ~vtkDisplacementFieldJacobianAnalysis();
+
+private:
+  vtkDisplacementFieldJacobianAnalysis(const vtkDisplacementFieldJacobianAnalysis&); // Not implemented
+  void operator=(const vtkDisplacementFieldJacobianAnalysis&);                     // Not implemented
+};
+
+#endif
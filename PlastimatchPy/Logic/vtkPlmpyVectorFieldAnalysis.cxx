@@ -20,14 +20,14 @@
 
 // PlastimatchPy Logic includes
 #include "vtkPlmpyVectorFieldAnalysis.h"
+#include "vtkDisplacementFieldJacobianAnalysis.h"
 
 // VTK includes
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkImageData.h>
-#include <vtkImageExport.h>
+#include <vtkMatrix4x4.h>
 #include <vtkSmartPointer.h>
-#include <vtkTransform.h>
 
 // Slicer includes
 #include "vtkMRMLVectorVolumeNode.h"
@@ -43,9 +43,6 @@
 #include "plm_image_header.h"
 #include "volume.h"
 
-#include "vf_jacobian.h"
-#include "itk_image_load.h"
-#include "itk_image_type.h"
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkPlmpyVectorFieldAnalysis);
@@ -69,10 +66,13 @@ vtkPlmpyVectorFieldAnalysis::vtkPlmpyVectorFieldAnalysis()
 
   this->MovingImageToFixedImageVectorField = NULL;
 
+  this->VFImageID = NULL;
+  this->JacobianAnalysis = vtkDisplacementFieldJacobianAnalysis::New();
 }
 
 vtkPlmpyVectorFieldAnalysis::~vtkPlmpyVectorFieldAnalysis()
 {
+  this->JacobianAnalysis->Delete();
 }
 
 //----------------------------------------------------------------------------
@@ -92,135 +92,60 @@ void vtkPlmpyVectorFieldAnalysis::SetMRMLSceneInternal(vtkMRMLScene * newScene)
 //---------------------------------------------------------------------------
 void vtkPlmpyVectorFieldAnalysis::RunJacobian()
 {
-  //TODO: Use VTK info/warning/error macro instead of cout
-  cout << "started RunJacobian from C++ module\n";
-  if ( this->VFImageID == NULL )
+  if (!this->GetMRMLScene() || !this->VFImageID)
   {
-    cout << "ERRROR: NULL input VF";
-  } 
-
-  // vtk to itk transform derived from vtkSlicerRtCommon.txx
-  vtkMRMLVectorVolumeNode* VFImage = vtkMRMLVectorVolumeNode::SafeDownCast(this->GetMRMLScene()->GetNodeByID(this->VFImageID));
-
-  DeformationFieldType::Pointer vol = itk::Image<itk::Vector<float,3> ,3>::New();
-
-  vtkImageData* inVolume = VFImage->GetImageData();
-  if ( inVolume == NULL )
-  {
-    vtkErrorWithObjectMacro(VFImage, "ConvertVolumeNodeToItkImage: Failed to convert volume node to itk image - image in input MRML volume node is NULL!");
+    vtkErrorMacro("RunJacobian: Invalid scene or vector field ID");
     return;
   }
-
-  cout << "got image data";
-
-  vtkSmartPointer<vtkImageExport> imageExport = vtkSmartPointer<vtkImageExport>::New();
-  imageExport->SetInputData(inVolume);
-
-  cout << "gone past set input";
-
-  imageExport->Update();
-
-  cout << "gone past Update";
-
-  //--
-  vtkSmartPointer<vtkMatrix4x4> rasToWorldTransformMatrix=vtkSmartPointer<vtkMatrix4x4>::New();
-  vtkMRMLTransformNode* inTransformNode=VFImage->GetParentTransformNode();
-  if (inTransformNode!=NULL)
+  vtkMRMLVectorVolumeNode* vectorFieldNode = vtkMRMLVectorVolumeNode::SafeDownCast(this->GetMRMLScene()->GetNodeByID(this->VFImageID));
+  if (!vectorFieldNode || !vectorFieldNode->GetImageData())
   {
-    if (inTransformNode->IsTransformToWorldLinear() == 0)
-    {
-      vtkErrorWithObjectMacro(VFImage, "ConvertVolumeNodeToItkImage: There is a non-linear transform assigned to an input dose volume. Only linear transforms are supported!");
-      return;
-    }
-    inTransformNode->GetMatrixTransformToWorld(rasToWorldTransformMatrix);
+    vtkErrorMacro("RunJacobian: Failed to get vector field image from node " << this->VFImageID);
+    return;
   }
 
-  vtkSmartPointer<vtkMatrix4x4> inVolumeToRasTransformMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  VFImage->GetIJKToRASMatrix(inVolumeToRasTransformMatrix);
-
-  vtkSmartPointer<vtkTransform> inVolumeToWorldTransform = vtkSmartPointer<vtkTransform>::New();
-  inVolumeToWorldTransform->Identity();
-  inVolumeToWorldTransform->PostMultiply();
-  inVolumeToWorldTransform->Concatenate(inVolumeToRasTransformMatrix);
-  inVolumeToWorldTransform->Concatenate(rasToWorldTransformMatrix);
-
-  // Set ITK image properties
-  double outputSpacing[3] = {0.0, 0.0, 0.0};
-  inVolumeToWorldTransform->GetScale(outputSpacing);
-  vol->SetSpacing(outputSpacing);
-
-  double outputOrigin[3] = {0.0, 0.0, 0.0};
-  inVolumeToWorldTransform->GetPosition(outputOrigin);
-  vol->SetOrigin(outputOrigin);
-
-  double outputOrienationAngles[3] = {0.0, 0.0, 0.0};
-  inVolumeToWorldTransform->GetOrientation(outputOrienationAngles);
-  vtkSmartPointer<vtkTransform> inVolumeToWorldOrientationTransform = vtkSmartPointer<vtkTransform>::New();
-  inVolumeToWorldOrientationTransform->Identity();
-  inVolumeToWorldOrientationTransform->RotateX(outputOrienationAngles[0]);
-  inVolumeToWorldOrientationTransform->RotateY(outputOrienationAngles[1]);
-  inVolumeToWorldOrientationTransform->RotateZ(outputOrienationAngles[2]);
-  vtkSmartPointer<vtkMatrix4x4> inVolumeToWorldOrientationTransformMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  inVolumeToWorldOrientationTransform->GetMatrix(inVolumeToWorldOrientationTransformMatrix);
-  itk::Matrix<double,3,3> outputDirectionMatrix;
-  for(int i=0; i<3; i++)
+  // The displacement vectors are defined in the coordinate frame of the vector field node, so the derivatives
+  // are taken in that frame too. Parent transforms are not applied, as they would not rotate the vectors
+  vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vectorFieldNode->GetIJKToRASMatrix(ijkToRasMatrix);
+
+  // The Jacobian image is only computed if an output volume is requested
+  vtkMRMLScalarVolumeNode* outputVolumeNode = NULL;
+  if (this->OutputVolumeID)
   {
-    for(int j=0; j<3; j++)
-    {
-      outputDirectionMatrix[i][j] = inVolumeToWorldOrientationTransformMatrix->GetElement(i,j);
-    }
+    outputVolumeNode = vtkMRMLScalarVolumeNode::SafeDownCast(this->GetMRMLScene()->GetNodeByID(this->OutputVolumeID));
   }
-  vol->SetDirection(outputDirectionMatrix);
 
-  //---
-  
-  int inputExtent[6]={0,0,0,0,0,0};
-  inVolume->GetExtent(inputExtent);
-  itk::Image<float, 3>::SizeType inputSize;
-  inputSize[0] = inputExtent[1] - inputExtent[0] + 1;
-  inputSize[1] = inputExtent[3] - inputExtent[2] + 1;
-  inputSize[2] = inputExtent[5] - inputExtent[4] + 1;
-
-  itk::Image<float, 3>::IndexType start;
-  start[0]=start[1]=start[2]=0.0;
-
-  itk::Image<float, 3>::RegionType region;
-  region.SetSize(inputSize);
-  region.SetIndex(start);   
-  vol->SetRegions(region);
-  
-  try
-  {  
-    vol->Allocate();
-  }
-  catch(itk::ExceptionObject & err)
+  this->JacobianAnalysis->SetDisplacementField(vectorFieldNode->GetImageData());
+  this->JacobianAnalysis->SetIJKToRASMatrix(ijkToRasMatrix);
+  this->JacobianAnalysis->SetComputeDeterminantImage(outputVolumeNode != NULL);
+  if (!this->JacobianAnalysis->Update())
   {
-    vtkErrorWithObjectMacro(VFImage, "ConvertVolumeNodeToItkImage: Failed to allocate memory for the image conversion: " << err.GetDescription())
+    vtkErrorMacro("RunJacobian: Failed to compute Jacobian of vector field " << this->VFImageID);
     return;
   }
+  this->JacobianAnalysis->SetDisplacementField(NULL);
 
-  imageExport->Export( vol->GetBufferPointer() );
-  
-  // modeled after pcmd_jacobian
-  FloatImageType::Pointer jacimage;
-
-  std::cout << "...loaded xf!" << std::endl;
-
-  /* Make jacobian */
-  Jacobian jacobian;
-  jacobian.set_input_vf (vol);    
-  jacimage=jacobian.make_jacobian();
-
-  printf("min/max jacobian values to output: %lf %lf\n", jacobian.jacobian_min, jacobian.jacobian_max); 
+  this->jacobian_min = this->JacobianAnalysis->GetMinimum();
+  this->jacobian_max = this->JacobianAnalysis->GetMaximum();
+  vtkDebugMacro("RunJacobian: Jacobian range: " << this->jacobian_min << " - " << this->jacobian_max
+    << ", mean: " << this->JacobianAnalysis->GetMean() << ", folding voxels: " << this->JacobianAnalysis->GetNumberOfFoldingVoxels());
 
   // The Python code can only access strings via GetJacobianMainString(), GetJacobianMaxString() macros
-  sprintf(this->JacobianMinString, "%f", jacobian.jacobian_min);
-  sprintf(this->JacobianMaxString, "%f", jacobian.jacobian_max);
+  sprintf(this->JacobianMinString, "%f", this->jacobian_min);
+  sprintf(this->JacobianMaxString, "%f", this->jacobian_max);
 
-  Plm_image::Pointer jacobianImage = Plm_image::New();
-  jacobianImage->set_itk(jacimage);
-  jacobianImage->convert_to_itk();
-  this->SetImageIntoVolumeNode(jacobianImage); // this also needs FixedImageID set to add geometry
+  // The determinant image is on the grid of the vector field, under the same parent transform
+  if (outputVolumeNode)
+  {
+    vtkSmartPointer<vtkImageData> jacobianImage = vtkSmartPointer<vtkImageData>::New();
+    jacobianImage->ShallowCopy(this->JacobianAnalysis->GetDeterminantImage());
+    jacobianImage->SetOrigin(0.0, 0.0, 0.0);
+    jacobianImage->SetSpacing(1.0, 1.0, 1.0);
+    outputVolumeNode->CopyOrientation(vectorFieldNode);
+    outputVolumeNode->SetAndObserveTransformNodeID(vectorFieldNode->GetTransformNodeID());
+    outputVolumeNode->SetAndObserveImageData(jacobianImage);
+  }
 }
 
 //---------------------------------------------------------------------------
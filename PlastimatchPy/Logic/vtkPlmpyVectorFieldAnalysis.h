@@ -44,6 +44,8 @@
 #include "registration_parms.h"
 #include "vf_jacobian.h"
 
+class vtkDisplacementFieldJacobianAnalysis;
+
 /// Class to wrap Plastimatch registration capability into the embedded Python shell in Slicer
 class VTK_SLICER_PLASTIMATCHPY_MODULE_LOGIC_EXPORT vtkPlmpyVectorFieldAnalysis :
   public vtkSlicerModuleLogic
@@ -57,7 +59,10 @@ public:
   vtkTypeMacro(vtkPlmpyVectorFieldAnalysis, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
 
-  /// Compute Jacobian
+  /// Compute Jacobian determinant statistics of the vector field (\sa VFImageID).
+  /// The derivatives are taken in the coordinate frame of the vector field node, as the displacements are defined there.
+  /// The Jacobian determinant image is only computed if the output volume (\sa OutputVolumeID) is set, and it is
+  /// placed under the parent transform of the vector field
   void RunJacobian();
 
   void SetImageIntoVolumeNode(Plm_image::Pointer& plastimatchImage);
@@ -83,6 +88,9 @@ public:
   /// Get the ID of the vector field
   vtkGetStringMacro(VFImageID);
 
+  /// Get Jacobian analysis (mean, number of folding voxels, histogram). Its parameters can be set before \sa RunJacobian
+  vtkGetObjectMacro(JacobianAnalysis, vtkDisplacementFieldJacobianAnalysis);
+
 protected:
   vtkPlmpyVectorFieldAnalysis();
   virtual ~vtkPlmpyVectorFieldAnalysis();
@@ -108,6 +116,8 @@ protected:
   char* JacobianMaxString;
   /// ID of the vector field image to calculate the Jacobian of
   char* VFImageID;
+  /// Jacobian determinant computation
+  vtkDisplacementFieldJacobianAnalysis* JacobianAnalysis;
 
 private:
   vtkPlmpyVectorFieldAnalysis(const vtkPlmpyVectorFieldAnalysis&); // Not implemented
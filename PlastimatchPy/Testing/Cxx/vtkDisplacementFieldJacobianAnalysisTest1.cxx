@@ -0,0 +1,217 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+
+// PlastimatchPy includes
+#include "vtkDisplacementFieldJacobianAnalysis.h"
+
+// VTK includes
+#include <vtkIdTypeArray.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+  // Grid of 6x5x4 points. With clamped central differences the derivative along a grid axis is exact
+  // for linear fields inside the grid, and half of it on the first and last points along the axis
+  const int DIMENSIONS[3] = { 6, 5, 4 };
+  const vtkIdType NUMBER_OF_VOXELS = 6 * 5 * 4;
+
+  //----------------------------------------------------------------------------
+  /// Fill the field with u(x) = diag(gradient) * x, where x is the position of the grid point in RAS
+  void CreateLinearField(vtkImageData* field, int scalarType, vtkMatrix4x4* ijkToRasMatrix, const double gradient[3])
+  {
+    field->SetDimensions(DIMENSIONS[0], DIMENSIONS[1], DIMENSIONS[2]);
+    field->AllocateScalars(scalarType, 3);
+    for (int k=0; k<DIMENSIONS[2]; ++k)
+    {
+      for (int j=0; j<DIMENSIONS[1]; ++j)
+      {
+        for (int i=0; i<DIMENSIONS[0]; ++i)
+        {
+          double ijk[4] = { static_cast<double>(i), static_cast<double>(j), static_cast<double>(k), 1.0 };
+          double ras[4] = { 0.0, 0.0, 0.0, 1.0 };
+          ijkToRasMatrix->MultiplyPoint(ijk, ras);
+          for (int component=0; component<3; ++component)
+          {
+            field->SetScalarComponentFromDouble(i, j, k, component, gradient[component] * ras[component]);
+          }
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Mean of the derivative factor (1 + a*d) along a grid axis, where d is 1 inside and 1/2 on the boundary
+  double GetMeanFactor(double gradient, int dimension)
+  {
+    return 1.0 + gradient * (dimension - 1) / dimension;
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsEqualWithTolerance(const char* name, double actual, double expected, double tolerance)
+  {
+    if (std::fabs(actual - expected) > tolerance)
+    {
+      std::cerr << "ERROR: " << name << " mismatch: " << actual << " (expected " << expected << " +/- " << tolerance << ")" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool CheckHistogramTotal(vtkDisplacementFieldJacobianAnalysis* analysis)
+  {
+    vtkIdType total = 0;
+    for (vtkIdType binIndex=0; binIndex<analysis->GetHistogram()->GetNumberOfValues(); ++binIndex)
+    {
+      total += analysis->GetHistogram()->GetValue(binIndex);
+    }
+    if (total != NUMBER_OF_VOXELS)
+    {
+      std::cerr << "ERROR: Histogram contains " << total << " grid points (expected " << NUMBER_OF_VOXELS << ")" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Uniform expansion u = a*x: det J = (1+a)^3 inside the grid, (1+a/2)^3 in the corners
+  bool TestUniformExpansion(vtkMatrix4x4* ijkToRasMatrix, int scalarType, int numberOfThreads)
+  {
+    const double a = 0.2;
+    const double gradient[3] = { a, a, a };
+    vtkNew<vtkImageData> field;
+    CreateLinearField(field.GetPointer(), scalarType, ijkToRasMatrix, gradient);
+
+    vtkNew<vtkDisplacementFieldJacobianAnalysis> analysis;
+    analysis->SetDisplacementField(field.GetPointer());
+    analysis->SetIJKToRASMatrix(ijkToRasMatrix);
+    analysis->ComputeDeterminantImageOn();
+    analysis->SetNumberOfThreads(numberOfThreads);
+    if (!analysis->Update())
+    {
+      std::cerr << "ERROR: Failed to compute Jacobian of uniform expansion" << std::endl;
+      return false;
+    }
+
+    const double expectedInsideDeterminant = (1.0 + a) * (1.0 + a) * (1.0 + a);
+    const double expectedMean = GetMeanFactor(a, DIMENSIONS[0]) * GetMeanFactor(a, DIMENSIONS[1]) * GetMeanFactor(a, DIMENSIONS[2]);
+    if ( !IsEqualWithTolerance("Uniform expansion maximum", analysis->GetMaximum(), expectedInsideDeterminant, 1e-5)
+      || !IsEqualWithTolerance("Uniform expansion minimum", analysis->GetMinimum(), (1.0 + a/2.0) * (1.0 + a/2.0) * (1.0 + a/2.0), 1e-5)
+      || !IsEqualWithTolerance("Uniform expansion mean", analysis->GetMean(), expectedMean, 1e-5)
+      || !CheckHistogramTotal(analysis.GetPointer()) )
+    {
+      return false;
+    }
+    if (analysis->GetNumberOfFoldingVoxels() != 0)
+    {
+      std::cerr << "ERROR: Uniform expansion has " << analysis->GetNumberOfFoldingVoxels() << " folding voxels (expected 0)" << std::endl;
+      return false;
+    }
+
+    vtkImageData* determinantImage = analysis->GetDeterminantImage();
+    for (int k=1; k<DIMENSIONS[2]-1; ++k)
+    {
+      for (int j=1; j<DIMENSIONS[1]-1; ++j)
+      {
+        for (int i=1; i<DIMENSIONS[0]-1; ++i)
+        {
+          if (!IsEqualWithTolerance("Uniform expansion determinant", determinantImage->GetScalarComponentAsDouble(i, j, k, 0), expectedInsideDeterminant, 1e-5))
+          {
+            std::cerr << "  at grid point (" << i << ", " << j << ", " << k << ")" << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkDisplacementFieldJacobianAnalysisTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // Axis aligned grid with anisotropic spacing
+  vtkNew<vtkMatrix4x4> axisAlignedIjkToRasMatrix;
+  axisAlignedIjkToRasMatrix->SetElement(0, 0, 2.0);
+  axisAlignedIjkToRasMatrix->SetElement(1, 1, 1.5);
+  axisAlignedIjkToRasMatrix->SetElement(2, 2, 3.0);
+  axisAlignedIjkToRasMatrix->SetElement(0, 3, -5.0);
+  axisAlignedIjkToRasMatrix->SetElement(1, 3, 3.0);
+  axisAlignedIjkToRasMatrix->SetElement(2, 3, 10.0);
+
+  // Same grid rotated. The field is isotropic, so the determinants do not change
+  vtkNew<vtkTransform> rotation;
+  rotation->RotateWXYZ(35.0, 1.0, 2.0, 3.0);
+  vtkNew<vtkMatrix4x4> rotatedIjkToRasMatrix;
+  vtkMatrix4x4::Multiply4x4(rotation->GetMatrix(), axisAlignedIjkToRasMatrix.GetPointer(), rotatedIjkToRasMatrix.GetPointer());
+
+  if ( !TestUniformExpansion(axisAlignedIjkToRasMatrix.GetPointer(), VTK_FLOAT, 0)
+    || !TestUniformExpansion(rotatedIjkToRasMatrix.GetPointer(), VTK_DOUBLE, 2) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Folding along the first axis: u = (b*x, 0, 0) with b = -1.5 gives det J = 1+b = -0.5 inside the grid,
+  // and 1+b/2 = 0.25 on the first and last points along the axis, so the two boundary faces do not fold
+  const double b = -1.5;
+  const double foldingGradient[3] = { b, 0.0, 0.0 };
+  vtkNew<vtkImageData> foldingField;
+  CreateLinearField(foldingField.GetPointer(), VTK_FLOAT, axisAlignedIjkToRasMatrix.GetPointer(), foldingGradient);
+  vtkNew<vtkDisplacementFieldJacobianAnalysis> analysis;
+  analysis->SetDisplacementField(foldingField.GetPointer());
+  analysis->SetIJKToRASMatrix(axisAlignedIjkToRasMatrix.GetPointer());
+  if (!analysis->Update())
+  {
+    std::cerr << "ERROR: Failed to compute Jacobian of folding field" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const vtkIdType expectedNumberOfFoldingVoxels = (DIMENSIONS[0] - 2) * DIMENSIONS[1] * DIMENSIONS[2];
+  if (analysis->GetNumberOfFoldingVoxels() != expectedNumberOfFoldingVoxels)
+  {
+    std::cerr << "ERROR: Folding field has " << analysis->GetNumberOfFoldingVoxels() << " folding voxels (expected "
+      << expectedNumberOfFoldingVoxels << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if ( !IsEqualWithTolerance("Folding field minimum", analysis->GetMinimum(), 1.0 + b, 1e-5)
+    || !IsEqualWithTolerance("Folding field maximum", analysis->GetMaximum(), 1.0 + b/2.0, 1e-5)
+    || !IsEqualWithTolerance("Folding field mean", analysis->GetMean(), GetMeanFactor(b, DIMENSIONS[0]), 1e-5)
+    || !CheckHistogramTotal(analysis.GetPointer()) )
+  {
+    return EXIT_FAILURE;
+  }
+  // Determinants below the histogram range are counted in the first bin
+  if (analysis->GetHistogram()->GetValue(0) != expectedNumberOfFoldingVoxels)
+  {
+    std::cerr << "ERROR: First histogram bin contains " << analysis->GetHistogram()->GetValue(0) << " grid points (expected "
+      << expectedNumberOfFoldingVoxels << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Displacement field Jacobian analysis test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+
+// PlastimatchPy includes
+#include "vtkDisplacementFieldJacobianAnalysis.h"
+#include "vtkPlmpyVectorFieldAnalysis.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLVectorVolumeNode.h>
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <cmath>
+#include <iostream>
+
+//-----------------------------------------------------------------------------
+int vtkPlmpyVectorFieldAnalysisTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkMRMLScene> mrmlScene;
+  vtkNew<vtkPlmpyVectorFieldAnalysis> logic;
+  logic->SetMRMLScene(mrmlScene.GetPointer());
+
+  // Uniform expansion u = a*x defined in the coordinate frame of the vector field node
+  const double a = 0.2;
+  const int dimensions[3] = { 5, 5, 5 };
+  vtkNew<vtkMRMLVectorVolumeNode> vectorFieldNode;
+  vectorFieldNode->SetSpacing(2.0, 2.0, 2.0);
+  vectorFieldNode->SetOrigin(-4.0, -4.0, -4.0);
+  vtkNew<vtkImageData> field;
+  field->SetDimensions(dimensions[0], dimensions[1], dimensions[2]);
+  field->AllocateScalars(VTK_FLOAT, 3);
+  vtkNew<vtkMatrix4x4> ijkToRasMatrix;
+  vectorFieldNode->GetIJKToRASMatrix(ijkToRasMatrix.GetPointer());
+  for (int k=0; k<dimensions[2]; ++k)
+  {
+    for (int j=0; j<dimensions[1]; ++j)
+    {
+      for (int i=0; i<dimensions[0]; ++i)
+      {
+        double ijk[4] = { static_cast<double>(i), static_cast<double>(j), static_cast<double>(k), 1.0 };
+        double ras[4] = { 0.0, 0.0, 0.0, 1.0 };
+        ijkToRasMatrix->MultiplyPoint(ijk, ras);
+        for (int component=0; component<3; ++component)
+        {
+          field->SetScalarComponentFromDouble(i, j, k, component, a * ras[component]);
+        }
+      }
+    }
+  }
+  vectorFieldNode->SetAndObserveImageData(field.GetPointer());
+  mrmlScene->AddNode(vectorFieldNode.GetPointer());
+
+  // Parent transform that scales and rotates. The vectors are not transformed by it, so it must not
+  // change the Jacobian
+  vtkNew<vtkTransform> parentTransform;
+  parentTransform->Translate(10.0, 0.0, -5.0);
+  parentTransform->RotateWXYZ(30.0, 0.0, 1.0, 1.0);
+  parentTransform->Scale(2.0, 2.0, 2.0);
+  vtkNew<vtkMRMLLinearTransformNode> parentTransformNode;
+  parentTransformNode->SetMatrixTransformToParent(parentTransform->GetMatrix());
+  mrmlScene->AddNode(parentTransformNode.GetPointer());
+  vectorFieldNode->SetAndObserveTransformNodeID(parentTransformNode->GetID());
+
+  vtkNew<vtkMRMLScalarVolumeNode> outputVolumeNode;
+  mrmlScene->AddNode(outputVolumeNode.GetPointer());
+
+  logic->SetVFImageID(vectorFieldNode->GetID());
+  logic->SetOutputVolumeID(outputVolumeNode->GetID());
+  logic->RunJacobian();
+
+  // Inside the grid det J = (1+a)^3, on the boundary the derivatives are halved
+  const double expectedMaximum = (1.0 + a) * (1.0 + a) * (1.0 + a);
+  const double expectedMinimum = (1.0 + a/2.0) * (1.0 + a/2.0) * (1.0 + a/2.0);
+  vtkDisplacementFieldJacobianAnalysis* analysis = logic->GetJacobianAnalysis();
+  if (fabs(analysis->GetMaximum() - expectedMaximum) > 1e-5 || fabs(analysis->GetMinimum() - expectedMinimum) > 1e-5)
+  {
+    std::cerr << "ERROR: Invalid Jacobian range: " << analysis->GetMinimum() << " - " << analysis->GetMaximum()
+      << " (expected " << expectedMinimum << " - " << expectedMaximum << ")" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (fabs(atof(logic->GetJacobianMaxString()) - expectedMaximum) > 1e-5)
+  {
+    std::cerr << "ERROR: Invalid maximum Jacobian string: " << logic->GetJacobianMaxString() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The determinant volume is on the grid of the vector field, under the same parent transform
+  int outputDimensions[3] = { 0, 0, 0 };
+  if (!outputVolumeNode->GetImageData())
+  {
+    std::cerr << "ERROR: Jacobian determinant volume was not computed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  outputVolumeNode->GetImageData()->GetDimensions(outputDimensions);
+  if (outputDimensions[0] != dimensions[0] || outputDimensions[1] != dimensions[1] || outputDimensions[2] != dimensions[2])
+  {
+    std::cerr << "ERROR: Invalid Jacobian determinant volume dimensions: " << outputDimensions[0] << ", "
+      << outputDimensions[1] << ", " << outputDimensions[2] << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkNew<vtkMatrix4x4> outputIjkToRasMatrix;
+  outputVolumeNode->GetIJKToRASMatrix(outputIjkToRasMatrix.GetPointer());
+  for (int row=0; row<4; ++row)
+  {
+    for (int column=0; column<4; ++column)
+    {
+      if (fabs(outputIjkToRasMatrix->GetElement(row, column) - ijkToRasMatrix->GetElement(row, column)) > 1e-9)
+      {
+        std::cerr << "ERROR: Geometry of the Jacobian determinant volume differs from that of the vector field" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  if (outputVolumeNode->GetParentTransformNode() != parentTransformNode.GetPointer())
+  {
+    std::cerr << "ERROR: Jacobian determinant volume is not under the parent transform of the vector field" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Vector field analysis test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
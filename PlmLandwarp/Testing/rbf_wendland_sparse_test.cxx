@@ -0,0 +1,196 @@
+/*==========================================================================
+
+  Copyright (c) Massachusetts General Hospital, Boston, MA, USA. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Gregory C. Sharp, Massachusetts General Hospital
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Natural Sciences and Engineering Research Council
+  of Canada.
+
+==========================================================================*/
+
+/* Compare the sparse Wendland warp to the dense plastimatch implementation.
+   With the same radius and no clustering the two solve the same
+   interpolation problem, so the vector fields and warped images need to
+   agree up to the precision of the solvers. */
+
+#include "plm_config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include "landmark_warp.h"
+#include "plm_image.h"
+#include "rbf_wendland.h"
+#include "rbf_wendland_sparse.h"
+#include "volume.h"
+#include "xform.h"
+
+/* Image of 32^3 voxels of 2 mm, centered at the origin */
+#define TEST_DIM 32
+#define TEST_SPACING 2.0f
+#define TEST_RADIUS 30.0f
+
+/* Intensity is linear in the position, so that linear interpolation
+   is exact and the warped images only differ where the fields do */
+static float
+test_intensity (const float p[3])
+{
+    return 0.5f * p[0] + 0.25f * p[1] + p[2];
+}
+
+static FloatImageType::Pointer
+create_test_image ()
+{
+    FloatImageType::SizeType size;
+    FloatImageType::IndexType index;
+    FloatImageType::PointType origin;
+    FloatImageType::SpacingType spacing;
+    for (int d = 0; d < 3; d++) {
+        size[d] = TEST_DIM;
+        index[d] = 0;
+        origin[d] = -0.5f * (TEST_DIM - 1) * TEST_SPACING;
+        spacing[d] = TEST_SPACING;
+    }
+    FloatImageType::RegionType region;
+    region.SetSize (size);
+    region.SetIndex (index);
+    FloatImageType::Pointer image = FloatImageType::New ();
+    image->SetRegions (region);
+    image->SetOrigin (origin);
+    image->SetSpacing (spacing);
+    image->Allocate ();
+
+    float *buffer = image->GetBufferPointer ();
+    for (int k = 0; k < TEST_DIM; k++) {
+        for (int j = 0; j < TEST_DIM; j++) {
+            for (int i = 0; i < TEST_DIM; i++) {
+                float p[3] = {
+                    (float) origin[0] + i * TEST_SPACING,
+                    (float) origin[1] + j * TEST_SPACING,
+                    (float) origin[2] + k * TEST_SPACING
+                };
+                buffer[(k * TEST_DIM + j) * TEST_DIM + i] = test_intensity (p);
+            }
+        }
+    }
+    return image;
+}
+
+/* Landmarks on a jittered 3x3x3 grid with displacements up to 3 mm.
+   Neighboring landmarks are 15 mm apart, so each one interacts with
+   several others within the radius. */
+static void
+create_test_landmarks (Landmark_warp *lw)
+{
+    int n = 0;
+    for (int k = -1; k <= 1; k++) {
+        for (int j = -1; j <= 1; j++) {
+            for (int i = -1; i <= 1; i++, n++) {
+                float fixed[3] = {
+                    15.0f * i + 1.5f * (float) sin (1.3 * n),
+                    15.0f * j + 1.5f * (float) sin (2.1 * n + 0.5),
+                    15.0f * k + 1.5f * (float) sin (3.7 * n + 1.0)
+                };
+                float moving[3] = {
+                    fixed[0] + 3.0f * (float) cos (0.7 * n),
+                    fixed[1] + 3.0f * (float) cos (1.9 * n + 0.3),
+                    fixed[2] + 3.0f * (float) cos (2.3 * n + 0.6)
+                };
+                lw->m_fixed_landmarks.insert_lps (fixed);
+                lw->m_moving_landmarks.insert_lps (moving);
+            }
+        }
+    }
+}
+
+int
+main ()
+{
+    Landmark_warp *lw = landmark_warp_create ();
+    lw->m_input_img = Plm_image::New ();
+    lw->m_input_img->set_itk (create_test_image ());
+    lw->m_pih.set_from_plm_image (lw->m_input_img);
+    lw->default_val = 0.0f;
+    lw->rbf_radius = TEST_RADIUS;
+    lw->young_modulus = 0.0f;
+    lw->num_clusters = 0;
+    create_test_landmarks (lw);
+
+    DeformationFieldType::Pointer sparse_vf;
+    FloatImageType::Pointer sparse_warped;
+    if (!rbf_wendland_sparse_warp (lw, sparse_vf, sparse_warped)) {
+        printf ("ERROR: Sparse Wendland warp failed\n");
+        return EXIT_FAILURE;
+    }
+
+    rbf_wendland_warp (lw);
+    if (!lw->m_vf || !lw->m_warped_img) {
+        printf ("ERROR: Dense Wendland warp failed\n");
+        return EXIT_FAILURE;
+    }
+    Volume::Pointer dense_vf = lw->m_vf->get_gpuit_vf ();
+    if (!dense_vf || dense_vf->npix != TEST_DIM * TEST_DIM * TEST_DIM) {
+        printf ("ERROR: Invalid dense Wendland vector field\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Both vector fields are interleaved in the same voxel order */
+    const float *sparse_img = (const float *) sparse_vf->GetBufferPointer ();
+    const float *dense_img = (const float *) dense_vf->img;
+    float max_vf_diff = 0.0f;
+    float max_displacement = 0.0f;
+    for (plm_long v = 0; v < 3 * dense_vf->npix; v++) {
+        max_vf_diff = std::max (max_vf_diff,
+            (float) fabs (sparse_img[v] - dense_img[v]));
+        max_displacement = std::max (max_displacement,
+            (float) fabs (dense_img[v]));
+    }
+    printf ("Maximum vector field difference %g mm, "
+        "maximum displacement %g mm\n", max_vf_diff, max_displacement);
+    if (max_displacement < 1.0f) {
+        printf ("ERROR: Dense Wendland vector field is nearly zero\n");
+        return EXIT_FAILURE;
+    }
+    if (max_vf_diff > 1e-3f) {
+        printf ("ERROR: Sparse and dense Wendland vector fields differ "
+            "by %g mm (tolerance 0.001 mm)\n", max_vf_diff);
+        return EXIT_FAILURE;
+    }
+
+    /* Compare the warped images away from the border, where the samples
+       may fall outside of the moving image. The displacements are below
+       two voxels. The intensity gradient is below 1.2 per mm. */
+    const float *sparse_warped_img = sparse_warped->GetBufferPointer ();
+    const float *dense_warped_img =
+        lw->m_warped_img->itk_float ()->GetBufferPointer ();
+    float max_warped_diff = 0.0f;
+    for (int k = 2; k < TEST_DIM - 2; k++) {
+        for (int j = 2; j < TEST_DIM - 2; j++) {
+            for (int i = 2; i < TEST_DIM - 2; i++) {
+                int v = (k * TEST_DIM + j) * TEST_DIM + i;
+                max_warped_diff = std::max (max_warped_diff,
+                    (float) fabs (sparse_warped_img[v] - dense_warped_img[v]));
+            }
+        }
+    }
+    printf ("Maximum warped image difference %g\n", max_warped_diff);
+    if (max_warped_diff > 1e-2f) {
+        printf ("ERROR: Sparse and dense Wendland warped images differ "
+            "by %g (tolerance 0.01)\n", max_warped_diff);
+        return EXIT_FAILURE;
+    }
+
+    printf ("Sparse Wendland warp test passed\n");
+    return EXIT_SUCCESS;
+}
@@ -27,6 +27,7 @@
 #include <math.h>
 #include <time.h>
 
+#include "itk_image_save.h"
 #include "itk_tps.h"
 #include "landmark_warp.h"
 #include "logfile.h"
@@ -35,6 +36,7 @@
 #include "raw_pointset.h"
 #include "rbf_gauss.h"
 #include "rbf_wendland.h"
+#include "rbf_wendland_sparse.h"
 #include "xform.h"
 
 // this .h is generated from ...landwarp.xml file by GenerateCLP in Slicer3-build
@@ -137,6 +139,38 @@ main (int argc, char *argv[])
     mov_ps.insert_ras (lm_mov);
   }
 
+  /* The sparse Wendland warp has no adaptive radius, so clustered
+     landmarks use the plastimatch implementation */
+  if (plmslc_landwarp_rbf_type == "wendland_sparse" && lw->num_clusters > 0) {
+    printf ("Adaptive radius is not supported by the sparse Wendland warp, "
+      "using the wendland basis function\n");
+    plmslc_landwarp_rbf_type = "wendland";
+  }
+
+  if (plmslc_landwarp_rbf_type == "wendland_sparse") {
+    DeformationFieldType::Pointer vf;
+    FloatImageType::Pointer warped;
+    if (!rbf_wendland_sparse_warp (lw, vf, warped)) {
+      return EXIT_FAILURE;
+    }
+    if (plmslc_landwarp_warped_volume != ""
+      && plmslc_landwarp_warped_volume != "None") 
+    {
+      itk_image_save (warped, plmslc_landwarp_warped_volume.c_str());
+    }
+    if (plmslc_landwarp_output_vf_f != ""
+      && plmslc_landwarp_output_vf_f != "None") 
+    {
+      itk_image_save (vf, plmslc_landwarp_output_vf_f.c_str());
+    }
+    if (plmslc_landwarp_output_vf != ""
+      && plmslc_landwarp_output_vf != "None") 
+    {
+      itk_image_save (vf, plmslc_landwarp_output_vf.c_str());
+    }
+    return EXIT_SUCCESS;
+  }
+
   do_landmark_warp (lw, plmslc_landwarp_rbf_type.c_str());
 
   if (lw->m_warped_img 
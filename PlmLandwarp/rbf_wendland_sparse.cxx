@@ -0,0 +1,404 @@
+/*==========================================================================
+
+  Copyright (c) Massachusetts General Hospital, Boston, MA, USA. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Gregory C. Sharp, Massachusetts General Hospital
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Natural Sciences and Engineering Research Council
+  of Canada.
+
+==========================================================================*/
+
+#include "plm_config.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkWarpImageFilter.h"
+#include "vnl/vnl_math.h"
+#include "vnl/vnl_sparse_matrix.h"
+#include "vnl/vnl_vector.h"
+#include "vnl/algo/vnl_sparse_lu.h"
+
+#include "landmark_warp.h"
+#include "plm_image.h"
+#include "plm_image_header.h"
+#include "rbf_wendland_sparse.h"
+
+/* Number of voxels along each side of the blocks the vector field
+   is rendered in */
+#define WENDLAND_BLOCK_SIZE 16
+
+/* Limit on the number of landmark grid cells. The cells are made
+   larger if the landmarks are spread out compared to the radius. */
+#define WENDLAND_MAX_GRID_CELLS (1 << 22)
+
+/* Wendland C2 function of the distance normalized by the radius.
+   Written without branches, so that loops calling it can be vectorized. */
+static inline float
+wendland_value (float r)
+{
+    float t = 1.0f - r;
+    t = t > 0.0f ? t : 0.0f;
+    float t2 = t * t;
+    return t2 * t2 * (4.0f * r + 1.0f);
+}
+
+/* Uniform grid over the landmarks, stored as landmark indices
+   sorted by cell with the start offset of each cell */
+class Landmark_grid {
+public:
+    float origin[3];
+    float cell_size;
+    int dim[3];
+    std::vector<int> cell_start;
+    std::vector<int> cell_points;
+public:
+    void build (const std::vector<float>& points, float min_cell_size);
+    void find_candidates (const float lo[3], const float hi[3],
+        std::vector<int>& candidates) const;
+protected:
+    int cell_index (const float *p) const;
+};
+
+void
+Landmark_grid::build (const std::vector<float>& points, float min_cell_size)
+{
+    int num_points = (int) (points.size() / 3);
+    float hi[3];
+    for (int d = 0; d < 3; d++) {
+        origin[d] = hi[d] = points[d];
+    }
+    for (int i = 1; i < num_points; i++) {
+        for (int d = 0; d < 3; d++) {
+            origin[d] = std::min (origin[d], points[3*i+d]);
+            hi[d] = std::max (hi[d], points[3*i+d]);
+        }
+    }
+
+    cell_size = min_cell_size;
+    while (1) {
+        double num_cells = 1.0;
+        for (int d = 0; d < 3; d++) {
+            dim[d] = (int) floor ((hi[d] - origin[d]) / cell_size) + 1;
+            num_cells *= dim[d];
+        }
+        if (num_cells <= WENDLAND_MAX_GRID_CELLS) {
+            break;
+        }
+        cell_size *= 2.0f;
+    }
+
+    /* Counting sort of the landmarks by cell */
+    int num_cells = dim[0] * dim[1] * dim[2];
+    cell_start.assign (num_cells + 1, 0);
+    std::vector<int> point_cell (num_points);
+    for (int i = 0; i < num_points; i++) {
+        point_cell[i] = cell_index (&points[3*i]);
+        cell_start[point_cell[i] + 1]++;
+    }
+    for (int c = 0; c < num_cells; c++) {
+        cell_start[c + 1] += cell_start[c];
+    }
+    std::vector<int> fill (cell_start.begin(), cell_start.end() - 1);
+    cell_points.resize (num_points);
+    for (int i = 0; i < num_points; i++) {
+        cell_points[fill[point_cell[i]]++] = i;
+    }
+}
+
+int
+Landmark_grid::cell_index (const float *p) const
+{
+    int idx[3];
+    for (int d = 0; d < 3; d++) {
+        idx[d] = (int) floor ((p[d] - origin[d]) / cell_size);
+        idx[d] = std::min (std::max (idx[d], 0), dim[d] - 1);
+    }
+    return (idx[2] * dim[1] + idx[1]) * dim[0] + idx[0];
+}
+
+/* Collect the landmarks in the cells overlapping the box [lo, hi] */
+void
+Landmark_grid::find_candidates (const float lo[3], const float hi[3],
+    std::vector<int>& candidates) const
+{
+    candidates.clear ();
+    int lo_idx[3], hi_idx[3];
+    for (int d = 0; d < 3; d++) {
+        lo_idx[d] = (int) floor ((lo[d] - origin[d]) / cell_size);
+        hi_idx[d] = (int) floor ((hi[d] - origin[d]) / cell_size);
+        if (hi_idx[d] < 0 || lo_idx[d] >= dim[d]) {
+            return;
+        }
+        lo_idx[d] = std::max (lo_idx[d], 0);
+        hi_idx[d] = std::min (hi_idx[d], dim[d] - 1);
+    }
+    for (int k = lo_idx[2]; k <= hi_idx[2]; k++) {
+        for (int j = lo_idx[1]; j <= hi_idx[1]; j++) {
+            int row = (k * dim[1] + j) * dim[0];
+            candidates.insert (candidates.end(),
+                cell_points.begin() + cell_start[row + lo_idx[0]],
+                cell_points.begin() + cell_start[row + hi_idx[0] + 1]);
+        }
+    }
+}
+
+bool
+rbf_wendland_sparse_warp (
+    Landmark_warp *lw,
+    DeformationFieldType::Pointer& vf_out,
+    FloatImageType::Pointer& warped_out)
+{
+    int num_landmarks = (int) lw->m_fixed_landmarks.get_count ();
+    float radius = lw->rbf_radius;
+    if (num_landmarks == 0
+        || (int) lw->m_moving_landmarks.get_count () < num_landmarks
+        || radius <= 0.0f || !lw->m_input_img)
+    {
+        printf ("Error: invalid input for sparse Wendland warp\n");
+        return false;
+    }
+    printf ("Sparse Wendland radial basis functions requested, "
+        "%d landmarks, radius %.2f\n", num_landmarks, radius);
+
+    /* Fixed landmarks, and their displacement to the moving landmarks */
+    std::vector<float> fixed (3 * num_landmarks);
+    std::vector<float> displacement (3 * num_landmarks);
+    for (int i = 0; i < num_landmarks; i++) {
+        for (int d = 0; d < 3; d++) {
+            fixed[3*i+d] = lw->m_fixed_landmarks.point_list[i].p[d];
+            displacement[3*i+d] = lw->m_moving_landmarks.point_list[i].p[d]
+                - lw->m_fixed_landmarks.point_list[i].p[d];
+        }
+    }
+    Landmark_grid grid;
+    grid.build (fixed, radius);
+
+    /* Assemble the system matrix. Landmarks only interact within
+       the radius, so most of the elements are zero. */
+    vnl_sparse_matrix<double> system_matrix (num_landmarks, num_landmarks);
+    std::vector<int> neighbors;
+    long num_nonzeros = 0;
+    for (int i = 0; i < num_landmarks; i++) {
+        float lo[3], hi[3];
+        for (int d = 0; d < 3; d++) {
+            lo[d] = fixed[3*i+d] - radius;
+            hi[d] = fixed[3*i+d] + radius;
+        }
+        grid.find_candidates (lo, hi, neighbors);
+        for (size_t n = 0; n < neighbors.size(); n++) {
+            int j = neighbors[n];
+            float dist2 = 0.0f;
+            for (int d = 0; d < 3; d++) {
+                float diff = fixed[3*i+d] - fixed[3*j+d];
+                dist2 += diff * diff;
+            }
+            float r = sqrtf (dist2) / radius;
+            if (r >= 1.0f) {
+                continue;
+            }
+            double value = wendland_value (r);
+            if (i == j) {
+                value += lw->young_modulus;
+            }
+            system_matrix (i, j) = value;
+            num_nonzeros++;
+        }
+    }
+    printf ("Solving for RBF coefficients (%ld nonzero elements)\n",
+        num_nonzeros);
+
+    /* Solve for the coefficients of the three displacement components
+       with one factorization */
+    vnl_sparse_lu lu (system_matrix, vnl_sparse_lu::quiet);
+    std::vector<float> coeff (3 * num_landmarks);
+    for (int d = 0; d < 3; d++) {
+        vnl_vector<double> rhs (num_landmarks);
+        for (int i = 0; i < num_landmarks; i++) {
+            rhs[i] = displacement[3*i+d];
+        }
+        vnl_vector<double> solution = lu.solve (rhs);
+        for (int i = 0; i < num_landmarks; i++) {
+            if (!vnl_math_isfinite (solution[i])) {
+                printf ("Error: failed to solve for RBF coefficients\n");
+                return false;
+            }
+            coeff[3*i+d] = (float) solution[i];
+        }
+    }
+
+    /* Create output vector field */
+    plm_long dim[3];
+    float origin[3], spacing[3], direction_cosines[9];
+    lw->m_pih.get_dim (dim);
+    lw->m_pih.get_origin (origin);
+    lw->m_pih.get_spacing (spacing);
+    lw->m_pih.get_direction_cosines (direction_cosines);
+
+    DeformationFieldType::SizeType vf_size;
+    DeformationFieldType::IndexType vf_index;
+    DeformationFieldType::PointType vf_origin;
+    DeformationFieldType::SpacingType vf_spacing;
+    DeformationFieldType::DirectionType vf_direction;
+    for (int d = 0; d < 3; d++) {
+        vf_size[d] = dim[d];
+        vf_index[d] = 0;
+        vf_origin[d] = origin[d];
+        vf_spacing[d] = spacing[d];
+        for (int e = 0; e < 3; e++) {
+            vf_direction[d][e] = direction_cosines[3*d+e];
+        }
+    }
+    DeformationFieldType::RegionType vf_region;
+    vf_region.SetSize (vf_size);
+    vf_region.SetIndex (vf_index);
+    vf_out = DeformationFieldType::New ();
+    vf_out->SetRegions (vf_region);
+    vf_out->SetOrigin (vf_origin);
+    vf_out->SetSpacing (vf_spacing);
+    vf_out->SetDirection (vf_direction);
+    vf_out->Allocate ();
+    DeformationFieldType::PixelType *vf_buffer = vf_out->GetBufferPointer ();
+
+    /* Physical position change when stepping one voxel along each axis */
+    float step[3][3];
+    for (int a = 0; a < 3; a++) {
+        for (int d = 0; d < 3; d++) {
+            step[a][d] = direction_cosines[3*d+a] * spacing[a];
+        }
+    }
+
+    /* Render the vector field block by block */
+    printf ("Rendering vector field\n");
+    int num_blocks[3];
+    for (int d = 0; d < 3; d++) {
+        num_blocks[d] = (int) ((dim[d] + WENDLAND_BLOCK_SIZE - 1)
+            / WENDLAND_BLOCK_SIZE);
+    }
+    int total_blocks = num_blocks[0] * num_blocks[1] * num_blocks[2];
+    float inverse_radius = 1.0f / radius;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int block = 0; block < total_blocks; block++) {
+        int block_idx[3] = {
+            block % num_blocks[0],
+            (block / num_blocks[0]) % num_blocks[1],
+            block / (num_blocks[0] * num_blocks[1])
+        };
+        plm_long first[3], last[3];
+        for (int d = 0; d < 3; d++) {
+            first[d] = (plm_long) block_idx[d] * WENDLAND_BLOCK_SIZE;
+            last[d] = std::min (first[d] + WENDLAND_BLOCK_SIZE, dim[d]) - 1;
+        }
+
+        /* Bounding box of the block in physical space */
+        float lo[3], hi[3];
+        for (int corner = 0; corner < 8; corner++) {
+            plm_long ijk[3] = {
+                (corner & 1) ? last[0] : first[0],
+                (corner & 2) ? last[1] : first[1],
+                (corner & 4) ? last[2] : first[2]
+            };
+            for (int d = 0; d < 3; d++) {
+                float p = origin[d] + ijk[0] * step[0][d]
+                    + ijk[1] * step[1][d] + ijk[2] * step[2][d];
+                lo[d] = (corner == 0) ? p : std::min (lo[d], p);
+                hi[d] = (corner == 0) ? p : std::max (hi[d], p);
+            }
+        }
+
+        /* Landmarks whose support reaches the block, packed for the kernel */
+        float search_lo[3], search_hi[3];
+        for (int d = 0; d < 3; d++) {
+            search_lo[d] = lo[d] - radius;
+            search_hi[d] = hi[d] + radius;
+        }
+        std::vector<int> candidates;
+        grid.find_candidates (search_lo, search_hi, candidates);
+        std::vector<float> lm_x, lm_y, lm_z, lm_cx, lm_cy, lm_cz;
+        for (size_t n = 0; n < candidates.size(); n++) {
+            int i = candidates[n];
+            float dist2 = 0.0f;
+            for (int d = 0; d < 3; d++) {
+                float p = fixed[3*i+d];
+                float diff = p < lo[d] ? lo[d] - p : (p > hi[d] ? p - hi[d] : 0.0f);
+                dist2 += diff * diff;
+            }
+            if (dist2 >= radius * radius) {
+                continue;
+            }
+            lm_x.push_back (fixed[3*i+0]);
+            lm_y.push_back (fixed[3*i+1]);
+            lm_z.push_back (fixed[3*i+2]);
+            lm_cx.push_back (coeff[3*i+0]);
+            lm_cy.push_back (coeff[3*i+1]);
+            lm_cz.push_back (coeff[3*i+2]);
+        }
+        int num_candidates = (int) lm_x.size ();
+        const float *px = num_candidates ? &lm_x[0] : 0;
+        const float *py = num_candidates ? &lm_y[0] : 0;
+        const float *pz = num_candidates ? &lm_z[0] : 0;
+        const float *pcx = num_candidates ? &lm_cx[0] : 0;
+        const float *pcy = num_candidates ? &lm_cy[0] : 0;
+        const float *pcz = num_candidates ? &lm_cz[0] : 0;
+
+        for (plm_long k = first[2]; k <= last[2]; k++) {
+            for (plm_long j = first[1]; j <= last[1]; j++) {
+                plm_long row_offset = (k * dim[1] + j) * dim[0];
+                for (plm_long i = first[0]; i <= last[0]; i++) {
+                    float x = origin[0] + i * step[0][0] + j * step[1][0] + k * step[2][0];
+                    float y = origin[1] + i * step[0][1] + j * step[1][1] + k * step[2][1];
+                    float z = origin[2] + i * step[0][2] + j * step[1][2] + k * step[2][2];
+
+                    /* Branch free sum over the candidate landmarks */
+                    float sum_x = 0.0f, sum_y = 0.0f, sum_z = 0.0f;
+                    for (int c = 0; c < num_candidates; c++) {
+                        float dx = x - px[c];
+                        float dy = y - py[c];
+                        float dz = z - pz[c];
+                        float r = sqrtf (dx*dx + dy*dy + dz*dz) * inverse_radius;
+                        float w = wendland_value (r);
+                        sum_x += w * pcx[c];
+                        sum_y += w * pcy[c];
+                        sum_z += w * pcz[c];
+                    }
+                    DeformationFieldType::PixelType& v = vf_buffer[row_offset + i];
+                    v[0] = sum_x;
+                    v[1] = sum_y;
+                    v[2] = sum_z;
+                }
+            }
+        }
+    }
+
+    /* Warp the moving image */
+    printf ("Warping image\n");
+    typedef itk::WarpImageFilter <FloatImageType, FloatImageType,
+        DeformationFieldType> WarpFilterType;
+    typedef itk::LinearInterpolateImageFunction <FloatImageType, double>
+        InterpolatorType;
+    WarpFilterType::Pointer warper = WarpFilterType::New ();
+    warper->SetInput (lw->m_input_img->itk_float ());
+    warper->SetDisplacementField (vf_out);
+    warper->SetInterpolator (InterpolatorType::New ());
+    warper->SetOutputParametersFromImage (vf_out);
+    warper->SetEdgePaddingValue (lw->default_val);
+    warper->Update ();
+    warped_out = warper->GetOutput ();
+
+    return true;
+}
@@ -0,0 +1,52 @@
+/*==========================================================================
+
+  Copyright (c) Massachusetts General Hospital, Boston, MA, USA. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Gregory C. Sharp, Massachusetts General Hospital
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Natural Sciences and Engineering Research Council
+  of Canada.
+
+==========================================================================*/
+
+#ifndef _rbf_wendland_sparse_h_
+#define _rbf_wendland_sparse_h_
+
+#include "plm_config.h"
+#include "itk_image_type.h"
+
+class Landmark_warp;
+
+/* Landmark warp with compactly supported Wendland radial basis functions,
+   for many landmarks on large images.
+
+   The landmarks are put in a uniform grid with the RBF radius as cell size.
+   Only landmark pairs closer than the radius interact, so the system matrix
+   is sparse and the coefficients are solved with a sparse LU factorization.
+   The vector field is rendered in parallel in blocks of voxels, each block
+   evaluating only the landmarks whose support reaches the block.
+
+   All landmarks use the same radius (lw->rbf_radius), and the stiffness
+   (lw->young_modulus) is added to the diagonal of the system matrix.
+   The vector field is defined on the output geometry (lw->m_pih) and
+   points from the fixed to the moving landmarks. The moving image
+   (lw->m_input_img) is warped with linear interpolation.
+
+   Returns false if the landmarks or the geometry are invalid, or the
+   system cannot be solved (e.g. duplicate landmarks without stiffness). */
+bool
+rbf_wendland_sparse_warp (
+    Landmark_warp *lw,
+    DeformationFieldType::Pointer& vf_out,
+    FloatImageType::Pointer& warped_out);
+
+#endif
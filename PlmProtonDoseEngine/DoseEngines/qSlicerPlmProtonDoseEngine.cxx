@@ -55,6 +55,20 @@
 #include <QDebug>
 #include <QStringList>
 
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Plan inputs converted to Plastimatch images, shared by all beams of the plan
+  class PlmProtonPlanInputs : public qSlicerAbstractDoseEngine::PlanInputCacheEntry
+  {
+  public:
+    Plm_image::Pointer ReferenceVolume;
+    Plm_image::Pointer TargetVolume;
+  };
+
+  const char* PLAN_INPUTS_CACHE_ENTRY_NAME = "PlmProtonPlanInputs";
+}
+
 //----------------------------------------------------------------------------
 qSlicerPlmProtonDoseEngine::qSlicerPlmProtonDoseEngine(QObject* parent)
   : qSlicerAbstractDoseEngine(parent)
@@ -165,23 +179,48 @@ QString qSlicerPlmProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBeamNode*
 
   vtkMRMLScene* scene = beamNode->GetScene();
 
-  // Get target as ITK image
-  vtkSmartPointer<vtkOrientedImageData> targetLabelmap = parentPlanNode->GetTargetOrientedImageData();
-  if (targetLabelmap.GetPointer() == NULL)
-  {
-    QString errorMessage("Failed to access target labelmap");
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-    return errorMessage;
-  }
-  Plm_image::Pointer targetPlmVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(targetLabelmap);
-  if (!targetPlmVolume)
+  // Get reference volume and target as Plastimatch images.
+  // They are converted only for the first beam of the plan, and then reused until the plan inputs change
+  PlmProtonPlanInputs* planInputs = dynamic_cast<PlmProtonPlanInputs*>(
+    this->planInputCacheEntry(parentPlanNode, PLAN_INPUTS_CACHE_ENTRY_NAME) );
+  if (!planInputs)
   {
-    QString errorMessage("Failed to convert segment labelmap");
-    qCritical() << Q_FUNC_INFO << ": " << errorMessage;
-    return errorMessage;
+    vtkOrientedImageData* targetLabelmap = this->planTargetLabelmap(parentPlanNode);
+    if (!targetLabelmap)
+    {
+      QString errorMessage("Failed to access target labelmap");
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+      return errorMessage;
+    }
+    Plm_image::Pointer targetPlmVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(targetLabelmap);
+    if (!targetPlmVolume)
+    {
+      QString errorMessage("Failed to convert segment labelmap");
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+      return errorMessage;
+    }
+    targetPlmVolume->print();
+
+    Plm_image::Pointer referenceVolumePlm = PlmCommon::ConvertVolumeNodeToPlmImage(referenceVolumeNode);
+    if (!referenceVolumePlm)
+    {
+      QString errorMessage("Failed to convert reference volume");
+      qCritical() << Q_FUNC_INFO << ": " << errorMessage;
+      return errorMessage;
+    }
+    referenceVolumePlm->print();
+
+    // Convert to the pixel types used for the calculation here, so that the shared images are not converted again later
+    targetPlmVolume->itk_uchar();
+    referenceVolumePlm->itk_short();
+
+    planInputs = new PlmProtonPlanInputs();
+    planInputs->TargetVolume = targetPlmVolume;
+    planInputs->ReferenceVolume = referenceVolumePlm;
+    this->setPlanInputCacheEntry(parentPlanNode, PLAN_INPUTS_CACHE_ENTRY_NAME, planInputs);
   }
-  targetPlmVolume->print();
-  itk::Image<unsigned char, 3>::Pointer targetVolumeItk = targetPlmVolume->itk_uchar();
+  itk::Image<unsigned char, 3>::Pointer targetVolumeItk = planInputs->TargetVolume->itk_uchar();
+  itk::Image<short, 3>::Pointer referenceVolumeItk = planInputs->ReferenceVolume->itk_short();
 
   // Reference code for setting the geometry of the segmentation rasterization
   // in case the default one (from DICOM) is not desired
@@ -214,13 +253,6 @@ QString qSlicerPlmProtonDoseEngine::calculateDoseUsingEngine(vtkMRMLRTBeamNode*
     return errorMessage;
   }
 
-  // Convert reference volume to Plastimatch image
-  //TODO: Cache it so that it does not need to be reconverted every time
-  Plm_image::Pointer referenceVolumePlm = PlmCommon::ConvertVolumeNodeToPlmImage(referenceVolumeNode);
-  referenceVolumePlm->print();
-  // Create ITK output dose volume based on the reference volume
-  itk::Image<short, 3>::Pointer referenceVolumeItk = referenceVolumePlm->itk_short();
-
   // Plastimatch RT plan and beam
   Rt_plan rt_plan;
   Rt_beam* rt_beam = NULL;
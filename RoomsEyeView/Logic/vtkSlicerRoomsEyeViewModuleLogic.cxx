@@ -22,6 +22,7 @@
 #include "vtkSlicerRoomsEyeViewModuleLogic.h"
 #include "vtkMRMLRoomsEyeViewNode.h"
 #include "vtkSlicerIECTransformLogic.h"
+#include "vtkIECKinematics.h"
 
 // SlicerRT includes
 #include "vtkMRMLRTBeamNode.h"
@@ -47,6 +48,7 @@
 #include <vtkSmartPointer.h>
 #include <vtkObjectFactory.h>
 #include <vtkTransform.h>
+#include <vtkMatrix4x4.h>
 #include <vtkAppendPolyData.h>
 #include <vtkPolyDataReader.h>
 #include <vtksys/SystemTools.hxx>
@@ -75,6 +77,36 @@ static const char* ADDITIONALCOLLIMATORMOUNTEDDEVICES_TO_COLLIMATOR_TRANSFORM_NO
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerRoomsEyeViewModuleLogic);
 
+namespace
+{
+  //----------------------------------------------------------------------------
+  /// Collect the machine parameters from the parameter node
+  void GetPoseFromParameterNode(vtkMRMLRoomsEyeViewNode* parameterNode, vtkIECKinematics::Pose& pose)
+  {
+    pose.GantryAngle = parameterNode->GetGantryRotationAngle();
+    pose.CollimatorAngle = parameterNode->GetCollimatorRotationAngle();
+    pose.PatientSupportRotationAngle = parameterNode->GetPatientSupportRotationAngle();
+    pose.TableTopDisplacement[0] = parameterNode->GetLateralTableTopDisplacement();
+    pose.TableTopDisplacement[1] = parameterNode->GetLongitudinalTableTopDisplacement();
+    pose.TableTopDisplacement[2] = parameterNode->GetVerticalTableTopDisplacement();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Set transform of an IEC frame computed from the parameter node to its transform node
+  void SetTransformToParentFromParameterNode(vtkMRMLRoomsEyeViewNode* parameterNode,
+    vtkSlicerIECTransformLogic::CoordinateSystemIdentifier frame, vtkMRMLLinearTransformNode* transformNode)
+  {
+    vtkIECKinematics::Pose pose;
+    GetPoseFromParameterNode(parameterNode, pose);
+    double matrixElements[16] = {0.0};
+    vtkIECKinematics::GetTransformToParent(frame, pose, matrixElements);
+
+    vtkSmartPointer<vtkMatrix4x4> matrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    matrix->DeepCopy(matrixElements);
+    transformNode->SetMatrixTransformToParent(matrix);
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkSlicerRoomsEyeViewModuleLogic::vtkSlicerRoomsEyeViewModuleLogic()
   : GantryPatientCollisionDetection(NULL)
@@ -818,12 +850,7 @@ void vtkSlicerRoomsEyeViewModuleLogic::UpdateCollimatorToGantryTransform(vtkMRML
 
   vtkMRMLLinearTransformNode* collimatorToGantryTransformNode =
     this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::Gantry);
-  vtkTransform* collimatorToGantryTransform = vtkTransform::SafeDownCast(
-    collimatorToGantryTransformNode->GetTransformToParent() );
-
-  collimatorToGantryTransform->Identity();
-  collimatorToGantryTransform->RotateZ(parameterNode->GetCollimatorRotationAngle());
-  collimatorToGantryTransform->Modified();
+  SetTransformToParentFromParameterNode(parameterNode, vtkSlicerIECTransformLogic::Collimator, collimatorToGantryTransformNode);
 }
 
 //----------------------------------------------------------------------------
@@ -837,17 +864,7 @@ void vtkSlicerRoomsEyeViewModuleLogic::UpdateGantryToFixedReferenceTransform(vtk
 
   vtkMRMLLinearTransformNode* gantryToFixedReferenceTransformNode =
     this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::Gantry, vtkSlicerIECTransformLogic::FixedReference);
-  vtkTransform* gantryToFixedReferenceTransform = vtkTransform::SafeDownCast(
-    gantryToFixedReferenceTransformNode->GetTransformToParent() );
-  
-  gantryToFixedReferenceTransform->Identity();
-  gantryToFixedReferenceTransform->RotateY(parameterNode->GetGantryRotationAngle() * (-1.0));
-  gantryToFixedReferenceTransform->Modified();
-
-  vtkMRMLLinearTransformNode* collimatorToGantryTransformNode =
-    this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::Collimator, vtkSlicerIECTransformLogic::Gantry);
-  vtkTransform* collimatorToGantryTransform = vtkTransform::SafeDownCast(
-    collimatorToGantryTransformNode->GetTransformToParent() );
+  SetTransformToParentFromParameterNode(parameterNode, vtkSlicerIECTransformLogic::Gantry, gantryToFixedReferenceTransformNode);
 }
 
 //-----------------------------------------------------------------------------
@@ -1018,13 +1035,7 @@ void vtkSlicerRoomsEyeViewModuleLogic::UpdatePatientSupportRotationToFixedRefere
 
   vtkMRMLLinearTransformNode* patientSupportRotationToFixedReferenceTransformNode =
     this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::PatientSupportRotation, vtkSlicerIECTransformLogic::FixedReference);
-  vtkTransform* patientSupportToRotatedPatientSupportTransform = vtkTransform::SafeDownCast(
-    patientSupportRotationToFixedReferenceTransformNode->GetTransformToParent() );
-  
-  double rotationAngle = parameterNode->GetPatientSupportRotationAngle();
-  patientSupportToRotatedPatientSupportTransform->Identity();
-  patientSupportToRotatedPatientSupportTransform->RotateZ(rotationAngle);
-  patientSupportToRotatedPatientSupportTransform->Modified();
+  SetTransformToParentFromParameterNode(parameterNode, vtkSlicerIECTransformLogic::PatientSupportRotation, patientSupportRotationToFixedReferenceTransformNode);
 }
 
 //-----------------------------------------------------------------------------
@@ -1096,14 +1107,7 @@ void vtkSlicerRoomsEyeViewModuleLogic::UpdateTableTopToTableTopEccentricRotation
 
   vtkMRMLLinearTransformNode* tableTopToTableTopEccentricRotationTransformNode =
     this->IECLogic->GetTransformNodeBetween(vtkSlicerIECTransformLogic::TableTop, vtkSlicerIECTransformLogic::TableTopEccentricRotation);
-  vtkTransform* tableTopEccentricRotationToPatientSupportTransform = vtkTransform::SafeDownCast(
-    tableTopToTableTopEccentricRotationTransformNode->GetTransformToParent() );
-
-  tableTopEccentricRotationToPatientSupportTransform->Identity();
-  double translationArray[3] =
-    { parameterNode->GetLateralTableTopDisplacement(), parameterNode->GetLongitudinalTableTopDisplacement(), parameterNode->GetVerticalTableTopDisplacement() };
-  tableTopEccentricRotationToPatientSupportTransform->Translate(translationArray);
-  tableTopEccentricRotationToPatientSupportTransform->Modified();
+  SetTransformToParentFromParameterNode(parameterNode, vtkSlicerIECTransformLogic::TableTop, tableTopToTableTopEccentricRotationTransformNode);
 }
 
 //-----------------------------------------------------------------------------
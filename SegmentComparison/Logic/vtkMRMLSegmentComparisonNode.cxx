@@ -42,6 +42,7 @@ static const char* COMPARE_SEGMENTATION_REFERENCE_ROLE = "compareSegmentationRef
 static const char* RASTERIZATION_REFERENCE_VOLUME_REFERENCE_ROLE = "rasterizationReferenceVolumeRef";
 static const char* DICE_TABLE_REFERENCE_ROLE = "diceTableRef";
 static const char* HAUSDORFF_TABLE_REFERENCE_ROLE = "hausdorffTableRef";
+static const char* DICE_MATRIX_TABLE_REFERENCE_ROLE = "diceMatrixTableRef";
 
 //------------------------------------------------------------------------------
 vtkMRMLNodeNewMacro(vtkMRMLSegmentComparisonNode);
@@ -422,3 +423,21 @@ void vtkMRMLSegmentComparisonNode::SetAndObserveHausdorffTableNode(vtkMRMLTableN
 
   this->SetNodeReferenceID(HAUSDORFF_TABLE_REFERENCE_ROLE, (node ? node->GetID() : NULL));
 }
+
+//----------------------------------------------------------------------------
+vtkMRMLTableNode* vtkMRMLSegmentComparisonNode::GetDiceMatrixTableNode()
+{
+  return vtkMRMLTableNode::SafeDownCast( this->GetNodeReference(DICE_MATRIX_TABLE_REFERENCE_ROLE) );
+}
+
+//----------------------------------------------------------------------------
+void vtkMRMLSegmentComparisonNode::SetAndObserveDiceMatrixTableNode(vtkMRMLTableNode* node)
+{
+  if (node && this->Scene != node->GetScene())
+    {
+    vtkErrorMacro("Cannot set reference: the referenced and referencing node are not in the same scene");
+    return;
+    }
+
+  this->SetNodeReferenceID(DICE_MATRIX_TABLE_REFERENCE_ROLE, (node ? node->GetID() : NULL));
+}
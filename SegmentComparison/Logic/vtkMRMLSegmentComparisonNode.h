@@ -80,6 +80,11 @@ public:
   /// Set Hausdorff table node
   void SetAndObserveHausdorffTableNode(vtkMRMLTableNode* node);
 
+  /// Get Dice matrix table node (all pairs of reference and compare segments)
+  vtkMRMLTableNode* GetDiceMatrixTableNode();
+  /// Set Dice matrix table node (all pairs of reference and compare segments)
+  void SetAndObserveDiceMatrixTableNode(vtkMRMLTableNode* node);
+
   /// Get reference segment ID
   vtkGetStringMacro(ReferenceSegmentID);
   /// Set reference segment ID
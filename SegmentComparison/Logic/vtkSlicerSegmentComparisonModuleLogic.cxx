@@ -28,11 +28,16 @@
 
 // SegmentationCore includes
 #include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
 #include "vtkOrientedImageDataResample.h"
 
 // SlicerRT includes
 #include "PlmCommon.h"
 
+// SlicerRtCommon includes
+#include "vtkSlicerRtPerformanceMonitor.h"
+
 // Plastimatch includes
 #include "dice_statistics.h"
 #include "hausdorff_distance.h"
@@ -43,15 +48,186 @@
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLTableNode.h>
+#include <vtkMRMLTransformNode.h>
 #include <vtkMRMLScene.h>
 
 // VTK includes
 #include <vtkNew.h>
+#include <vtkImageConstantPad.h>
 #include <vtkImageData.h>
-#include <vtkTimerLog.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
 #include <vtkObjectFactory.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
 #include <vtkStringArray.h>
 
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+  #include <intrin.h>
+#endif
+
+//-----------------------------------------------------------------------------
+namespace
+{
+  /// Number of voxels packed into one mask word
+  const int SEGMENT_MASK_WORD_BITS = 64;
+
+  //-----------------------------------------------------------------------------
+  /// Count set bits in a mask word
+  inline vtkIdType CountSetBits(vtkTypeUInt64 word)
+  {
+#if defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<vtkIdType>(__popcnt64(word));
+#elif defined(__GNUC__) || defined(__clang__)
+    return static_cast<vtkIdType>(__builtin_popcountll(word));
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<vtkIdType>((word * 0x0101010101010101ULL) >> 56);
+#endif
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Check whether a segment labelmap contains no voxels
+  bool IsLabelmapEmpty(vtkImageData* labelmap)
+  {
+    int* extent = labelmap->GetExtent();
+    return ( !labelmap->GetPointData()->GetScalars()
+      || extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5] );
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Segment rasterized onto the common comparison grid, one bit per voxel
+  struct PackedSegmentMask
+  {
+    PackedSegmentMask() : NumberOfSetVoxels(0) { }
+    std::string SegmentationName;
+    std::string SegmentID;
+    std::string SegmentName;
+    std::vector<vtkTypeUInt64> Bits;
+    vtkIdType NumberOfSetVoxels;
+  };
+
+  //-----------------------------------------------------------------------------
+  /// Packs a labelmap into mask words. Each word is written by exactly one thread
+  template <class T>
+  class PackSegmentMaskFunctor
+  {
+  public:
+    PackSegmentMaskFunctor(const T* scalars, vtkIdType numberOfVoxels, vtkTypeUInt64* bits)
+      : Scalars(scalars)
+      , NumberOfVoxels(numberOfVoxels)
+      , Bits(bits)
+      , NumberOfSetVoxels(0)
+    {
+    }
+
+    void Initialize()
+    {
+      this->LocalNumberOfSetVoxels.Local() = 0;
+    }
+
+    void operator()(vtkIdType beginWord, vtkIdType endWord)
+    {
+      vtkIdType& localNumberOfSetVoxels = this->LocalNumberOfSetVoxels.Local();
+      for (vtkIdType wordIndex=beginWord; wordIndex<endWord; ++wordIndex)
+      {
+        vtkIdType beginVoxel = wordIndex * SEGMENT_MASK_WORD_BITS;
+        vtkIdType endVoxel = std::min(beginVoxel + SEGMENT_MASK_WORD_BITS, this->NumberOfVoxels);
+        vtkTypeUInt64 word = 0;
+        for (vtkIdType voxelIndex=beginVoxel; voxelIndex<endVoxel; ++voxelIndex)
+        {
+          if (this->Scalars[voxelIndex] != 0)
+          {
+            word |= (vtkTypeUInt64(1) << (voxelIndex - beginVoxel));
+          }
+        }
+        this->Bits[wordIndex] = word;
+        localNumberOfSetVoxels += CountSetBits(word);
+      }
+    }
+
+    void Reduce()
+    {
+      for (typename vtkSMPThreadLocal<vtkIdType>::iterator it = this->LocalNumberOfSetVoxels.begin(); it != this->LocalNumberOfSetVoxels.end(); ++it)
+      {
+        this->NumberOfSetVoxels += (*it);
+      }
+    }
+
+    const T* Scalars;
+    vtkIdType NumberOfVoxels;
+    vtkTypeUInt64* Bits;
+    vtkIdType NumberOfSetVoxels;
+    vtkSMPThreadLocal<vtkIdType> LocalNumberOfSetVoxels;
+  };
+
+  //-----------------------------------------------------------------------------
+  template <class T>
+  vtkIdType PackSegmentMask(const T* scalars, vtkIdType numberOfVoxels, std::vector<vtkTypeUInt64>& bits)
+  {
+    vtkIdType numberOfWords = static_cast<vtkIdType>(bits.size());
+    PackSegmentMaskFunctor<T> functor(scalars, numberOfVoxels, bits.empty() ? NULL : &(bits[0]));
+    vtkSMPTools::For(0, numberOfWords, functor);
+    return functor.NumberOfSetVoxels;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Overlap counts of one reference and compare segment pair
+  struct SegmentPairOverlap
+  {
+    SegmentPairOverlap() : TruePositives(0), FalsePositives(0), FalseNegatives(0) { }
+    vtkIdType TruePositives;
+    vtkIdType FalsePositives;
+    vtkIdType FalseNegatives;
+  };
+
+  //-----------------------------------------------------------------------------
+  /// Computes overlap counts for a range of segment pairs (row-major in the reference x compare matrix)
+  class SegmentPairOverlapFunctor
+  {
+  public:
+    SegmentPairOverlapFunctor(const std::vector<PackedSegmentMask>& referenceMasks,
+      const std::vector<PackedSegmentMask>& compareMasks, std::vector<SegmentPairOverlap>& overlaps)
+      : ReferenceMasks(referenceMasks)
+      , CompareMasks(compareMasks)
+      , Overlaps(overlaps)
+    {
+    }
+
+    void operator()(vtkIdType beginPair, vtkIdType endPair)
+    {
+      const size_t numberOfCompareMasks = this->CompareMasks.size();
+      for (vtkIdType pairIndex=beginPair; pairIndex<endPair; ++pairIndex)
+      {
+        const PackedSegmentMask& referenceMask = this->ReferenceMasks[pairIndex / numberOfCompareMasks];
+        const PackedSegmentMask& compareMask = this->CompareMasks[pairIndex % numberOfCompareMasks];
+        const size_t numberOfWords = referenceMask.Bits.size();
+        vtkIdType truePositives = 0;
+        for (size_t wordIndex=0; wordIndex<numberOfWords; ++wordIndex)
+        {
+          truePositives += CountSetBits(referenceMask.Bits[wordIndex] & compareMask.Bits[wordIndex]);
+        }
+        SegmentPairOverlap& overlap = this->Overlaps[pairIndex];
+        overlap.TruePositives = truePositives;
+        overlap.FalsePositives = compareMask.NumberOfSetVoxels - truePositives;
+        overlap.FalseNegatives = referenceMask.NumberOfSetVoxels - truePositives;
+      }
+    }
+
+    const std::vector<PackedSegmentMask>& ReferenceMasks;
+    const std::vector<PackedSegmentMask>& CompareMasks;
+    std::vector<SegmentPairOverlap>& Overlaps;
+  };
+}
+
 //-----------------------------------------------------------------------------
 /// \ingroup SlicerRt_QtModules_SegmentComparison
 class vtkSlicerSegmentComparisonModuleLogicPrivate : public vtkObject
@@ -66,7 +242,17 @@ public:
     vtkMRMLSegmentComparisonNode* parameterNode,
     Plm_image::Pointer& plmRefSegmentLabelmap,
     Plm_image::Pointer& plmCmpSegmentLabelmap,
-    double &checkpointItkConvertStart);
+    double &itkConvertSeconds);
+
+  /// Determine common comparison grid of all segments of the reference and compare segmentations
+  /// and rasterize each segment onto it once, as a bit-packed mask
+  /// \return Error message, empty string if no error
+  std::string GetAllInputSegmentsAsPackedMasks(
+    vtkMRMLSegmentComparisonNode* parameterNode,
+    std::vector<PackedSegmentMask>& referenceMasks,
+    std::vector<PackedSegmentMask>& compareMasks,
+    vtkIdType& numberOfGridVoxels,
+    double& voxelVolumeCc );
 
   void SetLogic(vtkSlicerSegmentComparisonModuleLogic* logic) { this->Logic = logic; };
 
@@ -100,7 +286,7 @@ std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmV
   vtkMRMLSegmentComparisonNode* parameterNode, 
   Plm_image::Pointer& plmRefSegmentLabelmap,
   Plm_image::Pointer& plmCmpSegmentLabelmap,
-  double &checkpointItkConvertStart )
+  double &itkConvertSeconds )
 {
   if (!parameterNode || !this->Logic->GetMRMLScene())
   {
@@ -147,8 +333,7 @@ std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmV
   }
 
   // Convert inputs to ITK images
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
-  checkpointItkConvertStart = timer->GetUniversalTime();
+  vtkSlicerRtScopedTimer timer("SegmentComparison.ConvertToItk", this->Logic->GetLogSpeedMeasurements());
 
   plmRefSegmentLabelmap = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(referenceSegmentLabelmap);
   if (!plmRefSegmentLabelmap)
@@ -166,6 +351,206 @@ std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmV
     return errorMessage;
   }
 
+  timer.Stop();
+  itkConvertSeconds = timer.GetElapsedSeconds();
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetAllInputSegmentsAsPackedMasks(
+  vtkMRMLSegmentComparisonNode* parameterNode,
+  std::vector<PackedSegmentMask>& referenceMasks,
+  std::vector<PackedSegmentMask>& compareMasks,
+  vtkIdType& numberOfGridVoxels,
+  double& voxelVolumeCc )
+{
+  referenceMasks.clear();
+  compareMasks.clear();
+  numberOfGridVoxels = 0;
+  voxelVolumeCc = 0.0;
+
+  vtkMRMLSegmentationNode* segmentationNodes[2] = { parameterNode->GetReferenceSegmentationNode(), parameterNode->GetCompareSegmentationNode() };
+  std::vector<PackedSegmentMask>* masks[2] = { &referenceMasks, &compareMasks };
+
+  // Get binary labelmaps of all segments (with parent transforms applied)
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > labelmaps[2];
+  for (int segmentationIndex=0; segmentationIndex<2; ++segmentationIndex)
+  {
+    vtkMRMLSegmentationNode* segmentationNode = segmentationNodes[segmentationIndex];
+    std::vector<std::string> segmentIDs;
+    segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+    for (std::vector<std::string>::iterator segmentIdIt=segmentIDs.begin(); segmentIdIt!=segmentIDs.end(); ++segmentIdIt)
+    {
+      vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+      if (!vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(segmentationNode, *segmentIdIt, labelmap))
+      {
+        std::string errorMessage("Failed to get binary labelmap from segment: " + (*segmentIdIt));
+        vtkErrorMacro("GetAllInputSegmentsAsPackedMasks: " << errorMessage);
+        return errorMessage;
+      }
+      if ( segmentationNode->GetParentTransformNode()
+        && !vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(segmentationNode, labelmap) )
+      {
+        std::string errorMessage("Failed to apply parent transformation to segment: " + (*segmentIdIt));
+        vtkErrorMacro("GetAllInputSegmentsAsPackedMasks: " << errorMessage);
+        return errorMessage;
+      }
+      labelmaps[segmentationIndex].push_back(labelmap);
+
+      PackedSegmentMask mask;
+      mask.SegmentationName = (segmentationNode->GetName() ? segmentationNode->GetName() : "");
+      mask.SegmentID = (*segmentIdIt);
+      mask.SegmentName = segmentationNode->GetSegmentation()->GetSegment(*segmentIdIt)->GetName();
+      masks[segmentationIndex]->push_back(mask);
+    }
+  }
+  if (referenceMasks.empty() || compareMasks.empty())
+  {
+    std::string errorMessage("Reference and compare segmentations have to contain segments");
+    vtkErrorMacro("GetAllInputSegmentsAsPackedMasks: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Geometry of the common grid: rasterization reference volume if set, otherwise the first non-empty reference segment
+  vtkSmartPointer<vtkMatrix4x4> gridImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMRMLScalarVolumeNode* rasterizationReferenceVolumeNode = parameterNode->GetRasterizationReferenceVolumeNode();
+  if (rasterizationReferenceVolumeNode)
+  {
+    rasterizationReferenceVolumeNode->GetIJKToRASMatrix(gridImageToWorldMatrix);
+    vtkMRMLTransformNode* referenceVolumeParentTransformNode = rasterizationReferenceVolumeNode->GetParentTransformNode();
+    if (referenceVolumeParentTransformNode)
+    {
+      if (!referenceVolumeParentTransformNode->IsTransformToWorldLinear())
+      {
+        std::string errorMessage("Rasterization reference volume cannot be under a non-linear transform");
+        vtkErrorMacro("GetAllInputSegmentsAsPackedMasks: " << errorMessage);
+        return errorMessage;
+      }
+      vtkSmartPointer<vtkMatrix4x4> referenceVolumeRasToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      referenceVolumeParentTransformNode->GetMatrixTransformToWorld(referenceVolumeRasToWorldMatrix);
+      vtkMatrix4x4::Multiply4x4(referenceVolumeRasToWorldMatrix, gridImageToWorldMatrix, gridImageToWorldMatrix);
+    }
+  }
+  else
+  {
+    bool geometryFound = false;
+    for (int segmentationIndex=0; segmentationIndex<2 && !geometryFound; ++segmentationIndex)
+    {
+      for (size_t segmentIndex=0; segmentIndex<labelmaps[segmentationIndex].size() && !geometryFound; ++segmentIndex)
+      {
+        if (!IsLabelmapEmpty(labelmaps[segmentationIndex][segmentIndex]))
+        {
+          labelmaps[segmentationIndex][segmentIndex]->GetImageToWorldMatrix(gridImageToWorldMatrix);
+          geometryFound = true;
+        }
+      }
+    }
+    if (!geometryFound)
+    {
+      std::string errorMessage("All input segments are empty");
+      vtkErrorMacro("GetAllInputSegmentsAsPackedMasks: " << errorMessage);
+      return errorMessage;
+    }
+  }
+  vtkSmartPointer<vtkMatrix4x4> worldToGridImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Invert(gridImageToWorldMatrix, worldToGridImageMatrix);
+
+  // Extent of the common grid is the union of the segment extents
+  int gridExtent[6] = { VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN };
+  for (int segmentationIndex=0; segmentationIndex<2; ++segmentationIndex)
+  {
+    for (size_t segmentIndex=0; segmentIndex<labelmaps[segmentationIndex].size(); ++segmentIndex)
+    {
+      vtkOrientedImageData* labelmap = labelmaps[segmentationIndex][segmentIndex];
+      if (IsLabelmapEmpty(labelmap))
+      {
+        continue;
+      }
+      vtkSmartPointer<vtkMatrix4x4> labelmapToGridImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+      labelmap->GetImageToWorldMatrix(labelmapToGridImageMatrix);
+      vtkMatrix4x4::Multiply4x4(worldToGridImageMatrix, labelmapToGridImageMatrix, labelmapToGridImageMatrix);
+      int* labelmapExtent = labelmap->GetExtent();
+      for (int corner=0; corner<8; ++corner)
+      {
+        double cornerIjk[4] = { (double)labelmapExtent[(corner&1) ? 1 : 0], (double)labelmapExtent[(corner&2) ? 3 : 2],
+          (double)labelmapExtent[(corner&4) ? 5 : 4], 1.0 };
+        double cornerGridIjk[4] = { 0.0, 0.0, 0.0, 1.0 };
+        labelmapToGridImageMatrix->MultiplyPoint(cornerIjk, cornerGridIjk);
+        for (int axis=0; axis<3; ++axis)
+        {
+          gridExtent[2*axis] = std::min(gridExtent[2*axis], (int)std::floor(cornerGridIjk[axis]));
+          gridExtent[2*axis+1] = std::max(gridExtent[2*axis+1], (int)std::ceil(cornerGridIjk[axis]));
+        }
+      }
+    }
+  }
+  if (gridExtent[0] > gridExtent[1])
+  {
+    std::string errorMessage("All input segments are empty");
+    vtkErrorMacro("GetAllInputSegmentsAsPackedMasks: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkSmartPointer<vtkOrientedImageData> gridImage = vtkSmartPointer<vtkOrientedImageData>::New();
+  gridImage->SetExtent(gridExtent);
+  gridImage->SetGeometryFromImageToWorldMatrix(gridImageToWorldMatrix);
+  numberOfGridVoxels = static_cast<vtkIdType>(gridExtent[1]-gridExtent[0]+1)
+    * static_cast<vtkIdType>(gridExtent[3]-gridExtent[2]+1) * static_cast<vtkIdType>(gridExtent[5]-gridExtent[4]+1);
+  double gridSpacing[3] = { 1.0, 1.0, 1.0 };
+  gridImage->GetSpacing(gridSpacing);
+  voxelVolumeCc = gridSpacing[0] * gridSpacing[1] * gridSpacing[2] / 1000.0;
+
+  // Rasterize each segment once onto the common grid and pack it into bits
+  const vtkIdType numberOfWords = (numberOfGridVoxels + SEGMENT_MASK_WORD_BITS - 1) / SEGMENT_MASK_WORD_BITS;
+  for (int segmentationIndex=0; segmentationIndex<2; ++segmentationIndex)
+  {
+    for (size_t segmentIndex=0; segmentIndex<labelmaps[segmentationIndex].size(); ++segmentIndex)
+    {
+      PackedSegmentMask& mask = (*masks[segmentationIndex])[segmentIndex];
+      mask.Bits.assign(numberOfWords, 0);
+      vtkOrientedImageData* labelmap = labelmaps[segmentationIndex][segmentIndex];
+      if (IsLabelmapEmpty(labelmap))
+      {
+        continue;
+      }
+
+      vtkSmartPointer<vtkOrientedImageData> resampledLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+      if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(labelmap, gridImage, resampledLabelmap))
+      {
+        std::string errorMessage("Failed to resample segment to common grid: " + mask.SegmentID);
+        vtkErrorMacro("GetAllInputSegmentsAsPackedMasks: " << errorMessage);
+        return errorMessage;
+      }
+      // Make sure the voxels are laid out exactly as in the common grid
+      vtkImageData* gridLabelmap = resampledLabelmap;
+      vtkSmartPointer<vtkImageConstantPad> padder;
+      int* resampledExtent = resampledLabelmap->GetExtent();
+      if ( resampledExtent[0] != gridExtent[0] || resampledExtent[1] != gridExtent[1] || resampledExtent[2] != gridExtent[2]
+        || resampledExtent[3] != gridExtent[3] || resampledExtent[4] != gridExtent[4] || resampledExtent[5] != gridExtent[5] )
+      {
+        padder = vtkSmartPointer<vtkImageConstantPad>::New();
+        padder->SetInputData(resampledLabelmap);
+        padder->SetOutputWholeExtent(gridExtent);
+        padder->SetConstant(0);
+        padder->Update();
+        gridLabelmap = padder->GetOutput();
+      }
+
+      switch (gridLabelmap->GetScalarType())
+      {
+        vtkTemplateMacro( mask.NumberOfSetVoxels = PackSegmentMask(
+          static_cast<VTK_TT*>(gridLabelmap->GetScalarPointer()), numberOfGridVoxels, mask.Bits ) );
+        default:
+        {
+          std::string errorMessage("Unsupported segment labelmap scalar type");
+          vtkErrorMacro("GetAllInputSegmentsAsPackedMasks: " << errorMessage);
+          return errorMessage;
+        }
+      }
+    }
+  }
+
   return "";
 }
 
@@ -295,30 +680,30 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics(vtkMRML
     return errorMessage;
   }
 
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
-  double checkpointStart = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
-  double checkpointItkConvertStart = 0.0;
+  vtkSlicerRtScopedTimer timer("SegmentComparison.ComputeDiceStatistics", this->LogSpeedMeasurements);
+  double itkConvertSeconds = 0.0;
 
   // Convert input images to the format Plastimatch can use
+  vtkSlicerRtScopedTimer convertInputsTimer("SegmentComparison.ComputeDiceStatistics.ConvertInputs", this->LogSpeedMeasurements);
   Plm_image::Pointer plmRefSegmentLabelmap;
   Plm_image::Pointer plmCmpSegmentLabelmap;
-  std::string inputToPlmResult = this->LogicPrivate->GetInputSegmentsAsPlmVolumes(parameterNode, plmRefSegmentLabelmap, plmCmpSegmentLabelmap, checkpointItkConvertStart);
+  std::string inputToPlmResult = this->LogicPrivate->GetInputSegmentsAsPlmVolumes(parameterNode, plmRefSegmentLabelmap, plmCmpSegmentLabelmap, itkConvertSeconds);
   if (!inputToPlmResult.empty())
   {
     std::string errorMessage("Error occurred during ITK conversion");
     vtkErrorMacro("ComputeDiceStatistics: " << errorMessage);
     return errorMessage;
   }
+  convertInputsTimer.Stop();
 
   // Compute Dice similarity metrics
-  double checkpointDiceStart = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointDiceStart); // Although it is used later, a warning is logged so needs to be suppressed
+  vtkSlicerRtScopedTimer diceTimer("SegmentComparison.ComputeDiceStatistics.Dice", this->LogSpeedMeasurements);
   Dice_statistics dice;
   dice.set_reference_image(plmRefSegmentLabelmap->itk_uchar());
   dice.set_compare_image(plmCmpSegmentLabelmap->itk_uchar());
 
   dice.run();
+  diceTimer.Stop();
 
   unsigned long numberOfVoxels = dice.get_true_positives() 
     + dice.get_true_negatives() + dice.get_false_positives()
@@ -408,14 +793,14 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics(vtkMRML
     tableNode->Modified();
   }
 
+  vtkSlicerRtPerformanceMonitor::AddToCounter("SegmentComparison.ComputeDiceStatistics", "Voxels", numberOfVoxels);
+  timer.Stop();
   if (this->LogSpeedMeasurements)
   {
-    double checkpointEnd = timer->GetUniversalTime();
-    UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
-    vtkDebugMacro("ComputeDiceStatistics: Total Dice computation time: " << checkpointEnd-checkpointStart << " s\n"
-      << "\tApplying transforms: " << checkpointItkConvertStart-checkpointStart << " s\n"
-      << "\tConverting from VTK to ITK: " << checkpointDiceStart-checkpointItkConvertStart << " s\n"
-      << "\tDice computation: " << checkpointEnd-checkpointDiceStart << " s");
+    vtkDebugMacro("ComputeDiceStatistics: Total Dice computation time: " << timer.GetElapsedSeconds() << " s\n"
+      << "\tApplying transforms: " << convertInputsTimer.GetElapsedSeconds()-itkConvertSeconds << " s\n"
+      << "\tConverting from VTK to ITK: " << itkConvertSeconds << " s\n"
+      << "\tDice computation: " << diceTimer.GetElapsedSeconds() << " s");
   }
 
   return "";
@@ -439,30 +824,30 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeHausdorffDistances(vtk
     return errorMessage;
   }
 
-  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
-  double checkpointStart = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
-  double checkpointItkConvertStart = 0.0;
+  vtkSlicerRtScopedTimer timer("SegmentComparison.ComputeHausdorffDistances", this->LogSpeedMeasurements);
+  double itkConvertSeconds = 0.0;
 
   // Convert input images to the format Plastimatch can use
+  vtkSlicerRtScopedTimer convertInputsTimer("SegmentComparison.ComputeHausdorffDistances.ConvertInputs", this->LogSpeedMeasurements);
   Plm_image::Pointer plmRefSegmentLabelmap;
   Plm_image::Pointer plmCmpSegmentLabelmap;
-  std::string inputToPlmResult = this->LogicPrivate->GetInputSegmentsAsPlmVolumes(parameterNode, plmRefSegmentLabelmap, plmCmpSegmentLabelmap, checkpointItkConvertStart);
+  std::string inputToPlmResult = this->LogicPrivate->GetInputSegmentsAsPlmVolumes(parameterNode, plmRefSegmentLabelmap, plmCmpSegmentLabelmap, itkConvertSeconds);
   if (!inputToPlmResult.empty())
   {
     std::string errorMessage("Error occurred during ITK conversion");
     vtkErrorMacro("ComputeHausdorffDistances: " << errorMessage);
     return errorMessage;
   }
+  convertInputsTimer.Stop();
 
   // Compute Hausdorff distances
-  double checkpointHausdorffStart = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointHausdorffStart); // Although it is used later, a warning is logged so needs to be suppressed
+  vtkSlicerRtScopedTimer hausdorffTimer("SegmentComparison.ComputeHausdorffDistances.Hausdorff", this->LogSpeedMeasurements);
   Hausdorff_distance hausdorff;
   hausdorff.set_reference_image(plmRefSegmentLabelmap->itk_uchar());
   hausdorff.set_compare_image(plmCmpSegmentLabelmap->itk_uchar());
   hausdorff.set_volume_boundary_behavior(ZERO_PADDING);
   hausdorff.run();
+  hausdorffTimer.Stop();
 
   double maximumHausdorffDistanceForBoundaryMm = hausdorff.get_boundary_hausdorff();
   double averageHausdorffDistanceForBoundaryMm = hausdorff.get_avg_average_boundary_hausdorff();
@@ -514,14 +899,118 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeHausdorffDistances(vtk
     tableNode->Modified();
   }
 
+  timer.Stop();
+  if (this->LogSpeedMeasurements)
+  {
+    vtkDebugMacro("ComputeHausdorffDistances: Total Hausdorff computation time: " << timer.GetElapsedSeconds() << " s\n"
+      << "\tApplying transforms: " << convertInputsTimer.GetElapsedSeconds()-itkConvertSeconds << " s\n"
+      << "\tConverting from VTK to ITK: " << itkConvertSeconds << " s\n"
+      << "\tHausdorff computation: " << hausdorffTimer.GetElapsedSeconds() << " s");
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatisticsForAllSegmentPairs(vtkMRMLSegmentComparisonNode* parameterNode)
+{
+  if (!parameterNode || !this->GetMRMLScene())
+  {
+    std::string errorMessage("Invalid MRML scene or parameter set node");
+    vtkErrorMacro("ComputeDiceStatisticsForAllSegmentPairs: " << errorMessage);
+    return errorMessage;
+  }
+  if (!parameterNode->GetReferenceSegmentationNode() || !parameterNode->GetCompareSegmentationNode())
+  {
+    std::string errorMessage("Invalid input segmentation selection");
+    vtkErrorMacro("ComputeDiceStatisticsForAllSegmentPairs: " << errorMessage);
+    return errorMessage;
+  }
+  vtkMRMLTableNode* tableNode = parameterNode->GetDiceMatrixTableNode();
+  if (!tableNode)
+  {
+    std::string errorMessage("Invalid Dice matrix table node");
+    vtkErrorMacro("ComputeDiceStatisticsForAllSegmentPairs: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkSlicerRtScopedTimer timer("SegmentComparison.ComputeDiceStatisticsForAllSegmentPairs", this->LogSpeedMeasurements);
+
+  // Rasterize each segment once onto the common grid
+  vtkSlicerRtScopedTimer rasterizeTimer("SegmentComparison.ComputeDiceStatisticsForAllSegmentPairs.Rasterize", this->LogSpeedMeasurements);
+  std::vector<PackedSegmentMask> referenceMasks;
+  std::vector<PackedSegmentMask> compareMasks;
+  vtkIdType numberOfGridVoxels = 0;
+  double voxelVolumeCc = 0.0;
+  std::string errorMessage = this->LogicPrivate->GetAllInputSegmentsAsPackedMasks(
+    parameterNode, referenceMasks, compareMasks, numberOfGridVoxels, voxelVolumeCc );
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+
+  // Compute overlap counts of all pairs in parallel
+  rasterizeTimer.Stop();
+  vtkSlicerRtScopedTimer overlapTimer("SegmentComparison.ComputeDiceStatisticsForAllSegmentPairs.Overlap", this->LogSpeedMeasurements);
+  vtkIdType numberOfPairs = static_cast<vtkIdType>(referenceMasks.size() * compareMasks.size());
+  std::vector<SegmentPairOverlap> overlaps(numberOfPairs);
+  SegmentPairOverlapFunctor functor(referenceMasks, compareMasks, overlaps);
+  vtkSMPTools::For(0, numberOfPairs, 1, functor);
+  overlapTimer.Stop();
+  vtkSlicerRtPerformanceMonitor::AddToCounter("SegmentComparison.ComputeDiceStatisticsForAllSegmentPairs", "Voxels",
+    static_cast<double>(numberOfGridVoxels) * numberOfPairs);
+
+  // Set results to table node, one row per pair
+  vtkSlicerRtScopedTimer tableTimer("SegmentComparison.ComputeDiceStatisticsForAllSegmentPairs.Table", this->LogSpeedMeasurements);
+  tableNode->SetUseColumnNameAsColumnHeader(true);
+  tableNode->RemoveAllColumns();
+  const char* columnNames[] = { "Reference segmentation", "Reference segment", "Compare segmentation", "Compare segment",
+    "Dice coefficient", "True positives (%)", "True negatives (%)", "False positives (%)", "False negatives (%)",
+    "Reference volume (cc)", "Compare volume (cc)" };
+  const int numberOfColumns = sizeof(columnNames) / sizeof(columnNames[0]);
+  std::vector<vtkStringArray*> columns;
+  for (int columnIndex=0; columnIndex<numberOfColumns; ++columnIndex)
+  {
+    vtkStringArray* column = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+    column->SetName(columnNames[columnIndex]);
+    column->SetNumberOfValues(numberOfPairs);
+    columns.push_back(column);
+  }
+  for (vtkIdType pairIndex=0; pairIndex<numberOfPairs; ++pairIndex)
+  {
+    const PackedSegmentMask& referenceMask = referenceMasks[pairIndex / compareMasks.size()];
+    const PackedSegmentMask& compareMask = compareMasks[pairIndex % compareMasks.size()];
+    const SegmentPairOverlap& overlap = overlaps[pairIndex];
+    vtkIdType trueNegatives = numberOfGridVoxels - overlap.TruePositives - overlap.FalsePositives - overlap.FalseNegatives;
+    vtkIdType sumOfSizes = referenceMask.NumberOfSetVoxels + compareMask.NumberOfSetVoxels;
+    double diceCoefficient = (sumOfSizes > 0 ? 2.0 * overlap.TruePositives / (double)sumOfSizes : 0.0);
+
+    int column = 0;
+    columns[column++]->SetValue(pairIndex, referenceMask.SegmentationName);
+    columns[column++]->SetValue(pairIndex, referenceMask.SegmentName);
+    columns[column++]->SetValue(pairIndex, compareMask.SegmentationName);
+    columns[column++]->SetValue(pairIndex, compareMask.SegmentName);
+    columns[column++]->SetVariantValue(pairIndex, vtkVariant(diceCoefficient));
+    columns[column++]->SetVariantValue(pairIndex, vtkVariant(overlap.TruePositives * 100.0 / (double)numberOfGridVoxels));
+    columns[column++]->SetVariantValue(pairIndex, vtkVariant(trueNegatives * 100.0 / (double)numberOfGridVoxels));
+    columns[column++]->SetVariantValue(pairIndex, vtkVariant(overlap.FalsePositives * 100.0 / (double)numberOfGridVoxels));
+    columns[column++]->SetVariantValue(pairIndex, vtkVariant(overlap.FalseNegatives * 100.0 / (double)numberOfGridVoxels));
+    columns[column++]->SetVariantValue(pairIndex, vtkVariant(referenceMask.NumberOfSetVoxels * voxelVolumeCc));
+    columns[column++]->SetVariantValue(pairIndex, vtkVariant(compareMask.NumberOfSetVoxels * voxelVolumeCc));
+  }
+
+  // Trigger UI update
+  tableNode->Modified();
+
+  tableTimer.Stop();
+  timer.Stop();
   if (this->LogSpeedMeasurements)
   {
-    double checkpointEnd = timer->GetUniversalTime();
-    UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
-    vtkDebugMacro("ComputeHausdorffDistances: Total Hausdorff computation time: " << checkpointEnd-checkpointStart << " s\n"
-      << "\tApplying transforms: " << checkpointItkConvertStart-checkpointStart << " s\n"
-      << "\tConverting from VTK to ITK: " << checkpointHausdorffStart-checkpointItkConvertStart << " s\n"
-      << "\tHausdorff computation: " << checkpointEnd-checkpointHausdorffStart << " s");
+    vtkDebugMacro("ComputeDiceStatisticsForAllSegmentPairs: Total Dice matrix computation time ("
+      << referenceMasks.size() << "x" << compareMasks.size() << " segments): " << timer.GetElapsedSeconds() << " s\n"
+      << "\tRasterizing segments to common grid: " << rasterizeTimer.GetElapsedSeconds() << " s\n"
+      << "\tOverlap computation: " << overlapTimer.GetElapsedSeconds() << " s\n"
+      << "\tFilling table: " << tableTimer.GetElapsedSeconds() << " s");
   }
 
   return "";
@@ -53,6 +53,16 @@ public:
   /// \return Error message, empty string if no error
   std::string ComputeHausdorffDistances(vtkMRMLSegmentComparisonNode* parameterNode);
 
+  /// Compute Dice statistics for all pairs of segments in the reference and compare segmentations (NxM matrix).
+  /// Each segment is rasterized once onto a common grid (geometry of the rasterization reference volume if set,
+  /// otherwise of the first reference segment, extent covering all segments), and the overlaps of all pairs are
+  /// computed in parallel on bit-packed masks. True negatives are counted within the common grid.
+  /// Parent transforms of the segmentations and of the rasterization reference volume are applied, the latter
+  /// needs to be linear.
+  /// Results are written into the Dice matrix table node, one row per segment pair.
+  /// \return Error message, empty string if no error
+  std::string ComputeDiceStatisticsForAllSegmentPairs(vtkMRMLSegmentComparisonNode* parameterNode);
+
 public:
   vtkGetMacro(LogSpeedMeasurements, bool);
   vtkSetMacro(LogSpeedMeasurements, bool);
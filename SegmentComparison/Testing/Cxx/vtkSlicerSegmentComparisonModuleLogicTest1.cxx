@@ -31,16 +31,23 @@
 #include "vtkPlanarContourToClosedSurfaceConversionRule.h"
 
 // SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegment.h"
+#include "vtkSegmentation.h"
+#include "vtkSegmentationConverter.h"
 #include "vtkSegmentationConverterFactory.h"
 
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLLinearTransformNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkNew.h>
 #include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -49,6 +56,7 @@
 #include <vtksys/SystemTools.hxx>
 
 bool CheckIfResultIsWithinOneTenthPercentFromBaseline(double result, double baseline);
+int TestDiceMatrixWithKnownOverlaps(vtkMRMLScene* mrmlScene, vtkSlicerSegmentComparisonModuleLogic* segmentComparisonLogic);
 
 //-----------------------------------------------------------------------------
 int vtkSlicerSegmentComparisonModuleLogicTest1( int argc, char * argv[] )
@@ -449,9 +457,152 @@ int vtkSlicerSegmentComparisonModuleLogicTest1( int argc, char * argv[] )
     result = EXIT_FAILURE;
   }
 
+  // Compute Dice matrix for all segment pairs (single pair here), which has to agree with the plastimatch Dice
+  vtkSmartPointer<vtkMRMLTableNode> diceMatrixTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  mrmlScene->AddNode(diceMatrixTableNode);
+  paramNode->SetAndObserveDiceMatrixTableNode(diceMatrixTableNode);
+  std::string errorMessageDiceMatrix = segmentComparisonLogic->ComputeDiceStatisticsForAllSegmentPairs(paramNode);
+  if (!errorMessageDiceMatrix.empty() || diceMatrixTableNode->GetNumberOfRows() != 1)
+  {
+    std::cerr << "Failed to compute Dice matrix: " << errorMessageDiceMatrix << std::endl;
+    return EXIT_FAILURE;
+  }
+  double resultMatrixDiceCoefficient = vtkVariant(diceMatrixTableNode->GetCellText(0, 4)).ToDouble();
+  if (fabs(resultMatrixDiceCoefficient - resultDiceCoefficient) > 0.01)
+  {
+    std::cerr << "Dice matrix coefficient mismatch: " << resultMatrixDiceCoefficient << " instead of " << resultDiceCoefficient << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  if (TestDiceMatrixWithKnownOverlaps(mrmlScene, segmentComparisonLogic) != EXIT_SUCCESS)
+  {
+    result = EXIT_FAILURE;
+  }
+
   return result;
 }
 
+//-----------------------------------------------------------------------------
+// Add segment with a box labelmap on a 1mm grid at the origin. Empty box (first > last) gives an empty segment
+void AddBoxSegment(vtkMRMLSegmentationNode* segmentationNode, const char* segmentName, int boxExtent[6])
+{
+  vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  labelmap->SetExtent(boxExtent);
+  labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  if (labelmap->GetNumberOfPoints() > 0)
+  {
+    labelmap->GetPointData()->GetScalars()->FillComponent(0, 1);
+  }
+
+  vtkSmartPointer<vtkSegment> segment = vtkSmartPointer<vtkSegment>::New();
+  segment->SetName(segmentName);
+  segment->AddRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), labelmap);
+  segmentationNode->GetSegmentation()->AddSegment(segment, segmentName);
+}
+
+//-----------------------------------------------------------------------------
+// Check Dice matrix rows (reference segment major) against expected coefficients
+bool CheckDiceMatrix(vtkMRMLTableNode* diceMatrixTableNode, const double expectedDiceCoefficients[6], const char* description)
+{
+  if (diceMatrixTableNode->GetNumberOfRows() != 6)
+  {
+    std::cerr << "Dice matrix (" << description << ") has " << diceMatrixTableNode->GetNumberOfRows() << " rows instead of 6" << std::endl;
+    return false;
+  }
+  bool valid = true;
+  for (int row=0; row<6; ++row)
+  {
+    double diceCoefficient = vtkVariant(diceMatrixTableNode->GetCellText(row, 4)).ToDouble();
+    if (fabs(diceCoefficient - expectedDiceCoefficients[row]) > 1.0e-6)
+    {
+      std::cerr << "Dice matrix (" << description << ") coefficient mismatch for " << diceMatrixTableNode->GetCellText(row, 1)
+        << " - " << diceMatrixTableNode->GetCellText(row, 3) << ": " << diceCoefficient << " instead of " << expectedDiceCoefficients[row] << std::endl;
+      valid = false;
+    }
+  }
+  return valid;
+}
+
+//-----------------------------------------------------------------------------
+// Compute Dice matrix of 2x3 box segments with known overlaps, one of the compare segments being empty,
+// without and with a translation applied to the compare segmentation
+int TestDiceMatrixWithKnownOverlaps(vtkMRMLScene* mrmlScene, vtkSlicerSegmentComparisonModuleLogic* segmentComparisonLogic)
+{
+  // Reference: two adjacent boxes of 4x2x1 voxels
+  vtkSmartPointer<vtkMRMLSegmentationNode> referenceSegmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+  referenceSegmentationNode->SetName("BoxReference");
+  mrmlScene->AddNode(referenceSegmentationNode);
+  referenceSegmentationNode->GetSegmentation()->SetMasterRepresentationName(
+    vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() );
+  int reference1Extent[6] = { 0,3, 0,1, 0,0 };
+  AddBoxSegment(referenceSegmentationNode, "R1", reference1Extent);
+  int reference2Extent[6] = { 4,7, 0,1, 0,0 };
+  AddBoxSegment(referenceSegmentationNode, "R2", reference2Extent);
+
+  // Compare: same box as R1, box overlapping half of R1 and half of R2, and an empty segment
+  vtkSmartPointer<vtkMRMLSegmentationNode> compareSegmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+  compareSegmentationNode->SetName("BoxCompare");
+  mrmlScene->AddNode(compareSegmentationNode);
+  compareSegmentationNode->GetSegmentation()->SetMasterRepresentationName(
+    vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() );
+  int compare1Extent[6] = { 0,3, 0,1, 0,0 };
+  AddBoxSegment(compareSegmentationNode, "C1", compare1Extent);
+  int compare2Extent[6] = { 2,5, 0,1, 0,0 };
+  AddBoxSegment(compareSegmentationNode, "C2", compare2Extent);
+  int emptyExtent[6] = { 0,-1, 0,-1, 0,-1 };
+  AddBoxSegment(compareSegmentationNode, "C3", emptyExtent);
+
+  vtkSmartPointer<vtkMRMLSegmentComparisonNode> paramNode = vtkSmartPointer<vtkMRMLSegmentComparisonNode>::New();
+  mrmlScene->AddNode(paramNode);
+  paramNode->SetAndObserveReferenceSegmentationNode(referenceSegmentationNode);
+  paramNode->SetAndObserveCompareSegmentationNode(compareSegmentationNode);
+  vtkSmartPointer<vtkMRMLTableNode> diceMatrixTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  mrmlScene->AddNode(diceMatrixTableNode);
+  paramNode->SetAndObserveDiceMatrixTableNode(diceMatrixTableNode);
+
+  std::string errorMessage = segmentComparisonLogic->ComputeDiceStatisticsForAllSegmentPairs(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "Failed to compute Dice matrix of box segments: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Rows: R1-C1, R1-C2, R1-C3, R2-C1, R2-C2, R2-C3
+  const double expectedDiceCoefficients[6] = { 1.0, 0.5, 0.0, 0.0, 0.5, 0.0 };
+  if (!CheckDiceMatrix(diceMatrixTableNode, expectedDiceCoefficients, "box segments"))
+  {
+    return EXIT_FAILURE;
+  }
+  if ( fabs(vtkVariant(diceMatrixTableNode->GetCellText(0, 9)).ToDouble() - 0.008) > 1.0e-6
+    || vtkVariant(diceMatrixTableNode->GetCellText(2, 10)).ToDouble() != 0.0 )
+  {
+    std::cerr << "Dice matrix segment volume mismatch: " << diceMatrixTableNode->GetCellText(0, 9) << " and "
+      << diceMatrixTableNode->GetCellText(2, 10) << " instead of 0.008 and 0" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Translate compare segmentation by 4mm along X, which moves C1 onto R2 and C2 to overlap half of R2 only
+  vtkSmartPointer<vtkMatrix4x4> translationMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  translationMatrix->SetElement(0, 3, 4.0);
+  vtkSmartPointer<vtkMRMLLinearTransformNode> translationTransformNode = vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
+  mrmlScene->AddNode(translationTransformNode);
+  translationTransformNode->SetMatrixTransformToParent(translationMatrix);
+  compareSegmentationNode->SetAndObserveTransformNodeID(translationTransformNode->GetID());
+
+  errorMessage = segmentComparisonLogic->ComputeDiceStatisticsForAllSegmentPairs(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "Failed to compute Dice matrix of transformed box segments: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  const double expectedTransformedDiceCoefficients[6] = { 0.0, 0.0, 0.0, 1.0, 0.5, 0.0 };
+  if (!CheckDiceMatrix(diceMatrixTableNode, expectedTransformedDiceCoefficients, "transformed box segments"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
 //-----------------------------------------------------------------------------
 bool CheckIfResultIsWithinOneTenthPercentFromBaseline(double result, double baseline)
 {
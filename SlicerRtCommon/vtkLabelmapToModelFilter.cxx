@@ -20,6 +20,9 @@
 
 #include "vtkLabelmapToModelFilter.h"
 
+// SlicerRT includes
+#include "vtkSlicerRtPerformanceMonitor.h"
+
 // VTK includes
 #include <vtkVersion.h>
 #include <vtkObjectFactory.h>
@@ -27,7 +30,128 @@
 #include <vtkNew.h>
 #include <vtkMarchingCubes.h>
 #include <vtkDecimatePro.h>
-#include <vtkVersion.h>
+#include <vtkExtractVOI.h>
+#include <vtkFlyingEdges3D.h>
+#include <vtkPointData.h>
+#include <vtkQuadricClustering.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  //---------------------------------------------------------------------------
+  /// Bounding extent of voxels that are not below the isovalue
+  struct LabelExtent
+  {
+    int Extent[6];
+
+    void Reset()
+    {
+      this->Extent[0] = this->Extent[2] = this->Extent[4] = VTK_INT_MAX;
+      this->Extent[1] = this->Extent[3] = this->Extent[5] = VTK_INT_MIN;
+    }
+    void AddVoxel(int i, int j, int k)
+    {
+      this->Extent[0] = std::min(this->Extent[0], i);
+      this->Extent[1] = std::max(this->Extent[1], i);
+      this->Extent[2] = std::min(this->Extent[2], j);
+      this->Extent[3] = std::max(this->Extent[3], j);
+      this->Extent[4] = std::min(this->Extent[4], k);
+      this->Extent[5] = std::max(this->Extent[5], k);
+    }
+    void Merge(const LabelExtent& other)
+    {
+      for (int axis=0; axis<3; ++axis)
+      {
+        this->Extent[2*axis] = std::min(this->Extent[2*axis], other.Extent[2*axis]);
+        this->Extent[2*axis+1] = std::max(this->Extent[2*axis+1], other.Extent[2*axis+1]);
+      }
+    }
+  };
+
+  //---------------------------------------------------------------------------
+  /// Compute label extent slice by slice. Only the first and last label voxel of each row is searched for
+  template <class T> class LabelExtentFunctor
+  {
+  public:
+    LabelExtentFunctor(vtkImageData* imageData, double isoValue)
+      : ImageData(imageData)
+      , IsoValue(isoValue)
+    {
+      this->ImageData->GetExtent(this->WholeExtent);
+      this->Result.Reset();
+    }
+
+    void Initialize()
+    {
+      this->LocalExtent.Local().Reset();
+    }
+
+    void operator()(vtkIdType beginSlice, vtkIdType endSlice)
+    {
+      LabelExtent& localExtent = this->LocalExtent.Local();
+      for (vtkIdType slice=beginSlice; slice<endSlice; ++slice)
+      {
+        int k = this->WholeExtent[4] + (int)slice;
+        for (int j=this->WholeExtent[2]; j<=this->WholeExtent[3]; ++j)
+        {
+          T* row = static_cast<T*>(this->ImageData->GetScalarPointer(this->WholeExtent[0], j, k));
+          int rowLength = this->WholeExtent[1] - this->WholeExtent[0] + 1;
+          int first = 0;
+          while (first < rowLength && (double)row[first] < this->IsoValue)
+          {
+            ++first;
+          }
+          if (first == rowLength)
+          {
+            continue;
+          }
+          int last = rowLength - 1;
+          while ((double)row[last] < this->IsoValue)
+          {
+            --last;
+          }
+          localExtent.AddVoxel(this->WholeExtent[0] + first, j, k);
+          localExtent.AddVoxel(this->WholeExtent[0] + last, j, k);
+        }
+      }
+    }
+
+    void Reduce()
+    {
+      for (typename vtkSMPThreadLocal<LabelExtent>::iterator it = this->LocalExtent.begin(); it != this->LocalExtent.end(); ++it)
+      {
+        this->Result.Merge(*it);
+      }
+    }
+
+    const LabelExtent& GetResult()
+    {
+      return this->Result;
+    }
+
+  private:
+    vtkImageData* ImageData;
+    double IsoValue;
+    int WholeExtent[6];
+    vtkSMPThreadLocal<LabelExtent> LocalExtent;
+    LabelExtent Result;
+  };
+
+  //---------------------------------------------------------------------------
+  template <class T> void ComputeLabelExtentTemplate(vtkImageData* imageData, T*, double isoValue, LabelExtent& labelExtent)
+  {
+    int* extent = imageData->GetExtent();
+    LabelExtentFunctor<T> functor(imageData, isoValue);
+    vtkSMPTools::For(0, extent[5] - extent[4] + 1, functor);
+    labelExtent = functor.GetResult();
+  }
+}
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkLabelmapToModelFilter);
@@ -45,6 +169,12 @@ vtkLabelmapToModelFilter::vtkLabelmapToModelFilter()
 
   this->SetDecimateTargetReduction(0.0);
   this->SetLabelValue(1.0);
+  this->UseFlyingEdges = false;
+  this->RestrictToLabelExtent = true;
+  this->DecimationMethod = DecimatePro;
+  this->TargetNumberOfTriangles = 0;
+  this->LastExtractionTime = 0.0;
+  this->LastDecimationTime = 0.0;
 }
 
 //----------------------------------------------------------------------------
@@ -58,6 +188,12 @@ vtkLabelmapToModelFilter::~vtkLabelmapToModelFilter()
 void vtkLabelmapToModelFilter::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "DecimateTargetReduction: " << this->DecimateTargetReduction << "\n";
+  os << indent << "LabelValue: " << this->LabelValue << "\n";
+  os << indent << "UseFlyingEdges: " << (this->UseFlyingEdges ? "true" : "false") << "\n";
+  os << indent << "RestrictToLabelExtent: " << (this->RestrictToLabelExtent ? "true" : "false") << "\n";
+  os << indent << "DecimationMethod: " << (this->DecimationMethod == QuadricClustering ? "QuadricClustering" : "DecimatePro") << "\n";
+  os << indent << "TargetNumberOfTriangles: " << this->TargetNumberOfTriangles << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -66,6 +202,29 @@ vtkPolyData* vtkLabelmapToModelFilter::GetOutput()
   return this->OutputModel;
 }
 
+//----------------------------------------------------------------------------
+bool vtkLabelmapToModelFilter::ComputeLabelExtent(double isoValue, int labelExtent[6])
+{
+  LabelExtent result;
+  result.Reset();
+  switch (this->InputLabelmap->GetScalarType())
+  {
+    vtkTemplateMacro(ComputeLabelExtentTemplate(this->InputLabelmap, static_cast<VTK_TT*>(NULL), isoValue, result));
+    default:
+      vtkErrorMacro("ComputeLabelExtent: Unsupported scalar type " << this->InputLabelmap->GetScalarTypeAsString());
+      return false;
+  }
+  if (result.Extent[0] > result.Extent[1])
+  {
+    return false;
+  }
+  for (int i=0; i<6; ++i)
+  {
+    labelExtent[i] = result.Extent[i];
+  }
+  return true;
+}
+
 //----------------------------------------------------------------------------
 void vtkLabelmapToModelFilter::Update()
 {
@@ -74,47 +233,170 @@ void vtkLabelmapToModelFilter::Update()
     vtkErrorMacro("Update: Input labelmap and output poly data have to be initialized!");
     return;
   }
+  this->LastExtractionTime = 0.0;
+  this->LastDecimationTime = 0.0;
+
+  vtkSlicerRtScopedTimer extractionTimer("LabelmapToModel.Extract", true);
+  double isoValue = this->LabelValue/2.0;
+
+  // Crop to the label with one voxel padding so that the surface is the same as on the whole labelmap
+  vtkSmartPointer<vtkImageData> surfaceInput = this->InputLabelmap;
+  int wholeExtent[6] = {0, -1, 0, -1, 0, -1};
+  this->InputLabelmap->GetExtent(wholeExtent);
+  if ( this->RestrictToLabelExtent && this->InputLabelmap->GetPointData()->GetScalars()
+    && this->InputLabelmap->GetNumberOfScalarComponents() == 1 )
+  {
+    int labelExtent[6] = {0, -1, 0, -1, 0, -1};
+    if (!this->ComputeLabelExtent(isoValue, labelExtent))
+    {
+      vtkErrorMacro("No polygons can be created!");
+      return;
+    }
+    bool cropped = false;
+    for (int axis=0; axis<3; ++axis)
+    {
+      labelExtent[2*axis] = std::max(labelExtent[2*axis] - 1, wholeExtent[2*axis]);
+      labelExtent[2*axis+1] = std::min(labelExtent[2*axis+1] + 1, wholeExtent[2*axis+1]);
+      if (labelExtent[2*axis] != wholeExtent[2*axis] || labelExtent[2*axis+1] != wholeExtent[2*axis+1])
+      {
+        cropped = true;
+      }
+    }
+    if (cropped)
+    {
+      vtkSmartPointer<vtkExtractVOI> extractVoi = vtkSmartPointer<vtkExtractVOI>::New();
+      extractVoi->SetInputData(this->InputLabelmap);
+      extractVoi->SetVOI(labelExtent);
+      extractVoi->Update();
+      surfaceInput = extractVoi->GetOutput();
+    }
+  }
 
-  // Run marching cubes
-  vtkSmartPointer<vtkMarchingCubes> marchingCubes = vtkSmartPointer<vtkMarchingCubes>::New();
-  marchingCubes->SetInputData(this->InputLabelmap);
-  marchingCubes->SetNumberOfContours(1);
-  marchingCubes->SetValue(0, this->LabelValue/2.0);
-  marchingCubes->ComputeScalarsOff();
-  marchingCubes->ComputeGradientsOff();
-  marchingCubes->ComputeNormalsOff();
+  // Extract surface
+  vtkSmartPointer<vtkPolyData> surface;
   try
   {
-    marchingCubes->Update();
+    if (this->UseFlyingEdges)
+    {
+      vtkSmartPointer<vtkFlyingEdges3D> flyingEdges = vtkSmartPointer<vtkFlyingEdges3D>::New();
+      flyingEdges->SetInputData(surfaceInput);
+      flyingEdges->SetNumberOfContours(1);
+      flyingEdges->SetValue(0, isoValue);
+      flyingEdges->ComputeScalarsOff();
+      flyingEdges->ComputeGradientsOff();
+      flyingEdges->ComputeNormalsOff();
+      flyingEdges->Update();
+      surface = flyingEdges->GetOutput();
+    }
+    else
+    {
+      // Run marching cubes
+      vtkSmartPointer<vtkMarchingCubes> marchingCubes = vtkSmartPointer<vtkMarchingCubes>::New();
+      marchingCubes->SetInputData(surfaceInput);
+      marchingCubes->SetNumberOfContours(1);
+      marchingCubes->SetValue(0, isoValue);
+      marchingCubes->ComputeScalarsOff();
+      marchingCubes->ComputeGradientsOff();
+      marchingCubes->ComputeNormalsOff();
+      marchingCubes->Update();
+      surface = marchingCubes->GetOutput();
+    }
   }
   catch(...)
   {
     vtkErrorMacro("Error while running marching cubes!");
     return;
   }
-  if (marchingCubes->GetOutput()->GetNumberOfPolys() == 0)
+  if (surface->GetNumberOfPolys() == 0)
   {
     vtkErrorMacro("No polygons can be created!");
     return;
   }
+  extractionTimer.Stop();
+  this->LastExtractionTime = extractionTimer.GetElapsedSeconds();
+  vtkSlicerRtPerformanceMonitor::AddToCounter("LabelmapToModel.Extract", "Triangles", surface->GetNumberOfPolys());
 
   // Decimate
-  vtkSmartPointer<vtkDecimatePro> decimator = vtkSmartPointer<vtkDecimatePro>::New();
-  decimator->SetInputData(marchingCubes->GetOutput() );
-  decimator->SetFeatureAngle(60);
-  decimator->SplittingOff();
-  decimator->PreserveTopologyOn();
-  decimator->SetMaximumError(1);
-  decimator->SetTargetReduction(this->DecimateTargetReduction);
+  vtkSlicerRtScopedTimer decimationTimer("LabelmapToModel.Decimate", true);
+  vtkIdType numberOfInputTriangles = surface->GetNumberOfPolys();
+  double targetReduction = this->DecimateTargetReduction;
+  if (this->TargetNumberOfTriangles > 0)
+  {
+    targetReduction = std::max(0.0, 1.0 - (double)this->TargetNumberOfTriangles / (double)numberOfInputTriangles);
+  }
+  if (targetReduction <= 0.0)
+  {
+    this->OutputModel->ShallowCopy(surface);
+    return;
+  }
+
+  vtkSmartPointer<vtkPolyData> decimatedSurface;
   try
   {
-    decimator->Update();
+    if (this->DecimationMethod == QuadricClustering)
+    {
+      // Number of triangles after clustering is roughly proportional to the number of occupied cells on the surface,
+      // so the cell size is scaled by the square root of the reduction factor relative to the voxel size.
+      // If the triangle budget is still exceeded, then the cells are enlarged by the same rule
+      double spacing[3] = {1.0, 1.0, 1.0};
+      surfaceInput->GetSpacing(spacing);
+      double bounds[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+      surface->GetBounds(bounds);
+      double cellScale = 1.0 / sqrt(std::max(1.0 - targetReduction, 1e-6));
+      const int maximumNumberOfClusteringIterations = 10;
+      for (int iteration=0; iteration<maximumNumberOfClusteringIterations; ++iteration)
+      {
+        int numberOfDivisions[3] = {1, 1, 1};
+        for (int axis=0; axis<3; ++axis)
+        {
+          double cellSize = fabs(spacing[axis]) * cellScale;
+          numberOfDivisions[axis] = std::max(2, (int)ceil((bounds[2*axis+1] - bounds[2*axis]) / cellSize));
+        }
+        vtkSmartPointer<vtkQuadricClustering> quadricClustering = vtkSmartPointer<vtkQuadricClustering>::New();
+        quadricClustering->SetInputData(surface);
+        quadricClustering->AutoAdjustNumberOfDivisionsOff();
+        quadricClustering->SetNumberOfDivisions(numberOfDivisions);
+        quadricClustering->UseInputPointsOff();
+        quadricClustering->CopyCellDataOff();
+        quadricClustering->Update();
+        decimatedSurface = quadricClustering->GetOutput();
+        vtkIdType numberOfTriangles = decimatedSurface->GetNumberOfPolys();
+        if (this->TargetNumberOfTriangles <= 0 || numberOfTriangles <= this->TargetNumberOfTriangles)
+        {
+          break;
+        }
+        cellScale *= 1.1 * sqrt((double)numberOfTriangles / (double)this->TargetNumberOfTriangles);
+      }
+    }
+    else
+    {
+      vtkSmartPointer<vtkDecimatePro> decimatePro = vtkSmartPointer<vtkDecimatePro>::New();
+      decimatePro->SetInputData(surface);
+      decimatePro->SetFeatureAngle(60);
+      decimatePro->SplittingOff();
+      decimatePro->PreserveTopologyOn();
+      decimatePro->SetMaximumError(1);
+      decimatePro->SetTargetReduction(targetReduction);
+      decimatePro->Update();
+      if (this->TargetNumberOfTriangles > 0 && decimatePro->GetOutput()->GetNumberOfPolys() > this->TargetNumberOfTriangles)
+      {
+        // Preserving the topology can stop the reduction early. The budget can only be guaranteed without it
+        decimatePro->PreserveTopologyOff();
+        decimatePro->SplittingOn();
+        decimatePro->BoundaryVertexDeletionOn();
+        decimatePro->SetMaximumError(VTK_DOUBLE_MAX);
+        decimatePro->Update();
+      }
+      decimatedSurface = decimatePro->GetOutput();
+    }
   }
   catch(...)
   {
     vtkErrorMacro("Error decimating model");
     return;
   }
+  decimationTimer.Stop();
+  this->LastDecimationTime = decimationTimer.GetElapsedSeconds();
 
-  this->OutputModel->ShallowCopy(decimator->GetOutput());
-} 
\ No newline at end of file
+  this->OutputModel->ShallowCopy(decimatedSurface);
+}
@@ -35,8 +35,24 @@
 #include "vtkSlicerRtCommonWin32Header.h"
 
 /// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Create surface model from labelmap
+///
+/// By default the surface is extracted with marching cubes and decimated with vtkDecimatePro.
+/// For large labelmaps the faster path can be selected: threaded flying edges extraction
+/// (\sa UseFlyingEdges) and quadric clustering decimation (\sa DecimationMethod). Extraction is
+/// restricted to the bounding extent of the label (\sa RestrictToLabelExtent), which does not change
+/// the output. The size of the output can be limited by \sa TargetNumberOfTriangles.
 class VTK_SLICERRTCOMMON_EXPORT vtkLabelmapToModelFilter : public vtkObject
 {
+public:
+  enum DecimationMethodType
+  {
+    /// Topology preserving decimation (vtkDecimatePro). Accurate, but slow for large surfaces
+    DecimatePro = 0,
+    /// Vertex clustering on a uniform grid (vtkQuadricClustering). Linear time, suitable for large surfaces
+    QuadricClustering
+  };
+
 public:
 
   static vtkLabelmapToModelFilter *New();
@@ -55,15 +71,48 @@ public:
   vtkGetMacro(LabelValue, double);
   vtkSetMacro(LabelValue, double);
 
+  /// Use multithreaded flying edges instead of marching cubes for surface extraction. Off by default
+  vtkGetMacro(UseFlyingEdges, bool);
+  vtkSetMacro(UseFlyingEdges, bool);
+  vtkBooleanMacro(UseFlyingEdges, bool);
+
+  /// Only process the bounding extent of the label (padded by one voxel). On by default
+  vtkGetMacro(RestrictToLabelExtent, bool);
+  vtkSetMacro(RestrictToLabelExtent, bool);
+  vtkBooleanMacro(RestrictToLabelExtent, bool);
+
+  /// Decimation method. DecimatePro by default
+  vtkGetMacro(DecimationMethod, int);
+  vtkSetMacro(DecimationMethod, int);
+
+  /// Maximum number of triangles in the output. If positive, then it overrides \sa DecimateTargetReduction.
+  /// If topology preserving decimation cannot reach it, then the topology is not preserved. Zero by default
+  vtkGetMacro(TargetNumberOfTriangles, vtkIdType);
+  vtkSetMacro(TargetNumberOfTriangles, vtkIdType);
+
+  /// Get time spent in surface extraction and decimation during the last update (in seconds)
+  vtkGetMacro(LastExtractionTime, double);
+  vtkGetMacro(LastDecimationTime, double);
+
 protected:
   vtkSetObjectMacro(OutputModel, vtkPolyData);
 
+  /// Compute the extent of the voxels that are not below the isovalue, in parallel
+  /// \return False if there are no such voxels
+  bool ComputeLabelExtent(double isoValue, int labelExtent[6]);
+
 protected:
   vtkImageData* InputLabelmap;
   vtkPolyData* OutputModel;
   double DecimateTargetReduction;
   /// Use this value for the marching cubes
   double LabelValue;
+  bool UseFlyingEdges;
+  bool RestrictToLabelExtent;
+  int DecimationMethod;
+  vtkIdType TargetNumberOfTriangles;
+  double LastExtractionTime;
+  double LastDecimationTime;
 
 protected:
   vtkLabelmapToModelFilter();
@@ -20,17 +20,21 @@
 
 #include "vtkPolyDataToLabelmapFilter.h"
 
+// SlicerRT includes
+#include "vtkSlicerRtPerformanceMonitor.h"
+
 #include <algorithm>
 #include <math.h>
 
 // VTK includes
 #include <vtkVersion.h>
-#include <vtkImageCast.h>
 #include <vtkImageStencil.h>
+#include <vtkImageStencilData.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkPolyDataNormals.h>
 #include <vtkPolyDataToImageStencil.h>
+#include <vtkSMPTools.h>
 #include <vtkSmartPointer.h>
 #include <vtkStripper.h>
 #include <vtkTriangleFilter.h>
@@ -39,6 +43,9 @@
 
 namespace
 {
+  /// Number of slices rasterized by one stencil source in the parallel section
+  const int RASTERIZE_SLAB_SLICES = 4;
+
   bool areExtentsEqual(int extentsA[6], int extentsB[6])
   {
     return extentsA[0] == extentsB[0] &&
@@ -48,6 +55,74 @@ namespace
       extentsA[4] == extentsB[4] &&
       extentsA[5] == extentsB[5];
   }
+
+  //----------------------------------------------------------------------------
+  /// Rasterize slabs of slices. Each slab gets its own stencil source on a shallow copy of the surface,
+  /// and writes the label value directly to the rows of the output within the stencil extents.
+  template <class T> class RasterizeSlabFunctor
+  {
+  public:
+    RasterizeSlabFunctor(vtkPolyData* closedSurface, vtkImageData* labelmap, T labelValue)
+      : ClosedSurface(closedSurface)
+      , Labelmap(labelmap)
+      , LabelValue(labelValue)
+    {
+    }
+
+    void operator()(vtkIdType beginSlab, vtkIdType endSlab)
+    {
+      int extent[6] = {0, -1, 0, -1, 0, -1};
+      this->Labelmap->GetExtent(extent);
+      for (vtkIdType slab=beginSlab; slab<endSlab; ++slab)
+      {
+        int slabExtent[6] = { extent[0], extent[1], extent[2], extent[3],
+          extent[4] + (int)slab * RASTERIZE_SLAB_SLICES, 0 };
+        slabExtent[5] = std::min(slabExtent[4] + RASTERIZE_SLAB_SLICES - 1, extent[5]);
+
+        vtkNew<vtkPolyData> surfaceCopy;
+        surfaceCopy->ShallowCopy(this->ClosedSurface);
+        vtkNew<vtkPolyDataToImageStencil> polyToStencil;
+        polyToStencil->SetInputData(surfaceCopy);
+        polyToStencil->SetOutputSpacing(this->Labelmap->GetSpacing());
+        polyToStencil->SetOutputOrigin(this->Labelmap->GetOrigin());
+        polyToStencil->SetOutputWholeExtent(slabExtent);
+        polyToStencil->Update();
+        vtkImageStencilData* stencilData = polyToStencil->GetOutput();
+
+        for (int k=slabExtent[4]; k<=slabExtent[5]; ++k)
+        {
+          for (int j=slabExtent[2]; j<=slabExtent[3]; ++j)
+          {
+            T* row = static_cast<T*>(this->Labelmap->GetScalarPointer(extent[0], j, k));
+            int iter = 0;
+            int r1 = 0;
+            int r2 = 0;
+            while (stencilData->GetNextExtent(r1, r2, extent[0], extent[1], j, k, iter))
+            {
+              for (int i=r1; i<=r2; ++i)
+              {
+                row[i - extent[0]] = this->LabelValue;
+              }
+            }
+          }
+        }
+      }
+    }
+
+  private:
+    vtkPolyData* ClosedSurface;
+    vtkImageData* Labelmap;
+    T LabelValue;
+  };
+
+  //----------------------------------------------------------------------------
+  template <class T> void RasterizeToLabelmapTemplate(vtkPolyData* closedSurface, vtkImageData* labelmap, T*, double labelValue)
+  {
+    int* extent = labelmap->GetExtent();
+    int numberOfSlabs = (extent[5] - extent[4] + RASTERIZE_SLAB_SLICES) / RASTERIZE_SLAB_SLICES;
+    RasterizeSlabFunctor<T> functor(closedSurface, labelmap, static_cast<T>(labelValue));
+    vtkSMPTools::For(0, numberOfSlabs, 1, functor);
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -61,6 +136,8 @@ vtkPolyDataToLabelmapFilter::vtkPolyDataToLabelmapFilter()
 , LabelValue(2)
 , BackgroundValue(0.0)
 , UseReferenceValues(true)
+, CropToInputExtent(false)
+, OutputScalarType(VTK_UNSIGNED_CHAR)
 {
   this->SetInputPolyData(vtkSmartPointer<vtkPolyData>::New());
   this->SetOutputLabelmap(vtkSmartPointer<vtkImageData>::New());
@@ -79,6 +156,11 @@ vtkPolyDataToLabelmapFilter::~vtkPolyDataToLabelmapFilter()
 void vtkPolyDataToLabelmapFilter::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "LabelValue: " << this->LabelValue << "\n";
+  os << indent << "BackgroundValue: " << this->BackgroundValue << "\n";
+  os << indent << "UseReferenceValues: " << (this->UseReferenceValues ? "true" : "false") << "\n";
+  os << indent << "CropToInputExtent: " << (this->CropToInputExtent ? "true" : "false") << "\n";
+  os << indent << "OutputScalarType: " << this->OutputScalarType << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -116,48 +198,51 @@ void vtkPolyDataToLabelmapFilter::Update()
 
   int referenceExtents[6] = {0,0,0,0,0,0};
   double origin[3] = {0,0,0};
-  std::vector<int> referenceExtentsVector;
-  std::vector<double> originVector;
-  if (!this->DeterminePolyDataReferenceOverlap(referenceExtentsVector, originVector))
+  if (!this->UseReferenceValues && this->CropToInputExtent)
   {
-    vtkErrorMacro("Unable to determine input and reference overlap.");
-    return;
-  }
-  for (int i = 0; i < 6; ++i)
-  {
-    referenceExtents[i] = referenceExtentsVector[i];
-  }
-  for (int i = 0; i < 3; ++i)
-  {
-    origin[i] = originVector[i];
-  }
-
-  vtkSmartPointer<vtkImageData> referenceImage = vtkSmartPointer<vtkImageData>::New();
-  if (this->UseReferenceValues)
-  {
-    // Use reference image
-    referenceImage->ShallowCopy(this->ReferenceImageData);
+    // Output is on the reference voxel grid, only covering the input
+    this->ReferenceImageData->GetOrigin(origin);
+    if (!this->DetermineCroppedExtent(referenceExtents))
+    {
+      // Empty input or input outside the reference extent results in empty labelmap
+      this->OutputLabelmap->Initialize();
+      this->OutputLabelmap->SetOrigin(origin);
+      this->OutputLabelmap->SetSpacing(this->ReferenceImageData->GetSpacing());
+      this->OutputLabelmap->SetExtent(0, -1, 0, -1, 0, -1);
+      return;
+    }
   }
   else
   {
-    // Blank reference image
-    referenceImage->SetExtent(referenceExtents);
-    referenceImage->SetSpacing(this->ReferenceImageData->GetSpacing());
-    referenceImage->SetOrigin(origin);
-    referenceImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
-
-    void *referenceImagePixelsPointer = referenceImage->GetScalarPointerForExtent(this->ReferenceImageData->GetExtent());
-    if (referenceImagePixelsPointer==NULL)
+    std::vector<int> referenceExtentsVector;
+    std::vector<double> originVector;
+    if (!this->DeterminePolyDataReferenceOverlap(referenceExtentsVector, originVector))
     {
-      vtkErrorMacro("ERROR: Cannot allocate memory for accumulation image");
+      vtkErrorMacro("Unable to determine input and reference overlap.");
       return;
     }
-    else
+    for (int i = 0; i < 6; ++i)
+    {
+      referenceExtents[i] = referenceExtentsVector[i];
+    }
+    for (int i = 0; i < 3; ++i)
     {
-      memset(referenceImagePixelsPointer,0,((referenceExtents[1]-referenceExtents[0]+1)*(referenceExtents[3]-referenceExtents[2]+1)*(referenceExtents[5]-referenceExtents[4]+1)*referenceImage->GetScalarSize()*referenceImage->GetNumberOfScalarComponents()));
+      origin[i] = originVector[i];
     }
   }
 
+  if (!this->UseReferenceValues)
+  {
+    // Blank labelmap with the label inside the surface
+    stripper->Update();
+    this->RasterizeToLabelmap(stripper->GetOutput(), referenceExtents, origin);
+    return;
+  }
+
+  // Use reference image
+  vtkSmartPointer<vtkImageData> referenceImage = vtkSmartPointer<vtkImageData>::New();
+  referenceImage->ShallowCopy(this->ReferenceImageData);
+
   // Convert polydata to stencil
   vtkNew<vtkPolyDataToImageStencil> polyToImage;
   polyToImage->SetInputConnection(stripper->GetOutputPort());
@@ -170,28 +255,86 @@ void vtkPolyDataToLabelmapFilter::Update()
   vtkNew<vtkImageStencil> stencil;
   stencil->SetInputData(referenceImage);
   stencil->SetStencilData(polyToImage->GetOutput());
+  stencil->ReverseStencilOff();
+  stencil->SetBackgroundValue(this->BackgroundValue);
+  stencil->Update();
+
+  this->OutputLabelmap->ShallowCopy(stencil->GetOutput());
+}
 
-  if (this->UseReferenceValues)
+//----------------------------------------------------------------------------
+void vtkPolyDataToLabelmapFilter::RasterizeToLabelmap(vtkPolyData* closedSurface, int extent[6], double origin[3])
+{
+  vtkSlicerRtScopedTimer timer("PolyDataToLabelmap.Rasterize");
+
+  vtkSmartPointer<vtkImageData> labelmap = vtkSmartPointer<vtkImageData>::New();
+  labelmap->SetExtent(extent);
+  labelmap->SetSpacing(this->ReferenceImageData->GetSpacing());
+  labelmap->SetOrigin(origin);
+  labelmap->AllocateScalars(this->OutputScalarType, 1);
+  void* labelmapPixelsPointer = labelmap->GetScalarPointer();
+  if (!labelmapPixelsPointer)
   {
-    stencil->ReverseStencilOff();
-    stencil->SetBackgroundValue(this->BackgroundValue);
-    stencil->Update();
+    vtkErrorMacro("RasterizeToLabelmap: Cannot allocate memory for labelmap");
+    return;
+  }
+  memset(labelmapPixelsPointer, 0, labelmap->GetNumberOfPoints() * labelmap->GetScalarSize());
 
-    this->OutputLabelmap->ShallowCopy(stencil->GetOutput());
+  if (closedSurface->GetNumberOfPoints() > 0)
+  {
+    // Cells and bounds are built before the parallel section so that the shallow copies used by the threads
+    // only read them. Otherwise the stencil sources would compute the bounds of the shared points concurrently
+    closedSurface->BuildCells();
+    closedSurface->ComputeBounds();
+    switch (this->OutputScalarType)
+    {
+      vtkTemplateMacro(RasterizeToLabelmapTemplate(closedSurface, labelmap, static_cast<VTK_TT*>(NULL), this->LabelValue));
+      default:
+        vtkErrorMacro("RasterizeToLabelmap: Unsupported output scalar type " << this->OutputScalarType);
+        return;
+    }
   }
-  else
+  vtkSlicerRtPerformanceMonitor::AddToCounter("PolyDataToLabelmap.Rasterize", "Voxels", labelmap->GetNumberOfPoints());
+
+  this->OutputLabelmap->ShallowCopy(labelmap);
+}
+
+//----------------------------------------------------------------------------
+bool vtkPolyDataToLabelmapFilter::DetermineCroppedExtent(int croppedExtent[6])
+{
+  if (!this->InputPolyData->GetPoints() || this->InputPolyData->GetNumberOfPoints() == 0)
   {
-    stencil->ReverseStencilOn();
-    stencil->SetBackgroundValue(this->LabelValue);
-    stencil->Update();
-
-    // Save result to output
-    vtkNew<vtkImageCast> imageCast;
-    imageCast->SetInputConnection(stencil->GetOutputPort());
-    imageCast->SetOutputScalarTypeToUnsignedChar();
-    imageCast->Update();
-    this->OutputLabelmap->ShallowCopy(imageCast->GetOutput());
+    return false;
   }
+  double polydataBounds[6] = {0,0,0,0,0,0};
+  this->InputPolyData->GetPoints()->ComputeBounds();
+  this->InputPolyData->GetPoints()->GetBounds(polydataBounds);
+
+  double origin[3] = {0,0,0};
+  double spacing[3] = {1,1,1};
+  int referenceExtent[6] = {0,-1,0,-1,0,-1};
+  this->ReferenceImageData->GetOrigin(origin);
+  this->ReferenceImageData->GetSpacing(spacing);
+  this->ReferenceImageData->GetExtent(referenceExtent);
+  for (int axis = 0; axis < 3; ++axis)
+  {
+    if (spacing[axis] <= 0.0)
+    {
+      vtkErrorMacro("DetermineCroppedExtent: Invalid reference spacing. Is the input polydata in the IJK coordinate system of the reference image?");
+      return false;
+    }
+    croppedExtent[2*axis] = (int)floor((polydataBounds[2*axis] - origin[axis]) / spacing[axis]) - 1;
+    croppedExtent[2*axis+1] = (int)ceil((polydataBounds[2*axis+1] - origin[axis]) / spacing[axis]) + 1;
+
+    // The output is a sub-extent of the reference
+    croppedExtent[2*axis] = std::max(croppedExtent[2*axis], referenceExtent[2*axis]);
+    croppedExtent[2*axis+1] = std::min(croppedExtent[2*axis+1], referenceExtent[2*axis+1]);
+    if (croppedExtent[2*axis] > croppedExtent[2*axis+1])
+    {
+      return false;
+    }
+  }
+  return true;
 }
 
 //----------------------------------------------------------------------------
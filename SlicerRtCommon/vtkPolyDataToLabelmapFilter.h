@@ -36,6 +36,10 @@
 /// \ingroup SlicerRt_SlicerRtCommon
 /// The algorithm requires the input polydata to be transformed to the IJK coordinate system of the reference image data
 /// or the extents calculated to encompass both sets of data will be nonsensical.
+///
+/// If reference values are not used, then the labelmap is rasterized in parallel slabs of slices, and the label value
+/// is written directly in the output scalar type. With \sa CropToInputExtent the output only covers the bounding extent
+/// of the input polydata, on the voxel grid of the reference image (same origin and spacing, sub-extent).
 class VTK_SLICERRTCOMMON_EXPORT vtkPolyDataToLabelmapFilter : public vtkObject
 {
 public:
@@ -61,6 +65,16 @@ public:
   vtkSetMacro(UseReferenceValues, bool);
   vtkBooleanMacro(UseReferenceValues, bool);
 
+  /// Restrict output to the bounding extent of the input polydata padded by one voxel, clamped to the reference extent.
+  /// Only used if reference values are not used. Off by default
+  vtkGetMacro(CropToInputExtent, bool);
+  vtkSetMacro(CropToInputExtent, bool);
+  vtkBooleanMacro(CropToInputExtent, bool);
+
+  /// Scalar type of the output labelmap if reference values are not used. Unsigned char by default
+  vtkGetMacro(OutputScalarType, int);
+  vtkSetMacro(OutputScalarType, int);
+
 protected:
   vtkSetObjectMacro(OutputLabelmap, vtkImageData);
   vtkSetObjectMacro(ReferenceImageData, vtkImageData);
@@ -73,6 +87,15 @@ protected:
   /// Helper function to copy values from the arry into the vector
   void CopyArraysToVectors( std::vector<int> &extentVector, int extents[6], std::vector<double> &originVector, double origin[3] );
 
+  /// Compute the bounding extent of the input polydata on the voxel grid of the reference image, padded by one voxel
+  /// and clamped to the reference extent
+  /// \return False if the input polydata is empty or does not overlap the reference extent
+  bool DetermineCroppedExtent(int croppedExtent[6]);
+
+  /// Rasterize closed surface into a new labelmap with the given geometry. Voxels inside the surface are set to
+  /// \sa LabelValue, others to zero
+  void RasterizeToLabelmap(vtkPolyData* closedSurface, int extent[6], double origin[3]);
+
 protected:
   vtkPolyData* InputPolyData;
   vtkImageData* OutputLabelmap;
@@ -80,6 +103,8 @@ protected:
   unsigned short LabelValue;
   double BackgroundValue;
   bool UseReferenceValues;
+  bool CropToInputExtent;
+  int OutputScalarType;
 
 protected:
   vtkPolyDataToLabelmapFilter();
@@ -33,6 +33,7 @@
 #include <vtkDiscretizableColorTransferFunction.h>
 #include <vtkLookupTable.h>
 #include <vtkGeneralTransform.h>
+#include <vtkImageCast.h>
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
 #include <vtkSmartPointer.h>
@@ -44,6 +45,17 @@
 // VTK sys tools
 #include <vtksys/SystemTools.hxx>
 
+// Platform includes for memory usage queries
+#if defined(_WIN32)
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#endif
+
 //----------------------------------------------------------------------------
 // Constant strings
 //----------------------------------------------------------------------------
@@ -274,6 +286,47 @@ bool vtkSlicerRtCommon::AreExtentsEqual(int extentA[6], int extentB[6])
     extentA[5] == extentB [5];
 }
 
+//---------------------------------------------------------------------------
+double vtkSlicerRtCommon::GetProcessPeakMemoryUsageMB()
+{
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS memoryCounters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters)))
+  {
+    return 0.0;
+  }
+  return memoryCounters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+  {
+    return 0.0;
+  }
+#  if defined(__APPLE__)
+  // Reported in bytes on Mac
+  return usage.ru_maxrss / (1024.0 * 1024.0);
+#  else
+  // Reported in kilobytes on Linux
+  return usage.ru_maxrss / 1024.0;
+#  endif
+#endif
+}
+
+//---------------------------------------------------------------------------
+const float* vtkSlicerRtCommon::GetFloatScalars(vtkImageData* image, vtkSmartPointer<vtkImageData>& floatImage)
+{
+  if (image->GetScalarType() == VTK_FLOAT)
+  {
+    return static_cast<const float*>(image->GetScalarPointer());
+  }
+  vtkSmartPointer<vtkImageCast> cast = vtkSmartPointer<vtkImageCast>::New();
+  cast->SetInputData(image);
+  cast->SetOutputScalarTypeToFloat();
+  cast->Update();
+  floatImage = cast->GetOutput();
+  return static_cast<const float*>(floatImage->GetScalarPointer());
+}
+
 //---------------------------------------------------------------------------
 void vtkSlicerRtCommon::GenerateRandomColor(vtkMRMLColorTableNode* colorNode, double* newColor)
 {
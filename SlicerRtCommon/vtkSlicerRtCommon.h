@@ -144,6 +144,14 @@ public:
   /// Determine if two bounds are equal
   static bool AreExtentsEqual(int boundsA[6], int boundsB[6]);
 
+  /// Get the peak resident memory (high-water mark) of the current process in megabytes
+  /// \return Peak memory usage, or 0 if it cannot be determined on the current platform
+  static double GetProcessPeakMemoryUsageMB();
+
+  /// Get float scalars of an image. If the image is not float, then a float copy is made and stored in floatImage
+  /// \return Pointer to the float scalars, valid as long as the image (or floatImage if a copy was made) is not modified
+  static const float* GetFloatScalars(vtkImageData* image, vtkSmartPointer<vtkImageData>& floatImage);
+
   /// Generate a new color that is not already in use in a color table node
   /// \param colorNode Color table node to validate against
   static void GenerateRandomColor(vtkMRMLColorTableNode* colorNode, double* newColor);
@@ -204,6 +212,18 @@ public:
     \return Success
   */
   template<typename T> static bool ConvertItkImageToVolumeNode(typename itk::Image<T, 3>::Pointer inItkImage, vtkMRMLScalarVolumeNode* outVolumeNode, int vtkType, bool applyLpsToRasConversion=true);
+
+  /*!
+    Execute a functor in parallel with vtkSMPTools::For using a given number of threads, without changing
+    the number of threads of the SMP backend for the rest of the process.
+    Limiting the number of threads needs VTK 9.1 or later, older versions use the default of the SMP backend.
+    \param first Begin of the range
+    \param last End of the range
+    \param grain Grain size passed to vtkSMPTools::For
+    \param functor Functor to execute on the sub-ranges
+    \param numberOfThreads Number of threads to use. Zero means the default of the SMP backend
+  */
+  template<typename FunctorType> static void SMPFor(vtkIdType first, vtkIdType last, vtkIdType grain, FunctorType& functor, int numberOfThreads);
 };
 
 #include "vtkSlicerRtCommon.txx"
@@ -29,7 +29,9 @@
 #include <vtkImageData.h>
 #include <vtkImageExport.h>
 #include <vtkImageThreshold.h>
+#include <vtkSMPTools.h>
 #include <vtkTransform.h>
+#include <vtkVersionMacros.h>
 
 // ITK includes
 #include <itkImageRegionIteratorWithIndex.h>
@@ -320,3 +322,18 @@ template<typename T> bool vtkSlicerRtCommon::ConvertItkImageToVolumeNode(typenam
 
   return true;
 }
+
+//----------------------------------------------------------------------------
+template<typename FunctorType> void vtkSlicerRtCommon::SMPFor(vtkIdType first, vtkIdType last, vtkIdType grain, FunctorType& functor, int numberOfThreads)
+{
+#if VTK_MAJOR_VERSION > 9 || (VTK_MAJOR_VERSION == 9 && VTK_MINOR_VERSION >= 1)
+  if (numberOfThreads > 0)
+  {
+    vtkSMPTools::LocalScope(vtkSMPTools::Config(numberOfThreads), [&]() { vtkSMPTools::For(first, last, grain, functor); });
+    return;
+  }
+#else
+  (void)numberOfThreads;
+#endif
+  vtkSMPTools::For(first, last, grain, functor);
+}
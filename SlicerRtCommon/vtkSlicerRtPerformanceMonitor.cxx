@@ -0,0 +1,614 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkSlicerRtPerformanceMonitor.h"
+#include "vtkSlicerRtCommon.h"
+
+// VTK includes
+#include <vtkMultiThreader.h>
+#include <vtkObjectFactory.h>
+#include <vtkSimpleCriticalSection.h>
+#include <vtkStringArray.h>
+#include <vtkTimerLog.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <vector>
+
+//----------------------------------------------------------------------------
+namespace
+{
+  /// Get whether monitoring is requested in the environment
+  bool IsMonitoringEnabledInEnvironment()
+  {
+    std::string enabled;
+    if (!vtksys::SystemTools::GetEnv("SLICERRT_PERFORMANCE_MONITOR", enabled))
+    {
+      return false;
+    }
+    return !enabled.empty() && enabled != "0";
+  }
+
+  /// Escape string to be written as a JSON string value
+  std::string EscapeJsonString(const std::string& text)
+  {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (std::string::const_iterator charIt = text.begin(); charIt != text.end(); ++charIt)
+    {
+      switch (*charIt)
+      {
+      case '"': escaped += "\\\""; break;
+      case '\\': escaped += "\\\\"; break;
+      case '\n': escaped += "\\n"; break;
+      case '\r': escaped += "\\r"; break;
+      case '\t': escaped += "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(*charIt) < 0x20)
+        {
+          escaped += ' ';
+        }
+        else
+        {
+          escaped += *charIt;
+        }
+      }
+    }
+    return escaped;
+  }
+}
+
+//----------------------------------------------------------------------------
+class vtkSlicerRtPerformanceMonitor::vtkInternal
+{
+public:
+  /// Aggregated measurements of one operation
+  struct OperationStatistics
+  {
+    OperationStatistics()
+      : NumberOfCalls(0)
+      , TotalTimeSeconds(0.0)
+      , MinimumTimeSeconds(0.0)
+      , MaximumTimeSeconds(0.0)
+      , ProcessMaxRssMB(0.0)
+    {
+    }
+    int NumberOfCalls;
+    double TotalTimeSeconds;
+    double MinimumTimeSeconds;
+    double MaximumTimeSeconds;
+    double ProcessMaxRssMB;
+    std::map<std::string, double> Counters;
+  };
+
+  /// Timed operation for the trace
+  struct TraceEvent
+  {
+    std::string OperationName;
+    double StartTime;
+    double DurationSeconds;
+    int ThreadIndex;
+  };
+
+  /// Get index of the current thread (small numbers are easier to read in the trace viewer than system thread IDs)
+  int GetCurrentThreadIndex()
+  {
+    vtkMultiThreaderIDType currentThreadId = vtkMultiThreader::GetCurrentThreadID();
+    for (size_t threadIndex=0; threadIndex<this->ThreadIds.size(); ++threadIndex)
+    {
+      if (vtkMultiThreader::ThreadsEqual(this->ThreadIds[threadIndex], currentThreadId))
+      {
+        return static_cast<int>(threadIndex);
+      }
+    }
+    this->ThreadIds.push_back(currentThreadId);
+    return static_cast<int>(this->ThreadIds.size() - 1);
+  }
+
+  OperationStatistics* FindOperation(const char* operationName)
+  {
+    if (!operationName)
+    {
+      return NULL;
+    }
+    std::map<std::string, OperationStatistics>::iterator operationIt = this->Operations.find(operationName);
+    if (operationIt == this->Operations.end())
+    {
+      return NULL;
+    }
+    return &(operationIt->second);
+  }
+
+public:
+  vtkSimpleCriticalSection Lock;
+  std::map<std::string, OperationStatistics> Operations;
+  std::vector<TraceEvent> TraceEvents;
+  std::vector<vtkMultiThreaderIDType> ThreadIds;
+  /// Time of the first recorded event. Trace timestamps are relative to this
+  double TraceStartTime;
+};
+
+//----------------------------------------------------------------------------
+// Singleton management
+//----------------------------------------------------------------------------
+std::atomic<bool> vtkSlicerRtPerformanceMonitor::EnabledFlag(IsMonitoringEnabledInEnvironment());
+
+static vtkSlicerRtPerformanceMonitor* vtkSlicerRtPerformanceMonitorInstance = NULL;
+
+/// Deletes the singleton instance when the application exits. If requested in the environment,
+/// the trace is written to file before that.
+class vtkSlicerRtPerformanceMonitorCleanup
+{
+public:
+  ~vtkSlicerRtPerformanceMonitorCleanup()
+  {
+    if (!vtkSlicerRtPerformanceMonitorInstance)
+    {
+      return;
+    }
+    std::string traceFileName;
+    if ( vtksys::SystemTools::GetEnv("SLICERRT_PERFORMANCE_TRACE_FILE", traceFileName) && !traceFileName.empty()
+      && vtkSlicerRtPerformanceMonitorInstance->GetNumberOfTraceEvents() > 0 )
+    {
+      vtkSlicerRtPerformanceMonitorInstance->WriteChromeTrace(traceFileName.c_str());
+    }
+    vtkSlicerRtPerformanceMonitor::SetInstance(NULL);
+  }
+};
+static vtkSlicerRtPerformanceMonitorCleanup vtkSlicerRtPerformanceMonitorCleanupGlobal;
+
+//----------------------------------------------------------------------------
+vtkSlicerRtPerformanceMonitor* vtkSlicerRtPerformanceMonitor::New()
+{
+  vtkSlicerRtPerformanceMonitor* instance = vtkSlicerRtPerformanceMonitor::GetInstance();
+  instance->Register(NULL);
+  return instance;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerRtPerformanceMonitor* vtkSlicerRtPerformanceMonitor::GetInstance()
+{
+  if (!vtkSlicerRtPerformanceMonitorInstance)
+  {
+    // Try the factory first
+    vtkSlicerRtPerformanceMonitorInstance = (vtkSlicerRtPerformanceMonitor*)vtkObjectFactory::CreateInstance("vtkSlicerRtPerformanceMonitor");
+    // if the factory did not provide one, then create it here
+    if (!vtkSlicerRtPerformanceMonitorInstance)
+    {
+      vtkSlicerRtPerformanceMonitorInstance = new vtkSlicerRtPerformanceMonitor;
+#ifdef VTK_HAS_INITIALIZE_OBJECT_BASE
+      vtkSlicerRtPerformanceMonitorInstance->InitializeObjectBase();
+#endif
+    }
+  }
+  return vtkSlicerRtPerformanceMonitorInstance;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtPerformanceMonitor::SetInstance(vtkSlicerRtPerformanceMonitor* instance)
+{
+  if (vtkSlicerRtPerformanceMonitorInstance == instance)
+  {
+    return;
+  }
+  if (vtkSlicerRtPerformanceMonitorInstance)
+  {
+    vtkSlicerRtPerformanceMonitorInstance->Delete();
+  }
+  vtkSlicerRtPerformanceMonitorInstance = instance;
+  if (instance)
+  {
+    instance->Register(NULL);
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerRtPerformanceMonitor::vtkSlicerRtPerformanceMonitor()
+{
+  this->MaximumNumberOfTraceEvents = 100000;
+  this->Internal = new vtkInternal();
+  this->Internal->TraceStartTime = -1.0;
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerRtPerformanceMonitor::~vtkSlicerRtPerformanceMonitor()
+{
+  delete this->Internal;
+  this->Internal = NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtPerformanceMonitor::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+
+  os << indent << "Enabled: " << (vtkSlicerRtPerformanceMonitor::EnabledFlag ? "true" : "false") << "\n";
+  os << indent << "MaximumNumberOfTraceEvents: " << this->MaximumNumberOfTraceEvents << "\n";
+  os << indent << "NumberOfTraceEvents: " << this->GetNumberOfTraceEvents() << "\n";
+  os << indent << "Operations:\n";
+  this->Internal->Lock.Lock();
+  for (std::map<std::string, vtkInternal::OperationStatistics>::iterator operationIt = this->Internal->Operations.begin();
+    operationIt != this->Internal->Operations.end(); ++operationIt)
+  {
+    os << indent.GetNextIndent() << operationIt->first << ": calls=" << operationIt->second.NumberOfCalls
+      << ", total=" << operationIt->second.TotalTimeSeconds << "s, process max RSS=" << operationIt->second.ProcessMaxRssMB << "MB\n";
+  }
+  this->Internal->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtPerformanceMonitor::SetEnabled(bool enabled)
+{
+  if (vtkSlicerRtPerformanceMonitor::EnabledFlag.exchange(enabled) == enabled)
+  {
+    return;
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtPerformanceMonitor::RecordDuration(const char* operationName, double startTime, double durationSeconds)
+{
+  if (!operationName)
+  {
+    return;
+  }
+  this->Internal->Lock.Lock();
+  vtkInternal::OperationStatistics& operation = this->Internal->Operations[operationName];
+  if (operation.NumberOfCalls == 0)
+  {
+    operation.MinimumTimeSeconds = durationSeconds;
+    operation.MaximumTimeSeconds = durationSeconds;
+  }
+  else
+  {
+    operation.MinimumTimeSeconds = std::min(operation.MinimumTimeSeconds, durationSeconds);
+    operation.MaximumTimeSeconds = std::max(operation.MaximumTimeSeconds, durationSeconds);
+  }
+  ++operation.NumberOfCalls;
+  operation.TotalTimeSeconds += durationSeconds;
+
+  if (static_cast<int>(this->Internal->TraceEvents.size()) < this->MaximumNumberOfTraceEvents)
+  {
+    if (this->Internal->TraceStartTime < 0.0 || startTime < this->Internal->TraceStartTime)
+    {
+      this->Internal->TraceStartTime = startTime;
+    }
+    vtkInternal::TraceEvent event;
+    event.OperationName = operationName;
+    event.StartTime = startTime;
+    event.DurationSeconds = durationSeconds;
+    event.ThreadIndex = this->Internal->GetCurrentThreadIndex();
+    this->Internal->TraceEvents.push_back(event);
+  }
+  this->Internal->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtPerformanceMonitor::AddToCounterInternal(const char* operationName, const char* counterName, double value)
+{
+  if (!operationName || !counterName)
+  {
+    return;
+  }
+  this->Internal->Lock.Lock();
+  this->Internal->Operations[operationName].Counters[counterName] += value;
+  this->Internal->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtPerformanceMonitor::SampleProcessMaxRssInternal(const char* operationName)
+{
+  if (!operationName)
+  {
+    return;
+  }
+  // Query memory outside the lock, as it is a system call
+  double processMaxRssMB = vtkSlicerRtCommon::GetProcessPeakMemoryUsageMB();
+  this->Internal->Lock.Lock();
+  vtkInternal::OperationStatistics& operation = this->Internal->Operations[operationName];
+  operation.ProcessMaxRssMB = std::max(operation.ProcessMaxRssMB, processMaxRssMB);
+  this->Internal->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtPerformanceMonitor::Reset()
+{
+  this->Internal->Lock.Lock();
+  this->Internal->Operations.clear();
+  this->Internal->TraceEvents.clear();
+  this->Internal->TraceStartTime = -1.0;
+  this->Internal->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtPerformanceMonitor::GetOperationNames(vtkStringArray* operationNames)
+{
+  if (!operationNames)
+  {
+    vtkErrorMacro("GetOperationNames: Invalid output array");
+    return;
+  }
+  operationNames->Initialize();
+  this->Internal->Lock.Lock();
+  for (std::map<std::string, vtkInternal::OperationStatistics>::iterator operationIt = this->Internal->Operations.begin();
+    operationIt != this->Internal->Operations.end(); ++operationIt)
+  {
+    operationNames->InsertNextValue(operationIt->first);
+  }
+  this->Internal->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerRtPerformanceMonitor::GetNumberOfCalls(const char* operationName)
+{
+  this->Internal->Lock.Lock();
+  vtkInternal::OperationStatistics* operation = this->Internal->FindOperation(operationName);
+  int numberOfCalls = (operation ? operation->NumberOfCalls : 0);
+  this->Internal->Lock.Unlock();
+  return numberOfCalls;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerRtPerformanceMonitor::GetTotalTimeSeconds(const char* operationName)
+{
+  this->Internal->Lock.Lock();
+  vtkInternal::OperationStatistics* operation = this->Internal->FindOperation(operationName);
+  double totalTimeSeconds = (operation ? operation->TotalTimeSeconds : 0.0);
+  this->Internal->Lock.Unlock();
+  return totalTimeSeconds;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerRtPerformanceMonitor::GetMeanTimeSeconds(const char* operationName)
+{
+  this->Internal->Lock.Lock();
+  vtkInternal::OperationStatistics* operation = this->Internal->FindOperation(operationName);
+  double meanTimeSeconds = 0.0;
+  if (operation && operation->NumberOfCalls > 0)
+  {
+    meanTimeSeconds = operation->TotalTimeSeconds / operation->NumberOfCalls;
+  }
+  this->Internal->Lock.Unlock();
+  return meanTimeSeconds;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerRtPerformanceMonitor::GetMinimumTimeSeconds(const char* operationName)
+{
+  this->Internal->Lock.Lock();
+  vtkInternal::OperationStatistics* operation = this->Internal->FindOperation(operationName);
+  double minimumTimeSeconds = (operation ? operation->MinimumTimeSeconds : 0.0);
+  this->Internal->Lock.Unlock();
+  return minimumTimeSeconds;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerRtPerformanceMonitor::GetMaximumTimeSeconds(const char* operationName)
+{
+  this->Internal->Lock.Lock();
+  vtkInternal::OperationStatistics* operation = this->Internal->FindOperation(operationName);
+  double maximumTimeSeconds = (operation ? operation->MaximumTimeSeconds : 0.0);
+  this->Internal->Lock.Unlock();
+  return maximumTimeSeconds;
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerRtPerformanceMonitor::GetProcessMaxRssMB(const char* operationName)
+{
+  this->Internal->Lock.Lock();
+  vtkInternal::OperationStatistics* operation = this->Internal->FindOperation(operationName);
+  double processMaxRssMB = (operation ? operation->ProcessMaxRssMB : 0.0);
+  this->Internal->Lock.Unlock();
+  return processMaxRssMB;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtPerformanceMonitor::GetCounterNames(const char* operationName, vtkStringArray* counterNames)
+{
+  if (!counterNames)
+  {
+    vtkErrorMacro("GetCounterNames: Invalid output array");
+    return;
+  }
+  counterNames->Initialize();
+  this->Internal->Lock.Lock();
+  vtkInternal::OperationStatistics* operation = this->Internal->FindOperation(operationName);
+  if (operation)
+  {
+    for (std::map<std::string, double>::iterator counterIt = operation->Counters.begin(); counterIt != operation->Counters.end(); ++counterIt)
+    {
+      counterNames->InsertNextValue(counterIt->first);
+    }
+  }
+  this->Internal->Lock.Unlock();
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerRtPerformanceMonitor::GetCounterValue(const char* operationName, const char* counterName)
+{
+  double value = 0.0;
+  this->Internal->Lock.Lock();
+  vtkInternal::OperationStatistics* operation = this->Internal->FindOperation(operationName);
+  if (operation && counterName)
+  {
+    std::map<std::string, double>::iterator counterIt = operation->Counters.find(counterName);
+    if (counterIt != operation->Counters.end())
+    {
+      value = counterIt->second;
+    }
+  }
+  this->Internal->Lock.Unlock();
+  return value;
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerRtPerformanceMonitor::GetNumberOfTraceEvents()
+{
+  this->Internal->Lock.Lock();
+  int numberOfTraceEvents = static_cast<int>(this->Internal->TraceEvents.size());
+  this->Internal->Lock.Unlock();
+  return numberOfTraceEvents;
+}
+
+//----------------------------------------------------------------------------
+std::string vtkSlicerRtPerformanceMonitor::GetStatisticsAsJson()
+{
+  std::ostringstream json;
+  json.precision(std::numeric_limits<double>::digits10);
+  json << "{\n  \"operations\": [";
+  this->Internal->Lock.Lock();
+  bool firstOperation = true;
+  for (std::map<std::string, vtkInternal::OperationStatistics>::iterator operationIt = this->Internal->Operations.begin();
+    operationIt != this->Internal->Operations.end(); ++operationIt)
+  {
+    const vtkInternal::OperationStatistics& operation = operationIt->second;
+    json << (firstOperation ? "\n" : ",\n");
+    firstOperation = false;
+    json << "    {\n"
+      << "      \"name\": \"" << EscapeJsonString(operationIt->first) << "\",\n"
+      << "      \"calls\": " << operation.NumberOfCalls << ",\n"
+      << "      \"totalSeconds\": " << operation.TotalTimeSeconds << ",\n"
+      << "      \"meanSeconds\": " << (operation.NumberOfCalls > 0 ? operation.TotalTimeSeconds / operation.NumberOfCalls : 0.0) << ",\n"
+      << "      \"minSeconds\": " << operation.MinimumTimeSeconds << ",\n"
+      << "      \"maxSeconds\": " << operation.MaximumTimeSeconds << ",\n"
+      << "      \"processMaxRssMB\": " << operation.ProcessMaxRssMB << ",\n"
+      << "      \"counters\": {";
+    bool firstCounter = true;
+    for (std::map<std::string, double>::const_iterator counterIt = operation.Counters.begin(); counterIt != operation.Counters.end(); ++counterIt)
+    {
+      json << (firstCounter ? "" : ", ") << "\"" << EscapeJsonString(counterIt->first) << "\": " << counterIt->second;
+      firstCounter = false;
+    }
+    json << "}\n    }";
+  }
+  this->Internal->Lock.Unlock();
+  json << "\n  ]\n}\n";
+  return json.str();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerRtPerformanceMonitor::WriteStatisticsAsJson(const char* fileName)
+{
+  if (!fileName)
+  {
+    vtkErrorMacro("WriteStatisticsAsJson: Invalid file name");
+    return false;
+  }
+  std::ofstream file(fileName);
+  if (!file.is_open())
+  {
+    vtkErrorMacro("WriteStatisticsAsJson: Failed to open file " << fileName);
+    return false;
+  }
+  file << this->GetStatisticsAsJson();
+  return file.good();
+}
+
+//----------------------------------------------------------------------------
+bool vtkSlicerRtPerformanceMonitor::WriteChromeTrace(const char* fileName)
+{
+  if (!fileName)
+  {
+    vtkErrorMacro("WriteChromeTrace: Invalid file name");
+    return false;
+  }
+  std::ofstream file(fileName);
+  if (!file.is_open())
+  {
+    vtkErrorMacro("WriteChromeTrace: Failed to open file " << fileName);
+    return false;
+  }
+
+  // Complete events ("ph": "X") with timestamps and durations in microseconds
+  file.setf(std::ios::fixed);
+  file.precision(1);
+  file << "{\"traceEvents\": [";
+  this->Internal->Lock.Lock();
+  for (size_t eventIndex=0; eventIndex<this->Internal->TraceEvents.size(); ++eventIndex)
+  {
+    const vtkInternal::TraceEvent& event = this->Internal->TraceEvents[eventIndex];
+    file << (eventIndex == 0 ? "\n" : ",\n")
+      << "{\"name\": \"" << EscapeJsonString(event.OperationName) << "\", \"cat\": \"SlicerRT\", \"ph\": \"X\""
+      << ", \"ts\": " << (event.StartTime - this->Internal->TraceStartTime) * 1.0e6
+      << ", \"dur\": " << event.DurationSeconds * 1.0e6
+      << ", \"pid\": 0, \"tid\": " << event.ThreadIndex << "}";
+  }
+  this->Internal->Lock.Unlock();
+  file << "\n],\n\"displayTimeUnit\": \"ms\"}\n";
+  return file.good();
+}
+
+//----------------------------------------------------------------------------
+// vtkSlicerRtScopedTimer
+//----------------------------------------------------------------------------
+vtkSlicerRtScopedTimer::vtkSlicerRtScopedTimer(const char* operationName, bool alwaysMeasure/*=false*/)
+  : OperationName(operationName)
+  , Measuring(alwaysMeasure || vtkSlicerRtPerformanceMonitor::IsEnabled())
+  , Running(false)
+  , StartTime(0.0)
+  , DurationSeconds(0.0)
+{
+  if (this->Measuring)
+  {
+    this->StartTime = vtkTimerLog::GetUniversalTime();
+    this->Running = true;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerRtScopedTimer::~vtkSlicerRtScopedTimer()
+{
+  this->Stop();
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtScopedTimer::Stop()
+{
+  if (!this->Running)
+  {
+    return;
+  }
+  this->Running = false;
+  this->DurationSeconds = vtkTimerLog::GetUniversalTime() - this->StartTime;
+  if (vtkSlicerRtPerformanceMonitor::IsEnabled())
+  {
+    vtkSlicerRtPerformanceMonitor* monitor = vtkSlicerRtPerformanceMonitor::GetInstance();
+    monitor->RecordDuration(this->OperationName, this->StartTime, this->DurationSeconds);
+    vtkSlicerRtPerformanceMonitor::SampleProcessMaxRss(this->OperationName);
+  }
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerRtScopedTimer::GetElapsedSeconds() const
+{
+  if (this->Running)
+  {
+    return vtkTimerLog::GetUniversalTime() - this->StartTime;
+  }
+  return this->DurationSeconds;
+}
@@ -0,0 +1,201 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkSlicerRtPerformanceMonitor_h
+#define __vtkSlicerRtPerformanceMonitor_h
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <atomic>
+#include <string>
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+class vtkStringArray;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Collects timings, counters and the memory high-water mark of SlicerRT operations
+///
+/// Singleton that aggregates measurements per operation name (such as "DoseVolumeHistogram.ComputeDvh"):
+/// number of calls, total/min/max duration, named counters (e.g. voxels processed, bytes read, cache hits)
+/// and the maximum resident set size of the process at the end of the operation. Each timed operation is also
+/// recorded as a trace event, so that the timeline can be inspected in a Chrome trace viewer (chrome://tracing).
+///
+/// The maximum resident set size is the high-water mark of the whole process since it started (getrusage on
+/// Linux and Mac, peak working set on Windows), so it is not the memory used by the operation. It only shows
+/// which operation first raised the process peak.
+///
+/// Monitoring is disabled by default, in which case timers and counters only cost a check of a static flag.
+/// It can be enabled from Python:
+///   monitor = slicer.vtkSlicerRtPerformanceMonitor.GetInstance()
+///   monitor.EnabledOn()
+///   ... run computations ...
+///   print(monitor.GetStatisticsAsJson())
+///   monitor.WriteChromeTrace('/tmp/trace.json')
+/// or by setting the SLICERRT_PERFORMANCE_MONITOR environment variable to 1. If the SLICERRT_PERFORMANCE_TRACE_FILE
+/// environment variable is also set, then the trace is written to that file when the application exits.
+///
+/// Operations are instrumented using \sa vtkSlicerRtScopedTimer and the static \sa AddToCounter function.
+/// The timers measure the logic level operations (loading, DVH, gamma, isodose, segment comparison, dose
+/// calculation and optimization). Tests that report their own timings may use vtkTimerLog directly.
+class VTK_SLICERRTCOMMON_EXPORT vtkSlicerRtPerformanceMonitor : public vtkObject
+{
+public:
+  /// Get the singleton instance (does not increase the reference count)
+  static vtkSlicerRtPerformanceMonitor* GetInstance();
+  /// Return the singleton instance with increased reference count
+  static vtkSlicerRtPerformanceMonitor* New();
+  vtkTypeMacro(vtkSlicerRtPerformanceMonitor, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+  /// Enable or disable collecting measurements
+  void SetEnabled(bool enabled);
+  bool GetEnabled() { return vtkSlicerRtPerformanceMonitor::IsEnabled(); };
+  vtkBooleanMacro(Enabled, bool);
+
+  /// Fast check whether monitoring is enabled, used by the instrumented code
+  static bool IsEnabled() { return vtkSlicerRtPerformanceMonitor::EnabledFlag.load(std::memory_order_relaxed); };
+
+  /// Add value to a named counter of an operation. Does nothing if monitoring is disabled
+  static void AddToCounter(const char* operationName, const char* counterName, double value)
+  {
+    if (vtkSlicerRtPerformanceMonitor::IsEnabled())
+    {
+      vtkSlicerRtPerformanceMonitor::GetInstance()->AddToCounterInternal(operationName, counterName, value);
+    }
+  }
+
+  /// Record current maximum resident set size of the process for an operation. Does nothing if monitoring is disabled
+  static void SampleProcessMaxRss(const char* operationName)
+  {
+    if (vtkSlicerRtPerformanceMonitor::IsEnabled())
+    {
+      vtkSlicerRtPerformanceMonitor::GetInstance()->SampleProcessMaxRssInternal(operationName);
+    }
+  }
+
+  /// Record a timed operation. Called by \sa vtkSlicerRtScopedTimer
+  /// \param startTime Universal time of the start of the operation in seconds (see vtkTimerLog::GetUniversalTime)
+  /// \param durationSeconds Duration of the operation
+  void RecordDuration(const char* operationName, double startTime, double durationSeconds);
+
+  /// Clear all collected measurements
+  void Reset();
+
+  /// Get names of the operations that have measurements
+  void GetOperationNames(vtkStringArray* operationNames);
+  /// Get number of times an operation was timed
+  int GetNumberOfCalls(const char* operationName);
+  /// Get total time spent in an operation, in seconds
+  double GetTotalTimeSeconds(const char* operationName);
+  /// Get mean duration of an operation, in seconds
+  double GetMeanTimeSeconds(const char* operationName);
+  /// Get shortest duration of an operation, in seconds
+  double GetMinimumTimeSeconds(const char* operationName);
+  /// Get longest duration of an operation, in seconds
+  double GetMaximumTimeSeconds(const char* operationName);
+  /// Get the largest maximum resident set size of the process sampled at the end of an operation, in MB
+  double GetProcessMaxRssMB(const char* operationName);
+  /// Get names of the counters of an operation
+  void GetCounterNames(const char* operationName, vtkStringArray* counterNames);
+  /// Get value of a counter of an operation
+  double GetCounterValue(const char* operationName, const char* counterName);
+  /// Get number of recorded trace events
+  int GetNumberOfTraceEvents();
+
+  /// Maximum number of trace events kept in memory. Older events are kept, newer ones are only aggregated. Default is 100000
+  vtkGetMacro(MaximumNumberOfTraceEvents, int);
+  vtkSetMacro(MaximumNumberOfTraceEvents, int);
+
+  /// Get aggregated statistics of all operations in JSON format
+  std::string GetStatisticsAsJson();
+  /// Write aggregated statistics of all operations to a JSON file
+  /// \return Success flag
+  bool WriteStatisticsAsJson(const char* fileName);
+  /// Write trace events to a file in Chrome trace event format (can be opened in chrome://tracing or Perfetto)
+  /// \return Success flag
+  bool WriteChromeTrace(const char* fileName);
+
+protected:
+  void AddToCounterInternal(const char* operationName, const char* counterName, double value);
+  void SampleProcessMaxRssInternal(const char* operationName);
+
+protected:
+  /// Flag checked by the instrumented code. Static so that the check does not need the instance,
+  /// and atomic as it is read from the worker threads
+  static std::atomic<bool> EnabledFlag;
+
+  int MaximumNumberOfTraceEvents;
+
+  class vtkInternal;
+  vtkInternal* Internal;
+
+protected:
+  vtkSlicerRtPerformanceMonitor();
+  virtual ~vtkSlicerRtPerformanceMonitor();
+
+  friend class vtkSlicerRtPerformanceMonitorCleanup;
+  static void SetInstance(vtkSlicerRtPerformanceMonitor* instance);
+
+private:
+  vtkSlicerRtPerformanceMonitor(const vtkSlicerRtPerformanceMonitor&); // Not implemented
+  void operator=(const vtkSlicerRtPerformanceMonitor&);               // Not implemented
+};
+
+#ifndef __VTK_WRAP__
+//----------------------------------------------------------------------------
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Measures the time until it goes out of scope (or \sa Stop is called) and records it in the performance monitor
+///
+/// If monitoring is disabled, then no time is measured, unless alwaysMeasure is set (used when the caller logs
+/// the elapsed time itself, for example if LogSpeedMeasurements is enabled in a logic).
+/// Example:
+///   vtkSlicerRtScopedTimer timer("DoseVolumeHistogram.ComputeDvh", this->LogSpeedMeasurements);
+///   ...
+///   vtkDebugMacro("DVH computation time: " << timer.GetElapsedSeconds() << " s");
+class VTK_SLICERRTCOMMON_EXPORT vtkSlicerRtScopedTimer
+{
+public:
+  vtkSlicerRtScopedTimer(const char* operationName, bool alwaysMeasure=false);
+  ~vtkSlicerRtScopedTimer();
+
+  /// Stop measurement and record it. Subsequent calls have no effect
+  void Stop();
+
+  /// Get seconds elapsed since construction, or the measured duration if already stopped.
+  /// Returns zero if time is not measured
+  double GetElapsedSeconds() const;
+
+protected:
+  const char* OperationName;
+  bool Measuring;
+  bool Running;
+  double StartTime;
+  double DurationSeconds;
+
+private:
+  vtkSlicerRtScopedTimer(const vtkSlicerRtScopedTimer&); // Not implemented
+  void operator=(const vtkSlicerRtScopedTimer&);        // Not implemented
+};
+#endif
+
+#endif
@@ -0,0 +1,230 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+
+// SlicerRt includes
+#include "vtkLabelmapToModelFilter.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMassProperties.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+  // Ellipsoid label away from the labelmap center, so that the label extent is smaller than the labelmap.
+  // The voxels are anisotropic to catch mixed up axes
+  const int LABELMAP_DIMENSIONS[3] = { 48, 40, 36 };
+  const double LABELMAP_SPACING[3] = { 1.0, 1.5, 2.0 };
+  const double LABEL_CENTER_IJK[3] = { 30.0, 15.0, 12.0 };
+  const double LABEL_RADIUS_IJK[3] = { 8.0, 6.0, 5.0 };
+
+  /// Point coordinates that can be sorted, so that surfaces can be compared regardless of the point order
+  struct SurfacePoint
+  {
+    double Position[3];
+    bool operator<(const SurfacePoint& other) const
+    {
+      return std::lexicographical_compare(this->Position, this->Position+3, other.Position, other.Position+3);
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  void CreateLabelmap(vtkImageData* labelmap)
+  {
+    labelmap->SetDimensions(const_cast<int*>(LABELMAP_DIMENSIONS));
+    labelmap->SetOrigin(-20.0, 10.0, 5.0);
+    labelmap->SetSpacing(const_cast<double*>(LABELMAP_SPACING));
+    labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+    for (int k=0; k<LABELMAP_DIMENSIONS[2]; ++k)
+    {
+      for (int j=0; j<LABELMAP_DIMENSIONS[1]; ++j)
+      {
+        for (int i=0; i<LABELMAP_DIMENSIONS[0]; ++i)
+        {
+          double di = (i - LABEL_CENTER_IJK[0]) / LABEL_RADIUS_IJK[0];
+          double dj = (j - LABEL_CENTER_IJK[1]) / LABEL_RADIUS_IJK[1];
+          double dk = (k - LABEL_CENTER_IJK[2]) / LABEL_RADIUS_IJK[2];
+          unsigned char* voxel = static_cast<unsigned char*>(labelmap->GetScalarPointer(i, j, k));
+          (*voxel) = (di*di + dj*dj + dk*dk <= 1.0 ? 1 : 0);
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  /// Create model from the labelmap with the given options
+  /// \return Number of triangles in the model (zero if failed)
+  vtkIdType CreateModel(vtkImageData* labelmap, bool useFlyingEdges, bool restrictToLabelExtent,
+    int decimationMethod, vtkIdType targetNumberOfTriangles, vtkPolyData* model)
+  {
+    vtkNew<vtkLabelmapToModelFilter> labelmapToModelFilter;
+    labelmapToModelFilter->SetInputLabelmap(labelmap);
+    labelmapToModelFilter->SetLabelValue(1.0);
+    labelmapToModelFilter->SetDecimateTargetReduction(0.0);
+    labelmapToModelFilter->SetUseFlyingEdges(useFlyingEdges);
+    labelmapToModelFilter->SetRestrictToLabelExtent(restrictToLabelExtent);
+    labelmapToModelFilter->SetDecimationMethod(decimationMethod);
+    labelmapToModelFilter->SetTargetNumberOfTriangles(targetNumberOfTriangles);
+    labelmapToModelFilter->Update();
+    model->DeepCopy(labelmapToModelFilter->GetOutput());
+    return model->GetNumberOfPolys();
+  }
+
+  //----------------------------------------------------------------------------
+  void GetAreaAndVolume(vtkPolyData* model, double& area, double& volume)
+  {
+    vtkNew<vtkMassProperties> massProperties;
+    massProperties->SetInputData(model);
+    massProperties->Update();
+    area = massProperties->GetSurfaceArea();
+    volume = massProperties->GetVolume();
+  }
+
+  //----------------------------------------------------------------------------
+  /// Check that two models have the same points and triangles, and enclose the same volume
+  bool CompareModels(const char* name, vtkPolyData* model, vtkPolyData* referenceModel)
+  {
+    if ( model->GetNumberOfPolys() != referenceModel->GetNumberOfPolys()
+      || model->GetNumberOfPoints() != referenceModel->GetNumberOfPoints() )
+    {
+      std::cerr << "ERROR: " << name << ": " << model->GetNumberOfPolys() << " triangles and " << model->GetNumberOfPoints()
+        << " points instead of " << referenceModel->GetNumberOfPolys() << " triangles and " << referenceModel->GetNumberOfPoints()
+        << " points" << std::endl;
+      return false;
+    }
+
+    std::vector<SurfacePoint> points(model->GetNumberOfPoints());
+    std::vector<SurfacePoint> referencePoints(referenceModel->GetNumberOfPoints());
+    for (vtkIdType pointIndex=0; pointIndex<model->GetNumberOfPoints(); ++pointIndex)
+    {
+      model->GetPoint(pointIndex, points[pointIndex].Position);
+      referenceModel->GetPoint(pointIndex, referencePoints[pointIndex].Position);
+    }
+    std::sort(points.begin(), points.end());
+    std::sort(referencePoints.begin(), referencePoints.end());
+    for (size_t pointIndex=0; pointIndex<points.size(); ++pointIndex)
+    {
+      for (int axis=0; axis<3; ++axis)
+      {
+        if (fabs(points[pointIndex].Position[axis] - referencePoints[pointIndex].Position[axis]) > 1e-4)
+        {
+          std::cerr << "ERROR: " << name << ": point " << pointIndex << " differs from the reference: ("
+            << points[pointIndex].Position[0] << ", " << points[pointIndex].Position[1] << ", " << points[pointIndex].Position[2] << ") <> ("
+            << referencePoints[pointIndex].Position[0] << ", " << referencePoints[pointIndex].Position[1] << ", "
+            << referencePoints[pointIndex].Position[2] << ")" << std::endl;
+          return false;
+        }
+      }
+    }
+
+    double area = 0.0, volume = 0.0, referenceArea = 0.0, referenceVolume = 0.0;
+    GetAreaAndVolume(model, area, volume);
+    GetAreaAndVolume(referenceModel, referenceArea, referenceVolume);
+    if (fabs(area - referenceArea) > 1e-6 * referenceArea || fabs(volume - referenceVolume) > 1e-6 * referenceVolume)
+    {
+      std::cerr << "ERROR: " << name << ": area " << area << " mm2 and volume " << volume << " mm3 instead of "
+        << referenceArea << " mm2 and " << referenceVolume << " mm3" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Check that the decimated model is within the triangle budget, and still approximates the label
+  bool CheckTriangleBudget(const char* name, vtkPolyData* model, vtkIdType targetNumberOfTriangles, double referenceVolume)
+  {
+    if (model->GetNumberOfPolys() == 0 || model->GetNumberOfPolys() > targetNumberOfTriangles)
+    {
+      std::cerr << "ERROR: " << name << ": " << model->GetNumberOfPolys() << " triangles, expected at most "
+        << targetNumberOfTriangles << std::endl;
+      return false;
+    }
+    double area = 0.0, volume = 0.0;
+    GetAreaAndVolume(model, area, volume);
+    if (fabs(volume - referenceVolume) > 0.3 * referenceVolume)
+    {
+      std::cerr << "ERROR: " << name << ": decimated volume " << volume << " mm3 differs more than 30% from "
+        << referenceVolume << " mm3" << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkLabelmapToModelFilterTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkImageData> labelmap;
+  CreateLabelmap(labelmap.GetPointer());
+
+  // Marching cubes on the whole labelmap, without decimation (the original path)
+  vtkNew<vtkPolyData> referenceModel;
+  vtkIdType numberOfTriangles = CreateModel(labelmap.GetPointer(), false, false, vtkLabelmapToModelFilter::DecimatePro, 0, referenceModel.GetPointer());
+  if (numberOfTriangles == 0)
+  {
+    std::cerr << "ERROR: Failed to create reference model" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Restricting to the label extent does not change the surface
+  vtkNew<vtkPolyData> croppedModel;
+  CreateModel(labelmap.GetPointer(), false, true, vtkLabelmapToModelFilter::DecimatePro, 0, croppedModel.GetPointer());
+  if (!CompareModels("Restricted to label extent", croppedModel.GetPointer(), referenceModel.GetPointer()))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Flying edges gives the same surface as marching cubes
+  vtkNew<vtkPolyData> flyingEdgesModel;
+  CreateModel(labelmap.GetPointer(), true, true, vtkLabelmapToModelFilter::DecimatePro, 0, flyingEdgesModel.GetPointer());
+  if (!CompareModels("Flying edges", flyingEdgesModel.GetPointer(), referenceModel.GetPointer()))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Both decimation methods keep the triangle budget
+  double referenceArea = 0.0, referenceVolume = 0.0;
+  GetAreaAndVolume(referenceModel.GetPointer(), referenceArea, referenceVolume);
+  vtkIdType targetNumberOfTriangles = numberOfTriangles / 5;
+  vtkNew<vtkPolyData> decimateProModel;
+  CreateModel(labelmap.GetPointer(), true, true, vtkLabelmapToModelFilter::DecimatePro, targetNumberOfTriangles, decimateProModel.GetPointer());
+  vtkNew<vtkPolyData> quadricClusteringModel;
+  CreateModel(labelmap.GetPointer(), true, true, vtkLabelmapToModelFilter::QuadricClustering, targetNumberOfTriangles, quadricClusteringModel.GetPointer());
+  if ( !CheckTriangleBudget("DecimatePro", decimateProModel.GetPointer(), targetNumberOfTriangles, referenceVolume)
+    || !CheckTriangleBudget("QuadricClustering", quadricClusteringModel.GetPointer(), targetNumberOfTriangles, referenceVolume) )
+  {
+    return EXIT_FAILURE;
+  }
+  std::cout << "Triangles: " << numberOfTriangles << " extracted, " << decimateProModel->GetNumberOfPolys() << " after DecimatePro, "
+    << quadricClusteringModel->GetNumberOfPolys() << " after quadric clustering (budget " << targetNumberOfTriangles << ")" << std::endl;
+
+  std::cout << "Labelmap to model filter test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkPlanarContourToBinaryLabelmapConversionRule.h"
+#include "vtkPlanarContourToRibbonModelConversionRule.h"
+#include "vtkRibbonModelToBinaryLabelmapConversionRule.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkSegmentationConverter.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+  // Stack of circular contours sampling a sphere of 20 mm radius, with 2.5 mm plane spacing.
+  // The planes are between the slices of the 1 mm reference grid
+  const double SPHERE_RADIUS_MM = 20.0;
+  const double CONTOUR_SPACING_MM = 2.5;
+  const int NUMBER_OF_CONTOURS = 16;
+  const int NUMBER_OF_CONTOUR_POINTS = 64;
+
+  //----------------------------------------------------------------------------
+  void CreateSphereContours(vtkPolyData* contours)
+  {
+    vtkNew<vtkPoints> points;
+    vtkNew<vtkCellArray> lines;
+    for (int contourIndex=0; contourIndex<NUMBER_OF_CONTOURS; ++contourIndex)
+    {
+      double z = (contourIndex - (NUMBER_OF_CONTOURS - 1) / 2.0) * CONTOUR_SPACING_MM;
+      double radius = sqrt(SPHERE_RADIUS_MM * SPHERE_RADIUS_MM - z * z);
+      vtkIdType firstPointId = points->GetNumberOfPoints();
+      // Closed polyline, the first point is repeated at the end as in imported structures
+      lines->InsertNextCell(NUMBER_OF_CONTOUR_POINTS + 1);
+      for (int pointIndex=0; pointIndex<NUMBER_OF_CONTOUR_POINTS; ++pointIndex)
+      {
+        double angle = 2.0 * vtkMath::Pi() * pointIndex / NUMBER_OF_CONTOUR_POINTS;
+        lines->InsertCellPoint(points->InsertNextPoint(radius * cos(angle), radius * sin(angle), z));
+      }
+      lines->InsertCellPoint(firstPointId);
+    }
+    contours->SetPoints(points.GetPointer());
+    contours->SetLines(lines.GetPointer());
+  }
+
+  //----------------------------------------------------------------------------
+  int GetNumberOfForegroundVoxels(vtkOrientedImageData* labelmap)
+  {
+    int numberOfForegroundVoxels = 0;
+    const unsigned char* scalars = static_cast<unsigned char*>(labelmap->GetScalarPointer());
+    vtkIdType numberOfVoxels = labelmap->GetNumberOfPoints();
+    for (vtkIdType voxelIndex=0; voxelIndex<numberOfVoxels; ++voxelIndex)
+    {
+      if (scalars[voxelIndex] > 0)
+      {
+        ++numberOfForegroundVoxels;
+      }
+    }
+    return numberOfForegroundVoxels;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Count voxels that are foreground in both labelmaps. The labelmaps are on the same reference grid,
+  /// so voxels with the same IJK coordinates are at the same position
+  int GetNumberOfOverlappingVoxels(vtkOrientedImageData* labelmap1, vtkOrientedImageData* labelmap2)
+  {
+    int extent1[6] = {0,-1,0,-1,0,-1};
+    labelmap1->GetExtent(extent1);
+    int extent2[6] = {0,-1,0,-1,0,-1};
+    labelmap2->GetExtent(extent2);
+    int numberOfOverlappingVoxels = 0;
+    for (int k=std::max(extent1[4],extent2[4]); k<=std::min(extent1[5],extent2[5]); ++k)
+    {
+      for (int j=std::max(extent1[2],extent2[2]); j<=std::min(extent1[3],extent2[3]); ++j)
+      {
+        for (int i=std::max(extent1[0],extent2[0]); i<=std::min(extent1[1],extent2[1]); ++i)
+        {
+          if ( *static_cast<unsigned char*>(labelmap1->GetScalarPointer(i,j,k)) > 0
+            && *static_cast<unsigned char*>(labelmap2->GetScalarPointer(i,j,k)) > 0 )
+          {
+            ++numberOfOverlappingVoxels;
+          }
+        }
+      }
+    }
+    return numberOfOverlappingVoxels;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkPlanarContourToBinaryLabelmapConversionRuleTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  vtkNew<vtkPolyData> contours;
+  CreateSphereContours(contours.GetPointer());
+
+  // Reference geometry with 1 mm voxels covering the sphere
+  vtkNew<vtkOrientedImageData> referenceGeometry;
+  referenceGeometry->SetExtent(0, 59, 0, 59, 0, 59);
+  referenceGeometry->SetOrigin(-29.5, -29.5, -29.5);
+  referenceGeometry->SetSpacing(1.0, 1.0, 1.0);
+  std::string referenceGeometryString = vtkSegmentationConverter::SerializeImageGeometry(referenceGeometry.GetPointer());
+
+  // Direct conversion
+  vtkNew<vtkPlanarContourToBinaryLabelmapConversionRule> directRule;
+  directRule->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(), referenceGeometryString);
+  vtkNew<vtkOrientedImageData> directLabelmap;
+  if (!directRule->Convert(contours.GetPointer(), directLabelmap.GetPointer()))
+  {
+    std::cerr << "ERROR: Direct planar contour to binary labelmap conversion failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Conversion through ribbon model, which is the path the direct rule replaces
+  vtkNew<vtkPlanarContourToRibbonModelConversionRule> ribbonRule;
+  vtkNew<vtkPolyData> ribbonModel;
+  if (!ribbonRule->Convert(contours.GetPointer(), ribbonModel.GetPointer()))
+  {
+    std::cerr << "ERROR: Planar contour to ribbon model conversion failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkNew<vtkRibbonModelToBinaryLabelmapConversionRule> ribbonToLabelmapRule;
+  ribbonToLabelmapRule->SetConversionParameter(vtkSegmentationConverter::GetReferenceImageGeometryParameterName(), referenceGeometryString);
+  vtkNew<vtkOrientedImageData> ribbonLabelmap;
+  if (!ribbonToLabelmapRule->Convert(ribbonModel.GetPointer(), ribbonLabelmap.GetPointer()))
+  {
+    std::cerr << "ERROR: Ribbon model to binary labelmap conversion failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The two paths differ only in the rasterization of the contour boundaries, so they need to agree well.
+  // The volume of the contour stack is sum(pi*r^2) * spacing, about 33500 mm^3
+  int directVoxelCount = GetNumberOfForegroundVoxels(directLabelmap.GetPointer());
+  int ribbonVoxelCount = GetNumberOfForegroundVoxels(ribbonLabelmap.GetPointer());
+  int overlappingVoxelCount = GetNumberOfOverlappingVoxels(directLabelmap.GetPointer(), ribbonLabelmap.GetPointer());
+  double stackVolume = 0.0;
+  for (int contourIndex=0; contourIndex<NUMBER_OF_CONTOURS; ++contourIndex)
+  {
+    double z = (contourIndex - (NUMBER_OF_CONTOURS - 1) / 2.0) * CONTOUR_SPACING_MM;
+    stackVolume += vtkMath::Pi() * (SPHERE_RADIUS_MM * SPHERE_RADIUS_MM - z * z) * CONTOUR_SPACING_MM;
+  }
+  double dice = (directVoxelCount + ribbonVoxelCount > 0
+    ? 2.0 * overlappingVoxelCount / (directVoxelCount + ribbonVoxelCount) : 0.0);
+  std::cout << "Voxel counts: direct " << directVoxelCount << ", through ribbon model " << ribbonVoxelCount
+    << ", overlapping " << overlappingVoxelCount << " (Dice " << dice << "), contour stack volume " << stackVolume << " mm3" << std::endl;
+
+  if (fabs(directVoxelCount - stackVolume) > 0.03 * stackVolume)
+  {
+    std::cerr << "ERROR: Direct conversion voxel count " << directVoxelCount << " differs more than 3% from the contour stack volume "
+      << stackVolume << " mm3" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (abs(directVoxelCount - ribbonVoxelCount) > 0.03 * ribbonVoxelCount)
+  {
+    std::cerr << "ERROR: Direct conversion voxel count " << directVoxelCount << " differs more than 3% from the voxel count "
+      << ribbonVoxelCount << " of the conversion through ribbon model" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (dice < 0.97)
+  {
+    std::cerr << "ERROR: Dice similarity of direct conversion and conversion through ribbon model is " << dice << " (expected at least 0.97)" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Planar contour to binary labelmap conversion rule test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRt includes
+#include "vtkPolyDataToLabelmapFilter.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSphereSource.h>
+
+// STD includes
+#include <iostream>
+
+namespace
+{
+  // Reference grid of 50x50x50 voxels. The input polydata is in its IJK coordinate system
+  const int REFERENCE_EXTENT[6] = { 0, 49, 0, 49, 0, 49 };
+  const double SPHERE_RADIUS = 10.0;
+
+  //----------------------------------------------------------------------------
+  bool IsInExtent(const int extent[6], int i, int j, int k)
+  {
+    return i >= extent[0] && i <= extent[1] && j >= extent[2] && j <= extent[3] && k >= extent[4] && k <= extent[5];
+  }
+
+  //----------------------------------------------------------------------------
+  /// Rasterize a sphere with the given center with and without cropping to the input extent, and check that the
+  /// two labelmaps have the same voxels within the reference extent
+  bool CompareCroppedAndUncropped(const char* name, double centerI, double centerJ, double centerK, int expectedMinimumNumberOfVoxels)
+  {
+    vtkNew<vtkSphereSource> sphereSource;
+    sphereSource->SetCenter(centerI, centerJ, centerK);
+    sphereSource->SetRadius(SPHERE_RADIUS);
+    sphereSource->SetThetaResolution(32);
+    sphereSource->SetPhiResolution(32);
+    sphereSource->Update();
+
+    vtkNew<vtkImageData> referenceImage;
+    referenceImage->SetExtent(const_cast<int*>(REFERENCE_EXTENT));
+    referenceImage->SetOrigin(0.0, 0.0, 0.0);
+    referenceImage->SetSpacing(1.0, 1.0, 1.0);
+
+    vtkNew<vtkPolyDataToLabelmapFilter> uncroppedFilter;
+    uncroppedFilter->SetInputPolyData(sphereSource->GetOutput());
+    uncroppedFilter->SetReferenceImage(referenceImage.GetPointer());
+    uncroppedFilter->UseReferenceValuesOff();
+    uncroppedFilter->SetLabelValue(1);
+    uncroppedFilter->Update();
+    vtkImageData* uncroppedLabelmap = uncroppedFilter->GetOutput();
+
+    vtkNew<vtkPolyDataToLabelmapFilter> croppedFilter;
+    croppedFilter->SetInputPolyData(sphereSource->GetOutput());
+    croppedFilter->SetReferenceImage(referenceImage.GetPointer());
+    croppedFilter->UseReferenceValuesOff();
+    croppedFilter->CropToInputExtentOn();
+    croppedFilter->SetLabelValue(1);
+    croppedFilter->Update();
+    vtkImageData* croppedLabelmap = croppedFilter->GetOutput();
+
+    // Cropped output is a sub-extent on the reference voxel grid
+    int croppedExtent[6] = {0,-1,0,-1,0,-1};
+    croppedLabelmap->GetExtent(croppedExtent);
+    double* croppedOrigin = croppedLabelmap->GetOrigin();
+    if (croppedOrigin[0] != 0.0 || croppedOrigin[1] != 0.0 || croppedOrigin[2] != 0.0)
+    {
+      std::cerr << "ERROR: " << name << ": Cropped labelmap is not on the reference voxel grid, origin: "
+        << croppedOrigin[0] << ", " << croppedOrigin[1] << ", " << croppedOrigin[2] << std::endl;
+      return false;
+    }
+    bool croppedEmpty = (croppedExtent[0] > croppedExtent[1] || croppedExtent[2] > croppedExtent[3] || croppedExtent[4] > croppedExtent[5]);
+    if ( !croppedEmpty && ( !IsInExtent(REFERENCE_EXTENT, croppedExtent[0], croppedExtent[2], croppedExtent[4])
+      || !IsInExtent(REFERENCE_EXTENT, croppedExtent[1], croppedExtent[3], croppedExtent[5]) ) )
+    {
+      std::cerr << "ERROR: " << name << ": Cropped extent (" << croppedExtent[0] << ", " << croppedExtent[1] << ", " << croppedExtent[2]
+        << ", " << croppedExtent[3] << ", " << croppedExtent[4] << ", " << croppedExtent[5] << ") is not within the reference extent" << std::endl;
+      return false;
+    }
+
+    // The uncropped labelmap starts at the reference origin as the sphere does not extend below it,
+    // so voxels with the same IJK coordinates are at the same position
+    double* uncroppedOrigin = uncroppedLabelmap->GetOrigin();
+    if (uncroppedOrigin[0] != 0.0 || uncroppedOrigin[1] != 0.0 || uncroppedOrigin[2] != 0.0)
+    {
+      std::cerr << "ERROR: " << name << ": Unexpected origin of uncropped labelmap: "
+        << uncroppedOrigin[0] << ", " << uncroppedOrigin[1] << ", " << uncroppedOrigin[2] << std::endl;
+      return false;
+    }
+    int uncroppedExtent[6] = {0,-1,0,-1,0,-1};
+    uncroppedLabelmap->GetExtent(uncroppedExtent);
+    int numberOfVoxels = 0;
+    for (int k=REFERENCE_EXTENT[4]; k<=REFERENCE_EXTENT[5]; ++k)
+    {
+      for (int j=REFERENCE_EXTENT[2]; j<=REFERENCE_EXTENT[3]; ++j)
+      {
+        for (int i=REFERENCE_EXTENT[0]; i<=REFERENCE_EXTENT[1]; ++i)
+        {
+          unsigned char uncroppedValue = (IsInExtent(uncroppedExtent, i, j, k)
+            ? *static_cast<unsigned char*>(uncroppedLabelmap->GetScalarPointer(i, j, k)) : 0);
+          unsigned char croppedValue = (!croppedEmpty && IsInExtent(croppedExtent, i, j, k)
+            ? *static_cast<unsigned char*>(croppedLabelmap->GetScalarPointer(i, j, k)) : 0);
+          if (uncroppedValue != croppedValue)
+          {
+            std::cerr << "ERROR: " << name << ": Voxel (" << i << ", " << j << ", " << k << ") differs: "
+              << (int)uncroppedValue << " without cropping, " << (int)croppedValue << " with cropping" << std::endl;
+            return false;
+          }
+          if (uncroppedValue > 0)
+          {
+            ++numberOfVoxels;
+          }
+        }
+      }
+    }
+    if (numberOfVoxels < expectedMinimumNumberOfVoxels)
+    {
+      std::cerr << "ERROR: " << name << ": Too few label voxels in the reference extent: " << numberOfVoxels
+        << " (expected at least " << expectedMinimumNumberOfVoxels << ")" << std::endl;
+      return false;
+    }
+    std::cout << name << ": " << numberOfVoxels << " label voxels in the reference extent" << std::endl;
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkPolyDataToLabelmapFilterTest1(int vtkNotUsed(argc), char* vtkNotUsed(argv)[])
+{
+  // The sphere volume is about 4190 voxels, a bit less is inside due to the polygonal approximation
+  if (!CompareCroppedAndUncropped("Sphere inside reference", 20.0, 25.0, 24.0, 3900))
+  {
+    return EXIT_FAILURE;
+  }
+  // Only the half of the sphere below i=45 and a thin slab above it is in the reference extent
+  if (!CompareCroppedAndUncropped("Sphere crossing reference boundary", 45.0, 25.0, 24.0, 2000))
+  {
+    return EXIT_FAILURE;
+  }
+  // Nothing is in the reference extent, so the cropped labelmap is empty
+  if (!CompareCroppedAndUncropped("Sphere outside reference", 80.0, 25.0, 24.0, 0))
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Poly data to labelmap filter test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
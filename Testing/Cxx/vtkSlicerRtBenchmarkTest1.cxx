@@ -0,0 +1,971 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRt includes
+#include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtPerformanceMonitor.h"
+#include "vtkLabelmapToModelFilter.h"
+#include "vtkPlanarContourToClosedSurfaceConversionRule.h"
+
+// DoseVolumeHistogram includes
+#include "vtkSlicerDoseVolumeHistogramModuleLogic.h"
+#include "vtkMRMLDoseVolumeHistogramNode.h"
+
+// DoseComparison includes
+#include "vtkSlicerDoseComparisonModuleLogic.h"
+#include "vtkMRMLDoseComparisonNode.h"
+#include "vtkPlanarGammaBatchFilter.h"
+
+// Isodose includes
+#include "vtkSlicerIsodoseModuleLogic.h"
+#include "vtkMRMLIsodoseNode.h"
+
+// SegmentMorphology includes
+#include "vtkSlicerSegmentMorphologyModuleLogic.h"
+#include "vtkMRMLSegmentMorphologyNode.h"
+
+// SegmentComparison includes
+#include "vtkSlicerSegmentComparisonModuleLogic.h"
+#include "vtkMRMLSegmentComparisonNode.h"
+
+// ExternalBeamPlanning includes
+#include "vtkBeamletDoseCalculator.h"
+#include "vtkDoseInfluenceMatrix.h"
+#include "vtkFluenceMapOptimizer.h"
+
+// DicomRtImportExport includes
+#include "vtkSlicerDicomRtReader.h"
+#include "vtkSlicerSyntheticRtStudyGenerator.h"
+
+// Segmentations includes
+#include "vtkMRMLSegmentationNode.h"
+#include "vtkSlicerSegmentationsModuleLogic.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+#include "vtkSegmentationConverter.h"
+#include "vtkSegmentationConverterFactory.h"
+
+// MRML includes
+#include <vtkMRMLColorTableNode.h>
+#include <vtkMRMLModelHierarchyNode.h>
+#include <vtkMRMLScalarVolumeNode.h>
+#include <vtkMRMLScene.h>
+#include <vtkMRMLSubjectHierarchyNode.h>
+#include <vtkMRMLVolumeArchetypeStorageNode.h>
+
+// VTK includes
+#include <vtkExtractVOI.h>
+#include <vtkImageData.h>
+#include <vtkImageTranslateExtent.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkTransform.h>
+#include <vtkVariant.h>
+
+// ITK includes
+#include "itkFactoryRegistration.h"
+
+// VTKSYS includes
+#include <vtksys/Directory.hxx>
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace
+{
+  /// Fastest measurement of one benchmark on one dataset
+  struct BenchmarkResult
+  {
+    std::string Name;
+    std::string Dataset;
+    int UpscaleFactor;
+    double Seconds;
+    double WorkUnits;
+    std::string WorkUnitName;
+
+    /// Processed work units per second
+    double GetThroughput() const
+    {
+      return (this->Seconds > 0.0 ? this->WorkUnits / this->Seconds : 0.0);
+    }
+    /// Key identifying the measurement in the baseline
+    std::string GetKey() const
+    {
+      std::stringstream keyStream;
+      keyStream << this->Name << "," << this->Dataset << "," << this->UpscaleFactor;
+      return keyStream.str();
+    }
+  };
+
+  //-----------------------------------------------------------------------------
+  /// Add measurement to the results. Of the repeated measurements the shortest is kept,
+  /// as it is the least affected by other processes running on the machine
+  void AddMeasurement(std::vector<BenchmarkResult>& results, const std::string& name, const std::string& dataset,
+    int upscaleFactor, double seconds, double workUnits, const std::string& workUnitName)
+  {
+    for (std::vector<BenchmarkResult>::iterator resultIt=results.begin(); resultIt!=results.end(); ++resultIt)
+    {
+      if (resultIt->Name == name && resultIt->Dataset == dataset && resultIt->UpscaleFactor == upscaleFactor)
+      {
+        resultIt->Seconds = std::min(resultIt->Seconds, seconds);
+        return;
+      }
+    }
+
+    BenchmarkResult result;
+    result.Name = name;
+    result.Dataset = dataset;
+    result.UpscaleFactor = upscaleFactor;
+    result.Seconds = seconds;
+    result.WorkUnits = workUnits;
+    result.WorkUnitName = workUnitName;
+    results.push_back(result);
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Read dose volume from file and add it to the scene
+  vtkMRMLScalarVolumeNode* ReadDoseVolume(vtkMRMLScene* scene, const std::string& fileName, double& readSeconds)
+  {
+    vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode> storageNode = vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode>::New();
+    storageNode->SetFileName(fileName.c_str());
+    storageNode->ResetFileNameList();
+    storageNode->SetSingleFile(1);
+
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> volumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    vtkSlicerRtScopedTimer timer("Benchmark.ReadVolume", true);
+    if (!storageNode->ReadData(volumeNode))
+    {
+      std::cerr << "ERROR: Failed to read volume from file " << fileName << std::endl;
+      return NULL;
+    }
+    timer.Stop();
+    readSeconds = timer.GetElapsedSeconds();
+
+    volumeNode->SetName(vtksys::SystemTools::GetFilenameWithoutLastExtension(fileName).c_str());
+    volumeNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_VOLUME_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
+    scene->AddNode(volumeNode);
+    return volumeNode;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Create a synthetic upscaled version of a dose volume by subdividing each voxel along each axis
+  /// and interpolating linearly. The volume is written to file so that reading can also be measured.
+  /// \return Path of the written file, empty string on failure
+  std::string WriteUpscaledDoseVolume(vtkMRMLScene* scene, const std::string& fileName, int upscaleFactor, const std::string& temporaryDirectory)
+  {
+    double readSeconds = 0.0;
+    vtkMRMLScalarVolumeNode* doseVolumeNode = ReadDoseVolume(scene, fileName, readSeconds);
+    if (!doseVolumeNode)
+    {
+      return "";
+    }
+    vtkSmartPointer<vtkOrientedImageData> doseImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
+      vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(doseVolumeNode) );
+    scene->RemoveNode(doseVolumeNode);
+    if (!doseImageData.GetPointer())
+    {
+      std::cerr << "ERROR: Failed to get image data from dose volume " << fileName << std::endl;
+      return "";
+    }
+
+    // Same directions, subdivided spacing and extent. The subdivided voxels need to cover the original voxels,
+    // so the origin (center of the first voxel) moves by half of the new spacing minus half of the old spacing
+    // along each axis: origin' = origin - spacing/2 + spacing'/2
+    vtkSmartPointer<vtkOrientedImageData> upscaledGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+    double directions[3][3] = {{1.0,0.0,0.0},{0.0,1.0,0.0},{0.0,0.0,1.0}};
+    doseImageData->GetDirections(directions);
+    upscaledGeometry->SetDirections(directions);
+    double spacing[3] = {0.0, 0.0, 0.0};
+    doseImageData->GetSpacing(spacing);
+    double upscaledSpacing[3] = { spacing[0]/upscaleFactor, spacing[1]/upscaleFactor, spacing[2]/upscaleFactor };
+    upscaledGeometry->SetSpacing(upscaledSpacing);
+    double upscaledOrigin[3] = {0.0, 0.0, 0.0};
+    doseImageData->GetOrigin(upscaledOrigin);
+    for (int row=0; row<3; ++row)
+    {
+      for (int axis=0; axis<3; ++axis)
+      {
+        upscaledOrigin[row] += directions[row][axis] * (upscaledSpacing[axis] - spacing[axis]) / 2.0;
+      }
+    }
+    upscaledGeometry->SetOrigin(upscaledOrigin);
+    int extent[6] = {0,-1,0,-1,0,-1};
+    doseImageData->GetExtent(extent);
+    upscaledGeometry->SetExtent(
+      extent[0]*upscaleFactor, (extent[1]+1)*upscaleFactor-1,
+      extent[2]*upscaleFactor, (extent[3]+1)*upscaleFactor-1,
+      extent[4]*upscaleFactor, (extent[5]+1)*upscaleFactor-1 );
+
+    vtkSmartPointer<vtkOrientedImageData> upscaledImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(doseImageData, upscaledGeometry, upscaledImageData, true))
+    {
+      std::cerr << "ERROR: Failed to upscale dose volume " << fileName << std::endl;
+      return "";
+    }
+
+    std::stringstream upscaledFileNameStream;
+    upscaledFileNameStream << temporaryDirectory << "/" << vtksys::SystemTools::GetFilenameWithoutLastExtension(fileName)
+      << "_Upscaled" << upscaleFactor << ".nrrd";
+    std::string upscaledFileName = upscaledFileNameStream.str();
+    vtksys::SystemTools::RemoveFile(upscaledFileName.c_str());
+
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> upscaledVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    scene->AddNode(upscaledVolumeNode);
+    vtkSlicerSegmentationsModuleLogic::CopyOrientedImageDataToVolumeNode(upscaledImageData, upscaledVolumeNode);
+    vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode> storageNode = vtkSmartPointer<vtkMRMLVolumeArchetypeStorageNode>::New();
+    storageNode->SetFileName(upscaledFileName.c_str());
+    scene->AddNode(storageNode);
+    upscaledVolumeNode->SetAndObserveStorageNodeID(storageNode->GetID());
+    bool writeSuccessful = (storageNode->WriteData(upscaledVolumeNode) != 0);
+    scene->RemoveNode(storageNode);
+    scene->RemoveNode(upscaledVolumeNode);
+    if (!writeSuccessful)
+    {
+      std::cerr << "ERROR: Failed to write upscaled dose volume to file " << upscaledFileName << std::endl;
+      return "";
+    }
+
+    return upscaledFileName;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Get total size of a segmentation file and the files of its segments, in bytes
+  double GetSegmentationFileSize(const std::string& segmentationFileName)
+  {
+    double fileSize = static_cast<double>(vtksys::SystemTools::FileLength(segmentationFileName.c_str()));
+
+    // Segment files are stored in the directory named as the file without the last extension
+    std::string segmentsDirectoryPath = vtksys::SystemTools::GetFilenamePath(segmentationFileName) + "/"
+      + vtksys::SystemTools::GetFilenameWithoutLastExtension(segmentationFileName);
+    vtksys::Directory segmentsDirectory;
+    if (segmentsDirectory.Load(segmentsDirectoryPath.c_str()))
+    {
+      for (unsigned long fileIndex=0; fileIndex<segmentsDirectory.GetNumberOfFiles(); ++fileIndex)
+      {
+        std::string segmentFilePath = segmentsDirectoryPath + "/" + segmentsDirectory.GetFile(fileIndex);
+        if (!vtksys::SystemTools::FileIsDirectory(segmentFilePath))
+        {
+          fileSize += static_cast<double>(vtksys::SystemTools::FileLength(segmentFilePath.c_str()));
+        }
+      }
+    }
+
+    return fileSize;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Get number of voxels in an image
+  double GetNumberOfVoxels(vtkImageData* imageData)
+  {
+    if (!imageData)
+    {
+      return 0.0;
+    }
+    int* dimensions = imageData->GetDimensions();
+    return static_cast<double>(dimensions[0]) * dimensions[1] * dimensions[2];
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Read results file written by an earlier run
+  /// \return Throughput values by measurement key
+  bool ReadBaseline(const std::string& baselineFileName, std::map<std::string, double>& baselineThroughputs)
+  {
+    std::ifstream baselineFile(baselineFileName.c_str());
+    if (!baselineFile.is_open())
+    {
+      return false;
+    }
+
+    std::string line;
+    std::getline(baselineFile, line); // Header
+    while (std::getline(baselineFile, line))
+    {
+      std::vector<std::string> fields;
+      std::stringstream lineStream(line);
+      std::string field;
+      while (std::getline(lineStream, field, ','))
+      {
+        fields.push_back(field);
+      }
+      if (fields.size() < 7)
+      {
+        continue;
+      }
+      std::string key = fields[0] + "," + fields[1] + "," + fields[2];
+      baselineThroughputs[key] = vtkVariant(fields[6]).ToDouble();
+    }
+
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerRtBenchmarkTest1( int argc, char * argv[] )
+{
+  // Parse arguments. All of them are name-value pairs
+  std::string dataDirectoryPath;
+  std::string temporaryDirectoryPath;
+  std::string upscaleFactorsString("1");
+  int numberOfRepetitions = 3;
+  std::string resultsFileName;
+  std::string performanceMonitorFileName;
+  std::string baselineFileName;
+  double maximumThroughputDropPercent = 20.0;
+  for (int argIndex=1; argIndex+1<argc; argIndex+=2)
+  {
+    if (STRCASECMP(argv[argIndex], "-DataDirectoryPath") == 0)
+    {
+      dataDirectoryPath = argv[argIndex+1];
+    }
+    else if (STRCASECMP(argv[argIndex], "-TemporaryDirectoryPath") == 0)
+    {
+      temporaryDirectoryPath = argv[argIndex+1];
+    }
+    else if (STRCASECMP(argv[argIndex], "-UpscaleFactors") == 0)
+    {
+      upscaleFactorsString = argv[argIndex+1];
+    }
+    else if (STRCASECMP(argv[argIndex], "-NumberOfRepetitions") == 0)
+    {
+      numberOfRepetitions = std::max(1, vtkVariant(argv[argIndex+1]).ToInt());
+    }
+    else if (STRCASECMP(argv[argIndex], "-ResultsFile") == 0)
+    {
+      resultsFileName = argv[argIndex+1];
+    }
+    else if (STRCASECMP(argv[argIndex], "-PerformanceMonitorFile") == 0)
+    {
+      performanceMonitorFileName = argv[argIndex+1];
+    }
+    else if (STRCASECMP(argv[argIndex], "-BaselineFile") == 0)
+    {
+      baselineFileName = argv[argIndex+1];
+    }
+    else if (STRCASECMP(argv[argIndex], "-MaximumThroughputDropPercent") == 0)
+    {
+      maximumThroughputDropPercent = vtkVariant(argv[argIndex+1]).ToDouble();
+    }
+    else
+    {
+      std::cerr << "Invalid argument: " << argv[argIndex] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (dataDirectoryPath.empty() || temporaryDirectoryPath.empty() || resultsFileName.empty())
+  {
+    std::cerr << "Invalid arguments! DataDirectoryPath, TemporaryDirectoryPath and ResultsFile are mandatory" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<int> upscaleFactors;
+  std::stringstream upscaleFactorsStream(upscaleFactorsString);
+  std::string upscaleFactorString;
+  while (std::getline(upscaleFactorsStream, upscaleFactorString, ','))
+  {
+    int upscaleFactor = vtkVariant(upscaleFactorString).ToInt();
+    if (upscaleFactor > 0)
+    {
+      upscaleFactors.push_back(upscaleFactor);
+    }
+  }
+  if (upscaleFactors.empty())
+  {
+    std::cerr << "Invalid upscale factors: " << upscaleFactorsString << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtksys::SystemTools::MakeDirectory(temporaryDirectoryPath.c_str());
+
+  // Collect counters of the instrumented operations too
+  vtkSlicerRtPerformanceMonitor::GetInstance()->Reset();
+  vtkSlicerRtPerformanceMonitor::GetInstance()->EnabledOn();
+
+  // Make sure NRRD reading works
+  itk::itkFactoryRegistration();
+
+  // Register planar contour to closed surface conversion rule
+  vtkSegmentationConverterFactory::GetInstance()->RegisterConverterRule(
+    vtkSmartPointer<vtkPlanarContourToClosedSurfaceConversionRule>::New() );
+
+  // Create scene and logics
+  vtkSmartPointer<vtkMRMLScene> mrmlScene = vtkSmartPointer<vtkMRMLScene>::New();
+  vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(mrmlScene);
+
+  vtkSmartPointer<vtkSlicerSegmentationsModuleLogic> segmentationsLogic = vtkSmartPointer<vtkSlicerSegmentationsModuleLogic>::New();
+  segmentationsLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkSlicerDoseVolumeHistogramModuleLogic> dvhLogic = vtkSmartPointer<vtkSlicerDoseVolumeHistogramModuleLogic>::New();
+  dvhLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkSlicerDoseComparisonModuleLogic> doseComparisonLogic = vtkSmartPointer<vtkSlicerDoseComparisonModuleLogic>::New();
+  doseComparisonLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkSlicerIsodoseModuleLogic> isodoseLogic = vtkSmartPointer<vtkSlicerIsodoseModuleLogic>::New();
+  isodoseLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkSlicerSegmentMorphologyModuleLogic> segmentMorphologyLogic = vtkSmartPointer<vtkSlicerSegmentMorphologyModuleLogic>::New();
+  segmentMorphologyLogic->SetMRMLScene(mrmlScene);
+  vtkSmartPointer<vtkSlicerSegmentComparisonModuleLogic> segmentComparisonLogic = vtkSmartPointer<vtkSlicerSegmentComparisonModuleLogic>::New();
+  segmentComparisonLogic->SetMRMLScene(mrmlScene);
+
+  std::vector<BenchmarkResult> results;
+  const std::string prostateDataset("EclipseProstate");
+  const std::string entDataset("EclipseEnt");
+  const std::string syntheticDataset("Synthetic");
+  const std::string prostateDoseFileName = dataDirectoryPath + "/EclipseProstate_Dose.nrrd";
+  const std::string prostateSegmentationFileName = dataDirectoryPath + "/EclipseProstate_Structures.seg.vtm";
+  const std::string entDay1DoseFileName = dataDirectoryPath + "/EclipseEnt_Dose.nrrd";
+  const std::string entDay2DoseFileName = dataDirectoryPath + "/EclipseEnt_Dose_Day2.nrrd";
+
+  //----------------------------------------------------------------------------
+  // Segmentation reader and planar contour to closed surface conversion (independent of the dose grid)
+  vtkMRMLSegmentationNode* segmentationNode = NULL;
+  double segmentationFileSize = GetSegmentationFileSize(prostateSegmentationFileName);
+  for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+  {
+    if (segmentationNode)
+    {
+      mrmlScene->RemoveNode(segmentationNode);
+    }
+    vtkSlicerRtScopedTimer timer("Benchmark.ReadSegmentation", true);
+    segmentationNode = segmentationsLogic->LoadSegmentationFromFile(prostateSegmentationFileName.c_str());
+    timer.Stop();
+    if (!segmentationNode)
+    {
+      std::cerr << "ERROR: Failed to read segmentation from file " << prostateSegmentationFileName << std::endl;
+      return EXIT_FAILURE;
+    }
+    AddMeasurement(results, "ReadSegmentation", prostateDataset, 1, timer.GetElapsedSeconds(), segmentationFileSize, "bytes");
+  }
+  vtkSegmentation* segmentation = segmentationNode->GetSegmentation();
+  std::vector<std::string> segmentIDs;
+  segmentation->GetSegmentIDs(segmentIDs);
+  if (segmentIDs.size() < 3)
+  {
+    std::cerr << "ERROR: Segmentation " << prostateSegmentationFileName << " is expected to contain at least three segments" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  double numberOfContourPoints = 0.0;
+  for (std::vector<std::string>::iterator segmentIdIt=segmentIDs.begin(); segmentIdIt!=segmentIDs.end(); ++segmentIdIt)
+  {
+    vtkPolyData* planarContour = vtkPolyData::SafeDownCast( segmentation->GetSegment(*segmentIdIt)->GetRepresentation(
+      vtkSegmentationConverter::GetSegmentationPlanarContourRepresentationName() ) );
+    numberOfContourPoints += (planarContour ? planarContour->GetNumberOfPoints() : 0);
+  }
+  for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+  {
+    vtkSlicerRtScopedTimer timer("Benchmark.ContourToSurface", true);
+    if (!segmentation->CreateRepresentation(vtkSegmentationConverter::GetSegmentationClosedSurfaceRepresentationName(), true))
+    {
+      std::cerr << "ERROR: Failed to convert planar contours to closed surface" << std::endl;
+      return EXIT_FAILURE;
+    }
+    timer.Stop();
+    AddMeasurement(results, "ContourToSurface", prostateDataset, 1, timer.GetElapsedSeconds(), numberOfContourPoints, "contour points");
+  }
+
+  //----------------------------------------------------------------------------
+  // Dose grid dependent benchmarks on the original and the upscaled volumes
+  for (std::vector<int>::iterator upscaleFactorIt=upscaleFactors.begin(); upscaleFactorIt!=upscaleFactors.end(); ++upscaleFactorIt)
+  {
+    int upscaleFactor = (*upscaleFactorIt);
+    std::cout << "Running benchmarks with upscale factor " << upscaleFactor << std::endl;
+
+    std::string doseFileName = prostateDoseFileName;
+    std::string day1DoseFileName = entDay1DoseFileName;
+    std::string day2DoseFileName = entDay2DoseFileName;
+    if (upscaleFactor > 1)
+    {
+      doseFileName = WriteUpscaledDoseVolume(mrmlScene, prostateDoseFileName, upscaleFactor, temporaryDirectoryPath);
+      day1DoseFileName = WriteUpscaledDoseVolume(mrmlScene, entDay1DoseFileName, upscaleFactor, temporaryDirectoryPath);
+      day2DoseFileName = WriteUpscaledDoseVolume(mrmlScene, entDay2DoseFileName, upscaleFactor, temporaryDirectoryPath);
+      if (doseFileName.empty() || day1DoseFileName.empty() || day2DoseFileName.empty())
+      {
+        return EXIT_FAILURE;
+      }
+    }
+
+    // Volume reader
+    vtkMRMLScalarVolumeNode* doseVolumeNode = NULL;
+    double doseFileSize = static_cast<double>(vtksys::SystemTools::FileLength(doseFileName.c_str()));
+    for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+    {
+      if (doseVolumeNode)
+      {
+        mrmlScene->RemoveNode(doseVolumeNode);
+      }
+      double readSeconds = 0.0;
+      doseVolumeNode = ReadDoseVolume(mrmlScene, doseFileName, readSeconds);
+      if (!doseVolumeNode)
+      {
+        return EXIT_FAILURE;
+      }
+      AddMeasurement(results, "ReadVolume", prostateDataset, upscaleFactor, readSeconds, doseFileSize, "bytes");
+    }
+    double numberOfDoseVoxels = GetNumberOfVoxels(doseVolumeNode->GetImageData());
+
+    // Dose volume histogram
+    vtkSmartPointer<vtkMRMLDoseVolumeHistogramNode> dvhParameterNode = vtkSmartPointer<vtkMRMLDoseVolumeHistogramNode>::New();
+    mrmlScene->AddNode(dvhParameterNode);
+    dvhParameterNode->SetAndObserveDoseVolumeNode(doseVolumeNode);
+    dvhParameterNode->SetAndObserveSegmentationNode(segmentationNode);
+    for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+    {
+      vtkSlicerRtScopedTimer timer("Benchmark.Dvh", true);
+      std::string errorMessage = dvhLogic->ComputeDvh(dvhParameterNode);
+      timer.Stop();
+      if (!errorMessage.empty())
+      {
+        std::cerr << "ERROR: Failed to compute DVH: " << errorMessage << std::endl;
+        return EXIT_FAILURE;
+      }
+      AddMeasurement(results, "Dvh", prostateDataset, upscaleFactor, timer.GetElapsedSeconds(),
+        numberOfDoseVoxels * segmentIDs.size(), "voxels");
+    }
+
+    // Isodose
+    vtkMRMLColorTableNode* isodoseColorTableNode = vtkSlicerIsodoseModuleLogic::GetDefaultIsodoseColorTable(mrmlScene);
+    if (!isodoseColorTableNode)
+    {
+      std::cerr << "ERROR: Failed to get default isodose color table" << std::endl;
+      return EXIT_FAILURE;
+    }
+    vtkSmartPointer<vtkMRMLIsodoseNode> isodoseParameterNode = vtkSmartPointer<vtkMRMLIsodoseNode>::New();
+    mrmlScene->AddNode(isodoseParameterNode);
+    isodoseParameterNode->SetAndObserveDoseVolumeNode(doseVolumeNode);
+    isodoseParameterNode->SetAndObserveColorTableNode(isodoseColorTableNode);
+    for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+    {
+      // Contour all levels in each repetition instead of taking them from the cache
+      isodoseLogic->ClearIsodoseSurfaceCache();
+      vtkSlicerRtScopedTimer timer("Benchmark.Isodose", true);
+      isodoseLogic->CreateIsodoseSurfaces(isodoseParameterNode);
+      timer.Stop();
+      vtkMRMLModelHierarchyNode* isodoseRootHierarchyNode = isodoseLogic->GetRootModelHierarchyNode(isodoseParameterNode);
+      if ( !isodoseRootHierarchyNode || isodoseRootHierarchyNode->GetNumberOfChildrenNodes() == 0
+        || isodoseLogic->GetLastNumberOfContouredIsodoseLevels() != isodoseColorTableNode->GetNumberOfColors() )
+      {
+        std::cerr << "ERROR: Failed to create isodose surfaces (" << isodoseLogic->GetLastNumberOfContouredIsodoseLevels()
+          << " of " << isodoseColorTableNode->GetNumberOfColors() << " levels contoured)" << std::endl;
+        return EXIT_FAILURE;
+      }
+      AddMeasurement(results, "Isodose", prostateDataset, upscaleFactor, timer.GetElapsedSeconds(),
+        numberOfDoseVoxels * isodoseColorTableNode->GetNumberOfColors(), "voxels");
+    }
+
+    // Segment labelmaps on the (upscaled) dose grid for morphology and Hausdorff distance
+    vtkSmartPointer<vtkOrientedImageData> doseImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
+      vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(doseVolumeNode) );
+    segmentation->SetConversionParameter( vtkSegmentationConverter::GetReferenceImageGeometryParameterName(),
+      vtkSegmentationConverter::SerializeImageGeometry(doseImageData) );
+    if (!segmentation->CreateRepresentation(vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName(), true))
+    {
+      std::cerr << "ERROR: Failed to create binary labelmap representation" << std::endl;
+      return EXIT_FAILURE;
+    }
+    vtkImageData* segmentALabelmap = vtkImageData::SafeDownCast( segmentation->GetSegment(segmentIDs[1])->GetRepresentation(
+      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
+    vtkImageData* segmentBLabelmap = vtkImageData::SafeDownCast( segmentation->GetSegment(segmentIDs[2])->GetRepresentation(
+      vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
+
+    // Morphology (expansion)
+    vtkSmartPointer<vtkMRMLSegmentationNode> morphologyOutputSegmentationNode = vtkSmartPointer<vtkMRMLSegmentationNode>::New();
+    mrmlScene->AddNode(morphologyOutputSegmentationNode);
+    vtkSmartPointer<vtkMRMLSegmentMorphologyNode> morphologyParameterNode = vtkSmartPointer<vtkMRMLSegmentMorphologyNode>::New();
+    mrmlScene->AddNode(morphologyParameterNode);
+    morphologyParameterNode->SetAndObserveSegmentationANode(segmentationNode);
+    morphologyParameterNode->SetSegmentAID(segmentIDs[1].c_str());
+    morphologyParameterNode->SetAndObserveOutputSegmentationNode(morphologyOutputSegmentationNode);
+    morphologyParameterNode->SetOperation(vtkMRMLSegmentMorphologyNode::Expand);
+    morphologyParameterNode->SetXSize(5.0);
+    morphologyParameterNode->SetYSize(5.0);
+    morphologyParameterNode->SetZSize(5.0);
+    for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+    {
+      vtkSlicerRtScopedTimer timer("Benchmark.Morphology", true);
+      std::string errorMessage = segmentMorphologyLogic->ApplyMorphologyOperation(morphologyParameterNode);
+      timer.Stop();
+      if (!errorMessage.empty())
+      {
+        std::cerr << "ERROR: Failed to apply morphology operation: " << errorMessage << std::endl;
+        return EXIT_FAILURE;
+      }
+      AddMeasurement(results, "Morphology", prostateDataset, upscaleFactor, timer.GetElapsedSeconds(),
+        GetNumberOfVoxels(segmentALabelmap), "voxels");
+    }
+
+    // Hausdorff distance
+    vtkSmartPointer<vtkMRMLSegmentComparisonNode> segmentComparisonParameterNode = vtkSmartPointer<vtkMRMLSegmentComparisonNode>::New();
+    mrmlScene->AddNode(segmentComparisonParameterNode);
+    segmentComparisonParameterNode->SetAndObserveReferenceSegmentationNode(segmentationNode);
+    segmentComparisonParameterNode->SetReferenceSegmentID(segmentIDs[1].c_str());
+    segmentComparisonParameterNode->SetAndObserveCompareSegmentationNode(segmentationNode);
+    segmentComparisonParameterNode->SetCompareSegmentID(segmentIDs[2].c_str());
+    for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+    {
+      vtkSlicerRtScopedTimer timer("Benchmark.Hausdorff", true);
+      std::string errorMessage = segmentComparisonLogic->ComputeHausdorffDistances(segmentComparisonParameterNode);
+      timer.Stop();
+      if (!errorMessage.empty())
+      {
+        std::cerr << "ERROR: Failed to compute Hausdorff distances: " << errorMessage << std::endl;
+        return EXIT_FAILURE;
+      }
+      AddMeasurement(results, "Hausdorff", prostateDataset, upscaleFactor, timer.GetElapsedSeconds(),
+        GetNumberOfVoxels(segmentALabelmap) + GetNumberOfVoxels(segmentBLabelmap), "voxels");
+    }
+
+    // Labelmap to model: marching cubes and topology preserving decimation on the whole labelmap (original path),
+    // and flying edges on the label extent with quadric clustering
+    for (int path=0; path<2; ++path)
+    {
+      bool fastPath = (path == 1);
+      std::string benchmarkName = (fastPath ? "LabelmapToModelFast" : "LabelmapToModel");
+      std::string timerName = "Benchmark." + benchmarkName;
+      for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+      {
+        vtkSmartPointer<vtkLabelmapToModelFilter> labelmapToModelFilter = vtkSmartPointer<vtkLabelmapToModelFilter>::New();
+        labelmapToModelFilter->SetInputLabelmap(segmentALabelmap);
+        labelmapToModelFilter->SetLabelValue(1.0);
+        labelmapToModelFilter->SetDecimateTargetReduction(0.5);
+        labelmapToModelFilter->SetUseFlyingEdges(fastPath);
+        labelmapToModelFilter->SetRestrictToLabelExtent(fastPath);
+        labelmapToModelFilter->SetDecimationMethod(fastPath ? vtkLabelmapToModelFilter::QuadricClustering : vtkLabelmapToModelFilter::DecimatePro);
+        vtkSlicerRtScopedTimer timer(timerName.c_str(), true);
+        labelmapToModelFilter->Update();
+        timer.Stop();
+        if (labelmapToModelFilter->GetOutput()->GetNumberOfPolys() == 0)
+        {
+          std::cerr << "ERROR: Failed to create model from labelmap" << std::endl;
+          return EXIT_FAILURE;
+        }
+        AddMeasurement(results, benchmarkName, prostateDataset, upscaleFactor, timer.GetElapsedSeconds(),
+          GetNumberOfVoxels(segmentALabelmap), "voxels");
+        if (repetition == 0)
+        {
+          std::cout << "  " << benchmarkName << ": extraction " << labelmapToModelFilter->GetLastExtractionTime()
+            << " s, decimation " << labelmapToModelFilter->GetLastDecimationTime() << " s, "
+            << labelmapToModelFilter->GetOutput()->GetNumberOfPolys() << " triangles" << std::endl;
+        }
+      }
+    }
+
+    // Dose influence matrix of a coplanar beam arrangement on the voxels of two segments, and fluence map
+    // optimization on it with a uniform dose objective on the first segment and a maximum dose on the second
+    vtkOrientedImageData* segmentAMask = vtkOrientedImageData::SafeDownCast(segmentALabelmap);
+    vtkOrientedImageData* segmentBMask = vtkOrientedImageData::SafeDownCast(segmentBLabelmap);
+    const int numberOfInfluenceBeams = 7;
+    for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+    {
+      vtkSmartPointer<vtkDoseInfluenceMatrix> influenceMatrix = vtkSmartPointer<vtkDoseInfluenceMatrix>::New();
+      vtkSlicerRtScopedTimer timer("Benchmark.InfluenceMatrixBuild", true);
+      influenceMatrix->SetDoseGrid(doseImageData);
+      if ( !segmentAMask || !segmentBMask
+        || !influenceMatrix->AddVoxelsInMask(segmentAMask) || !influenceMatrix->AddVoxelsInMask(segmentBMask)
+        || influenceMatrix->GetNumberOfVoxels() == 0 )
+      {
+        std::cerr << "ERROR: Failed to add segment voxels to the dose influence matrix" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      // Isocenter is the center of the voxels of interest, beams are evenly distributed around it
+      double isocenter[3] = { 0.0, 0.0, 0.0 };
+      for (vtkIdType row=0; row<influenceMatrix->GetNumberOfVoxels(); ++row)
+      {
+        double position[3] = { 0.0, 0.0, 0.0 };
+        influenceMatrix->GetVoxelPosition(row, position);
+        isocenter[0] += position[0];
+        isocenter[1] += position[1];
+        isocenter[2] += position[2];
+      }
+      for (int i=0; i<3; ++i)
+      {
+        isocenter[i] /= influenceMatrix->GetNumberOfVoxels();
+      }
+      vtkSmartPointer<vtkBeamletDoseCalculator> beamletDoseCalculator = vtkSmartPointer<vtkBeamletDoseCalculator>::New();
+      const double jaws[4] = { -40.0, 40.0, -40.0, 40.0 };
+      for (int beamIndex=0; beamIndex<numberOfInfluenceBeams; ++beamIndex)
+      {
+        vtkSmartPointer<vtkTransform> beamToWorldTransform = vtkSmartPointer<vtkTransform>::New();
+        beamToWorldTransform->Translate(isocenter);
+        beamToWorldTransform->RotateZ(360.0 * beamIndex / numberOfInfluenceBeams);
+        beamToWorldTransform->RotateX(90.0);
+        std::stringstream beamIdStream;
+        beamIdStream << "Beam" << beamIndex;
+        if (beamletDoseCalculator->AddBeam(influenceMatrix, beamIdStream.str().c_str(), beamToWorldTransform->GetMatrix(), 1000.0, jaws) < 0)
+        {
+          std::cerr << "ERROR: Failed to compute beamlet doses" << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+      influenceMatrix->Finalize();
+      timer.Stop();
+      AddMeasurement(results, "InfluenceMatrixBuild", prostateDataset, upscaleFactor, timer.GetElapsedSeconds(),
+        influenceMatrix->GetNumberOfNonZeros(), "nonzeros");
+
+      vtkSmartPointer<vtkFluenceMapOptimizer> fluenceMapOptimizer = vtkSmartPointer<vtkFluenceMapOptimizer>::New();
+      fluenceMapOptimizer->SetInfluenceMatrix(influenceMatrix);
+      fluenceMapOptimizer->AddObjective(segmentAMask, vtkFluenceMapOptimizer::UniformDose, 70.0, 1.0);
+      fluenceMapOptimizer->AddObjective(segmentBMask, vtkFluenceMapOptimizer::MaximumDose, 40.0, 0.5);
+      fluenceMapOptimizer->SetMaximumNumberOfIterations(50);
+      vtkSlicerRtScopedTimer optimizationTimer("Benchmark.FluenceOptimization", true);
+      if (!fluenceMapOptimizer->Optimize())
+      {
+        std::cerr << "ERROR: Fluence map optimization failed" << std::endl;
+        return EXIT_FAILURE;
+      }
+      optimizationTimer.Stop();
+      // Mean time of an iteration, including the products computed before the first one
+      AddMeasurement(results, "FluenceOptimizationIteration", prostateDataset, upscaleFactor,
+        optimizationTimer.GetElapsedSeconds() / std::max(fluenceMapOptimizer->GetLastNumberOfIterations(), 1),
+        influenceMatrix->GetNumberOfNonZeros(), "nonzeros");
+      if (repetition == 0)
+      {
+        std::cout << "  InfluenceMatrix: " << influenceMatrix->GetNumberOfVoxels() << " voxels, "
+          << influenceMatrix->GetNumberOfBeamlets() << " beamlets, " << influenceMatrix->GetNumberOfNonZeros() << " nonzeros, "
+          << influenceMatrix->GetMemorySizeMB() << " MB; optimization " << fluenceMapOptimizer->GetLastNumberOfIterations()
+          << " iterations, objective " << fluenceMapOptimizer->GetLastObjectiveValue() << std::endl;
+      }
+    }
+
+    // Gamma dose comparison
+    double readSeconds = 0.0;
+    vtkMRMLScalarVolumeNode* day1DoseVolumeNode = ReadDoseVolume(mrmlScene, day1DoseFileName, readSeconds);
+    vtkMRMLScalarVolumeNode* day2DoseVolumeNode = ReadDoseVolume(mrmlScene, day2DoseFileName, readSeconds);
+    if (!day1DoseVolumeNode || !day2DoseVolumeNode)
+    {
+      return EXIT_FAILURE;
+    }
+    vtkSmartPointer<vtkMRMLScalarVolumeNode> gammaVolumeNode = vtkSmartPointer<vtkMRMLScalarVolumeNode>::New();
+    mrmlScene->AddNode(gammaVolumeNode);
+    vtkSmartPointer<vtkMRMLDoseComparisonNode> doseComparisonParameterNode = vtkSmartPointer<vtkMRMLDoseComparisonNode>::New();
+    mrmlScene->AddNode(doseComparisonParameterNode);
+    doseComparisonParameterNode->SetAndObserveReferenceDoseVolumeNode(day1DoseVolumeNode);
+    doseComparisonParameterNode->SetAndObserveCompareDoseVolumeNode(day2DoseVolumeNode);
+    doseComparisonParameterNode->SetAndObserveGammaVolumeNode(gammaVolumeNode);
+    doseComparisonParameterNode->UseNativeGammaEngineOn();
+    for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+    {
+      vtkSlicerRtScopedTimer timer("Benchmark.Gamma", true);
+      std::string errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(doseComparisonParameterNode);
+      timer.Stop();
+      if (!errorMessage.empty())
+      {
+        std::cerr << "ERROR: Failed to compute gamma: " << errorMessage << std::endl;
+        return EXIT_FAILURE;
+      }
+      AddMeasurement(results, "Gamma", entDataset, upscaleFactor, timer.GetElapsedSeconds(),
+        GetNumberOfVoxels(day1DoseVolumeNode->GetImageData()), "voxels");
+    }
+
+    // Planar gamma batch: each slice of the day 1 dose is compared to the next slice moved into its plane,
+    // similar to comparing a batch of portal images against predicted images
+    vtkSmartPointer<vtkOrientedImageData> day1ImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
+      vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(day1DoseVolumeNode) );
+    vtkSmartPointer<vtkPlanarGammaBatchFilter> planarGammaFilter = vtkSmartPointer<vtkPlanarGammaBatchFilter>::New();
+    planarGammaFilter->SetAnalysisThresholdPercent(10.0);
+    double day1Directions[3][3] = {{1.0, 0.0, 0.0}, {0.0, 1.0, 0.0}, {0.0, 0.0, 1.0}};
+    day1ImageData->GetDirections(day1Directions);
+    int day1Extent[6] = {0, -1, 0, -1, 0, -1};
+    day1ImageData->GetExtent(day1Extent);
+    double numberOfPlanarPixels = 0.0;
+    for (int slice=day1Extent[4]; slice<day1Extent[5]; ++slice)
+    {
+      vtkSmartPointer<vtkExtractVOI> extractReference = vtkSmartPointer<vtkExtractVOI>::New();
+      extractReference->SetInputData(day1ImageData);
+      extractReference->SetVOI(day1Extent[0], day1Extent[1], day1Extent[2], day1Extent[3], slice, slice);
+      extractReference->Update();
+      vtkSmartPointer<vtkOrientedImageData> referenceSlice = vtkSmartPointer<vtkOrientedImageData>::New();
+      referenceSlice->ShallowCopy(extractReference->GetOutput());
+      referenceSlice->SetDirections(day1Directions);
+
+      vtkSmartPointer<vtkExtractVOI> extractCompare = vtkSmartPointer<vtkExtractVOI>::New();
+      extractCompare->SetInputData(day1ImageData);
+      extractCompare->SetVOI(day1Extent[0], day1Extent[1], day1Extent[2], day1Extent[3], slice+1, slice+1);
+      vtkSmartPointer<vtkImageTranslateExtent> moveCompare = vtkSmartPointer<vtkImageTranslateExtent>::New();
+      moveCompare->SetInputConnection(extractCompare->GetOutputPort());
+      moveCompare->SetTranslation(0, 0, -1);
+      moveCompare->Update();
+      vtkSmartPointer<vtkOrientedImageData> compareSlice = vtkSmartPointer<vtkOrientedImageData>::New();
+      compareSlice->ShallowCopy(moveCompare->GetOutput());
+      compareSlice->SetOrigin(referenceSlice->GetOrigin());
+      compareSlice->SetDirections(day1Directions);
+
+      planarGammaFilter->AddImagePair(referenceSlice, compareSlice);
+      numberOfPlanarPixels += GetNumberOfVoxels(referenceSlice);
+    }
+    for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+    {
+      vtkSlicerRtScopedTimer timer("Benchmark.PlanarGammaBatch", true);
+      bool success = planarGammaFilter->Update();
+      timer.Stop();
+      if (!success)
+      {
+        std::cerr << "ERROR: Failed to compute planar gamma batch" << std::endl;
+        return EXIT_FAILURE;
+      }
+      AddMeasurement(results, "PlanarGammaBatch", entDataset, upscaleFactor, timer.GetElapsedSeconds(),
+        numberOfPlanarPixels, "pixels");
+      if (repetition == 0)
+      {
+        std::cout << "  PlanarGammaBatch: " << planarGammaFilter->GetNumberOfImagePairs() << " image pairs, "
+          << planarGammaFilter->GetTotalNumberOfAnalyzedPixels() << " analyzed pixels" << std::endl;
+      }
+    }
+
+    // Release volumes of this upscale factor before the next one
+    mrmlScene->RemoveNode(doseComparisonParameterNode);
+    mrmlScene->RemoveNode(gammaVolumeNode);
+    mrmlScene->RemoveNode(day1DoseVolumeNode);
+    mrmlScene->RemoveNode(day2DoseVolumeNode);
+    mrmlScene->RemoveNode(segmentComparisonParameterNode);
+    mrmlScene->RemoveNode(morphologyParameterNode);
+    mrmlScene->RemoveNode(morphologyOutputSegmentationNode);
+    mrmlScene->RemoveNode(isodoseParameterNode);
+    mrmlScene->RemoveNode(dvhParameterNode);
+    mrmlScene->RemoveNode(doseVolumeNode);
+
+    // Synthetic DICOM RT study: the number of CT slices and structures grows with the upscale factor.
+    // Each study is written into its own directory, so that only its files are loaded
+    std::string syntheticStudyDirectoryPath = temporaryDirectoryPath + "/SyntheticStudy_" + vtkVariant(upscaleFactor).ToString();
+    vtksys::SystemTools::MakeDirectory(syntheticStudyDirectoryPath.c_str());
+    vtkSmartPointer<vtkSlicerSyntheticRtStudyGenerator> syntheticStudyGenerator = vtkSmartPointer<vtkSlicerSyntheticRtStudyGenerator>::New();
+    syntheticStudyGenerator->SetOutputDirectory(syntheticStudyDirectoryPath.c_str());
+    int* syntheticImageDimensions = syntheticStudyGenerator->GetImageDimensions();
+    syntheticStudyGenerator->SetImageDimensions(syntheticImageDimensions[0], syntheticImageDimensions[1], 100 * upscaleFactor);
+    syntheticStudyGenerator->SetNumberOfStructures(20 * upscaleFactor);
+    double numberOfSyntheticImageVoxels = static_cast<double>(syntheticImageDimensions[0]) * syntheticImageDimensions[1] * syntheticImageDimensions[2];
+    {
+      vtkSlicerRtScopedTimer timer("Benchmark.GenerateSyntheticStudy", true);
+      bool success = syntheticStudyGenerator->Write();
+      timer.Stop();
+      if (!success)
+      {
+        std::cerr << "ERROR: Failed to generate synthetic study to " << syntheticStudyDirectoryPath << std::endl;
+        return EXIT_FAILURE;
+      }
+      AddMeasurement(results, "GenerateSyntheticStudy", syntheticDataset, upscaleFactor, timer.GetElapsedSeconds(),
+        numberOfSyntheticImageVoxels, "voxels");
+    }
+    for (int repetition=0; repetition<numberOfRepetitions; ++repetition)
+    {
+      vtkSlicerRtScopedTimer timer("Benchmark.LoadSyntheticStructureSet", true);
+      vtkSmartPointer<vtkSlicerDicomRtReader> structureSetReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
+      structureSetReader->SetFileName(syntheticStudyGenerator->GetStructureSetFilePath());
+      structureSetReader->Update();
+      timer.Stop();
+      if ( !structureSetReader->GetLoadRTStructureSetSuccessful()
+        || structureSetReader->GetNumberOfRois() != syntheticStudyGenerator->GetNumberOfStructures() )
+      {
+        std::cerr << "ERROR: Failed to load synthetic structure set " << syntheticStudyGenerator->GetStructureSetFilePath() << std::endl;
+        return EXIT_FAILURE;
+      }
+      double numberOfSyntheticContourPoints = 0.0;
+      for (int roiIndex=0; roiIndex<structureSetReader->GetNumberOfRois(); ++roiIndex)
+      {
+        vtkPolyData* roiPolyData = structureSetReader->GetRoiPolyData(roiIndex);
+        numberOfSyntheticContourPoints += (roiPolyData ? roiPolyData->GetNumberOfPoints() : 0);
+      }
+      AddMeasurement(results, "LoadSyntheticStructureSet", syntheticDataset, upscaleFactor, timer.GetElapsedSeconds(),
+        numberOfSyntheticContourPoints, "contour points");
+
+      vtkSlicerRtScopedTimer planTimer("Benchmark.LoadSyntheticPlan", true);
+      vtkSmartPointer<vtkSlicerDicomRtReader> planReader = vtkSmartPointer<vtkSlicerDicomRtReader>::New();
+      planReader->SetFileName(syntheticStudyGenerator->GetPlanFilePath());
+      planReader->Update();
+      planTimer.Stop();
+      if (!planReader->GetLoadRTPlanSuccessful() || planReader->GetNumberOfBeams() != syntheticStudyGenerator->GetNumberOfBeams())
+      {
+        std::cerr << "ERROR: Failed to load synthetic plan " << syntheticStudyGenerator->GetPlanFilePath() << std::endl;
+        return EXIT_FAILURE;
+      }
+      AddMeasurement(results, "LoadSyntheticPlan", syntheticDataset, upscaleFactor, planTimer.GetElapsedSeconds(),
+        syntheticStudyGenerator->GetNumberOfBeams() * syntheticStudyGenerator->GetNumberOfControlPoints(), "control points");
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Write results
+  std::ofstream resultsFile(resultsFileName.c_str());
+  if (!resultsFile.is_open())
+  {
+    std::cerr << "ERROR: Failed to open results file " << resultsFileName << std::endl;
+    return EXIT_FAILURE;
+  }
+  resultsFile << "Benchmark,Dataset,UpscaleFactor,Seconds,WorkUnits,WorkUnitName,Throughput" << std::endl;
+  for (std::vector<BenchmarkResult>::iterator resultIt=results.begin(); resultIt!=results.end(); ++resultIt)
+  {
+    resultsFile << resultIt->GetKey() << "," << resultIt->Seconds << "," << resultIt->WorkUnits << ","
+      << resultIt->WorkUnitName << "," << resultIt->GetThroughput() << std::endl;
+    std::cout << resultIt->Name << " (" << resultIt->Dataset << ", upscale " << resultIt->UpscaleFactor << "): "
+      << resultIt->Seconds << " s, " << resultIt->GetThroughput() << " " << resultIt->WorkUnitName << "/s" << std::endl;
+  }
+  resultsFile.close();
+  std::cout << "Benchmark results written to " << resultsFileName << std::endl;
+
+  if (!performanceMonitorFileName.empty())
+  {
+    vtkSlicerRtPerformanceMonitor::GetInstance()->WriteStatisticsAsJson(performanceMonitorFileName.c_str());
+  }
+  vtkSlicerRtPerformanceMonitor::GetInstance()->EnabledOff();
+
+  //----------------------------------------------------------------------------
+  // Compare throughput to baseline
+  if (baselineFileName.empty())
+  {
+    std::cout << "No baseline is specified, regression check skipped" << std::endl;
+    return EXIT_SUCCESS;
+  }
+  std::map<std::string, double> baselineThroughputs;
+  if (!ReadBaseline(baselineFileName, baselineThroughputs))
+  {
+    std::cerr << "ERROR: Failed to read baseline file " << baselineFileName << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int numberOfRegressions = 0;
+  for (std::vector<BenchmarkResult>::iterator resultIt=results.begin(); resultIt!=results.end(); ++resultIt)
+  {
+    std::map<std::string, double>::iterator baselineIt = baselineThroughputs.find(resultIt->GetKey());
+    if (baselineIt == baselineThroughputs.end() || baselineIt->second <= 0.0)
+    {
+      std::cout << "No baseline for " << resultIt->GetKey() << std::endl;
+      continue;
+    }
+    double throughputDropPercent = 100.0 * (1.0 - resultIt->GetThroughput() / baselineIt->second);
+    if (throughputDropPercent > maximumThroughputDropPercent)
+    {
+      std::cerr << "ERROR: Throughput of " << resultIt->GetKey() << " dropped by " << throughputDropPercent
+        << "% (" << resultIt->GetThroughput() << " vs. baseline " << baselineIt->second << " " << resultIt->WorkUnitName
+        << "/s), more than the allowed " << maximumThroughputDropPercent << "%" << std::endl;
+      ++numberOfRegressions;
+    }
+  }
+  if (numberOfRegressions > 0)
+  {
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Throughput of all benchmarks is within " << maximumThroughputDropPercent << "% of the baseline" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,268 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRt includes
+#include "vtkSlicerRtPerformanceMonitor.h"
+
+// VTK includes
+#include <vtkNew.h>
+#include <vtkStringArray.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+namespace
+{
+  const char* OUTER_OPERATION = "PerformanceMonitorTest.Outer";
+  const char* INNER_OPERATION = "PerformanceMonitorTest.Inner";
+
+  /// Trace event read back from the written trace file
+  struct TraceEvent
+  {
+    std::string Name;
+    double StartMicroseconds;
+    double DurationMicroseconds;
+  };
+
+  //-----------------------------------------------------------------------------
+  double GetJsonNumber(const std::string& line, const std::string& key)
+  {
+    std::string searchString = "\"" + key + "\": ";
+    size_t position = line.find(searchString);
+    if (position == std::string::npos)
+    {
+      return -1.0;
+    }
+    std::stringstream valueStream(line.substr(position + searchString.size()));
+    double value = -1.0;
+    valueStream >> value;
+    return value;
+  }
+
+  //-----------------------------------------------------------------------------
+  /// Read events from a trace written by \sa vtkSlicerRtPerformanceMonitor::WriteChromeTrace (one event per line)
+  bool ReadTraceEvents(const std::string& fileName, std::vector<TraceEvent>& events)
+  {
+    std::ifstream file(fileName.c_str());
+    if (!file.is_open())
+    {
+      return false;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+      if (line.find("\"ph\": \"X\"") == std::string::npos)
+      {
+        continue;
+      }
+      size_t nameBegin = line.find("\"name\": \"") + 9;
+      size_t nameEnd = line.find('"', nameBegin);
+      TraceEvent event;
+      event.Name = line.substr(nameBegin, nameEnd - nameBegin);
+      event.StartMicroseconds = GetJsonNumber(line, "ts");
+      event.DurationMicroseconds = GetJsonNumber(line, "dur");
+      events.push_back(event);
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  bool CheckContains(const std::string& text, const std::string& expected)
+  {
+    if (text.find(expected) == std::string::npos)
+    {
+      std::cerr << "ERROR: Statistics report does not contain '" << expected << "':\n" << text << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerRtPerformanceMonitorTest1(int argc, char* argv[])
+{
+  int argIndex = 1;
+
+  // TemporaryDirectoryPath
+  const char* temporaryDirectoryPath = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-TemporaryDirectoryPath") == 0)
+    {
+      temporaryDirectoryPath = argv[argIndex+1];
+      std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+      argIndex += 2;
+    }
+  }
+  if (!temporaryDirectoryPath)
+  {
+    std::cerr << "Invalid arguments! Usage: vtkSlicerRtPerformanceMonitorTest1 -TemporaryDirectoryPath <path>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtksys::SystemTools::MakeDirectory(temporaryDirectoryPath);
+
+  vtkSlicerRtPerformanceMonitor* monitor = vtkSlicerRtPerformanceMonitor::GetInstance();
+  monitor->Reset();
+
+  // Nothing is recorded while disabled, and the timers only measure if asked to
+  monitor->EnabledOff();
+  {
+    vtkSlicerRtScopedTimer timer(OUTER_OPERATION);
+    vtkSlicerRtScopedTimer measuringTimer(INNER_OPERATION, true);
+    vtkSlicerRtPerformanceMonitor::AddToCounter(INNER_OPERATION, "Items", 1.0);
+    vtksys::SystemTools::Delay(10);
+    if (timer.GetElapsedSeconds() != 0.0 || measuringTimer.GetElapsedSeconds() <= 0.0)
+    {
+      std::cerr << "ERROR: Invalid elapsed time of timers while monitoring is disabled: "
+        << timer.GetElapsedSeconds() << ", " << measuringTimer.GetElapsedSeconds() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  vtkNew<vtkStringArray> operationNames;
+  monitor->GetOperationNames(operationNames.GetPointer());
+  if (operationNames->GetNumberOfValues() != 0 || monitor->GetNumberOfTraceEvents() != 0)
+  {
+    std::cerr << "ERROR: Measurements were recorded while monitoring is disabled" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Nested timers: one outer operation containing two inner ones
+  monitor->EnabledOn();
+  double outerElapsedSeconds = 0.0;
+  {
+    vtkSlicerRtScopedTimer outerTimer(OUTER_OPERATION);
+    for (int callIndex=0; callIndex<2; ++callIndex)
+    {
+      vtkSlicerRtScopedTimer innerTimer(INNER_OPERATION);
+      vtkSlicerRtPerformanceMonitor::AddToCounter(INNER_OPERATION, "Items", 5.0);
+      vtksys::SystemTools::Delay(20);
+      innerTimer.Stop();
+      innerTimer.Stop(); // Only the first stop is recorded
+    }
+    outerElapsedSeconds = outerTimer.GetElapsedSeconds();
+  }
+
+  if (monitor->GetNumberOfCalls(OUTER_OPERATION) != 1 || monitor->GetNumberOfCalls(INNER_OPERATION) != 2)
+  {
+    std::cerr << "ERROR: Invalid number of calls: outer " << monitor->GetNumberOfCalls(OUTER_OPERATION)
+      << " (expected 1), inner " << monitor->GetNumberOfCalls(INNER_OPERATION) << " (expected 2)" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (monitor->GetCounterValue(INNER_OPERATION, "Items") != 10.0)
+  {
+    std::cerr << "ERROR: Invalid counter value: " << monitor->GetCounterValue(INNER_OPERATION, "Items") << " (expected 10)" << std::endl;
+    return EXIT_FAILURE;
+  }
+  double innerTotalSeconds = monitor->GetTotalTimeSeconds(INNER_OPERATION);
+  double outerTotalSeconds = monitor->GetTotalTimeSeconds(OUTER_OPERATION);
+  if ( monitor->GetMinimumTimeSeconds(INNER_OPERATION) < 0.015
+    || monitor->GetMinimumTimeSeconds(INNER_OPERATION) > monitor->GetMaximumTimeSeconds(INNER_OPERATION)
+    || innerTotalSeconds > outerTotalSeconds || outerTotalSeconds < outerElapsedSeconds
+    || fabs(monitor->GetMeanTimeSeconds(INNER_OPERATION) - innerTotalSeconds / 2.0) > 1e-9 )
+  {
+    std::cerr << "ERROR: Inconsistent durations: inner total " << innerTotalSeconds << " s (min "
+      << monitor->GetMinimumTimeSeconds(INNER_OPERATION) << " s, max " << monitor->GetMaximumTimeSeconds(INNER_OPERATION)
+      << " s), outer total " << outerTotalSeconds << " s" << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (monitor->GetProcessMaxRssMB(OUTER_OPERATION) < 0.0)
+  {
+    std::cerr << "ERROR: Invalid process max RSS: " << monitor->GetProcessMaxRssMB(OUTER_OPERATION) << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Statistics report
+  std::string statistics = monitor->GetStatisticsAsJson();
+  if ( !CheckContains(statistics, std::string("\"name\": \"") + OUTER_OPERATION + "\"")
+    || !CheckContains(statistics, std::string("\"name\": \"") + INNER_OPERATION + "\"")
+    || !CheckContains(statistics, "\"calls\": 2,")
+    || !CheckContains(statistics, "\"counters\": {\"Items\": 10}")
+    || !CheckContains(statistics, "\"processMaxRssMB\": ") )
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Trace: the inner events are within the outer one, in the order of the calls
+  std::string traceFileName = std::string(temporaryDirectoryPath) + "/PerformanceMonitorTestTrace.json";
+  if (!monitor->WriteChromeTrace(traceFileName.c_str()))
+  {
+    std::cerr << "ERROR: Failed to write trace file " << traceFileName << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::vector<TraceEvent> events;
+  if (!ReadTraceEvents(traceFileName, events) || events.size() != 3)
+  {
+    std::cerr << "ERROR: Invalid number of events in trace file " << traceFileName << ": " << events.size() << " (expected 3)" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Events are recorded when the timers stop, so the outer one is the last
+  const TraceEvent& outerEvent = events[2];
+  const double toleranceMicroseconds = 1.0; // Trace is written with 0.1 microsecond precision
+  for (int eventIndex=0; eventIndex<2; ++eventIndex)
+  {
+    const TraceEvent& innerEvent = events[eventIndex];
+    if ( innerEvent.Name != INNER_OPERATION || outerEvent.Name != OUTER_OPERATION
+      || innerEvent.StartMicroseconds < outerEvent.StartMicroseconds - toleranceMicroseconds
+      || innerEvent.StartMicroseconds + innerEvent.DurationMicroseconds
+         > outerEvent.StartMicroseconds + outerEvent.DurationMicroseconds + toleranceMicroseconds )
+    {
+      std::cerr << "ERROR: Inner event " << eventIndex << " (" << innerEvent.Name << ", " << innerEvent.StartMicroseconds
+        << "+" << innerEvent.DurationMicroseconds << " us) is not within the outer event (" << outerEvent.Name << ", "
+        << outerEvent.StartMicroseconds << "+" << outerEvent.DurationMicroseconds << " us)" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if (events[0].StartMicroseconds + events[0].DurationMicroseconds > events[1].StartMicroseconds + toleranceMicroseconds)
+  {
+    std::cerr << "ERROR: Inner events overlap in the trace" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Trace events beyond the maximum are only aggregated
+  monitor->SetMaximumNumberOfTraceEvents(3);
+  {
+    vtkSlicerRtScopedTimer timer(INNER_OPERATION);
+  }
+  monitor->SetMaximumNumberOfTraceEvents(100000);
+  if (monitor->GetNumberOfTraceEvents() != 3 || monitor->GetNumberOfCalls(INNER_OPERATION) != 3)
+  {
+    std::cerr << "ERROR: Invalid number of trace events (" << monitor->GetNumberOfTraceEvents()
+      << ", expected 3) or calls (" << monitor->GetNumberOfCalls(INNER_OPERATION) << ", expected 3)" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  monitor->Reset();
+  monitor->EnabledOff();
+  if (monitor->GetNumberOfCalls(OUTER_OPERATION) != 0 || monitor->GetNumberOfTraceEvents() != 0)
+  {
+    std::cerr << "ERROR: Measurements were not cleared by reset" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Performance monitor test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
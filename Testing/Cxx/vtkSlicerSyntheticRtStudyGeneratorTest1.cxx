@@ -0,0 +1,197 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// DicomRtImportExport includes
+#include "vtkSlicerDicomRtReader.h"
+#include "vtkSlicerSyntheticRtStudyGenerator.h"
+
+// VTK includes
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <iostream>
+#include <string>
+
+namespace
+{
+  // Small study that is quick to write and load
+  const int NUMBER_OF_SLICES = 10;
+  const int NUMBER_OF_STRUCTURES = 3;
+  const int NUMBER_OF_BEAMS = 2;
+
+  //----------------------------------------------------------------------------
+  bool CheckWrittenFile(const char* name, const char* filePath)
+  {
+    if (!filePath || !vtksys::SystemTools::FileExists(filePath, true))
+    {
+      std::cerr << "ERROR: Generated " << name << " file " << (filePath ? filePath : "NULL") << " does not exist" << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  /// Write the study, and check that all files are written and they can be loaded as a consistent study
+  bool GenerateAndLoadStudy(vtkSlicerSyntheticRtStudyGenerator* generator)
+  {
+    if (!generator->Write())
+    {
+      std::cerr << "ERROR: Failed to generate synthetic study to " << generator->GetOutputDirectory() << std::endl;
+      return false;
+    }
+    if ( !CheckWrittenFile("structure set", generator->GetStructureSetFilePath())
+      || !CheckWrittenFile("dose", generator->GetDoseFilePath())
+      || !CheckWrittenFile("plan", generator->GetPlanFilePath()) )
+    {
+      return false;
+    }
+    if (generator->GetNumberOfImageFiles() != NUMBER_OF_SLICES)
+    {
+      std::cerr << "ERROR: Invalid number of CT slice files: " << generator->GetNumberOfImageFiles()
+        << " (expected " << NUMBER_OF_SLICES << ")" << std::endl;
+      return false;
+    }
+
+    vtkNew<vtkSlicerDicomRtReader> structureSetReader;
+    structureSetReader->SetFileName(generator->GetStructureSetFilePath());
+    structureSetReader->Update();
+    if (!structureSetReader->GetLoadRTStructureSetSuccessful() || structureSetReader->GetNumberOfRois() != NUMBER_OF_STRUCTURES)
+    {
+      std::cerr << "ERROR: Failed to load structure set, or invalid number of structures: "
+        << structureSetReader->GetNumberOfRois() << " (expected " << NUMBER_OF_STRUCTURES << ")" << std::endl;
+      return false;
+    }
+    for (int roiIndex=0; roiIndex<NUMBER_OF_STRUCTURES; ++roiIndex)
+    {
+      vtkPolyData* roiPolyData = structureSetReader->GetRoiPolyData(roiIndex);
+      if (!roiPolyData || roiPolyData->GetNumberOfPoints() == 0)
+      {
+        std::cerr << "ERROR: Structure " << roiIndex << " has no contours" << std::endl;
+        return false;
+      }
+    }
+
+    vtkNew<vtkSlicerDicomRtReader> doseReader;
+    doseReader->SetFileName(generator->GetDoseFilePath());
+    doseReader->Update();
+    if (!doseReader->GetLoadRTDoseSuccessful())
+    {
+      std::cerr << "ERROR: Failed to load dose" << std::endl;
+      return false;
+    }
+
+    vtkNew<vtkSlicerDicomRtReader> planReader;
+    planReader->SetFileName(generator->GetPlanFilePath());
+    planReader->Update();
+    if (!planReader->GetLoadRTPlanSuccessful() || planReader->GetNumberOfBeams() != NUMBER_OF_BEAMS)
+    {
+      std::cerr << "ERROR: Failed to load plan, or invalid number of beams: "
+        << planReader->GetNumberOfBeams() << " (expected " << NUMBER_OF_BEAMS << ")" << std::endl;
+      return false;
+    }
+
+    // All objects are in the generated study, and the plan references the structure set and dose of this run
+    const char* studyInstanceUid = generator->GetStudyInstanceUid();
+    vtkSlicerDicomRtReader* readers[3] = { structureSetReader.GetPointer(), doseReader.GetPointer(), planReader.GetPointer() };
+    for (int readerIndex=0; readerIndex<3; ++readerIndex)
+    {
+      if (!studyInstanceUid || !readers[readerIndex]->GetStudyInstanceUid()
+        || std::string(readers[readerIndex]->GetStudyInstanceUid()) != studyInstanceUid)
+      {
+        std::cerr << "ERROR: Loaded object " << readerIndex << " is not in the generated study "
+          << (studyInstanceUid ? studyInstanceUid : "NULL") << std::endl;
+        return false;
+      }
+    }
+    if ( !planReader->GetRTPlanReferencedStructureSetSOPInstanceUID() || !structureSetReader->GetSOPInstanceUID()
+      || std::string(planReader->GetRTPlanReferencedStructureSetSOPInstanceUID()) != structureSetReader->GetSOPInstanceUID() )
+    {
+      std::cerr << "ERROR: Plan does not reference the generated structure set" << std::endl;
+      return false;
+    }
+    if ( !planReader->GetRTPlanReferencedDoseSOPInstanceUIDs() || !doseReader->GetSOPInstanceUID()
+      || std::string(planReader->GetRTPlanReferencedDoseSOPInstanceUIDs()) != doseReader->GetSOPInstanceUID() )
+    {
+      std::cerr << "ERROR: Plan does not reference the generated dose" << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+}
+
+//-----------------------------------------------------------------------------
+int vtkSlicerSyntheticRtStudyGeneratorTest1(int argc, char* argv[])
+{
+  int argIndex = 1;
+
+  // TemporaryDirectoryPath
+  const char* temporaryDirectoryPath = NULL;
+  if (argc > argIndex+1)
+  {
+    if (STRCASECMP(argv[argIndex], "-TemporaryDirectoryPath") == 0)
+    {
+      temporaryDirectoryPath = argv[argIndex+1];
+      std::cout << "Temporary directory path: " << temporaryDirectoryPath << std::endl;
+      argIndex += 2;
+    }
+  }
+  if (!temporaryDirectoryPath)
+  {
+    std::cerr << "Invalid arguments! Usage: vtkSlicerSyntheticRtStudyGeneratorTest1 -TemporaryDirectoryPath <path>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtksys::SystemTools::MakeDirectory(temporaryDirectoryPath);
+
+  vtkNew<vtkSlicerSyntheticRtStudyGenerator> generator;
+  generator->SetOutputDirectory(temporaryDirectoryPath);
+  generator->SetImageDimensions(32, 32, NUMBER_OF_SLICES);
+  generator->SetImageSpacing(2.0, 2.0, 2.0);
+  generator->SetDoseSpacing(4.0, 4.0, 4.0);
+  generator->SetNumberOfStructures(NUMBER_OF_STRUCTURES);
+  generator->SetNumberOfContourPoints(8);
+  generator->SetNumberOfBeams(NUMBER_OF_BEAMS);
+  generator->SetNumberOfControlPoints(3);
+  generator->SetNumberOfLeafPairs(4);
+  if (!GenerateAndLoadStudy(generator.GetPointer()))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Generate again into the same directory: the new study is found among the files of the earlier one
+  std::string firstStudyInstanceUid(generator->GetStudyInstanceUid());
+  generator->SetRandomSeed(2);
+  if (!GenerateAndLoadStudy(generator.GetPointer()))
+  {
+    return EXIT_FAILURE;
+  }
+  if (firstStudyInstanceUid == generator->GetStudyInstanceUid())
+  {
+    std::cerr << "ERROR: Second generated study has the same study instance UID as the first one" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Synthetic RT study generator test passed" << std::endl;
+  return EXIT_SUCCESS;
+}